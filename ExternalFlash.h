@@ -0,0 +1,437 @@
+/**
+ *  @file       ExternalFlash.h
+ *
+ *  @brief      DataFlash Module public interface.
+ *  @details    Instances are declared in EXTERNAL_FLASH_MAP (ExternalFlash_prv.h), optional features are enabled
+ *              there with the EXTERNAL_FLASH_*_FEATURE defines.
+ *
+ *              Shared instances: the modules built on the driver address the device directly through the instance of
+ *              their client channel, got from ExternalFlash__GetAllocation without a mirror. The objects of one module
+ *              on the same channel share that instance: the module registers its event handler once per instance and,
+ *              as the instance runs one operation at a time, starts again from its handler task the requests rejected
+ *              while it was busy.
+ *
+ *  @author     Marco Di Goro
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+#ifndef EXTERNALFLASH_H_
+#define EXTERNALFLASH_H_
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "C_Extensions.h"
+#include "Callback.h"
+#include "ExternalFlash_prv.h"
+
+//-------------------------------------- PUBLIC (Variables, Constants & Defines) --------------------------------------
+
+//! EXTERNAL_FLASH_TIMESTAMP_US(): free running microsecond timestamp, wrapping at 32 bit, to be defined by the
+//! application in ExternalFlash_prv.h, e.g. from a free running hardware timer, as SystemTimers has no microsecond time
+//! base. It times the chip completion model and the handler scheduling, the write combining and scrub delays, and the
+//! statistics, trace and capture timestamps.
+
+//! Write combining: writes are accumulated in the chip SRAM buffer 1 and the buffered page is programmed only when
+//! a write or read touches another page, after EXTERNAL_FLASH_WRITE_COMBINE_TIMEOUT_MS without writes, or on
+//! ExternalFlash__Flush. The write callback then only means the data reached the chip buffer.
+#ifndef EXTERNAL_FLASH_WRITE_COMBINE_FEATURE
+#define EXTERNAL_FLASH_WRITE_COMBINE_FEATURE        DISABLED
+#endif
+
+//! Time without writes after which the buffered page is programmed
+#ifndef EXTERNAL_FLASH_WRITE_COMBINE_TIMEOUT_MS
+#define EXTERNAL_FLASH_WRITE_COMBINE_TIMEOUT_MS     (100)
+#endif
+
+//! Per instance statistics (operation counters, latency histograms)
+#ifndef EXTERNAL_FLASH_STATS_FEATURE
+#define EXTERNAL_FLASH_STATS_FEATURE                DISABLED
+#endif
+
+//! Latency histogram buckets: bucket 0 counts latencies below 1 us, bucket n latencies in [2^(n-1), 2^n) us,
+//! the last bucket everything above
+#define EXTERNAL_FLASH_STATS_LATENCY_BUCKETS        (24)
+
+//! External Flash instance statistics struct type
+typedef struct EXTERNAL_FLASH_STATS_STRUCT
+{
+    uint32_t                    Reads;                      // Completed read requests
+    uint32_t                    Writes;                     // Completed write requests
+    uint32_t                    Page_Writes;                // Page programs issued
+    uint32_t                    Page_Erases;                // Page erases issued, including the built-in erase of page writes
+    uint32_t                    Buffer_Writes;              // (Partial) page writes combined in the chip buffer
+    uint32_t                    Buffer_Reads;               // Reads served from a chip buffer instead of the main memory
+    uint32_t                    Bytes_Read;
+    uint32_t                    Bytes_Written;
+    uint32_t                    Busy_Polls;                 // Status register reads that found the chip busy
+    uint32_t                    Busy_Wait_Us;               // Time spent waiting for the chip to become ready
+    uint32_t                    Late_Transfers;             // Bus transfers completed after EXTERNAL_FLASH_WAIT_TIMEOUT_MS
+    uint32_t                    Retries;                    // Bus transactions that could not be started and were retried
+    uint32_t                    Crc_Errors;                 // Whole page reads not matching the page CRC
+    uint32_t                    Scrub_Bytes;                // Bytes read by the background scrub
+    uint32_t                    Scrub_Repairs;              // Pages rewritten by the background scrub
+    uint32_t                    Read_Latency[EXTERNAL_FLASH_STATS_LATENCY_BUCKETS];     // Submit to callback
+    uint32_t                    Write_Latency[EXTERNAL_FLASH_STATS_LATENCY_BUCKETS];    // Submit to callback
+} EXTERNAL_FLASH_STATS_TYPE;
+
+//! State transition trace (ring buffers of state changes and bus events)
+#ifndef EXTERNAL_FLASH_TRACE_FEATURE
+#define EXTERNAL_FLASH_TRACE_FEATURE                DISABLED
+#endif
+
+//! Entries of each trace ring, must be a power of two
+#ifndef EXTERNAL_FLASH_TRACE_SIZE
+#define EXTERNAL_FLASH_TRACE_SIZE                   (64)
+#endif
+
+//! Trace block marker, "EFTR" in a little endian dump
+#define EXTERNAL_FLASH_TRACE_MAGIC                  (0x52544645UL)
+
+//! Trace entry types
+typedef enum EXTERNAL_FLASH_TRACE_EVENT_ENUM
+{
+    EXTERNAL_FLASH_TRACE_EVENT_STATE,                       // NVM_State change
+    EXTERNAL_FLASH_TRACE_EVENT_BUS,                         // Bus transfer completed
+    EXTERNAL_FLASH_TRACE_EVENT_NUM
+} EXTERNAL_FLASH_TRACE_EVENT_TYPE;
+
+//! Trace rings, one per writing context so that each ring has a single writer and needs no lock
+typedef enum EXTERNAL_FLASH_TRACE_CONTEXT_ENUM
+{
+    EXTERNAL_FLASH_TRACE_CONTEXT_TASK,                      // Handler task and client calls
+    EXTERNAL_FLASH_TRACE_CONTEXT_BUS,                       // Bus event handler (interrupt)
+    EXTERNAL_FLASH_TRACE_CONTEXT_NUM
+} EXTERNAL_FLASH_TRACE_CONTEXT_TYPE;
+
+//! Trace entry struct type
+typedef struct EXTERNAL_FLASH_TRACE_ENTRY_STRUCT
+{
+    uint32_t                    Timestamp_Us;
+    uint8_t                     Event;                      // EXTERNAL_FLASH_TRACE_EVENT_TYPE
+    uint8_t                     Instance;
+    uint8_t                     Old_State;
+    uint8_t                     New_State;                  // Same as Old_State for bus events
+    uint8_t                     Process;                    // NVM_Current_Process after the event
+    uint8_t                     Reserved;
+    uint16_t                    Progress;                   // NVM_Buffer_Progress
+} EXTERNAL_FLASH_TRACE_ENTRY_TYPE;
+
+//! Trace ring struct type
+typedef struct EXTERNAL_FLASH_TRACE_RING_STRUCT
+{
+    uint32_t                    Head;                       // Entries ever written, the oldest is Entry[Head % SIZE] once wrapped
+    EXTERNAL_FLASH_TRACE_ENTRY_TYPE Entry[EXTERNAL_FLASH_TRACE_SIZE];
+} EXTERNAL_FLASH_TRACE_RING_TYPE;
+
+//! Trace block struct type, dumped as is and decoded by Host/ExternalFlashTraceDecode
+typedef struct EXTERNAL_FLASH_TRACE_STRUCT
+{
+    uint32_t                    Magic;                      // EXTERNAL_FLASH_TRACE_MAGIC
+    uint16_t                    Size;                       // EXTERNAL_FLASH_TRACE_SIZE
+    uint16_t                    Ring_Num;                   // EXTERNAL_FLASH_TRACE_CONTEXT_NUM
+    EXTERNAL_FLASH_TRACE_RING_TYPE  Ring[EXTERNAL_FLASH_TRACE_CONTEXT_NUM];
+} EXTERNAL_FLASH_TRACE_TYPE;
+
+//! Capture of the public calls (I/O workload trace) for replay on the host
+#ifndef EXTERNAL_FLASH_CAPTURE_FEATURE
+#define EXTERNAL_FLASH_CAPTURE_FEATURE              DISABLED
+#endif
+
+//! Size of the RAM capture buffer, used unless the application streams the records through EXTERNAL_FLASH_CAPTURE_SINK
+#ifndef EXTERNAL_FLASH_CAPTURE_SIZE
+#define EXTERNAL_FLASH_CAPTURE_SIZE                 (4096)
+#endif
+
+//! Capture stream marker, "EFCP" in the stream, followed by the format version byte
+#define EXTERNAL_FLASH_CAPTURE_MAGIC                (0x50434645UL)
+#define EXTERNAL_FLASH_CAPTURE_VERSION              (1)
+
+//! Capture record types
+//! Every record is: type (1 byte), time since the previous record in us (varint), then by type:
+//! - ALLOCATION: client id (1), mirror used (1), instance offset (varint), allocated instance (1)
+//! - READ/WRITE: instance (1), address (varint), size (varint), accepted (1)
+//! - COMPLETE: instance (1), callback event value (varint)
+//! - FLUSH: same as READ/WRITE, address and size 0
+//! - PROGRAM/ERASE/WRITE_PAGES: same as READ/WRITE
+//! - READ_SPARE/SCAN_ERASED: same as READ/WRITE, the size is the number of pages
+//! Varints are LEB128: 7 bits per byte, least significant first, bit 7 set on all bytes but the last.
+typedef enum EXTERNAL_FLASH_CAPTURE_RECORD_ENUM
+{
+    EXTERNAL_FLASH_CAPTURE_RECORD_ALLOCATION,
+    EXTERNAL_FLASH_CAPTURE_RECORD_READ,
+    EXTERNAL_FLASH_CAPTURE_RECORD_WRITE,
+    EXTERNAL_FLASH_CAPTURE_RECORD_COMPLETE,
+    EXTERNAL_FLASH_CAPTURE_RECORD_FLUSH,
+    EXTERNAL_FLASH_CAPTURE_RECORD_PROGRAM,
+    EXTERNAL_FLASH_CAPTURE_RECORD_ERASE,
+    EXTERNAL_FLASH_CAPTURE_RECORD_WRITE_PAGES,
+    EXTERNAL_FLASH_CAPTURE_RECORD_READ_SPARE,
+    EXTERNAL_FLASH_CAPTURE_RECORD_SCAN_ERASED,
+    EXTERNAL_FLASH_CAPTURE_RECORD_NUM
+} EXTERNAL_FLASH_CAPTURE_RECORD_TYPE;
+
+//! Gather transfers: the bus provider chains a 32 bit address phase (sent MSB first) and the data of a Read/Write in
+//! one transfer. The command header (opcode + 3 address bytes) then travels as the address phase of the payload
+//! transfer, saving a bus event and a handler turn per page.
+//! Reads then use the Continuous Array Read without dummy byte (0x03), specified only up to the low frequency SPI clock
+//! of the part (fCAR2 in the datasheet): the bus provider of a gather instance must not clock the SPI faster.
+#ifndef EXTERNAL_FLASH_GATHER_FEATURE
+#define EXTERNAL_FLASH_GATHER_FEATURE               DISABLED
+#endif
+
+//! Typical chip operation times, initial values of the completion timing model refined on each status poll, and bus
+//! rate, used to estimate the time to idle (ExternalFlash__GetTimeToIdle)
+#ifndef EXTERNAL_FLASH_PAGE_ERASE_PROGRAM_US
+#define EXTERNAL_FLASH_PAGE_ERASE_PROGRAM_US        (9000)          // tEP, read-modify-write and buffer commit
+#endif
+#ifndef EXTERNAL_FLASH_PAGE_PROGRAM_US
+#define EXTERNAL_FLASH_PAGE_PROGRAM_US              (1500)          // tP
+#endif
+#ifndef EXTERNAL_FLASH_PAGE_ERASE_US
+#define EXTERNAL_FLASH_PAGE_ERASE_US                (7000)          // tPE
+#endif
+#ifndef EXTERNAL_FLASH_BLOCK_ERASE_US
+#define EXTERNAL_FLASH_BLOCK_ERASE_US               (25000)         // tBE
+#endif
+#ifndef EXTERNAL_FLASH_BUFFER_TRANSFER_US
+#define EXTERNAL_FLASH_BUFFER_TRANSFER_US           (200)           // tXFR, page to buffer
+#endif
+#ifndef EXTERNAL_FLASH_BUS_BYTES_PER_MS
+#define EXTERNAL_FLASH_BUS_BYTES_PER_MS             (1250)          // 10 MHz SPI clock
+#endif
+
+//! Physical chips behind the instances of EXTERNAL_FLASH_MAP, one for each distinct (bus provider, bus channel) pair.
+//! The state kept per chip (page CRCs, erased page map, scrub and blank check buffers) is allocated this many times:
+//! set it to the actual chip count when several instances share a chip.
+#ifndef EXTERNAL_FLASH_CHIP_NUM
+#define EXTERNAL_FLASH_CHIP_NUM                     EXTERNAL_FLASH_CH_NUM
+#endif
+
+//! Page integrity: the driver keeps the CRC-32 of each device page in RAM, updated by the writes, programs and erases
+//! it issues, and checks it on every read covering whole pages. A page partially written by ExternalFlash__Write, or
+//! programmed where it was not known erased, has no CRC until it is read whole again. Mismatches are reported by
+//! ExternalFlash__CheckIntegrity.
+//! The CRCs are not stored in the flash: they are learned again by the first whole page reads after each reset, so the
+//! check only covers changes of a page within one power cycle, not a corruption happened while the device was off.
+//! RAM cost: 4 bytes and 1 bit per page of EXTERNAL_FLASH_MAX_PAGE_NUMBER on each of the EXTERNAL_FLASH_CHIP_NUM chips,
+//! e.g. 33 KB for one chip of 8192 pages, 66 KB for two.
+#ifndef EXTERNAL_FLASH_INTEGRITY_FEATURE
+#define EXTERNAL_FLASH_INTEGRITY_FEATURE            DISABLED
+#endif
+
+//! CRC-32 of the page integrity check and of ExternalFlash__GetCrc computed with slicing-by-8 tables (8 KB of RAM,
+//! built at initialization) instead of the 64 byte nibble table
+#ifndef EXTERNAL_FLASH_INTEGRITY_SLICING_FEATURE
+#define EXTERNAL_FLASH_INTEGRITY_SLICING_FEATURE    DISABLED
+#endif
+
+//! Background scrub, requires EXTERNAL_FLASH_INTEGRITY_FEATURE: while the chip is idle the handler reads the whole
+//! device, EXTERNAL_FLASH_SCRUB_SIZE bytes at a time within EXTERNAL_FLASH_SCRUB_BYTES_PER_S, checking the page CRCs.
+//! A page failing its CRC is read again: if it then matches it is rewritten with the good data, otherwise the error is
+//! reported by ExternalFlash__CheckIntegrity to all the instances of the chip. Client requests are rejected while a
+//! scrub step runs, as for any other busy instance.
+//! The scrub never learns a CRC from what it reads, a page degraded since before the reset would pass. On chips with a
+//! spare area (EXTERNAL_FLASH_SPARE_FEATURE) each page is checked against the CRC stored in its metadata and written
+//! back with its metadata; otherwise the CRCs kept in RAM are lost at reset and only the pages written, programmed or
+//! erased by the driver since then are checked.
+//! RAM cost on each of the EXTERNAL_FLASH_CHIP_NUM chips: a buffer of EXTERNAL_FLASH_SCRUB_SIZE bytes, one page of
+//! EXTERNAL_FLASH_MAX_PAGE_SIZE at least, and 1 bit per page of EXTERNAL_FLASH_MAX_PAGE_NUMBER, e.g. 2 KB for 1 KB
+//! steps on 8192 pages.
+#ifndef EXTERNAL_FLASH_SCRUB_FEATURE
+#define EXTERNAL_FLASH_SCRUB_FEATURE                DISABLED
+#endif
+
+//! Scrub read bandwidth
+#ifndef EXTERNAL_FLASH_SCRUB_BYTES_PER_S
+#define EXTERNAL_FLASH_SCRUB_BYTES_PER_S            (1024)
+#endif
+
+//! Bytes read by each scrub step, rounded down to whole pages of the chip, one page at least
+#ifndef EXTERNAL_FLASH_SCRUB_SIZE
+#define EXTERNAL_FLASH_SCRUB_SIZE                   (1024)
+#endif
+
+//! Erased page map: the driver keeps a bitmap of the device pages known erased, set by the erases and cleared by any
+//! write or program to the page. ExternalFlash__ScanErased fills it for a range of pages from a blank check run in the
+//! background, EXTERNAL_FLASH_BLANK_SCAN_SIZE bytes at a time with continuous array reads, and ExternalFlash__IsErased
+//! answers from it without any bus access. Without write combining ExternalFlash__Write programs pages known erased
+//! instead of erasing them again.
+//! RAM cost on each of the EXTERNAL_FLASH_CHIP_NUM chips: 1 bit per page of EXTERNAL_FLASH_MAX_PAGE_NUMBER and a buffer
+//! of EXTERNAL_FLASH_BLANK_SCAN_SIZE bytes, one page of EXTERNAL_FLASH_MAX_PAGE_SIZE at least, e.g. 3 KB for 2 KB steps
+//! on 8192 pages.
+#ifndef EXTERNAL_FLASH_BLANK_FEATURE
+#define EXTERNAL_FLASH_BLANK_FEATURE                DISABLED
+#endif
+
+//! Bytes read by each blank check step, rounded down to whole pages of the chip, one page at least
+#ifndef EXTERNAL_FLASH_BLANK_SCAN_SIZE
+#define EXTERNAL_FLASH_BLANK_SCAN_SIZE              (2048)
+#endif
+
+//! Process of the event notifying the end of an ExternalFlash__ScanErased, COMBINE_BYTES(process, 0): past the
+//! NVDATA_PROCESS_TYPE values, so that it is not taken for the completion of a read
+#define EXTERNAL_FLASH_PROCESS_SCAN_COMPLETE        (0x80)
+
+//! RDY/BUSY pin: instances with ExternalFlash_Ready_Feature enabled in EXTERNAL_FLASH_MAP read the pin through
+//! GENERIC_IO_HANDLERS instead of polling the status register over the bus, and the bus is not taken while the pin
+//! reports busy. Boards with the pin on an interrupt line call ExternalFlash__ReadyPinInterrupt from its rising edge,
+//! so the driver resumes at once instead of on its next period.
+#ifndef EXTERNAL_FLASH_READY_PIN_FEATURE
+#define EXTERNAL_FLASH_READY_PIN_FEATURE            DISABLED
+#endif
+
+//! Predictive completion: the driver does not poll a chip its timing model expects still busy, and schedules its
+//! handler for the first millisecond after the expected end of each program, erase or transfer instead of waiting for
+//! the next EXTERNAL_FLASH_HANDLER_PERIOD_MS period.
+#ifndef EXTERNAL_FLASH_PREDICTIVE_FEATURE
+#define EXTERNAL_FLASH_PREDICTIVE_FEATURE           DISABLED
+#endif
+
+//! Device detection: each chip is identified at initialization from its JEDEC ID (manufacturer and device id) and its
+//! page size configuration (status register), and its geometry taken from the AT45DB table, 1 to 64 Mbit. Without
+//! detection, or for an unknown part, the chip is the EXTERNAL_FLASH_DEVICE_ID part. The AT45DB642D and AT45DB641E share
+//! the device id 0x28, detection tells them apart from the extended device information length (0 and 1); without
+//! detection 0x28 is the AT45DB642D. The 32768 pages of the AT45DB641E are used up to EXTERNAL_FLASH_MAX_PAGE_NUMBER.
+#ifndef EXTERNAL_FLASH_DETECT_FEATURE
+#define EXTERNAL_FLASH_DETECT_FEATURE               DISABLED
+#endif
+
+//! Device id (JEDEC device id 1) of the populated part, or the default one with detection: 0x22 AT45DB011 ... 0x28 AT45DB641
+#ifndef EXTERNAL_FLASH_DEVICE_ID
+#define EXTERNAL_FLASH_DEVICE_ID                    (0x23)
+#endif
+
+//! Page size configuration of the populated part without detection: ENABLED for binary pages (256, 512, 1024 bytes),
+//! DISABLED for the DataFlash pages (264, 528, 1056 bytes)
+#ifndef EXTERNAL_FLASH_DEVICE_BINARY_PAGE
+#define EXTERNAL_FLASH_DEVICE_BINARY_PAGE           ENABLED
+#endif
+
+//! Geometry of the EXTERNAL_FLASH_DEVICE_ID part, the binary page size as a power of two
+#if (EXTERNAL_FLASH_DEVICE_ID == 0x22)
+#define EXTERNAL_FLASH_DEVICE_PAGE_NUMBER           (512)
+#define EXTERNAL_FLASH_DEVICE_PAGE_BITS             (8)
+#elif (EXTERNAL_FLASH_DEVICE_ID == 0x23)
+#define EXTERNAL_FLASH_DEVICE_PAGE_NUMBER           (1024)
+#define EXTERNAL_FLASH_DEVICE_PAGE_BITS             (8)
+#elif (EXTERNAL_FLASH_DEVICE_ID == 0x24)
+#define EXTERNAL_FLASH_DEVICE_PAGE_NUMBER           (2048)
+#define EXTERNAL_FLASH_DEVICE_PAGE_BITS             (8)
+#elif (EXTERNAL_FLASH_DEVICE_ID == 0x25)
+#define EXTERNAL_FLASH_DEVICE_PAGE_NUMBER           (4096)
+#define EXTERNAL_FLASH_DEVICE_PAGE_BITS             (8)
+#elif (EXTERNAL_FLASH_DEVICE_ID == 0x26)
+#define EXTERNAL_FLASH_DEVICE_PAGE_NUMBER           (4096)
+#define EXTERNAL_FLASH_DEVICE_PAGE_BITS             (9)
+#elif (EXTERNAL_FLASH_DEVICE_ID == 0x27)
+#define EXTERNAL_FLASH_DEVICE_PAGE_NUMBER           (8192)
+#define EXTERNAL_FLASH_DEVICE_PAGE_BITS             (9)
+#elif (EXTERNAL_FLASH_DEVICE_ID == 0x28)
+#define EXTERNAL_FLASH_DEVICE_PAGE_NUMBER           (8192)
+#define EXTERNAL_FLASH_DEVICE_PAGE_BITS             (10)
+#else
+#error "EXTERNAL_FLASH_DEVICE_ID is not an AT45DB part"
+#endif
+
+//! Page spare area: on chips with DataFlash pages the instances address the binary part of each page only (256, 512,
+//! 1024 bytes) and the page_size / 32 extra bytes hold the page metadata, EXTERNAL_FLASH_SPARE_TYPE. Whole pages written
+//! by ExternalFlash__WritePages carry their metadata in the same transfer and page program, ExternalFlash__ReadSpare
+//! reads the metadata only, e.g. to mount without reading the data. Reads are split at the page boundaries, to skip the
+//! spare areas. Chips with binary pages have no spare area.
+//! The metadata of every page is either erased or matches its data and carries its erase count: on such chips
+//! ExternalFlash__Write reads each page and its metadata into a RAM buffer of EXTERNAL_FLASH_MAX_PAGE_SIZE + 8 bytes
+//! per chip, merges the new data and writes the whole page with its metadata, keeping its sequence and logical page.
+//! ExternalFlash__Program does the same on pages with metadata, and stays a plain program of pages with erased
+//! metadata, which keep it erased, so that appending to such pages never erases their older data. ExternalFlash__Erase
+//! erases the metadata too.
+#ifndef EXTERNAL_FLASH_SPARE_FEATURE
+#define EXTERNAL_FLASH_SPARE_FEATURE                DISABLED
+#endif
+
+//! Page size and byte address bits of the EXTERNAL_FLASH_DEVICE_ID part, a DataFlash page has 1/32 more bytes, the
+//! spare area when EXTERNAL_FLASH_SPARE_FEATURE is enabled
+#if (EXTERNAL_FLASH_DEVICE_BINARY_PAGE == ENABLED)
+#define EXTERNAL_FLASH_DEVICE_PAGE_SIZE             (1 << EXTERNAL_FLASH_DEVICE_PAGE_BITS)
+#define EXTERNAL_FLASH_DEVICE_SPARE_SIZE            (0)
+#define EXTERNAL_FLASH_DEVICE_BYTE_BITS             (EXTERNAL_FLASH_DEVICE_PAGE_BITS)
+#elif (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+#define EXTERNAL_FLASH_DEVICE_PAGE_SIZE             (1 << EXTERNAL_FLASH_DEVICE_PAGE_BITS)
+#define EXTERNAL_FLASH_DEVICE_SPARE_SIZE            (1 << (EXTERNAL_FLASH_DEVICE_PAGE_BITS - 5))
+#define EXTERNAL_FLASH_DEVICE_BYTE_BITS             (EXTERNAL_FLASH_DEVICE_PAGE_BITS + 1)
+#else
+#define EXTERNAL_FLASH_DEVICE_PAGE_SIZE             (33 << (EXTERNAL_FLASH_DEVICE_PAGE_BITS - 5))
+#define EXTERNAL_FLASH_DEVICE_SPARE_SIZE            (0)
+#define EXTERNAL_FLASH_DEVICE_BYTE_BITS             (EXTERNAL_FLASH_DEVICE_PAGE_BITS + 1)
+#endif
+
+//! Largest device supported, sizes the per page and per chip tables; larger parts are used up to this many pages,
+//! a power of two
+#if (EXTERNAL_FLASH_DETECT_FEATURE == ENABLED)
+#ifndef EXTERNAL_FLASH_MAX_PAGE_NUMBER
+#define EXTERNAL_FLASH_MAX_PAGE_NUMBER              (8192)
+#endif
+#ifndef EXTERNAL_FLASH_MAX_PAGE_SIZE
+#define EXTERNAL_FLASH_MAX_PAGE_SIZE                (1056)
+#endif
+#else
+#ifndef EXTERNAL_FLASH_MAX_PAGE_NUMBER
+#define EXTERNAL_FLASH_MAX_PAGE_NUMBER              EXTERNAL_FLASH_DEVICE_PAGE_NUMBER
+#endif
+#ifndef EXTERNAL_FLASH_MAX_PAGE_SIZE
+#define EXTERNAL_FLASH_MAX_PAGE_SIZE                EXTERNAL_FLASH_DEVICE_PAGE_SIZE
+#endif
+#endif
+
+//! Chip geometry struct type
+typedef struct EXTERNAL_FLASH_GEOMETRY_STRUCT
+{
+    uint8_t                     Jedec_Id[4];                // Manufacturer id, device id 1, device id 2, extended info length
+    uint8_t                     Byte_Bits;                  // Byte address bits of the command address, page address above
+    uint16_t                    Page_Size;                  // Bytes
+    uint16_t                    Page_Num;
+    uint16_t                    Block_Size;                 // Bytes erased by a block erase
+    uint16_t                    Spare_Size;                 // Bytes of the page spare area, 0 if none
+} EXTERNAL_FLASH_GEOMETRY_TYPE;
+
+//! Page metadata struct type, at the start of the page spare area; 0xFF bytes on an erased page
+//! The CRC is kept to 16 bits so that the metadata fits the 8 byte spare area of the 256 byte page parts, the smallest:
+//! a full CRC-32 would leave room for one more 16 bit field only. The CRC is a check against corruption, not against
+//! tampering: a randomly corrupted page goes undetected with probability 2^-16, about 1 in 65536.
+//! The RAM page CRCs of EXTERNAL_FLASH_INTEGRITY_FEATURE are full CRC-32, and a module needing a stronger check can
+//! keep the ExternalFlash__GetCrc of its data in the page data.
+typedef struct EXTERNAL_FLASH_SPARE_STRUCT
+{
+    uint16_t                    Crc;                        // Low 16 bits of ExternalFlash__GetCrc of the page data, set by the driver
+    uint16_t                    Sequence;                   // Given for all the pages written together
+    uint16_t                    Logical_Page;               // Given for the first page written, +1 for each next page
+    uint16_t                    Erase_Count;                // Writes of the page since its metadata was erased, set by the driver
+} EXTERNAL_FLASH_SPARE_TYPE;
+
+//-------------------------------------- PUBLIC (Function Prototypes) -------------------------------------------------
+
+void ExternalFlash__Initialize(void);
+void ExternalFlash__Handler(void);
+BOOL_TYPE ExternalFlash__Read(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size);
+BOOL_TYPE ExternalFlash__Write(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size);
+BOOL_TYPE ExternalFlash__Program(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size);
+BOOL_TYPE ExternalFlash__Erase(uint8_t instance_id, uint32_t data_address, uint16_t size);
+BOOL_TYPE ExternalFlash__Flush(uint8_t instance_id);
+uint8_t ExternalFlash__GetAllocation(uint8_t client_id, void* mirror_pointer, uint16_t nv_instance_offset);
+void ExternalFlash__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value);
+void ExternalFlash__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler);
+BOOL_TYPE ExternalFlash__IsBusy(uint8_t externalflash_instance);
+uint32_t ExternalFlash__GetTimeToIdle(uint8_t instance_id);
+BOOL_TYPE ExternalFlash__GetGeometry(uint8_t instance_id, EXTERNAL_FLASH_GEOMETRY_TYPE* geometry);
+BOOL_TYPE ExternalFlash__WritePages(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size, const EXTERNAL_FLASH_SPARE_TYPE* spare);
+BOOL_TYPE ExternalFlash__ReadSpare(uint8_t instance_id, EXTERNAL_FLASH_SPARE_TYPE* spare, uint32_t data_address, uint16_t page_num);
+BOOL_TYPE ExternalFlash__ScanErased(uint8_t instance_id, uint32_t data_address, uint16_t page_num);
+BOOL_TYPE ExternalFlash__IsErased(uint8_t instance_id, uint32_t data_address, uint16_t size);
+void ExternalFlash__ReadyPinInterrupt(void);
+BOOL_TYPE ExternalFlash__CheckIntegrity(uint8_t flash_instance);
+BOOL_TYPE ExternalFlash__GetStats(uint8_t instance_id, EXTERNAL_FLASH_STATS_TYPE* stats);
+void ExternalFlash__ResetStats(uint8_t instance_id);
+const EXTERNAL_FLASH_TRACE_TYPE* ExternalFlash__GetTrace(void);
+const uint8_t* ExternalFlash__GetCapture(uint32_t* size, uint32_t* dropped);
+uint32_t ExternalFlash__GetCrc(uint32_t crc, const void* data, uint16_t size);
+
+#endif /* EXTERNALFLASH_H_ */
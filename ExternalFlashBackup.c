@@ -27,21 +27,73 @@
 //! Define the callback control structure module static variable
 DEFINE_CALLBACK_CONTROL_STRUCTURE(ExternalFlash_Callback_Control_Structure, EXTERNAL_FLASH_CALLBACK_REGISTERS_SIZE);
 
-//! FLASH Instance info
-#define EXTERNAL_FLASH_PAGE_SIZE_256
-
-#define SECTOR_NUM 8
+//! Pages erased by a block erase, on all the AT45DB parts
+#define EXTERNAL_FLASH_BLOCK_PAGES                  (8)
 
+#if ((EXTERNAL_FLASH_MAX_PAGE_NUMBER & (EXTERNAL_FLASH_MAX_PAGE_NUMBER - 1)) != 0)
+#error "EXTERNAL_FLASH_MAX_PAGE_NUMBER must be a power of two"
+#endif
 
-#ifdef EXTERNAL_FLASH_PAGE_SIZE_256
-#define EXTERNAL_FLASH_PAGE_SIZE                256
-#define EXTERNAL_FLASH_PAGE_NUMBER              1024
-#define EXTERNAL_FLASH_NUMBER_OF_BYTES EXTERNAL_FLASH_PAGE_SIZE * EXTERNAL_FLASH_PAGE_NUMBER 
-#define EXTERNAL_FLASH_PAGE_ADDRESS_BIT         10
-#define EXTERNAL_FLASH_PAGE_ADDRESS_BYTE        2
-#define EXTERNAL_FLASH_PAGE_BYTE_ADDRESS_BIT    8
-#define EXTERNAL_FLASH_PAGE_BYTE_ADDRESS_BYTE   1 
+//! FLASH Instance info, geometry of the chip of the instance
+#if (EXTERNAL_FLASH_DETECT_FEATURE == ENABLED)
+#define EXTERNAL_FLASH_PAGE_SIZE(instance_id)       (ExternalFlash_Chip[ExternalFlash_Instance_Chip[(instance_id)]].Geometry.Page_Size)
+#define EXTERNAL_FLASH_PAGE_NUMBER(instance_id)     (ExternalFlash_Chip[ExternalFlash_Instance_Chip[(instance_id)]].Geometry.Page_Num)
+#define EXTERNAL_FLASH_BYTE_BITS(instance_id)       (ExternalFlash_Chip[ExternalFlash_Instance_Chip[(instance_id)]].Geometry.Byte_Bits)
+#define EXTERNAL_FLASH_SPARE_SIZE(instance_id)      (ExternalFlash_Chip[ExternalFlash_Instance_Chip[(instance_id)]].Geometry.Spare_Size)
+#else
+//! Without detection the geometry is constant, the address computations below fold into shifts and masks
+#if (EXTERNAL_FLASH_DEVICE_PAGE_SIZE > EXTERNAL_FLASH_MAX_PAGE_SIZE)
+#error "EXTERNAL_FLASH_MAX_PAGE_SIZE is smaller than the EXTERNAL_FLASH_DEVICE_ID page"
+#endif
+#define EXTERNAL_FLASH_PAGE_SIZE(instance_id)       (EXTERNAL_FLASH_DEVICE_PAGE_SIZE)
+#if (EXTERNAL_FLASH_DEVICE_PAGE_NUMBER > EXTERNAL_FLASH_MAX_PAGE_NUMBER)
+#define EXTERNAL_FLASH_PAGE_NUMBER(instance_id)     (EXTERNAL_FLASH_MAX_PAGE_NUMBER)
+#else
+#define EXTERNAL_FLASH_PAGE_NUMBER(instance_id)     (EXTERNAL_FLASH_DEVICE_PAGE_NUMBER)
+#endif
+#define EXTERNAL_FLASH_BYTE_BITS(instance_id)       (EXTERNAL_FLASH_DEVICE_BYTE_BITS)
+#define EXTERNAL_FLASH_SPARE_SIZE(instance_id)      (EXTERNAL_FLASH_DEVICE_SPARE_SIZE)
 #endif
+//! Byte address bits of the data of a page, the spare area is above them
+#define EXTERNAL_FLASH_PAGE_BITS(instance_id)       (EXTERNAL_FLASH_BYTE_BITS(instance_id) - ((EXTERNAL_FLASH_SPARE_SIZE(instance_id) != 0) ? 1 : 0))
+#define EXTERNAL_FLASH_BLOCK_SIZE(instance_id)      (EXTERNAL_FLASH_BLOCK_PAGES * EXTERNAL_FLASH_PAGE_SIZE(instance_id))
+#define EXTERNAL_FLASH_NUMBER_OF_BYTES(instance_id) ((uint32_t)EXTERNAL_FLASH_PAGE_SIZE(instance_id) * EXTERNAL_FLASH_PAGE_NUMBER(instance_id))
+
+//! Page of a device address and byte offset in the page, see GetPage
+#define EXTERNAL_FLASH_PAGE_OF(instance_id, address)        GetPage(EXTERNAL_FLASH_PAGE_SIZE(instance_id), EXTERNAL_FLASH_PAGE_BITS(instance_id), (address))
+#define EXTERNAL_FLASH_PAGE_OFFSET(instance_id, address)    GetPageOffset(EXTERNAL_FLASH_PAGE_SIZE(instance_id), EXTERNAL_FLASH_PAGE_BITS(instance_id), (address))
+
+//! Division by 33 of the DataFlash page addresses: (x * RECIPROCAL) >> SHIFT, the reciprocal rounded up, is x / 33 or
+//! one more for x < 33 * 2^15, without overflowing 32 bit (the AT45DB641E has 32768 * 264 / 8 = 1081344 units of 8 bytes)
+#define EXTERNAL_FLASH_DIV33_RECIPROCAL             (1986UL)
+#define EXTERNAL_FLASH_DIV33_SHIFT                  (16)
+
+//! JEDEC manufacturer id
+#define EXTERNAL_FLASH_MANUFACTURER_ID              (0x1F)
+
+//! AT45DB device struct type
+typedef struct EXTERNAL_FLASH_DEVICE_STRUCT
+{
+    uint8_t                     Device_Id;                  // JEDEC device id 1: family and density
+    uint8_t                     Edi_Length;                 // JEDEC extended device information length, 0xFF for any
+    uint16_t                    Page_Num;
+    uint16_t                    Page_Size;                  // Binary page size, the DataFlash page has 1/32 more bytes
+} EXTERNAL_FLASH_DEVICE_TYPE;
+
+//! AT45DB devices, the opcodes are the same on all of them. The D and E series share the device ids and the geometry,
+//! except at 64 Mbit: the AT45DB641E has smaller pages and is told apart by its extended device information (1 byte)
+static const EXTERNAL_FLASH_DEVICE_TYPE ExternalFlash_Device[] =
+{
+    {0x22, 0xFF,   512,  256},                              // AT45DB011, 1 Mbit
+    {0x23, 0xFF,  1024,  256},                              // AT45DB021, 2 Mbit
+    {0x24, 0xFF,  2048,  256},                              // AT45DB041, 4 Mbit
+    {0x25, 0xFF,  4096,  256},                              // AT45DB081, 8 Mbit
+    {0x26, 0xFF,  4096,  512},                              // AT45DB161, 16 Mbit
+    {0x27, 0xFF,  8192,  512},                              // AT45DB321, 32 Mbit
+    {0x28, 0x00,  8192, 1024},                              // AT45DB642D, 64 Mbit
+    {0x28, 0x01, 32768,  256},                              // AT45DB641E, 64 Mbit
+};
+
 #define EXTERNAL_FLASH_ADDRESS_SIZE_BYTE 3    
 #define EXTERNAL_FLASH_COMMAND_SIZE_BYTE 1
 
@@ -53,10 +105,13 @@ DEFINE_CALLBACK_CONTROL_STRUCTURE(ExternalFlash_Callback_Control_Structure, EXTE
 
 #define    EXTERNAL_FLASH_CMD_DUMMY                   	    0x00
 #define    EXTERNAL_FLASH_CMD_WRITE_MEMORY    		        0x58		// WRITE Command
-#define    EXTERNAL_FLASH_CMD_READ_MEMORY    		        0xd2		// READ Command
+#define    EXTERNAL_FLASH_CMD_READ_MEMORY    		        0x0b		// READ Command (Continuous Array Read, crosses page boundaries)
 #define    EXTERNAL_FLASH_CMD_READ_STATUS_REGISTER          0xd7		// Read Status Register
+#define    EXTERNAL_FLASH_CMD_READ_DEVICE_ID                0x9f		// Manufacturer and Device ID Read
 #define    EXTERNAL_FLASH_CMD_INVALID                 	    0xFF
 
+#define    EXTERNAL_FLASH_CMD_READ_MEMORY_GATHER            0x03		// READ Command without dummy byte, low frequency SPI clock only
+
 //! External Flash Message Read Header struct type
 typedef __PACKED_STRUCT EXTERNAL_FLASH_READ_HEADER_STRUCT
 {
@@ -87,6 +142,13 @@ typedef enum EXTERNAL_FLASH_STATE_ENUM
     EXTERNAL_FLASH_STATE_READ_STATUS_REGISTER_BEFORE_READ,
     EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_WRITE,
     EXTERNAL_FLASH_STATE_READ_STATUS_REGISTER_BEFORE_WRITE,
+    EXTERNAL_FLASH_STATE_COMMIT_BUFFER_BEFORE_READ,
+    EXTERNAL_FLASH_STATE_COMMIT_BUFFER_BEFORE_WRITE,
+    EXTERNAL_FLASH_STATE_LOAD_BUFFER,
+    EXTERNAL_FLASH_STATE_ERASE,
+    EXTERNAL_FLASH_STATE_DETECT_ID,
+    EXTERNAL_FLASH_STATE_DETECT_PAGE_SIZE,
+    EXTERNAL_FLASH_STATE_WRITE_SPARE,
     EXTERNAL_FLASH_STATE_INVALID
 } EXTERNAL_FLASH_STATE_TYPE;
 
@@ -97,10 +159,16 @@ typedef enum EXTERNAL_FLASH_STATE_ENUM
 #define EXTERNAL_FLASH_CONTINUOUS_ARRAY_READ_LP_COMMAND 0x01
 #define EXTERNAL_FLASH_BUFFER_READ_HF_COMMAND           0xd4
 #define EXTERNAL_FLASH_BUFFER_READ_LF_COMMAND           0xd1
+#define EXTERNAL_FLASH_BUFFER_2_READ_HF_COMMAND         0xd6
+#define EXTERNAL_FLASH_BUFFER_2_READ_LF_COMMAND         0xd3
 
 //Write command
 #define EXTERNAL_FLASH_BUFFER_WRITE_COMMAND             0x84
+#define EXTERNAL_FLASH_BUFFER_TO_MAIN_ERASE_COMMAND     0x83
+#define EXTERNAL_FLASH_MAIN_TO_BUFFER_COMMAND           0x53
 #define EXTERNAL_FLASH_READ_MODIFY_WRITE_COMMAND        0x58
+#define EXTERNAL_FLASH_READ_MODIFY_WRITE_2_COMMAND      0x59
+#define EXTERNAL_FLASH_PAGE_PROGRAM_COMMAND             0x02        // Through buffer 1, without built-in erase
 #define EXTERNAL_FLASH_PAGE_ERASE_COMMAND               0x81
 #define EXTERNAL_FLASH_BLOCK_ERASE_COMMAND              0x50
 #define EXTERNAL_FLASH_SECTOR_ERASE_COMMAND             0x7c
@@ -115,6 +183,13 @@ typedef enum EXTERNAL_FLASH_STATE_ENUM
 #define EXTERNAL_FLASH_SECTOR_OAP_0BUP                  0xc0
 #define EXTERNAL_FLASH_SECTOR_OAUP_0BP                  0x30
 
+//! Chip SRAM buffers, buffer 1 is index 0
+#define EXTERNAL_FLASH_BUFFER_NUM                       (2)
+#define EXTERNAL_FLASH_BUFFER_NONE                      INVALID_VALUE_8
+
+//! Buffer used by write combining
+#define EXTERNAL_FLASH_COMBINE_BUFFER                   (0)
+
 
 
 static NVMEMORY_INSTANCE_TYPE ExternalFlash_Instance_Store[EXTERNAL_FLASH_CH_NUM];
@@ -131,45 +206,431 @@ typedef __PACKED_STRUCT EXTERNAL_FLASH_MAP_STRUCT
     BOOL_TYPE                   ExternalFlash_Reset_Feature;
     BOOL_TYPE                   ExternalFlash_Reset_Level;
     GENERIC_COMM_BUS_TYPE       Generic_Comm_Bus_Id;
+#if (EXTERNAL_FLASH_READY_PIN_FEATURE == ENABLED)
+    uint8_t                     ExternalFlash_Ready_Pin;
+    BOOL_TYPE                   ExternalFlash_Ready_Feature;
+    BOOL_TYPE                   ExternalFlash_Ready_Level;      // Pin level while the chip is ready
+#endif
 } EXTERNAL_FLASH_MAP_TYPE;
 
 
-//External Flash Status register struct
+//External Flash Status register struct (bit-fields are allocated from the LSB, RDY/BUSY is bit 7 of each byte)
 typedef __PACKED_STRUCT EXTERNAL_FLASH_STATUS_REGISTER_STRUCT
 {
-    uint8_t RDY_1       : 1;
-    uint8_t COMP        : 1;
-    uint8_t Density     : 3;
-    uint8_t Protect     : 1;
     uint8_t PageSize    : 1;
+    uint8_t Protect     : 1;
+    uint8_t Density     : 4;
+    uint8_t COMP        : 1;
+    uint8_t RDY_1       : 1;
     
-    uint8_t RDY_2       : 1;
-    uint8_t Reserved_1  : 1;
-    uint8_t EPE         : 1;
     uint8_t Reserved_2  : 5;    
+    uint8_t EPE         : 1;
+    uint8_t Reserved_1  : 1;
+    uint8_t RDY_2       : 1;
 }EXTERNAL_FLASH_STATUS_REGISTER_TYPE;
 
 
-static EXTERNAL_FLASH_STATUS_REGISTER_TYPE Status_Register;
-
 //! External Flash Configuration Map
 static const EXTERNAL_FLASH_MAP_TYPE ExternalFlash_Map[] = EXTERNAL_FLASH_MAP; 
 
 //! External Flash Task Handler Index
 static uint8_t ExternalFlash_Handler_Index = INVALID_VALUE_8;
 
+//! Earliest handler call requested since the handler last ran
+static uint32_t ExternalFlash_Wakeup_Us;
+static BOOL_TYPE ExternalFlash_Wakeup_Pending;
+
 static uint8_t ExternalFlash_Timeout_Handle = INVALID_VALUE_8;
 #define EXTERNAL_FLASH_WAIT_TIMEOUT_MS          (50)
 
+//! Bus lookup table size: must be a power of two and at least twice EXTERNAL_FLASH_CHIP_NUM to keep probe chains short
+#ifndef EXTERNAL_FLASH_BUS_LOOKUP_SIZE
+#define EXTERNAL_FLASH_BUS_LOOKUP_SIZE          (16)
+#endif
+
+#if ((EXTERNAL_FLASH_BUS_LOOKUP_SIZE & (EXTERNAL_FLASH_BUS_LOOKUP_SIZE - 1)) != 0)
+#error "EXTERNAL_FLASH_BUS_LOOKUP_SIZE must be a power of two"
+#endif
+
+//! Hash of a (bus provider, bus channel) pair into the bus lookup table
+#define EXTERNAL_FLASH_BUS_LOOKUP_HASH(provider, channel)   ((((uint16_t)(provider) * 31) + (channel)) & (EXTERNAL_FLASH_BUS_LOOKUP_SIZE - 1))
+
+//! Chip internal operations timed by the completion model
+typedef enum EXTERNAL_FLASH_CHIP_OP_ENUM
+{
+    EXTERNAL_FLASH_CHIP_OP_ERASE_PROGRAM,                   // tEP
+    EXTERNAL_FLASH_CHIP_OP_PROGRAM,                         // tP
+    EXTERNAL_FLASH_CHIP_OP_PAGE_ERASE,                      // tPE
+    EXTERNAL_FLASH_CHIP_OP_BLOCK_ERASE,                     // tBE
+    EXTERNAL_FLASH_CHIP_OP_TRANSFER,                        // tXFR
+    EXTERNAL_FLASH_CHIP_OP_NUM
+} EXTERNAL_FLASH_CHIP_OP_TYPE;
+
+//! No internal operation being timed
+#define EXTERNAL_FLASH_CHIP_OP_NONE                     EXTERNAL_FLASH_CHIP_OP_NUM
+
+//! Handler scheduling resolution
+#define EXTERNAL_FLASH_SCHEDULE_TICK_US                 (1000)
+
+//! Initial completion model, typical operation times
+static const uint32_t ExternalFlash_Chip_Op_Typical_Us[EXTERNAL_FLASH_CHIP_OP_NUM] =
+{
+    EXTERNAL_FLASH_PAGE_ERASE_PROGRAM_US,
+    EXTERNAL_FLASH_PAGE_PROGRAM_US,
+    EXTERNAL_FLASH_PAGE_ERASE_US,
+    EXTERNAL_FLASH_BLOCK_ERASE_US,
+    EXTERNAL_FLASH_BUFFER_TRANSFER_US,
+};
+
+#if (EXTERNAL_FLASH_SCRUB_FEATURE == ENABLED)
+//! Scrub buffer, a scrub step reads one page of the largest part at least
+#if (EXTERNAL_FLASH_SCRUB_SIZE > EXTERNAL_FLASH_MAX_PAGE_SIZE)
+#define EXTERNAL_FLASH_SCRUB_BUFFER_SIZE        EXTERNAL_FLASH_SCRUB_SIZE
+#else
+#define EXTERNAL_FLASH_SCRUB_BUFFER_SIZE        EXTERNAL_FLASH_MAX_PAGE_SIZE
+#endif
+#endif
+
+#if (EXTERNAL_FLASH_BLANK_FEATURE == ENABLED)
+//! Blank check buffer, a step reads one page of the largest part at least
+#if (EXTERNAL_FLASH_BLANK_SCAN_SIZE > EXTERNAL_FLASH_MAX_PAGE_SIZE)
+#define EXTERNAL_FLASH_BLANK_BUFFER_SIZE        EXTERNAL_FLASH_BLANK_SCAN_SIZE
+#else
+#define EXTERNAL_FLASH_BLANK_BUFFER_SIZE        EXTERNAL_FLASH_MAX_PAGE_SIZE
+#endif
+#endif
+
+//! External Flash physical chip struct type, one for each distinct (bus provider, bus channel) pair
+typedef struct EXTERNAL_FLASH_CHIP_STRUCT
+{
+    GENERIC_COMM_BUS_TYPE       Generic_Comm_Bus_Id;
+    uint8_t                     Bus_Instance_Channel;
+    uint8_t                     Active_Instance;            // Instance currently owning the chip, INVALID_VALUE_8 if none
+    EXTERNAL_FLASH_STATUS_REGISTER_TYPE Status_Register;    // Last status register read
+    uint16_t                    Buffer_Page[EXTERNAL_FLASH_BUFFER_NUM];     // Page held in each SRAM buffer, INVALID_VALUE_16 if unknown
+    uint8_t                     Busy_Buffer;                // Buffer used by the last program or transfer, EXTERNAL_FLASH_BUFFER_NONE if none
+    uint32_t                    Ready_Us;                   // Estimated end of the last internal operation (program, erase, transfer)
+    uint32_t                    Busy_Start_Us;              // Start of the last internal operation
+    uint8_t                     Busy_Op;                    // Last internal operation, EXTERNAL_FLASH_CHIP_OP_NONE once seen ended
+    uint32_t                    Op_Us[EXTERNAL_FLASH_CHIP_OP_NUM];          // Completion model, learned operation times
+    EXTERNAL_FLASH_GEOMETRY_TYPE Geometry;
+#if (EXTERNAL_FLASH_DETECT_FEATURE == ENABLED)
+    BOOL_TYPE                   Detected;                   // Geometry read from the chip, its instances can leave INITIALIZE
+#endif
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+    BOOL_TYPE                   Buffer_Dirty;               // Combining buffer holds writes not programmed yet
+    uint8_t                     Buffer_Instance;            // Instance of the last buffered write, commits on timeout
+    BOOL_TYPE                   Flush_Notify;               // Flush in progress was requested by a client
+    uint32_t                    Buffer_Write_Us;            // Last buffered write
+#endif
+#if (EXTERNAL_FLASH_INTEGRITY_FEATURE == ENABLED)
+    uint32_t                    Page_Crc[EXTERNAL_FLASH_MAX_PAGE_NUMBER];           // CRC-32 of each page, valid if known
+    uint8_t                     Page_Crc_Known[EXTERNAL_FLASH_MAX_PAGE_NUMBER / 8]; // Bitmap of the pages with a known CRC
+    uint32_t                    Erased_Crc;                 // CRC of an erased page
+#endif
+#if (EXTERNAL_FLASH_SCRUB_FEATURE == ENABLED)
+    uint8_t                     Scrub_Instance;             // Instance running the scrub steps, the first bound to the chip
+    uint8_t                     Scrub_Step;                 // EXTERNAL_FLASH_SCRUB_STEP_TYPE, next or in progress
+    BOOL_TYPE                   Scrub_Busy;                 // Scrub step in progress on Scrub_Instance
+    uint16_t                    Scrub_Page;                 // Page read again and repaired
+    uint32_t                    Scrub_Address;              // Next device address to read
+    uint32_t                    Scrub_Us;                   // Start of the last step
+    uint32_t                    Scrub_Wait_Us;              // Time before the next step, to stay within the budget
+    uint8_t                     Scrub_Buffer[EXTERNAL_FLASH_SCRUB_BUFFER_SIZE];
+    uint8_t                     Page_Crc_Learned[EXTERNAL_FLASH_MAX_PAGE_NUMBER / 8];   // Bitmap of the pages with a CRC learned by a read
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    EXTERNAL_FLASH_SPARE_TYPE   Scrub_Spare;                // Metadata of Scrub_Page, on chips with a spare area
+#endif
+#endif
+#if (EXTERNAL_FLASH_BLANK_FEATURE == ENABLED)
+    uint8_t                     Page_Erased[EXTERNAL_FLASH_MAX_PAGE_NUMBER / 8];    // Bitmap of the pages known erased
+    uint8_t                     Blank_Instance;             // Instance running the blank check, INVALID_VALUE_8 if none
+    BOOL_TYPE                   Blank_Busy;                 // Blank check step in progress on Blank_Instance
+    uint32_t                    Blank_Address;              // Next device address to check
+    uint32_t                    Blank_End;                  // End of the device range to check
+    uint32_t                    Blank_Buffer[(EXTERNAL_FLASH_BLANK_BUFFER_SIZE + 3) / 4];   // Word aligned, checked a word at a time
+#endif
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    uint8_t                     Merge_Buffer[EXTERNAL_FLASH_MAX_PAGE_SIZE + sizeof(EXTERNAL_FLASH_SPARE_TYPE)]; // Page merged by a plain write
+#endif
+} EXTERNAL_FLASH_CHIP_TYPE;
+
+//! Physical chips bound to the External Flash instances
+static EXTERNAL_FLASH_CHIP_TYPE ExternalFlash_Chip[EXTERNAL_FLASH_CHIP_NUM];
+static uint8_t ExternalFlash_Chip_Num;
+
+//! Chip index of each instance
+static uint8_t ExternalFlash_Instance_Chip[EXTERNAL_FLASH_CH_NUM];
+
+//! Kind of write process
+typedef enum EXTERNAL_FLASH_OPERATION_ENUM
+{
+    EXTERNAL_FLASH_OPERATION_WRITE,                         // Read-modify-write, or buffer write when combining
+    EXTERNAL_FLASH_OPERATION_PROGRAM,                       // Program of erased space, without built-in erase
+    EXTERNAL_FLASH_OPERATION_ERASE                          // Page and block erase, no data
+} EXTERNAL_FLASH_OPERATION_TYPE;
+
+//! Write process kind of each instance
+static EXTERNAL_FLASH_OPERATION_TYPE ExternalFlash_Instance_Operation[EXTERNAL_FLASH_CH_NUM];
+
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+//! Page metadata of the ExternalFlash__WritePages, ExternalFlash__ReadSpare or merged plain write in progress
+typedef struct EXTERNAL_FLASH_SPARE_STATE_STRUCT
+{
+    EXTERNAL_FLASH_SPARE_TYPE   First;                      // Metadata given for the first page written
+    EXTERNAL_FLASH_SPARE_TYPE   Page;                       // Metadata of the page being written, sent after its data
+    BOOL_TYPE                   Active;                     // Process in progress writes or reads page metadata
+    BOOL_TYPE                   Loading;                    // Old metadata, or whole page to merge, of the page to write being read
+    BOOL_TYPE                   Loaded;                     // Old metadata of the page to write read
+    BOOL_TYPE                   Merge;                      // Plain write or program, pages merged in the chip Merge_Buffer
+    BOOL_TYPE                   Merge_Program;              // Merged data is the bitwise AND of old and new data
+} EXTERNAL_FLASH_SPARE_STATE_TYPE;
+
+static EXTERNAL_FLASH_SPARE_STATE_TYPE ExternalFlash_Instance_Spare[EXTERNAL_FLASH_CH_NUM];
+
+#define EXTERNAL_FLASH_SPARE_ACTIVE(instance_id)    (ExternalFlash_Instance_Spare[(instance_id)].Active)
+//! Plain writes and programs of the instance are merged with the old page data and written whole with the metadata
+#define EXTERNAL_FLASH_MERGE_WRITES(instance_id)    (((instance_id) < EXTERNAL_FLASH_CH_NUM) && (EXTERNAL_FLASH_SPARE_SIZE(instance_id) != 0))
+//! Page written whole from Merge_Buffer with its metadata, a page of a program left without metadata is programmed
+#define EXTERNAL_FLASH_MERGING(instance_id)         ((ExternalFlash_Instance_Spare[(instance_id)].Merge == TRUE) && \
+                                                     (ExternalFlash_Instance_Operation[(instance_id)] == EXTERNAL_FLASH_OPERATION_WRITE))
+//! Old metadata, or page to merge, of the page to write not read yet
+#define EXTERNAL_FLASH_SPARE_TO_LOAD(instance_id)   ((ExternalFlash_Instance_Spare[(instance_id)].Active == TRUE) && \
+                                                     (ExternalFlash_Instance_Spare[(instance_id)].Loaded == FALSE))
+#else
+#define EXTERNAL_FLASH_SPARE_ACTIVE(instance_id)    (FALSE)
+#define EXTERNAL_FLASH_SPARE_TO_LOAD(instance_id)   (FALSE)
+#define EXTERNAL_FLASH_MERGE_WRITES(instance_id)    (FALSE)
+#define EXTERNAL_FLASH_MERGING(instance_id)         (FALSE)
+#endif
+//! Spare area bytes written with each page data
+#define EXTERNAL_FLASH_SPARE_WRITE_SIZE(instance_id) ((EXTERNAL_FLASH_SPARE_ACTIVE(instance_id) == TRUE) ? sizeof(EXTERNAL_FLASH_SPARE_TYPE) : 0)
+
+//! Open addressing (bus provider, bus channel) -> chip index table, INVALID_VALUE_8 marks an empty slot
+static uint8_t ExternalFlash_Bus_Lookup[EXTERNAL_FLASH_BUS_LOOKUP_SIZE];
+
+#ifndef EXTERNAL_FLASH_TIMESTAMP_US
+#error "EXTERNAL_FLASH_TIMESTAMP_US() must be defined in ExternalFlash_prv.h, see ExternalFlash.h"
+#endif
+
+#if (EXTERNAL_FLASH_STATS_FEATURE == ENABLED)
+//! External Flash instance statistics and timestamps of the process in progress
+typedef struct EXTERNAL_FLASH_STATS_DATA_STRUCT
+{
+    EXTERNAL_FLASH_STATS_TYPE   Stats;
+    uint32_t                    Request_Us;                 // Read/Write request accepted
+    uint32_t                    Bus_Request_Us;             // Last bus transfer requested
+    uint32_t                    Busy_Since_Us;              // First status poll that found the chip busy
+    BOOL_TYPE                   Busy;
+} EXTERNAL_FLASH_STATS_DATA_TYPE;
+
+static EXTERNAL_FLASH_STATS_DATA_TYPE ExternalFlash_Stats[EXTERNAL_FLASH_CH_NUM];
+
+#define EXTERNAL_FLASH_STATS_COUNT(instance_id, counter, value)     (ExternalFlash_Stats[(instance_id)].Stats.counter += (value))
+#define EXTERNAL_FLASH_STATS_REQUEST(instance_id)                   StatsRequest(instance_id)
+#define EXTERNAL_FLASH_STATS_BUS_REQUEST(instance_id)               (ExternalFlash_Stats[(instance_id)].Bus_Request_Us = EXTERNAL_FLASH_TIMESTAMP_US())
+#define EXTERNAL_FLASH_STATS_BUS_EVENT(instance_id)                 StatsBusEvent(instance_id)
+#define EXTERNAL_FLASH_STATS_STATUS(instance_id, ready)             StatsStatus(instance_id, ready)
+#define EXTERNAL_FLASH_STATS_COMPLETE(instance_id, write)           StatsComplete(instance_id, write)
+#else
+#define EXTERNAL_FLASH_STATS_COUNT(instance_id, counter, value)     ((void)0)
+#define EXTERNAL_FLASH_STATS_REQUEST(instance_id)                   ((void)0)
+#define EXTERNAL_FLASH_STATS_BUS_REQUEST(instance_id)               ((void)0)
+#define EXTERNAL_FLASH_STATS_BUS_EVENT(instance_id)                 ((void)0)
+#define EXTERNAL_FLASH_STATS_STATUS(instance_id, ready)             ((void)0)
+#define EXTERNAL_FLASH_STATS_COMPLETE(instance_id, write)           ((void)0)
+#endif
+
+#if (EXTERNAL_FLASH_TRACE_FEATURE == ENABLED)
+#if ((EXTERNAL_FLASH_TRACE_SIZE & (EXTERNAL_FLASH_TRACE_SIZE - 1)) != 0)
+#error "EXTERNAL_FLASH_TRACE_SIZE must be a power of two"
+#endif
+
+//! State changes and bus events trace
+static EXTERNAL_FLASH_TRACE_TYPE ExternalFlash_Trace;
+
+#define EXTERNAL_FLASH_TRACE(context, event, instance_id, old_state, new_state)     Trace(context, event, instance_id, old_state, new_state)
+#else
+#define EXTERNAL_FLASH_TRACE(context, event, instance_id, old_state, new_state)     ((void)0)
+#endif
+
+#if (EXTERNAL_FLASH_CAPTURE_FEATURE == ENABLED)
+//! Largest capture record: type, time, instance, two 32 bit varints, flag
+#define EXTERNAL_FLASH_CAPTURE_RECORD_MAX_SIZE  (1 + 5 + 1 + 5 + 5 + 1)
+
+//! Records are stored in RAM unless the application provides its own sink (e.g. a log partition or a serial port)
+#ifndef EXTERNAL_FLASH_CAPTURE_SINK
+#define EXTERNAL_FLASH_CAPTURE_SINK(record, size)   CaptureStore(record, size)
+#define EXTERNAL_FLASH_CAPTURE_RAM
+
+static uint8_t ExternalFlash_Capture[EXTERNAL_FLASH_CAPTURE_SIZE];
+static uint32_t ExternalFlash_Capture_Size;
+static uint32_t ExternalFlash_Capture_Dropped;              // Records not stored, the capture stops at the first one
+#endif
+
+//! Timestamp of the last captured record
+static uint32_t ExternalFlash_Capture_Last_Us;
+
+#define EXTERNAL_FLASH_CAPTURE(type, instance_id, value_1, value_2, flag)   Capture(type, instance_id, value_1, value_2, flag)
+#else
+#define EXTERNAL_FLASH_CAPTURE(type, instance_id, value_1, value_2, flag)   ((void)0)
+#endif
+
+#if (EXTERNAL_FLASH_INTEGRITY_SLICING_FEATURE == ENABLED)
+//! CRC-32 (reflected, polynomial 0xEDB88320) slicing-by-8 tables, Crc_Table[0] is the byte table
+static uint32_t ExternalFlash_Crc_Table[8][256];
+#else
+//! CRC-32 (reflected, polynomial 0xEDB88320) nibble table
+static const uint32_t ExternalFlash_Crc_Table[16] =
+{
+    0x00000000UL, 0x1DB71064UL, 0x3B6E20C8UL, 0x26D930ACUL, 0x76DC4190UL, 0x6B6B51F4UL, 0x4DB26158UL, 0x5005713CUL,
+    0xEDB88320UL, 0xF00F9344UL, 0xD6D6A3E8UL, 0xCB61B38CUL, 0x9B64C2B0UL, 0x86D3D2D4UL, 0xA00AE278UL, 0xBDBDF21CUL
+};
+#endif
+
+#if (EXTERNAL_FLASH_INTEGRITY_FEATURE == ENABLED)
+//! A whole page read of the instance did not match its CRC since the last ExternalFlash__CheckIntegrity
+static BOOL_TYPE ExternalFlash_Integrity_Error[EXTERNAL_FLASH_CH_NUM];
+
+#define EXTERNAL_FLASH_INTEGRITY_READ(instance_id)                  IntegrityRead(instance_id)
+#define EXTERNAL_FLASH_INTEGRITY_WRITE(instance_id, write_size)     IntegrityWrite(instance_id, write_size)
+#define EXTERNAL_FLASH_INTEGRITY_ERASE(instance_id, erase_size)     IntegrityErase(instance_id, erase_size)
+#else
+#define EXTERNAL_FLASH_INTEGRITY_READ(instance_id)                  ((void)0)
+#define EXTERNAL_FLASH_INTEGRITY_WRITE(instance_id, write_size)     ((void)0)
+#define EXTERNAL_FLASH_INTEGRITY_ERASE(instance_id, erase_size)     ((void)0)
+#endif
+
+#if (EXTERNAL_FLASH_SCRUB_FEATURE == ENABLED)
+#if (EXTERNAL_FLASH_INTEGRITY_FEATURE == DISABLED)
+#error "EXTERNAL_FLASH_SCRUB_FEATURE requires EXTERNAL_FLASH_INTEGRITY_FEATURE"
+#endif
+
+//! Scrub steps
+typedef enum EXTERNAL_FLASH_SCRUB_STEP_ENUM
+{
+    EXTERNAL_FLASH_SCRUB_STEP_READ,                         // Read and check the next EXTERNAL_FLASH_SCRUB_SIZE bytes
+    EXTERNAL_FLASH_SCRUB_STEP_SPARE,                        // Read the metadata of the page read, chips with a spare area
+    EXTERNAL_FLASH_SCRUB_STEP_VERIFY,                       // Read again the page that failed its CRC
+    EXTERNAL_FLASH_SCRUB_STEP_REPAIR                        // Rewrite the page with the data read again
+} EXTERNAL_FLASH_SCRUB_STEP_TYPE;
+
+#define EXTERNAL_FLASH_SCRUBBING(instance_id)                       (ExternalFlash_Chip[ExternalFlash_Instance_Chip[(instance_id)]].Scrub_Busy)
+#define EXTERNAL_FLASH_SCRUB_COMPLETE(instance_id)                  ScrubComplete(instance_id)
+#else
+#define EXTERNAL_FLASH_SCRUBBING(instance_id)                       (FALSE)
+#define EXTERNAL_FLASH_SCRUB_COMPLETE(instance_id)                  ((void)0)
+#endif
+
+#if (EXTERNAL_FLASH_BLANK_FEATURE == ENABLED)
+#define EXTERNAL_FLASH_BLANK_CHECKING(instance_id)                  (ExternalFlash_Chip[ExternalFlash_Instance_Chip[(instance_id)]].Blank_Busy)
+#define EXTERNAL_FLASH_BLANK_COMPLETE(instance_id)                  BlankComplete(instance_id)
+#define EXTERNAL_FLASH_BLANK_WRITE(instance_id)                     SetPagesErased(instance_id, (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, ExternalFlash_Instance_Store[(instance_id)].NVM_Target_Address + ExternalFlash_Instance_Store[(instance_id)].NVM_Buffer_Progress), 1, FALSE)
+#define EXTERNAL_FLASH_BLANK_ERASE(instance_id, erase_size)         SetPagesErased(instance_id, (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, ExternalFlash_Instance_Store[(instance_id)].NVM_Target_Address + ExternalFlash_Instance_Store[(instance_id)].NVM_Buffer_Progress), \
+                                                                               (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, erase_size), TRUE)
+#else
+#define EXTERNAL_FLASH_BLANK_CHECKING(instance_id)                  (FALSE)
+#define EXTERNAL_FLASH_BLANK_COMPLETE(instance_id)                  ((void)0)
+#define EXTERNAL_FLASH_BLANK_WRITE(instance_id)                     ((void)0)
+#define EXTERNAL_FLASH_BLANK_ERASE(instance_id, erase_size)         ((void)0)
+#endif
+
 //-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
 
 static void CommBusEventHandler(CALLBACK_EVENT_TYPE event);
 static void ExecuteCallBack(COMMON_I_CALLBACK_TYPE data);
 static BOOL_TYPE SendCommand(uint8_t instance_id, uint8_t command_id);
+#if (EXTERNAL_FLASH_GATHER_FEATURE == DISABLED)
 static BOOL_TYPE SendReadHeader(uint8_t instance_id);
+#endif
 static BOOL_TYPE ReadData(uint8_t instance_id);
+#if (EXTERNAL_FLASH_GATHER_FEATURE == DISABLED)
 static BOOL_TYPE SendWriteHeader(uint8_t instace_id);
+#endif
 static BOOL_TYPE WriteData(uint8_t instance_id, uint16_t write_size);
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+static BOOL_TYPE WriteSpare(uint8_t instance_id);
+static void StartMerge(uint8_t instance_id, BOOL_TYPE program);
+static void MergePage(uint8_t instance_id);
+#endif
+static BOOL_TYPE ReadStatusRegister(uint8_t instance_id);
+#if (EXTERNAL_FLASH_DETECT_FEATURE == ENABLED)
+static BOOL_TYPE ReadDeviceId(uint8_t instance_id);
+#endif
+static void SendStatusCommand(uint8_t instance_id, EXTERNAL_FLASH_STATE_TYPE state);
+#if (EXTERNAL_FLASH_READY_PIN_FEATURE == ENABLED) || (EXTERNAL_FLASH_PREDICTIVE_FEATURE == ENABLED)
+static BOOL_TYPE IsChipWait(uint8_t instance_id);
+#endif
+static BOOL_TYPE StartRead(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size);
+static BOOL_TYPE StartWrite(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size, EXTERNAL_FLASH_OPERATION_TYPE operation);
+static uint16_t GetWriteSize(uint8_t instance_id);
+static uint16_t GetReadSize(uint8_t instance_id);
+static uint16_t GetEraseSize(uint8_t instance_id);
+static uint32_t GetReadCommand(uint8_t instance_id);
+static uint32_t GetWriteCommand(uint8_t instance_id);
+static uint8_t GetReadBuffer(uint8_t instance_id);
+static void InvalidateBuffers(uint8_t instance_id, uint16_t first_page, uint16_t page_num);
+static void WriteComplete(uint8_t instance_id);
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+static BOOL_TYPE StartFlush(uint8_t instance_id, BOOL_TYPE notify);
+static BOOL_TYPE StartBufferStep(uint8_t instance_id, BOOL_TYPE before_read);
+static void AbortBufferStep(uint8_t instance_id, BOOL_TYPE before_read);
+#endif
+static BOOL_TYPE SendPageCommand(uint8_t instance_id, uint8_t command_id, uint16_t page);
+static inline uint32_t GetPage(uint16_t page_size, uint8_t page_bits, uint32_t address);
+static inline uint32_t GetPageOffset(uint16_t page_size, uint8_t page_bits, uint32_t address);
+static uint32_t GetCommandAddress(uint8_t instance_id, uint32_t flash_address);
+#if (EXTERNAL_FLASH_GATHER_FEATURE == DISABLED)
+static void EncodeAddress(uint8_t* address, uint32_t command);
+#endif
+static uint8_t BindChip(GENERIC_COMM_BUS_TYPE bus_id, uint8_t bus_channel);
+static void SetGeometry(uint8_t chip_index, BOOL_TYPE binary_page);
+static uint8_t LookupChip(uint8_t bus_id, uint8_t bus_channel);
+static void SetState(uint8_t instance_id, EXTERNAL_FLASH_STATE_TYPE state);
+static void SetChipBusy(uint8_t instance_id, EXTERNAL_FLASH_CHIP_OP_TYPE op);
+static void UpdateChipTiming(uint8_t instance_id);
+static uint32_t GetChipBusyUs(uint8_t instance_id);
+static void ScheduleHandler(uint32_t delay_us);
+static uint32_t GetRemainingUs(uint8_t instance_id);
+#if (EXTERNAL_FLASH_TRACE_FEATURE == ENABLED)
+static void Trace(EXTERNAL_FLASH_TRACE_CONTEXT_TYPE context, EXTERNAL_FLASH_TRACE_EVENT_TYPE event, uint8_t instance_id, uint8_t old_state, uint8_t new_state);
+#endif
+#if (EXTERNAL_FLASH_CAPTURE_FEATURE == ENABLED)
+static void CaptureStart(void);
+static void Capture(EXTERNAL_FLASH_CAPTURE_RECORD_TYPE type, uint8_t instance_id, uint32_t value_1, uint32_t value_2, uint8_t flag);
+static uint8_t EncodeVarint(uint8_t* data, uint32_t value);
+#ifdef EXTERNAL_FLASH_CAPTURE_RAM
+static void CaptureStore(const uint8_t* record, uint8_t size);
+#endif
+#endif
+#if (EXTERNAL_FLASH_STATS_FEATURE == ENABLED)
+static void StatsRequest(uint8_t instance_id);
+static void StatsBusEvent(uint8_t instance_id);
+static void StatsStatus(uint8_t instance_id, BOOL_TYPE ready);
+static void StatsComplete(uint8_t instance_id, BOOL_TYPE write);
+#endif
+#if (EXTERNAL_FLASH_INTEGRITY_FEATURE == ENABLED)
+static void IntegrityInitialize(void);
+static void IntegrityRead(uint8_t instance_id);
+static void IntegrityWrite(uint8_t instance_id, uint16_t write_size);
+static void IntegrityErase(uint8_t instance_id, uint16_t erase_size);
+static void SetPageCrc(uint8_t instance_id, uint16_t page, uint32_t crc);
+static uint32_t GetCrcZeros(uint32_t crc, uint16_t size);
+#endif
+static void CrcInitialize(void);
+static uint32_t GetCrc(uint32_t crc, const uint8_t* data, uint16_t size);
+#if (EXTERNAL_FLASH_SCRUB_FEATURE == ENABLED)
+static BOOL_TYPE StartScrub(uint8_t instance_id);
+static void ScrubComplete(uint8_t instance_id);
+static uint16_t ScrubCheck(uint8_t instance_id, uint32_t address, uint16_t size);
+static void ReportIntegrityError(uint8_t instance_id);
+#endif
+#if (EXTERNAL_FLASH_BLANK_FEATURE == ENABLED)
+static BOOL_TYPE StartBlankStep(uint8_t instance_id);
+static void BlankComplete(uint8_t instance_id);
+static void SetPagesErased(uint8_t instance_id, uint16_t first_page, uint16_t page_num, BOOL_TYPE erased);
+static BOOL_TYPE IsBlank(const uint32_t* data, uint16_t size);
+#endif
 
 //=====================================================================================================================
 //-------------------------------------- Public Functions -------------------------------------------------------------
@@ -188,6 +649,32 @@ void ExternalFlash__Initialize(void)
     // Initialize instance id store
     memset(ExternalFlash_Instance_Store, 0x00, sizeof(ExternalFlash_Instance_Store));
     
+    // Initialize bus lookup table
+    SYS_ASSERT((2 * EXTERNAL_FLASH_CHIP_NUM) <= EXTERNAL_FLASH_BUS_LOOKUP_SIZE);
+    memset(ExternalFlash_Bus_Lookup, INVALID_VALUE_8, sizeof(ExternalFlash_Bus_Lookup));
+    ExternalFlash_Chip_Num = 0;
+    
+#if (EXTERNAL_FLASH_STATS_FEATURE == ENABLED)
+    memset(ExternalFlash_Stats, 0x00, sizeof(ExternalFlash_Stats));
+#endif
+    
+#if (EXTERNAL_FLASH_TRACE_FEATURE == ENABLED)
+    memset(&ExternalFlash_Trace, 0x00, sizeof(ExternalFlash_Trace));
+    ExternalFlash_Trace.Magic = EXTERNAL_FLASH_TRACE_MAGIC;
+    ExternalFlash_Trace.Size = EXTERNAL_FLASH_TRACE_SIZE;
+    ExternalFlash_Trace.Ring_Num = EXTERNAL_FLASH_TRACE_CONTEXT_NUM;
+#endif
+    
+#if (EXTERNAL_FLASH_CAPTURE_FEATURE == ENABLED)
+    CaptureStart();
+#endif
+    
+    CrcInitialize();
+    
+#if (EXTERNAL_FLASH_INTEGRITY_FEATURE == ENABLED)
+    IntegrityInitialize();
+#endif
+    
     // Search bound bus IDs
     for(uint8_t instance_id = 0; instance_id < EXTERNAL_FLASH_CH_NUM; instance_id++)
     {
@@ -215,586 +702,3748 @@ void ExternalFlash__Initialize(void)
             GENERIC_IO_HANDLERS[GENERIC_IO_DIGITALIO].Write(ExternalFlash_Map[instance_id].ExternalFlash_Reset_Pin, !ExternalFlash_Map[instance_id].ExternalFlash_Reset_Level);
         }
         
-        // Get Register Event Handler
-        COMMBUS__REGISTERHANDLER register_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].RegisterEventHandler;
+        // Bind the instance to its physical chip, registering the bus event handler once per chip
+        ExternalFlash_Instance_Chip[instance_id] = BindChip(ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id,
+                                                           ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);
         
-        // If handler exists
-        if(register_handler != NULL)
+#if (EXTERNAL_FLASH_SCRUB_FEATURE == ENABLED)
+        // The first instance of each chip runs its scrub
+        if(ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Scrub_Instance == INVALID_VALUE_8)
         {
-            // Register event handler to service provider
-            register_handler(CommBusEventHandler, ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, CALLBACK_FILTER_VALUE_NONE);
+            ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Scrub_Instance = instance_id;
         }
+#endif
             
         // Initialize Instance Store
-        ExternalFlash_Instance_Store[instance_id].NVM_State = EXTERNAL_FLASH_STATE_INITIALIZE;
+        SetState(instance_id, EXTERNAL_FLASH_STATE_INITIALIZE);
         ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_NONE;
     }
 }
 
-void ExternalFlash_Handler(void)
+void ExternalFlash__Handler(void)
 {
     COMMON_I_CALLBACK_TYPE nv_callback;
     
+    ExternalFlash_Wakeup_Pending = FALSE;
+    
     for(uint8_t instance_id = 0; instance_id < ELEMENTS_IN_ARRAY(ExternalFlash_Instance_Store); instance_id ++)
     {
         
+        COMMBUS__STARTTRANSACTION start_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].StartTransaction;
         COMMBUS__STOPTRANSACTION stop_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].StopTransaction;
         
         // NOTE: Only one instance can be "active", i.e. not in IDLE state, to prevent isseues when multiple channels are referred to the same physical chip
         switch(ExternalFlash_Instance_Store[instance_id].NVM_State)
         {
           case EXTERNAL_FLASH_STATE_INITIALIZE:
-            
+            // Instance ready to accept requests once bound to a bus instance
+            if(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel != INVALID_VALUE_8)
+            {
+#if (EXTERNAL_FLASH_DETECT_FEATURE == ENABLED)
+                // and once its chip is detected, by the first instance finding the chip free
+                if(ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Detected == FALSE)
+                {
+                    if((ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance == INVALID_VALUE_8) &&
+                       (start_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel) == TRUE))
+                    {
+                        // Claim the chip for bus event dispatch
+                        ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance = instance_id;
+                        // Update NV Process Info
+                        ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
+                        // Update Memory State machine
+                        SetState(instance_id, EXTERNAL_FLASH_STATE_DETECT_ID);
+                        
+                        SendCommand(instance_id, EXTERNAL_FLASH_CMD_READ_DEVICE_ID);
+                    }
+                }
+                else
+#endif
+                {
+                    SetState(instance_id, EXTERNAL_FLASH_STATE_IDLE);
+                }
+            }
             break;
             
           case EXTERNAL_FLASH_STATE_IDLE:
-            
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+            // Program the buffered page once writes to it stopped, on behalf of the instance that last wrote it
+            if((ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Buffer_Dirty == TRUE) &&
+               (ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Buffer_Instance == instance_id) &&
+               (ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance == INVALID_VALUE_8) &&
+               ((EXTERNAL_FLASH_TIMESTAMP_US() - ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Buffer_Write_Us) >= (EXTERNAL_FLASH_WRITE_COMBINE_TIMEOUT_MS * 1000UL)))
+            {
+                StartFlush(instance_id, FALSE);
+            }
+            else
+#endif
+#if (EXTERNAL_FLASH_BLANK_FEATURE == ENABLED)
+            // Check the next pages of the blank check requested, on behalf of the instance that requested it, before
+            // any scrub step
+            if((ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Blank_Instance == instance_id) &&
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+               (ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Buffer_Dirty == FALSE) &&
+#endif
+               (ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance == INVALID_VALUE_8))
+            {
+                StartBlankStep(instance_id);
+            }
+            else
+#endif
+#if (EXTERNAL_FLASH_SCRUB_FEATURE == ENABLED)
+            // Scrub the next step once the budget allows it, on behalf of the first instance of an idle chip
+            if((ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Scrub_Instance == instance_id) &&
+               (ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance == INVALID_VALUE_8) &&
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+               (ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Buffer_Dirty == FALSE) &&
+#endif
+               ((EXTERNAL_FLASH_TIMESTAMP_US() - ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Scrub_Us) >= ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Scrub_Wait_Us))
+            {
+                StartScrub(instance_id);
+            }
+#endif
             break;
             
-          case EXTERNAL_FLASH_STATE_SEND_READ_HEADER:
-            // Check if NV Process is "write complete", Header data has been transmitted
-            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_WRITE)
+          case EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_READ:
+          case EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_WRITE:
+            // Check if NV Process is "none", chip was busy at last poll and the command has to be sent again
+            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_NONE)
+            {
+#if (EXTERNAL_FLASH_READY_PIN_FEATURE == ENABLED) || (EXTERNAL_FLASH_PREDICTIVE_FEATURE == ENABLED)
+                if(IsChipWait(instance_id) == TRUE)
+                {
+                    // Chip still busy, wait for the RDY/BUSY pin or the expected end without taking the bus
+                }
+                else
+#endif
+                if(start_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel) == TRUE)
+                {
+                    SendStatusCommand(instance_id, (EXTERNAL_FLASH_STATE_TYPE)ExternalFlash_Instance_Store[instance_id].NVM_State);
+                }
+                else
+                {
+                    // Bus busy, retry on next turn
+                    EXTERNAL_FLASH_STATS_COUNT(instance_id, Retries, 1);
+                }
+            }
+            // Check if NV Process is "write complete", Status Register command has been transmitted
+            else if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_WRITE)
             {
                 // Update NV Process Info
                 ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_READ;
                 // Update Memory State machine
-                ExternalFlash_Instance_Store[instance_id].NVM_State = EXTERNAL_FLASH_STATE_READ;
-                        
-                // Read payload data
-                ReadData(instance_id);
+                SetState(instance_id, (ExternalFlash_Instance_Store[instance_id].NVM_State == EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_READ) ?
+                                      EXTERNAL_FLASH_STATE_READ_STATUS_REGISTER_BEFORE_READ :
+                                      EXTERNAL_FLASH_STATE_READ_STATUS_REGISTER_BEFORE_WRITE);
+                
+                // Read Status Register
+                ReadStatusRegister(instance_id);
             }
             break;
             
-          case EXTERNAL_FLASH_STATE_READ:
-            // Check if NV Process is "read complete", payload data has been read
+          case EXTERNAL_FLASH_STATE_READ_STATUS_REGISTER_BEFORE_READ:
+          case EXTERNAL_FLASH_STATE_READ_STATUS_REGISTER_BEFORE_WRITE:
+            // Check if NV Process is "read complete", Status Register has been read
             if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_READ)
             {
-                stop_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);   
+                BOOL_TYPE before_read = (ExternalFlash_Instance_Store[instance_id].NVM_State == EXTERNAL_FLASH_STATE_READ_STATUS_REGISTER_BEFORE_READ) ? TRUE : FALSE;
+                uint8_t read_buffer = (before_read == TRUE) ? GetReadBuffer(instance_id) : EXTERNAL_FLASH_BUFFER_NONE;
                 
-                // Fill NV callback data
-                nv_callback.Source_Instance_Id = instance_id;
-                nv_callback.Event_Value = COMBINE_BYTES(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process,
-                                                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size);
+                // A read served from a buffer only needs that buffer to be free, not the whole chip
+                BOOL_TYPE ready = ((ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Status_Register.RDY_1 == 1) ||
+                                   ((read_buffer != EXTERNAL_FLASH_BUFFER_NONE) && (read_buffer != ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Busy_Buffer))) ? TRUE : FALSE;
                 
-                // Update NV Process Info
-                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_NONE;
-                // Update Memory State machine
-                ExternalFlash_Instance_Store[instance_id].NVM_State = EXTERNAL_FLASH_STATE_IDLE; 
+                stop_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);
                 
-                // Trigger Callback Notify
-                ExecuteCallBack(nv_callback);
-            }
-            break;
-            
-          case EXTERNAL_FLASH_STATE_SEND_WRITE_HEADER:
-            // Check if NV Process is "write complete", Header data has been transmitted
-            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_WRITE)
-            {
-                // Calculate write size
-                uint16_t write_size = MIN((ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size - ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress), EXTERNAL_FLASH_PAGE_SIZE);
-                write_size = MIN((EXTERNAL_FLASH_PAGE_SIZE - ((ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress) % EXTERNAL_FLASH_PAGE_SIZE)), write_size);
-                           
-                COMMBUS__STARTTRANSACTION start_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].StartTransaction;
-                if(start_handler != NULL)
+                EXTERNAL_FLASH_STATS_STATUS(instance_id, ready);
+                
+                UpdateChipTiming(instance_id);
+                
+                // If chip is ready start the requested operation, otherwise poll again on next turn
+                if((ready == TRUE) &&
+                   (start_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel) == TRUE))
                 {
-                    if(start_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel) == TRUE)
-                    { 
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+                    // Commit or load the chip buffer first if needed, the operation starts after the next poll
+                    if(StartBufferStep(instance_id, before_read) == TRUE)
+                    {
+                        // Buffer command sent, or flush completed
+                    }
+                    else
+#endif
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+                    // Read the old metadata of the page to write first, its erase count goes on in the new metadata; a
+                    // page to merge is read whole
+                    if((before_read == FALSE) && (ExternalFlash_Instance_Spare[instance_id].Active == TRUE) &&
+                       (ExternalFlash_Instance_Spare[instance_id].Loaded == FALSE))
+                    {
+                        ExternalFlash_Instance_Spare[instance_id].Loading = TRUE;
+#if (EXTERNAL_FLASH_GATHER_FEATURE == ENABLED)
+                        // Update NV Process Info
+                        ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_READ;
+                        // Update Memory State machine
+                        SetState(instance_id, EXTERNAL_FLASH_STATE_READ);
+                        // Read the page metadata, header sent as address phase
+                        ReadData(instance_id);
+#else
+                        // Update NV Process Info
                         ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
-                        
                         // Update Memory State machine
-                        ExternalFlash_Instance_Store[instance_id].NVM_State = EXTERNAL_FLASH_STATE_WRITE;
-                        // Write (partial) page
-                        WriteData(instance_id, write_size);                  
+                        SetState(instance_id, EXTERNAL_FLASH_STATE_SEND_READ_HEADER);
+                        // Send read header
+                        SendReadHeader(instance_id);
+#endif
                     }
-                }
-            }
-            
-            break;
-            
-          case EXTERNAL_FLASH_STATE_WRITE:
-            // Check if NV Process is "write complete", Header data has been transmitted
-            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_WRITE)
-            {
-                stop_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);
-                if(ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress < ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size)       // If there is still something to write
-                {
-                    SendWriteHeader(instance_id);
+                    else
+#endif
+                    if((before_read == FALSE) && (ExternalFlash_Instance_Operation[instance_id] == EXTERNAL_FLASH_OPERATION_ERASE))
+                    {
+                        // Update NV Process Info
+                        ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
+                        // Update Memory State machine
+                        SetState(instance_id, EXTERNAL_FLASH_STATE_ERASE);
+                        // Erase the next block or page, no data phase
+                        SendPageCommand(instance_id,
+                                        (GetEraseSize(instance_id) == EXTERNAL_FLASH_BLOCK_SIZE(instance_id)) ? EXTERNAL_FLASH_BLOCK_ERASE_COMMAND : EXTERNAL_FLASH_PAGE_ERASE_COMMAND,
+                                        (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress));
+                    }
+                    else
+#if (EXTERNAL_FLASH_GATHER_FEATURE == ENABLED)
+                    if(before_read == TRUE)
+                    {
+                        // Update NV Process Info
+                        ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_READ;
+                        // Update Memory State machine
+                        SetState(instance_id, EXTERNAL_FLASH_STATE_READ);
+                        // Read payload data, header sent as address phase
+                        ReadData(instance_id);
+                    }
+                    else
+                    {
+                        // Update NV Process Info
+                        ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
+                        // Update Memory State machine
+                        SetState(instance_id, EXTERNAL_FLASH_STATE_WRITE);
+                        // Write (partial) page, header sent as address phase
+                        WriteData(instance_id, GetWriteSize(instance_id));
+                    }
+#else
+                    if(before_read == TRUE)
+                    {
+                        // Update NV Process Info
+                        ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
+                        // Update Memory State machine
+                        SetState(instance_id, EXTERNAL_FLASH_STATE_SEND_READ_HEADER);
+                        // Send read header
+                        SendReadHeader(instance_id);
+                    }
+                    else
+                    {
+                        // Update NV Process Info
+                        ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
+                        // Update Memory State machine
+                        SetState(instance_id, EXTERNAL_FLASH_STATE_SEND_WRITE_HEADER);
+                        // Send write header
+                        SendWriteHeader(instance_id);
+                    }
+#endif
                 }
                 else
                 {
-                    if(ExternalFlash_Map[instance_id].ExternalFlash_WP_Feature == ENABLED)
+                    if(ready == TRUE)
                     {
-                        // Activate agin Write Protection
-                        GENERIC_IO_HANDLERS[GENERIC_IO_DIGITALIO].Write(ExternalFlash_Map[instance_id].ExternalFlash_WP_Pin, !ExternalFlash_Map[instance_id].ExternalFlash_WP_Level);
+                        // Chip ready but bus busy
+                        EXTERNAL_FLASH_STATS_COUNT(instance_id, Retries, 1);
                     }
                     
-                    // Fill NV callback data
-                    nv_callback.Source_Instance_Id = instance_id;
-                    nv_callback.Event_Value = COMBINE_BYTES(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process,
-                                                            ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size);
-                    
-                    // Trigger Callback Notify
-                    ExecuteCallBack(nv_callback);
-            
                     // Update NV Process Info
                     ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_NONE;
                     // Update Memory State machine
-                    ExternalFlash_Instance_Store[instance_id].NVM_State = EXTERNAL_FLASH_STATE_IDLE;
+                    SetState(instance_id, (before_read == TRUE) ?
+                                          EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_READ :
+                                          EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_WRITE);
                 }
             }
-            
             break;
-
-          case EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND:
             
-            break;
+          case EXTERNAL_FLASH_STATE_SEND_READ_HEADER:
+            // Check if NV Process is "write complete", Header data has been transmitted
+            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_WRITE)
+            {
+                // Update NV Process Info
+                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_READ;
+                // Update Memory State machine
+                SetState(instance_id, EXTERNAL_FLASH_STATE_READ);
+                        
+                // Read payload data
+                ReadData(instance_id);
+            }
+            break;
+            
+          case EXTERNAL_FLASH_STATE_READ:
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+            // Check if NV Process is "read complete" for the old metadata of the page to write, the write goes on
+            if((ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_READ) &&
+               (ExternalFlash_Instance_Spare[instance_id].Loading == TRUE))
+            {
+                stop_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);
+                
+                ExternalFlash_Instance_Spare[instance_id].Loading = FALSE;
+                ExternalFlash_Instance_Spare[instance_id].Loaded = TRUE;
+                if(ExternalFlash_Instance_Spare[instance_id].Merge == TRUE)
+                {
+                    MergePage(instance_id);
+                }
+                
+                // Write the page on next turn, once the chip is ready
+                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_NONE;
+                SetState(instance_id, EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_WRITE);
+                ScheduleHandler(0);     // Request immediate execution on next turn
+            }
+            // Check if NV Process is "read complete" with pages left, reads are split at the page spare areas
+            else if((ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_READ) &&
+               ((ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress + GetReadSize(instance_id)) < ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size))
+            {
+                stop_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);
+                
+                EXTERNAL_FLASH_STATS_COUNT(instance_id, Buffer_Reads, (GetReadBuffer(instance_id) != EXTERNAL_FLASH_BUFFER_NONE) ? 1 : 0);
+                
+                ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress += GetReadSize(instance_id);
+                
+                // Read the next page on next turn, once the chip is ready
+                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_NONE;
+                SetState(instance_id, EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_READ);
+                ScheduleHandler(0);     // Request immediate execution on next turn
+            }
+            else
+#endif
+            // Check if NV Process is "read complete", payload data has been read
+            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_READ)
+            {
+                BOOL_TYPE scrub = EXTERNAL_FLASH_SCRUBBING(instance_id);
+                BOOL_TYPE blank = EXTERNAL_FLASH_BLANK_CHECKING(instance_id);
+                
+                stop_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);   
+                
+                EXTERNAL_FLASH_STATS_COUNT(instance_id, Buffer_Reads, (GetReadBuffer(instance_id) != EXTERNAL_FLASH_BUFFER_NONE) ? 1 : 0);
+                
+                ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress = ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size;
+                
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+                if(ExternalFlash_Map[instance_id].ExternalFlash_WP_Feature == ENABLED)
+                {
+                    // Activate again Write Protection, released if the read committed the chip buffer
+                    GENERIC_IO_HANDLERS[GENERIC_IO_DIGITALIO].Write(ExternalFlash_Map[instance_id].ExternalFlash_WP_Pin, !ExternalFlash_Map[instance_id].ExternalFlash_WP_Level);
+                }
+#endif
+                
+                if((scrub == FALSE) && (blank == FALSE))
+                {
+                    EXTERNAL_FLASH_STATS_COMPLETE(instance_id, FALSE);
+                    
+                    // Check the whole pages read against their CRC, page metadata reads have no page data
+                    if(EXTERNAL_FLASH_SPARE_ACTIVE(instance_id) == FALSE)
+                    {
+                        EXTERNAL_FLASH_INTEGRITY_READ(instance_id);
+                    }
+                }
+                
+                // Fill NV callback data
+                nv_callback.Source_Instance_Id = instance_id;
+                nv_callback.Event_Value = COMBINE_BYTES(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process,
+                                                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size);
+                
+                // Update NV Process Info
+                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_NONE;
+                // Update Memory State machine
+                SetState(instance_id, EXTERNAL_FLASH_STATE_IDLE);
+                // Release the chip
+                ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance = INVALID_VALUE_8;
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+                ExternalFlash_Instance_Spare[instance_id].Active = FALSE;
+#endif
+                
+                if(scrub == TRUE)
+                {
+                    // Scrub reads are checked by the scrub itself, not notified
+                    EXTERNAL_FLASH_SCRUB_COMPLETE(instance_id);
+                }
+                else if(blank == TRUE)
+                {
+                    // Blank check steps are notified once the whole range is checked
+                    EXTERNAL_FLASH_BLANK_COMPLETE(instance_id);
+                }
+                else
+                {
+                    // Trigger Callback Notify
+                    ExecuteCallBack(nv_callback);
+                }
+            }
+            break;
+            
+          case EXTERNAL_FLASH_STATE_SEND_WRITE_HEADER:
+            // Check if NV Process is "write complete", Header data has been transmitted
+            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_WRITE)
+            {
+                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
+                
+                // Update Memory State machine
+                SetState(instance_id, EXTERNAL_FLASH_STATE_WRITE);
+                // Write (partial) page, in the same transaction of the header
+                WriteData(instance_id, GetWriteSize(instance_id));                  
+            }
+            
+            break;
+            
+          case EXTERNAL_FLASH_STATE_WRITE:
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+          case EXTERNAL_FLASH_STATE_WRITE_SPARE:
+            // Check if NV Process is "write complete" for page data with metadata, sent in the same transaction so that
+            // the page is programmed once
+            if((ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_WRITE) &&
+               (ExternalFlash_Instance_Store[instance_id].NVM_State == EXTERNAL_FLASH_STATE_WRITE) &&
+               (ExternalFlash_Instance_Spare[instance_id].Active == TRUE) &&
+               (ExternalFlash_Instance_Operation[instance_id] == EXTERNAL_FLASH_OPERATION_WRITE))
+            {
+                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
+                
+                // Update Memory State machine
+                SetState(instance_id, EXTERNAL_FLASH_STATE_WRITE_SPARE);
+                // Write the page metadata, right after the page data in the spare area
+                WriteSpare(instance_id);
+            }
+            else
+#endif
+            // Check if NV Process is "write complete", Header data has been transmitted
+            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_WRITE)
+            {
+                // Chip starts programming the page when the transaction ends
+                stop_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);
+                
+                if(ExternalFlash_Instance_Operation[instance_id] == EXTERNAL_FLASH_OPERATION_PROGRAM)
+                {
+                    // Buffer 1 holds the programmed bytes only, not a page image, and any copy of the page is stale
+                    InvalidateBuffers(instance_id, (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress), 1);
+                    ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Buffer_Page[0] = INVALID_VALUE_16;
+                    ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Busy_Buffer = 0;
+                    SetChipBusy(instance_id, EXTERNAL_FLASH_CHIP_OP_PROGRAM);
+                    
+                    EXTERNAL_FLASH_STATS_COUNT(instance_id, Page_Writes, 1);
+                }
+                else
+                {
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+                    // Data is in the chip buffer only, programmed by a later commit
+                    ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Buffer_Page[EXTERNAL_FLASH_COMBINE_BUFFER] = (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress);
+                    ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Buffer_Dirty = TRUE;
+                    ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Buffer_Instance = instance_id;
+                    ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Buffer_Write_Us = EXTERNAL_FLASH_TIMESTAMP_US();
+                    
+                    EXTERNAL_FLASH_STATS_COUNT(instance_id, Buffer_Writes, 1);
+#else
+                    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+                    uint8_t buffer = (chip->Busy_Buffer == 0) ? 1 : 0;
+                    uint16_t page = (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress);
+                    
+                    // Read-modify-write leaves the new page content in its buffer, the other one may hold a stale copy
+                    InvalidateBuffers(instance_id, page, 1);
+                    chip->Buffer_Page[buffer] = page;
+                    chip->Busy_Buffer = buffer;
+                    SetChipBusy(instance_id, EXTERNAL_FLASH_CHIP_OP_ERASE_PROGRAM);
+                    
+                    // Read-modify-write erases the page before programming it
+                    EXTERNAL_FLASH_STATS_COUNT(instance_id, Page_Writes, 1);
+                    EXTERNAL_FLASH_STATS_COUNT(instance_id, Page_Erases, 1);
+#endif
+                }
+                
+                EXTERNAL_FLASH_INTEGRITY_WRITE(instance_id, GetWriteSize(instance_id));
+                EXTERNAL_FLASH_BLANK_WRITE(instance_id);
+                
+                ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress += GetWriteSize(instance_id);
+                
+                if(ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress < ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size)       // If there is still something to write
+                {
+                    // Wait for the page program to complete before the next page, starting on next turn
+                    ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_NONE;
+                    SetState(instance_id, EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_WRITE);
+                }
+                else
+                {
+                    WriteComplete(instance_id);
+                }
+            }
+            
+            break;
+            
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+          case EXTERNAL_FLASH_STATE_COMMIT_BUFFER_BEFORE_READ:
+          case EXTERNAL_FLASH_STATE_COMMIT_BUFFER_BEFORE_WRITE:
+          case EXTERNAL_FLASH_STATE_LOAD_BUFFER:
+            // Check if NV Process is "write complete", buffer command has been transmitted
+            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_WRITE)
+            {
+                // Chip starts the page program or the page to buffer transfer when the transaction ends
+                stop_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);
+                
+                ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Busy_Buffer = EXTERNAL_FLASH_COMBINE_BUFFER;
+                
+                if(ExternalFlash_Instance_Store[instance_id].NVM_State == EXTERNAL_FLASH_STATE_LOAD_BUFFER)
+                {
+                    ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Buffer_Page[EXTERNAL_FLASH_COMBINE_BUFFER] = (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress);
+                    SetChipBusy(instance_id, EXTERNAL_FLASH_CHIP_OP_TRANSFER);
+                }
+                else
+                {
+                    // Buffer to main memory with built-in erase, the buffer still holds the page
+                    ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Buffer_Dirty = FALSE;
+                    SetChipBusy(instance_id, EXTERNAL_FLASH_CHIP_OP_ERASE_PROGRAM);
+                    EXTERNAL_FLASH_STATS_COUNT(instance_id, Page_Writes, 1);
+                    EXTERNAL_FLASH_STATS_COUNT(instance_id, Page_Erases, 1);
+                }
+                
+                // Wait for the chip before going on with the operation, starting on next turn
+                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_NONE;
+                SetState(instance_id, (ExternalFlash_Instance_Store[instance_id].NVM_State == EXTERNAL_FLASH_STATE_COMMIT_BUFFER_BEFORE_READ) ?
+                                      EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_READ :
+                                      EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_WRITE);
+            }
+            break;
+#endif
+            
+          case EXTERNAL_FLASH_STATE_ERASE:
+            // Check if NV Process is "write complete", erase command has been transmitted
+            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_WRITE)
+            {
+                uint16_t erase_size = GetEraseSize(instance_id);
+                
+                // Chip starts erasing when the transaction ends, no buffer is involved
+                stop_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);
+                
+                InvalidateBuffers(instance_id, (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress),
+                                  (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, erase_size));
+                ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Busy_Buffer = EXTERNAL_FLASH_BUFFER_NONE;
+                SetChipBusy(instance_id, (erase_size == EXTERNAL_FLASH_BLOCK_SIZE(instance_id)) ? EXTERNAL_FLASH_CHIP_OP_BLOCK_ERASE : EXTERNAL_FLASH_CHIP_OP_PAGE_ERASE);
+                
+                EXTERNAL_FLASH_STATS_COUNT(instance_id, Page_Erases, EXTERNAL_FLASH_PAGE_OF(instance_id, erase_size));
+                EXTERNAL_FLASH_INTEGRITY_ERASE(instance_id, erase_size);
+                EXTERNAL_FLASH_BLANK_ERASE(instance_id, erase_size);
+                
+                ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress += erase_size;
+                
+                if(ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress < ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size)
+                {
+                    // Wait for the erase to complete before the next block or page, starting on next turn
+                    ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_NONE;
+                    SetState(instance_id, EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_WRITE);
+                }
+                else
+                {
+                    WriteComplete(instance_id);
+                }
+            }
+            break;
+
+#if (EXTERNAL_FLASH_DETECT_FEATURE == ENABLED)
+          case EXTERNAL_FLASH_STATE_DETECT_ID:
+            // Check if NV Process is "write complete", ID read command has been transmitted
+            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_WRITE)
+            {
+                // Update NV Process Info
+                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_READ;
+                
+                ReadDeviceId(instance_id);
+            }
+            // Check if NV Process is "read complete", JEDEC ID has been read
+            else if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_READ)
+            {
+                stop_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);
+                
+                // Read the page size configuration on next turn
+                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_NONE;
+                SetState(instance_id, EXTERNAL_FLASH_STATE_DETECT_PAGE_SIZE);
+                ScheduleHandler(0);     // Request immediate execution on next turn
+            }
+            break;
+            
+          case EXTERNAL_FLASH_STATE_DETECT_PAGE_SIZE:
+            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_NONE)
+            {
+                if(start_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel) == TRUE)
+                {
+                    // Update NV Process Info
+                    ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
+                    
+                    SendCommand(instance_id, EXTERNAL_FLASH_CMD_READ_STATUS_REGISTER);
+                }
+            }
+            // Check if NV Process is "write complete", Status Register command has been transmitted
+            else if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_WRITE)
+            {
+                // Update NV Process Info
+                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_READ;
+                
+                ReadStatusRegister(instance_id);
+            }
+            // Check if NV Process is "read complete", Status Register has been read
+            else if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_READ)
+            {
+                stop_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);
+                
+                SetGeometry(ExternalFlash_Instance_Chip[instance_id],
+                            (ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Status_Register.PageSize == 1) ? TRUE : FALSE);
+                ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Detected = TRUE;
+                
+                // Update NV Process Info
+                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_NONE;
+                // Update Memory State machine
+                SetState(instance_id, EXTERNAL_FLASH_STATE_IDLE);
+                // Release the chip
+                ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance = INVALID_VALUE_8;
+            }
+            break;
+#endif
+            
+          case EXTERNAL_FLASH_STATE_INVALID:
+          default:
+            break;
+        }
+    }
+}
+
+
+BOOL_TYPE ExternalFlash__Read(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size)
+{
+    BOOL_TYPE success = StartRead(instance_id, buffer, data_address, size);
+    
+    EXTERNAL_FLASH_CAPTURE(EXTERNAL_FLASH_CAPTURE_RECORD_READ, instance_id, data_address, size, success);
+    
+    return success;
+}
+
+
+BOOL_TYPE ExternalFlash__Write(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size)
+{
+    EXTERNAL_FLASH_OPERATION_TYPE operation = EXTERNAL_FLASH_OPERATION_WRITE;
+    BOOL_TYPE success = FALSE;
+    
+#if (EXTERNAL_FLASH_BLANK_FEATURE == ENABLED) && (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == DISABLED)
+    // Pages known erased only need a program, tP instead of the tEP of the read-modify-write
+    if((ExternalFlash__IsErased(instance_id, data_address, size) == TRUE) && (EXTERNAL_FLASH_MERGE_WRITES(instance_id) == FALSE))
+    {
+        operation = EXTERNAL_FLASH_OPERATION_PROGRAM;
+    }
+#endif
+    success = StartWrite(instance_id, buffer, data_address, size, operation);
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    if((success == TRUE) && (EXTERNAL_FLASH_MERGE_WRITES(instance_id) == TRUE))
+    {
+        // Each page is written whole with its metadata, see EXTERNAL_FLASH_SPARE_FEATURE
+        StartMerge(instance_id, FALSE);
+    }
+#endif
+    
+    EXTERNAL_FLASH_CAPTURE(EXTERNAL_FLASH_CAPTURE_RECORD_WRITE, instance_id, data_address, size, success);
+    
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Programs data into erased space, without the built-in erase of ExternalFlash__Write
+ * @details Only the bytes written are programmed, the rest of their pages is left as is: the target range must have
+ *          been erased (ExternalFlash__Erase) and not programmed since, otherwise the result is the bitwise AND of old
+ *          and new data. A page program takes tP instead of the tEP of a write. On a chip with a spare area the pages
+ *          are merged and written whole with their metadata, as by ExternalFlash__Write, the result is the same.
+ *          Completion is notified as a write.
+ * @param   instance_id: External Flash instance
+ * @param   buffer: data to program, must stay valid until the completion callback
+ * @param   data_address: address in the instance
+ * @param   size: bytes to program, not 0
+ * @return  TRUE if the program was started, FALSE if the instance or its chip is busy
+ */
+BOOL_TYPE ExternalFlash__Program(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+    
+    if(size > 0)
+    {
+        success = StartWrite(instance_id, buffer, data_address, size,
+                             (EXTERNAL_FLASH_MERGE_WRITES(instance_id) == TRUE) ? EXTERNAL_FLASH_OPERATION_WRITE : EXTERNAL_FLASH_OPERATION_PROGRAM);
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+        if((success == TRUE) && (EXTERNAL_FLASH_MERGE_WRITES(instance_id) == TRUE))
+        {
+            StartMerge(instance_id, TRUE);
+        }
+#endif
+    }
+    
+    EXTERNAL_FLASH_CAPTURE(EXTERNAL_FLASH_CAPTURE_RECORD_PROGRAM, instance_id, data_address, size, success);
+    
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Erases whole pages, using block erases where the range covers whole aligned blocks
+ * @details On a chip with a spare area the page metadata is erased with the page data. Completion is notified as a
+ *          write.
+ * @param   instance_id: External Flash instance
+ * @param   data_address: address in the instance, page aligned in the device
+ * @param   size: bytes to erase, a multiple of the page size and not 0
+ * @return  TRUE if the erase was started, FALSE if the range is not made of whole pages or the instance or its chip is
+ *          busy
+ */
+BOOL_TYPE ExternalFlash__Erase(uint8_t instance_id, uint32_t data_address, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+    
+    if((instance_id < EXTERNAL_FLASH_CH_NUM) &&
+       (size > 0) && (EXTERNAL_FLASH_PAGE_OFFSET(instance_id, size) == 0) &&
+       (EXTERNAL_FLASH_PAGE_OFFSET(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Instance_Memory_Offset + data_address) == 0))
+    {
+        success = StartWrite(instance_id, NULL, data_address, size, EXTERNAL_FLASH_OPERATION_ERASE);
+    }
+    
+    EXTERNAL_FLASH_CAPTURE(EXTERNAL_FLASH_CAPTURE_RECORD_ERASE, instance_id, data_address, size, success);
+    
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Programs the page held in the chip buffer of the instance, if it holds combined writes not programmed yet
+ * @details Completion is notified as a write of size 0.
+ * @param   instance_id: External Flash instance
+ * @return  TRUE if the flush was started, FALSE if the instance or its chip is busy or
+ *          EXTERNAL_FLASH_WRITE_COMBINE_FEATURE is disabled (writes are programmed before their callback)
+ */
+BOOL_TYPE ExternalFlash__Flush(uint8_t instance_id)
+{
+    BOOL_TYPE success = FALSE;
+    
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+    // If a valid instance with a bound bus instance, and no current process active neither on the instance nor on its chip
+    if((instance_id < EXTERNAL_FLASH_CH_NUM) &&
+       (ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel != INVALID_VALUE_8) &&
+       (ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_NONE) &&
+       (ExternalFlash_Instance_Store[instance_id].NVM_State == EXTERNAL_FLASH_STATE_IDLE) &&
+       (ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance == INVALID_VALUE_8))
+    {
+        success = StartFlush(instance_id, TRUE);
+    }
+#else
+    (void)instance_id;
+#endif
+    
+    EXTERNAL_FLASH_CAPTURE(EXTERNAL_FLASH_CAPTURE_RECORD_FLUSH, instance_id, 0, 0, success);
+    
+    return success;
+}
+
+
+
+uint8_t ExternalFlash__GetAllocation(uint8_t client_id, void* mirror_pointer, uint16_t nv_instance_offset)
+{
+    uint8_t instance_id = INVALID_VALUE_8;
+
+    // Scroll through ExternalFlash_Map
+    for(instance_id = 0; instance_id < ELEMENTS_IN_ARRAY(ExternalFlash_Map); instance_id++)
+    {
+        // If client id matches
+        if(ExternalFlash_Map[instance_id].ExternalFlash_Channel == (EXTERNAL_FLASH_CH_TYPE)client_id)
+        {
+            // Chache matching instance id            
+            ExternalFlash_Instance_Store[instance_id].NVM_Mirror_Pointer = mirror_pointer;    
+            ExternalFlash_Instance_Store[instance_id].NVM_Instance_Memory_Offset = nv_instance_offset;                   
+            break;
+        }
+    }
+    
+    EXTERNAL_FLASH_CAPTURE(EXTERNAL_FLASH_CAPTURE_RECORD_ALLOCATION, client_id, nv_instance_offset, instance_id, (mirror_pointer != NULL) ? TRUE : FALSE);
+    
+    return instance_id;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Registers event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlash__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value)
+{
+    Callback__Register(&ExternalFlash_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler, filter_id, filter_value);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Unregisters event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlash__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler)
+{
+    Callback__Unregister(&ExternalFlash_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Tells if a request to the instance would be rejected or would have to wait for the chip
+ * @details The instance is busy while it runs a request, while another instance (or a scrub or blank check step) owns
+ *          its chip, and while the chip is expected to be still programming or erasing after the last request ended.
+ * @param   externalflash_instance: External Flash instance
+ * @return  TRUE if busy, invalid or not bound to a bus yet, FALSE otherwise
+ */
+BOOL_TYPE ExternalFlash__IsBusy(uint8_t externalflash_instance)
+{
+    BOOL_TYPE retval = TRUE;
+    
+    if((externalflash_instance < EXTERNAL_FLASH_CH_NUM) &&
+       (ExternalFlash_Instance_Store[externalflash_instance].NVM_State == EXTERNAL_FLASH_STATE_IDLE) &&
+       (ExternalFlash_Instance_Store[externalflash_instance].NVM_Current_Process == NVDATA_PROCESS_NONE) &&
+       (ExternalFlash_Chip[ExternalFlash_Instance_Chip[externalflash_instance]].Active_Instance == INVALID_VALUE_8) &&
+       (GetChipBusyUs(externalflash_instance) == 0))
+    {
+        retval = FALSE;
+    }
+    return retval;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   RDY/BUSY pin rising edge, to be called from the pin interrupt
+ * @details Resumes the instances waiting for their chip at once instead of on the next handler period.
+ */
+void ExternalFlash__ReadyPinInterrupt(void)
+{
+#if (EXTERNAL_FLASH_READY_PIN_FEATURE == ENABLED)
+    ScheduleHandler(0);     // Request immediate execution on next turn
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Estimates the time before the instance is idle on a ready chip
+ * @details The estimate adds the remaining part of the request owning the chip, from its pages left, the typical
+ *          operation times (EXTERNAL_FLASH_PAGE_ERASE_PROGRAM_US...) and EXTERNAL_FLASH_BUS_BYTES_PER_MS, to the time the
+ *          chip is expected to stay busy with the last operation started. It is corrected by each status poll.
+ * @param   instance_id: External Flash instance
+ * @return  estimated time in us, 0 if idle, INVALID_VALUE_32 if the instance is invalid or not bound to a bus yet
+ */
+uint32_t ExternalFlash__GetTimeToIdle(uint8_t instance_id)
+{
+    uint32_t time_us = INVALID_VALUE_32;
+    
+    if((instance_id < EXTERNAL_FLASH_CH_NUM) &&
+       (ExternalFlash_Instance_Store[instance_id].NVM_State != EXTERNAL_FLASH_STATE_INITIALIZE))
+    {
+        uint8_t active_id = ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance;
+        
+        time_us = GetChipBusyUs(instance_id);
+        if(active_id != INVALID_VALUE_8)
+        {
+            time_us += GetRemainingUs(active_id);
+        }
+    }
+    return time_us;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gets the geometry of the chip of the instance, as detected or configured
+ * @details Instance addresses map linearly on the device pages: page n holds the device bytes [n * Page_Size,
+ *          (n + 1) * Page_Size). Page spare areas are not in the device bytes.
+ * @param   instance_id: External Flash instance
+ * @param   geometry: geometry copy
+ * @return  TRUE if the geometry was copied, FALSE if the instance is invalid or its chip is not detected yet
+ */
+BOOL_TYPE ExternalFlash__GetGeometry(uint8_t instance_id, EXTERNAL_FLASH_GEOMETRY_TYPE* geometry)
+{
+    BOOL_TYPE retval = FALSE;
+    
+    if((instance_id < EXTERNAL_FLASH_CH_NUM) &&
+       (ExternalFlash_Instance_Store[instance_id].NVM_State != EXTERNAL_FLASH_STATE_INITIALIZE) &&
+       (ExternalFlash_Instance_Store[instance_id].NVM_State != EXTERNAL_FLASH_STATE_DETECT_ID) &&
+       (ExternalFlash_Instance_Store[instance_id].NVM_State != EXTERNAL_FLASH_STATE_DETECT_PAGE_SIZE))
+    {
+        *geometry = ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Geometry;
+        retval = TRUE;
+    }
+    return retval;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Writes whole pages together with their metadata, see EXTERNAL_FLASH_SPARE_FEATURE
+ * @details Each page is written as by ExternalFlash__Write, its metadata in the same page program: spare gives the
+ *          sequence of all the pages and the logical page of the first one, +1 for each next page. The driver sets the
+ *          CRC of each page data, and its erase count from the one of the old page metadata, read before the write.
+ *          Completion is notified as a write.
+ * @param   instance_id: External Flash instance
+ * @param   buffer: data to write, must stay valid until the completion callback
+ * @param   data_address: address in the instance, page aligned
+ * @param   size: bytes to write, whole pages, not 0
+ * @param   spare: metadata of the first page, copied; its CRC and erase count are not used
+ * @return  TRUE if the write was started, FALSE if the chip has no spare area, the range is not made of whole pages or
+ *          the instance or its chip is busy
+ */
+BOOL_TYPE ExternalFlash__WritePages(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size, const EXTERNAL_FLASH_SPARE_TYPE* spare)
+{
+    BOOL_TYPE success = FALSE;
+    
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    if((instance_id < EXTERNAL_FLASH_CH_NUM) && (EXTERNAL_FLASH_SPARE_SIZE(instance_id) != 0) &&
+       (size > 0) && (EXTERNAL_FLASH_PAGE_OFFSET(instance_id, size) == 0) &&
+       (EXTERNAL_FLASH_PAGE_OFFSET(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Instance_Memory_Offset + data_address) == 0))
+    {
+        success = StartWrite(instance_id, buffer, data_address, size, EXTERNAL_FLASH_OPERATION_WRITE);
+        if(success == TRUE)
+        {
+            ExternalFlash_Instance_Spare[instance_id].First = *spare;
+            ExternalFlash_Instance_Spare[instance_id].Active = TRUE;
+            ExternalFlash_Instance_Spare[instance_id].Loaded = FALSE;
+        }
+    }
+#else
+    (void)instance_id;
+    (void)buffer;
+    (void)data_address;
+    (void)size;
+    (void)spare;
+#endif
+    
+    EXTERNAL_FLASH_CAPTURE(EXTERNAL_FLASH_CAPTURE_RECORD_WRITE_PAGES, instance_id, data_address, size, success);
+    
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the metadata of consecutive pages, without their data, see EXTERNAL_FLASH_SPARE_FEATURE
+ * @details Each page metadata is a short read of its spare area; erased pages read all 0xFF. Completion is notified
+ *          as a read of page_num metadata.
+ * @param   instance_id: External Flash instance
+ * @param   spare: metadata of each page, must stay valid until the completion callback
+ * @param   data_address: address in the instance of the first page, page aligned
+ * @param   page_num: pages, not 0
+ * @return  TRUE if the read was started, FALSE if the chip has no spare area, the address is not page aligned or the
+ *          instance or its chip is busy
+ */
+BOOL_TYPE ExternalFlash__ReadSpare(uint8_t instance_id, EXTERNAL_FLASH_SPARE_TYPE* spare, uint32_t data_address, uint16_t page_num)
+{
+    BOOL_TYPE success = FALSE;
+    
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    if((instance_id < EXTERNAL_FLASH_CH_NUM) && (EXTERNAL_FLASH_SPARE_SIZE(instance_id) != 0) &&
+       (page_num > 0) && (page_num <= (INVALID_VALUE_16 / sizeof(EXTERNAL_FLASH_SPARE_TYPE))) &&
+       (EXTERNAL_FLASH_PAGE_OFFSET(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Instance_Memory_Offset + data_address) == 0))
+    {
+        success = StartRead(instance_id, spare, data_address, page_num * sizeof(EXTERNAL_FLASH_SPARE_TYPE));
+        if(success == TRUE)
+        {
+            ExternalFlash_Instance_Spare[instance_id].Active = TRUE;
+        }
+    }
+#else
+    (void)instance_id;
+    (void)spare;
+    (void)data_address;
+    (void)page_num;
+#endif
+    
+    EXTERNAL_FLASH_CAPTURE(EXTERNAL_FLASH_CAPTURE_RECORD_READ_SPARE, instance_id, data_address, page_num, success);
+    
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the blank check of consecutive pages, see EXTERNAL_FLASH_BLANK_FEATURE
+ * @details The pages are read in the background while the chip is idle, client requests going on in between, and each
+ *          page is marked erased or not. Completion is notified with EXTERNAL_FLASH_PROCESS_SCAN_COMPLETE, size 0.
+ * @param   instance_id: External Flash instance
+ * @param   data_address: address in the instance of the first page, page aligned in the device
+ * @param   page_num: pages, not 0
+ * @return  TRUE if the check was started, FALSE if the range is out of the device or not page aligned, the instance is
+ *          not ready yet, a check is already running on its chip or EXTERNAL_FLASH_BLANK_FEATURE is disabled
+ */
+BOOL_TYPE ExternalFlash__ScanErased(uint8_t instance_id, uint32_t data_address, uint16_t page_num)
+{
+    BOOL_TYPE success = FALSE;
+    
+#if (EXTERNAL_FLASH_BLANK_FEATURE == ENABLED)
+    if((instance_id < EXTERNAL_FLASH_CH_NUM) &&
+       (ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel != INVALID_VALUE_8) &&
+       (ExternalFlash_Instance_Store[instance_id].NVM_State != EXTERNAL_FLASH_STATE_INITIALIZE) &&
+       (ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Blank_Instance == INVALID_VALUE_8))
+    {
+        uint32_t address = ExternalFlash_Instance_Store[instance_id].NVM_Instance_Memory_Offset + data_address;
+        
+        if((page_num > 0) && (EXTERNAL_FLASH_PAGE_OFFSET(instance_id, address) == 0) &&
+           ((EXTERNAL_FLASH_PAGE_OF(instance_id, address) + page_num) <= EXTERNAL_FLASH_PAGE_NUMBER(instance_id)))
+        {
+            ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Blank_Instance = instance_id;
+            ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Blank_Address = address;
+            ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Blank_End = address + ((uint32_t)page_num * EXTERNAL_FLASH_PAGE_SIZE(instance_id));
+            
+            // First step on next turn
+            ScheduleHandler(0);
+            
+            success = TRUE;
+        }
+    }
+#else
+    (void)instance_id;
+    (void)data_address;
+    (void)page_num;
+#endif
+    
+    EXTERNAL_FLASH_CAPTURE(EXTERNAL_FLASH_CAPTURE_RECORD_SCAN_ERASED, instance_id, data_address, page_num, success);
+    
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Tells if the pages holding a range are known erased, see EXTERNAL_FLASH_BLANK_FEATURE
+ * @details Answers from the erased page map, without bus access: pages erased by ExternalFlash__Erase or found blank by
+ *          ExternalFlash__ScanErased, not written or programmed since.
+ * @param   instance_id: External Flash instance
+ * @param   data_address: address in the instance
+ * @param   size: bytes, not 0
+ * @return  TRUE if all the pages are known erased, FALSE otherwise, for an invalid instance or range and if
+ *          EXTERNAL_FLASH_BLANK_FEATURE is disabled
+ */
+BOOL_TYPE ExternalFlash__IsErased(uint8_t instance_id, uint32_t data_address, uint16_t size)
+{
+    BOOL_TYPE erased = FALSE;
+    
+#if (EXTERNAL_FLASH_BLANK_FEATURE == ENABLED)
+    if((instance_id < EXTERNAL_FLASH_CH_NUM) && (size > 0))
+    {
+        EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+        uint32_t address = ExternalFlash_Instance_Store[instance_id].NVM_Instance_Memory_Offset + data_address;
+        
+        if((address + size) <= EXTERNAL_FLASH_NUMBER_OF_BYTES(instance_id))
+        {
+            uint16_t last_page = (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, address + size - 1);
+            
+            erased = TRUE;
+            for(uint16_t page = (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, address); (page <= last_page) && (erased == TRUE); page++)
+            {
+                if((chip->Page_Erased[page / 8] & (1 << (page % 8))) == 0)
+                {
+                    erased = FALSE;
+                }
+            }
+        }
+    }
+#else
+    (void)instance_id;
+    (void)data_address;
+    (void)size;
+#endif
+    
+    return erased;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reports the CRC mismatches found by the reads of the instance since the previous call
+ * @details Only reads covering whole pages are checked, against the CRC the driver keeps for each page it wrote,
+ *          programmed, erased or read whole before. The mismatch report is cleared by the call.
+ * @param   flash_instance: External Flash instance
+ * @return  FALSE if a page read did not match its CRC or the instance is invalid, TRUE otherwise and if
+ *          EXTERNAL_FLASH_INTEGRITY_FEATURE is disabled
+ */
+BOOL_TYPE ExternalFlash__CheckIntegrity(uint8_t flash_instance)
+{
+    BOOL_TYPE retval = TRUE;
+    
+#if (EXTERNAL_FLASH_INTEGRITY_FEATURE == ENABLED)
+    if(flash_instance >= EXTERNAL_FLASH_CH_NUM)
+    {
+        retval = FALSE;
+    }
+    else if(ExternalFlash_Integrity_Error[flash_instance] == TRUE)
+    {
+        ExternalFlash_Integrity_Error[flash_instance] = FALSE;
+        retval = FALSE;
+    }
+#else
+    (void)flash_instance;
+#endif
+    return retval;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gets a snapshot of the instance statistics
+ * @param   instance_id: External Flash instance
+ * @param   stats: statistics copy
+ * @return  TRUE if the statistics were copied, FALSE if the instance is invalid or EXTERNAL_FLASH_STATS_FEATURE is disabled
+ */
+BOOL_TYPE ExternalFlash__GetStats(uint8_t instance_id, EXTERNAL_FLASH_STATS_TYPE* stats)
+{
+    BOOL_TYPE success = FALSE;
+    
+#if (EXTERNAL_FLASH_STATS_FEATURE == ENABLED)
+    if((instance_id < EXTERNAL_FLASH_CH_NUM) && (stats != NULL))
+    {
+        memcpy(stats, &ExternalFlash_Stats[instance_id].Stats, sizeof(EXTERNAL_FLASH_STATS_TYPE));
+        success = TRUE;
+    }
+#else
+    (void)instance_id;
+    (void)stats;
+#endif
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Clears the instance statistics
+ * @param   instance_id: External Flash instance
+ */
+void ExternalFlash__ResetStats(uint8_t instance_id)
+{
+#if (EXTERNAL_FLASH_STATS_FEATURE == ENABLED)
+    if(instance_id < EXTERNAL_FLASH_CH_NUM)
+    {
+        memset(&ExternalFlash_Stats[instance_id].Stats, 0x00, sizeof(EXTERNAL_FLASH_STATS_TYPE));
+    }
+#else
+    (void)instance_id;
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gets the trace block, to be dumped as raw memory and decoded with Host/ExternalFlashTraceDecode
+ * @return  trace block, NULL if EXTERNAL_FLASH_TRACE_FEATURE is disabled
+ */
+const EXTERNAL_FLASH_TRACE_TYPE* ExternalFlash__GetTrace(void)
+{
+#if (EXTERNAL_FLASH_TRACE_FEATURE == ENABLED)
+    return &ExternalFlash_Trace;
+#else
+    return NULL;
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gets the RAM capture stream, to be saved and replayed with Host/ExternalFlashReplay
+ * @param   size: stream size in bytes
+ * @param   dropped: records not captured because the buffer was full
+ * @return  capture stream, NULL if EXTERNAL_FLASH_CAPTURE_FEATURE is disabled or records go to EXTERNAL_FLASH_CAPTURE_SINK
+ */
+const uint8_t* ExternalFlash__GetCapture(uint32_t* size, uint32_t* dropped)
+{
+#if ((EXTERNAL_FLASH_CAPTURE_FEATURE == ENABLED) && defined(EXTERNAL_FLASH_CAPTURE_RAM))
+    *size = ExternalFlash_Capture_Size;
+    *dropped = ExternalFlash_Capture_Dropped;
+    return ExternalFlash_Capture;
+#else
+    *size = 0;
+    *dropped = 0;
+    return NULL;
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Computes the CRC-32 (reflected, polynomial 0xEDB88320, as zlib crc32) of data, shared by the External Flash
+ *          modules for their records and headers
+ * @details The CRC of data split in parts is computed part by part, passing the CRC of the previous parts. Modules with
+ *          16 bit CRC fields store its low 16 bits.
+ * @param   crc: CRC of the previous parts, 0 for the first part
+ * @param   data: data
+ * @param   size: data bytes
+ * @return  CRC of the data so far
+ */
+uint32_t ExternalFlash__GetCrc(uint32_t crc, const void* data, uint16_t size)
+{
+    return ~GetCrc(~crc, (const uint8_t*)data, size);
+}
+
+
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+static BOOL_TYPE SendCommand(uint8_t instance_id, uint8_t command_id)
+{
+    static uint8_t command;
+    BOOL_TYPE success = FALSE;
+    
+    // Command must outlive the call, the bus may transmit it asynchronously
+    command = command_id;
+    
+    // Get pointer to Write handler
+    COMMBUS__WRITE write_handler =  GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Write;
+        
+    // If handlers exist
+    if(write_handler != NULL)
+    {
+        // Call Handler
+        if(write_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
+                         (void*)&command, 
+                         COMMBUS_ADDRESS_NONE, 
+                         sizeof(uint8_t)) == TRUE)
+        {
+            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
+            {
+                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
+                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
+                
+                // Start Timeout handle
+                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
+            }
+    
+            // Timestamp bus request for late transfer statistics
+            EXTERNAL_FLASH_STATS_BUS_REQUEST(instance_id);
+
+            // Signal ExternalFlash request success
+            success = TRUE;
+        }
+    }
+    return success;
+}
+
+#if (EXTERNAL_FLASH_GATHER_FEATURE == DISABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      This function sends the Read Header to External FLash memory using the selected bus
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @return     TRUE if Read process was successful, FALSE otherwise
+ */
+static BOOL_TYPE SendReadHeader(uint8_t instance_id)
+{
+    static EXTERNAL_FLASH_READ_HEADER_TYPE header;
+    uint32_t command = GetReadCommand(instance_id);
+    BOOL_TYPE success = FALSE;
+    
+    header.ExternalFlash_OpCode_Cmd = (uint8_t)(command >> 24);
+    
+    EncodeAddress(header.ExternalFlash_Address, command);
+    header.ExternalFlash_Address[EXTERNAL_FLASH_ADDRESS_SIZE_BYTES] = EXTERNAL_FLASH_CMD_DUMMY;
+    
+    // Get pointer to Write handler
+    COMMBUS__WRITE write_handler =  GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Write;
+        
+    // If handlers exist
+    if(write_handler != NULL)
+    {
+        // Call Handler
+        if(write_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
+                         (void*)&header, 
+                         COMMBUS_ADDRESS_NONE, 
+                         sizeof(EXTERNAL_FLASH_READ_HEADER_TYPE)) == TRUE)
+        {
+            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
+            {
+                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
+                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
+                
+                // Start Timeout handle
+                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
+            }
+    
+            // Timestamp bus request for late transfer statistics
+            EXTERNAL_FLASH_STATS_BUS_REQUEST(instance_id);
+
+            // Signal ExternalFlash request success
+            success = TRUE;
+        }
+    }
+    
+    return success;
+}
+#endif
+
+static BOOL_TYPE ReadData(uint8_t instance_id)
+{
+    BOOL_TYPE success = FALSE;
+#if (EXTERNAL_FLASH_GATHER_FEATURE == ENABLED)
+    uint32_t bus_address = GetReadCommand(instance_id);
+#else
+    uint32_t bus_address = COMMBUS_ADDRESS_NONE;
+#endif
+    uint8_t* read_pointer = ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
+    
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    if(ExternalFlash_Instance_Spare[instance_id].Loading == TRUE)
+    {
+        // Old metadata of the page to write, or the whole old page to merge, not client data
+        read_pointer = (ExternalFlash_Instance_Spare[instance_id].Merge == TRUE) ?
+                       ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Merge_Buffer :
+                       (uint8_t*)&ExternalFlash_Instance_Spare[instance_id].Page;
+    }
+#endif
+    
+    // Get pointer to Read handler
+    COMMBUS__READ read_handler =  GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Read;
+        
+    // If handlers exist
+    if(read_handler != NULL)
+    {
+        // Call Handler
+        if(read_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
+                         (void*)read_pointer, 
+                         bus_address, 
+                         GetReadSize(instance_id)) == TRUE)
+        {
+            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
+            {
+                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
+                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
+                
+                // Start Timeout handle
+                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
+            }
+            
+            // Timestamp bus request for late transfer statistics
+            EXTERNAL_FLASH_STATS_BUS_REQUEST(instance_id);
+
+            // Signal External Flash request success
+            success = TRUE;
+        }
+    }   
+    return success;
+}
+#if (EXTERNAL_FLASH_GATHER_FEATURE == DISABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      This function sends the Write Header to External FLash memory using the selected bus
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @return     TRUE if Write process was successful, FALSE otherwise
+ */
+static BOOL_TYPE SendWriteHeader(uint8_t instance_id)
+{
+    static EXTERNAL_FLASH_WRITE_HEADER_TYPE header;
+    uint32_t command = GetWriteCommand(instance_id);
+    BOOL_TYPE success = FALSE;
+    
+    header.ExternalFlash_OpCode_Cmd = (uint8_t)(command >> 24);
+    
+    EncodeAddress(header.ExternalFlash_Address, command);
+    
+    // Get pointer to Write handler
+    COMMBUS__WRITE write_handler =  GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Write;
+    
+    // If handlers exist
+    if(write_handler != NULL)
+    {
+        // Call Handler
+        if(write_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
+                         (void*)&header, 
+                         COMMBUS_ADDRESS_NONE, 
+                         sizeof(EXTERNAL_FLASH_WRITE_HEADER_TYPE)) == TRUE)
+        {
+            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
+            {
+                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
+                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
+                
+                // Start Timeout handle
+                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
+            }
+    
+            // Timestamp bus request for late transfer statistics
+            EXTERNAL_FLASH_STATS_BUS_REQUEST(instance_id);
+
+            // Signal External FLash request success
+            success = TRUE;
+        }
+    }
+    
+    return success;
+}
+#endif
+
+static BOOL_TYPE WriteData(uint8_t instance_id, uint16_t write_size)
+{
+    BOOL_TYPE success = FALSE;
+#if (EXTERNAL_FLASH_GATHER_FEATURE == ENABLED)
+    uint32_t bus_address = GetWriteCommand(instance_id);
+#else
+    uint32_t bus_address = COMMBUS_ADDRESS_NONE;
+#endif
+    uint8_t* write_pointer = ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
+    
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    if(EXTERNAL_FLASH_MERGING(instance_id) == TRUE)
+    {
+        // Whole merged page, not client data
+        write_pointer = ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Merge_Buffer;
+        write_size = EXTERNAL_FLASH_PAGE_SIZE(instance_id);
+    }
+#endif
+ 
+    // Get pointer to Write handler
+    COMMBUS__WRITE write_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Write;
+    
+
+    if(write_handler != NULL)
+    {
+        // Call Handler
+        if(write_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
+                         (void*)write_pointer, 
+                         bus_address, 
+                         write_size) == TRUE)
+        {
+            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
+            {
+                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
+                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
+                
+                // Start Timeout handle
+                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
+            }
+        
+            // Timestamp bus request for late transfer statistics
+            EXTERNAL_FLASH_STATS_BUS_REQUEST(instance_id);
+
+            // Signal External Flash request success
+            success = TRUE;
+        }
+    }
+    
+    return success;
+}
+
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Writes the metadata of the page just written, in the same transaction of its data
+ *  @details    The page data ends at the start of the spare area, so the metadata follows it in the chip buffer and
+ *              is programmed with the page. The CRC and the logical page are set here for the page, and the erase count
+ *              of its old metadata, read before the write, is incremented: the write erases the page. An erased page
+ *              has no count (0xFFFF) and starts from 0, the count stops at 0xFFFE. A merged page keeps the sequence and
+ *              logical page of its old metadata.
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @return     TRUE if the write was started, FALSE otherwise
+ */
+static BOOL_TYPE WriteSpare(uint8_t instance_id)
+{
+    EXTERNAL_FLASH_SPARE_STATE_TYPE* spare = &ExternalFlash_Instance_Spare[instance_id];
+    uint16_t erase_count = spare->Page.Erase_Count;
+    const uint8_t* data = ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
+    BOOL_TYPE success = FALSE;
+    
+    spare->Page = spare->First;
+    spare->Page.Erase_Count = (erase_count == INVALID_VALUE_16) ? 0 :
+                              ((erase_count < (INVALID_VALUE_16 - 1)) ? (uint16_t)(erase_count + 1) : erase_count);
+    // The next page old metadata is read before its write
+    spare->Loaded = FALSE;
+    if(EXTERNAL_FLASH_MERGING(instance_id) == TRUE)
+    {
+        data = ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Merge_Buffer;
+    }
+    else
+    {
+        spare->Page.Logical_Page += (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress);
+    }
+    spare->Page.Crc = (uint16_t)ExternalFlash__GetCrc(0, data, EXTERNAL_FLASH_PAGE_SIZE(instance_id));
+    
+    // Get pointer to Write handler
+    COMMBUS__WRITE write_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Write;
+    
+    if(write_handler != NULL)
+    {
+        // Call Handler
+        if(write_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
+                         (void*)&spare->Page, 
+                         COMMBUS_ADDRESS_NONE, 
+                         sizeof(EXTERNAL_FLASH_SPARE_TYPE)) == TRUE)
+        {
+            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
+            {
+                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
+                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
+                
+                // Start Timeout handle
+                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
+            }
+        
+            // Timestamp bus request for late transfer statistics
+            EXTERNAL_FLASH_STATS_BUS_REQUEST(instance_id);
+
+            success = TRUE;
+        }
+    }
+    
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Turns the plain write or program just started into page merges, see EXTERNAL_FLASH_SPARE_FEATURE
+ *  @details    Before the write of each page its old data and metadata are read into the chip Merge_Buffer and the
+ *              new data merged in, then the whole page is written with its new metadata, as by
+ *              ExternalFlash__WritePages.
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      program : TRUE for a program, the merged data is the bitwise AND of old and new data
+ */
+static void StartMerge(uint8_t instance_id, BOOL_TYPE program)
+{
+    ExternalFlash_Instance_Spare[instance_id].Active = TRUE;
+    ExternalFlash_Instance_Spare[instance_id].Loaded = FALSE;
+    ExternalFlash_Instance_Spare[instance_id].Merge = TRUE;
+    ExternalFlash_Instance_Spare[instance_id].Merge_Program = program;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Merges the new data of the (partial) page write in progress into the old page read in Merge_Buffer
+ *  @details    The old metadata, after the page data, gives the erase count to go on from and the sequence and
+ *              logical page to keep. A program of a page with erased metadata goes on as a plain program, without
+ *              erase and without metadata, so that programs appending to a page never put its older data at risk.
+ *
+ *  @param      instance_id : specific External FLash instance
+ */
+static void MergePage(uint8_t instance_id)
+{
+    EXTERNAL_FLASH_SPARE_STATE_TYPE* spare = &ExternalFlash_Instance_Spare[instance_id];
+    uint8_t* page_data = ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Merge_Buffer;
+    uint16_t offset = (uint16_t)EXTERNAL_FLASH_PAGE_OFFSET(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress);
+    const uint8_t* data = ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
+    uint16_t write_size = GetWriteSize(instance_id);
+    BOOL_TYPE erased;
+    
+    memcpy(&spare->Page, &page_data[EXTERNAL_FLASH_PAGE_SIZE(instance_id)], sizeof(EXTERNAL_FLASH_SPARE_TYPE));
+    spare->First = spare->Page;
+    
+    erased = ((spare->Page.Crc == INVALID_VALUE_16) && (spare->Page.Sequence == INVALID_VALUE_16) &&
+              (spare->Page.Logical_Page == INVALID_VALUE_16) && (spare->Page.Erase_Count == INVALID_VALUE_16)) ? TRUE : FALSE;
+    ExternalFlash_Instance_Operation[instance_id] = ((spare->Merge_Program == TRUE) && (erased == TRUE)) ?
+                                                    EXTERNAL_FLASH_OPERATION_PROGRAM : EXTERNAL_FLASH_OPERATION_WRITE;
+    
+    // The page content after the write, see IntegrityWrite
+    for(uint16_t index = 0; index < write_size; index++)
+    {
+        page_data[offset + index] = (spare->Merge_Program == TRUE) ? (uint8_t)(page_data[offset + index] & data[index]) : data[index];
+    }
+}
+#endif
+
+static BOOL_TYPE ReadStatusRegister(uint8_t instance_id)
+{
+    BOOL_TYPE success = FALSE;
+    
+    COMMBUS__READ read_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Read;
+    if(read_handler != NULL)
+    {
+        if(read_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
+                         (void*)&ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Status_Register, 
+                         COMMBUS_ADDRESS_NONE, 
+                         sizeof(EXTERNAL_FLASH_STATUS_REGISTER_TYPE)) == TRUE)
+        {
+                    
+            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
+            {
+                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
+                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
+                
+                // Start Timeout handle
+                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
+            }
+            
+            // Timestamp bus request for late transfer statistics
+            EXTERNAL_FLASH_STATS_BUS_REQUEST(instance_id);
+
+            // Signal External Flash request success
+            success = TRUE;
+        }
+    }
+    return success;
+}
+
+#if (EXTERNAL_FLASH_DETECT_FEATURE == ENABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Reads the JEDEC ID of the instance chip into its geometry, up to the extended device information length,
+ *              the ID read command must be already sent
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @return     TRUE if the read was started, FALSE otherwise
+ */
+static BOOL_TYPE ReadDeviceId(uint8_t instance_id)
+{
+    BOOL_TYPE success = FALSE;
+    
+    COMMBUS__READ read_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Read;
+    if(read_handler != NULL)
+    {
+        if(read_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
+                         (void*)ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Geometry.Jedec_Id, 
+                         COMMBUS_ADDRESS_NONE, 
+                         sizeof(ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Geometry.Jedec_Id)) == TRUE)
+        {
+            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
+            {
+                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
+                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
+                
+                // Start Timeout handle
+                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
+            }
+            
+            // Timestamp bus request for late transfer statistics
+            EXTERNAL_FLASH_STATS_BUS_REQUEST(instance_id);
+
+            success = TRUE;
+        }
+    }
+    return success;
+}
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Sends the Read Status Register command, the transaction must be already started
+ *  @details    With the RDY/BUSY pin the status register is not read: RDY_1 is taken from the pin and the status is
+ *              handled on the next handler turn as if just read.
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      state : status polling state, before read or before write
+ */
+static void SendStatusCommand(uint8_t instance_id, EXTERNAL_FLASH_STATE_TYPE state)
+{
+#if (EXTERNAL_FLASH_READY_PIN_FEATURE == ENABLED)
+    if(ExternalFlash_Map[instance_id].ExternalFlash_Ready_Feature == ENABLED)
+    {
+        BOOL_TYPE level = GENERIC_IO_HANDLERS[GENERIC_IO_DIGITALIO].Read(ExternalFlash_Map[instance_id].ExternalFlash_Ready_Pin);
+        
+        ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Status_Register.RDY_1 = (level == ExternalFlash_Map[instance_id].ExternalFlash_Ready_Level) ? 1 : 0;
+        
+        // Update NV Process Info
+        ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_READ;
+        // Update Memory State machine
+        SetState(instance_id, (state == EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_READ) ?
+                              EXTERNAL_FLASH_STATE_READ_STATUS_REGISTER_BEFORE_READ :
+                              EXTERNAL_FLASH_STATE_READ_STATUS_REGISTER_BEFORE_WRITE);
+        
+        ScheduleHandler(0);     // Request immediate execution on next turn
+    }
+    else
+#endif
+    {
+        // Update NV Process Info
+        ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
+        // Update Memory State machine
+        SetState(instance_id, state);
+        
+        SendCommand(instance_id, EXTERNAL_FLASH_CMD_READ_STATUS_REGISTER);
+    }
+}
+
+#if (EXTERNAL_FLASH_READY_PIN_FEATURE == ENABLED) || (EXTERNAL_FLASH_PREDICTIVE_FEATURE == ENABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Tells if the instance, polling its chip, has to keep waiting without reading the status register
+ *  @details    The RDY/BUSY pin, if the instance has one, tells the actual chip state, otherwise the completion model
+ *              tells if the chip is expected still busy; the handler is then scheduled for the expected end. A read
+ *              served from a chip buffer not used by the ongoing operation does not wait.
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @return     TRUE if the chip is busy
+ */
+static BOOL_TYPE IsChipWait(uint8_t instance_id)
+{
+    BOOL_TYPE busy;
+    
+#if (EXTERNAL_FLASH_READY_PIN_FEATURE == ENABLED)
+    if(ExternalFlash_Map[instance_id].ExternalFlash_Ready_Feature == ENABLED)
+    {
+        BOOL_TYPE level = GENERIC_IO_HANDLERS[GENERIC_IO_DIGITALIO].Read(ExternalFlash_Map[instance_id].ExternalFlash_Ready_Pin);
+        
+        busy = (level != ExternalFlash_Map[instance_id].ExternalFlash_Ready_Level) ? TRUE : FALSE;
+        if(busy == TRUE)
+        {
+            // Refine the completion model as a status poll would
+            ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Status_Register.RDY_1 = 0;
+            UpdateChipTiming(instance_id);
+        }
+    }
+    else
+#endif
+    {
+        busy = ((EXTERNAL_FLASH_PREDICTIVE_FEATURE == ENABLED) && (GetChipBusyUs(instance_id) > 0)) ? TRUE : FALSE;
+#if (EXTERNAL_FLASH_PREDICTIVE_FEATURE == ENABLED)
+        if(busy == TRUE)
+        {
+            ScheduleHandler(GetChipBusyUs(instance_id));
+        }
+#endif
+    }
+    
+    if(busy == TRUE)
+    {
+        uint8_t read_buffer = (ExternalFlash_Instance_Store[instance_id].NVM_State == EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_READ) ?
+                              GetReadBuffer(instance_id) : EXTERNAL_FLASH_BUFFER_NONE;
+        
+        busy = ((read_buffer == EXTERNAL_FLASH_BUFFER_NONE) ||
+                (read_buffer == ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Busy_Buffer)) ? TRUE : FALSE;
+    }
+    return busy;
+}
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Starts a read process on an idle instance and chip
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      buffer : read data
+ *  @param      data_address : address in the instance
+ *  @param      size : bytes to read
+ *  @return     TRUE if started, FALSE if the instance or its chip is busy
+ */
+static BOOL_TYPE StartRead(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+    //If a valid instance
+    if(instance_id < EXTERNAL_FLASH_CH_NUM)
+    {
+        //if a client has a buond bus instance
+        if(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel != INVALID_VALUE_8)
+        {
+            //If no current process active, neither on this instance nor on its chip
+            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_NONE &&
+               ExternalFlash_Instance_Store[instance_id].NVM_State == EXTERNAL_FLASH_STATE_IDLE &&
+               ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance == INVALID_VALUE_8)
+            {
+                //Get pointer to start transaction handler
+                COMMBUS__STARTTRANSACTION start_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].StartTransaction;
+                
+                //If handlers exists
+                if(start_handler != NULL)
+                {
+                    if(start_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel) == TRUE)
+                    {
+                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer = (uint8_t*)buffer;
+                        ExternalFlash_Instance_Store[instance_id].NVM_Target_Address = ExternalFlash_Instance_Store[instance_id].NVM_Instance_Memory_Offset + data_address;
+                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size = size;
+                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress = 0;
+                        
+                        // Claim the chip for bus event dispatch
+                        ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance = instance_id;
+                        
+                        EXTERNAL_FLASH_STATS_REQUEST(instance_id);
+                        
+                        // Wait for the chip to be ready before sending the read header
+                        SendStatusCommand(instance_id, EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_READ);
+                        
+                        // Resume Task to process the read request
+                        SystemTimers__ResumeTask(ExternalFlash_Handler_Index);
+                        
+                        success = TRUE;
+                    }
+                }
+            }
+        }
+    }
+    
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Starts a write process (write, program or erase) on an idle instance and chip
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      buffer : data to write, NULL for an erase
+ *  @param      data_address : address in the instance
+ *  @param      size : bytes to write or erase
+ *  @param      operation : kind of write process
+ *  @return     TRUE if started, FALSE if the instance or its chip is busy
+ */
+static BOOL_TYPE StartWrite(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size, EXTERNAL_FLASH_OPERATION_TYPE operation)
+{
+     BOOL_TYPE success = FALSE;
+    
+    // If a valid instnace
+    if(instance_id < EXTERNAL_FLASH_CH_NUM)
+    {
+        // If client has a bound bus instance
+        if(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel != INVALID_VALUE_8)
+        {
+            // If no current process active, neither on this instance nor on its chip
+            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_NONE &&
+               ExternalFlash_Instance_Store[instance_id].NVM_State == EXTERNAL_FLASH_STATE_IDLE &&
+               ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance == INVALID_VALUE_8)
+            {      
+                // Get pointer to Start Transaction handler
+                COMMBUS__STARTTRANSACTION start_handler =  GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].StartTransaction;
+                
+                // If handlers exist
+                if(start_handler != NULL)
+                {
+                    // If transaction started
+                    if(start_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel) == TRUE)
+                    {                                     
+                        // If External FLash instance has the write protection pin feature enabled
+                        if(ExternalFlash_Map[instance_id].ExternalFlash_WP_Feature == ENABLED)
+                        {
+                            // Disable Write Protection
+                            GENERIC_IO_HANDLERS[GENERIC_IO_DIGITALIO].Write(ExternalFlash_Map[instance_id].ExternalFlash_WP_Pin, ExternalFlash_Map[instance_id].ExternalFlash_WP_Level);
+                        }    
+                        
+                        // Prepare process data
+                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer = (uint8_t*)buffer;
+                        ExternalFlash_Instance_Store[instance_id].NVM_Target_Address = ExternalFlash_Instance_Store[instance_id].NVM_Instance_Memory_Offset + data_address;
+                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size = size;
+                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress = 0;
+                        ExternalFlash_Instance_Operation[instance_id] = operation;
+                        
+                        // Claim the chip for bus event dispatch
+                        ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance = instance_id;
+                        
+                        EXTERNAL_FLASH_STATS_REQUEST(instance_id);
+                        
+                        // Wait for the chip to be ready before sending the write header or erase command
+                        SendStatusCommand(instance_id, EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_WRITE);
+                        
+                        // Manage NV Memory RAM mirror if reference not null
+                        if(ExternalFlash_Instance_Store[instance_id].NVM_Mirror_Pointer != NULL)
+                        {
+                            if(operation == EXTERNAL_FLASH_OPERATION_ERASE)
+                            {
+                                memset((void*)(((uint8_t*)ExternalFlash_Instance_Store[instance_id].NVM_Mirror_Pointer) + data_address), 0xff, size);
+                            }
+                            else
+                            {
+                                memcpy((void*)(((uint8_t*)ExternalFlash_Instance_Store[instance_id].NVM_Mirror_Pointer) + data_address), buffer, size);
+                            }
+                        }       
+                        
+                        // Resume Task to process the write request
+                        SystemTimers__ResumeTask(ExternalFlash_Handler_Index);
+                        
+                        success = TRUE;
+                    }
+                }
+            }
+        }
+    }
+    
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Size of the next (partial) page write of the current write process
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @return     bytes to write, never crossing a page boundary
+ */
+static uint16_t GetWriteSize(uint8_t instance_id)
+{
+    uint16_t write_size = MIN((ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size - ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress), EXTERNAL_FLASH_PAGE_SIZE(instance_id));
+    write_size = MIN((EXTERNAL_FLASH_PAGE_SIZE(instance_id) - EXTERNAL_FLASH_PAGE_OFFSET(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress)), write_size);
+    
+    return write_size;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Size of the next read transfer of the current read process
+ *  @details    A continuous read would run through the page spare areas, so on chips with a spare area each page is
+ *              read on its own, and page metadata reads read one page metadata at a time.
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @return     bytes to read
+ */
+static uint16_t GetReadSize(uint8_t instance_id)
+{
+    uint16_t read_size = ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size - ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
+    
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    if((ExternalFlash_Instance_Spare[instance_id].Loading == TRUE) && (ExternalFlash_Instance_Spare[instance_id].Merge == TRUE))
+    {
+        // Old page data and metadata, contiguous in the DataFlash page
+        read_size = EXTERNAL_FLASH_PAGE_SIZE(instance_id) + sizeof(EXTERNAL_FLASH_SPARE_TYPE);
+    }
+    else if(ExternalFlash_Instance_Spare[instance_id].Active == TRUE)
+    {
+        read_size = sizeof(EXTERNAL_FLASH_SPARE_TYPE);
+    }
+    else if(EXTERNAL_FLASH_SPARE_SIZE(instance_id) != 0)
+    {
+        read_size = MIN((EXTERNAL_FLASH_PAGE_SIZE(instance_id) - EXTERNAL_FLASH_PAGE_OFFSET(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress)), read_size);
+    }
+#endif
+    
+    return read_size;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Size of the next erase step of the current erase process
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @return     block size if a whole aligned block is left to erase, page size otherwise
+ */
+static uint16_t GetEraseSize(uint8_t instance_id)
+{
+    uint32_t address = ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
+    uint16_t erase_size = EXTERNAL_FLASH_PAGE_SIZE(instance_id);
+    
+    if((EXTERNAL_FLASH_PAGE_OFFSET(instance_id, address) == 0) && ((EXTERNAL_FLASH_PAGE_OF(instance_id, address) % EXTERNAL_FLASH_BLOCK_PAGES) == 0) &&
+       ((ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size - ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress) >= EXTERNAL_FLASH_BLOCK_SIZE(instance_id)))
+    {
+        erase_size = EXTERNAL_FLASH_BLOCK_SIZE(instance_id);
+    }
+    
+    return erase_size;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Opcode and address of the read in progress
+ *  @details    Reads fully contained in a page held in a chip buffer are served from the buffer, otherwise from
+ *              the main memory.
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @return     opcode in the most significant byte, 24 bit command address below
+ */
+static uint32_t GetReadCommand(uint8_t instance_id)
+{
+#if (EXTERNAL_FLASH_GATHER_FEATURE == ENABLED)
+    // No dummy byte in the address phase
+    static const uint8_t buffer_read_command[EXTERNAL_FLASH_BUFFER_NUM] = {EXTERNAL_FLASH_BUFFER_READ_LF_COMMAND, EXTERNAL_FLASH_BUFFER_2_READ_LF_COMMAND};
+    uint8_t opcode = EXTERNAL_FLASH_CMD_READ_MEMORY_GATHER;
+#else
+    static const uint8_t buffer_read_command[EXTERNAL_FLASH_BUFFER_NUM] = {EXTERNAL_FLASH_BUFFER_READ_HF_COMMAND, EXTERNAL_FLASH_BUFFER_2_READ_HF_COMMAND};
+    uint8_t opcode = EXTERNAL_FLASH_CMD_READ_MEMORY;
+#endif
+    uint32_t address = ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
+    uint8_t buffer = GetReadBuffer(instance_id);
+    uint32_t command_address;
+    
+    if(buffer != EXTERNAL_FLASH_BUFFER_NONE)
+    {
+        // Buffer read, only the byte address in the page is used
+        opcode = buffer_read_command[buffer];
+        address = EXTERNAL_FLASH_PAGE_OFFSET(instance_id, address);
+    }
+    command_address = GetCommandAddress(instance_id, address);
+    
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    if(ExternalFlash_Instance_Spare[instance_id].Active == TRUE)
+    {
+        // Metadata of the next page, or of the page to write, past the page data; the whole page to merge
+        uint32_t page = (ExternalFlash_Instance_Spare[instance_id].Loading == TRUE) ?
+                        EXTERNAL_FLASH_PAGE_OF(instance_id, address) :
+                        EXTERNAL_FLASH_PAGE_OF(instance_id, ExternalFlash_Instance_Store[instance_id].NVM_Target_Address) +
+                        (ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress / sizeof(EXTERNAL_FLASH_SPARE_TYPE));
+        
+        command_address = (page << EXTERNAL_FLASH_BYTE_BITS(instance_id)) |
+                          ((ExternalFlash_Instance_Spare[instance_id].Merge == TRUE) ? 0 : EXTERNAL_FLASH_PAGE_SIZE(instance_id));
+    }
+#endif
+    
+    return ((uint32_t)opcode << 24) | command_address;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Opcode and address of the next (partial) page write of the write or program in progress
+ *  @details    Without write combining read-modify-write alternates the two buffers, so the page just written stays
+ *              readable from its buffer while the next one is programmed.
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @return     opcode in the most significant byte, 24 bit command address below
+ */
+static uint32_t GetWriteCommand(uint8_t instance_id)
+{
+    uint32_t address = ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
+    uint8_t opcode;
+    
+    if(EXTERNAL_FLASH_MERGING(instance_id) == TRUE)
+    {
+        // Merged pages are written whole
+        address -= EXTERNAL_FLASH_PAGE_OFFSET(instance_id, address);
+    }
+    
+    if(ExternalFlash_Instance_Operation[instance_id] == EXTERNAL_FLASH_OPERATION_PROGRAM)
+    {
+        // Only the bytes clocked in are programmed
+        opcode = EXTERNAL_FLASH_PAGE_PROGRAM_COMMAND;
+    }
+    else
+    {
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+        // Buffer write, only the byte address in the page is used
+        opcode = EXTERNAL_FLASH_BUFFER_WRITE_COMMAND;
+        address = EXTERNAL_FLASH_PAGE_OFFSET(instance_id, address);
+#else
+        opcode = (ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Busy_Buffer == 0) ?
+                 EXTERNAL_FLASH_READ_MODIFY_WRITE_2_COMMAND : EXTERNAL_FLASH_READ_MODIFY_WRITE_COMMAND;
+#endif
+    }
+    
+    return ((uint32_t)opcode << 24) | GetCommandAddress(instance_id, address);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Chip buffer holding the whole range of the next read transfer of the read in progress
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @return     buffer index, EXTERNAL_FLASH_BUFFER_NONE if the read must go to the main memory
+ */
+static uint8_t GetReadBuffer(uint8_t instance_id)
+{
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    uint32_t address = ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
+    uint16_t page = (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, address);
+    uint8_t buffer = EXTERNAL_FLASH_BUFFER_NONE;
+    
+    // Buffer reads wrap around within the buffer, so they cannot cross a page boundary; scrub and page metadata reads
+    // go to the main memory
+    if(((EXTERNAL_FLASH_PAGE_OFFSET(instance_id, address) + GetReadSize(instance_id)) <= EXTERNAL_FLASH_PAGE_SIZE(instance_id)) &&
+       (EXTERNAL_FLASH_SCRUBBING(instance_id) == FALSE) && (EXTERNAL_FLASH_SPARE_ACTIVE(instance_id) == FALSE))
+    {
+        for(uint8_t index = 0; index < EXTERNAL_FLASH_BUFFER_NUM; index++)
+        {
+            if(chip->Buffer_Page[index] == page)
+            {
+                buffer = index;
+                break;
+            }
+        }
+    }
+    
+    return buffer;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Forgets the chip buffers holding a copy of pages changed in the main memory
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      first_page : first changed page
+ *  @param      page_num : changed pages
+ */
+static void InvalidateBuffers(uint8_t instance_id, uint16_t first_page, uint16_t page_num)
+{
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    
+    for(uint8_t index = 0; index < EXTERNAL_FLASH_BUFFER_NUM; index++)
+    {
+        if((chip->Buffer_Page[index] >= first_page) && (chip->Buffer_Page[index] < (first_page + page_num)))
+        {
+            chip->Buffer_Page[index] = INVALID_VALUE_16;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Ends the write process: restores write protection, releases the chip and notifies the client
+ *
+ *  @param      instance_id : specific External FLash instance
+ */
+static void WriteComplete(uint8_t instance_id)
+{
+    COMMON_I_CALLBACK_TYPE nv_callback;
+    BOOL_TYPE scrub = EXTERNAL_FLASH_SCRUBBING(instance_id);
+    BOOL_TYPE notify = TRUE;
+    
+    if(ExternalFlash_Map[instance_id].ExternalFlash_WP_Feature == ENABLED)
+    {
+        // Activate agin Write Protection
+        GENERIC_IO_HANDLERS[GENERIC_IO_DIGITALIO].Write(ExternalFlash_Map[instance_id].ExternalFlash_WP_Pin, !ExternalFlash_Map[instance_id].ExternalFlash_WP_Level);
+    }
+    
+    if(scrub == TRUE)
+    {
+        // Scrub repairs are not notified
+        notify = FALSE;
+    }
+    else
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+    // Flushes have no data, the ones started on timeout are not notified
+    if(ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size == 0)
+    {
+        notify = ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Flush_Notify;
+    }
+    else
+#endif
+    {
+        EXTERNAL_FLASH_STATS_COMPLETE(instance_id, TRUE);
+    }
+    
+    // Fill NV callback data
+    nv_callback.Source_Instance_Id = instance_id;
+    nv_callback.Event_Value = COMBINE_BYTES(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process,
+                                            ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size);
+    
+    // Update NV Process Info
+    ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_NONE;
+    // Update Memory State machine
+    SetState(instance_id, EXTERNAL_FLASH_STATE_IDLE);
+    // Release the chip
+    ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance = INVALID_VALUE_8;
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    ExternalFlash_Instance_Spare[instance_id].Active = FALSE;
+    ExternalFlash_Instance_Spare[instance_id].Merge = FALSE;
+#endif
+    
+    if(notify == TRUE)
+    {
+        // Trigger Callback Notify, the client can chain a new request from the callback
+        ExecuteCallBack(nv_callback);
+    }
+    else if(scrub == TRUE)
+    {
+        EXTERNAL_FLASH_SCRUB_COMPLETE(instance_id);
+    }
+}
+
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Starts a write process of size 0, committing the chip buffer if it holds combined writes
+ *
+ *  @param      instance_id : specific External FLash instance, idle on an idle chip
+ *  @param      notify : TRUE to notify the completion to the client
+ *  @return     TRUE if started, FALSE if the bus transaction could not be started
+ */
+static BOOL_TYPE StartFlush(uint8_t instance_id, BOOL_TYPE notify)
+{
+    BOOL_TYPE success = FALSE;
+    COMMBUS__STARTTRANSACTION start_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].StartTransaction;
+    
+    if((start_handler != NULL) && (start_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel) == TRUE))
+    {
+        if(ExternalFlash_Map[instance_id].ExternalFlash_WP_Feature == ENABLED)
+        {
+            // Disable Write Protection
+            GENERIC_IO_HANDLERS[GENERIC_IO_DIGITALIO].Write(ExternalFlash_Map[instance_id].ExternalFlash_WP_Pin, ExternalFlash_Map[instance_id].ExternalFlash_WP_Level);
+        }
+        
+        // Prepare process data
+        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer = NULL;
+        ExternalFlash_Instance_Store[instance_id].NVM_Target_Address = ExternalFlash_Instance_Store[instance_id].NVM_Instance_Memory_Offset;
+        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size = 0;
+        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress = 0;
+        ExternalFlash_Instance_Operation[instance_id] = EXTERNAL_FLASH_OPERATION_WRITE;
+        
+        // Claim the chip for bus event dispatch
+        ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Active_Instance = instance_id;
+        ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Flush_Notify = notify;
+        
+        // Wait for the chip to be ready before committing the buffer
+        SendStatusCommand(instance_id, EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_WRITE);
+        
+        // Resume Task to process the flush
+        SystemTimers__ResumeTask(ExternalFlash_Handler_Index);
+        
+        success = TRUE;
+    }
+    
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Buffer management step of a ready chip, before the next read or (partial) page write
+ *  @details    The buffered page is committed before a write to another page, a read overlapping it (main memory
+ *              is stale), a program or an erase, before the old metadata of the page to write is read, or at the end
+ *              of a flush. A partial write to a page not in the buffer first loads the page, a full page write, spare
+ *              area included, overwrites the whole buffer, as a merged page does. The bus transaction must be already
+ *              started.
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      before_read : TRUE if a read is in progress, FALSE for a write or a flush
+ *  @return     TRUE if the step was handled here (buffer command sent or flush completed), FALSE to go on with the
+ *              read or buffer write
+ */
+static BOOL_TYPE StartBufferStep(uint8_t instance_id, BOOL_TYPE before_read)
+{
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    uint32_t address = ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
+    uint16_t page = (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, address);
+    BOOL_TYPE done = (ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress >= ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size) ? TRUE : FALSE;
+    BOOL_TYPE commit;
+    BOOL_TYPE handled = TRUE;
+    
+    if(before_read == TRUE)
+    {
+        uint16_t last_page = (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, address + GetReadSize(instance_id) - 1);
+        
+        // Reads contained in the buffered page are served from the buffer, page metadata reads always commit it
+        commit = ((chip->Buffer_Dirty == TRUE) && (GetReadBuffer(instance_id) == EXTERNAL_FLASH_BUFFER_NONE) &&
+                  (((chip->Buffer_Page[EXTERNAL_FLASH_COMBINE_BUFFER] >= page) && (chip->Buffer_Page[EXTERNAL_FLASH_COMBINE_BUFFER] <= last_page)) ||
+                   (EXTERNAL_FLASH_SPARE_ACTIVE(instance_id) == TRUE))) ? TRUE : FALSE;
+    }
+    else
+    {
+        // Programs go through the buffer and erases may hit the buffered page, both must follow the buffered writes;
+        // the old page metadata, or page to merge, is read from the main memory
+        commit = ((chip->Buffer_Dirty == TRUE) &&
+                  ((done == TRUE) || (ExternalFlash_Instance_Operation[instance_id] != EXTERNAL_FLASH_OPERATION_WRITE) ||
+                   (chip->Buffer_Page[EXTERNAL_FLASH_COMBINE_BUFFER] != page) || (EXTERNAL_FLASH_SPARE_TO_LOAD(instance_id) == TRUE))) ? TRUE : FALSE;
+    }
+    
+    if(commit == TRUE)
+    {
+        if((before_read == TRUE) && (ExternalFlash_Map[instance_id].ExternalFlash_WP_Feature == ENABLED))
+        {
+            // Disable Write Protection, activated again at the end of the read
+            GENERIC_IO_HANDLERS[GENERIC_IO_DIGITALIO].Write(ExternalFlash_Map[instance_id].ExternalFlash_WP_Pin, ExternalFlash_Map[instance_id].ExternalFlash_WP_Level);
+        }
+        
+        // Update NV Process Info
+        ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
+        // Update Memory State machine
+        SetState(instance_id, (before_read == TRUE) ? EXTERNAL_FLASH_STATE_COMMIT_BUFFER_BEFORE_READ : EXTERNAL_FLASH_STATE_COMMIT_BUFFER_BEFORE_WRITE);
+        // Program the buffered page
+        if(SendPageCommand(instance_id, EXTERNAL_FLASH_BUFFER_TO_MAIN_ERASE_COMMAND, chip->Buffer_Page[EXTERNAL_FLASH_COMBINE_BUFFER]) == FALSE)
+        {
+            AbortBufferStep(instance_id, before_read);
+        }
+    }
+    else if(before_read == TRUE)
+    {
+        handled = FALSE;
+    }
+    else if(done == TRUE)
+    {
+        // Flush completed, the bus is not needed
+        GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].StopTransaction(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);
+        WriteComplete(instance_id);
+    }
+    else if((ExternalFlash_Instance_Operation[instance_id] == EXTERNAL_FLASH_OPERATION_WRITE) &&
+            (chip->Buffer_Page[EXTERNAL_FLASH_COMBINE_BUFFER] != page) &&
+            (((GetWriteSize(instance_id) < EXTERNAL_FLASH_PAGE_SIZE(instance_id)) && (EXTERNAL_FLASH_MERGING(instance_id) == FALSE)) ||
+             (EXTERNAL_FLASH_SPARE_SIZE(instance_id) != EXTERNAL_FLASH_SPARE_WRITE_SIZE(instance_id))))
+    {
+        // Update NV Process Info
+        ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
+        // Update Memory State machine
+        SetState(instance_id, EXTERNAL_FLASH_STATE_LOAD_BUFFER);
+        // Transfer the page in the buffer, the write then only changes its own bytes
+        if(SendPageCommand(instance_id, EXTERNAL_FLASH_MAIN_TO_BUFFER_COMMAND, page) == FALSE)
+        {
+            AbortBufferStep(instance_id, before_read);
+        }
+    }
+    else
+    {
+        handled = FALSE;
+    }
+    
+    return handled;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Undoes a buffer step whose command was not accepted by the bus
+ *  @details    The bus transaction is stopped. A flush started on timeout gives the chip back and is started again
+ *              once the instance is idle, any other operation keeps its chip and polls the status register again
+ *              before the next attempt.
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      before_read : TRUE if a read is in progress, FALSE for a write or a flush
+ */
+static void AbortBufferStep(uint8_t instance_id, BOOL_TYPE before_read)
+{
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    BOOL_TYPE release = ((before_read == FALSE) && (ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size == 0) &&
+                         (chip->Flush_Notify == FALSE)) ? TRUE : FALSE;
+    
+    GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].StopTransaction(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel);
+    EXTERNAL_FLASH_STATS_COUNT(instance_id, Retries, 1);
+    
+    if(((before_read == TRUE) || (release == TRUE)) && (ExternalFlash_Map[instance_id].ExternalFlash_WP_Feature == ENABLED))
+    {
+        // Activate again Write Protection, disabled for the commit or the flush
+        GENERIC_IO_HANDLERS[GENERIC_IO_DIGITALIO].Write(ExternalFlash_Map[instance_id].ExternalFlash_WP_Pin, !ExternalFlash_Map[instance_id].ExternalFlash_WP_Level);
+    }
+    
+    // Update NV Process Info
+    ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_NONE;
+    
+    if(release == TRUE)
+    {
+        // Update Memory State machine
+        SetState(instance_id, EXTERNAL_FLASH_STATE_IDLE);
+        // Release the chip
+        chip->Active_Instance = INVALID_VALUE_8;
+    }
+    else
+    {
+        // Update Memory State machine
+        SetState(instance_id, (before_read == TRUE) ?
+                              EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_READ :
+                              EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_WRITE);
+    }
+}
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Sends a command addressing a whole page, without data (buffer to main memory, main memory to buffer,
+ *              page and block erase)
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      command_id : command opcode
+ *  @param      page : page address
+ *  @return     TRUE if the command was sent, FALSE otherwise
+ */
+static BOOL_TYPE SendPageCommand(uint8_t instance_id, uint8_t command_id, uint16_t page)
+{
+    static EXTERNAL_FLASH_WRITE_HEADER_TYPE header;
+    uint32_t command_address = GetCommandAddress(instance_id, (uint32_t)page * EXTERNAL_FLASH_PAGE_SIZE(instance_id));
+    BOOL_TYPE success = FALSE;
+    
+    header.ExternalFlash_OpCode_Cmd = command_id;
+    header.ExternalFlash_Address[0] = (uint8_t)(command_address >> 16);
+    header.ExternalFlash_Address[1] = (uint8_t)(command_address >> 8);
+    header.ExternalFlash_Address[2] = (uint8_t)(command_address);
+    
+    // Get pointer to Write handler
+    COMMBUS__WRITE write_handler =  GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Write;
+    
+    // If handlers exist
+    if(write_handler != NULL)
+    {
+        // Call Handler
+        if(write_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
+                         (void*)&header, 
+                         COMMBUS_ADDRESS_NONE, 
+                         sizeof(EXTERNAL_FLASH_WRITE_HEADER_TYPE)) == TRUE)
+        {
+            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
+            {
+                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
+                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
+                
+                // Start Timeout handle
+                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
+            }
+    
+            // Timestamp bus request for late transfer statistics
+            EXTERNAL_FLASH_STATS_BUS_REQUEST(instance_id);
+
+            success = TRUE;
+        }
+    }
+    
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Page of a linear device address, without division
+ *  @details    Binary pages are a shift. A DataFlash page is 33 << (page_bits - 6) bytes: the address is shifted by the
+ *              power of two and divided by 33 with its reciprocal, corrected once. With a constant geometry, without
+ *              EXTERNAL_FLASH_DETECT_FEATURE, the page size test folds at compile time.
+ *
+ *  @param      page_size : page size, see EXTERNAL_FLASH_PAGE_SIZE
+ *  @param      page_bits : byte address bits of the page data, see EXTERNAL_FLASH_PAGE_BITS
+ *  @param      address : linear address in the device, or a size
+ *  @return     page
+ */
+static inline uint32_t GetPage(uint16_t page_size, uint8_t page_bits, uint32_t address)
+{
+    uint32_t page;
+    
+    if((page_size & (page_size - 1)) == 0)
+    {
+        page = address >> page_bits;
+    }
+    else
+    {
+        uint32_t units = address >> (page_bits - 6);
+        
+        page = (uint32_t)(units * EXTERNAL_FLASH_DIV33_RECIPROCAL) >> EXTERNAL_FLASH_DIV33_SHIFT;
+        if((page * 33) > units)
+        {
+            page--;
+        }
+    }
+    return page;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Offset of a linear device address in its page, without division, see GetPage
+ *
+ *  @param      page_size : page size, see EXTERNAL_FLASH_PAGE_SIZE
+ *  @param      page_bits : byte address bits of the page data, see EXTERNAL_FLASH_PAGE_BITS
+ *  @param      address : linear address in the device, or a size
+ *  @return     byte offset
+ */
+static inline uint32_t GetPageOffset(uint16_t page_size, uint8_t page_bits, uint32_t address)
+{
+    uint32_t offset;
+    
+    if((page_size & (page_size - 1)) == 0)
+    {
+        offset = address & (page_size - 1);
+    }
+    else
+    {
+        offset = address - (GetPage(page_size, page_bits, address) * page_size);
+    }
+    return offset;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Converts a linear flash address into the 24 bit page/byte address of a command header
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      flash_address : linear address in the device
+ *  @return     command address
+ */
+static uint32_t GetCommandAddress(uint8_t instance_id, uint32_t flash_address)
+{
+    uint32_t page_address = EXTERNAL_FLASH_PAGE_OF(instance_id, flash_address);
+    uint32_t byte_address = flash_address - (page_address * EXTERNAL_FLASH_PAGE_SIZE(instance_id));
+    
+#if (EXTERNAL_FLASH_DETECT_FEATURE == DISABLED)
+    // The geometry is constant
+    (void)instance_id;
+#endif
+    return (page_address << EXTERNAL_FLASH_BYTE_BITS(instance_id)) | byte_address;
+}
+
+#if (EXTERNAL_FLASH_GATHER_FEATURE == DISABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Encodes the 24 bit command address into the 3 address bytes of a command header, MSB first
+ *
+ *  @param      address : header address bytes
+ *  @param      command : opcode and command address, see GetReadCommand / GetWriteCommand
+ */
+static void EncodeAddress(uint8_t* address, uint32_t command)
+{
+    address[0] = (uint8_t)(command >> 16);
+    address[1] = (uint8_t)(command >> 8);
+    address[2] = (uint8_t)(command);
+}
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Binds a (bus provider, bus channel) pair to a physical chip, creating it on first use
+ *  @details    The bus event handler is registered once per chip, filtered on the chip bus channel, so instances
+ *              sharing the same chip do not receive duplicated events and events of other channels are not delivered.
+ *
+ *  @param      bus_id : generic comm bus provider
+ *  @param      bus_channel : bus instance channel allocated by the provider
+ *  @return     chip index
+ */
+static uint8_t BindChip(GENERIC_COMM_BUS_TYPE bus_id, uint8_t bus_channel)
+{
+    uint8_t chip_index = LookupChip((uint8_t)bus_id, bus_channel);
+    
+    // If chip not bound yet
+    if(chip_index == INVALID_VALUE_8)
+    {
+        uint8_t slot = EXTERNAL_FLASH_BUS_LOOKUP_HASH(bus_id, bus_channel);
+        
+        // Find first empty slot
+        while(ExternalFlash_Bus_Lookup[slot] != INVALID_VALUE_8)
+        {
+            slot = (slot + 1) & (EXTERNAL_FLASH_BUS_LOOKUP_SIZE - 1);
+        }
+        
+        // More chips than EXTERNAL_FLASH_CHIP_NUM in EXTERNAL_FLASH_MAP
+        SYS_ASSERT(ExternalFlash_Chip_Num < EXTERNAL_FLASH_CHIP_NUM);
+        
+        chip_index = ExternalFlash_Chip_Num++;
+        ExternalFlash_Chip[chip_index].Generic_Comm_Bus_Id = bus_id;
+        ExternalFlash_Chip[chip_index].Bus_Instance_Channel = bus_channel;
+        ExternalFlash_Chip[chip_index].Active_Instance = INVALID_VALUE_8;
+        ExternalFlash_Chip[chip_index].Buffer_Page[0] = INVALID_VALUE_16;
+        ExternalFlash_Chip[chip_index].Buffer_Page[1] = INVALID_VALUE_16;
+        ExternalFlash_Chip[chip_index].Busy_Buffer = EXTERNAL_FLASH_BUFFER_NONE;
+        ExternalFlash_Chip[chip_index].Ready_Us = EXTERNAL_FLASH_TIMESTAMP_US();
+        ExternalFlash_Chip[chip_index].Busy_Op = EXTERNAL_FLASH_CHIP_OP_NONE;
+        memcpy(ExternalFlash_Chip[chip_index].Op_Us, ExternalFlash_Chip_Op_Typical_Us, sizeof(ExternalFlash_Chip[chip_index].Op_Us));
+        // Configured part, until detected
+        ExternalFlash_Chip[chip_index].Geometry.Jedec_Id[0] = EXTERNAL_FLASH_MANUFACTURER_ID;
+        ExternalFlash_Chip[chip_index].Geometry.Jedec_Id[1] = EXTERNAL_FLASH_DEVICE_ID;
+        ExternalFlash_Chip[chip_index].Geometry.Jedec_Id[2] = 0x00;
+        ExternalFlash_Chip[chip_index].Geometry.Jedec_Id[3] = 0x00;
+        SetGeometry(chip_index, (EXTERNAL_FLASH_DEVICE_BINARY_PAGE == ENABLED) ? TRUE : FALSE);
+#if (EXTERNAL_FLASH_DETECT_FEATURE == ENABLED)
+        ExternalFlash_Chip[chip_index].Detected = FALSE;
+#endif
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+        ExternalFlash_Chip[chip_index].Buffer_Dirty = FALSE;
+#endif
+#if (EXTERNAL_FLASH_INTEGRITY_FEATURE == ENABLED)
+        memset(ExternalFlash_Chip[chip_index].Page_Crc_Known, 0x00, sizeof(ExternalFlash_Chip[chip_index].Page_Crc_Known));
+#endif
+#if (EXTERNAL_FLASH_SCRUB_FEATURE == ENABLED)
+        memset(ExternalFlash_Chip[chip_index].Page_Crc_Learned, 0x00, sizeof(ExternalFlash_Chip[chip_index].Page_Crc_Learned));
+        ExternalFlash_Chip[chip_index].Scrub_Instance = INVALID_VALUE_8;
+        ExternalFlash_Chip[chip_index].Scrub_Step = EXTERNAL_FLASH_SCRUB_STEP_READ;
+        ExternalFlash_Chip[chip_index].Scrub_Busy = FALSE;
+        ExternalFlash_Chip[chip_index].Scrub_Address = 0;
+        ExternalFlash_Chip[chip_index].Scrub_Us = EXTERNAL_FLASH_TIMESTAMP_US();
+        ExternalFlash_Chip[chip_index].Scrub_Wait_Us = (uint32_t)(((uint64_t)EXTERNAL_FLASH_SCRUB_SIZE * 1000000UL) / EXTERNAL_FLASH_SCRUB_BYTES_PER_S);
+#endif
+#if (EXTERNAL_FLASH_BLANK_FEATURE == ENABLED)
+        memset(ExternalFlash_Chip[chip_index].Page_Erased, 0x00, sizeof(ExternalFlash_Chip[chip_index].Page_Erased));
+        ExternalFlash_Chip[chip_index].Blank_Instance = INVALID_VALUE_8;
+        ExternalFlash_Chip[chip_index].Blank_Busy = FALSE;
+#endif
+        ExternalFlash_Bus_Lookup[slot] = chip_index;
+        
+        // Get Register Event Handler
+        COMMBUS__REGISTERHANDLER register_handler = GENERIC_COMM_BUS_HANDLERS[bus_id].RegisterEventHandler;
+        
+        // If handler exists
+        if(register_handler != NULL)
+        {
+            // Register event handler to service provider
+            register_handler(CommBusEventHandler, bus_channel, CALLBACK_FILTER_VALUE_NONE);
+        }
+    }
+    
+    return chip_index;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Sets the chip geometry from its JEDEC ID and page size configuration
+ *  @details    Unknown parts are handled as the EXTERNAL_FLASH_DEVICE_ID part. DataFlash pages (264, 528, 1056 bytes) keep
+ *              the byte address one bit wider than the binary ones, the linear address of a byte is so still page *
+ *              page size + byte.
+ *
+ *  @param      chip_index : chip, with Geometry.Jedec_Id set
+ *  @param      binary_page : TRUE if the chip is configured for binary pages
+ */
+static void SetGeometry(uint8_t chip_index, BOOL_TYPE binary_page)
+{
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[chip_index];
+    uint8_t index = 0;
+    
+    while((index < ELEMENTS_IN_ARRAY(ExternalFlash_Device)) &&
+          ((chip->Geometry.Jedec_Id[0] != EXTERNAL_FLASH_MANUFACTURER_ID) || (chip->Geometry.Jedec_Id[1] != ExternalFlash_Device[index].Device_Id) ||
+           ((ExternalFlash_Device[index].Edi_Length != 0xFF) && (chip->Geometry.Jedec_Id[3] != ExternalFlash_Device[index].Edi_Length))))
+    {
+        index++;
+    }
+    if(index == ELEMENTS_IN_ARRAY(ExternalFlash_Device))
+    {
+        index = 0;
+        while((index < (ELEMENTS_IN_ARRAY(ExternalFlash_Device) - 1)) && (ExternalFlash_Device[index].Device_Id != EXTERNAL_FLASH_DEVICE_ID))
+        {
+            index++;
+        }
+        SYS_ASSERT(ExternalFlash_Device[index].Device_Id == EXTERNAL_FLASH_DEVICE_ID);
+    }
+    
+    chip->Geometry.Byte_Bits = 0;
+    while((1UL << chip->Geometry.Byte_Bits) < ExternalFlash_Device[index].Page_Size)
+    {
+        chip->Geometry.Byte_Bits++;
+    }
+    
+    chip->Geometry.Spare_Size = 0;
+    if(binary_page == TRUE)
+    {
+        chip->Geometry.Page_Size = ExternalFlash_Device[index].Page_Size;
+    }
+    else
+    {
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+        // The extra bytes are the spare area, not addressed as data
+        chip->Geometry.Page_Size = ExternalFlash_Device[index].Page_Size;
+        chip->Geometry.Spare_Size = ExternalFlash_Device[index].Page_Size / 32;
+#else
+        chip->Geometry.Page_Size = ExternalFlash_Device[index].Page_Size + (ExternalFlash_Device[index].Page_Size / 32);
+#endif
+        chip->Geometry.Byte_Bits++;
+    }
+    chip->Geometry.Page_Num = MIN(ExternalFlash_Device[index].Page_Num, EXTERNAL_FLASH_MAX_PAGE_NUMBER);
+    chip->Geometry.Block_Size = EXTERNAL_FLASH_BLOCK_PAGES * chip->Geometry.Page_Size;
+    
+    SYS_ASSERT(chip->Geometry.Page_Size <= EXTERNAL_FLASH_MAX_PAGE_SIZE);
+    
+#if (EXTERNAL_FLASH_INTEGRITY_FEATURE == ENABLED)
+    {
+        uint8_t erased[8];
+        uint32_t crc = 0xFFFFFFFFUL;
+        
+        // All page sizes are multiple of 8 bytes
+        memset(erased, 0xFF, sizeof(erased));
+        for(uint16_t offset = 0; offset < chip->Geometry.Page_Size; offset += sizeof(erased))
+        {
+            crc = GetCrc(crc, erased, sizeof(erased));
+        }
+        chip->Erased_Crc = ~crc;
+    }
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Finds the physical chip bound to a (bus provider, bus channel) pair
+ *
+ *  @param      bus_id : generic comm bus provider
+ *  @param      bus_channel : bus instance channel allocated by the provider
+ *  @return     chip index, INVALID_VALUE_8 if no chip is bound to the pair
+ */
+static uint8_t LookupChip(uint8_t bus_id, uint8_t bus_channel)
+{
+    uint8_t slot = EXTERNAL_FLASH_BUS_LOOKUP_HASH(bus_id, bus_channel);
+    uint8_t chip_index;
+    
+    // Probe until an empty slot, the table is never full
+    while((chip_index = ExternalFlash_Bus_Lookup[slot]) != INVALID_VALUE_8)
+    {
+        if((ExternalFlash_Chip[chip_index].Generic_Comm_Bus_Id == bus_id) &&
+           (ExternalFlash_Chip[chip_index].Bus_Instance_Channel == bus_channel))
+        {
+            break;
+        }
+        slot = (slot + 1) & (EXTERNAL_FLASH_BUS_LOOKUP_SIZE - 1);
+    }
+    
+    return chip_index;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Moves the instance state machine to a new state, tracing the transition
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      state : new state
+ */
+static void SetState(uint8_t instance_id, EXTERNAL_FLASH_STATE_TYPE state)
+{
+    EXTERNAL_FLASH_TRACE(EXTERNAL_FLASH_TRACE_CONTEXT_TASK, EXTERNAL_FLASH_TRACE_EVENT_STATE, instance_id,
+                         ExternalFlash_Instance_Store[instance_id].NVM_State, state);
+    
+    ExternalFlash_Instance_Store[instance_id].NVM_State = state;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Records the internal operation the chip of the instance has just started and its expected end
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      op : operation started
+ */
+static void SetChipBusy(uint8_t instance_id, EXTERNAL_FLASH_CHIP_OP_TYPE op)
+{
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    
+    chip->Busy_Op = op;
+    chip->Busy_Start_Us = EXTERNAL_FLASH_TIMESTAMP_US();
+    chip->Ready_Us = chip->Busy_Start_Us + chip->Op_Us[op];
+    
+#if (EXTERNAL_FLASH_PREDICTIVE_FEATURE == ENABLED)
+    // Next step of the request, if any, when the chip is expected ready
+    ScheduleHandler(chip->Op_Us[op]);
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Refines the completion model with the status register just read by the instance
+ *  @details    A chip found busy took longer than the elapsed time, the model is raised above it. A chip found ready
+ *              took at most the elapsed time: a model longer than it is lowered to it, and a model matched by the first
+ *              poll after the expected end is lowered a little, so that it does not stay above the actual time.
+ *
+ *  @param      instance_id : specific External FLash instance
+ */
+static void UpdateChipTiming(uint8_t instance_id)
+{
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    uint32_t now_us = EXTERNAL_FLASH_TIMESTAMP_US();
+    
+    if(chip->Busy_Op != EXTERNAL_FLASH_CHIP_OP_NONE)
+    {
+        uint32_t elapsed_us = now_us - chip->Busy_Start_Us;
+        uint32_t* model_us = &chip->Op_Us[chip->Busy_Op];
+        
+        if(chip->Status_Register.RDY_1 == 1)
+        {
+            if(elapsed_us < *model_us)
+            {
+                *model_us = elapsed_us;
+            }
+            else if(elapsed_us < (*model_us + EXTERNAL_FLASH_SCHEDULE_TICK_US))
+            {
+                *model_us -= *model_us / 64;
+            }
+            chip->Busy_Op = EXTERNAL_FLASH_CHIP_OP_NONE;
+            chip->Ready_Us = now_us;
+        }
+        else
+        {
+            if(elapsed_us >= *model_us)
+            {
+                *model_us = elapsed_us + (elapsed_us / 8);
+            }
+            chip->Ready_Us = chip->Busy_Start_Us + *model_us;
+        }
+    }
+    else if(chip->Status_Register.RDY_1 == 1)
+    {
+        chip->Ready_Us = now_us;
+    }
+    else
+    {
+        // Busy with an operation not started by the driver, expect it by the next period
+        chip->Ready_Us = now_us + (EXTERNAL_FLASH_HANDLER_PERIOD_MS * 1000UL);
+    }
+    
+#if (EXTERNAL_FLASH_PREDICTIVE_FEATURE == ENABLED)
+    if(chip->Status_Register.RDY_1 == 0)
+    {
+        ScheduleHandler(GetChipBusyUs(instance_id));
+    }
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Time the chip of the instance is expected to stay busy with its last internal operation
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @return     time in us, 0 if expected ready
+ */
+static uint32_t GetChipBusyUs(uint8_t instance_id)
+{
+    int32_t busy_us = (int32_t)(ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Ready_Us - EXTERNAL_FLASH_TIMESTAMP_US());
+    
+    return (busy_us > 0) ? (uint32_t)busy_us : 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Requests a handler call, unless an earlier one is already pending
+ *  @details    The call is rounded up to the scheduling resolution; calls not earlier than the handler period are left
+ *              to the period.
+ *
+ *  @param      delay_us : delay from now, 0 for an immediate call
+ */
+static void ScheduleHandler(uint32_t delay_us)
+{
+    uint32_t delay_ms = (delay_us + EXTERNAL_FLASH_SCHEDULE_TICK_US - 1) / EXTERNAL_FLASH_SCHEDULE_TICK_US;
+    uint32_t wakeup_us = EXTERNAL_FLASH_TIMESTAMP_US() + (delay_ms * EXTERNAL_FLASH_SCHEDULE_TICK_US);
+    
+    if((delay_ms < EXTERNAL_FLASH_HANDLER_PERIOD_MS) &&
+       ((ExternalFlash_Wakeup_Pending == FALSE) || ((int32_t)(wakeup_us - ExternalFlash_Wakeup_Us) < 0)))
+    {
+        ExternalFlash_Wakeup_Pending = TRUE;
+        ExternalFlash_Wakeup_Us = wakeup_us;
+        SystemTimers__SetTaskIdxNextCall(ExternalFlash_Handler_Index, (delay_ms == 0) ? TASK_IMMEDIATE_EXECUTION : delay_ms);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Estimates the time left to the request of the instance owning its chip, beyond the chip busy time
+ *  @details    A read costs its transfer. A write costs, for each page not sent yet, its transfer and the program or
+ *              erase it starts; buffer writes of the write combining only cost the transfer. An erase costs its block
+ *              and page erases left. Programs and erases are timed by the completion model of the chip.
+ *
+ *  @param      instance_id : specific External FLash instance, owning its chip
+ *  @return     time in us
+ */
+static uint32_t GetRemainingUs(uint8_t instance_id)
+{
+    NVMEMORY_INSTANCE_TYPE* instance = &ExternalFlash_Instance_Store[instance_id];
+    const uint32_t* op_us = ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Op_Us;
+    uint32_t address = instance->NVM_Target_Address + instance->NVM_Buffer_Progress;
+    uint32_t left = (instance->NVM_Buffer_Size > instance->NVM_Buffer_Progress) ? (instance->NVM_Buffer_Size - instance->NVM_Buffer_Progress) : 0;
+    uint32_t pages = (left == 0) ? 0 : EXTERNAL_FLASH_PAGE_OF(instance_id, EXTERNAL_FLASH_PAGE_OFFSET(instance_id, address) + left + EXTERNAL_FLASH_PAGE_SIZE(instance_id) - 1);
+    uint32_t transfer_us = (left * 1000UL) / EXTERNAL_FLASH_BUS_BYTES_PER_MS;
+    uint32_t time_us;
+    
+    switch(instance->NVM_State)
+    {
+      case EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_READ:
+      case EXTERNAL_FLASH_STATE_READ_STATUS_REGISTER_BEFORE_READ:
+      case EXTERNAL_FLASH_STATE_SEND_READ_HEADER:
+      case EXTERNAL_FLASH_STATE_READ:
+      case EXTERNAL_FLASH_STATE_COMMIT_BUFFER_BEFORE_READ:
+        time_us = transfer_us;
+        break;
+        
+      case EXTERNAL_FLASH_STATE_DETECT_ID:
+      case EXTERNAL_FLASH_STATE_DETECT_PAGE_SIZE:
+        time_us = 0;
+        break;
+        
+      default:
+        if(ExternalFlash_Instance_Operation[instance_id] == EXTERNAL_FLASH_OPERATION_ERASE)
+        {
+            time_us = ((pages / EXTERNAL_FLASH_BLOCK_PAGES) * op_us[EXTERNAL_FLASH_CHIP_OP_BLOCK_ERASE]) +
+                      ((pages % EXTERNAL_FLASH_BLOCK_PAGES) * op_us[EXTERNAL_FLASH_CHIP_OP_PAGE_ERASE]);
+        }
+        else if(ExternalFlash_Instance_Operation[instance_id] == EXTERNAL_FLASH_OPERATION_PROGRAM)
+        {
+            time_us = transfer_us + (pages * op_us[EXTERNAL_FLASH_CHIP_OP_PROGRAM]);
+        }
+        else
+        {
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+            // Each page but the last one is committed when the write moves to the next
+            time_us = transfer_us + (((pages > 0) ? (pages - 1) : 0) * op_us[EXTERNAL_FLASH_CHIP_OP_ERASE_PROGRAM]);
+#else
+            time_us = transfer_us + (pages * op_us[EXTERNAL_FLASH_CHIP_OP_ERASE_PROGRAM]);
+#endif
+        }
+        break;
+    }
+    
+    return time_us;
+}
+
+#if (EXTERNAL_FLASH_TRACE_FEATURE == ENABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Appends an entry to the trace ring of the calling context
+ *  @details    Each ring is written by one context only: the entry is filled before the head is published, so
+ *              a reader (debugger, dump) never sees a half written entry behind the head.
+ *
+ *  @param      context : calling context, selects the ring
+ *  @param      event : entry type
+ *  @param      instance_id : specific External FLash instance
+ *  @param      old_state : state before the event
+ *  @param      new_state : state after the event
+ */
+static void Trace(EXTERNAL_FLASH_TRACE_CONTEXT_TYPE context, EXTERNAL_FLASH_TRACE_EVENT_TYPE event, uint8_t instance_id, uint8_t old_state, uint8_t new_state)
+{
+    volatile EXTERNAL_FLASH_TRACE_RING_TYPE* ring = &ExternalFlash_Trace.Ring[context];
+    volatile EXTERNAL_FLASH_TRACE_ENTRY_TYPE* entry = &ring->Entry[ring->Head & (EXTERNAL_FLASH_TRACE_SIZE - 1)];
+    
+    entry->Timestamp_Us = EXTERNAL_FLASH_TIMESTAMP_US();
+    entry->Event = (uint8_t)event;
+    entry->Instance = instance_id;
+    entry->Old_State = old_state;
+    entry->New_State = new_state;
+    entry->Process = (uint8_t)ExternalFlash_Instance_Store[instance_id].NVM_Current_Process;
+    entry->Reserved = 0;
+    entry->Progress = ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
+    
+    ring->Head++;
+}
+#endif
+
+#if (EXTERNAL_FLASH_CAPTURE_FEATURE == ENABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Starts a new capture stream with its header: magic and format version
+ */
+static void CaptureStart(void)
+{
+    static const uint8_t header[] = {(uint8_t)(EXTERNAL_FLASH_CAPTURE_MAGIC), (uint8_t)(EXTERNAL_FLASH_CAPTURE_MAGIC >> 8),
+                                     (uint8_t)(EXTERNAL_FLASH_CAPTURE_MAGIC >> 16), (uint8_t)(EXTERNAL_FLASH_CAPTURE_MAGIC >> 24),
+                                     EXTERNAL_FLASH_CAPTURE_VERSION};
+    
+#ifdef EXTERNAL_FLASH_CAPTURE_RAM
+    ExternalFlash_Capture_Size = 0;
+    ExternalFlash_Capture_Dropped = 0;
+#endif
+    ExternalFlash_Capture_Last_Us = EXTERNAL_FLASH_TIMESTAMP_US();
+    
+    EXTERNAL_FLASH_CAPTURE_SINK(header, sizeof(header));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Encodes a capture record (see EXTERNAL_FLASH_CAPTURE_RECORD_TYPE) and passes it to the sink
+ *
+ *  @param      type : record type
+ *  @param      instance_id : instance, client id for allocation records
+ *  @param      value_1 : address, instance offset or callback event value
+ *  @param      value_2 : size, number of pages or allocated instance
+ *  @param      flag : request accepted, or mirror used for allocation records
+ */
+static void Capture(EXTERNAL_FLASH_CAPTURE_RECORD_TYPE type, uint8_t instance_id, uint32_t value_1, uint32_t value_2, uint8_t flag)
+{
+    uint8_t record[EXTERNAL_FLASH_CAPTURE_RECORD_MAX_SIZE];
+    uint8_t size = 0;
+    uint32_t now_us = EXTERNAL_FLASH_TIMESTAMP_US();
+    
+    record[size++] = (uint8_t)type;
+    size += EncodeVarint(&record[size], now_us - ExternalFlash_Capture_Last_Us);
+    record[size++] = instance_id;
+    ExternalFlash_Capture_Last_Us = now_us;
+    
+    switch(type)
+    {
+      case EXTERNAL_FLASH_CAPTURE_RECORD_ALLOCATION:
+        record[size++] = flag;
+        size += EncodeVarint(&record[size], value_1);
+        record[size++] = (uint8_t)value_2;
+        break;
+        
+      case EXTERNAL_FLASH_CAPTURE_RECORD_READ:
+      case EXTERNAL_FLASH_CAPTURE_RECORD_WRITE:
+      case EXTERNAL_FLASH_CAPTURE_RECORD_FLUSH:
+      case EXTERNAL_FLASH_CAPTURE_RECORD_PROGRAM:
+      case EXTERNAL_FLASH_CAPTURE_RECORD_ERASE:
+      case EXTERNAL_FLASH_CAPTURE_RECORD_WRITE_PAGES:
+      case EXTERNAL_FLASH_CAPTURE_RECORD_READ_SPARE:
+      case EXTERNAL_FLASH_CAPTURE_RECORD_SCAN_ERASED:
+        size += EncodeVarint(&record[size], value_1);
+        size += EncodeVarint(&record[size], value_2);
+        record[size++] = flag;
+        break;
+        
+      case EXTERNAL_FLASH_CAPTURE_RECORD_COMPLETE:
+      default:
+        size += EncodeVarint(&record[size], value_1);
+        break;
+    }
+    
+    EXTERNAL_FLASH_CAPTURE_SINK(record, size);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Encodes a LEB128 varint
+ *
+ *  @param      data : destination, at least 5 bytes
+ *  @param      value : value to encode
+ *  @return     encoded size
+ */
+static uint8_t EncodeVarint(uint8_t* data, uint32_t value)
+{
+    uint8_t size = 0;
+    
+    while(value >= 0x80)
+    {
+        data[size++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    data[size++] = (uint8_t)value;
+    
+    return size;
+}
+
+#ifdef EXTERNAL_FLASH_CAPTURE_RAM
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Default capture sink, appends the record to the RAM capture buffer
+ *  @details    Once a record does not fit the capture stops, so the stored stream is always a consistent prefix.
+ *
+ *  @param      record : encoded record
+ *  @param      size : record size
+ */
+static void CaptureStore(const uint8_t* record, uint8_t size)
+{
+    if((ExternalFlash_Capture_Dropped == 0) && ((ExternalFlash_Capture_Size + size) <= EXTERNAL_FLASH_CAPTURE_SIZE))
+    {
+        memcpy(&ExternalFlash_Capture[ExternalFlash_Capture_Size], record, size);
+        ExternalFlash_Capture_Size += size;
+    }
+    else
+    {
+        ExternalFlash_Capture_Dropped++;
+    }
+}
+#endif
+#endif
+
+#if (EXTERNAL_FLASH_STATS_FEATURE == ENABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Starts the statistics of an accepted Read/Write request
+ *
+ *  @param      instance_id : specific External FLash instance
+ */
+static void StatsRequest(uint8_t instance_id)
+{
+    ExternalFlash_Stats[instance_id].Request_Us = EXTERNAL_FLASH_TIMESTAMP_US();
+    ExternalFlash_Stats[instance_id].Busy = FALSE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Counts bus transfers completed later than the wait timeout, called from the bus event
+ *
+ *  @param      instance_id : specific External FLash instance
+ */
+static void StatsBusEvent(uint8_t instance_id)
+{
+    if((EXTERNAL_FLASH_TIMESTAMP_US() - ExternalFlash_Stats[instance_id].Bus_Request_Us) > (EXTERNAL_FLASH_WAIT_TIMEOUT_MS * 1000UL))
+    {
+        ExternalFlash_Stats[instance_id].Stats.Late_Transfers++;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Accounts a status register poll, busy polls and the time spent waiting for the chip
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      ready : RDY/BUSY bit of the status register
+ */
+static void StatsStatus(uint8_t instance_id, BOOL_TYPE ready)
+{
+    uint32_t now_us = EXTERNAL_FLASH_TIMESTAMP_US();
+    
+    if(ready == FALSE)
+    {
+        ExternalFlash_Stats[instance_id].Stats.Busy_Polls++;
+        if(ExternalFlash_Stats[instance_id].Busy == FALSE)
+        {
+            ExternalFlash_Stats[instance_id].Busy_Since_Us = now_us;
+            ExternalFlash_Stats[instance_id].Busy = TRUE;
+        }
+    }
+    else if(ExternalFlash_Stats[instance_id].Busy == TRUE)
+    {
+        ExternalFlash_Stats[instance_id].Stats.Busy_Wait_Us += now_us - ExternalFlash_Stats[instance_id].Busy_Since_Us;
+        ExternalFlash_Stats[instance_id].Busy = FALSE;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Accounts a completed Read/Write request and its latency from submit to callback
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      write : TRUE for a write request, FALSE for a read request
+ */
+static void StatsComplete(uint8_t instance_id, BOOL_TYPE write)
+{
+    uint32_t latency_us = EXTERNAL_FLASH_TIMESTAMP_US() - ExternalFlash_Stats[instance_id].Request_Us;
+    uint8_t bucket = 0;
+    
+    // Bucket is the bit length of the latency
+    while((latency_us != 0) && (bucket < (EXTERNAL_FLASH_STATS_LATENCY_BUCKETS - 1)))
+    {
+        latency_us >>= 1;
+        bucket++;
+    }
+    
+    if(write == TRUE)
+    {
+        ExternalFlash_Stats[instance_id].Stats.Writes++;
+        ExternalFlash_Stats[instance_id].Stats.Bytes_Written += ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size;
+        ExternalFlash_Stats[instance_id].Stats.Write_Latency[bucket]++;
+    }
+    else
+    {
+        ExternalFlash_Stats[instance_id].Stats.Reads++;
+        ExternalFlash_Stats[instance_id].Stats.Bytes_Read += ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size;
+        ExternalFlash_Stats[instance_id].Stats.Read_Latency[bucket]++;
+    }
+}
+#endif
 
-          case EXTERNAL_FLASH_STATE_INVALID:
-            break;
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Builds the CRC tables if needed
+ */
+static void CrcInitialize(void)
+{
+#if (EXTERNAL_FLASH_INTEGRITY_SLICING_FEATURE == ENABLED)
+    for(uint16_t index = 0; index < 256; index++)
+    {
+        uint32_t value = index;
+        
+        for(uint8_t bit = 0; bit < 8; bit++)
+        {
+            value = (value & 1) ? ((value >> 1) ^ 0xEDB88320UL) : (value >> 1);
+        }
+        ExternalFlash_Crc_Table[0][index] = value;
+    }
+    for(uint16_t index = 0; index < 256; index++)
+    {
+        // Table n advances the CRC of a byte followed by n zero bytes
+        for(uint8_t slice = 1; slice < 8; slice++)
+        {
+            ExternalFlash_Crc_Table[slice][index] = (ExternalFlash_Crc_Table[slice - 1][index] >> 8) ^
+                                                    ExternalFlash_Crc_Table[0][ExternalFlash_Crc_Table[slice - 1][index] & 0xFF];
         }
     }
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Updates a CRC-32 register (reflected, polynomial 0xEDB88320) with data, without initial value and final
+ *              XOR: the CRC of a buffer is ~GetCrc(0xFFFFFFFF, buffer, size)
+ *
+ *  @param      crc : CRC register
+ *  @param      data : data
+ *  @param      size : data bytes
+ *  @return     updated CRC register
+ */
+static uint32_t GetCrc(uint32_t crc, const uint8_t* data, uint16_t size)
+{
+#if (EXTERNAL_FLASH_INTEGRITY_SLICING_FEATURE == ENABLED)
+    // Eight bytes per step, the data is read byte by byte so neither alignment nor endianness matter
+    while(size >= 8)
+    {
+        uint32_t low = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+        uint32_t high = (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+        
+        crc = ExternalFlash_Crc_Table[7][low & 0xFF] ^ ExternalFlash_Crc_Table[6][(low >> 8) & 0xFF] ^
+              ExternalFlash_Crc_Table[5][(low >> 16) & 0xFF] ^ ExternalFlash_Crc_Table[4][low >> 24] ^
+              ExternalFlash_Crc_Table[3][high & 0xFF] ^ ExternalFlash_Crc_Table[2][(high >> 8) & 0xFF] ^
+              ExternalFlash_Crc_Table[1][(high >> 16) & 0xFF] ^ ExternalFlash_Crc_Table[0][high >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while(size > 0)
+    {
+        crc = (crc >> 8) ^ ExternalFlash_Crc_Table[0][(crc ^ *data++) & 0xFF];
+        size--;
+    }
+#else
+    while(size > 0)
+    {
+        crc = (crc >> 4) ^ ExternalFlash_Crc_Table[(crc ^ *data) & 0x0F];
+        crc = (crc >> 4) ^ ExternalFlash_Crc_Table[(crc ^ (*data >> 4)) & 0x0F];
+        data++;
+        size--;
+    }
+#endif
+    return crc;
 }
 
+#if (EXTERNAL_FLASH_INTEGRITY_FEATURE == ENABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      No page CRC is known yet
+ */
+static void IntegrityInitialize(void)
+{
+    memset(ExternalFlash_Integrity_Error, 0x00, sizeof(ExternalFlash_Integrity_Error));
+}
 
-BOOL_TYPE ExternalFlash__Read(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Checks the whole pages of the completed read against their CRC, learning the CRC of unknown pages
+ *  @details    The CRC is computed on the data already in the client buffer, the pages are not read again. A mismatch
+ *              is reported to ExternalFlash__CheckIntegrity.
+ *
+ *  @param      instance_id : specific External FLash instance
+ */
+static void IntegrityRead(uint8_t instance_id)
 {
-    BOOL_TYPE success = FALSE;
-    //If a valid instance
-    if(instance_id < EXTERNAL_FLASH_CH_NUM)
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    uint32_t address = ExternalFlash_Instance_Store[instance_id].NVM_Target_Address;
+    uint32_t end = address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size;
+    uint32_t page_address = EXTERNAL_FLASH_PAGE_OF(instance_id, address + EXTERNAL_FLASH_PAGE_SIZE(instance_id) - 1) * EXTERNAL_FLASH_PAGE_SIZE(instance_id);
+    
+    while((page_address + EXTERNAL_FLASH_PAGE_SIZE(instance_id)) <= end)
     {
-        //if a client has a buond bus instance
-        if(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel != INVALID_VALUE_8)
+        uint16_t page = (uint16_t)(EXTERNAL_FLASH_PAGE_OF(instance_id, page_address) & (EXTERNAL_FLASH_PAGE_NUMBER(instance_id) - 1));
+        uint32_t crc = ~GetCrc(0xFFFFFFFFUL, ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer + (page_address - address), EXTERNAL_FLASH_PAGE_SIZE(instance_id));
+        
+        if((chip->Page_Crc_Known[page / 8] & (1 << (page % 8))) == 0)
         {
-            //If no current process active
-            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_NONE &&
-               ExternalFlash_Instance_Store[instance_id].NVM_State == EXTERNAL_FLASH_STATE_IDLE)
-            {
-                //Get pointer to start transaction handler
-                COMMBUS__STARTTRANSACTION start_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].StartTransaction;
-                
-                //If handlers exists
-                if(start_handler != NULL)
-                {
-                    if(start_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel) == TRUE)
-                    {
-                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer = (uint8_t*)buffer;
-                        ExternalFlash_Instance_Store[instance_id].NVM_Target_Address = ExternalFlash_Instance_Store[instance_id].NVM_Instance_Memory_Offset + data_address;
-                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size = size;
-                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress = 0;
-                        
-                        ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
-                        
-                        ExternalFlash_Instance_Store[instance_id].NVM_State = EXTERNAL_FLASH_STATE_SEND_READ_HEADER;
-                        
-                        SendReadHeader(instance_id);
-                    }
-                }
-            }
+            SetPageCrc(instance_id, page, crc);
+#if (EXTERNAL_FLASH_SCRUB_FEATURE == ENABLED)
+            // Maybe from a page already degraded, the scrub does not check against it
+            chip->Page_Crc_Learned[page / 8] |= (uint8_t)(1 << (page % 8));
+#endif
+        }
+        else if(chip->Page_Crc[page] != crc)
+        {
+            // The CRC is kept, the page stays reported until it is written again
+            ExternalFlash_Integrity_Error[instance_id] = TRUE;
+            EXTERNAL_FLASH_STATS_COUNT(instance_id, Crc_Errors, 1);
         }
+        
+        page_address += EXTERNAL_FLASH_PAGE_SIZE(instance_id);
     }
-    return success;
 }
 
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Updates the CRC of the page of the (partial) page write just sent
+ *  @details    A whole page write sets the CRC from the data. A program only clears bits, its result is the data only
+ *              where the page was erased: it updates the CRC of a page known erased, from the erased page map or its
+ *              CRC, and CRC-32 being linear a partial program changes it by the CRC of the difference, i.e. of the
+ *              bytes XOR 0xFF followed by zeros up to the page end. A merged page write or program sets the CRC
+ *              from the whole page merged in Merge_Buffer. Any other partial write or program leaves bytes the driver
+ *              does not know, the page CRC becomes unknown.
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      write_size : bytes written in the page
+ */
+static void IntegrityWrite(uint8_t instance_id, uint16_t write_size)
+{
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    uint32_t address = ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
+    uint16_t page = (uint16_t)(EXTERNAL_FLASH_PAGE_OF(instance_id, address) & (EXTERNAL_FLASH_PAGE_NUMBER(instance_id) - 1));
+    uint16_t offset = (uint16_t)EXTERNAL_FLASH_PAGE_OFFSET(instance_id, address);
+    const uint8_t* data = ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
+    BOOL_TYPE erased = FALSE;
+    
+    if(((chip->Page_Crc_Known[page / 8] & (1 << (page % 8))) != 0) && (chip->Page_Crc[page] == chip->Erased_Crc))
+    {
+        erased = TRUE;
+    }
+#if (EXTERNAL_FLASH_BLANK_FEATURE == ENABLED)
+    // Checked before EXTERNAL_FLASH_BLANK_WRITE clears the page from the map
+    if((chip->Page_Erased[page / 8] & (1 << (page % 8))) != 0)
+    {
+        erased = TRUE;
+    }
+#endif
+    
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    if(ExternalFlash_Instance_Spare[instance_id].Merge == TRUE)
+    {
+        // The page content is known whole from the merge, written or programmed
+        SetPageCrc(instance_id, page, ~GetCrc(0xFFFFFFFFUL, chip->Merge_Buffer, EXTERNAL_FLASH_PAGE_SIZE(instance_id)));
+    }
+    else
+#endif
+    if((ExternalFlash_Instance_Operation[instance_id] == EXTERNAL_FLASH_OPERATION_PROGRAM) && (erased == FALSE))
+    {
+        // Programmed over bytes the driver does not know, e.g. a bit-flip counter clearing more bits
+        chip->Page_Crc_Known[page / 8] &= (uint8_t)~(1 << (page % 8));
+    }
+    else if(write_size == EXTERNAL_FLASH_PAGE_SIZE(instance_id))
+    {
+        SetPageCrc(instance_id, page, ~GetCrc(0xFFFFFFFFUL, data, EXTERNAL_FLASH_PAGE_SIZE(instance_id)));
+    }
+    else if(ExternalFlash_Instance_Operation[instance_id] == EXTERNAL_FLASH_OPERATION_PROGRAM)
+    {
+        uint32_t crc = 0;
+        
+        for(uint16_t index = 0; index < write_size; index++)
+        {
+            uint8_t delta = (uint8_t)(data[index] ^ 0xFF);
+            
+            crc = GetCrc(crc, &delta, 1);
+        }
+        SetPageCrc(instance_id, page, chip->Erased_Crc ^ GetCrcZeros(crc, (uint16_t)(EXTERNAL_FLASH_PAGE_SIZE(instance_id) - offset - write_size)));
+    }
+    else
+    {
+        chip->Page_Crc_Known[page / 8] &= (uint8_t)~(1 << (page % 8));
+    }
+    
+#if (EXTERNAL_FLASH_SCRUB_FEATURE == ENABLED)
+    // A pending check or repair of the page would use the data read before this write
+    if((chip->Scrub_Step != EXTERNAL_FLASH_SCRUB_STEP_READ) && (chip->Scrub_Busy == FALSE) && (chip->Scrub_Page == page))
+    {
+        chip->Scrub_Step = EXTERNAL_FLASH_SCRUB_STEP_READ;
+    }
+#endif
+}
 
-BOOL_TYPE ExternalFlash__Write(uint8_t instance_id, void* buffer, uint32_t data_address, uint16_t size)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Sets the CRC of the pages of the erase step just sent to the CRC of an erased page
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      erase_size : bytes erased
+ */
+static void IntegrityErase(uint8_t instance_id, uint16_t erase_size)
 {
-     BOOL_TYPE success = FALSE;
+    uint32_t address = ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress;
     
-    // If a valid instnace
-    if(instance_id < EXTERNAL_FLASH_CH_NUM)
+    for(uint16_t offset = 0; offset < erase_size; offset += EXTERNAL_FLASH_PAGE_SIZE(instance_id))
     {
-        // If client has a bound bus instance
-        if(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel != INVALID_VALUE_8)
+        uint16_t page = (uint16_t)(EXTERNAL_FLASH_PAGE_OF(instance_id, address + offset) & (EXTERNAL_FLASH_PAGE_NUMBER(instance_id) - 1));
+        
+        SetPageCrc(instance_id, page, ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Erased_Crc);
+        
+#if (EXTERNAL_FLASH_SCRUB_FEATURE == ENABLED)
+        // A pending check or repair of the page would use the data read before this erase
+        if((ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Scrub_Step != EXTERNAL_FLASH_SCRUB_STEP_READ) &&
+           (ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Scrub_Page == page))
         {
-            // If no current process active
-            if(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process == NVDATA_PROCESS_NONE &&
-               ExternalFlash_Instance_Store[instance_id].NVM_State == EXTERNAL_FLASH_STATE_IDLE)
-            {      
-                // Get pointer to Start Transaction handler
-                COMMBUS__STARTTRANSACTION start_handler =  GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].StartTransaction;
-                
-                // If handlers exist
-                if(start_handler != NULL)
-                {
-                    // If transaction started
-                    if(start_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel) == TRUE)
-                    {                                     
-                        // If External FLash instance has the write protection pin feature enabled
-                        if(ExternalFlash_Map[instance_id].ExternalFlash_WP_Feature == ENABLED)
-                        {
-                            // Disable Write Protection
-                            GENERIC_IO_HANDLERS[GENERIC_IO_DIGITALIO].Write(ExternalFlash_Map[instance_id].ExternalFlash_WP_Pin, ExternalFlash_Map[instance_id].ExternalFlash_WP_Level);
-                        }    
-                        
-                        // Prepare process data
-                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer = (uint8_t*)buffer;
-                        ExternalFlash_Instance_Store[instance_id].NVM_Target_Address = ExternalFlash_Instance_Store[instance_id].NVM_Instance_Memory_Offset + data_address;
-                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size = size;
-                        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress = 0;
-                        
-                        // Update NV Process Info
-                        ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WAIT_WRITE;
+            ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]].Scrub_Step = EXTERNAL_FLASH_SCRUB_STEP_READ;
+        }
+#endif
+    }
+}
 
-                        // Update Memory State machine
-                        ExternalFlash_Instance_Store[instance_id].NVM_State = EXTERNAL_FLASH_STATE_SEND_WRITE_HEADER;
-                        
-                        // Send write header
-                        SendWriteHeader(instance_id); 
-                        
-                        // Manage NV Memory RAM mirror if reference not null
-                        if(ExternalFlash_Instance_Store[instance_id].NVM_Mirror_Pointer != NULL)
-                        {
-                            memcpy((void*)(((uint8_t*)ExternalFlash_Instance_Store[instance_id].NVM_Mirror_Pointer) + data_address), buffer, size);
-                        }       
-                        
-                        // Resume Task to process the write request
-                        SystemTimers__ResumeTask(ExternalFlash_Handler_Index);
-                        
-                        success = TRUE;
-                    }
-                }
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Stores the CRC of a page of the instance chip and marks it known
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      page : page index in the device
+ *  @param      crc : page CRC
+ */
+static void SetPageCrc(uint8_t instance_id, uint16_t page, uint32_t crc)
+{
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    
+    chip->Page_Crc[page] = crc;
+    chip->Page_Crc_Known[page / 8] |= (uint8_t)(1 << (page % 8));
+#if (EXTERNAL_FLASH_SCRUB_FEATURE == ENABLED)
+    chip->Page_Crc_Learned[page / 8] &= (uint8_t)~(1 << (page % 8));
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Updates a CRC-32 register with zero bytes
+ *
+ *  @param      crc : CRC register
+ *  @param      size : zero bytes
+ *  @return     updated CRC register
+ */
+static uint32_t GetCrcZeros(uint32_t crc, uint16_t size)
+{
+    static const uint8_t zeros[16] = {0};
+    
+    while(size > 0)
+    {
+        uint16_t step = MIN(size, sizeof(zeros));
+        
+        crc = GetCrc(crc, zeros, step);
+        size -= step;
+    }
+    return crc;
+}
+#endif
+
+#if (EXTERNAL_FLASH_SCRUB_FEATURE == ENABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Starts the next scrub step on an idle instance and chip
+ *  @details    The step runs as a read or a whole page write of the instance, at device addresses and from the chip
+ *              scrub buffer. It does not touch the instance mirror and its completion goes to ScrubComplete instead of
+ *              the clients.
+ *
+ *  @param      instance_id : scrub instance of the chip
+ *  @return     TRUE if started, FALSE if the bus transaction could not be started
+ */
+static BOOL_TYPE StartScrub(uint8_t instance_id)
+{
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    COMMBUS__STARTTRANSACTION start_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].StartTransaction;
+    BOOL_TYPE success = FALSE;
+    
+    if((start_handler != NULL) && (start_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel) == TRUE))
+    {
+        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer = chip->Scrub_Buffer;
+        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress = 0;
+        
+        if(chip->Scrub_Step == EXTERNAL_FLASH_SCRUB_STEP_READ)
+        {
+            // Whole pages, one at least
+            uint16_t scrub_size = (uint16_t)(EXTERNAL_FLASH_PAGE_OF(instance_id, EXTERNAL_FLASH_SCRUB_SIZE) * EXTERNAL_FLASH_PAGE_SIZE(instance_id));
+            
+            // On chips with a spare area each page is checked against its metadata, read next
+            if((scrub_size == 0) || (EXTERNAL_FLASH_SPARE_SIZE(instance_id) != 0))
+            {
+                scrub_size = EXTERNAL_FLASH_PAGE_SIZE(instance_id);
+            }
+            
+            ExternalFlash_Instance_Store[instance_id].NVM_Target_Address = chip->Scrub_Address;
+            ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size = (uint16_t)MIN(scrub_size, EXTERNAL_FLASH_NUMBER_OF_BYTES(instance_id) - chip->Scrub_Address);
+            
+            // Spread the reads over time within the budget
+            chip->Scrub_Wait_Us = (uint32_t)(((uint64_t)ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size * 1000000UL) / EXTERNAL_FLASH_SCRUB_BYTES_PER_S);
+        }
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+        else if(chip->Scrub_Step == EXTERNAL_FLASH_SCRUB_STEP_SPARE)
+        {
+            // Metadata of the page just read, follows at once
+            ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer = (uint8_t*)&chip->Scrub_Spare;
+            ExternalFlash_Instance_Store[instance_id].NVM_Target_Address = (uint32_t)chip->Scrub_Page * EXTERNAL_FLASH_PAGE_SIZE(instance_id);
+            ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size = sizeof(EXTERNAL_FLASH_SPARE_TYPE);
+            ExternalFlash_Instance_Spare[instance_id].Active = TRUE;
+            chip->Scrub_Wait_Us = 0;
+        }
+#endif
+        else
+        {
+            // Verify and repair follow at once
+            ExternalFlash_Instance_Store[instance_id].NVM_Target_Address = (uint32_t)chip->Scrub_Page * EXTERNAL_FLASH_PAGE_SIZE(instance_id);
+            ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size = EXTERNAL_FLASH_PAGE_SIZE(instance_id);
+            chip->Scrub_Wait_Us = 0;
+        }
+        
+        // Claim the chip for bus event dispatch
+        chip->Active_Instance = instance_id;
+        chip->Scrub_Busy = TRUE;
+        chip->Scrub_Us = EXTERNAL_FLASH_TIMESTAMP_US();
+        
+        if(chip->Scrub_Step == EXTERNAL_FLASH_SCRUB_STEP_REPAIR)
+        {
+            if(ExternalFlash_Map[instance_id].ExternalFlash_WP_Feature == ENABLED)
+            {
+                // Disable Write Protection
+                GENERIC_IO_HANDLERS[GENERIC_IO_DIGITALIO].Write(ExternalFlash_Map[instance_id].ExternalFlash_WP_Pin, ExternalFlash_Map[instance_id].ExternalFlash_WP_Level);
+            }
+            
+            ExternalFlash_Instance_Operation[instance_id] = EXTERNAL_FLASH_OPERATION_WRITE;
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+            if(EXTERNAL_FLASH_SPARE_SIZE(instance_id) != 0)
+            {
+                // Written back with its metadata, as by ExternalFlash__WritePages
+                ExternalFlash_Instance_Spare[instance_id].First = chip->Scrub_Spare;
+                ExternalFlash_Instance_Spare[instance_id].Active = TRUE;
+                ExternalFlash_Instance_Spare[instance_id].Loaded = FALSE;
             }
+#endif
+            
+            // Wait for the chip to be ready before writing the page back
+            SendStatusCommand(instance_id, EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_WRITE);
         }
+        else
+        {
+            // Wait for the chip to be ready before sending the read header
+            SendStatusCommand(instance_id, EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_READ);
+        }
+        
+        success = TRUE;
     }
     
     return success;
 }
 
-
-
-uint8_t ExternalFlash__GetAllocation(uint8_t client_id, void* mirror_pointer, uint16_t nv_instance_offset)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Checks the result of the completed scrub step and picks the next one
+ *  @details    A page failing its CRC is read again on its own: a match means the first read hit a marginal page, which
+ *              is then rewritten with the good data; a second mismatch is reported. The walk goes on after the page. On
+ *              chips with a spare area the walk reads one page at a time, then its metadata.
+ *
+ *  @param      instance_id : scrub instance of the chip
+ */
+static void ScrubComplete(uint8_t instance_id)
 {
-    uint8_t instance_id = INVALID_VALUE_8;
-
-    // Scroll through ExternalFlash_Map
-    for(instance_id = 0; instance_id < ELEMENTS_IN_ARRAY(ExternalFlash_Map); instance_id++)
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    uint32_t checked_address = ExternalFlash_Instance_Store[instance_id].NVM_Target_Address;
+    uint16_t checked_size = 0;
+    uint16_t failed_page = INVALID_VALUE_16;
+    
+    chip->Scrub_Busy = FALSE;
+    
+    switch(chip->Scrub_Step)
+    {
+      case EXTERNAL_FLASH_SCRUB_STEP_READ:
+        EXTERNAL_FLASH_STATS_COUNT(instance_id, Scrub_Bytes, ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size);
+        
+        if(EXTERNAL_FLASH_SPARE_SIZE(instance_id) != 0)
+        {
+            // The page data stays in the scrub buffer until its metadata is read
+            chip->Scrub_Page = (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, chip->Scrub_Address);
+            chip->Scrub_Step = EXTERNAL_FLASH_SCRUB_STEP_SPARE;
+        }
+        else
+        {
+            checked_size = ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size;
+            failed_page = ScrubCheck(instance_id, checked_address, checked_size);
+        }
+        break;
+        
+      case EXTERNAL_FLASH_SCRUB_STEP_SPARE:
+        checked_address = (uint32_t)chip->Scrub_Page * EXTERNAL_FLASH_PAGE_SIZE(instance_id);
+        checked_size = EXTERNAL_FLASH_PAGE_SIZE(instance_id);
+        failed_page = ScrubCheck(instance_id, checked_address, checked_size);
+        
+        chip->Scrub_Step = EXTERNAL_FLASH_SCRUB_STEP_READ;
+        break;
+        
+      case EXTERNAL_FLASH_SCRUB_STEP_VERIFY:
+        EXTERNAL_FLASH_STATS_COUNT(instance_id, Scrub_Bytes, EXTERNAL_FLASH_PAGE_SIZE(instance_id));
+        
+        if(ScrubCheck(instance_id, checked_address, EXTERNAL_FLASH_PAGE_SIZE(instance_id)) == INVALID_VALUE_16)
+        {
+            chip->Scrub_Step = EXTERNAL_FLASH_SCRUB_STEP_REPAIR;
+        }
+        else
+        {
+            ReportIntegrityError(instance_id);
+            chip->Scrub_Step = EXTERNAL_FLASH_SCRUB_STEP_READ;
+        }
+        break;
+        
+      case EXTERNAL_FLASH_SCRUB_STEP_REPAIR:
+      default:
+        EXTERNAL_FLASH_STATS_COUNT(instance_id, Scrub_Repairs, 1);
+        
+        chip->Scrub_Step = EXTERNAL_FLASH_SCRUB_STEP_READ;
+        break;
+    }
+    
+    if(checked_size != 0)
     {
-        // If client id matches
-        if(ExternalFlash_Map[instance_id].ExternalFlash_Channel == (EXTERNAL_FLASH_CH_TYPE)client_id)
+        if(failed_page != INVALID_VALUE_16)
         {
-            // Chache matching instance id            
-            ExternalFlash_Instance_Store[instance_id].NVM_Mirror_Pointer = mirror_pointer;    
-            ExternalFlash_Instance_Store[instance_id].NVM_Instance_Memory_Offset = nv_instance_offset;                   
-            break;
+            chip->Scrub_Page = failed_page;
+            chip->Scrub_Step = EXTERNAL_FLASH_SCRUB_STEP_VERIFY;
+            chip->Scrub_Address = ((uint32_t)failed_page + 1) * EXTERNAL_FLASH_PAGE_SIZE(instance_id);
+        }
+        else
+        {
+            chip->Scrub_Address = checked_address + checked_size;
+        }
+        
+        if(chip->Scrub_Address >= EXTERNAL_FLASH_NUMBER_OF_BYTES(instance_id))
+        {
+            chip->Scrub_Address = 0;
         }
     }
-    return instance_id;
-}
-
-//---------------------------------------------------------------------------------------------------------------------
-/**
- * @brief   Registers event handler with the module.
- * @param   event_handler: pointer to the function that handles the event
- */
-void ExternalFlash__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value)
-{
-    Callback__Register(&ExternalFlash_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler, filter_id, filter_value);
 }
 
 //---------------------------------------------------------------------------------------------------------------------
 /**
- * @brief   Unregisters event handler with the module.
- * @param   event_handler: pointer to the function that handles the event
+ *  @brief      Checks the whole pages of a completed scrub read against a CRC not learned from the chip
+ *  @details    On chips with a spare area the page is checked against the CRC of its metadata, programmed with the
+ *              page, an erased page has none. Otherwise only the CRCs set by the writes, programs and erases of the
+ *              driver are used: a CRC learned by a read may come from a page already degraded. Pages without such a
+ *              CRC are skipped.
+ *
+ *  @param      instance_id : scrub instance of the chip
+ *  @param      address : device address of the data in the scrub buffer, page aligned
+ *  @param      size : bytes read
+ *  @return     first page not matching its CRC, INVALID_VALUE_16 if none
  */
-void ExternalFlash__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler)
+static uint16_t ScrubCheck(uint8_t instance_id, uint32_t address, uint16_t size)
 {
-    Callback__Unregister(&ExternalFlash_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler);
-}
-
-BOOL_TYPE ExternalFlash__IsBusy(uint8_t externalflash_instance)
-{
-    BOOL_TYPE retval = TRUE;
-    return retval;
-}
-
-BOOL_TYPE ExternalFlash__CheckIntegrity(uint8_t flash_instance)
-{
-    BOOL_TYPE retval = TRUE;
-    return retval;
-}
-
-
-
-//=====================================================================================================================
-//-------------------------------------- Private Functions ------------------------------------------------------------
-//=====================================================================================================================
-
-static BOOL_TYPE SendCommand(uint8_t instance_id, uint8_t command_id)
-{
-    BOOL_TYPE success = TRUE;
-        // Get pointer to Write handler
-    COMMBUS__WRITE write_handler =  GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Write;
-        
-    // If handlers exist
-    if(write_handler != NULL)
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    uint16_t failed_page = INVALID_VALUE_16;
+    
+    for(uint16_t offset = 0; (offset + EXTERNAL_FLASH_PAGE_SIZE(instance_id)) <= size; offset += EXTERNAL_FLASH_PAGE_SIZE(instance_id))
     {
-        // Call Handler
-        if(write_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
-                         (void*)&command_id, 
-                         COMMBUS_ADDRESS_NONE, 
-                         sizeof(uint8_t)) == TRUE)
+        uint16_t page = (uint16_t)(EXTERNAL_FLASH_PAGE_OF(instance_id, address + offset) & (EXTERNAL_FLASH_PAGE_NUMBER(instance_id) - 1));
+        BOOL_TYPE failed = FALSE;
+        
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+        if(EXTERNAL_FLASH_SPARE_SIZE(instance_id) != 0)
         {
-            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
+            if((chip->Scrub_Spare.Crc != INVALID_VALUE_16) || (chip->Scrub_Spare.Logical_Page != INVALID_VALUE_16))
             {
-                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
-                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
-                
-                // Start Timeout handle
-                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
+                failed = ((uint16_t)ExternalFlash__GetCrc(0, &chip->Scrub_Buffer[offset], EXTERNAL_FLASH_PAGE_SIZE(instance_id)) != chip->Scrub_Spare.Crc) ? TRUE : FALSE;
             }
-    
-            // Signal ExternalFlash request success
-            success = TRUE;
+        }
+        else
+#endif
+        if(((chip->Page_Crc_Known[page / 8] & (1 << (page % 8))) != 0) && ((chip->Page_Crc_Learned[page / 8] & (1 << (page % 8))) == 0))
+        {
+            failed = (~GetCrc(0xFFFFFFFFUL, &chip->Scrub_Buffer[offset], EXTERNAL_FLASH_PAGE_SIZE(instance_id)) != chip->Page_Crc[page]) ? TRUE : FALSE;
+        }
+        
+        if((failed == TRUE) && (failed_page == INVALID_VALUE_16))
+        {
+            failed_page = page;
         }
     }
-    return success;
+    
+    return failed_page;
 }
 
 //---------------------------------------------------------------------------------------------------------------------
 /**
- *  @brief      This function sends the Read Header to External FLash memory using the selected bus
+ *  @brief      Reports a page failing its CRC to all the instances of the chip
  *
- *  @param      instance_id : specific External FLash instance
- *  @return     TRUE if Read process was successful, FALSE otherwise
+ *  @param      instance_id : scrub instance of the chip
  */
-static BOOL_TYPE SendReadHeader(uint8_t instance_id)
+static void ReportIntegrityError(uint8_t instance_id)
 {
-    static EXTERNAL_FLASH_READ_HEADER_TYPE header;
-    BOOL_TYPE success = FALSE;
-    uint16_t page_address;
-    uint8_t  byte_address;
+    EXTERNAL_FLASH_STATS_COUNT(instance_id, Crc_Errors, 1);
     
-    page_address = ExternalFlash_Instance_Store[instance_id].NVM_Target_Address / EXTERNAL_FLASH_PAGE_NUMBER;
-    byte_address = ExternalFlash_Instance_Store[instance_id].NVM_Target_Address % EXTERNAL_FLASH_PAGE_NUMBER;
-    header.ExternalFlash_OpCode_Cmd = EXTERNAL_FLASH_CMD_READ_MEMORY;
-    
-    memcpy(header.ExternalFlash_Address + EXTERNAL_FLASH_PAGE_ADDRESS_BYTE, (void*)&byte_address, EXTERNAL_FLASH_PAGE_BYTE_ADDRESS_BYTE);
-    memcpy(header.ExternalFlash_Address, (void*)&page_address, EXTERNAL_FLASH_PAGE_ADDRESS_BYTE);
-    
-    // Get pointer to Write handler
-    COMMBUS__WRITE write_handler =  GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Write;
-        
-    // If handlers exist
-    if(write_handler != NULL)
+    for(uint8_t other_id = 0; other_id < EXTERNAL_FLASH_CH_NUM; other_id++)
     {
-        // Call Handler
-        if(write_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
-                         (void*)&header, 
-                         COMMBUS_ADDRESS_NONE, 
-                         sizeof(EXTERNAL_FLASH_READ_HEADER_TYPE)) == TRUE)
+        if(ExternalFlash_Instance_Chip[other_id] == ExternalFlash_Instance_Chip[instance_id])
         {
-            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
-            {
-                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
-                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
-                
-                // Start Timeout handle
-                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
-            }
-    
-            // Signal ExternalFlash request success
-            success = TRUE;
+            ExternalFlash_Integrity_Error[other_id] = TRUE;
         }
     }
-    
-    return success;
 }
+#endif
 
-static BOOL_TYPE ReadData(uint8_t instance_id)
+#if (EXTERNAL_FLASH_BLANK_FEATURE == ENABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Starts the next blank check step on an idle instance and chip
+ *  @details    The step runs as a read of the instance, at device addresses and into the chip blank check buffer: a
+ *              continuous array read of whole pages, split at the page spare areas if any. It does not touch the
+ *              instance mirror and its completion goes to BlankComplete instead of the clients.
+ *
+ *  @param      instance_id : blank check instance of the chip
+ *  @return     TRUE if started, FALSE if the bus transaction could not be started
+ */
+static BOOL_TYPE StartBlankStep(uint8_t instance_id)
 {
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    COMMBUS__STARTTRANSACTION start_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].StartTransaction;
     BOOL_TYPE success = FALSE;
     
-    // Get pointer to Read handler
-    COMMBUS__READ read_handler =  GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Read;
-        
-    // If handlers exist
-    if(read_handler != NULL)
+    if((start_handler != NULL) && (start_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel) == TRUE))
     {
-        // Call Handler
-        if(read_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
-                         (void*)ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer, 
-                         COMMBUS_ADDRESS_NONE, 
-                         ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size) == TRUE)
+        // Whole pages, one at least
+        uint16_t step_size = (uint16_t)(EXTERNAL_FLASH_PAGE_OF(instance_id, EXTERNAL_FLASH_BLANK_SCAN_SIZE) * EXTERNAL_FLASH_PAGE_SIZE(instance_id));
+        
+        if(step_size == 0)
         {
-            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
-            {
-                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
-                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
-                
-                // Start Timeout handle
-                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
-            }
-            
-            // Signal External Flash request success
-            success = TRUE;
+            step_size = EXTERNAL_FLASH_PAGE_SIZE(instance_id);
         }
-    }   
+        
+        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer = (uint8_t*)chip->Blank_Buffer;
+        ExternalFlash_Instance_Store[instance_id].NVM_Target_Address = chip->Blank_Address;
+        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size = (uint16_t)MIN(step_size, chip->Blank_End - chip->Blank_Address);
+        ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress = 0;
+        
+        // Claim the chip for bus event dispatch
+        chip->Active_Instance = instance_id;
+        chip->Blank_Busy = TRUE;
+        
+        // Wait for the chip to be ready before sending the read header
+        SendStatusCommand(instance_id, EXTERNAL_FLASH_STATE_SEND_READ_STATUS_REGISTER_COMMAND_BEFORE_READ);
+        
+        success = TRUE;
+    }
+    
     return success;
 }
+
 //---------------------------------------------------------------------------------------------------------------------
 /**
- *  @brief      This function sends the Write Header to External FLash memory using the selected bus
+ *  @brief      Marks the pages of the completed blank check step, then goes on with the next step or notifies the end
+ *              of the check to the clients
  *
- *  @param      instance_id : specific External FLash instance
- *  @return     TRUE if Write process was successful, FALSE otherwise
+ *  @param      instance_id : blank check instance of the chip
  */
-static BOOL_TYPE SendWriteHeader(uint8_t instance_id)
+static void BlankComplete(uint8_t instance_id)
 {
-    static EXTERNAL_FLASH_WRITE_HEADER_TYPE header;
-    BOOL_TYPE success = FALSE;
-    uint16_t page_address;
-    uint8_t  byte_address;
-    
-    header.ExternalFlash_OpCode_Cmd = EXTERNAL_FLASH_CMD_WRITE_MEMORY;
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
+    uint16_t page = (uint16_t)EXTERNAL_FLASH_PAGE_OF(instance_id, chip->Blank_Address);
+    COMMON_I_CALLBACK_TYPE nv_callback;
     
-    page_address = (ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress) / EXTERNAL_FLASH_PAGE_NUMBER;
-    byte_address = (ExternalFlash_Instance_Store[instance_id].NVM_Target_Address + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress) % EXTERNAL_FLASH_PAGE_NUMBER;
-    header.ExternalFlash_OpCode_Cmd = EXTERNAL_FLASH_CMD_READ_MEMORY;
+    chip->Blank_Busy = FALSE;
     
-    memcpy(header.ExternalFlash_Address + EXTERNAL_FLASH_PAGE_ADDRESS_BYTE, (void*)&byte_address, EXTERNAL_FLASH_PAGE_BYTE_ADDRESS_BYTE);
-    memcpy(header.ExternalFlash_Address, (void*)&page_address, EXTERNAL_FLASH_PAGE_ADDRESS_BYTE);
+    for(uint16_t offset = 0; offset < ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size; offset += EXTERNAL_FLASH_PAGE_SIZE(instance_id))
+    {
+        SetPagesErased(instance_id, page, 1, IsBlank(&chip->Blank_Buffer[offset / sizeof(uint32_t)], EXTERNAL_FLASH_PAGE_SIZE(instance_id)));
+        page++;
+    }
     
-    // Get pointer to Write handler
-    COMMBUS__WRITE write_handler =  GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Write;
+    chip->Blank_Address += ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Size;
     
-    // If handlers exist
-    if(write_handler != NULL)
+    if(chip->Blank_Address < chip->Blank_End)
     {
-        // Call Handler
-        if(write_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
-                         (void*)&header, 
-                         COMMBUS_ADDRESS_NONE, 
-                         sizeof(EXTERNAL_FLASH_WRITE_HEADER_TYPE)) == TRUE)
-        {
-            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
-            {
-                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
-                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
-                
-                // Start Timeout handle
-                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
-            }
-    
-            // Signal External FLash request success
-            success = TRUE;
-        }
+        // Next step on next turn, unless a client request takes the chip first
+        ScheduleHandler(0);
+    }
+    else
+    {
+        chip->Blank_Instance = INVALID_VALUE_8;
+        
+        nv_callback.Source_Instance_Id = instance_id;
+        nv_callback.Event_Value = COMBINE_BYTES(EXTERNAL_FLASH_PROCESS_SCAN_COMPLETE, 0);
+        ExecuteCallBack(nv_callback);
     }
-    
-    return success;
 }
 
-static BOOL_TYPE WriteData(uint8_t instance_id, uint16_t write_size)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Marks pages of the instance chip erased or not in the erased page map
+ *
+ *  @param      instance_id : specific External FLash instance
+ *  @param      first_page : first page, page index in the device
+ *  @param      page_num : pages
+ *  @param      erased : TRUE if the pages are erased
+ */
+static void SetPagesErased(uint8_t instance_id, uint16_t first_page, uint16_t page_num, BOOL_TYPE erased)
 {
-    BOOL_TYPE success = FALSE;
- 
-    // Get pointer to Write handler
-    COMMBUS__WRITE write_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Write;
+    EXTERNAL_FLASH_CHIP_TYPE* chip = &ExternalFlash_Chip[ExternalFlash_Instance_Chip[instance_id]];
     
-
-    if(write_handler != NULL)
+    for(uint16_t page = first_page; page < (first_page + page_num); page++)
     {
-        // Call Handler
-        if(write_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
-                         (void*)(ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Pointer + ExternalFlash_Instance_Store[instance_id].NVM_Buffer_Progress), 
-                         COMMBUS_ADDRESS_NONE, 
-                         write_size) == TRUE)
+        if(erased == TRUE)
         {
-            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
-            {
-                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
-                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
-                
-                // Start Timeout handle
-                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
-            }
-        
-            // Signal External Flash request success
-            success = TRUE;
+            chip->Page_Erased[page / 8] |= (uint8_t)(1 << (page % 8));
+        }
+        else
+        {
+            chip->Page_Erased[page / 8] &= (uint8_t)~(1 << (page % 8));
         }
     }
-    
-    return success;
 }
 
-static BOOL_TYPE ReadStatusRegister(uint8_t instance_id)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ *  @brief      Tells if page data is all 0xFF
+ *  @details    32 bit words are ANDed together without early exit: a tight loop on the target, vectorized by the
+ *              compiler on hosts with SIMD.
+ *
+ *  @param      data : page data, word aligned
+ *  @param      size : bytes, a multiple of 4 (all the page sizes are)
+ *  @return     TRUE if blank
+ */
+static BOOL_TYPE IsBlank(const uint32_t* data, uint16_t size)
 {
-    BOOL_TYPE success = FALSE;
+    uint32_t all = 0xFFFFFFFFUL;
     
-    COMMBUS__WRITE read_handler = GENERIC_COMM_BUS_HANDLERS[ExternalFlash_Map[instance_id].Generic_Comm_Bus_Id].Read;
-    if(read_handler != NULL)
+    for(uint16_t index = 0; index < (size / sizeof(uint32_t)); index++)
     {
-        if(read_handler(ExternalFlash_Instance_Store[instance_id].Bus_Instance_Channel, 
-                         (void*)&Status_Register, 
-                         COMMBUS_ADDRESS_NONE, 
-                         sizeof(EXTERNAL_FLASH_STATUS_REGISTER_TYPE) == TRUE))
-        {
-                    
-            if(ExternalFlash_Timeout_Handle == INVALID_VALUE_8)      // If timeout timer not allocated yet
-            {
-                ExternalFlash_Timeout_Handle = SystemTimers__AllocateHandle();
-                SYS_ASSERT(ExternalFlash_Timeout_Handle != INVALID_VALUE_8); 
-                
-                // Start Timeout handle
-                SystemTimers__SetMs(ExternalFlash_Timeout_Handle, EXTERNAL_FLASH_WAIT_TIMEOUT_MS);
-            }
-            
-            // Signal External Flash request success
-            success = TRUE;
-        }
+        all &= data[index];
     }
-    return success;
+    return (all == 0xFFFFFFFFUL) ? TRUE : FALSE;
 }
+#endif
 
 void CommBusEventHandler(CALLBACK_EVENT_TYPE event)
 {
 
     COMMON_I_CALLBACK_TYPE bus_event;
     BOOL_TYPE event_match = FALSE;
+    uint8_t chip_index;
+    uint8_t instance_id;
     
     memcpy(&bus_event, &event, sizeof(CALLBACK_EVENT_TYPE));
     
-    COMM_BUS_PROCESS_TYPE bus_process = HIBYTE(bus_event.Event_Value);
-    uint8_t bus_length = LOBYTE(bus_event.Event_Value);
-
-    // Find instance linked to comm bus instance that is notifying the eveny
-    for(uint8_t channel_index = 0; channel_index < EXTERNAL_FLASH_CH_NUM; channel_index++)
+    // Find chip linked to comm bus instance that is notifying the event
+    chip_index = LookupChip(bus_event.Generic_Provider_Id, bus_event.Source_Instance_Id);
+    
+    if(chip_index != INVALID_VALUE_8)
     {
-        // If Generic Bus provider that fired the callback is the same linked to the indexed element of the map
-        if(bus_event.Generic_Provider_Id == ExternalFlash_Map[channel_index].Generic_Comm_Bus_Id)
+        // Only the instance owning the chip can be waiting for a bus event
+        instance_id = ExternalFlash_Chip[chip_index].Active_Instance;
+        
+        if(instance_id != INVALID_VALUE_8)
         {
-            if(ExternalFlash_Instance_Store[channel_index].Bus_Instance_Channel == bus_event.Source_Instance_Id)
-            {                
-                switch(ExternalFlash_Instance_Store[channel_index].NVM_Current_Process)
-                {
-                  case NVDATA_PROCESS_WAIT_READ:
-                    // Set pending read to be handled in Periodic Handler
-                    ExternalFlash_Instance_Store[channel_index].NVM_Current_Process = NVDATA_PROCESS_READ;
-                    SystemTimers__SetTaskIdxNextCall(ExternalFlash_Handler_Index, TASK_IMMEDIATE_EXECUTION);    // Request immediate execution on next turn
-                    break;
-                    
-                  case NVDATA_PROCESS_WAIT_WRITE:
-                    // Set pending write to be handled in Periodic Handler
-                    ExternalFlash_Instance_Store[channel_index].NVM_Current_Process = NVDATA_PROCESS_WRITE;
-                    SystemTimers__SetTaskIdxNextCall(ExternalFlash_Handler_Index, TASK_IMMEDIATE_EXECUTION);    // Request immediate execution on next turn
-                    break;
-                    
-                  default:
-                    // Do nothing with this instance, continue to the next one
-                    continue;
-                    break;
-                }
+            switch(ExternalFlash_Instance_Store[instance_id].NVM_Current_Process)
+            {
+              case NVDATA_PROCESS_WAIT_READ:
+                // Set pending read to be handled in Periodic Handler
+                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_READ;
+                ScheduleHandler(0);     // Request immediate execution on next turn
+                event_match = TRUE;
+                break;
                 
+              case NVDATA_PROCESS_WAIT_WRITE:
+                // Set pending write to be handled in Periodic Handler
+                ExternalFlash_Instance_Store[instance_id].NVM_Current_Process = NVDATA_PROCESS_WRITE;
+                ScheduleHandler(0);     // Request immediate execution on next turn
                 event_match = TRUE;
+                break;
+                
+              default:
+                // Not waiting for a bus event
+                break;
             }
             
-            // Break the loop in case of event match found
             if(event_match == TRUE)
             {
-                ExternalFlash_Instance_Store[channel_index].NVM_Buffer_Progress += (bus_length);
+                EXTERNAL_FLASH_STATS_BUS_EVENT(instance_id);
+                EXTERNAL_FLASH_TRACE(EXTERNAL_FLASH_TRACE_CONTEXT_BUS, EXTERNAL_FLASH_TRACE_EVENT_BUS, instance_id,
+                                     ExternalFlash_Instance_Store[instance_id].NVM_State, ExternalFlash_Instance_Store[instance_id].NVM_State);
+                
                 // Reset and Release Timeout Timer
                 SystemTimers__ReleaseHandle(ExternalFlash_Timeout_Handle);
                 ExternalFlash_Timeout_Handle = INVALID_VALUE_8;
-                break;
             }
         }
     }
@@ -814,6 +4463,8 @@ static void ExecuteCallBack(COMMON_I_CALLBACK_TYPE data)
     
     memcpy(&callback_event, ((uint32_t*)(&data)), sizeof(CALLBACK_EVENT_TYPE));   // Fill the common callback data type
 
+    EXTERNAL_FLASH_CAPTURE(EXTERNAL_FLASH_CAPTURE_RECORD_COMPLETE, data.Source_Instance_Id, data.Event_Value, 0, 0);
+    
     Callback__Notify(&ExternalFlash_Callback_Control_Structure, (CALLBACK_EVENT_TYPE)callback_event, data.Source_Instance_Id, NULL);
 }
 
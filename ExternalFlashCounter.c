@@ -0,0 +1,599 @@
+/**
+ *  @file       ExternalFlashCounter.c
+ *
+ *  @brief      Monotonic counters incremented by programming bits of erased External Flash.
+ *  @details    Half layout: EXTERNAL_FLASH_COUNTER_HEADER_TYPE, then the bitmap. Bits are cleared in order, from the
+ *              least significant bit of the first bitmap byte on, each increment programming the byte holding the
+ *              next bit with all its bits up to that one cleared: the cleared bits are always a prefix of the bitmap
+ *              and mount stops at the first byte not fully programmed. A rollover erases the other half and programs
+ *              its header with the value reached and the next sequence number, then the increment goes on in it.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashCounter.h"
+#include "ExternalFlashCounter_prv.h"
+#include "ExternalFlash.h"
+
+#include "Callback.h"
+#include "CommonInterface.h"
+
+#include "SystemTimers.h"
+#include "Utilities.h"
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Define the callback control structure module static variable
+DEFINE_CALLBACK_CONTROL_STRUCTURE(ExternalFlashCounter_Callback_Control_Structure, EXTERNAL_FLASH_COUNTER_CALLBACK_REGISTERS_SIZE);
+
+//! Counter Map struct type
+typedef struct EXTERNAL_FLASH_COUNTER_MAP_STRUCT
+{
+    EXTERNAL_FLASH_CH_TYPE      ExternalFlash_Channel;      // Client channel of the External Flash instance, owned by the counter
+    uint32_t                    Address;                    // Device address, page aligned
+    uint16_t                    Pages;                      // Pages of each half, the counter uses two halves
+} EXTERNAL_FLASH_COUNTER_MAP_TYPE;
+
+//! Counter Configuration Map
+static const EXTERNAL_FLASH_COUNTER_MAP_TYPE ExternalFlashCounter_Map[] = EXTERNAL_FLASH_COUNTER_MAP;
+
+#define EXTERNAL_FLASH_COUNTER_NUM              ELEMENTS_IN_ARRAY(ExternalFlashCounter_Map)
+
+//! Half header, at the start of the half
+typedef __PACKED_STRUCT EXTERNAL_FLASH_COUNTER_HEADER_STRUCT
+{
+    uint32_t                    Sequence;
+    uint32_t                    Base;                       // Counter value at the first bit of the half
+    uint16_t                    Crc;                        // Low 16 bits of the CRC-32 of Sequence and Base
+} EXTERNAL_FLASH_COUNTER_HEADER_TYPE;
+
+//! Sequence number of an erased header
+#define EXTERNAL_FLASH_COUNTER_SEQUENCE_ERASED  INVALID_VALUE_32
+
+//! Halves of a counter
+#define EXTERNAL_FLASH_COUNTER_HALVES           (2)
+#define EXTERNAL_FLASH_COUNTER_HALF_NONE        INVALID_VALUE_8
+
+//! Half size of a counter
+#define EXTERNAL_FLASH_COUNTER_HALF_SIZE(counter_id)    ((uint32_t)ExternalFlashCounter_Map[(counter_id)].Pages * EXTERNAL_FLASH_COUNTER_PAGE_SIZE)
+
+//! Counter states
+typedef enum EXTERNAL_FLASH_COUNTER_STATE_ENUM
+{
+    EXTERNAL_FLASH_COUNTER_STATE_UNMOUNTED,
+    EXTERNAL_FLASH_COUNTER_STATE_IDLE,
+    EXTERNAL_FLASH_COUNTER_STATE_MOUNT_HEADER,              // Reading the header of a half
+    EXTERNAL_FLASH_COUNTER_STATE_MOUNT_BITS,                // Reading the bitmap of the current half, a page at a time
+    EXTERNAL_FLASH_COUNTER_STATE_INCREMENT,                 // Programming the next bit
+    EXTERNAL_FLASH_COUNTER_STATE_ROLL_ERASE,                // Erasing the other half
+    EXTERNAL_FLASH_COUNTER_STATE_ROLL_COMMIT                // Programming the header of the other half
+} EXTERNAL_FLASH_COUNTER_STATE_TYPE;
+
+//! External Flash request of a counter
+typedef enum EXTERNAL_FLASH_COUNTER_REQUEST_ENUM
+{
+    EXTERNAL_FLASH_COUNTER_REQUEST_NONE,
+    EXTERNAL_FLASH_COUNTER_REQUEST_PENDING,                 // To be started, retried by the handler while the instance is busy
+    EXTERNAL_FLASH_COUNTER_REQUEST_WAIT,                    // Started, waiting for the External Flash event
+    EXTERNAL_FLASH_COUNTER_REQUEST_DONE                     // Completed, the state machine advances
+} EXTERNAL_FLASH_COUNTER_REQUEST_TYPE;
+
+//! External Flash operations used by the counters
+typedef enum EXTERNAL_FLASH_COUNTER_OPERATION_ENUM
+{
+    EXTERNAL_FLASH_COUNTER_OPERATION_READ,
+    EXTERNAL_FLASH_COUNTER_OPERATION_PROGRAM,
+    EXTERNAL_FLASH_COUNTER_OPERATION_ERASE
+} EXTERNAL_FLASH_COUNTER_OPERATION_TYPE;
+
+//! Counter store struct type
+typedef struct EXTERNAL_FLASH_COUNTER_STORE_STRUCT
+{
+    uint8_t                     Instance;                   // External Flash instance
+    EXTERNAL_FLASH_COUNTER_STATE_TYPE State;
+
+    uint8_t                     Half;                       // Current half, EXTERNAL_FLASH_COUNTER_HALF_NONE if none
+    uint32_t                    Sequence;                   // Sequence number of the current half
+    uint32_t                    Base;                       // Value at the first bit of the current half
+    uint32_t                    Bits;                       // Bits cleared in the current half
+
+    uint8_t                     Target_Half;                // Half being mounted or rolled over to
+    EXTERNAL_FLASH_COUNTER_HEADER_TYPE Header;              // Header of the half being mounted or rolled over to
+    uint16_t                    Page;                       // Mount: bitmap page being read
+    uint8_t                     Program_Byte;               // Bitmap byte being programmed
+
+    EXTERNAL_FLASH_COUNTER_REQUEST_TYPE Request;
+    EXTERNAL_FLASH_COUNTER_OPERATION_TYPE Request_Operation;
+    uint32_t                    Request_Address;
+    void*                       Request_Buffer;
+    uint16_t                    Request_Size;
+
+    uint8_t                     Page_Buffer[EXTERNAL_FLASH_COUNTER_PAGE_SIZE];
+} EXTERNAL_FLASH_COUNTER_STORE_TYPE;
+
+static EXTERNAL_FLASH_COUNTER_STORE_TYPE ExternalFlashCounter_Store[EXTERNAL_FLASH_COUNTER_NUM];
+
+//! Counter Task Handler Index
+static uint8_t ExternalFlashCounter_Handler_Index = INVALID_VALUE_8;
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void ExternalFlashEventHandler(CALLBACK_EVENT_TYPE event);
+static void Process(uint8_t counter_id);
+static void Advance(uint8_t counter_id);
+static void Request(uint8_t counter_id, EXTERNAL_FLASH_COUNTER_OPERATION_TYPE operation, uint8_t half, uint32_t offset, void* buffer, uint16_t size);
+static void StartMountHeader(uint8_t counter_id);
+static void MountHeader(uint8_t counter_id);
+static void MountBits(uint8_t counter_id);
+static void StartIncrement(uint8_t counter_id);
+static void StartRollCommit(uint8_t counter_id);
+static void ExecuteCallBack(uint8_t counter_id, EXTERNAL_FLASH_COUNTER_EVENT_TYPE event);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Binds the counters to their External Flash instances, to be called after ExternalFlash__Initialize
+ * @details The counters are unmounted, ExternalFlashCounter__Mount makes them usable.
+ */
+void ExternalFlashCounter__Initialize(void)
+{
+    BOOL_TYPE shared;
+
+    // Initialize callback structure
+    Callback__Initialize(&ExternalFlashCounter_Callback_Control_Structure);
+
+    // Start periodic handler task
+    ExternalFlashCounter_Handler_Index = SystemTimers__CreateTask("ExternalFlashCounter__Handler", &ExternalFlashCounter__Handler, EXTERNAL_FLASH_COUNTER_HANDLER_PERIOD_MS, TIMER_MS, FALSE );
+
+    SYS_ASSERT(ExternalFlashCounter_Handler_Index != INVALID_VALUE_8);
+
+    memset(ExternalFlashCounter_Store, 0x00, sizeof(ExternalFlashCounter_Store));
+
+    for(uint8_t counter_id = 0; counter_id < EXTERNAL_FLASH_COUNTER_NUM; counter_id++)
+    {
+        EXTERNAL_FLASH_COUNTER_STORE_TYPE* counter = &ExternalFlashCounter_Store[counter_id];
+
+        SYS_ASSERT((ExternalFlashCounter_Map[counter_id].Address % EXTERNAL_FLASH_COUNTER_PAGE_SIZE) == 0);
+        SYS_ASSERT((ExternalFlashCounter_Map[counter_id].Pages > 0) && (EXTERNAL_FLASH_COUNTER_HALF_SIZE(counter_id) <= INVALID_VALUE_16));
+
+        // Shared instance of the channel, see ExternalFlash.h
+        counter->Instance = ExternalFlash__GetAllocation(ExternalFlashCounter_Map[counter_id].ExternalFlash_Channel, NULL, 0);
+        SYS_ASSERT(counter->Instance < EXTERNAL_FLASH_CH_NUM);
+
+        shared = FALSE;
+        for(uint8_t other_id = 0; other_id < counter_id; other_id++)
+        {
+            if(ExternalFlashCounter_Store[other_id].Instance == counter->Instance)
+            {
+                shared = TRUE;
+            }
+        }
+        if(shared == FALSE)
+        {
+            ExternalFlash__RegisterEventHandler(&ExternalFlashEventHandler, counter->Instance, CALLBACK_FILTER_VALUE_NONE);
+        }
+
+        counter->State = EXTERNAL_FLASH_COUNTER_STATE_UNMOUNTED;
+        counter->Half = EXTERNAL_FLASH_COUNTER_HALF_NONE;
+        counter->Request = EXTERNAL_FLASH_COUNTER_REQUEST_NONE;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the External Flash requests rejected while their instance was busy
+ */
+void ExternalFlashCounter__Handler(void)
+{
+    for(uint8_t counter_id = 0; counter_id < EXTERNAL_FLASH_COUNTER_NUM; counter_id++)
+    {
+        Process(counter_id);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Finds the counter value, reading both half headers and the bitmap of the current half up to its last bit
+ *          cleared
+ * @details Notifies EXTERNAL_FLASH_COUNTER_EVENT_MOUNTED; a counter never incremented is 0.
+ * @param   counter_id: counter index in EXTERNAL_FLASH_COUNTER_MAP
+ * @return  TRUE if the mount was started, FALSE if the counter is busy
+ */
+BOOL_TYPE ExternalFlashCounter__Mount(uint8_t counter_id)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((counter_id < EXTERNAL_FLASH_COUNTER_NUM) &&
+       ((ExternalFlashCounter_Store[counter_id].State == EXTERNAL_FLASH_COUNTER_STATE_UNMOUNTED) || (ExternalFlashCounter_Store[counter_id].State == EXTERNAL_FLASH_COUNTER_STATE_IDLE)))
+    {
+        ExternalFlashCounter_Store[counter_id].Half = EXTERNAL_FLASH_COUNTER_HALF_NONE;
+        ExternalFlashCounter_Store[counter_id].Sequence = 0;
+        ExternalFlashCounter_Store[counter_id].Base = 0;
+        ExternalFlashCounter_Store[counter_id].Bits = 0;
+        ExternalFlashCounter_Store[counter_id].Target_Half = 0;
+        StartMountHeader(counter_id);
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Increments the counter by one
+ * @details Programs one byte of the bitmap, without erase. Once the current half is exhausted the other half is
+ *          erased and its header programmed first. Notifies EXTERNAL_FLASH_COUNTER_EVENT_INCREMENTED.
+ * @param   counter_id: counter index in EXTERNAL_FLASH_COUNTER_MAP
+ * @return  TRUE if the increment was started, FALSE if the counter is not mounted or busy
+ */
+BOOL_TYPE ExternalFlashCounter__Increment(uint8_t counter_id)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((counter_id < EXTERNAL_FLASH_COUNTER_NUM) &&
+       (ExternalFlashCounter_Store[counter_id].State == EXTERNAL_FLASH_COUNTER_STATE_IDLE))
+    {
+        EXTERNAL_FLASH_COUNTER_STORE_TYPE* counter = &ExternalFlashCounter_Store[counter_id];
+
+        if((counter->Half == EXTERNAL_FLASH_COUNTER_HALF_NONE) ||
+           (counter->Bits >= EXTERNAL_FLASH_COUNTER_BITS(ExternalFlashCounter_Map[counter_id].Pages)))
+        {
+            // Roll over to the other half, the first one if none was ever written
+            counter->Target_Half = (counter->Half == 0) ? 1 : 0;
+            counter->State = EXTERNAL_FLASH_COUNTER_STATE_ROLL_ERASE;
+            Request(counter_id, EXTERNAL_FLASH_COUNTER_OPERATION_ERASE, counter->Target_Half, 0, NULL, (uint16_t)EXTERNAL_FLASH_COUNTER_HALF_SIZE(counter_id));
+        }
+        else
+        {
+            StartIncrement(counter_id);
+        }
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gives the counter value
+ * @param   counter_id: counter index in EXTERNAL_FLASH_COUNTER_MAP
+ * @return  value, INVALID_VALUE_32 if not mounted or invalid counter
+ */
+uint32_t ExternalFlashCounter__GetValue(uint8_t counter_id)
+{
+    uint32_t value = INVALID_VALUE_32;
+
+    if((counter_id < EXTERNAL_FLASH_COUNTER_NUM) &&
+       (ExternalFlashCounter_Store[counter_id].State != EXTERNAL_FLASH_COUNTER_STATE_UNMOUNTED) &&
+       (ExternalFlashCounter_Store[counter_id].State != EXTERNAL_FLASH_COUNTER_STATE_MOUNT_HEADER) &&
+       (ExternalFlashCounter_Store[counter_id].State != EXTERNAL_FLASH_COUNTER_STATE_MOUNT_BITS))
+    {
+        value = ExternalFlashCounter_Store[counter_id].Base + ExternalFlashCounter_Store[counter_id].Bits;
+    }
+
+    return value;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Tells if a counter has an operation in progress
+ * @param   counter_id: counter index in EXTERNAL_FLASH_COUNTER_MAP
+ * @return  TRUE if busy or invalid counter
+ */
+BOOL_TYPE ExternalFlashCounter__IsBusy(uint8_t counter_id)
+{
+    BOOL_TYPE busy = TRUE;
+
+    if((counter_id < EXTERNAL_FLASH_COUNTER_NUM) &&
+       ((ExternalFlashCounter_Store[counter_id].State == EXTERNAL_FLASH_COUNTER_STATE_UNMOUNTED) || (ExternalFlashCounter_Store[counter_id].State == EXTERNAL_FLASH_COUNTER_STATE_IDLE)))
+    {
+        busy = FALSE;
+    }
+
+    return busy;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Registers event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlashCounter__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value)
+{
+    Callback__Register(&ExternalFlashCounter_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler, filter_id, filter_value);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Unregisters event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlashCounter__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler)
+{
+    Callback__Unregister(&ExternalFlashCounter_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler);
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+/**
+ * @brief   External Flash event handler: completes the request of the counter owning the instance and chains the next one
+ * @param   event: External Flash callback event
+ */
+static void ExternalFlashEventHandler(CALLBACK_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE nv_event;
+
+    memcpy(&nv_event, &event, sizeof(CALLBACK_EVENT_TYPE));
+
+    for(uint8_t counter_id = 0; counter_id < EXTERNAL_FLASH_COUNTER_NUM; counter_id++)
+    {
+        if((ExternalFlashCounter_Store[counter_id].Instance == nv_event.Source_Instance_Id) &&
+           (ExternalFlashCounter_Store[counter_id].Request == EXTERNAL_FLASH_COUNTER_REQUEST_WAIT))
+        {
+            ExternalFlashCounter_Store[counter_id].Request = EXTERNAL_FLASH_COUNTER_REQUEST_DONE;
+            Process(counter_id);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Advances the counter state machine over completed requests and starts the pending one
+ * @param   counter_id: counter index
+ */
+static void Process(uint8_t counter_id)
+{
+    EXTERNAL_FLASH_COUNTER_STORE_TYPE* counter = &ExternalFlashCounter_Store[counter_id];
+    BOOL_TYPE started = FALSE;
+
+    while(counter->Request == EXTERNAL_FLASH_COUNTER_REQUEST_DONE)
+    {
+        counter->Request = EXTERNAL_FLASH_COUNTER_REQUEST_NONE;
+        Advance(counter_id);
+    }
+
+    if(counter->Request == EXTERNAL_FLASH_COUNTER_REQUEST_PENDING)
+    {
+        switch(counter->Request_Operation)
+        {
+          case EXTERNAL_FLASH_COUNTER_OPERATION_READ:
+            started = ExternalFlash__Read(counter->Instance, counter->Request_Buffer, counter->Request_Address, counter->Request_Size);
+            break;
+
+          case EXTERNAL_FLASH_COUNTER_OPERATION_PROGRAM:
+            started = ExternalFlash__Program(counter->Instance, counter->Request_Buffer, counter->Request_Address, counter->Request_Size);
+            break;
+
+          case EXTERNAL_FLASH_COUNTER_OPERATION_ERASE:
+          default:
+            started = ExternalFlash__Erase(counter->Instance, counter->Request_Address, counter->Request_Size);
+            break;
+        }
+
+        if(started == TRUE)
+        {
+            counter->Request = EXTERNAL_FLASH_COUNTER_REQUEST_WAIT;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Counter state machine, called when the request of the current state is done
+ * @param   counter_id: counter index
+ */
+static void Advance(uint8_t counter_id)
+{
+    EXTERNAL_FLASH_COUNTER_STORE_TYPE* counter = &ExternalFlashCounter_Store[counter_id];
+
+    switch(counter->State)
+    {
+      case EXTERNAL_FLASH_COUNTER_STATE_MOUNT_HEADER:
+        MountHeader(counter_id);
+        break;
+
+      case EXTERNAL_FLASH_COUNTER_STATE_MOUNT_BITS:
+        MountBits(counter_id);
+        break;
+
+      case EXTERNAL_FLASH_COUNTER_STATE_INCREMENT:
+        counter->Bits++;
+        counter->State = EXTERNAL_FLASH_COUNTER_STATE_IDLE;
+        ExecuteCallBack(counter_id, EXTERNAL_FLASH_COUNTER_EVENT_INCREMENTED);
+        break;
+
+      case EXTERNAL_FLASH_COUNTER_STATE_ROLL_ERASE:
+        StartRollCommit(counter_id);
+        break;
+
+      case EXTERNAL_FLASH_COUNTER_STATE_ROLL_COMMIT:
+        // The other half carries the value from now on
+        counter->Half = counter->Target_Half;
+        counter->Sequence = counter->Header.Sequence;
+        counter->Base = counter->Header.Base;
+        counter->Bits = 0;
+        StartIncrement(counter_id);
+        break;
+
+      case EXTERNAL_FLASH_COUNTER_STATE_UNMOUNTED:
+      case EXTERNAL_FLASH_COUNTER_STATE_IDLE:
+      default:
+        break;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Sets the External Flash request of the current state, started now or by the handler
+ * @param   counter_id: counter index
+ * @param   operation: External Flash operation
+ * @param   half: counter half
+ * @param   offset: offset in the half
+ * @param   buffer: data buffer, NULL for erases
+ * @param   size: bytes
+ */
+static void Request(uint8_t counter_id, EXTERNAL_FLASH_COUNTER_OPERATION_TYPE operation, uint8_t half, uint32_t offset, void* buffer, uint16_t size)
+{
+    EXTERNAL_FLASH_COUNTER_STORE_TYPE* counter = &ExternalFlashCounter_Store[counter_id];
+
+    counter->Request_Operation = operation;
+    counter->Request_Address = ExternalFlashCounter_Map[counter_id].Address + (half * EXTERNAL_FLASH_COUNTER_HALF_SIZE(counter_id)) + offset;
+    counter->Request_Buffer = buffer;
+    counter->Request_Size = size;
+    counter->Request = EXTERNAL_FLASH_COUNTER_REQUEST_PENDING;
+
+    SystemTimers__ResumeTask(ExternalFlashCounter_Handler_Index);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the header of the half being mounted
+ * @param   counter_id: counter index
+ */
+static void StartMountHeader(uint8_t counter_id)
+{
+    EXTERNAL_FLASH_COUNTER_STORE_TYPE* counter = &ExternalFlashCounter_Store[counter_id];
+
+    counter->State = EXTERNAL_FLASH_COUNTER_STATE_MOUNT_HEADER;
+    Request(counter_id, EXTERNAL_FLASH_COUNTER_OPERATION_READ, counter->Target_Half, 0, &counter->Header, EXTERNAL_FLASH_COUNTER_HEADER_SIZE);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Keeps the half mounted if its header is valid and newer than the other, then mounts the next half or starts
+ *          reading the bitmap of the current one
+ * @param   counter_id: counter index
+ */
+static void MountHeader(uint8_t counter_id)
+{
+    EXTERNAL_FLASH_COUNTER_STORE_TYPE* counter = &ExternalFlashCounter_Store[counter_id];
+
+    if((counter->Header.Sequence != EXTERNAL_FLASH_COUNTER_SEQUENCE_ERASED) &&
+       ((uint16_t)ExternalFlash__GetCrc(0, &counter->Header, sizeof(counter->Header) - sizeof(counter->Header.Crc)) == counter->Header.Crc) &&
+       ((counter->Half == EXTERNAL_FLASH_COUNTER_HALF_NONE) || ((int32_t)(counter->Header.Sequence - counter->Sequence) > 0)))
+    {
+        counter->Half = counter->Target_Half;
+        counter->Sequence = counter->Header.Sequence;
+        counter->Base = counter->Header.Base;
+    }
+
+    counter->Target_Half++;
+    if(counter->Target_Half < EXTERNAL_FLASH_COUNTER_HALVES)
+    {
+        StartMountHeader(counter_id);
+    }
+    else if(counter->Half != EXTERNAL_FLASH_COUNTER_HALF_NONE)
+    {
+        counter->Page = 0;
+        counter->State = EXTERNAL_FLASH_COUNTER_STATE_MOUNT_BITS;
+        Request(counter_id, EXTERNAL_FLASH_COUNTER_OPERATION_READ, counter->Half, 0, counter->Page_Buffer, EXTERNAL_FLASH_COUNTER_PAGE_SIZE);
+    }
+    else
+    {
+        // Never incremented
+        counter->State = EXTERNAL_FLASH_COUNTER_STATE_IDLE;
+        ExecuteCallBack(counter_id, EXTERNAL_FLASH_COUNTER_EVENT_MOUNTED);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Counts the bits cleared in the bitmap page read and reads the next page, or ends the mount at the first
+ *          byte not fully programmed
+ * @param   counter_id: counter index
+ */
+static void MountBits(uint8_t counter_id)
+{
+    EXTERNAL_FLASH_COUNTER_STORE_TYPE* counter = &ExternalFlashCounter_Store[counter_id];
+    uint16_t index = (counter->Page == 0) ? EXTERNAL_FLASH_COUNTER_HEADER_SIZE : 0;
+    BOOL_TYPE end = FALSE;
+
+    for(; (index < EXTERNAL_FLASH_COUNTER_PAGE_SIZE) && (end == FALSE); index++)
+    {
+        if(counter->Page_Buffer[index] == 0x00)
+        {
+            counter->Bits += 8;
+        }
+        else
+        {
+            // Bits are cleared from the least significant one on
+            for(uint8_t bit = 0; (counter->Page_Buffer[index] & (1 << bit)) == 0; bit++)
+            {
+                counter->Bits++;
+            }
+            end = TRUE;
+        }
+    }
+
+    counter->Page++;
+    if((end == FALSE) && (counter->Page < ExternalFlashCounter_Map[counter_id].Pages))
+    {
+        Request(counter_id, EXTERNAL_FLASH_COUNTER_OPERATION_READ, counter->Half, (uint32_t)counter->Page * EXTERNAL_FLASH_COUNTER_PAGE_SIZE,
+                counter->Page_Buffer, EXTERNAL_FLASH_COUNTER_PAGE_SIZE);
+    }
+    else
+    {
+        counter->State = EXTERNAL_FLASH_COUNTER_STATE_IDLE;
+        ExecuteCallBack(counter_id, EXTERNAL_FLASH_COUNTER_EVENT_MOUNTED);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Programs the next bit of the current half, with the bits before it in the same byte
+ * @param   counter_id: counter index
+ */
+static void StartIncrement(uint8_t counter_id)
+{
+    EXTERNAL_FLASH_COUNTER_STORE_TYPE* counter = &ExternalFlashCounter_Store[counter_id];
+
+    counter->Program_Byte = (uint8_t)(0xFF << ((counter->Bits % 8) + 1));
+    counter->State = EXTERNAL_FLASH_COUNTER_STATE_INCREMENT;
+    Request(counter_id, EXTERNAL_FLASH_COUNTER_OPERATION_PROGRAM, counter->Half, EXTERNAL_FLASH_COUNTER_HEADER_SIZE + (counter->Bits / 8), &counter->Program_Byte, 1);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Programs the header of the half erased, carrying the counter value over
+ * @param   counter_id: counter index
+ */
+static void StartRollCommit(uint8_t counter_id)
+{
+    EXTERNAL_FLASH_COUNTER_STORE_TYPE* counter = &ExternalFlashCounter_Store[counter_id];
+
+    counter->Header.Sequence = counter->Sequence + 1;
+    counter->Header.Base = counter->Base + counter->Bits;
+    counter->Header.Crc = (uint16_t)ExternalFlash__GetCrc(0, &counter->Header, sizeof(counter->Header) - sizeof(counter->Header.Crc));
+
+    counter->State = EXTERNAL_FLASH_COUNTER_STATE_ROLL_COMMIT;
+    Request(counter_id, EXTERNAL_FLASH_COUNTER_OPERATION_PROGRAM, counter->Target_Half, 0, &counter->Header, EXTERNAL_FLASH_COUNTER_HEADER_SIZE);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Notifies a counter event to the registered handlers
+ * @param   counter_id: counter index, source instance of the event
+ * @param   event: EXTERNAL_FLASH_COUNTER_EVENT_TYPE, event value
+ */
+static void ExecuteCallBack(uint8_t counter_id, EXTERNAL_FLASH_COUNTER_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE data;
+    CALLBACK_EVENT_TYPE callback_event;
+
+    data.Generic_Provider_Id = GENERIC_NVDATA_EXTERNAL_FLASH;
+    data.Source_Instance_Id = counter_id;
+    data.Event_Value = (uint16_t)event;
+
+    memcpy(&callback_event, ((uint32_t*)(&data)), sizeof(CALLBACK_EVENT_TYPE));
+
+    Callback__Notify(&ExternalFlashCounter_Callback_Control_Structure, callback_event, counter_id, NULL);
+}
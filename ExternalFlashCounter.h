@@ -0,0 +1,70 @@
+/**
+ *  @file       ExternalFlashCounter.h
+ *
+ *  @brief      Monotonic counters incremented by programming bits of erased External Flash.
+ *  @details    Each counter declared in EXTERNAL_FLASH_COUNTER_MAP (ExternalFlashCounter_prv.h) owns the External Flash
+ *              instance of its client channel and two halves of Pages pages each from its address. The current half
+ *              starts with a header {sequence, base, CRC} and is followed by a unary bitmap: an increment programs
+ *              the next bit from 1 to 0 with ExternalFlash__Program, a single byte program without erase, and the
+ *              counter value is the base plus the bits cleared. Only when the current half is exhausted the other
+ *              half is erased and gets a header carrying the value over, so a half of one page counts
+ *              EXTERNAL_FLASH_COUNTER_BITS(1) increments per erase.
+ *
+ *              An increment interrupted by a reset is either lost or counted; a header interrupted by a reset fails
+ *              its CRC and mount keeps the previous half.
+ *
+ *              All operations are asynchronous: they return FALSE if the counter is busy and their completion is
+ *              notified to the registered event handlers, with the counter id as source instance and an
+ *              EXTERNAL_FLASH_COUNTER_EVENT_TYPE as event value.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+#ifndef EXTERNALFLASHCOUNTER_H_
+#define EXTERNALFLASHCOUNTER_H_
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "C_Extensions.h"
+#include "Callback.h"
+#include "ExternalFlash.h"
+#include "ExternalFlashCounter_prv.h"
+
+//-------------------------------------- PUBLIC (Variables, Constants & Defines) --------------------------------------
+
+//! Device page size
+#ifndef EXTERNAL_FLASH_COUNTER_PAGE_SIZE
+#define EXTERNAL_FLASH_COUNTER_PAGE_SIZE            (256)
+#endif
+
+//! Handler task period
+#ifndef EXTERNAL_FLASH_COUNTER_HANDLER_PERIOD_MS
+#define EXTERNAL_FLASH_COUNTER_HANDLER_PERIOD_MS    EXTERNAL_FLASH_HANDLER_PERIOD_MS
+#endif
+
+//! Half header size
+#define EXTERNAL_FLASH_COUNTER_HEADER_SIZE          (10)
+
+//! Increments counted by a half of pages pages before the other half is erased
+#define EXTERNAL_FLASH_COUNTER_BITS(pages)                                                                             \
+    ((((uint32_t)(pages) * EXTERNAL_FLASH_COUNTER_PAGE_SIZE) - EXTERNAL_FLASH_COUNTER_HEADER_SIZE) * 8)
+
+//! Counter events, notified as event value
+typedef enum EXTERNAL_FLASH_COUNTER_EVENT_ENUM
+{
+    EXTERNAL_FLASH_COUNTER_EVENT_MOUNTED,                   // Mount completed, see ExternalFlashCounter__GetValue
+    EXTERNAL_FLASH_COUNTER_EVENT_INCREMENTED,               // Increment programmed
+    EXTERNAL_FLASH_COUNTER_EVENT_NUM
+} EXTERNAL_FLASH_COUNTER_EVENT_TYPE;
+
+//-------------------------------------- PUBLIC (Function Prototypes) -------------------------------------------------
+
+void ExternalFlashCounter__Initialize(void);
+void ExternalFlashCounter__Handler(void);
+BOOL_TYPE ExternalFlashCounter__Mount(uint8_t counter_id);
+BOOL_TYPE ExternalFlashCounter__Increment(uint8_t counter_id);
+uint32_t ExternalFlashCounter__GetValue(uint8_t counter_id);
+BOOL_TYPE ExternalFlashCounter__IsBusy(uint8_t counter_id);
+void ExternalFlashCounter__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value);
+void ExternalFlashCounter__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler);
+
+#endif /* EXTERNALFLASHCOUNTER_H_ */
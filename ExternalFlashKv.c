@@ -0,0 +1,1189 @@
+/**
+ *  @file       ExternalFlashKv.c
+ *
+ *  @brief      Log-structured key-value stores over External Flash logs.
+ *  @details    Record payload: EXTERNAL_FLASH_KV_RECORD_HEADER_TYPE, then the value for puts. Deletes append a record
+ *              without value and remove the key from the index. Garbage collection never copies delete records: the
+ *              older records of their key are in sectors the log drops before theirs.
+ *
+ *              Checkpoint slot: EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE, then the index array as it is in RAM. The index
+ *              is written first and the header last, its CRC covering both, so a slot interrupted while written fails
+ *              its check and mount falls back to the other slot, or to reading the whole log if neither is valid. A
+ *              checkpoint is used only if the log still holds, at its position, the last record it covers: replay
+ *              starts by reading that record again, which updates the index to the same state.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashKv.h"
+#include "ExternalFlashKv_prv.h"
+#include "ExternalFlashLog.h"
+#include "ExternalFlash.h"
+
+#include "Callback.h"
+#include "CommonInterface.h"
+
+#include "SystemTimers.h"
+#include "Utilities.h"
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if ((EXTERNAL_FLASH_KV_INDEX_SIZE & (EXTERNAL_FLASH_KV_INDEX_SIZE - 1)) != 0)
+#error "EXTERNAL_FLASH_KV_INDEX_SIZE must be a power of two"
+#endif
+
+//! Define the callback control structure module static variable
+DEFINE_CALLBACK_CONTROL_STRUCTURE(ExternalFlashKv_Callback_Control_Structure, EXTERNAL_FLASH_KV_CALLBACK_REGISTERS_SIZE);
+
+//! Store Map struct type
+typedef struct EXTERNAL_FLASH_KV_MAP_STRUCT
+{
+    uint8_t                     Log_Id;                     // External Flash log, owned by the store
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+    EXTERNAL_FLASH_CH_TYPE      Checkpoint_Channel;         // Client channel of the External Flash instance, owned by the store
+    uint32_t                    Checkpoint_Address;         // Two slots of EXTERNAL_FLASH_KV_CHECKPOINT_SLOT_SIZE
+#endif
+} EXTERNAL_FLASH_KV_MAP_TYPE;
+
+//! Store Configuration Map
+static const EXTERNAL_FLASH_KV_MAP_TYPE ExternalFlashKv_Map[] = EXTERNAL_FLASH_KV_MAP;
+
+#define EXTERNAL_FLASH_KV_NUM                   ELEMENTS_IN_ARRAY(ExternalFlashKv_Map)
+
+//! Record types
+#define EXTERNAL_FLASH_KV_RECORD_PUT            (0x01)
+#define EXTERNAL_FLASH_KV_RECORD_DELETE         (0x02)
+
+//! Record payload header
+typedef __PACKED_STRUCT EXTERNAL_FLASH_KV_RECORD_HEADER_STRUCT
+{
+    uint32_t                    Key;
+    uint8_t                     Type;
+} EXTERNAL_FLASH_KV_RECORD_HEADER_TYPE;
+
+//! Log bytes of a record
+#define EXTERNAL_FLASH_KV_RECORD_SIZE(value_size)   (EXTERNAL_FLASH_LOG_HEADER_SIZE + sizeof(EXTERNAL_FLASH_KV_RECORD_HEADER_TYPE) + (value_size))
+
+//! Largest record payload
+#define EXTERNAL_FLASH_KV_SCRATCH_SIZE          (sizeof(EXTERNAL_FLASH_KV_RECORD_HEADER_TYPE) + EXTERNAL_FLASH_KV_MAX_VALUE_SIZE)
+
+//! Index slot position of a free slot
+#define EXTERNAL_FLASH_KV_POSITION_NONE         INVALID_VALUE_32
+
+//! Home slot of a key (Fibonacci hashing)
+#define EXTERNAL_FLASH_KV_HASH(key)             ((uint16_t)(((uint32_t)(key) * 2654435761UL) >> 16) & (EXTERNAL_FLASH_KV_INDEX_SIZE - 1))
+
+//! Index entry struct type, linear probing
+typedef struct EXTERNAL_FLASH_KV_ENTRY_STRUCT
+{
+    uint32_t                    Key;
+    uint32_t                    Position;                   // Newest record in the log, EXTERNAL_FLASH_KV_POSITION_NONE if free slot
+    uint16_t                    Size;                       // Value size
+} EXTERNAL_FLASH_KV_ENTRY_TYPE;
+
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+//! Checkpoint slot header
+typedef __PACKED_STRUCT EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_STRUCT
+{
+    uint32_t                    Generation;                 // Incremented by each checkpoint, INVALID_VALUE_32 if slot erased
+    uint32_t                    Position;                   // Last record applied to the index, EXTERNAL_FLASH_KV_POSITION_NONE if none
+    uint32_t                    Sequence;                   // Its sequence number
+    uint16_t                    Entry_Num;
+    uint16_t                    Crc;                        // Low 16 bits of the CRC-32 of the fields above and of the index
+} EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE;
+
+//! Checkpoint slots of a store
+#define EXTERNAL_FLASH_KV_CHECKPOINT_SLOTS      (2)
+#endif
+
+//! Store states
+typedef enum EXTERNAL_FLASH_KV_STATE_ENUM
+{
+    EXTERNAL_FLASH_KV_STATE_UNMOUNTED,
+    EXTERNAL_FLASH_KV_STATE_IDLE,
+    EXTERNAL_FLASH_KV_STATE_MOUNT,                          // Mounting the log
+    EXTERNAL_FLASH_KV_STATE_FORMAT,                         // Formatting the log
+    EXTERNAL_FLASH_KV_STATE_REBUILD,                        // Reading the log to rebuild the index
+    EXTERNAL_FLASH_KV_STATE_PUT,                            // Appending a put or delete record
+    EXTERNAL_FLASH_KV_STATE_GET,                            // Reading a record
+    EXTERNAL_FLASH_KV_STATE_GC_READ,                        // Reading the oldest record not collected
+    EXTERNAL_FLASH_KV_STATE_GC_COPY,                        // Appending it again
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+    EXTERNAL_FLASH_KV_STATE_CHECKPOINT_HEADER,              // Reading the slot headers
+    EXTERNAL_FLASH_KV_STATE_CHECKPOINT_LOAD,                // Reading the index of the newest slot not tried yet
+    EXTERNAL_FLASH_KV_STATE_CHECKPOINT_REPLAY,              // Reading the last record covered by the checkpoint
+    EXTERNAL_FLASH_KV_STATE_CHECKPOINT_INDEX,               // Writing the index into a slot
+    EXTERNAL_FLASH_KV_STATE_CHECKPOINT_COMMIT,              // Writing the slot header
+#endif
+} EXTERNAL_FLASH_KV_STATE_TYPE;
+
+//! Store struct type
+typedef struct EXTERNAL_FLASH_KV_STORE_STRUCT
+{
+    EXTERNAL_FLASH_KV_STATE_TYPE State;
+    BOOL_TYPE                   Log_Pending;                // Log call of the state to be (re)started by the handler
+    uint16_t                    Entry_Num;
+    uint32_t                    Live_Bytes;                 // Log bytes of the records referenced by the index
+    uint32_t                    Live_Limit;                 // Live bytes that garbage collection can always keep in the log
+    uint32_t                    Record_Position;            // GET: record read, GC: record to copy
+    uint16_t                    Record_Size;                // Payload bytes in Scratch
+    uint8_t*                    Client_Buffer;
+    uint16_t                    Client_Size;
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+    uint8_t                     Instance;                   // External Flash instance of the checkpoint area
+    BOOL_TYPE                   Formatting;                 // Checkpoint written before formatting the log
+    uint8_t                     Slot;                       // Slot being read or written
+    uint32_t                    Generation;                 // Newest generation found or written
+    uint32_t                    Last_Position;              // Last record applied to the index
+    uint32_t                    Last_Sequence;
+    uint16_t                    Records;                    // Records applied since the last checkpoint
+    EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE Slot_Header[EXTERNAL_FLASH_KV_CHECKPOINT_SLOTS];
+#endif
+    EXTERNAL_FLASH_KV_ENTRY_TYPE Index[EXTERNAL_FLASH_KV_INDEX_SIZE];
+    uint8_t                     Scratch[EXTERNAL_FLASH_KV_SCRATCH_SIZE];
+} EXTERNAL_FLASH_KV_STORE_TYPE;
+
+static EXTERNAL_FLASH_KV_STORE_TYPE ExternalFlashKv_Store[EXTERNAL_FLASH_KV_NUM];
+
+//! Store Task Handler Index
+static uint8_t ExternalFlashKv_Handler_Index = INVALID_VALUE_8;
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void LogEventHandler(CALLBACK_EVENT_TYPE event);
+static void Advance(uint8_t store_id, EXTERNAL_FLASH_LOG_EVENT_TYPE event);
+static void StartStep(uint8_t store_id, EXTERNAL_FLASH_KV_STATE_TYPE state);
+static void Issue(uint8_t store_id);
+static BOOL_TYPE StartPut(uint8_t store_id, uint32_t key, uint8_t type, void* value, uint16_t size);
+static void ApplyRecord(uint8_t store_id, uint32_t position, uint32_t sequence);
+static BOOL_TYPE IsGcNeeded(uint8_t store_id);
+static void ClearIndex(uint8_t store_id);
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+static void ExternalFlashEventHandler(CALLBACK_EVENT_TYPE event);
+static void AdvanceCheckpoint(uint8_t store_id);
+static void StartCheckpoint(uint8_t store_id);
+static void StartLoad(uint8_t store_id);
+static void StartRebuild(uint8_t store_id);
+static uint16_t GetCheckpointCrc(uint8_t store_id, const EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE* header);
+#endif
+static uint16_t Lookup(uint8_t store_id, uint32_t key);
+static BOOL_TYPE SetEntry(uint8_t store_id, uint32_t key, uint32_t position, uint16_t size);
+static void RemoveEntry(uint8_t store_id, uint32_t key);
+static void ExecuteCallBack(uint8_t store_id, EXTERNAL_FLASH_KV_EVENT_TYPE event);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Initializes the stores, to be called after ExternalFlashLog__Initialize
+ * @details The stores are unmounted, ExternalFlashKv__Mount or ExternalFlashKv__Format make them usable.
+ */
+void ExternalFlashKv__Initialize(void)
+{
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+    BOOL_TYPE shared;
+
+#endif
+    // Initialize callback structure
+    Callback__Initialize(&ExternalFlashKv_Callback_Control_Structure);
+
+    // Start periodic handler task
+    ExternalFlashKv_Handler_Index = SystemTimers__CreateTask("ExternalFlashKv__Handler", &ExternalFlashKv__Handler, EXTERNAL_FLASH_KV_HANDLER_PERIOD_MS, TIMER_MS, FALSE );
+
+    SYS_ASSERT(ExternalFlashKv_Handler_Index != INVALID_VALUE_8);
+
+    memset(ExternalFlashKv_Store, 0x00, sizeof(ExternalFlashKv_Store));
+
+    for(uint8_t store_id = 0; store_id < EXTERNAL_FLASH_KV_NUM; store_id++)
+    {
+        ExternalFlashLog__RegisterEventHandler(&LogEventHandler, ExternalFlashKv_Map[store_id].Log_Id, CALLBACK_FILTER_VALUE_NONE);
+
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+        SYS_ASSERT((sizeof(EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE) + sizeof(ExternalFlashKv_Store[store_id].Index)) <= EXTERNAL_FLASH_KV_CHECKPOINT_SLOT_SIZE);
+
+        // Shared instance of the checkpoint channel, see ExternalFlash.h
+        ExternalFlashKv_Store[store_id].Instance = ExternalFlash__GetAllocation(ExternalFlashKv_Map[store_id].Checkpoint_Channel, NULL, 0);
+        SYS_ASSERT(ExternalFlashKv_Store[store_id].Instance < EXTERNAL_FLASH_CH_NUM);
+
+        shared = FALSE;
+        for(uint8_t other_id = 0; other_id < store_id; other_id++)
+        {
+            if(ExternalFlashKv_Store[other_id].Instance == ExternalFlashKv_Store[store_id].Instance)
+            {
+                shared = TRUE;
+            }
+        }
+        if(shared == FALSE)
+        {
+            ExternalFlash__RegisterEventHandler(&ExternalFlashEventHandler, ExternalFlashKv_Store[store_id].Instance, CALLBACK_FILTER_VALUE_NONE);
+        }
+#endif
+
+        ExternalFlashKv_Store[store_id].State = EXTERNAL_FLASH_KV_STATE_UNMOUNTED;
+        ClearIndex(store_id);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Restarts the log calls rejected while the log was busy and runs one garbage collection step per store,
+ *          or saves a checkpoint of the index
+ */
+void ExternalFlashKv__Handler(void)
+{
+    for(uint8_t store_id = 0; store_id < EXTERNAL_FLASH_KV_NUM; store_id++)
+    {
+        if(ExternalFlashKv_Store[store_id].Log_Pending == TRUE)
+        {
+            Issue(store_id);
+        }
+        else if((ExternalFlashKv_Store[store_id].State == EXTERNAL_FLASH_KV_STATE_IDLE) &&
+                (IsGcNeeded(store_id) == TRUE))
+        {
+            StartStep(store_id, EXTERNAL_FLASH_KV_STATE_GC_READ);
+        }
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+        else if((ExternalFlashKv_Store[store_id].State == EXTERNAL_FLASH_KV_STATE_IDLE) &&
+                (ExternalFlashKv_Store[store_id].Records >= EXTERNAL_FLASH_KV_CHECKPOINT_INTERVAL))
+        {
+            ExternalFlashKv_Store[store_id].Formatting = FALSE;
+            StartCheckpoint(store_id);
+        }
+#endif
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Mounts the log of a store and rebuilds the index reading all its records
+ * @details With EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE the index is loaded from the newest valid checkpoint and only the
+ *          records appended after it are read. Notifies EXTERNAL_FLASH_KV_EVENT_MOUNTED.
+ * @param   store_id: store index in EXTERNAL_FLASH_KV_MAP
+ * @return  TRUE if the mount was started, FALSE if the store is busy
+ */
+BOOL_TYPE ExternalFlashKv__Mount(uint8_t store_id)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((store_id < EXTERNAL_FLASH_KV_NUM) &&
+       ((ExternalFlashKv_Store[store_id].State == EXTERNAL_FLASH_KV_STATE_UNMOUNTED) || (ExternalFlashKv_Store[store_id].State == EXTERNAL_FLASH_KV_STATE_IDLE)))
+    {
+        StartStep(store_id, EXTERNAL_FLASH_KV_STATE_MOUNT);
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Formats the log of a store, leaving it mounted and empty
+ * @details With EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE an empty checkpoint is saved first, so that an interrupted format
+ *          never leaves an older checkpoint over the new log. Notifies EXTERNAL_FLASH_KV_EVENT_MOUNTED.
+ * @param   store_id: store index in EXTERNAL_FLASH_KV_MAP
+ * @return  TRUE if the format was started, FALSE if the store is busy
+ */
+BOOL_TYPE ExternalFlashKv__Format(uint8_t store_id)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((store_id < EXTERNAL_FLASH_KV_NUM) &&
+       ((ExternalFlashKv_Store[store_id].State == EXTERNAL_FLASH_KV_STATE_UNMOUNTED) || (ExternalFlashKv_Store[store_id].State == EXTERNAL_FLASH_KV_STATE_IDLE)))
+    {
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+        ExternalFlashKv_Store[store_id].Formatting = TRUE;
+        ExternalFlashKv_Store[store_id].Slot = 0;
+        StartStep(store_id, EXTERNAL_FLASH_KV_STATE_CHECKPOINT_HEADER);
+#else
+        StartStep(store_id, EXTERNAL_FLASH_KV_STATE_FORMAT);
+#endif
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Stores a value, replacing the previous one of the key
+ * @details The value is copied, the buffer can be reused on return. Notifies EXTERNAL_FLASH_KV_EVENT_STORED.
+ * @param   store_id: store index in EXTERNAL_FLASH_KV_MAP
+ * @param   key: key
+ * @param   value: value
+ * @param   size: value size, up to EXTERNAL_FLASH_KV_MAX_VALUE_SIZE
+ * @return  TRUE if the put was started, FALSE if the store is not mounted or busy, the value is too large, or the
+ *          index or the log has no room for it until garbage collection frees space (or, with
+ *          EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE, until the handler saves a checkpoint)
+ */
+BOOL_TYPE ExternalFlashKv__Put(uint8_t store_id, uint32_t key, void* value, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((store_id < EXTERNAL_FLASH_KV_NUM) &&
+       (size <= EXTERNAL_FLASH_KV_MAX_VALUE_SIZE))
+    {
+        success = StartPut(store_id, key, EXTERNAL_FLASH_KV_RECORD_PUT, value, size);
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the value of a key
+ * @details Notifies EXTERNAL_FLASH_KV_EVENT_VALUE, or EXTERNAL_FLASH_KV_EVENT_CORRUPT if the record fails its check.
+ *          A value larger than the buffer is truncated, ExternalFlashKv__GetSize gives its size.
+ * @param   store_id: store index in EXTERNAL_FLASH_KV_MAP
+ * @param   key: key
+ * @param   buffer: value destination, must stay valid until the event
+ * @param   size: buffer size
+ * @return  TRUE if the get was started, FALSE if the store is not mounted or busy or the key is not stored
+ */
+BOOL_TYPE ExternalFlashKv__Get(uint8_t store_id, uint32_t key, void* buffer, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+    uint16_t slot;
+
+    if((store_id < EXTERNAL_FLASH_KV_NUM) &&
+       (ExternalFlashKv_Store[store_id].State == EXTERNAL_FLASH_KV_STATE_IDLE))
+    {
+        slot = Lookup(store_id, key);
+        if(slot != INVALID_VALUE_16)
+        {
+            ExternalFlashKv_Store[store_id].Record_Position = ExternalFlashKv_Store[store_id].Index[slot].Position;
+            ExternalFlashKv_Store[store_id].Client_Buffer = (uint8_t*)buffer;
+            ExternalFlashKv_Store[store_id].Client_Size = size;
+            StartStep(store_id, EXTERNAL_FLASH_KV_STATE_GET);
+            success = TRUE;
+        }
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Deletes a key
+ * @details Notifies EXTERNAL_FLASH_KV_EVENT_DELETED.
+ * @param   store_id: store index in EXTERNAL_FLASH_KV_MAP
+ * @param   key: key
+ * @return  TRUE if the delete was started, FALSE if the store is not mounted or busy, the key is not stored or the log
+ *          has no room until garbage collection frees space
+ */
+BOOL_TYPE ExternalFlashKv__Delete(uint8_t store_id, uint32_t key)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((store_id < EXTERNAL_FLASH_KV_NUM) &&
+       (Lookup(store_id, key) != INVALID_VALUE_16))
+    {
+        success = StartPut(store_id, key, EXTERNAL_FLASH_KV_RECORD_DELETE, NULL, 0);
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gives the value size of a key, from the index
+ * @param   store_id: store index in EXTERNAL_FLASH_KV_MAP
+ * @param   key: key
+ * @return  value size, INVALID_VALUE_16 if the key is not stored
+ */
+uint16_t ExternalFlashKv__GetSize(uint8_t store_id, uint32_t key)
+{
+    uint16_t size = INVALID_VALUE_16;
+    uint16_t slot;
+
+    if(store_id < EXTERNAL_FLASH_KV_NUM)
+    {
+        slot = Lookup(store_id, key);
+        if(slot != INVALID_VALUE_16)
+        {
+            size = ExternalFlashKv_Store[store_id].Index[slot].Size;
+        }
+    }
+
+    return size;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Tells if a store has an operation or a garbage collection step in progress
+ * @param   store_id: store index in EXTERNAL_FLASH_KV_MAP
+ * @return  TRUE if busy or invalid store
+ */
+BOOL_TYPE ExternalFlashKv__IsBusy(uint8_t store_id)
+{
+    BOOL_TYPE busy = TRUE;
+
+    if((store_id < EXTERNAL_FLASH_KV_NUM) &&
+       ((ExternalFlashKv_Store[store_id].State == EXTERNAL_FLASH_KV_STATE_UNMOUNTED) || (ExternalFlashKv_Store[store_id].State == EXTERNAL_FLASH_KV_STATE_IDLE)))
+    {
+        busy = FALSE;
+    }
+
+    return busy;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Registers event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlashKv__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value)
+{
+    Callback__Register(&ExternalFlashKv_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler, filter_id, filter_value);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Unregisters event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlashKv__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler)
+{
+    Callback__Unregister(&ExternalFlashKv_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler);
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+/**
+ * @brief   Log event handler: advances the store owning the log
+ * @param   event: log callback event
+ */
+static void LogEventHandler(CALLBACK_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE log_event;
+
+    memcpy(&log_event, &event, sizeof(CALLBACK_EVENT_TYPE));
+
+    for(uint8_t store_id = 0; store_id < EXTERNAL_FLASH_KV_NUM; store_id++)
+    {
+        if((ExternalFlashKv_Map[store_id].Log_Id == log_event.Source_Instance_Id) &&
+           (ExternalFlashKv_Store[store_id].Log_Pending == FALSE))
+        {
+            Advance(store_id, (EXTERNAL_FLASH_LOG_EVENT_TYPE)log_event.Event_Value);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Store state machine, called on the completion of the log call of the current state
+ * @param   store_id: store index
+ * @param   event: log event
+ */
+static void Advance(uint8_t store_id, EXTERNAL_FLASH_LOG_EVENT_TYPE event)
+{
+    EXTERNAL_FLASH_KV_STORE_TYPE* store = &ExternalFlashKv_Store[store_id];
+    EXTERNAL_FLASH_KV_RECORD_HEADER_TYPE header;
+    uint32_t sequence;
+    uint32_t position;
+    uint16_t length;
+    uint16_t slot;
+
+    ExternalFlashLog__GetRecordInfo(ExternalFlashKv_Map[store_id].Log_Id, &sequence, &length, &position);
+    store->Record_Size = (length < sizeof(store->Scratch)) ? length : sizeof(store->Scratch);
+    memcpy(&header, store->Scratch, sizeof(header));
+
+    switch(store->State)
+    {
+      case EXTERNAL_FLASH_KV_STATE_MOUNT:
+      case EXTERNAL_FLASH_KV_STATE_FORMAT:
+        if(event == EXTERNAL_FLASH_LOG_EVENT_MOUNTED)
+        {
+            EXTERNAL_FLASH_LOG_INFO_TYPE info;
+
+            // Keep a free sector, the garbage collection margin and the end of sector slack of every sector
+            ExternalFlashLog__GetInfo(ExternalFlashKv_Map[store_id].Log_Id, &info);
+            SYS_ASSERT(info.Sector_Num > (EXTERNAL_FLASH_KV_GC_THRESHOLD + 2));
+            store->Live_Limit = (uint32_t)(info.Sector_Num - EXTERNAL_FLASH_KV_GC_THRESHOLD - 2) *
+                                (EXTERNAL_FLASH_LOG_SECTOR_SIZE - EXTERNAL_FLASH_KV_RECORD_SIZE(EXTERNAL_FLASH_KV_MAX_VALUE_SIZE));
+            ClearIndex(store_id);
+
+            if(store->State == EXTERNAL_FLASH_KV_STATE_MOUNT)
+            {
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+                store->Formatting = FALSE;
+                store->Slot = 0;
+                StartStep(store_id, EXTERNAL_FLASH_KV_STATE_CHECKPOINT_HEADER);
+#else
+                ExternalFlashLog__Rewind(ExternalFlashKv_Map[store_id].Log_Id);
+                StartStep(store_id, EXTERNAL_FLASH_KV_STATE_REBUILD);
+#endif
+            }
+            else
+            {
+                store->State = EXTERNAL_FLASH_KV_STATE_IDLE;
+                ExecuteCallBack(store_id, EXTERNAL_FLASH_KV_EVENT_MOUNTED);
+            }
+        }
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_REBUILD:
+        if(event == EXTERNAL_FLASH_LOG_EVENT_END)
+        {
+            // Garbage collection starts from the oldest record
+            ExternalFlashLog__Rewind(ExternalFlashKv_Map[store_id].Log_Id);
+            store->State = EXTERNAL_FLASH_KV_STATE_IDLE;
+            ExecuteCallBack(store_id, EXTERNAL_FLASH_KV_EVENT_MOUNTED);
+        }
+        else
+        {
+            // Records failing their check are skipped, the key keeps its previous record
+            if((event == EXTERNAL_FLASH_LOG_EVENT_RECORD) && (length >= sizeof(header)) && (length <= sizeof(store->Scratch)))
+            {
+                ApplyRecord(store_id, position, sequence);
+            }
+            StartStep(store_id, EXTERNAL_FLASH_KV_STATE_REBUILD);
+        }
+        break;
+
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+      case EXTERNAL_FLASH_KV_STATE_CHECKPOINT_REPLAY:
+        if((event == EXTERNAL_FLASH_LOG_EVENT_RECORD) &&
+           (position == store->Slot_Header[store->Slot].Position) && (sequence == store->Slot_Header[store->Slot].Sequence))
+        {
+            // The log still holds the records appended after the checkpoint
+            if((length >= sizeof(header)) && (length <= sizeof(store->Scratch)))
+            {
+                ApplyRecord(store_id, position, sequence);
+            }
+            StartStep(store_id, EXTERNAL_FLASH_KV_STATE_REBUILD);
+        }
+        else
+        {
+            StartRebuild(store_id);
+        }
+        break;
+#endif
+
+      case EXTERNAL_FLASH_KV_STATE_PUT:
+        if(event == EXTERNAL_FLASH_LOG_EVENT_APPENDED)
+        {
+            ApplyRecord(store_id, position, sequence);
+            store->State = EXTERNAL_FLASH_KV_STATE_IDLE;
+            ExecuteCallBack(store_id, (header.Type == EXTERNAL_FLASH_KV_RECORD_PUT) ? EXTERNAL_FLASH_KV_EVENT_STORED : EXTERNAL_FLASH_KV_EVENT_DELETED);
+        }
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_GET:
+        store->State = EXTERNAL_FLASH_KV_STATE_IDLE;
+        if((event == EXTERNAL_FLASH_LOG_EVENT_RECORD) && (store->Record_Size >= sizeof(header)))
+        {
+            length = store->Record_Size - sizeof(header);
+            if(length > store->Client_Size)
+            {
+                length = store->Client_Size;
+            }
+            memcpy(store->Client_Buffer, &store->Scratch[sizeof(header)], length);
+            ExecuteCallBack(store_id, EXTERNAL_FLASH_KV_EVENT_VALUE);
+        }
+        else
+        {
+            ExecuteCallBack(store_id, EXTERNAL_FLASH_KV_EVENT_CORRUPT);
+        }
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_GC_READ:
+        store->State = EXTERNAL_FLASH_KV_STATE_IDLE;
+        if((event == EXTERNAL_FLASH_LOG_EVENT_RECORD) && (length >= sizeof(header)) && (length <= sizeof(store->Scratch)) &&
+           (header.Type == EXTERNAL_FLASH_KV_RECORD_PUT))
+        {
+            // Copy the record if it is still the newest of its key
+            slot = Lookup(store_id, header.Key);
+            if((slot != INVALID_VALUE_16) && (store->Index[slot].Position == position))
+            {
+                StartStep(store_id, EXTERNAL_FLASH_KV_STATE_GC_COPY);
+            }
+        }
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_GC_COPY:
+        if(event == EXTERNAL_FLASH_LOG_EVENT_APPENDED)
+        {
+            ApplyRecord(store_id, position, sequence);
+            store->State = EXTERNAL_FLASH_KV_STATE_IDLE;
+        }
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_UNMOUNTED:
+      case EXTERNAL_FLASH_KV_STATE_IDLE:
+      default:
+        break;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Enters a state and starts its log call
+ * @param   store_id: store index
+ * @param   state: new state
+ */
+static void StartStep(uint8_t store_id, EXTERNAL_FLASH_KV_STATE_TYPE state)
+{
+    ExternalFlashKv_Store[store_id].State = state;
+    ExternalFlashKv_Store[store_id].Log_Pending = TRUE;
+
+    Issue(store_id);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the log call of the current state, left pending for the handler if the log is busy
+ * @param   store_id: store index
+ */
+static void Issue(uint8_t store_id)
+{
+    EXTERNAL_FLASH_KV_STORE_TYPE* store = &ExternalFlashKv_Store[store_id];
+    uint8_t log_id = ExternalFlashKv_Map[store_id].Log_Id;
+    BOOL_TYPE started = FALSE;
+
+    store->Log_Pending = FALSE;
+
+    switch(store->State)
+    {
+      case EXTERNAL_FLASH_KV_STATE_MOUNT:
+        started = ExternalFlashLog__Mount(log_id);
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_FORMAT:
+        started = ExternalFlashLog__Format(log_id);
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_REBUILD:
+      case EXTERNAL_FLASH_KV_STATE_GC_READ:
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+      case EXTERNAL_FLASH_KV_STATE_CHECKPOINT_REPLAY:
+#endif
+        started = ExternalFlashLog__ReadNext(log_id, store->Scratch, sizeof(store->Scratch));
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_PUT:
+      case EXTERNAL_FLASH_KV_STATE_GC_COPY:
+        started = ExternalFlashLog__Append(log_id, store->Scratch, store->Record_Size);
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_GET:
+        started = ExternalFlashLog__ReadRecord(log_id, store->Record_Position, store->Scratch, sizeof(store->Scratch));
+        break;
+
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+      case EXTERNAL_FLASH_KV_STATE_CHECKPOINT_HEADER:
+        started = ExternalFlash__Read(store->Instance, &store->Slot_Header[store->Slot],
+                                      ExternalFlashKv_Map[store_id].Checkpoint_Address + (store->Slot * EXTERNAL_FLASH_KV_CHECKPOINT_SLOT_SIZE),
+                                      sizeof(EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE));
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_CHECKPOINT_LOAD:
+        started = ExternalFlash__Read(store->Instance, store->Index,
+                                      ExternalFlashKv_Map[store_id].Checkpoint_Address + (store->Slot * EXTERNAL_FLASH_KV_CHECKPOINT_SLOT_SIZE) + sizeof(EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE),
+                                      sizeof(store->Index));
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_CHECKPOINT_INDEX:
+        started = ExternalFlash__Write(store->Instance, store->Index,
+                                       ExternalFlashKv_Map[store_id].Checkpoint_Address + (store->Slot * EXTERNAL_FLASH_KV_CHECKPOINT_SLOT_SIZE) + sizeof(EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE),
+                                       sizeof(store->Index));
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_CHECKPOINT_COMMIT:
+        started = ExternalFlash__Write(store->Instance, &store->Slot_Header[store->Slot],
+                                       ExternalFlashKv_Map[store_id].Checkpoint_Address + (store->Slot * EXTERNAL_FLASH_KV_CHECKPOINT_SLOT_SIZE),
+                                       sizeof(EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE));
+        break;
+#endif
+
+      default:
+        started = TRUE;
+        break;
+    }
+
+    if(started == FALSE)
+    {
+        store->Log_Pending = TRUE;
+        SystemTimers__ResumeTask(ExternalFlashKv_Handler_Index);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Appends a put or delete record, if index and log have room for it
+ * @param   store_id: store index
+ * @param   key: key
+ * @param   type: EXTERNAL_FLASH_KV_RECORD_PUT or EXTERNAL_FLASH_KV_RECORD_DELETE
+ * @param   value: value, NULL for deletes
+ * @param   size: value size
+ * @return  TRUE if started
+ */
+static BOOL_TYPE StartPut(uint8_t store_id, uint32_t key, uint8_t type, void* value, uint16_t size)
+{
+    EXTERNAL_FLASH_KV_STORE_TYPE* store = &ExternalFlashKv_Store[store_id];
+    EXTERNAL_FLASH_KV_RECORD_HEADER_TYPE header;
+    EXTERNAL_FLASH_LOG_INFO_TYPE info;
+    BOOL_TYPE success = FALSE;
+    uint32_t live_bytes = store->Live_Bytes;
+    uint16_t slot;
+
+    if(store->State == EXTERNAL_FLASH_KV_STATE_IDLE)
+    {
+        slot = Lookup(store_id, key);
+        if(slot != INVALID_VALUE_16)
+        {
+            live_bytes -= EXTERNAL_FLASH_KV_RECORD_SIZE(store->Index[slot].Size);
+        }
+        if(type == EXTERNAL_FLASH_KV_RECORD_PUT)
+        {
+            live_bytes += EXTERNAL_FLASH_KV_RECORD_SIZE(size);
+        }
+
+        ExternalFlashLog__GetInfo(ExternalFlashKv_Map[store_id].Log_Id, &info);
+
+        // The log must not drop a sector that garbage collection has not gone through yet
+        if(((slot != INVALID_VALUE_16) || (store->Entry_Num < ((EXTERNAL_FLASH_KV_INDEX_SIZE * 3) / 4))) &&
+           (live_bytes <= store->Live_Limit) &&
+           ((info.Free_Sectors + info.Read_Sectors) > 0)
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+           // Nor can the records after the last checkpoint grow without bound while the handler finds the store busy
+           && (store->Records < (2 * EXTERNAL_FLASH_KV_CHECKPOINT_INTERVAL))
+#endif
+          )
+        {
+            header.Key = key;
+            header.Type = type;
+            memcpy(store->Scratch, &header, sizeof(header));
+            if(size > 0)
+            {
+                memcpy(&store->Scratch[sizeof(header)], value, size);
+            }
+            store->Record_Size = sizeof(header) + size;
+
+            StartStep(store_id, EXTERNAL_FLASH_KV_STATE_PUT);
+            success = TRUE;
+        }
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Updates the index with the record in the scratch buffer
+ * @param   store_id: store index
+ * @param   position: record position in the log
+ * @param   sequence: record sequence number
+ */
+static void ApplyRecord(uint8_t store_id, uint32_t position, uint32_t sequence)
+{
+    EXTERNAL_FLASH_KV_STORE_TYPE* store = &ExternalFlashKv_Store[store_id];
+    EXTERNAL_FLASH_KV_RECORD_HEADER_TYPE header;
+
+    memcpy(&header, store->Scratch, sizeof(header));
+
+    if(header.Type == EXTERNAL_FLASH_KV_RECORD_PUT)
+    {
+        SetEntry(store_id, header.Key, position, store->Record_Size - sizeof(header));
+    }
+    else
+    {
+        RemoveEntry(store_id, header.Key);
+    }
+
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+    store->Last_Position = position;
+    store->Last_Sequence = sequence;
+    store->Records++;
+#else
+    (void)sequence;
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Tells if the log is close to dropping a sector not collected yet
+ * @param   store_id: store index
+ * @return  TRUE if a garbage collection step is needed
+ */
+static BOOL_TYPE IsGcNeeded(uint8_t store_id)
+{
+    EXTERNAL_FLASH_LOG_INFO_TYPE info;
+    BOOL_TYPE needed = FALSE;
+
+    ExternalFlashLog__GetInfo(ExternalFlashKv_Map[store_id].Log_Id, &info);
+
+    if((info.Free_Sectors + info.Read_Sectors) <= EXTERNAL_FLASH_KV_GC_THRESHOLD)
+    {
+        needed = TRUE;
+    }
+
+    return needed;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Empties the index of a store
+ * @param   store_id: store index
+ */
+static void ClearIndex(uint8_t store_id)
+{
+    EXTERNAL_FLASH_KV_STORE_TYPE* store = &ExternalFlashKv_Store[store_id];
+
+    for(uint16_t slot = 0; slot < EXTERNAL_FLASH_KV_INDEX_SIZE; slot++)
+    {
+        store->Index[slot].Position = EXTERNAL_FLASH_KV_POSITION_NONE;
+    }
+    store->Entry_Num = 0;
+    store->Live_Bytes = 0;
+
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+    store->Last_Position = EXTERNAL_FLASH_KV_POSITION_NONE;
+    store->Last_Sequence = 0;
+    store->Records = 0;
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Finds the index slot of a key
+ * @param   store_id: store index
+ * @param   key: key
+ * @return  slot, INVALID_VALUE_16 if the key is not stored
+ */
+static uint16_t Lookup(uint8_t store_id, uint32_t key)
+{
+    EXTERNAL_FLASH_KV_STORE_TYPE* store = &ExternalFlashKv_Store[store_id];
+    uint16_t slot = EXTERNAL_FLASH_KV_HASH(key);
+    uint16_t found = INVALID_VALUE_16;
+
+    // The index is never full, so the probe ends on a free slot
+    while((found == INVALID_VALUE_16) && (store->Index[slot].Position != EXTERNAL_FLASH_KV_POSITION_NONE))
+    {
+        if(store->Index[slot].Key == key)
+        {
+            found = slot;
+        }
+        slot = (slot + 1) & (EXTERNAL_FLASH_KV_INDEX_SIZE - 1);
+    }
+
+    return found;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Inserts or updates the index entry of a key
+ * @param   store_id: store index
+ * @param   key: key
+ * @param   position: record position in the log
+ * @param   size: value size
+ * @return  FALSE if the index is full
+ */
+static BOOL_TYPE SetEntry(uint8_t store_id, uint32_t key, uint32_t position, uint16_t size)
+{
+    EXTERNAL_FLASH_KV_STORE_TYPE* store = &ExternalFlashKv_Store[store_id];
+    uint16_t slot = Lookup(store_id, key);
+    BOOL_TYPE success = TRUE;
+
+    if(slot != INVALID_VALUE_16)
+    {
+        store->Live_Bytes -= EXTERNAL_FLASH_KV_RECORD_SIZE(store->Index[slot].Size);
+    }
+    else if(store->Entry_Num < (EXTERNAL_FLASH_KV_INDEX_SIZE - 1))
+    {
+        slot = EXTERNAL_FLASH_KV_HASH(key);
+        while(store->Index[slot].Position != EXTERNAL_FLASH_KV_POSITION_NONE)
+        {
+            slot = (slot + 1) & (EXTERNAL_FLASH_KV_INDEX_SIZE - 1);
+        }
+        store->Index[slot].Key = key;
+        store->Entry_Num++;
+    }
+    else
+    {
+        success = FALSE;
+    }
+
+    if(success == TRUE)
+    {
+        store->Index[slot].Position = position;
+        store->Index[slot].Size = size;
+        store->Live_Bytes += EXTERNAL_FLASH_KV_RECORD_SIZE(size);
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Removes the index entry of a key, shifting back the entries of its probe chain
+ * @param   store_id: store index
+ * @param   key: key
+ */
+static void RemoveEntry(uint8_t store_id, uint32_t key)
+{
+    EXTERNAL_FLASH_KV_STORE_TYPE* store = &ExternalFlashKv_Store[store_id];
+    uint16_t slot = Lookup(store_id, key);
+    uint16_t next;
+    uint16_t home;
+
+    if(slot != INVALID_VALUE_16)
+    {
+        store->Live_Bytes -= EXTERNAL_FLASH_KV_RECORD_SIZE(store->Index[slot].Size);
+        store->Entry_Num--;
+
+        next = (slot + 1) & (EXTERNAL_FLASH_KV_INDEX_SIZE - 1);
+        while(store->Index[next].Position != EXTERNAL_FLASH_KV_POSITION_NONE)
+        {
+            // Move the entry into the hole unless its home slot lies cyclically in (hole, next]
+            home = EXTERNAL_FLASH_KV_HASH(store->Index[next].Key);
+            if(((next - home) & (EXTERNAL_FLASH_KV_INDEX_SIZE - 1)) >= ((next - slot) & (EXTERNAL_FLASH_KV_INDEX_SIZE - 1)))
+            {
+                store->Index[slot] = store->Index[next];
+                slot = next;
+            }
+            next = (next + 1) & (EXTERNAL_FLASH_KV_INDEX_SIZE - 1);
+        }
+        store->Index[slot].Position = EXTERNAL_FLASH_KV_POSITION_NONE;
+    }
+}
+
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == ENABLED)
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   External Flash event handler: advances the store owning the checkpoint instance
+ * @param   event: External Flash callback event
+ */
+static void ExternalFlashEventHandler(CALLBACK_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE nv_event;
+    EXTERNAL_FLASH_KV_STATE_TYPE state;
+
+    memcpy(&nv_event, &event, sizeof(CALLBACK_EVENT_TYPE));
+
+    for(uint8_t store_id = 0; store_id < EXTERNAL_FLASH_KV_NUM; store_id++)
+    {
+        state = ExternalFlashKv_Store[store_id].State;
+
+        if((ExternalFlashKv_Store[store_id].Instance == nv_event.Source_Instance_Id) &&
+           (ExternalFlashKv_Store[store_id].Log_Pending == FALSE) &&
+           ((state == EXTERNAL_FLASH_KV_STATE_CHECKPOINT_HEADER) || (state == EXTERNAL_FLASH_KV_STATE_CHECKPOINT_LOAD) ||
+            (state == EXTERNAL_FLASH_KV_STATE_CHECKPOINT_INDEX) || (state == EXTERNAL_FLASH_KV_STATE_CHECKPOINT_COMMIT)))
+        {
+            AdvanceCheckpoint(store_id);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Store state machine of the checkpoint states, called on the completion of their External Flash call
+ * @param   store_id: store index
+ */
+static void AdvanceCheckpoint(uint8_t store_id)
+{
+    EXTERNAL_FLASH_KV_STORE_TYPE* store = &ExternalFlashKv_Store[store_id];
+    EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE* header = &store->Slot_Header[store->Slot];
+
+    switch(store->State)
+    {
+      case EXTERNAL_FLASH_KV_STATE_CHECKPOINT_HEADER:
+        store->Slot++;
+        if(store->Slot < EXTERNAL_FLASH_KV_CHECKPOINT_SLOTS)
+        {
+            StartStep(store_id, EXTERNAL_FLASH_KV_STATE_CHECKPOINT_HEADER);
+        }
+        else
+        {
+            // The next checkpoint must be newer than any slot header, even one failing its check
+            store->Generation = 0;
+            for(uint8_t slot = 0; slot < EXTERNAL_FLASH_KV_CHECKPOINT_SLOTS; slot++)
+            {
+                if((store->Slot_Header[slot].Generation != INVALID_VALUE_32) && (store->Slot_Header[slot].Generation > store->Generation))
+                {
+                    store->Generation = store->Slot_Header[slot].Generation;
+                }
+            }
+
+            if(store->Formatting == TRUE)
+            {
+                ClearIndex(store_id);
+                StartCheckpoint(store_id);
+            }
+            else
+            {
+                StartLoad(store_id);
+            }
+        }
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_CHECKPOINT_LOAD:
+        if((header->Entry_Num < EXTERNAL_FLASH_KV_INDEX_SIZE) && (GetCheckpointCrc(store_id, header) == header->Crc))
+        {
+            store->Entry_Num = 0;
+            store->Live_Bytes = 0;
+            for(uint16_t slot = 0; slot < EXTERNAL_FLASH_KV_INDEX_SIZE; slot++)
+            {
+                if(store->Index[slot].Position != EXTERNAL_FLASH_KV_POSITION_NONE)
+                {
+                    store->Live_Bytes += EXTERNAL_FLASH_KV_RECORD_SIZE(store->Index[slot].Size);
+                    store->Entry_Num++;
+                }
+            }
+            store->Last_Position = header->Position;
+            store->Last_Sequence = header->Sequence;
+            store->Records = 0;
+
+            if(header->Position == EXTERNAL_FLASH_KV_POSITION_NONE)
+            {
+                // Checkpoint of an empty log: all the records came after it
+                ExternalFlashLog__Rewind(ExternalFlashKv_Map[store_id].Log_Id);
+                StartStep(store_id, EXTERNAL_FLASH_KV_STATE_REBUILD);
+            }
+            else if(ExternalFlashLog__Seek(ExternalFlashKv_Map[store_id].Log_Id, header->Position) == TRUE)
+            {
+                StartStep(store_id, EXTERNAL_FLASH_KV_STATE_CHECKPOINT_REPLAY);
+            }
+            else
+            {
+                StartRebuild(store_id);
+            }
+        }
+        else
+        {
+            // Interrupted checkpoint, try the other slot
+            header->Generation = INVALID_VALUE_32;
+            StartLoad(store_id);
+        }
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_CHECKPOINT_INDEX:
+        StartStep(store_id, EXTERNAL_FLASH_KV_STATE_CHECKPOINT_COMMIT);
+        break;
+
+      case EXTERNAL_FLASH_KV_STATE_CHECKPOINT_COMMIT:
+        store->Records = 0;
+        if(store->Formatting == TRUE)
+        {
+            StartStep(store_id, EXTERNAL_FLASH_KV_STATE_FORMAT);
+        }
+        else
+        {
+            store->State = EXTERNAL_FLASH_KV_STATE_IDLE;
+        }
+        break;
+
+      default:
+        break;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Saves the index into the slot of the next generation, the older one
+ * @param   store_id: store index
+ */
+static void StartCheckpoint(uint8_t store_id)
+{
+    EXTERNAL_FLASH_KV_STORE_TYPE* store = &ExternalFlashKv_Store[store_id];
+    EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE* header;
+
+    store->Generation++;
+    store->Slot = (uint8_t)(store->Generation % EXTERNAL_FLASH_KV_CHECKPOINT_SLOTS);
+
+    header = &store->Slot_Header[store->Slot];
+    header->Generation = store->Generation;
+    header->Position = store->Last_Position;
+    header->Sequence = store->Last_Sequence;
+    header->Entry_Num = store->Entry_Num;
+    header->Crc = GetCheckpointCrc(store_id, header);
+
+    StartStep(store_id, EXTERNAL_FLASH_KV_STATE_CHECKPOINT_INDEX);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Loads the index from the newest slot not tried yet, or rebuilds it from the whole log if none is left
+ * @param   store_id: store index
+ */
+static void StartLoad(uint8_t store_id)
+{
+    EXTERNAL_FLASH_KV_STORE_TYPE* store = &ExternalFlashKv_Store[store_id];
+    uint8_t newest = INVALID_VALUE_8;
+
+    for(uint8_t slot = 0; slot < EXTERNAL_FLASH_KV_CHECKPOINT_SLOTS; slot++)
+    {
+        if((store->Slot_Header[slot].Generation != INVALID_VALUE_32) &&
+           ((newest == INVALID_VALUE_8) || (store->Slot_Header[slot].Generation > store->Slot_Header[newest].Generation)))
+        {
+            newest = slot;
+        }
+    }
+
+    if(newest != INVALID_VALUE_8)
+    {
+        store->Slot = newest;
+        StartStep(store_id, EXTERNAL_FLASH_KV_STATE_CHECKPOINT_LOAD);
+    }
+    else
+    {
+        StartRebuild(store_id);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Rebuilds the index reading the whole log, from its oldest record
+ * @param   store_id: store index
+ */
+static void StartRebuild(uint8_t store_id)
+{
+    ClearIndex(store_id);
+    ExternalFlashLog__Rewind(ExternalFlashKv_Map[store_id].Log_Id);
+    StartStep(store_id, EXTERNAL_FLASH_KV_STATE_REBUILD);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   CRC of a checkpoint: header fields before the CRC, then the index in RAM
+ * @param   store_id: store index
+ * @param   header: slot header
+ * @return  low 16 bits of the CRC-32
+ */
+static uint16_t GetCheckpointCrc(uint8_t store_id, const EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE* header)
+{
+    uint32_t crc;
+
+    crc = ExternalFlash__GetCrc(0, header, sizeof(EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE) - sizeof(header->Crc));
+    crc = ExternalFlash__GetCrc(crc, ExternalFlashKv_Store[store_id].Index, sizeof(ExternalFlashKv_Store[store_id].Index));
+
+    return (uint16_t)crc;
+}
+#endif
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Notifies a store event to the registered handlers
+ * @param   store_id: store index, source instance of the event
+ * @param   event: EXTERNAL_FLASH_KV_EVENT_TYPE, event value
+ */
+static void ExecuteCallBack(uint8_t store_id, EXTERNAL_FLASH_KV_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE data;
+    CALLBACK_EVENT_TYPE callback_event;
+
+    data.Generic_Provider_Id = GENERIC_NVDATA_EXTERNAL_FLASH;
+    data.Source_Instance_Id = store_id;
+    data.Event_Value = (uint16_t)event;
+
+    memcpy(&callback_event, ((uint32_t*)(&data)), sizeof(CALLBACK_EVENT_TYPE));
+
+    Callback__Notify(&ExternalFlashKv_Callback_Control_Structure, callback_event, store_id, NULL);
+}
@@ -0,0 +1,96 @@
+/**
+ *  @file       ExternalFlashKv.h
+ *
+ *  @brief      Log-structured key-value stores over External Flash logs.
+ *  @details    Each store declared in EXTERNAL_FLASH_KV_MAP (ExternalFlashKv_prv.h) owns an External Flash log. Puts and
+ *              deletes are appended to the log as records {key, type, value}; a RAM hash index maps each stored key to
+ *              its newest record, so a get is one record read and a put never rewrites old data. Mount rebuilds the
+ *              index reading the log from its oldest record.
+ *
+ *              With EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE the index is also saved, every EXTERNAL_FLASH_KV_CHECKPOINT_INTERVAL
+ *              records, into the older of two slots of a reserved External Flash area with a generation number. Mount
+ *              then loads the newest valid slot with a single read and only reads the log records appended after it,
+ *              so its time depends on the checkpoint interval rather than on how full the log is.
+ *
+ *              Garbage collection runs from the handler task, one record per turn, when the log is close to dropping
+ *              its oldest sector: it walks the log from the oldest record and appends again the records still
+ *              referenced by the index, so the oldest sectors only hold stale records when the log drops them.
+ *
+ *              All operations are asynchronous: they return FALSE if the store is busy and their completion is
+ *              notified to the registered event handlers, with the store id as source instance and an
+ *              EXTERNAL_FLASH_KV_EVENT_TYPE as event value.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+#ifndef EXTERNALFLASHKV_H_
+#define EXTERNALFLASHKV_H_
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "C_Extensions.h"
+#include "Callback.h"
+#include "ExternalFlashLog.h"
+#include "ExternalFlashKv_prv.h"
+
+//-------------------------------------- PUBLIC (Variables, Constants & Defines) --------------------------------------
+
+//! Largest value
+#ifndef EXTERNAL_FLASH_KV_MAX_VALUE_SIZE
+#define EXTERNAL_FLASH_KV_MAX_VALUE_SIZE            (64)
+#endif
+
+//! Index entries of each store, must be a power of two; at most 3/4 of them are used to keep probe chains short
+#ifndef EXTERNAL_FLASH_KV_INDEX_SIZE
+#define EXTERNAL_FLASH_KV_INDEX_SIZE                (64)
+#endif
+
+//! Garbage collection runs while the log has this many sectors or less free or already collected
+#ifndef EXTERNAL_FLASH_KV_GC_THRESHOLD
+#define EXTERNAL_FLASH_KV_GC_THRESHOLD              (2)
+#endif
+
+//! Index checkpoints, the map entries then also give channel and address of the checkpoint area of each store
+#ifndef EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE
+#define EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE        DISABLED
+#endif
+
+//! Records appended or replayed after which the handler saves a checkpoint
+#ifndef EXTERNAL_FLASH_KV_CHECKPOINT_INTERVAL
+#define EXTERNAL_FLASH_KV_CHECKPOINT_INTERVAL       (32)
+#endif
+
+//! Checkpoint slot size, 16 byte header and 12 bytes per index entry in whole 256 byte pages; the checkpoint area of a
+//! store is two slots
+#define EXTERNAL_FLASH_KV_CHECKPOINT_SLOT_SIZE      ((((EXTERNAL_FLASH_KV_INDEX_SIZE * 12UL) + 16UL) + 255UL) & ~255UL)
+
+//! Handler task period, one garbage collection step per period
+#ifndef EXTERNAL_FLASH_KV_HANDLER_PERIOD_MS
+#define EXTERNAL_FLASH_KV_HANDLER_PERIOD_MS         EXTERNAL_FLASH_LOG_HANDLER_PERIOD_MS
+#endif
+
+//! Store events, notified as event value
+typedef enum EXTERNAL_FLASH_KV_EVENT_ENUM
+{
+    EXTERNAL_FLASH_KV_EVENT_MOUNTED,                        // Mount or format completed
+    EXTERNAL_FLASH_KV_EVENT_STORED,                         // Put completed
+    EXTERNAL_FLASH_KV_EVENT_DELETED,                        // Delete completed
+    EXTERNAL_FLASH_KV_EVENT_VALUE,                          // Get completed, value in the client buffer
+    EXTERNAL_FLASH_KV_EVENT_CORRUPT,                        // Get found a record failing its CRC
+    EXTERNAL_FLASH_KV_EVENT_NUM
+} EXTERNAL_FLASH_KV_EVENT_TYPE;
+
+//-------------------------------------- PUBLIC (Function Prototypes) -------------------------------------------------
+
+void ExternalFlashKv__Initialize(void);
+void ExternalFlashKv__Handler(void);
+BOOL_TYPE ExternalFlashKv__Mount(uint8_t store_id);
+BOOL_TYPE ExternalFlashKv__Format(uint8_t store_id);
+BOOL_TYPE ExternalFlashKv__Put(uint8_t store_id, uint32_t key, void* value, uint16_t size);
+BOOL_TYPE ExternalFlashKv__Get(uint8_t store_id, uint32_t key, void* buffer, uint16_t size);
+BOOL_TYPE ExternalFlashKv__Delete(uint8_t store_id, uint32_t key);
+uint16_t ExternalFlashKv__GetSize(uint8_t store_id, uint32_t key);
+BOOL_TYPE ExternalFlashKv__IsBusy(uint8_t store_id);
+void ExternalFlashKv__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value);
+void ExternalFlashKv__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler);
+
+#endif /* EXTERNALFLASHKV_H_ */
@@ -0,0 +1,1179 @@
+/**
+ *  @file       ExternalFlashLog.c
+ *
+ *  @brief      Append-only circular logs over regions of External Flash instances.
+ *  @details    Layout of a log region: sectors of EXTERNAL_FLASH_LOG_SECTOR_SIZE, each holding records packed from its
+ *              start. A record is a EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE followed by Length payload bytes, the
+ *              sequence numbers of consecutive records are consecutive. An erased header (all 0xFF) ends the records
+ *              of a sector. The sector after the head sector is always kept erased, so the head can move there without
+ *              waiting for an erase and mount can tell the newest sector from the oldest one.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashLog.h"
+#include "ExternalFlashLog_prv.h"
+#include "ExternalFlash.h"
+
+#include "Callback.h"
+#include "CommonInterface.h"
+
+#include "SystemTimers.h"
+#include "Utilities.h"
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if ((EXTERNAL_FLASH_LOG_SCRATCH_SIZE < EXTERNAL_FLASH_LOG_HEADER_SIZE) || (EXTERNAL_FLASH_LOG_SCRATCH_SIZE > EXTERNAL_FLASH_LOG_SECTOR_SIZE))
+#error "EXTERNAL_FLASH_LOG_SCRATCH_SIZE must hold a record header and fit in a sector"
+#endif
+
+//! Define the callback control structure module static variable
+DEFINE_CALLBACK_CONTROL_STRUCTURE(ExternalFlashLog_Callback_Control_Structure, EXTERNAL_FLASH_LOG_CALLBACK_REGISTERS_SIZE);
+
+//! Log Map struct type
+typedef struct EXTERNAL_FLASH_LOG_MAP_STRUCT
+{
+    EXTERNAL_FLASH_CH_TYPE      ExternalFlash_Channel;      // Client channel of the External Flash instance, owned by the log
+    uint32_t                    Region_Address;             // Device address, sector aligned
+    uint32_t                    Region_Size;                // Multiple of EXTERNAL_FLASH_LOG_SECTOR_SIZE, at least 2 sectors
+} EXTERNAL_FLASH_LOG_MAP_TYPE;
+
+//! Log Configuration Map
+static const EXTERNAL_FLASH_LOG_MAP_TYPE ExternalFlashLog_Map[] = EXTERNAL_FLASH_LOG_MAP;
+
+#define EXTERNAL_FLASH_LOG_NUM                  ELEMENTS_IN_ARRAY(ExternalFlashLog_Map)
+
+//! Record header, programmed in the same page program as the payload when both fit in the scratch buffer
+typedef __PACKED_STRUCT EXTERNAL_FLASH_LOG_RECORD_HEADER_STRUCT
+{
+    uint32_t                    Sequence;
+    uint16_t                    Length;                     // Payload bytes
+    uint16_t                    Crc;                        // Low 16 bits of the CRC-32 of Sequence, Length and payload
+} EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE;
+
+//! Sequence number of an erased header
+#define EXTERNAL_FLASH_LOG_SEQUENCE_ERASED      INVALID_VALUE_32
+
+//! Log states
+typedef enum EXTERNAL_FLASH_LOG_STATE_ENUM
+{
+    EXTERNAL_FLASH_LOG_STATE_UNMOUNTED,
+    EXTERNAL_FLASH_LOG_STATE_IDLE,
+    EXTERNAL_FLASH_LOG_STATE_MOUNT_FIRST,                   // Reading the first header of sector 0
+    EXTERNAL_FLASH_LOG_STATE_MOUNT_LAST,                    // Reading the first header of the last sector, sector 0 erased
+    EXTERNAL_FLASH_LOG_STATE_MOUNT_SEARCH,                  // Binary search of the head sector
+    EXTERNAL_FLASH_LOG_STATE_MOUNT_TAIL,                    // Reading the first header of the sector after the erased one
+    EXTERNAL_FLASH_LOG_STATE_MOUNT_SCAN,                    // Walking the headers of the head sector
+    EXTERNAL_FLASH_LOG_STATE_MOUNT_ERASE,                   // Erasing the sector after the head
+    EXTERNAL_FLASH_LOG_STATE_FORMAT,                        // Erasing the region
+    EXTERNAL_FLASH_LOG_STATE_APPEND_HEADER,                 // Programming the header of a record larger than the scratch buffer
+    EXTERNAL_FLASH_LOG_STATE_APPEND,                        // Programming the record (or its payload)
+    EXTERNAL_FLASH_LOG_STATE_ERASE_AHEAD,                   // Erasing the sector after the new head sector
+    EXTERNAL_FLASH_LOG_STATE_READ_HEADER,
+    EXTERNAL_FLASH_LOG_STATE_READ_PAYLOAD,
+    EXTERNAL_FLASH_LOG_STATE_READ_END                       // No more records, notifies from the handler
+} EXTERNAL_FLASH_LOG_STATE_TYPE;
+
+//! External Flash request of a log
+typedef enum EXTERNAL_FLASH_LOG_REQUEST_ENUM
+{
+    EXTERNAL_FLASH_LOG_REQUEST_NONE,
+    EXTERNAL_FLASH_LOG_REQUEST_PENDING,                     // To be started, retried by the handler while the instance is busy
+    EXTERNAL_FLASH_LOG_REQUEST_WAIT,                        // Started, waiting for the External Flash event
+    EXTERNAL_FLASH_LOG_REQUEST_DONE                         // Completed, the state machine advances
+} EXTERNAL_FLASH_LOG_REQUEST_TYPE;
+
+//! External Flash operations used by the logs
+typedef enum EXTERNAL_FLASH_LOG_OPERATION_ENUM
+{
+    EXTERNAL_FLASH_LOG_OPERATION_READ,
+    EXTERNAL_FLASH_LOG_OPERATION_PROGRAM,
+    EXTERNAL_FLASH_LOG_OPERATION_ERASE
+} EXTERNAL_FLASH_LOG_OPERATION_TYPE;
+
+//! Log position: sector index and offset in the sector
+typedef struct EXTERNAL_FLASH_LOG_POSITION_STRUCT
+{
+    uint16_t                    Sector;
+    uint16_t                    Offset;
+} EXTERNAL_FLASH_LOG_POSITION_TYPE;
+
+//! Log store struct type
+typedef struct EXTERNAL_FLASH_LOG_STORE_STRUCT
+{
+    uint8_t                     Instance;                   // External Flash instance
+    EXTERNAL_FLASH_LOG_STATE_TYPE State;
+    uint16_t                    Sector_Num;
+
+    EXTERNAL_FLASH_LOG_POSITION_TYPE Head;                  // Append position
+    uint32_t                    Next_Sequence;              // Sequence number of the next record appended
+    uint16_t                    Tail_Sector;                // Oldest sector
+
+    EXTERNAL_FLASH_LOG_POSITION_TYPE Cursor;                // Read position
+    uint32_t                    Cursor_Sequence;            // Expected sequence at the cursor, EXTERNAL_FLASH_LOG_SEQUENCE_ERASED if unknown
+    uint8_t*                    Client_Buffer;              // Append source or read destination
+    uint16_t                    Client_Size;
+    uint32_t                    Record_Sequence;            // Last record appended or read
+    uint16_t                    Record_Length;
+    EXTERNAL_FLASH_LOG_POSITION_TYPE Record_Position;
+    BOOL_TYPE                   Read_Random;                // Read of Record_Position, the cursor is not used
+    BOOL_TYPE                   Erase_Ahead;                // Append moved the head to a new sector
+
+    uint16_t                    Search_Low;                 // Binary search: newest sector candidate, first sector known not newer
+    uint16_t                    Search_High;
+    uint16_t                    Search_Sector;              // Sector being read
+    uint32_t                    First_Sequence;             // First sequence of sector 0
+    uint16_t                    Scan_Offset;                // Scan: next header offset, offset of the scratch buffer data
+    uint16_t                    Chunk_Offset;
+
+    EXTERNAL_FLASH_LOG_REQUEST_TYPE Request;
+    EXTERNAL_FLASH_LOG_OPERATION_TYPE Request_Operation;
+    uint32_t                    Request_Address;
+    void*                       Request_Buffer;
+    uint16_t                    Request_Size;
+
+    uint8_t                     Scratch[EXTERNAL_FLASH_LOG_SCRATCH_SIZE];
+} EXTERNAL_FLASH_LOG_STORE_TYPE;
+
+static EXTERNAL_FLASH_LOG_STORE_TYPE ExternalFlashLog_Store[EXTERNAL_FLASH_LOG_NUM];
+
+//! Log Task Handler Index
+static uint8_t ExternalFlashLog_Handler_Index = INVALID_VALUE_8;
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void ExternalFlashEventHandler(CALLBACK_EVENT_TYPE event);
+static void Process(uint8_t log_id);
+static void Advance(uint8_t log_id);
+static void Request(uint8_t log_id, EXTERNAL_FLASH_LOG_OPERATION_TYPE operation, uint16_t sector, uint16_t offset, void* buffer, uint16_t size);
+static void RequestDone(uint8_t log_id);
+static void StartSearchStep(uint8_t log_id);
+static void StartTail(uint8_t log_id);
+static void StartScanChunk(uint8_t log_id);
+static void ScanChunk(uint8_t log_id);
+static void StartEraseAhead(uint8_t log_id, EXTERNAL_FLASH_LOG_STATE_TYPE state);
+static void StartReadHeader(uint8_t log_id);
+static void ReadHeaderAt(uint8_t log_id, EXTERNAL_FLASH_LOG_POSITION_TYPE position);
+static void ReadHeader(uint8_t log_id);
+static void ReadPayload(uint8_t log_id);
+static void Mounted(uint8_t log_id);
+static uint16_t NextSector(uint8_t log_id, uint16_t sector);
+static BOOL_TYPE IsErased(const EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE* header);
+static uint16_t GetRecordCrc(const EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE* header, const uint8_t* payload);
+static void ExecuteCallBack(uint8_t log_id, EXTERNAL_FLASH_LOG_EVENT_TYPE event);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Binds the logs to their External Flash instances, to be called after ExternalFlash__Initialize
+ * @details The logs are unmounted, ExternalFlashLog__Mount or ExternalFlashLog__Format make them usable.
+ */
+void ExternalFlashLog__Initialize(void)
+{
+    BOOL_TYPE shared;
+
+    // Initialize callback structure
+    Callback__Initialize(&ExternalFlashLog_Callback_Control_Structure);
+
+    // Start periodic handler task
+    ExternalFlashLog_Handler_Index = SystemTimers__CreateTask("ExternalFlashLog__Handler", &ExternalFlashLog__Handler, EXTERNAL_FLASH_LOG_HANDLER_PERIOD_MS, TIMER_MS, FALSE );
+
+    SYS_ASSERT(ExternalFlashLog_Handler_Index != INVALID_VALUE_8);
+
+    memset(ExternalFlashLog_Store, 0x00, sizeof(ExternalFlashLog_Store));
+
+    for(uint8_t log_id = 0; log_id < EXTERNAL_FLASH_LOG_NUM; log_id++)
+    {
+        EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+
+        SYS_ASSERT((ExternalFlashLog_Map[log_id].Region_Address % EXTERNAL_FLASH_LOG_SECTOR_SIZE) == 0);
+        SYS_ASSERT((ExternalFlashLog_Map[log_id].Region_Size % EXTERNAL_FLASH_LOG_SECTOR_SIZE) == 0);
+        SYS_ASSERT(ExternalFlashLog_Map[log_id].Region_Size >= (2 * EXTERNAL_FLASH_LOG_SECTOR_SIZE));
+
+        // Shared instance of the channel, see ExternalFlash.h
+        log->Instance = ExternalFlash__GetAllocation(ExternalFlashLog_Map[log_id].ExternalFlash_Channel, NULL, 0);
+        SYS_ASSERT(log->Instance < EXTERNAL_FLASH_CH_NUM);
+
+        shared = FALSE;
+        for(uint8_t other_id = 0; other_id < log_id; other_id++)
+        {
+            if(ExternalFlashLog_Store[other_id].Instance == log->Instance)
+            {
+                shared = TRUE;
+            }
+        }
+        if(shared == FALSE)
+        {
+            ExternalFlash__RegisterEventHandler(&ExternalFlashEventHandler, log->Instance, CALLBACK_FILTER_VALUE_NONE);
+        }
+
+        log->State = EXTERNAL_FLASH_LOG_STATE_UNMOUNTED;
+        log->Sector_Num = (uint16_t)(ExternalFlashLog_Map[log_id].Region_Size / EXTERNAL_FLASH_LOG_SECTOR_SIZE);
+        log->Request = EXTERNAL_FLASH_LOG_REQUEST_NONE;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the External Flash requests rejected while their instance was busy
+ */
+void ExternalFlashLog__Handler(void)
+{
+    for(uint8_t log_id = 0; log_id < EXTERNAL_FLASH_LOG_NUM; log_id++)
+    {
+        Process(log_id);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Locates head and tail of a log, then erases the sector after the head
+ * @details The erase is repeated at every mount because an erase interrupted by a reset cannot be told from its
+ *          first header. Reads: the first header of sector 0 (and of the last sector if sector 0 is erased), log2 of
+ *          the sector number headers for the search, one header for the tail and the head sector up to its end.
+ *          Notifies EXTERNAL_FLASH_LOG_EVENT_MOUNTED.
+ * @param   log_id: log index in EXTERNAL_FLASH_LOG_MAP
+ * @return  TRUE if the mount was started, FALSE if the log is busy
+ */
+BOOL_TYPE ExternalFlashLog__Mount(uint8_t log_id)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((log_id < EXTERNAL_FLASH_LOG_NUM) &&
+       ((ExternalFlashLog_Store[log_id].State == EXTERNAL_FLASH_LOG_STATE_UNMOUNTED) || (ExternalFlashLog_Store[log_id].State == EXTERNAL_FLASH_LOG_STATE_IDLE)))
+    {
+        ExternalFlashLog_Store[log_id].State = EXTERNAL_FLASH_LOG_STATE_MOUNT_FIRST;
+        Request(log_id, EXTERNAL_FLASH_LOG_OPERATION_READ, 0, 0, ExternalFlashLog_Store[log_id].Scratch, sizeof(EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE));
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Erases the whole region of a log and mounts it empty
+ * @details Needed before the first mount of a region not known to be erased. Notifies EXTERNAL_FLASH_LOG_EVENT_MOUNTED.
+ * @param   log_id: log index in EXTERNAL_FLASH_LOG_MAP
+ * @return  TRUE if the format was started, FALSE if the log is busy
+ */
+BOOL_TYPE ExternalFlashLog__Format(uint8_t log_id)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((log_id < EXTERNAL_FLASH_LOG_NUM) &&
+       ((ExternalFlashLog_Store[log_id].State == EXTERNAL_FLASH_LOG_STATE_UNMOUNTED) || (ExternalFlashLog_Store[log_id].State == EXTERNAL_FLASH_LOG_STATE_IDLE)))
+    {
+        ExternalFlashLog_Store[log_id].State = EXTERNAL_FLASH_LOG_STATE_FORMAT;
+        ExternalFlashLog_Store[log_id].Search_Sector = 0;
+        Request(log_id, EXTERNAL_FLASH_LOG_OPERATION_ERASE, 0, 0, NULL, EXTERNAL_FLASH_LOG_SECTOR_SIZE);
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Appends a record at the head of a log
+ * @details The record is programmed into erased space, one page program if header and payload fit in
+ *          EXTERNAL_FLASH_LOG_SCRATCH_SIZE, two otherwise. When the record does not fit in the head sector the head
+ *          moves to the next sector and, after the record, the sector after it is erased, dropping the oldest sector if
+ *          the region is full. Notifies EXTERNAL_FLASH_LOG_EVENT_APPENDED once the record is programmed.
+ * @param   log_id: log index in EXTERNAL_FLASH_LOG_MAP
+ * @param   record: payload, must stay valid until the APPENDED event
+ * @param   size: payload bytes, up to EXTERNAL_FLASH_LOG_MAX_RECORD_SIZE
+ * @return  TRUE if the append was started, FALSE if the log is not mounted or busy or the record is too large
+ */
+BOOL_TYPE ExternalFlashLog__Append(uint8_t log_id, void* record, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+    EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE header;
+
+    if((log_id < EXTERNAL_FLASH_LOG_NUM) &&
+       (ExternalFlashLog_Store[log_id].State == EXTERNAL_FLASH_LOG_STATE_IDLE) &&
+       (size <= EXTERNAL_FLASH_LOG_MAX_RECORD_SIZE))
+    {
+        EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+        uint16_t record_size = sizeof(EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE) + size;
+
+        // Records do not cross sectors, the next sector is already erased
+        log->Erase_Ahead = FALSE;
+        if((EXTERNAL_FLASH_LOG_SECTOR_SIZE - log->Head.Offset) < record_size)
+        {
+            log->Head.Sector = NextSector(log_id, log->Head.Sector);
+            log->Head.Offset = 0;
+            log->Erase_Ahead = TRUE;
+        }
+
+        log->Record_Position = log->Head;
+        log->Record_Sequence = log->Next_Sequence;
+        log->Record_Length = size;
+
+        header.Sequence = log->Next_Sequence;
+        header.Length = size;
+        header.Crc = GetRecordCrc(&header, (const uint8_t*)record);
+        memcpy(log->Scratch, &header, sizeof(header));
+
+        log->Client_Buffer = (uint8_t*)record;
+        log->Client_Size = size;
+
+        if(record_size <= EXTERNAL_FLASH_LOG_SCRATCH_SIZE)
+        {
+            memcpy(&log->Scratch[sizeof(header)], record, size);
+            log->State = EXTERNAL_FLASH_LOG_STATE_APPEND;
+            Request(log_id, EXTERNAL_FLASH_LOG_OPERATION_PROGRAM, log->Head.Sector, log->Head.Offset, log->Scratch, record_size);
+        }
+        else
+        {
+            log->State = EXTERNAL_FLASH_LOG_STATE_APPEND_HEADER;
+            Request(log_id, EXTERNAL_FLASH_LOG_OPERATION_PROGRAM, log->Head.Sector, log->Head.Offset, log->Scratch, sizeof(header));
+        }
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Moves the read cursor of a log to its oldest record
+ * @param   log_id: log index in EXTERNAL_FLASH_LOG_MAP
+ * @return  TRUE if done, FALSE if the log is not mounted or busy
+ */
+BOOL_TYPE ExternalFlashLog__Rewind(uint8_t log_id)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((log_id < EXTERNAL_FLASH_LOG_NUM) &&
+       (ExternalFlashLog_Store[log_id].State == EXTERNAL_FLASH_LOG_STATE_IDLE))
+    {
+        ExternalFlashLog_Store[log_id].Cursor.Sector = ExternalFlashLog_Store[log_id].Tail_Sector;
+        ExternalFlashLog_Store[log_id].Cursor.Offset = 0;
+        ExternalFlashLog_Store[log_id].Cursor_Sequence = EXTERNAL_FLASH_LOG_SEQUENCE_ERASED;
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Moves the read cursor of a log to a record position given by ExternalFlashLog__GetRecordInfo
+ * @details The next ExternalFlashLog__ReadNext reads from the position: the caller checks, with the sequence number of
+ *          the record read, that the record there is still the one it was given the position of.
+ * @param   log_id: log index in EXTERNAL_FLASH_LOG_MAP
+ * @param   position: record position in the region
+ * @return  TRUE if done, FALSE if the log is not mounted or busy or the position is not between the oldest sector and
+ *          the head
+ */
+BOOL_TYPE ExternalFlashLog__Seek(uint8_t log_id, uint32_t position)
+{
+    BOOL_TYPE success = FALSE;
+    EXTERNAL_FLASH_LOG_POSITION_TYPE record;
+
+    if((log_id < EXTERNAL_FLASH_LOG_NUM) &&
+       (ExternalFlashLog_Store[log_id].State == EXTERNAL_FLASH_LOG_STATE_IDLE) &&
+       (position < ExternalFlashLog_Map[log_id].Region_Size))
+    {
+        EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+
+        record.Sector = (uint16_t)(position / EXTERNAL_FLASH_LOG_SECTOR_SIZE);
+        record.Offset = (uint16_t)(position % EXTERNAL_FLASH_LOG_SECTOR_SIZE);
+
+        if((((record.Sector + log->Sector_Num - log->Tail_Sector) % log->Sector_Num) <
+            ((log->Head.Sector + log->Sector_Num - log->Tail_Sector) % log->Sector_Num)) ||
+           ((record.Sector == log->Head.Sector) && (record.Offset < log->Head.Offset)))
+        {
+            log->Cursor = record;
+            log->Cursor_Sequence = EXTERNAL_FLASH_LOG_SEQUENCE_ERASED;
+            success = TRUE;
+        }
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the record at the read cursor of a log and moves the cursor to the next one
+ * @details Notifies EXTERNAL_FLASH_LOG_EVENT_RECORD, EXTERNAL_FLASH_LOG_EVENT_CORRUPT if the record fails its CRC, or
+ *          EXTERNAL_FLASH_LOG_EVENT_END at the head. A record larger than the buffer is truncated and not checked, its
+ *          length is given by ExternalFlashLog__GetRecordInfo. Sectors closed by an interrupted append are skipped.
+ * @param   log_id: log index in EXTERNAL_FLASH_LOG_MAP
+ * @param   buffer: payload destination, must stay valid until the event
+ * @param   size: buffer size
+ * @return  TRUE if the read was started, FALSE if the log is not mounted or busy
+ */
+BOOL_TYPE ExternalFlashLog__ReadNext(uint8_t log_id, void* buffer, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((log_id < EXTERNAL_FLASH_LOG_NUM) &&
+       (ExternalFlashLog_Store[log_id].State == EXTERNAL_FLASH_LOG_STATE_IDLE))
+    {
+        ExternalFlashLog_Store[log_id].Client_Buffer = (uint8_t*)buffer;
+        ExternalFlashLog_Store[log_id].Client_Size = size;
+        ExternalFlashLog_Store[log_id].Read_Random = FALSE;
+        StartReadHeader(log_id);
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the record at a position given by ExternalFlashLog__GetRecordInfo, the read cursor is not moved
+ * @details Notifies EXTERNAL_FLASH_LOG_EVENT_RECORD, or EXTERNAL_FLASH_LOG_EVENT_CORRUPT if the record fails its CRC or
+ *          there is no record at the position (dropped with its sector). Truncation as ExternalFlashLog__ReadNext.
+ * @param   log_id: log index in EXTERNAL_FLASH_LOG_MAP
+ * @param   position: record position in the region
+ * @param   buffer: payload destination, must stay valid until the event
+ * @param   size: buffer size
+ * @return  TRUE if the read was started, FALSE if the log is not mounted or busy or the position is out of the region
+ */
+BOOL_TYPE ExternalFlashLog__ReadRecord(uint8_t log_id, uint32_t position, void* buffer, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+    EXTERNAL_FLASH_LOG_POSITION_TYPE record;
+
+    if((log_id < EXTERNAL_FLASH_LOG_NUM) &&
+       (ExternalFlashLog_Store[log_id].State == EXTERNAL_FLASH_LOG_STATE_IDLE) &&
+       (position < ExternalFlashLog_Map[log_id].Region_Size) &&
+       ((position % EXTERNAL_FLASH_LOG_SECTOR_SIZE) <= (EXTERNAL_FLASH_LOG_SECTOR_SIZE - EXTERNAL_FLASH_LOG_HEADER_SIZE)))
+    {
+        record.Sector = (uint16_t)(position / EXTERNAL_FLASH_LOG_SECTOR_SIZE);
+        record.Offset = (uint16_t)(position % EXTERNAL_FLASH_LOG_SECTOR_SIZE);
+
+        ExternalFlashLog_Store[log_id].Client_Buffer = (uint8_t*)buffer;
+        ExternalFlashLog_Store[log_id].Client_Size = size;
+        ExternalFlashLog_Store[log_id].Read_Random = TRUE;
+        ReadHeaderAt(log_id, record);
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gives sequence number, full payload length and position of the last record appended or read
+ * @param   log_id: log index in EXTERNAL_FLASH_LOG_MAP
+ * @param   sequence: record sequence number
+ * @param   length: record payload length
+ * @param   position: record position in the region, for ExternalFlashLog__ReadRecord
+ * @return  TRUE if valid log
+ */
+BOOL_TYPE ExternalFlashLog__GetRecordInfo(uint8_t log_id, uint32_t* sequence, uint16_t* length, uint32_t* position)
+{
+    BOOL_TYPE success = FALSE;
+
+    if(log_id < EXTERNAL_FLASH_LOG_NUM)
+    {
+        *sequence = ExternalFlashLog_Store[log_id].Record_Sequence;
+        *length = ExternalFlashLog_Store[log_id].Record_Length;
+        *position = ((uint32_t)ExternalFlashLog_Store[log_id].Record_Position.Sector * EXTERNAL_FLASH_LOG_SECTOR_SIZE) +
+                    ExternalFlashLog_Store[log_id].Record_Position.Offset;
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gives the space state of a mounted log
+ * @param   log_id: log index in EXTERNAL_FLASH_LOG_MAP
+ * @param   info: log info
+ * @return  TRUE if valid log
+ */
+BOOL_TYPE ExternalFlashLog__GetInfo(uint8_t log_id, EXTERNAL_FLASH_LOG_INFO_TYPE* info)
+{
+    BOOL_TYPE success = FALSE;
+
+    if(log_id < EXTERNAL_FLASH_LOG_NUM)
+    {
+        EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+
+        info->Sector_Num = log->Sector_Num;
+        // The head can move this many times before the erase ahead reaches the tail sector
+        info->Free_Sectors = (uint16_t)((log->Tail_Sector + (2 * log->Sector_Num) - log->Head.Sector - 2) % log->Sector_Num);
+        info->Read_Sectors = (uint16_t)((log->Cursor.Sector + log->Sector_Num - log->Tail_Sector) % log->Sector_Num);
+        info->Next_Sequence = log->Next_Sequence;
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gives the sequence number of the next record appended to a mounted log
+ * @param   log_id: log index in EXTERNAL_FLASH_LOG_MAP
+ * @return  sequence number, EXTERNAL_FLASH_LOG_SEQUENCE_ERASED if invalid log
+ */
+uint32_t ExternalFlashLog__GetNextSequence(uint8_t log_id)
+{
+    uint32_t sequence = EXTERNAL_FLASH_LOG_SEQUENCE_ERASED;
+
+    if(log_id < EXTERNAL_FLASH_LOG_NUM)
+    {
+        sequence = ExternalFlashLog_Store[log_id].Next_Sequence;
+    }
+
+    return sequence;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Tells if a log has an operation in progress
+ * @param   log_id: log index in EXTERNAL_FLASH_LOG_MAP
+ * @return  TRUE if busy or invalid log
+ */
+BOOL_TYPE ExternalFlashLog__IsBusy(uint8_t log_id)
+{
+    BOOL_TYPE busy = TRUE;
+
+    if((log_id < EXTERNAL_FLASH_LOG_NUM) &&
+       ((ExternalFlashLog_Store[log_id].State == EXTERNAL_FLASH_LOG_STATE_UNMOUNTED) || (ExternalFlashLog_Store[log_id].State == EXTERNAL_FLASH_LOG_STATE_IDLE)))
+    {
+        busy = FALSE;
+    }
+
+    return busy;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Registers event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlashLog__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value)
+{
+    Callback__Register(&ExternalFlashLog_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler, filter_id, filter_value);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Unregisters event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlashLog__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler)
+{
+    Callback__Unregister(&ExternalFlashLog_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler);
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+/**
+ * @brief   External Flash event handler: completes the request of the log owning the instance and chains the next one
+ * @param   event: External Flash callback event
+ */
+static void ExternalFlashEventHandler(CALLBACK_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE nv_event;
+
+    memcpy(&nv_event, &event, sizeof(CALLBACK_EVENT_TYPE));
+
+    for(uint8_t log_id = 0; log_id < EXTERNAL_FLASH_LOG_NUM; log_id++)
+    {
+        if((ExternalFlashLog_Store[log_id].Instance == nv_event.Source_Instance_Id) &&
+           (ExternalFlashLog_Store[log_id].Request == EXTERNAL_FLASH_LOG_REQUEST_WAIT))
+        {
+            ExternalFlashLog_Store[log_id].Request = EXTERNAL_FLASH_LOG_REQUEST_DONE;
+            Process(log_id);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Advances the log state machine over completed requests and starts the pending one
+ * @param   log_id: log index
+ */
+static void Process(uint8_t log_id)
+{
+    EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+    BOOL_TYPE started = FALSE;
+
+    // Completing a step may complete the next one without External Flash access, or start a new operation from the
+    // client callback
+    while(log->Request == EXTERNAL_FLASH_LOG_REQUEST_DONE)
+    {
+        log->Request = EXTERNAL_FLASH_LOG_REQUEST_NONE;
+        Advance(log_id);
+    }
+
+    if(log->Request == EXTERNAL_FLASH_LOG_REQUEST_PENDING)
+    {
+        switch(log->Request_Operation)
+        {
+          case EXTERNAL_FLASH_LOG_OPERATION_READ:
+            started = ExternalFlash__Read(log->Instance, log->Request_Buffer, log->Request_Address, log->Request_Size);
+            break;
+
+          case EXTERNAL_FLASH_LOG_OPERATION_PROGRAM:
+            started = ExternalFlash__Program(log->Instance, log->Request_Buffer, log->Request_Address, log->Request_Size);
+            break;
+
+          case EXTERNAL_FLASH_LOG_OPERATION_ERASE:
+          default:
+            started = ExternalFlash__Erase(log->Instance, log->Request_Address, log->Request_Size);
+            break;
+        }
+
+        if(started == TRUE)
+        {
+            log->Request = EXTERNAL_FLASH_LOG_REQUEST_WAIT;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Log state machine, called when the request of the current state is done
+ * @param   log_id: log index
+ */
+static void Advance(uint8_t log_id)
+{
+    EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+    EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE header;
+
+    memcpy(&header, log->Scratch, sizeof(header));
+
+    switch(log->State)
+    {
+      case EXTERNAL_FLASH_LOG_STATE_MOUNT_FIRST:
+        if(IsErased(&header) == TRUE)
+        {
+            // Either empty, or the head just wrapped and sector 0 is the erased one
+            log->State = EXTERNAL_FLASH_LOG_STATE_MOUNT_LAST;
+            Request(log_id, EXTERNAL_FLASH_LOG_OPERATION_READ, log->Sector_Num - 1, 0, log->Scratch, sizeof(header));
+        }
+        else
+        {
+            // The newest sector is the last one whose first sequence is not older than the one of sector 0
+            log->First_Sequence = header.Sequence;
+            log->Search_Low = 0;
+            log->Search_High = log->Sector_Num;
+            StartSearchStep(log_id);
+        }
+        break;
+
+      case EXTERNAL_FLASH_LOG_STATE_MOUNT_LAST:
+        log->First_Sequence = EXTERNAL_FLASH_LOG_SEQUENCE_ERASED;
+        if(IsErased(&header) == TRUE)
+        {
+            // Empty log
+            log->Head.Sector = 0;
+            log->Head.Offset = 0;
+            log->Next_Sequence = 0;
+            log->Tail_Sector = 0;
+            StartEraseAhead(log_id, EXTERNAL_FLASH_LOG_STATE_MOUNT_ERASE);
+        }
+        else
+        {
+            log->Head.Sector = log->Sector_Num - 1;
+            StartTail(log_id);
+        }
+        break;
+
+      case EXTERNAL_FLASH_LOG_STATE_MOUNT_SEARCH:
+        if((IsErased(&header) == FALSE) && (header.Sequence >= log->First_Sequence))
+        {
+            log->Search_Low = log->Search_Sector;
+        }
+        else
+        {
+            log->Search_High = log->Search_Sector;
+        }
+        StartSearchStep(log_id);
+        break;
+
+      case EXTERNAL_FLASH_LOG_STATE_MOUNT_TAIL:
+        if(IsErased(&header) == FALSE)
+        {
+            // Wrapped: the oldest sector follows the erased one
+            log->Tail_Sector = log->Search_Sector;
+        }
+        else
+        {
+            // Not wrapped yet
+            log->Tail_Sector = (log->First_Sequence != EXTERNAL_FLASH_LOG_SEQUENCE_ERASED) ? 0 : log->Head.Sector;
+        }
+        log->Scan_Offset = 0;
+        log->Next_Sequence = EXTERNAL_FLASH_LOG_SEQUENCE_ERASED;
+        StartScanChunk(log_id);
+        break;
+
+      case EXTERNAL_FLASH_LOG_STATE_MOUNT_SCAN:
+        ScanChunk(log_id);
+        break;
+
+      case EXTERNAL_FLASH_LOG_STATE_MOUNT_ERASE:
+        Mounted(log_id);
+        break;
+
+      case EXTERNAL_FLASH_LOG_STATE_FORMAT:
+        log->Search_Sector++;
+        if(log->Search_Sector < log->Sector_Num)
+        {
+            Request(log_id, EXTERNAL_FLASH_LOG_OPERATION_ERASE, log->Search_Sector, 0, NULL, EXTERNAL_FLASH_LOG_SECTOR_SIZE);
+        }
+        else
+        {
+            log->Head.Sector = 0;
+            log->Head.Offset = 0;
+            log->Next_Sequence = 0;
+            log->Tail_Sector = 0;
+            Mounted(log_id);
+        }
+        break;
+
+      case EXTERNAL_FLASH_LOG_STATE_APPEND_HEADER:
+        log->State = EXTERNAL_FLASH_LOG_STATE_APPEND;
+        Request(log_id, EXTERNAL_FLASH_LOG_OPERATION_PROGRAM, log->Head.Sector, log->Head.Offset + sizeof(header), log->Client_Buffer, log->Client_Size);
+        break;
+
+      case EXTERNAL_FLASH_LOG_STATE_APPEND:
+        log->Head.Offset += sizeof(header) + log->Client_Size;
+        log->Next_Sequence++;
+        if(log->Erase_Ahead == TRUE)
+        {
+            StartEraseAhead(log_id, EXTERNAL_FLASH_LOG_STATE_ERASE_AHEAD);
+        }
+        else
+        {
+            log->State = EXTERNAL_FLASH_LOG_STATE_IDLE;
+        }
+        ExecuteCallBack(log_id, EXTERNAL_FLASH_LOG_EVENT_APPENDED);
+        break;
+
+      case EXTERNAL_FLASH_LOG_STATE_ERASE_AHEAD:
+        log->State = EXTERNAL_FLASH_LOG_STATE_IDLE;
+        break;
+
+      case EXTERNAL_FLASH_LOG_STATE_READ_HEADER:
+        ReadHeader(log_id);
+        break;
+
+      case EXTERNAL_FLASH_LOG_STATE_READ_PAYLOAD:
+        ReadPayload(log_id);
+        break;
+
+      case EXTERNAL_FLASH_LOG_STATE_READ_END:
+        log->State = EXTERNAL_FLASH_LOG_STATE_IDLE;
+        ExecuteCallBack(log_id, EXTERNAL_FLASH_LOG_EVENT_END);
+        break;
+
+      case EXTERNAL_FLASH_LOG_STATE_UNMOUNTED:
+      case EXTERNAL_FLASH_LOG_STATE_IDLE:
+      default:
+        break;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Sets the External Flash request of the current state, started now or by the handler
+ * @param   log_id: log index
+ * @param   operation: External Flash operation
+ * @param   sector: sector index in the region
+ * @param   offset: offset in the sector
+ * @param   buffer: data buffer, NULL for erases
+ * @param   size: bytes
+ */
+static void Request(uint8_t log_id, EXTERNAL_FLASH_LOG_OPERATION_TYPE operation, uint16_t sector, uint16_t offset, void* buffer, uint16_t size)
+{
+    EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+
+    log->Request_Operation = operation;
+    log->Request_Address = ExternalFlashLog_Map[log_id].Region_Address + ((uint32_t)sector * EXTERNAL_FLASH_LOG_SECTOR_SIZE) + offset;
+    log->Request_Buffer = buffer;
+    log->Request_Size = size;
+    log->Request = EXTERNAL_FLASH_LOG_REQUEST_PENDING;
+
+    SystemTimers__ResumeTask(ExternalFlashLog_Handler_Index);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Completes the current state without External Flash access, advanced by Process
+ * @param   log_id: log index
+ */
+static void RequestDone(uint8_t log_id)
+{
+    ExternalFlashLog_Store[log_id].Request = EXTERNAL_FLASH_LOG_REQUEST_DONE;
+
+    SystemTimers__ResumeTask(ExternalFlashLog_Handler_Index);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the first header of the middle sector of the search range, or ends the search
+ * @param   log_id: log index
+ */
+static void StartSearchStep(uint8_t log_id)
+{
+    EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+
+    if((log->Search_High - log->Search_Low) > 1)
+    {
+        log->Search_Sector = log->Search_Low + ((log->Search_High - log->Search_Low) / 2);
+        log->State = EXTERNAL_FLASH_LOG_STATE_MOUNT_SEARCH;
+        Request(log_id, EXTERNAL_FLASH_LOG_OPERATION_READ, log->Search_Sector, 0, log->Scratch, sizeof(EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE));
+    }
+    else
+    {
+        log->Head.Sector = log->Search_Low;
+        StartTail(log_id);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the first header of the sector after the erased one, the tail if the log has wrapped
+ * @param   log_id: log index
+ */
+static void StartTail(uint8_t log_id)
+{
+    EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+
+    log->Search_Sector = NextSector(log_id, NextSector(log_id, log->Head.Sector));
+    log->State = EXTERNAL_FLASH_LOG_STATE_MOUNT_TAIL;
+
+    if(log->Search_Sector == log->Head.Sector)
+    {
+        // Two sectors region: the head sector is the only one holding records
+        memset(log->Scratch, 0xFF, sizeof(EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE));
+        log->First_Sequence = EXTERNAL_FLASH_LOG_SEQUENCE_ERASED;
+        RequestDone(log_id);
+    }
+    else
+    {
+        Request(log_id, EXTERNAL_FLASH_LOG_OPERATION_READ, log->Search_Sector, 0, log->Scratch, sizeof(EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE));
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the head sector from the scan offset into the scratch buffer
+ * @param   log_id: log index
+ */
+static void StartScanChunk(uint8_t log_id)
+{
+    EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+    uint16_t size = EXTERNAL_FLASH_LOG_SECTOR_SIZE - log->Scan_Offset;
+
+    if(size > EXTERNAL_FLASH_LOG_SCRATCH_SIZE)
+    {
+        size = EXTERNAL_FLASH_LOG_SCRATCH_SIZE;
+    }
+
+    log->Chunk_Offset = log->Scan_Offset;
+    log->State = EXTERNAL_FLASH_LOG_STATE_MOUNT_SCAN;
+    Request(log_id, EXTERNAL_FLASH_LOG_OPERATION_READ, log->Head.Sector, log->Scan_Offset, log->Scratch, size);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Walks the headers in the scratch buffer to find the append position of the head sector
+ * @details Payloads are skipped, not read. A header that is neither erased nor the next record (interrupted append)
+ *          closes the sector: the next append goes to the next sector.
+ * @param   log_id: log index
+ */
+static void ScanChunk(uint8_t log_id)
+{
+    EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+    EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE header;
+    uint16_t chunk_end = log->Request_Size + log->Chunk_Offset;
+    BOOL_TYPE done = FALSE;
+
+    while((done == FALSE) && ((log->Scan_Offset + sizeof(header)) <= chunk_end))
+    {
+        memcpy(&header, &log->Scratch[log->Scan_Offset - log->Chunk_Offset], sizeof(header));
+
+        if(IsErased(&header) == TRUE)
+        {
+            done = TRUE;
+        }
+        else if(((log->Next_Sequence == EXTERNAL_FLASH_LOG_SEQUENCE_ERASED) || (header.Sequence == log->Next_Sequence)) &&
+                (header.Length <= (EXTERNAL_FLASH_LOG_SECTOR_SIZE - log->Scan_Offset - sizeof(header))))
+        {
+            log->Next_Sequence = header.Sequence + 1;
+            log->Scan_Offset += sizeof(header) + header.Length;
+        }
+        else
+        {
+            // Keep the sequence increasing even if the first record of the sector is the broken one
+            if(log->Next_Sequence == EXTERNAL_FLASH_LOG_SEQUENCE_ERASED)
+            {
+                log->Next_Sequence = header.Sequence + 1;
+            }
+            log->Scan_Offset = EXTERNAL_FLASH_LOG_SECTOR_SIZE;
+            done = TRUE;
+        }
+    }
+
+    if((done == FALSE) && ((log->Scan_Offset + sizeof(header)) <= EXTERNAL_FLASH_LOG_SECTOR_SIZE))
+    {
+        StartScanChunk(log_id);
+    }
+    else
+    {
+        log->Head.Offset = log->Scan_Offset;
+        if(log->Next_Sequence == EXTERNAL_FLASH_LOG_SEQUENCE_ERASED)
+        {
+            log->Next_Sequence = 0;
+        }
+        StartEraseAhead(log_id, EXTERNAL_FLASH_LOG_STATE_MOUNT_ERASE);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Erases the sector after the head sector, moving the tail and the read cursor off it
+ * @param   log_id: log index
+ * @param   state: state waiting for the erase
+ */
+static void StartEraseAhead(uint8_t log_id, EXTERNAL_FLASH_LOG_STATE_TYPE state)
+{
+    EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+    uint16_t sector = NextSector(log_id, log->Head.Sector);
+
+    if(log->Tail_Sector == sector)
+    {
+        log->Tail_Sector = NextSector(log_id, sector);
+    }
+    if(log->Cursor.Sector == sector)
+    {
+        log->Cursor.Sector = log->Tail_Sector;
+        log->Cursor.Offset = 0;
+        log->Cursor_Sequence = EXTERNAL_FLASH_LOG_SEQUENCE_ERASED;
+    }
+
+    log->State = state;
+    Request(log_id, EXTERNAL_FLASH_LOG_OPERATION_ERASE, sector, 0, NULL, EXTERNAL_FLASH_LOG_SECTOR_SIZE);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the header at the read cursor, or ends the read at the head
+ * @param   log_id: log index
+ */
+static void StartReadHeader(uint8_t log_id)
+{
+    EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+
+    // Skip the end of a sector too short for a record
+    if(((log->Cursor.Sector != log->Head.Sector) || (log->Cursor.Offset != log->Head.Offset)) &&
+       ((log->Cursor.Offset + sizeof(EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE)) > EXTERNAL_FLASH_LOG_SECTOR_SIZE))
+    {
+        log->Cursor.Sector = NextSector(log_id, log->Cursor.Sector);
+        log->Cursor.Offset = 0;
+    }
+
+    if((log->Cursor.Sector == log->Head.Sector) && (log->Cursor.Offset >= log->Head.Offset))
+    {
+        log->State = EXTERNAL_FLASH_LOG_STATE_READ_END;
+        RequestDone(log_id);
+    }
+    else
+    {
+        ReadHeaderAt(log_id, log->Cursor);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the record header at a position
+ * @param   log_id: log index
+ * @param   position: record position
+ */
+static void ReadHeaderAt(uint8_t log_id, EXTERNAL_FLASH_LOG_POSITION_TYPE position)
+{
+    EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+
+    log->Record_Position = position;
+    log->State = EXTERNAL_FLASH_LOG_STATE_READ_HEADER;
+    Request(log_id, EXTERNAL_FLASH_LOG_OPERATION_READ, position.Sector, position.Offset, log->Scratch, sizeof(EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Checks the header read and reads its payload, or moves the read cursor to the next sector
+ * @param   log_id: log index
+ */
+static void ReadHeader(uint8_t log_id)
+{
+    EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+    EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE header;
+    uint16_t size;
+
+    memcpy(&header, log->Scratch, sizeof(header));
+
+    if((log->Read_Random == TRUE) &&
+       ((IsErased(&header) == TRUE) || (header.Length > (EXTERNAL_FLASH_LOG_SECTOR_SIZE - log->Record_Position.Offset - sizeof(header)))))
+    {
+        // No record at the position
+        log->State = EXTERNAL_FLASH_LOG_STATE_IDLE;
+        ExecuteCallBack(log_id, EXTERNAL_FLASH_LOG_EVENT_CORRUPT);
+    }
+    else if((log->Read_Random == FALSE) &&
+            ((IsErased(&header) == TRUE) ||
+             ((log->Cursor_Sequence != EXTERNAL_FLASH_LOG_SEQUENCE_ERASED) && (header.Sequence != log->Cursor_Sequence)) ||
+             (header.Length > (EXTERNAL_FLASH_LOG_SECTOR_SIZE - log->Cursor.Offset - sizeof(header)))))
+    {
+        // End of the records of a full or closed sector, the head sector has none after the head
+        if(log->Cursor.Sector == log->Head.Sector)
+        {
+            log->Cursor = log->Head;
+        }
+        else
+        {
+            log->Cursor.Sector = NextSector(log_id, log->Cursor.Sector);
+            log->Cursor.Offset = 0;
+        }
+        StartReadHeader(log_id);
+    }
+    else
+    {
+        log->Record_Sequence = header.Sequence;
+        log->Record_Length = header.Length;
+
+        size = (header.Length < log->Client_Size) ? header.Length : log->Client_Size;
+        log->State = EXTERNAL_FLASH_LOG_STATE_READ_PAYLOAD;
+        if(size > 0)
+        {
+            Request(log_id, EXTERNAL_FLASH_LOG_OPERATION_READ, log->Record_Position.Sector, log->Record_Position.Offset + sizeof(header), log->Client_Buffer, size);
+        }
+        else
+        {
+            RequestDone(log_id);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Checks the payload read, moves the read cursor past a record read in sequence and notifies the client
+ * @param   log_id: log index
+ */
+static void ReadPayload(uint8_t log_id)
+{
+    EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+    EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE header;
+    EXTERNAL_FLASH_LOG_EVENT_TYPE event = EXTERNAL_FLASH_LOG_EVENT_RECORD;
+
+    memcpy(&header, log->Scratch, sizeof(header));
+
+    if((header.Length <= log->Client_Size) && (GetRecordCrc(&header, log->Client_Buffer) != header.Crc))
+    {
+        event = EXTERNAL_FLASH_LOG_EVENT_CORRUPT;
+    }
+
+    if(log->Read_Random == FALSE)
+    {
+        log->Cursor.Offset += sizeof(header) + header.Length;
+        log->Cursor_Sequence = header.Sequence + 1;
+    }
+    log->State = EXTERNAL_FLASH_LOG_STATE_IDLE;
+
+    ExecuteCallBack(log_id, event);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Ends mount and format: rewinds the read cursor and notifies the client
+ * @param   log_id: log index
+ */
+static void Mounted(uint8_t log_id)
+{
+    EXTERNAL_FLASH_LOG_STORE_TYPE* log = &ExternalFlashLog_Store[log_id];
+
+    log->State = EXTERNAL_FLASH_LOG_STATE_IDLE;
+    log->Cursor.Sector = log->Tail_Sector;
+    log->Cursor.Offset = 0;
+    log->Cursor_Sequence = EXTERNAL_FLASH_LOG_SEQUENCE_ERASED;
+
+    ExecuteCallBack(log_id, EXTERNAL_FLASH_LOG_EVENT_MOUNTED);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Next sector of a log region, wrapping at its end
+ * @param   log_id: log index
+ * @param   sector: sector index
+ * @return  next sector index
+ */
+static uint16_t NextSector(uint8_t log_id, uint16_t sector)
+{
+    sector++;
+    if(sector >= ExternalFlashLog_Store[log_id].Sector_Num)
+    {
+        sector = 0;
+    }
+    return sector;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Tells if a record header is erased
+ * @param   header: record header
+ * @return  TRUE if all its bytes are 0xFF
+ */
+static BOOL_TYPE IsErased(const EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE* header)
+{
+    BOOL_TYPE erased = FALSE;
+
+    if((header->Sequence == EXTERNAL_FLASH_LOG_SEQUENCE_ERASED) && (header->Length == INVALID_VALUE_16) && (header->Crc == INVALID_VALUE_16))
+    {
+        erased = TRUE;
+    }
+
+    return erased;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   CRC of a record: header without its Crc field, then payload
+ * @param   header: record header
+ * @param   payload: Length payload bytes
+ * @return  record CRC, low 16 bits of the CRC-32
+ */
+static uint16_t GetRecordCrc(const EXTERNAL_FLASH_LOG_RECORD_HEADER_TYPE* header, const uint8_t* payload)
+{
+    uint32_t crc = ExternalFlash__GetCrc(0, header, sizeof(*header) - sizeof(header->Crc));
+
+    return (uint16_t)ExternalFlash__GetCrc(crc, payload, header->Length);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Notifies a log event to the registered handlers
+ * @param   log_id: log index, source instance of the event
+ * @param   event: EXTERNAL_FLASH_LOG_EVENT_TYPE, event value
+ */
+static void ExecuteCallBack(uint8_t log_id, EXTERNAL_FLASH_LOG_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE data;
+    CALLBACK_EVENT_TYPE callback_event;
+
+    data.Generic_Provider_Id = GENERIC_NVDATA_EXTERNAL_FLASH;
+    data.Source_Instance_Id = log_id;
+    data.Event_Value = (uint16_t)event;
+
+    memcpy(&callback_event, ((uint32_t*)(&data)), sizeof(CALLBACK_EVENT_TYPE));
+
+    Callback__Notify(&ExternalFlashLog_Callback_Control_Structure, callback_event, log_id, NULL);
+}
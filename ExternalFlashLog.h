@@ -0,0 +1,90 @@
+/**
+ *  @file       ExternalFlashLog.h
+ *
+ *  @brief      Append-only circular logs over regions of External Flash instances.
+ *  @details    Each log declared in EXTERNAL_FLASH_LOG_MAP (ExternalFlashLog_prv.h) owns the External Flash instance of
+ *              its client channel and a region of the device, split in sectors of EXTERNAL_FLASH_LOG_SECTOR_SIZE.
+ *              Records (header with sequence number, length and CRC, then the payload) are programmed back to back
+ *              into erased space with ExternalFlash__Program, so an append costs only the bytes written. Records do not
+ *              cross sectors: when the head sector is full the head moves to the next sector, which is always erased,
+ *              and the sector after it is erased ahead, dropping the oldest sector once the region is full.
+ *
+ *              Mount locates the head sector with a binary search on the sequence numbers of the sector first
+ *              records, then scans only the head sector for the append position.
+ *
+ *              All operations are asynchronous: they return FALSE if the log is busy and their completion is notified
+ *              to the registered event handlers, with the log id as source instance and an EXTERNAL_FLASH_LOG_EVENT_TYPE
+ *              as event value.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+#ifndef EXTERNALFLASHLOG_H_
+#define EXTERNALFLASHLOG_H_
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "C_Extensions.h"
+#include "Callback.h"
+#include "ExternalFlash.h"
+#include "ExternalFlashLog_prv.h"
+
+//-------------------------------------- PUBLIC (Variables, Constants & Defines) --------------------------------------
+
+//! Log sector size, the erase unit of the logs: a multiple of the External Flash block size
+#ifndef EXTERNAL_FLASH_LOG_SECTOR_SIZE
+#define EXTERNAL_FLASH_LOG_SECTOR_SIZE              (2048)
+#endif
+
+//! Per log RAM buffer used by mount scans and to program small records in a single page program
+#ifndef EXTERNAL_FLASH_LOG_SCRATCH_SIZE
+#define EXTERNAL_FLASH_LOG_SCRATCH_SIZE             (256)
+#endif
+
+//! Handler task period
+#ifndef EXTERNAL_FLASH_LOG_HANDLER_PERIOD_MS
+#define EXTERNAL_FLASH_LOG_HANDLER_PERIOD_MS        EXTERNAL_FLASH_HANDLER_PERIOD_MS
+#endif
+
+//! Record header size and largest record payload
+#define EXTERNAL_FLASH_LOG_HEADER_SIZE              (8)
+#define EXTERNAL_FLASH_LOG_MAX_RECORD_SIZE          (EXTERNAL_FLASH_LOG_SECTOR_SIZE - EXTERNAL_FLASH_LOG_HEADER_SIZE)
+
+//! Log space info struct type
+typedef struct EXTERNAL_FLASH_LOG_INFO_STRUCT
+{
+    uint16_t                    Sector_Num;
+    uint16_t                    Free_Sectors;               // Sectors the head can move to before the oldest sector is dropped
+    uint16_t                    Read_Sectors;               // Sectors from the oldest one to the read cursor sector
+    uint32_t                    Next_Sequence;
+} EXTERNAL_FLASH_LOG_INFO_TYPE;
+
+//! Log events, notified as event value
+typedef enum EXTERNAL_FLASH_LOG_EVENT_ENUM
+{
+    EXTERNAL_FLASH_LOG_EVENT_MOUNTED,                       // Mount or format completed, the log accepts appends
+    EXTERNAL_FLASH_LOG_EVENT_APPENDED,                      // Record programmed, see ExternalFlashLog__GetRecordInfo
+    EXTERNAL_FLASH_LOG_EVENT_RECORD,                        // Record read, see ExternalFlashLog__GetRecordInfo
+    EXTERNAL_FLASH_LOG_EVENT_CORRUPT,                       // Record read failing its CRC (interrupted append), or no record
+    EXTERNAL_FLASH_LOG_EVENT_END,                           // ReadNext reached the head, no record read
+    EXTERNAL_FLASH_LOG_EVENT_NUM
+} EXTERNAL_FLASH_LOG_EVENT_TYPE;
+
+//-------------------------------------- PUBLIC (Function Prototypes) -------------------------------------------------
+
+void ExternalFlashLog__Initialize(void);
+void ExternalFlashLog__Handler(void);
+BOOL_TYPE ExternalFlashLog__Mount(uint8_t log_id);
+BOOL_TYPE ExternalFlashLog__Format(uint8_t log_id);
+BOOL_TYPE ExternalFlashLog__Append(uint8_t log_id, void* record, uint16_t size);
+BOOL_TYPE ExternalFlashLog__Rewind(uint8_t log_id);
+BOOL_TYPE ExternalFlashLog__Seek(uint8_t log_id, uint32_t position);
+BOOL_TYPE ExternalFlashLog__ReadNext(uint8_t log_id, void* buffer, uint16_t size);
+BOOL_TYPE ExternalFlashLog__ReadRecord(uint8_t log_id, uint32_t position, void* buffer, uint16_t size);
+BOOL_TYPE ExternalFlashLog__GetRecordInfo(uint8_t log_id, uint32_t* sequence, uint16_t* length, uint32_t* position);
+BOOL_TYPE ExternalFlashLog__GetInfo(uint8_t log_id, EXTERNAL_FLASH_LOG_INFO_TYPE* info);
+uint32_t ExternalFlashLog__GetNextSequence(uint8_t log_id);
+BOOL_TYPE ExternalFlashLog__IsBusy(uint8_t log_id);
+void ExternalFlashLog__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value);
+void ExternalFlashLog__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler);
+
+#endif /* EXTERNALFLASHLOG_H_ */
@@ -0,0 +1,734 @@
+/**
+ *  @file       ExternalFlashQueue.c
+ *
+ *  @brief      Persistent FIFO queues over External Flash logs.
+ *  @details    Elements are log records, in enqueue order. The log read cursor is kept past the last element read:
+ *              a peek reads the record at the cursor, skipping records failing their check, and a peek repeated without
+ *              dequeue moves the cursor back to the element peeked first.
+ *
+ *              Read pointer record: EXTERNAL_FLASH_QUEUE_POINTER_TYPE. Mount moves the cursor to the position of the
+ *              pointer and reads the record there again: if it still has the sequence number of the pointer the cursor
+ *              is past it, the next element; otherwise the log has dropped its sector, all the elements before the
+ *              oldest one kept were dequeued, and the cursor is rewound to the oldest record.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashQueue.h"
+#include "ExternalFlashQueue_prv.h"
+#include "ExternalFlashLog.h"
+#include "ExternalFlashRecord.h"
+
+#include "Callback.h"
+#include "CommonInterface.h"
+
+#include "SystemTimers.h"
+#include "Utilities.h"
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Define the callback control structure module static variable
+DEFINE_CALLBACK_CONTROL_STRUCTURE(ExternalFlashQueue_Callback_Control_Structure, EXTERNAL_FLASH_QUEUE_CALLBACK_REGISTERS_SIZE);
+
+//! Queue Map struct type
+typedef struct EXTERNAL_FLASH_QUEUE_MAP_STRUCT
+{
+    uint8_t                     Log_Id;                     // External Flash log of the elements, owned by the queue
+    uint8_t                     Record_Id;                  // External Flash record of the read pointer, owned by the queue
+} EXTERNAL_FLASH_QUEUE_MAP_TYPE;
+
+//! Queue Configuration Map
+static const EXTERNAL_FLASH_QUEUE_MAP_TYPE ExternalFlashQueue_Map[] = EXTERNAL_FLASH_QUEUE_MAP;
+
+#define EXTERNAL_FLASH_QUEUE_NUM                ELEMENTS_IN_ARRAY(ExternalFlashQueue_Map)
+
+//! Read pointer position when no element was dequeued
+#define EXTERNAL_FLASH_QUEUE_POSITION_NONE      INVALID_VALUE_32
+
+//! Read pointer
+typedef __PACKED_STRUCT EXTERNAL_FLASH_QUEUE_POINTER_STRUCT
+{
+    uint32_t                    Position;                   // Last element dequeued, EXTERNAL_FLASH_QUEUE_POSITION_NONE if none
+    uint32_t                    Sequence;                   // Its sequence number
+} EXTERNAL_FLASH_QUEUE_POINTER_TYPE;
+
+//! Queue states
+typedef enum EXTERNAL_FLASH_QUEUE_STATE_ENUM
+{
+    EXTERNAL_FLASH_QUEUE_STATE_UNMOUNTED,
+    EXTERNAL_FLASH_QUEUE_STATE_IDLE,
+    EXTERNAL_FLASH_QUEUE_STATE_MOUNT,                       // Mounting the log
+    EXTERNAL_FLASH_QUEUE_STATE_MOUNT_POINTER,               // Mounting the read pointer record
+    EXTERNAL_FLASH_QUEUE_STATE_LOAD_POINTER,                // Reading the read pointer
+    EXTERNAL_FLASH_QUEUE_STATE_REPLAY,                      // Reading the last element dequeued again
+    EXTERNAL_FLASH_QUEUE_STATE_FORMAT_POINTER_MOUNT,        // Mounting the read pointer record before clearing it
+    EXTERNAL_FLASH_QUEUE_STATE_FORMAT_POINTER,              // Clearing the read pointer
+    EXTERNAL_FLASH_QUEUE_STATE_FORMAT,                      // Formatting the log
+    EXTERNAL_FLASH_QUEUE_STATE_ENQUEUE,                     // Appending an element
+    EXTERNAL_FLASH_QUEUE_STATE_PEEK,                        // Reading the element at the cursor
+    EXTERNAL_FLASH_QUEUE_STATE_COMMIT,                      // Writing the read pointer
+} EXTERNAL_FLASH_QUEUE_STATE_TYPE;
+
+//! Queue struct type
+typedef struct EXTERNAL_FLASH_QUEUE_STORE_STRUCT
+{
+    EXTERNAL_FLASH_QUEUE_STATE_TYPE State;
+    BOOL_TYPE                   Pending;                    // Log or record call of the state to be (re)started by the handler
+    BOOL_TYPE                   Peeked;                     // An element was peeked and not dequeued
+    uint32_t                    Peek_Position;              // Element peeked
+    uint32_t                    Peek_Sequence;
+    uint16_t                    Peek_Length;
+    uint32_t                    Last_Position;              // Last element dequeued, EXTERNAL_FLASH_QUEUE_POSITION_NONE if none
+    uint32_t                    Last_Sequence;
+    uint16_t                    Dequeues;                   // Dequeues since the last commit
+    uint8_t*                    Client_Buffer;
+    uint16_t                    Client_Size;
+    EXTERNAL_FLASH_QUEUE_POINTER_TYPE Pointer;              // Read pointer being read or written
+} EXTERNAL_FLASH_QUEUE_STORE_TYPE;
+
+static EXTERNAL_FLASH_QUEUE_STORE_TYPE ExternalFlashQueue_Store[EXTERNAL_FLASH_QUEUE_NUM];
+
+//! Queue Task Handler Index
+static uint8_t ExternalFlashQueue_Handler_Index = INVALID_VALUE_8;
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void LogEventHandler(CALLBACK_EVENT_TYPE event);
+static void RecordEventHandler(CALLBACK_EVENT_TYPE event);
+static void AdvanceLog(uint8_t queue_id, EXTERNAL_FLASH_LOG_EVENT_TYPE event);
+static void AdvanceRecord(uint8_t queue_id, EXTERNAL_FLASH_RECORD_EVENT_TYPE event);
+static void StartStep(uint8_t queue_id, EXTERNAL_FLASH_QUEUE_STATE_TYPE state);
+static void Issue(uint8_t queue_id);
+static void StartCommit(uint8_t queue_id);
+static void Mounted(uint8_t queue_id, BOOL_TYPE rewind);
+static void ExecuteCallBack(uint8_t queue_id, EXTERNAL_FLASH_QUEUE_EVENT_TYPE event);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Initializes the queues, to be called after ExternalFlashLog__Initialize and ExternalFlashRecord__Initialize
+ * @details The queues are unmounted, ExternalFlashQueue__Mount or ExternalFlashQueue__Format make them usable.
+ */
+void ExternalFlashQueue__Initialize(void)
+{
+    // Initialize callback structure
+    Callback__Initialize(&ExternalFlashQueue_Callback_Control_Structure);
+
+    // Start periodic handler task
+    ExternalFlashQueue_Handler_Index = SystemTimers__CreateTask("ExternalFlashQueue__Handler", &ExternalFlashQueue__Handler, EXTERNAL_FLASH_QUEUE_HANDLER_PERIOD_MS, TIMER_MS, FALSE );
+
+    SYS_ASSERT(ExternalFlashQueue_Handler_Index != INVALID_VALUE_8);
+    SYS_ASSERT(sizeof(EXTERNAL_FLASH_QUEUE_POINTER_TYPE) == EXTERNAL_FLASH_QUEUE_POINTER_SIZE);
+
+    memset(ExternalFlashQueue_Store, 0x00, sizeof(ExternalFlashQueue_Store));
+
+    for(uint8_t queue_id = 0; queue_id < EXTERNAL_FLASH_QUEUE_NUM; queue_id++)
+    {
+        ExternalFlashLog__RegisterEventHandler(&LogEventHandler, ExternalFlashQueue_Map[queue_id].Log_Id, CALLBACK_FILTER_VALUE_NONE);
+        ExternalFlashRecord__RegisterEventHandler(&RecordEventHandler, ExternalFlashQueue_Map[queue_id].Record_Id, CALLBACK_FILTER_VALUE_NONE);
+
+        ExternalFlashQueue_Store[queue_id].State = EXTERNAL_FLASH_QUEUE_STATE_UNMOUNTED;
+        ExternalFlashQueue_Store[queue_id].Last_Position = EXTERNAL_FLASH_QUEUE_POSITION_NONE;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Restarts the log and record calls rejected while they were busy, and writes the read pointer of the queues
+ *          dequeued EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL times since the last commit
+ */
+void ExternalFlashQueue__Handler(void)
+{
+    for(uint8_t queue_id = 0; queue_id < EXTERNAL_FLASH_QUEUE_NUM; queue_id++)
+    {
+        if(ExternalFlashQueue_Store[queue_id].Pending == TRUE)
+        {
+            Issue(queue_id);
+        }
+        else if((ExternalFlashQueue_Store[queue_id].State == EXTERNAL_FLASH_QUEUE_STATE_IDLE) &&
+                (ExternalFlashQueue_Store[queue_id].Dequeues >= EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL))
+        {
+            StartCommit(queue_id);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Mounts the log and the read pointer record of a queue and moves the log read cursor to the first element
+ *          not dequeued
+ * @details Notifies EXTERNAL_FLASH_QUEUE_EVENT_MOUNTED. The elements dequeued after the last commit are delivered again.
+ * @param   queue_id: queue index in EXTERNAL_FLASH_QUEUE_MAP
+ * @return  TRUE if the mount was started, FALSE if the queue is busy
+ */
+BOOL_TYPE ExternalFlashQueue__Mount(uint8_t queue_id)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((queue_id < EXTERNAL_FLASH_QUEUE_NUM) &&
+       ((ExternalFlashQueue_Store[queue_id].State == EXTERNAL_FLASH_QUEUE_STATE_UNMOUNTED) || (ExternalFlashQueue_Store[queue_id].State == EXTERNAL_FLASH_QUEUE_STATE_IDLE)))
+    {
+        ExternalFlashQueue_Store[queue_id].Peeked = FALSE;
+        StartStep(queue_id, EXTERNAL_FLASH_QUEUE_STATE_MOUNT);
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Empties a queue, leaving it mounted
+ * @details The read pointer is cleared first, so that an interrupted format never leaves a read pointer over the new
+ *          log. Notifies EXTERNAL_FLASH_QUEUE_EVENT_MOUNTED.
+ * @param   queue_id: queue index in EXTERNAL_FLASH_QUEUE_MAP
+ * @return  TRUE if the format was started, FALSE if the queue is busy
+ */
+BOOL_TYPE ExternalFlashQueue__Format(uint8_t queue_id)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((queue_id < EXTERNAL_FLASH_QUEUE_NUM) &&
+       ((ExternalFlashQueue_Store[queue_id].State == EXTERNAL_FLASH_QUEUE_STATE_UNMOUNTED) || (ExternalFlashQueue_Store[queue_id].State == EXTERNAL_FLASH_QUEUE_STATE_IDLE)))
+    {
+        ExternalFlashQueue_Store[queue_id].Peeked = FALSE;
+        StartStep(queue_id, EXTERNAL_FLASH_QUEUE_STATE_FORMAT_POINTER_MOUNT);
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Appends an element at the tail of a queue
+ * @details Notifies EXTERNAL_FLASH_QUEUE_EVENT_ENQUEUED once the element is programmed.
+ * @param   queue_id: queue index in EXTERNAL_FLASH_QUEUE_MAP
+ * @param   element: data, must stay valid until the event
+ * @param   size: data bytes, up to EXTERNAL_FLASH_QUEUE_MAX_ELEMENT_SIZE
+ * @return  TRUE if the enqueue was started, FALSE if the queue is not mounted or busy, the element is too large or
+ *          the log has no room for it until elements are dequeued
+ */
+BOOL_TYPE ExternalFlashQueue__Enqueue(uint8_t queue_id, void* element, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+    EXTERNAL_FLASH_LOG_INFO_TYPE info;
+
+    if((queue_id < EXTERNAL_FLASH_QUEUE_NUM) &&
+       (ExternalFlashQueue_Store[queue_id].State == EXTERNAL_FLASH_QUEUE_STATE_IDLE) &&
+       (size <= EXTERNAL_FLASH_QUEUE_MAX_ELEMENT_SIZE))
+    {
+        ExternalFlashLog__GetInfo(ExternalFlashQueue_Map[queue_id].Log_Id, &info);
+
+        // The log must not drop the sector of the read cursor, nor the one before it if it holds the element peeked
+        if((info.Free_Sectors + info.Read_Sectors) > ((ExternalFlashQueue_Store[queue_id].Peeked == TRUE) ? 1 : 0))
+        {
+            ExternalFlashQueue_Store[queue_id].Client_Buffer = (uint8_t*)element;
+            ExternalFlashQueue_Store[queue_id].Client_Size = size;
+            StartStep(queue_id, EXTERNAL_FLASH_QUEUE_STATE_ENQUEUE);
+            success = TRUE;
+        }
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the element at the head of a queue, without removing it
+ * @details Notifies EXTERNAL_FLASH_QUEUE_EVENT_PEEKED, or EXTERNAL_FLASH_QUEUE_EVENT_EMPTY. Elements failing their check
+ *          (interrupted enqueues) are skipped. An element larger than the buffer is truncated and not checked,
+ *          ExternalFlashQueue__GetLength gives its length.
+ * @param   queue_id: queue index in EXTERNAL_FLASH_QUEUE_MAP
+ * @param   buffer: element destination, must stay valid until the event
+ * @param   size: buffer size
+ * @return  TRUE if the peek was started, FALSE if the queue is not mounted or busy
+ */
+BOOL_TYPE ExternalFlashQueue__Peek(uint8_t queue_id, void* buffer, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((queue_id < EXTERNAL_FLASH_QUEUE_NUM) &&
+       (ExternalFlashQueue_Store[queue_id].State == EXTERNAL_FLASH_QUEUE_STATE_IDLE))
+    {
+        ExternalFlashQueue_Store[queue_id].Client_Buffer = (uint8_t*)buffer;
+        ExternalFlashQueue_Store[queue_id].Client_Size = size;
+        StartStep(queue_id, EXTERNAL_FLASH_QUEUE_STATE_PEEK);
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Removes the element peeked from the head of a queue
+ * @details Moves the read pointer in RAM only. Every EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL dequeues the read pointer
+ *          is written, making the queue busy until EXTERNAL_FLASH_QUEUE_EVENT_COMMITTED; a dequeue done while the queue
+ *          is busy leaves the write to the handler.
+ * @param   queue_id: queue index in EXTERNAL_FLASH_QUEUE_MAP
+ * @return  TRUE if done, FALSE if no element was peeked since the last dequeue
+ */
+BOOL_TYPE ExternalFlashQueue__Dequeue(uint8_t queue_id)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((queue_id < EXTERNAL_FLASH_QUEUE_NUM) &&
+       (ExternalFlashQueue_Store[queue_id].Peeked == TRUE))
+    {
+        EXTERNAL_FLASH_QUEUE_STORE_TYPE* queue = &ExternalFlashQueue_Store[queue_id];
+
+        queue->Peeked = FALSE;
+        queue->Last_Position = queue->Peek_Position;
+        queue->Last_Sequence = queue->Peek_Sequence;
+        queue->Dequeues++;
+
+        // Started here rather than by the handler, which a client keeping the queue busy would starve
+        if((queue->Dequeues >= EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL) &&
+           (queue->State == EXTERNAL_FLASH_QUEUE_STATE_IDLE))
+        {
+            StartCommit(queue_id);
+        }
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Writes the read pointer of a queue now, so that no element dequeued is delivered again after a reset
+ * @details Notifies EXTERNAL_FLASH_QUEUE_EVENT_COMMITTED.
+ * @param   queue_id: queue index in EXTERNAL_FLASH_QUEUE_MAP
+ * @return  TRUE if the commit was started, FALSE if the queue is not mounted or busy or nothing was dequeued since the
+ *          last commit
+ */
+BOOL_TYPE ExternalFlashQueue__Commit(uint8_t queue_id)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((queue_id < EXTERNAL_FLASH_QUEUE_NUM) &&
+       (ExternalFlashQueue_Store[queue_id].State == EXTERNAL_FLASH_QUEUE_STATE_IDLE) &&
+       (ExternalFlashQueue_Store[queue_id].Dequeues > 0))
+    {
+        StartCommit(queue_id);
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gives the length of the element peeked
+ * @param   queue_id: queue index in EXTERNAL_FLASH_QUEUE_MAP
+ * @return  element bytes, INVALID_VALUE_16 if no element was peeked since the last dequeue
+ */
+uint16_t ExternalFlashQueue__GetLength(uint8_t queue_id)
+{
+    uint16_t length = INVALID_VALUE_16;
+
+    if((queue_id < EXTERNAL_FLASH_QUEUE_NUM) &&
+       (ExternalFlashQueue_Store[queue_id].Peeked == TRUE))
+    {
+        length = ExternalFlashQueue_Store[queue_id].Peek_Length;
+    }
+
+    return length;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Tells if a queue has an operation or a commit in progress
+ * @param   queue_id: queue index in EXTERNAL_FLASH_QUEUE_MAP
+ * @return  TRUE if busy or invalid queue
+ */
+BOOL_TYPE ExternalFlashQueue__IsBusy(uint8_t queue_id)
+{
+    BOOL_TYPE busy = TRUE;
+
+    if((queue_id < EXTERNAL_FLASH_QUEUE_NUM) &&
+       ((ExternalFlashQueue_Store[queue_id].State == EXTERNAL_FLASH_QUEUE_STATE_UNMOUNTED) || (ExternalFlashQueue_Store[queue_id].State == EXTERNAL_FLASH_QUEUE_STATE_IDLE)))
+    {
+        busy = FALSE;
+    }
+
+    return busy;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Registers event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlashQueue__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value)
+{
+    Callback__Register(&ExternalFlashQueue_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler, filter_id, filter_value);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Unregisters event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlashQueue__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler)
+{
+    Callback__Unregister(&ExternalFlashQueue_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler);
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+/**
+ * @brief   Log event handler: advances the queue owning the log
+ * @param   event: log callback event
+ */
+static void LogEventHandler(CALLBACK_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE log_event;
+
+    memcpy(&log_event, &event, sizeof(CALLBACK_EVENT_TYPE));
+
+    for(uint8_t queue_id = 0; queue_id < EXTERNAL_FLASH_QUEUE_NUM; queue_id++)
+    {
+        if((ExternalFlashQueue_Map[queue_id].Log_Id == log_event.Source_Instance_Id) &&
+           (ExternalFlashQueue_Store[queue_id].Pending == FALSE))
+        {
+            AdvanceLog(queue_id, (EXTERNAL_FLASH_LOG_EVENT_TYPE)log_event.Event_Value);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Record event handler: advances the queue owning the record
+ * @param   event: record callback event
+ */
+static void RecordEventHandler(CALLBACK_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE record_event;
+
+    memcpy(&record_event, &event, sizeof(CALLBACK_EVENT_TYPE));
+
+    for(uint8_t queue_id = 0; queue_id < EXTERNAL_FLASH_QUEUE_NUM; queue_id++)
+    {
+        if((ExternalFlashQueue_Map[queue_id].Record_Id == record_event.Source_Instance_Id) &&
+           (ExternalFlashQueue_Store[queue_id].Pending == FALSE))
+        {
+            AdvanceRecord(queue_id, (EXTERNAL_FLASH_RECORD_EVENT_TYPE)record_event.Event_Value);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Queue state machine, called on the completion of the log call of the current state
+ * @param   queue_id: queue index
+ * @param   event: log event
+ */
+static void AdvanceLog(uint8_t queue_id, EXTERNAL_FLASH_LOG_EVENT_TYPE event)
+{
+    EXTERNAL_FLASH_QUEUE_STORE_TYPE* queue = &ExternalFlashQueue_Store[queue_id];
+    uint32_t sequence;
+    uint32_t position;
+    uint16_t length;
+
+    ExternalFlashLog__GetRecordInfo(ExternalFlashQueue_Map[queue_id].Log_Id, &sequence, &length, &position);
+
+    switch(queue->State)
+    {
+      case EXTERNAL_FLASH_QUEUE_STATE_MOUNT:
+        if(event == EXTERNAL_FLASH_LOG_EVENT_MOUNTED)
+        {
+            StartStep(queue_id, EXTERNAL_FLASH_QUEUE_STATE_MOUNT_POINTER);
+        }
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_FORMAT:
+        if(event == EXTERNAL_FLASH_LOG_EVENT_MOUNTED)
+        {
+            Mounted(queue_id, FALSE);
+        }
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_REPLAY:
+        // The cursor is past the last element dequeued if the log still holds it
+        if((event == EXTERNAL_FLASH_LOG_EVENT_RECORD) &&
+           (position == queue->Pointer.Position) && (sequence == queue->Pointer.Sequence))
+        {
+            queue->Last_Position = position;
+            queue->Last_Sequence = sequence;
+            Mounted(queue_id, FALSE);
+        }
+        else
+        {
+            Mounted(queue_id, TRUE);
+        }
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_ENQUEUE:
+        if(event == EXTERNAL_FLASH_LOG_EVENT_APPENDED)
+        {
+            queue->State = EXTERNAL_FLASH_QUEUE_STATE_IDLE;
+            ExecuteCallBack(queue_id, EXTERNAL_FLASH_QUEUE_EVENT_ENQUEUED);
+        }
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_PEEK:
+        if(event == EXTERNAL_FLASH_LOG_EVENT_RECORD)
+        {
+            queue->Peeked = TRUE;
+            queue->Peek_Position = position;
+            queue->Peek_Sequence = sequence;
+            queue->Peek_Length = length;
+            queue->State = EXTERNAL_FLASH_QUEUE_STATE_IDLE;
+            ExecuteCallBack(queue_id, EXTERNAL_FLASH_QUEUE_EVENT_PEEKED);
+        }
+        else if(event == EXTERNAL_FLASH_LOG_EVENT_CORRUPT)
+        {
+            // Interrupted enqueue, never notified to the client
+            StartStep(queue_id, EXTERNAL_FLASH_QUEUE_STATE_PEEK);
+        }
+        else
+        {
+            queue->State = EXTERNAL_FLASH_QUEUE_STATE_IDLE;
+            ExecuteCallBack(queue_id, EXTERNAL_FLASH_QUEUE_EVENT_EMPTY);
+        }
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_UNMOUNTED:
+      case EXTERNAL_FLASH_QUEUE_STATE_IDLE:
+      default:
+        break;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Queue state machine, called on the completion of the record call of the current state
+ * @param   queue_id: queue index
+ * @param   event: record event
+ */
+static void AdvanceRecord(uint8_t queue_id, EXTERNAL_FLASH_RECORD_EVENT_TYPE event)
+{
+    EXTERNAL_FLASH_QUEUE_STORE_TYPE* queue = &ExternalFlashQueue_Store[queue_id];
+    uint8_t log_id = ExternalFlashQueue_Map[queue_id].Log_Id;
+
+    switch(queue->State)
+    {
+      case EXTERNAL_FLASH_QUEUE_STATE_MOUNT_POINTER:
+        if(event == EXTERNAL_FLASH_RECORD_EVENT_MOUNTED)
+        {
+            if(ExternalFlashRecord__GetLength(ExternalFlashQueue_Map[queue_id].Record_Id) == sizeof(EXTERNAL_FLASH_QUEUE_POINTER_TYPE))
+            {
+                StartStep(queue_id, EXTERNAL_FLASH_QUEUE_STATE_LOAD_POINTER);
+            }
+            else
+            {
+                // Nothing was ever committed
+                Mounted(queue_id, TRUE);
+            }
+        }
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_LOAD_POINTER:
+        if(event == EXTERNAL_FLASH_RECORD_EVENT_READ)
+        {
+            if((queue->Pointer.Position != EXTERNAL_FLASH_QUEUE_POSITION_NONE) &&
+               (ExternalFlashLog__Seek(log_id, queue->Pointer.Position) == TRUE))
+            {
+                StartStep(queue_id, EXTERNAL_FLASH_QUEUE_STATE_REPLAY);
+            }
+            else
+            {
+                Mounted(queue_id, TRUE);
+            }
+        }
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_FORMAT_POINTER_MOUNT:
+        if(event == EXTERNAL_FLASH_RECORD_EVENT_MOUNTED)
+        {
+            queue->Pointer.Position = EXTERNAL_FLASH_QUEUE_POSITION_NONE;
+            queue->Pointer.Sequence = 0;
+            StartStep(queue_id, EXTERNAL_FLASH_QUEUE_STATE_FORMAT_POINTER);
+        }
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_FORMAT_POINTER:
+        if(event == EXTERNAL_FLASH_RECORD_EVENT_WRITTEN)
+        {
+            StartStep(queue_id, EXTERNAL_FLASH_QUEUE_STATE_FORMAT);
+        }
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_COMMIT:
+        if(event == EXTERNAL_FLASH_RECORD_EVENT_WRITTEN)
+        {
+            queue->State = EXTERNAL_FLASH_QUEUE_STATE_IDLE;
+            ExecuteCallBack(queue_id, EXTERNAL_FLASH_QUEUE_EVENT_COMMITTED);
+        }
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_UNMOUNTED:
+      case EXTERNAL_FLASH_QUEUE_STATE_IDLE:
+      default:
+        break;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Enters a state and starts its log or record call
+ * @param   queue_id: queue index
+ * @param   state: new state
+ */
+static void StartStep(uint8_t queue_id, EXTERNAL_FLASH_QUEUE_STATE_TYPE state)
+{
+    ExternalFlashQueue_Store[queue_id].State = state;
+    ExternalFlashQueue_Store[queue_id].Pending = TRUE;
+
+    Issue(queue_id);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the log or record call of the current state, left pending for the handler if busy
+ * @param   queue_id: queue index
+ */
+static void Issue(uint8_t queue_id)
+{
+    EXTERNAL_FLASH_QUEUE_STORE_TYPE* queue = &ExternalFlashQueue_Store[queue_id];
+    uint8_t log_id = ExternalFlashQueue_Map[queue_id].Log_Id;
+    uint8_t record_id = ExternalFlashQueue_Map[queue_id].Record_Id;
+    BOOL_TYPE started = FALSE;
+
+    queue->Pending = FALSE;
+
+    switch(queue->State)
+    {
+      case EXTERNAL_FLASH_QUEUE_STATE_MOUNT:
+        started = ExternalFlashLog__Mount(log_id);
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_MOUNT_POINTER:
+      case EXTERNAL_FLASH_QUEUE_STATE_FORMAT_POINTER_MOUNT:
+        started = ExternalFlashRecord__Mount(record_id);
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_LOAD_POINTER:
+        started = ExternalFlashRecord__Read(record_id, &queue->Pointer, sizeof(queue->Pointer));
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_REPLAY:
+        // Header only, the sequence number identifies the element
+        started = ExternalFlashLog__ReadNext(log_id, &queue->Pointer, 0);
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_FORMAT_POINTER:
+      case EXTERNAL_FLASH_QUEUE_STATE_COMMIT:
+        started = ExternalFlashRecord__Write(record_id, &queue->Pointer, sizeof(queue->Pointer));
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_FORMAT:
+        started = ExternalFlashLog__Format(log_id);
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_ENQUEUE:
+        started = ExternalFlashLog__Append(log_id, queue->Client_Buffer, queue->Client_Size);
+        break;
+
+      case EXTERNAL_FLASH_QUEUE_STATE_PEEK:
+        // The log can still be erasing after an append, the cursor is moved only once it is idle
+        if(ExternalFlashLog__IsBusy(log_id) == FALSE)
+        {
+            // Read again the element peeked and not dequeued, the oldest one if the log has dropped it
+            if((queue->Peeked == TRUE) &&
+               (ExternalFlashLog__Seek(log_id, queue->Peek_Position) == FALSE))
+            {
+                ExternalFlashLog__Rewind(log_id);
+            }
+            queue->Peeked = FALSE;
+            started = ExternalFlashLog__ReadNext(log_id, queue->Client_Buffer, queue->Client_Size);
+        }
+        break;
+
+      default:
+        started = TRUE;
+        break;
+    }
+
+    if(started == FALSE)
+    {
+        queue->Pending = TRUE;
+        SystemTimers__ResumeTask(ExternalFlashQueue_Handler_Index);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Writes the read pointer at the last element dequeued
+ * @details Elements dequeued while the write is in progress are left for the next commit.
+ * @param   queue_id: queue index
+ */
+static void StartCommit(uint8_t queue_id)
+{
+    EXTERNAL_FLASH_QUEUE_STORE_TYPE* queue = &ExternalFlashQueue_Store[queue_id];
+
+    queue->Pointer.Position = queue->Last_Position;
+    queue->Pointer.Sequence = queue->Last_Sequence;
+    queue->Dequeues = 0;
+    StartStep(queue_id, EXTERNAL_FLASH_QUEUE_STATE_COMMIT);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Ends mount and format and notifies the client
+ * @param   queue_id: queue index
+ * @param   rewind: TRUE to deliver the log from its oldest record, no valid read pointer being found
+ */
+static void Mounted(uint8_t queue_id, BOOL_TYPE rewind)
+{
+    EXTERNAL_FLASH_QUEUE_STORE_TYPE* queue = &ExternalFlashQueue_Store[queue_id];
+
+    if(rewind == TRUE)
+    {
+        ExternalFlashLog__Rewind(ExternalFlashQueue_Map[queue_id].Log_Id);
+    }
+    if((rewind == TRUE) || (queue->State == EXTERNAL_FLASH_QUEUE_STATE_FORMAT))
+    {
+        queue->Last_Position = EXTERNAL_FLASH_QUEUE_POSITION_NONE;
+        queue->Last_Sequence = 0;
+    }
+    queue->Dequeues = 0;
+    queue->State = EXTERNAL_FLASH_QUEUE_STATE_IDLE;
+    ExecuteCallBack(queue_id, EXTERNAL_FLASH_QUEUE_EVENT_MOUNTED);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Notifies a queue event to the registered handlers
+ * @param   queue_id: queue index, source instance of the event
+ * @param   event: EXTERNAL_FLASH_QUEUE_EVENT_TYPE, event value
+ */
+static void ExecuteCallBack(uint8_t queue_id, EXTERNAL_FLASH_QUEUE_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE data;
+    CALLBACK_EVENT_TYPE callback_event;
+
+    data.Generic_Provider_Id = GENERIC_NVDATA_EXTERNAL_FLASH;
+    data.Source_Instance_Id = queue_id;
+    data.Event_Value = (uint16_t)event;
+
+    memcpy(&callback_event, ((uint32_t*)(&data)), sizeof(CALLBACK_EVENT_TYPE));
+
+    Callback__Notify(&ExternalFlashQueue_Callback_Control_Structure, callback_event, queue_id, NULL);
+}
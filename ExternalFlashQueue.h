@@ -0,0 +1,78 @@
+/**
+ *  @file       ExternalFlashQueue.h
+ *
+ *  @brief      Persistent FIFO queues over External Flash logs.
+ *  @details    Each queue declared in EXTERNAL_FLASH_QUEUE_MAP (ExternalFlashQueue_prv.h) owns an External Flash log
+ *              holding its elements and an External Flash record holding its read pointer, the position and sequence
+ *              number of the last element dequeued. An enqueue is a log append, programmed into erased space; a peek
+ *              reads the oldest element not dequeued; a dequeue only moves the read pointer in RAM. Neither rewrites
+ *              the elements, and the log erases its oldest sector only when it needs the room.
+ *
+ *              The read pointer is written to its record every EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL dequeues, or by
+ *              ExternalFlashQueue__Commit. After a reset the elements dequeued since the last commit are delivered
+ *              again: delivery is at least once, and the commit interval bounds the duplicates.
+ *
+ *              An enqueue is refused while the log would have to drop a sector holding elements not dequeued yet.
+ *
+ *              All operations but dequeue are asynchronous: they return FALSE if the queue is busy and their completion
+ *              is notified to the registered event handlers, with the queue id as source instance and an
+ *              EXTERNAL_FLASH_QUEUE_EVENT_TYPE as event value.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+#ifndef EXTERNALFLASHQUEUE_H_
+#define EXTERNALFLASHQUEUE_H_
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "C_Extensions.h"
+#include "Callback.h"
+#include "ExternalFlashLog.h"
+#include "ExternalFlashRecord.h"
+#include "ExternalFlashQueue_prv.h"
+
+//-------------------------------------- PUBLIC (Variables, Constants & Defines) --------------------------------------
+
+//! Dequeues after which the read pointer is written
+#ifndef EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL
+#define EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL        (16)
+#endif
+
+//! Handler task period
+#ifndef EXTERNAL_FLASH_QUEUE_HANDLER_PERIOD_MS
+#define EXTERNAL_FLASH_QUEUE_HANDLER_PERIOD_MS      EXTERNAL_FLASH_LOG_HANDLER_PERIOD_MS
+#endif
+
+//! Read pointer size, the Record_Size of the record of a queue must be at least this
+#define EXTERNAL_FLASH_QUEUE_POINTER_SIZE           (8)
+
+//! Largest element
+#define EXTERNAL_FLASH_QUEUE_MAX_ELEMENT_SIZE       EXTERNAL_FLASH_LOG_MAX_RECORD_SIZE
+
+//! Queue events, notified as event value
+typedef enum EXTERNAL_FLASH_QUEUE_EVENT_ENUM
+{
+    EXTERNAL_FLASH_QUEUE_EVENT_MOUNTED,                     // Mount or format completed
+    EXTERNAL_FLASH_QUEUE_EVENT_ENQUEUED,                    // Enqueue programmed
+    EXTERNAL_FLASH_QUEUE_EVENT_PEEKED,                      // Peek completed, element in the client buffer
+    EXTERNAL_FLASH_QUEUE_EVENT_EMPTY,                       // Peek found no element
+    EXTERNAL_FLASH_QUEUE_EVENT_COMMITTED,                   // Read pointer written
+    EXTERNAL_FLASH_QUEUE_EVENT_NUM
+} EXTERNAL_FLASH_QUEUE_EVENT_TYPE;
+
+//-------------------------------------- PUBLIC (Function Prototypes) -------------------------------------------------
+
+void ExternalFlashQueue__Initialize(void);
+void ExternalFlashQueue__Handler(void);
+BOOL_TYPE ExternalFlashQueue__Mount(uint8_t queue_id);
+BOOL_TYPE ExternalFlashQueue__Format(uint8_t queue_id);
+BOOL_TYPE ExternalFlashQueue__Enqueue(uint8_t queue_id, void* element, uint16_t size);
+BOOL_TYPE ExternalFlashQueue__Peek(uint8_t queue_id, void* buffer, uint16_t size);
+BOOL_TYPE ExternalFlashQueue__Dequeue(uint8_t queue_id);
+BOOL_TYPE ExternalFlashQueue__Commit(uint8_t queue_id);
+uint16_t ExternalFlashQueue__GetLength(uint8_t queue_id);
+BOOL_TYPE ExternalFlashQueue__IsBusy(uint8_t queue_id);
+void ExternalFlashQueue__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value);
+void ExternalFlashQueue__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler);
+
+#endif /* EXTERNALFLASHQUEUE_H_ */
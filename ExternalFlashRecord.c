@@ -0,0 +1,676 @@
+/**
+ *  @file       ExternalFlashRecord.c
+ *
+ *  @brief      Records written atomically into two alternating External Flash slots.
+ *  @details    Slot layout: EXTERNAL_FLASH_RECORD_HEADER_TYPE, then the record data. A write first writes the data past
+ *              the first page of the slot, then the first page with header and data head: until this last write is
+ *              programmed the slot keeps its previous header, whose CRC no longer matches the data, or holds a torn
+ *              page. A slot holding a record two writes old with its data untouched still passes its CRC, but the
+ *              current record has a newer sequence number.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashRecord.h"
+#include "ExternalFlashRecord_prv.h"
+#include "ExternalFlash.h"
+
+#include "Callback.h"
+#include "CommonInterface.h"
+
+#include "SystemTimers.h"
+#include "Utilities.h"
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Define the callback control structure module static variable
+DEFINE_CALLBACK_CONTROL_STRUCTURE(ExternalFlashRecord_Callback_Control_Structure, EXTERNAL_FLASH_RECORD_CALLBACK_REGISTERS_SIZE);
+
+//! Record Map struct type
+typedef struct EXTERNAL_FLASH_RECORD_MAP_STRUCT
+{
+    EXTERNAL_FLASH_CH_TYPE      ExternalFlash_Channel;      // Client channel of the External Flash instance, owned by the record
+    uint32_t                    Address;                    // Device address, page aligned
+    uint16_t                    Record_Size;                // Largest record, two slots of EXTERNAL_FLASH_RECORD_SLOT_SIZE(Record_Size) are used
+} EXTERNAL_FLASH_RECORD_MAP_TYPE;
+
+//! Record Configuration Map
+static const EXTERNAL_FLASH_RECORD_MAP_TYPE ExternalFlashRecord_Map[] = EXTERNAL_FLASH_RECORD_MAP;
+
+#define EXTERNAL_FLASH_RECORD_NUM               ELEMENTS_IN_ARRAY(ExternalFlashRecord_Map)
+
+//! Commit header, at the start of the slot
+typedef __PACKED_STRUCT EXTERNAL_FLASH_RECORD_HEADER_STRUCT
+{
+    uint32_t                    Sequence;
+    uint16_t                    Length;                     // Data bytes
+    uint16_t                    Crc;                        // Low 16 bits of the CRC-32 of Sequence, Length and data
+} EXTERNAL_FLASH_RECORD_HEADER_TYPE;
+
+//! Sequence number of an erased header
+#define EXTERNAL_FLASH_RECORD_SEQUENCE_ERASED   INVALID_VALUE_32
+
+//! Data bytes in the first page of a slot
+#define EXTERNAL_FLASH_RECORD_FIRST_DATA_SIZE   (EXTERNAL_FLASH_RECORD_PAGE_SIZE - EXTERNAL_FLASH_RECORD_HEADER_SIZE)
+
+//! Slots of a record
+#define EXTERNAL_FLASH_RECORD_SLOTS             (2)
+#define EXTERNAL_FLASH_RECORD_SLOT_NONE         INVALID_VALUE_8
+
+//! Record states
+typedef enum EXTERNAL_FLASH_RECORD_STATE_ENUM
+{
+    EXTERNAL_FLASH_RECORD_STATE_UNMOUNTED,
+    EXTERNAL_FLASH_RECORD_STATE_IDLE,
+    EXTERNAL_FLASH_RECORD_STATE_MOUNT_PAGE,                 // Reading the first page of a slot
+    EXTERNAL_FLASH_RECORD_STATE_MOUNT_DATA,                 // Reading the rest of its data for the CRC
+    EXTERNAL_FLASH_RECORD_STATE_READ,
+    EXTERNAL_FLASH_RECORD_STATE_WRITE_DATA,                 // Writing the data past the first page
+    EXTERNAL_FLASH_RECORD_STATE_WRITE_COMMIT,               // Writing the first page, with the header
+    EXTERNAL_FLASH_RECORD_STATE_WRITE_FLUSH                 // Programming the combined writes
+} EXTERNAL_FLASH_RECORD_STATE_TYPE;
+
+//! External Flash request of a record
+typedef enum EXTERNAL_FLASH_RECORD_REQUEST_ENUM
+{
+    EXTERNAL_FLASH_RECORD_REQUEST_NONE,
+    EXTERNAL_FLASH_RECORD_REQUEST_PENDING,                  // To be started, retried by the handler while the instance is busy
+    EXTERNAL_FLASH_RECORD_REQUEST_WAIT,                     // Started, waiting for the External Flash event
+    EXTERNAL_FLASH_RECORD_REQUEST_DONE                      // Completed, the state machine advances
+} EXTERNAL_FLASH_RECORD_REQUEST_TYPE;
+
+//! External Flash operations used by the records
+typedef enum EXTERNAL_FLASH_RECORD_OPERATION_ENUM
+{
+    EXTERNAL_FLASH_RECORD_OPERATION_READ,
+    EXTERNAL_FLASH_RECORD_OPERATION_WRITE,
+    EXTERNAL_FLASH_RECORD_OPERATION_FLUSH
+} EXTERNAL_FLASH_RECORD_OPERATION_TYPE;
+
+//! Record store struct type
+typedef struct EXTERNAL_FLASH_RECORD_STORE_STRUCT
+{
+    uint8_t                     Instance;                   // External Flash instance
+    EXTERNAL_FLASH_RECORD_STATE_TYPE State;
+
+    uint8_t                     Slot;                       // Slot of the current record, EXTERNAL_FLASH_RECORD_SLOT_NONE if none
+    uint32_t                    Sequence;                   // Sequence number of the current record
+    uint16_t                    Length;                     // Data bytes of the current record
+
+    uint8_t                     Target_Slot;                // Slot being mounted or written
+    EXTERNAL_FLASH_RECORD_HEADER_TYPE Header;               // Header of the slot being mounted or written
+    uint16_t                    Progress;                   // Mount: data bytes in the CRC
+    uint32_t                    Crc;
+
+    uint8_t*                    Client_Buffer;
+    uint16_t                    Client_Size;
+
+    EXTERNAL_FLASH_RECORD_REQUEST_TYPE Request;
+    EXTERNAL_FLASH_RECORD_OPERATION_TYPE Request_Operation;
+    uint32_t                    Request_Address;
+    void*                       Request_Buffer;
+    uint16_t                    Request_Size;
+
+    uint8_t                     Page_Buffer[EXTERNAL_FLASH_RECORD_PAGE_SIZE];
+} EXTERNAL_FLASH_RECORD_STORE_TYPE;
+
+static EXTERNAL_FLASH_RECORD_STORE_TYPE ExternalFlashRecord_Store[EXTERNAL_FLASH_RECORD_NUM];
+
+//! Record Task Handler Index
+static uint8_t ExternalFlashRecord_Handler_Index = INVALID_VALUE_8;
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void ExternalFlashEventHandler(CALLBACK_EVENT_TYPE event);
+static void Process(uint8_t record_id);
+static void Advance(uint8_t record_id);
+static void Request(uint8_t record_id, EXTERNAL_FLASH_RECORD_OPERATION_TYPE operation, uint8_t slot, uint16_t offset, void* buffer, uint16_t size);
+static void RequestDone(uint8_t record_id);
+static void StartMountSlot(uint8_t record_id);
+static void MountPage(uint8_t record_id);
+static void MountData(uint8_t record_id);
+static void MountSlotDone(uint8_t record_id, BOOL_TYPE valid);
+static void StartCommit(uint8_t record_id);
+static void Committed(uint8_t record_id);
+static void ExecuteCallBack(uint8_t record_id, EXTERNAL_FLASH_RECORD_EVENT_TYPE event);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Binds the records to their External Flash instances, to be called after ExternalFlash__Initialize
+ * @details The records are unmounted, ExternalFlashRecord__Mount makes them usable.
+ */
+void ExternalFlashRecord__Initialize(void)
+{
+    BOOL_TYPE shared;
+
+    // Initialize callback structure
+    Callback__Initialize(&ExternalFlashRecord_Callback_Control_Structure);
+
+    // Start periodic handler task
+    ExternalFlashRecord_Handler_Index = SystemTimers__CreateTask("ExternalFlashRecord__Handler", &ExternalFlashRecord__Handler, EXTERNAL_FLASH_RECORD_HANDLER_PERIOD_MS, TIMER_MS, FALSE );
+
+    SYS_ASSERT(ExternalFlashRecord_Handler_Index != INVALID_VALUE_8);
+
+    memset(ExternalFlashRecord_Store, 0x00, sizeof(ExternalFlashRecord_Store));
+
+    for(uint8_t record_id = 0; record_id < EXTERNAL_FLASH_RECORD_NUM; record_id++)
+    {
+        EXTERNAL_FLASH_RECORD_STORE_TYPE* record = &ExternalFlashRecord_Store[record_id];
+
+        SYS_ASSERT((ExternalFlashRecord_Map[record_id].Address % EXTERNAL_FLASH_RECORD_PAGE_SIZE) == 0);
+
+        // Shared instance of the channel, see ExternalFlash.h
+        record->Instance = ExternalFlash__GetAllocation(ExternalFlashRecord_Map[record_id].ExternalFlash_Channel, NULL, 0);
+        SYS_ASSERT(record->Instance < EXTERNAL_FLASH_CH_NUM);
+
+        shared = FALSE;
+        for(uint8_t other_id = 0; other_id < record_id; other_id++)
+        {
+            if(ExternalFlashRecord_Store[other_id].Instance == record->Instance)
+            {
+                shared = TRUE;
+            }
+        }
+        if(shared == FALSE)
+        {
+            ExternalFlash__RegisterEventHandler(&ExternalFlashEventHandler, record->Instance, CALLBACK_FILTER_VALUE_NONE);
+        }
+
+        record->State = EXTERNAL_FLASH_RECORD_STATE_UNMOUNTED;
+        record->Slot = EXTERNAL_FLASH_RECORD_SLOT_NONE;
+        record->Request = EXTERNAL_FLASH_RECORD_REQUEST_NONE;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the External Flash requests rejected while their instance was busy
+ */
+void ExternalFlashRecord__Handler(void)
+{
+    for(uint8_t record_id = 0; record_id < EXTERNAL_FLASH_RECORD_NUM; record_id++)
+    {
+        Process(record_id);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Finds the current record, reading both slots and checking their CRC
+ * @details Notifies EXTERNAL_FLASH_RECORD_EVENT_MOUNTED; ExternalFlashRecord__GetLength then tells if a record exists.
+ * @param   record_id: record index in EXTERNAL_FLASH_RECORD_MAP
+ * @return  TRUE if the mount was started, FALSE if the record is busy
+ */
+BOOL_TYPE ExternalFlashRecord__Mount(uint8_t record_id)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((record_id < EXTERNAL_FLASH_RECORD_NUM) &&
+       ((ExternalFlashRecord_Store[record_id].State == EXTERNAL_FLASH_RECORD_STATE_UNMOUNTED) || (ExternalFlashRecord_Store[record_id].State == EXTERNAL_FLASH_RECORD_STATE_IDLE)))
+    {
+        ExternalFlashRecord_Store[record_id].Slot = EXTERNAL_FLASH_RECORD_SLOT_NONE;
+        ExternalFlashRecord_Store[record_id].Sequence = 0;
+        ExternalFlashRecord_Store[record_id].Length = 0;
+        ExternalFlashRecord_Store[record_id].Target_Slot = 0;
+        StartMountSlot(record_id);
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the current record
+ * @details Notifies EXTERNAL_FLASH_RECORD_EVENT_READ. A record larger than the buffer is truncated.
+ * @param   record_id: record index in EXTERNAL_FLASH_RECORD_MAP
+ * @param   buffer: destination, must stay valid until the event
+ * @param   size: buffer size
+ * @return  TRUE if the read was started, FALSE if the record is not mounted or busy or no record was written
+ */
+BOOL_TYPE ExternalFlashRecord__Read(uint8_t record_id, void* buffer, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((record_id < EXTERNAL_FLASH_RECORD_NUM) &&
+       (ExternalFlashRecord_Store[record_id].State == EXTERNAL_FLASH_RECORD_STATE_IDLE) &&
+       (ExternalFlashRecord_Store[record_id].Slot != EXTERNAL_FLASH_RECORD_SLOT_NONE))
+    {
+        EXTERNAL_FLASH_RECORD_STORE_TYPE* record = &ExternalFlashRecord_Store[record_id];
+
+        if(size > record->Length)
+        {
+            size = record->Length;
+        }
+
+        record->State = EXTERNAL_FLASH_RECORD_STATE_READ;
+        if(size > 0)
+        {
+            Request(record_id, EXTERNAL_FLASH_RECORD_OPERATION_READ, record->Slot, EXTERNAL_FLASH_RECORD_HEADER_SIZE, buffer, size);
+        }
+        else
+        {
+            RequestDone(record_id);
+        }
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Replaces the current record
+ * @details The record is written into the other slot and becomes the current one when its first page is written.
+ *          Notifies EXTERNAL_FLASH_RECORD_EVENT_WRITTEN; with EXTERNAL_FLASH_WRITE_COMBINE_FEATURE the chip buffer is
+ *          flushed first, so the event always means the record is in main memory.
+ * @param   record_id: record index in EXTERNAL_FLASH_RECORD_MAP
+ * @param   buffer: data, must stay valid until the event
+ * @param   size: data bytes, up to the Record_Size of the map
+ * @return  TRUE if the write was started, FALSE if the record is not mounted or busy or the data is too large
+ */
+BOOL_TYPE ExternalFlashRecord__Write(uint8_t record_id, void* buffer, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((record_id < EXTERNAL_FLASH_RECORD_NUM) &&
+       (ExternalFlashRecord_Store[record_id].State == EXTERNAL_FLASH_RECORD_STATE_IDLE) &&
+       (size <= ExternalFlashRecord_Map[record_id].Record_Size))
+    {
+        EXTERNAL_FLASH_RECORD_STORE_TYPE* record = &ExternalFlashRecord_Store[record_id];
+
+        record->Client_Buffer = (uint8_t*)buffer;
+        record->Client_Size = size;
+        record->Target_Slot = (record->Slot == 0) ? 1 : 0;
+
+        if(size > EXTERNAL_FLASH_RECORD_FIRST_DATA_SIZE)
+        {
+            record->State = EXTERNAL_FLASH_RECORD_STATE_WRITE_DATA;
+            Request(record_id, EXTERNAL_FLASH_RECORD_OPERATION_WRITE, record->Target_Slot, EXTERNAL_FLASH_RECORD_PAGE_SIZE,
+                    &record->Client_Buffer[EXTERNAL_FLASH_RECORD_FIRST_DATA_SIZE], size - EXTERNAL_FLASH_RECORD_FIRST_DATA_SIZE);
+        }
+        else
+        {
+            StartCommit(record_id);
+        }
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gives the length of the current record
+ * @param   record_id: record index in EXTERNAL_FLASH_RECORD_MAP
+ * @return  data bytes, INVALID_VALUE_16 if not mounted, no record written or invalid record
+ */
+uint16_t ExternalFlashRecord__GetLength(uint8_t record_id)
+{
+    uint16_t length = INVALID_VALUE_16;
+
+    if((record_id < EXTERNAL_FLASH_RECORD_NUM) &&
+       (ExternalFlashRecord_Store[record_id].Slot != EXTERNAL_FLASH_RECORD_SLOT_NONE))
+    {
+        length = ExternalFlashRecord_Store[record_id].Length;
+    }
+
+    return length;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Tells if a record has an operation in progress
+ * @param   record_id: record index in EXTERNAL_FLASH_RECORD_MAP
+ * @return  TRUE if busy or invalid record
+ */
+BOOL_TYPE ExternalFlashRecord__IsBusy(uint8_t record_id)
+{
+    BOOL_TYPE busy = TRUE;
+
+    if((record_id < EXTERNAL_FLASH_RECORD_NUM) &&
+       ((ExternalFlashRecord_Store[record_id].State == EXTERNAL_FLASH_RECORD_STATE_UNMOUNTED) || (ExternalFlashRecord_Store[record_id].State == EXTERNAL_FLASH_RECORD_STATE_IDLE)))
+    {
+        busy = FALSE;
+    }
+
+    return busy;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Registers event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlashRecord__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value)
+{
+    Callback__Register(&ExternalFlashRecord_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler, filter_id, filter_value);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Unregisters event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlashRecord__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler)
+{
+    Callback__Unregister(&ExternalFlashRecord_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler);
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+/**
+ * @brief   External Flash event handler: completes the request of the record owning the instance and chains the next one
+ * @param   event: External Flash callback event
+ */
+static void ExternalFlashEventHandler(CALLBACK_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE nv_event;
+
+    memcpy(&nv_event, &event, sizeof(CALLBACK_EVENT_TYPE));
+
+    for(uint8_t record_id = 0; record_id < EXTERNAL_FLASH_RECORD_NUM; record_id++)
+    {
+        if((ExternalFlashRecord_Store[record_id].Instance == nv_event.Source_Instance_Id) &&
+           (ExternalFlashRecord_Store[record_id].Request == EXTERNAL_FLASH_RECORD_REQUEST_WAIT))
+        {
+            ExternalFlashRecord_Store[record_id].Request = EXTERNAL_FLASH_RECORD_REQUEST_DONE;
+            Process(record_id);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Advances the record state machine over completed requests and starts the pending one
+ * @param   record_id: record index
+ */
+static void Process(uint8_t record_id)
+{
+    EXTERNAL_FLASH_RECORD_STORE_TYPE* record = &ExternalFlashRecord_Store[record_id];
+    BOOL_TYPE started = FALSE;
+
+    while(record->Request == EXTERNAL_FLASH_RECORD_REQUEST_DONE)
+    {
+        record->Request = EXTERNAL_FLASH_RECORD_REQUEST_NONE;
+        Advance(record_id);
+    }
+
+    if(record->Request == EXTERNAL_FLASH_RECORD_REQUEST_PENDING)
+    {
+        switch(record->Request_Operation)
+        {
+          case EXTERNAL_FLASH_RECORD_OPERATION_READ:
+            started = ExternalFlash__Read(record->Instance, record->Request_Buffer, record->Request_Address, record->Request_Size);
+            break;
+
+          case EXTERNAL_FLASH_RECORD_OPERATION_WRITE:
+            started = ExternalFlash__Write(record->Instance, record->Request_Buffer, record->Request_Address, record->Request_Size);
+            break;
+
+          case EXTERNAL_FLASH_RECORD_OPERATION_FLUSH:
+          default:
+            started = ExternalFlash__Flush(record->Instance);
+            break;
+        }
+
+        if(started == TRUE)
+        {
+            record->Request = EXTERNAL_FLASH_RECORD_REQUEST_WAIT;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Record state machine, called when the request of the current state is done
+ * @param   record_id: record index
+ */
+static void Advance(uint8_t record_id)
+{
+    EXTERNAL_FLASH_RECORD_STORE_TYPE* record = &ExternalFlashRecord_Store[record_id];
+
+    switch(record->State)
+    {
+      case EXTERNAL_FLASH_RECORD_STATE_MOUNT_PAGE:
+        MountPage(record_id);
+        break;
+
+      case EXTERNAL_FLASH_RECORD_STATE_MOUNT_DATA:
+        MountData(record_id);
+        break;
+
+      case EXTERNAL_FLASH_RECORD_STATE_READ:
+        record->State = EXTERNAL_FLASH_RECORD_STATE_IDLE;
+        ExecuteCallBack(record_id, EXTERNAL_FLASH_RECORD_EVENT_READ);
+        break;
+
+      case EXTERNAL_FLASH_RECORD_STATE_WRITE_DATA:
+        StartCommit(record_id);
+        break;
+
+      case EXTERNAL_FLASH_RECORD_STATE_WRITE_COMMIT:
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+        // The header may still be in the chip buffer only
+        record->State = EXTERNAL_FLASH_RECORD_STATE_WRITE_FLUSH;
+        Request(record_id, EXTERNAL_FLASH_RECORD_OPERATION_FLUSH, record->Target_Slot, 0, NULL, 0);
+#else
+        Committed(record_id);
+#endif
+        break;
+
+      case EXTERNAL_FLASH_RECORD_STATE_WRITE_FLUSH:
+        Committed(record_id);
+        break;
+
+      case EXTERNAL_FLASH_RECORD_STATE_UNMOUNTED:
+      case EXTERNAL_FLASH_RECORD_STATE_IDLE:
+      default:
+        break;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Sets the External Flash request of the current state, started now or by the handler
+ * @param   record_id: record index
+ * @param   operation: External Flash operation
+ * @param   slot: record slot
+ * @param   offset: offset in the slot
+ * @param   buffer: data buffer, NULL for flushes
+ * @param   size: bytes
+ */
+static void Request(uint8_t record_id, EXTERNAL_FLASH_RECORD_OPERATION_TYPE operation, uint8_t slot, uint16_t offset, void* buffer, uint16_t size)
+{
+    EXTERNAL_FLASH_RECORD_STORE_TYPE* record = &ExternalFlashRecord_Store[record_id];
+
+    record->Request_Operation = operation;
+    record->Request_Address = ExternalFlashRecord_Map[record_id].Address +
+                              (slot * EXTERNAL_FLASH_RECORD_SLOT_SIZE(ExternalFlashRecord_Map[record_id].Record_Size)) + offset;
+    record->Request_Buffer = buffer;
+    record->Request_Size = size;
+    record->Request = EXTERNAL_FLASH_RECORD_REQUEST_PENDING;
+
+    SystemTimers__ResumeTask(ExternalFlashRecord_Handler_Index);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Completes the current state without External Flash access, advanced by Process
+ * @param   record_id: record index
+ */
+static void RequestDone(uint8_t record_id)
+{
+    ExternalFlashRecord_Store[record_id].Request = EXTERNAL_FLASH_RECORD_REQUEST_DONE;
+
+    SystemTimers__ResumeTask(ExternalFlashRecord_Handler_Index);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the first page of the slot being mounted
+ * @param   record_id: record index
+ */
+static void StartMountSlot(uint8_t record_id)
+{
+    EXTERNAL_FLASH_RECORD_STORE_TYPE* record = &ExternalFlashRecord_Store[record_id];
+
+    record->State = EXTERNAL_FLASH_RECORD_STATE_MOUNT_PAGE;
+    Request(record_id, EXTERNAL_FLASH_RECORD_OPERATION_READ, record->Target_Slot, 0, record->Page_Buffer, EXTERNAL_FLASH_RECORD_PAGE_SIZE);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Checks the header of the slot being mounted and starts the CRC with the data of the first page
+ * @param   record_id: record index
+ */
+static void MountPage(uint8_t record_id)
+{
+    EXTERNAL_FLASH_RECORD_STORE_TYPE* record = &ExternalFlashRecord_Store[record_id];
+    uint16_t size;
+
+    memcpy(&record->Header, record->Page_Buffer, sizeof(record->Header));
+
+    if((record->Header.Sequence == EXTERNAL_FLASH_RECORD_SEQUENCE_ERASED) ||
+       (record->Header.Length > ExternalFlashRecord_Map[record_id].Record_Size))
+    {
+        MountSlotDone(record_id, FALSE);
+    }
+    else
+    {
+        size = MIN(record->Header.Length, (uint16_t)EXTERNAL_FLASH_RECORD_FIRST_DATA_SIZE);
+        record->Crc = ExternalFlash__GetCrc(0, &record->Header, sizeof(record->Header) - sizeof(record->Header.Crc));
+        record->Crc = ExternalFlash__GetCrc(record->Crc, &record->Page_Buffer[EXTERNAL_FLASH_RECORD_HEADER_SIZE], size);
+        record->Progress = size;
+        MountData(record_id);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Adds the chunk read to the CRC of the slot being mounted and reads the next one, or ends the slot
+ * @param   record_id: record index
+ */
+static void MountData(uint8_t record_id)
+{
+    EXTERNAL_FLASH_RECORD_STORE_TYPE* record = &ExternalFlashRecord_Store[record_id];
+    uint16_t size;
+
+    if(record->State == EXTERNAL_FLASH_RECORD_STATE_MOUNT_DATA)
+    {
+        size = MIN((uint16_t)(record->Header.Length - record->Progress), (uint16_t)EXTERNAL_FLASH_RECORD_PAGE_SIZE);
+        record->Crc = ExternalFlash__GetCrc(record->Crc, record->Page_Buffer, size);
+        record->Progress += size;
+    }
+
+    if(record->Progress < record->Header.Length)
+    {
+        size = MIN((uint16_t)(record->Header.Length - record->Progress), (uint16_t)EXTERNAL_FLASH_RECORD_PAGE_SIZE);
+        record->State = EXTERNAL_FLASH_RECORD_STATE_MOUNT_DATA;
+        Request(record_id, EXTERNAL_FLASH_RECORD_OPERATION_READ, record->Target_Slot, EXTERNAL_FLASH_RECORD_HEADER_SIZE + record->Progress, record->Page_Buffer, size);
+    }
+    else
+    {
+        MountSlotDone(record_id, ((uint16_t)record->Crc == record->Header.Crc) ? TRUE : FALSE);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Keeps the slot mounted if valid and newer than the other, then mounts the next slot or ends the mount
+ * @param   record_id: record index
+ * @param   valid: TRUE if the slot passed its checks
+ */
+static void MountSlotDone(uint8_t record_id, BOOL_TYPE valid)
+{
+    EXTERNAL_FLASH_RECORD_STORE_TYPE* record = &ExternalFlashRecord_Store[record_id];
+
+    if((valid == TRUE) &&
+       ((record->Slot == EXTERNAL_FLASH_RECORD_SLOT_NONE) || ((int32_t)(record->Header.Sequence - record->Sequence) > 0)))
+    {
+        record->Slot = record->Target_Slot;
+        record->Sequence = record->Header.Sequence;
+        record->Length = record->Header.Length;
+    }
+
+    record->Target_Slot++;
+    if(record->Target_Slot < EXTERNAL_FLASH_RECORD_SLOTS)
+    {
+        StartMountSlot(record_id);
+    }
+    else
+    {
+        record->State = EXTERNAL_FLASH_RECORD_STATE_IDLE;
+        ExecuteCallBack(record_id, EXTERNAL_FLASH_RECORD_EVENT_MOUNTED);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Writes the first page of the target slot: commit header and data head
+ * @param   record_id: record index
+ */
+static void StartCommit(uint8_t record_id)
+{
+    EXTERNAL_FLASH_RECORD_STORE_TYPE* record = &ExternalFlashRecord_Store[record_id];
+    uint16_t size = MIN(record->Client_Size, (uint16_t)EXTERNAL_FLASH_RECORD_FIRST_DATA_SIZE);
+    uint32_t crc;
+
+    record->Header.Sequence = record->Sequence + 1;
+    record->Header.Length = record->Client_Size;
+    crc = ExternalFlash__GetCrc(0, &record->Header, sizeof(record->Header) - sizeof(record->Header.Crc));
+    record->Header.Crc = (uint16_t)ExternalFlash__GetCrc(crc, record->Client_Buffer, record->Client_Size);
+
+    memcpy(record->Page_Buffer, &record->Header, sizeof(record->Header));
+    memcpy(&record->Page_Buffer[EXTERNAL_FLASH_RECORD_HEADER_SIZE], record->Client_Buffer, size);
+
+    record->State = EXTERNAL_FLASH_RECORD_STATE_WRITE_COMMIT;
+    Request(record_id, EXTERNAL_FLASH_RECORD_OPERATION_WRITE, record->Target_Slot, 0, record->Page_Buffer, EXTERNAL_FLASH_RECORD_HEADER_SIZE + size);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Makes the record written the current one and notifies the client
+ * @param   record_id: record index
+ */
+static void Committed(uint8_t record_id)
+{
+    EXTERNAL_FLASH_RECORD_STORE_TYPE* record = &ExternalFlashRecord_Store[record_id];
+
+    record->Slot = record->Target_Slot;
+    record->Sequence = record->Header.Sequence;
+    record->Length = record->Header.Length;
+    record->State = EXTERNAL_FLASH_RECORD_STATE_IDLE;
+
+    ExecuteCallBack(record_id, EXTERNAL_FLASH_RECORD_EVENT_WRITTEN);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Notifies a record event to the registered handlers
+ * @param   record_id: record index, source instance of the event
+ * @param   event: EXTERNAL_FLASH_RECORD_EVENT_TYPE, event value
+ */
+static void ExecuteCallBack(uint8_t record_id, EXTERNAL_FLASH_RECORD_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE data;
+    CALLBACK_EVENT_TYPE callback_event;
+
+    data.Generic_Provider_Id = GENERIC_NVDATA_EXTERNAL_FLASH;
+    data.Source_Instance_Id = record_id;
+    data.Event_Value = (uint16_t)event;
+
+    memcpy(&callback_event, ((uint32_t*)(&data)), sizeof(CALLBACK_EVENT_TYPE));
+
+    Callback__Notify(&ExternalFlashRecord_Callback_Control_Structure, callback_event, record_id, NULL);
+}
@@ -0,0 +1,70 @@
+/**
+ *  @file       ExternalFlashRecord.h
+ *
+ *  @brief      Records written atomically into two alternating External Flash slots.
+ *  @details    Each record declared in EXTERNAL_FLASH_RECORD_MAP (ExternalFlashRecord_prv.h) owns the External Flash
+ *              instance of its client channel and two slots of EXTERNAL_FLASH_RECORD_SLOT_SIZE(Record_Size) bytes from
+ *              its address. A write goes to the slot not holding the current record, and the slot first page, with the
+ *              commit header {sequence, length, CRC}, is written last: a write interrupted at any point leaves a slot
+ *              failing its CRC, and mount keeps the other one. Readers so always get the old or the new record.
+ *
+ *              A write costs the pages of the record only, the commit header shares the first page with the data.
+ *
+ *              All operations are asynchronous: they return FALSE if the record is busy and their completion is
+ *              notified to the registered event handlers, with the record id as source instance and an
+ *              EXTERNAL_FLASH_RECORD_EVENT_TYPE as event value.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+#ifndef EXTERNALFLASHRECORD_H_
+#define EXTERNALFLASHRECORD_H_
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "C_Extensions.h"
+#include "Callback.h"
+#include "ExternalFlash.h"
+#include "ExternalFlashRecord_prv.h"
+
+//-------------------------------------- PUBLIC (Variables, Constants & Defines) --------------------------------------
+
+//! Device page size
+#ifndef EXTERNAL_FLASH_RECORD_PAGE_SIZE
+#define EXTERNAL_FLASH_RECORD_PAGE_SIZE             (256)
+#endif
+
+//! Handler task period
+#ifndef EXTERNAL_FLASH_RECORD_HANDLER_PERIOD_MS
+#define EXTERNAL_FLASH_RECORD_HANDLER_PERIOD_MS     EXTERNAL_FLASH_HANDLER_PERIOD_MS
+#endif
+
+//! Commit header size
+#define EXTERNAL_FLASH_RECORD_HEADER_SIZE           (8)
+
+//! Slot size of a record of record_size bytes, whole pages; the record uses two slots
+#define EXTERNAL_FLASH_RECORD_SLOT_SIZE(record_size)                                                                   \
+    ((((uint32_t)(record_size) + EXTERNAL_FLASH_RECORD_HEADER_SIZE + EXTERNAL_FLASH_RECORD_PAGE_SIZE - 1) /            \
+      EXTERNAL_FLASH_RECORD_PAGE_SIZE) * EXTERNAL_FLASH_RECORD_PAGE_SIZE)
+
+//! Record events, notified as event value
+typedef enum EXTERNAL_FLASH_RECORD_EVENT_ENUM
+{
+    EXTERNAL_FLASH_RECORD_EVENT_MOUNTED,                    // Mount completed, see ExternalFlashRecord__GetLength
+    EXTERNAL_FLASH_RECORD_EVENT_READ,
+    EXTERNAL_FLASH_RECORD_EVENT_WRITTEN,                    // Write committed, the new record is the current one
+    EXTERNAL_FLASH_RECORD_EVENT_NUM
+} EXTERNAL_FLASH_RECORD_EVENT_TYPE;
+
+//-------------------------------------- PUBLIC (Function Prototypes) -------------------------------------------------
+
+void ExternalFlashRecord__Initialize(void);
+void ExternalFlashRecord__Handler(void);
+BOOL_TYPE ExternalFlashRecord__Mount(uint8_t record_id);
+BOOL_TYPE ExternalFlashRecord__Read(uint8_t record_id, void* buffer, uint16_t size);
+BOOL_TYPE ExternalFlashRecord__Write(uint8_t record_id, void* buffer, uint16_t size);
+uint16_t ExternalFlashRecord__GetLength(uint8_t record_id);
+BOOL_TYPE ExternalFlashRecord__IsBusy(uint8_t record_id);
+void ExternalFlashRecord__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value);
+void ExternalFlashRecord__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler);
+
+#endif /* EXTERNALFLASHRECORD_H_ */
@@ -0,0 +1,777 @@
+/**
+ *  @file       ExternalFlashWear.c
+ *
+ *  @brief      Wear leveled volumes over pools of External Flash pages.
+ *  @details    Pool pages are mapped (newest copy of a logical page), erased (ready to be programmed) or dirty (stale
+ *              copy, or left by an interrupted program, to be erased). A write programs the new copy before the old
+ *              one is marked dirty, so after a reset mount finds at least one valid copy: the one with the highest
+ *              sequence number and a good CRC wins.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashWear.h"
+#include "ExternalFlashWear_prv.h"
+#include "ExternalFlash.h"
+
+#include "Callback.h"
+#include "CommonInterface.h"
+
+#include "SystemTimers.h"
+#include "Utilities.h"
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Define the callback control structure module static variable
+DEFINE_CALLBACK_CONTROL_STRUCTURE(ExternalFlashWear_Callback_Control_Structure, EXTERNAL_FLASH_WEAR_CALLBACK_REGISTERS_SIZE);
+
+//! Volume Map struct type
+typedef struct EXTERNAL_FLASH_WEAR_MAP_STRUCT
+{
+    EXTERNAL_FLASH_CH_TYPE      ExternalFlash_Channel;      // Client channel of the External Flash instance, owned by the volume
+    uint32_t                    Pool_Address;               // Device address, page aligned
+    uint16_t                    Pool_Pages;                 // Up to EXTERNAL_FLASH_WEAR_MAX_POOL_PAGES
+    uint16_t                    Logical_Pages;              // Less than Pool_Pages, the difference is the wear leveling room
+} EXTERNAL_FLASH_WEAR_MAP_TYPE;
+
+//! Volume Configuration Map
+static const EXTERNAL_FLASH_WEAR_MAP_TYPE ExternalFlashWear_Map[] = EXTERNAL_FLASH_WEAR_MAP;
+
+#define EXTERNAL_FLASH_WEAR_NUM                 ELEMENTS_IN_ARRAY(ExternalFlashWear_Map)
+
+//! Page footer, programmed with the data
+typedef __PACKED_STRUCT EXTERNAL_FLASH_WEAR_FOOTER_STRUCT
+{
+    uint16_t                    Logical_Page;
+    uint16_t                    Crc;                        // Low 16 bits of the CRC-32 of data, Logical_Page and Sequence
+    uint32_t                    Sequence;
+} EXTERNAL_FLASH_WEAR_FOOTER_TYPE;
+
+//! Map entry of a logical page never written
+#define EXTERNAL_FLASH_WEAR_PAGE_NONE           INVALID_VALUE_16
+
+//! Pool page states
+typedef enum EXTERNAL_FLASH_WEAR_PAGE_STATE_ENUM
+{
+    EXTERNAL_FLASH_WEAR_PAGE_DIRTY,
+    EXTERNAL_FLASH_WEAR_PAGE_ERASED,
+    EXTERNAL_FLASH_WEAR_PAGE_MAPPED
+} EXTERNAL_FLASH_WEAR_PAGE_STATE_TYPE;
+
+//! Volume states
+typedef enum EXTERNAL_FLASH_WEAR_STATE_ENUM
+{
+    EXTERNAL_FLASH_WEAR_STATE_UNMOUNTED,
+    EXTERNAL_FLASH_WEAR_STATE_IDLE,
+    EXTERNAL_FLASH_WEAR_STATE_MOUNT,                        // Reading pool pages
+    EXTERNAL_FLASH_WEAR_STATE_READ,                         // Reading a logical page
+    EXTERNAL_FLASH_WEAR_STATE_WRITE_LOAD,                   // Reading the data of a logical page partially written
+    EXTERNAL_FLASH_WEAR_STATE_WRITE_PROGRAM,                // Programming the new copy
+    EXTERNAL_FLASH_WEAR_STATE_CLEAN                         // Erasing a dirty page from the handler
+} EXTERNAL_FLASH_WEAR_STATE_TYPE;
+
+//! External Flash request of a volume
+typedef enum EXTERNAL_FLASH_WEAR_REQUEST_ENUM
+{
+    EXTERNAL_FLASH_WEAR_REQUEST_NONE,
+    EXTERNAL_FLASH_WEAR_REQUEST_PENDING,                    // To be started, retried by the handler while the instance is busy
+    EXTERNAL_FLASH_WEAR_REQUEST_WAIT,                       // Started, waiting for the External Flash event
+    EXTERNAL_FLASH_WEAR_REQUEST_DONE                        // Completed, the state machine advances
+} EXTERNAL_FLASH_WEAR_REQUEST_TYPE;
+
+//! External Flash operations used by the volumes
+typedef enum EXTERNAL_FLASH_WEAR_OPERATION_ENUM
+{
+    EXTERNAL_FLASH_WEAR_OPERATION_READ,
+    EXTERNAL_FLASH_WEAR_OPERATION_PROGRAM,                  // Into an erased page
+    EXTERNAL_FLASH_WEAR_OPERATION_WRITE,                    // Erase and program in one device command
+    EXTERNAL_FLASH_WEAR_OPERATION_ERASE
+} EXTERNAL_FLASH_WEAR_OPERATION_TYPE;
+
+//! Volume store struct type
+typedef struct EXTERNAL_FLASH_WEAR_STORE_STRUCT
+{
+    uint8_t                     Instance;                   // External Flash instance
+    EXTERNAL_FLASH_WEAR_STATE_TYPE State;
+
+    uint16_t                    Map[EXTERNAL_FLASH_WEAR_MAX_POOL_PAGES];            // Logical page -> pool page
+    uint8_t                     Page_State[EXTERNAL_FLASH_WEAR_MAX_POOL_PAGES];     // EXTERNAL_FLASH_WEAR_PAGE_STATE_TYPE
+    uint32_t                    Sequence[EXTERNAL_FLASH_WEAR_MAX_POOL_PAGES];       // Sequence of the mapped copy of each logical page
+    uint32_t                    Next_Sequence;
+    uint16_t                    Alloc_Page;                 // Last pool page allocated, the search of the next one starts after it
+
+    uint8_t*                    Client_Buffer;
+    uint32_t                    Client_Address;
+    uint16_t                    Client_Size;
+    uint16_t                    Progress;                   // Client bytes done
+    uint16_t                    Chunk_Size;                 // Client bytes of the logical page in progress
+    uint16_t                    Page;                       // Pool page of the step in progress
+
+    EXTERNAL_FLASH_WEAR_REQUEST_TYPE Request;
+    EXTERNAL_FLASH_WEAR_OPERATION_TYPE Request_Operation;
+    uint32_t                    Request_Address;
+    void*                       Request_Buffer;
+    uint16_t                    Request_Size;
+
+    uint8_t                     Page_Buffer[EXTERNAL_FLASH_WEAR_PAGE_SIZE];
+} EXTERNAL_FLASH_WEAR_STORE_TYPE;
+
+static EXTERNAL_FLASH_WEAR_STORE_TYPE ExternalFlashWear_Store[EXTERNAL_FLASH_WEAR_NUM];
+
+//! Volume Task Handler Index
+static uint8_t ExternalFlashWear_Handler_Index = INVALID_VALUE_8;
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void ExternalFlashEventHandler(CALLBACK_EVENT_TYPE event);
+static void Process(uint8_t volume_id);
+static void Advance(uint8_t volume_id);
+static void Request(uint8_t volume_id, EXTERNAL_FLASH_WEAR_OPERATION_TYPE operation, uint16_t page, uint16_t offset, void* buffer, uint16_t size);
+static void RequestDone(uint8_t volume_id);
+static void MountRead(uint8_t volume_id);
+static void MountPage(uint8_t volume_id);
+static void StartChunk(uint8_t volume_id);
+static void StartProgram(uint8_t volume_id);
+static void ChunkDone(uint8_t volume_id);
+static uint16_t FindPage(uint8_t volume_id, EXTERNAL_FLASH_WEAR_PAGE_STATE_TYPE state, uint16_t after);
+static void ExecuteCallBack(uint8_t volume_id, EXTERNAL_FLASH_WEAR_EVENT_TYPE event);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Binds the volumes to their External Flash instances, to be called after ExternalFlash__Initialize
+ * @details The volumes are unmounted, ExternalFlashWear__Mount makes them usable.
+ */
+void ExternalFlashWear__Initialize(void)
+{
+    BOOL_TYPE shared;
+
+    // Initialize callback structure
+    Callback__Initialize(&ExternalFlashWear_Callback_Control_Structure);
+
+    // Start periodic handler task
+    ExternalFlashWear_Handler_Index = SystemTimers__CreateTask("ExternalFlashWear__Handler", &ExternalFlashWear__Handler, EXTERNAL_FLASH_WEAR_HANDLER_PERIOD_MS, TIMER_MS, FALSE );
+
+    SYS_ASSERT(ExternalFlashWear_Handler_Index != INVALID_VALUE_8);
+
+    memset(ExternalFlashWear_Store, 0x00, sizeof(ExternalFlashWear_Store));
+
+    for(uint8_t volume_id = 0; volume_id < EXTERNAL_FLASH_WEAR_NUM; volume_id++)
+    {
+        EXTERNAL_FLASH_WEAR_STORE_TYPE* volume = &ExternalFlashWear_Store[volume_id];
+
+        SYS_ASSERT((ExternalFlashWear_Map[volume_id].Pool_Address % EXTERNAL_FLASH_WEAR_PAGE_SIZE) == 0);
+        SYS_ASSERT(ExternalFlashWear_Map[volume_id].Pool_Pages <= EXTERNAL_FLASH_WEAR_MAX_POOL_PAGES);
+        SYS_ASSERT(ExternalFlashWear_Map[volume_id].Logical_Pages < ExternalFlashWear_Map[volume_id].Pool_Pages);
+
+        // Shared instance of the channel, see ExternalFlash.h
+        volume->Instance = ExternalFlash__GetAllocation(ExternalFlashWear_Map[volume_id].ExternalFlash_Channel, NULL, 0);
+        SYS_ASSERT(volume->Instance < EXTERNAL_FLASH_CH_NUM);
+
+        shared = FALSE;
+        for(uint8_t other_id = 0; other_id < volume_id; other_id++)
+        {
+            if(ExternalFlashWear_Store[other_id].Instance == volume->Instance)
+            {
+                shared = TRUE;
+            }
+        }
+        if(shared == FALSE)
+        {
+            ExternalFlash__RegisterEventHandler(&ExternalFlashEventHandler, volume->Instance, CALLBACK_FILTER_VALUE_NONE);
+        }
+
+        volume->State = EXTERNAL_FLASH_WEAR_STATE_UNMOUNTED;
+        volume->Request = EXTERNAL_FLASH_WEAR_REQUEST_NONE;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the External Flash requests rejected while their instance was busy, erases dirty pages of idle volumes
+ */
+void ExternalFlashWear__Handler(void)
+{
+    EXTERNAL_FLASH_WEAR_STORE_TYPE* volume;
+
+    for(uint8_t volume_id = 0; volume_id < EXTERNAL_FLASH_WEAR_NUM; volume_id++)
+    {
+        volume = &ExternalFlashWear_Store[volume_id];
+
+        if(volume->State == EXTERNAL_FLASH_WEAR_STATE_IDLE)
+        {
+            volume->Page = FindPage(volume_id, EXTERNAL_FLASH_WEAR_PAGE_DIRTY, volume->Alloc_Page);
+            if(volume->Page != EXTERNAL_FLASH_WEAR_PAGE_NONE)
+            {
+                volume->State = EXTERNAL_FLASH_WEAR_STATE_CLEAN;
+                Request(volume_id, EXTERNAL_FLASH_WEAR_OPERATION_ERASE, volume->Page, 0, NULL, EXTERNAL_FLASH_WEAR_PAGE_SIZE);
+            }
+        }
+
+        Process(volume_id);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Rebuilds the logical to physical table reading the whole pool
+ * @details Pool pages the External Flash knows erased (ExternalFlash__IsErased) are not read. Notifies
+ *          EXTERNAL_FLASH_WEAR_EVENT_MOUNTED.
+ * @param   volume_id: volume index in EXTERNAL_FLASH_WEAR_MAP
+ * @return  TRUE if the mount was started, FALSE if the volume is busy
+ */
+BOOL_TYPE ExternalFlashWear__Mount(uint8_t volume_id)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((volume_id < EXTERNAL_FLASH_WEAR_NUM) &&
+       ((ExternalFlashWear_Store[volume_id].State == EXTERNAL_FLASH_WEAR_STATE_UNMOUNTED) || (ExternalFlashWear_Store[volume_id].State == EXTERNAL_FLASH_WEAR_STATE_IDLE)))
+    {
+        EXTERNAL_FLASH_WEAR_STORE_TYPE* volume = &ExternalFlashWear_Store[volume_id];
+
+        memset(volume->Map, 0xFF, sizeof(volume->Map));
+        volume->Next_Sequence = 0;
+        volume->Alloc_Page = 0;
+        volume->Page = 0;
+        volume->State = EXTERNAL_FLASH_WEAR_STATE_MOUNT;
+        MountRead(volume_id);
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads volume bytes, the ones never written read as 0xFF
+ * @details Notifies EXTERNAL_FLASH_WEAR_EVENT_READ.
+ * @param   volume_id: volume index in EXTERNAL_FLASH_WEAR_MAP
+ * @param   buffer: destination, must stay valid until the event
+ * @param   data_address: address in the volume
+ * @param   size: bytes to read, not 0
+ * @return  TRUE if the read was started, FALSE if the volume is not mounted or busy or the range is out of the volume
+ */
+BOOL_TYPE ExternalFlashWear__Read(uint8_t volume_id, void* buffer, uint32_t data_address, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((volume_id < EXTERNAL_FLASH_WEAR_NUM) &&
+       (ExternalFlashWear_Store[volume_id].State == EXTERNAL_FLASH_WEAR_STATE_IDLE) &&
+       (size > 0) && ((data_address + size) <= ExternalFlashWear__GetSize(volume_id)))
+    {
+        ExternalFlashWear_Store[volume_id].Client_Buffer = (uint8_t*)buffer;
+        ExternalFlashWear_Store[volume_id].Client_Address = data_address;
+        ExternalFlashWear_Store[volume_id].Client_Size = size;
+        ExternalFlashWear_Store[volume_id].Progress = 0;
+        ExternalFlashWear_Store[volume_id].State = EXTERNAL_FLASH_WEAR_STATE_READ;
+        StartChunk(volume_id);
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Writes volume bytes
+ * @details Each logical page touched is programmed into an erased pool page: a partial page is first read from its
+ *          current copy. Notifies EXTERNAL_FLASH_WEAR_EVENT_WRITTEN once all the pages are programmed.
+ * @param   volume_id: volume index in EXTERNAL_FLASH_WEAR_MAP
+ * @param   buffer: data, must stay valid until the event
+ * @param   data_address: address in the volume
+ * @param   size: bytes to write, not 0
+ * @return  TRUE if the write was started, FALSE if the volume is not mounted or busy or the range is out of the volume
+ */
+BOOL_TYPE ExternalFlashWear__Write(uint8_t volume_id, void* buffer, uint32_t data_address, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((volume_id < EXTERNAL_FLASH_WEAR_NUM) &&
+       (ExternalFlashWear_Store[volume_id].State == EXTERNAL_FLASH_WEAR_STATE_IDLE) &&
+       (size > 0) && ((data_address + size) <= ExternalFlashWear__GetSize(volume_id)))
+    {
+        ExternalFlashWear_Store[volume_id].Client_Buffer = (uint8_t*)buffer;
+        ExternalFlashWear_Store[volume_id].Client_Address = data_address;
+        ExternalFlashWear_Store[volume_id].Client_Size = size;
+        ExternalFlashWear_Store[volume_id].Progress = 0;
+        ExternalFlashWear_Store[volume_id].State = EXTERNAL_FLASH_WEAR_STATE_WRITE_LOAD;
+        StartChunk(volume_id);
+        success = TRUE;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gives the size of a volume
+ * @param   volume_id: volume index in EXTERNAL_FLASH_WEAR_MAP
+ * @return  bytes, 0 if invalid volume
+ */
+uint32_t ExternalFlashWear__GetSize(uint8_t volume_id)
+{
+    uint32_t size = 0;
+
+    if(volume_id < EXTERNAL_FLASH_WEAR_NUM)
+    {
+        size = (uint32_t)ExternalFlashWear_Map[volume_id].Logical_Pages * EXTERNAL_FLASH_WEAR_DATA_SIZE;
+    }
+
+    return size;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Tells if a volume has an operation or a page erase in progress
+ * @param   volume_id: volume index in EXTERNAL_FLASH_WEAR_MAP
+ * @return  TRUE if busy or invalid volume
+ */
+BOOL_TYPE ExternalFlashWear__IsBusy(uint8_t volume_id)
+{
+    BOOL_TYPE busy = TRUE;
+
+    if((volume_id < EXTERNAL_FLASH_WEAR_NUM) &&
+       ((ExternalFlashWear_Store[volume_id].State == EXTERNAL_FLASH_WEAR_STATE_UNMOUNTED) || (ExternalFlashWear_Store[volume_id].State == EXTERNAL_FLASH_WEAR_STATE_IDLE)))
+    {
+        busy = FALSE;
+    }
+
+    return busy;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Registers event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlashWear__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value)
+{
+    Callback__Register(&ExternalFlashWear_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler, filter_id, filter_value);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Unregisters event handler with the module.
+ * @param   event_handler: pointer to the function that handles the event
+ */
+void ExternalFlashWear__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler)
+{
+    Callback__Unregister(&ExternalFlashWear_Callback_Control_Structure, (CALLBACK_HANDLER_TYPE)event_handler);
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+/**
+ * @brief   External Flash event handler: completes the request of the volume owning the instance and chains the next one
+ * @param   event: External Flash callback event
+ */
+static void ExternalFlashEventHandler(CALLBACK_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE nv_event;
+
+    memcpy(&nv_event, &event, sizeof(CALLBACK_EVENT_TYPE));
+
+    for(uint8_t volume_id = 0; volume_id < EXTERNAL_FLASH_WEAR_NUM; volume_id++)
+    {
+        if((ExternalFlashWear_Store[volume_id].Instance == nv_event.Source_Instance_Id) &&
+           (ExternalFlashWear_Store[volume_id].Request == EXTERNAL_FLASH_WEAR_REQUEST_WAIT))
+        {
+            ExternalFlashWear_Store[volume_id].Request = EXTERNAL_FLASH_WEAR_REQUEST_DONE;
+            Process(volume_id);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Advances the volume state machine over completed requests and starts the pending one
+ * @param   volume_id: volume index
+ */
+static void Process(uint8_t volume_id)
+{
+    EXTERNAL_FLASH_WEAR_STORE_TYPE* volume = &ExternalFlashWear_Store[volume_id];
+    BOOL_TYPE started = FALSE;
+
+    while(volume->Request == EXTERNAL_FLASH_WEAR_REQUEST_DONE)
+    {
+        volume->Request = EXTERNAL_FLASH_WEAR_REQUEST_NONE;
+        Advance(volume_id);
+    }
+
+    if(volume->Request == EXTERNAL_FLASH_WEAR_REQUEST_PENDING)
+    {
+        switch(volume->Request_Operation)
+        {
+          case EXTERNAL_FLASH_WEAR_OPERATION_READ:
+            started = ExternalFlash__Read(volume->Instance, volume->Request_Buffer, volume->Request_Address, volume->Request_Size);
+            break;
+
+          case EXTERNAL_FLASH_WEAR_OPERATION_PROGRAM:
+            started = ExternalFlash__Program(volume->Instance, volume->Request_Buffer, volume->Request_Address, volume->Request_Size);
+            break;
+
+          case EXTERNAL_FLASH_WEAR_OPERATION_WRITE:
+            started = ExternalFlash__Write(volume->Instance, volume->Request_Buffer, volume->Request_Address, volume->Request_Size);
+            break;
+
+          case EXTERNAL_FLASH_WEAR_OPERATION_ERASE:
+          default:
+            started = ExternalFlash__Erase(volume->Instance, volume->Request_Address, volume->Request_Size);
+            break;
+        }
+
+        if(started == TRUE)
+        {
+            volume->Request = EXTERNAL_FLASH_WEAR_REQUEST_WAIT;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Volume state machine, called when the request of the current state is done
+ * @param   volume_id: volume index
+ */
+static void Advance(uint8_t volume_id)
+{
+    EXTERNAL_FLASH_WEAR_STORE_TYPE* volume = &ExternalFlashWear_Store[volume_id];
+    uint16_t offset;
+
+    switch(volume->State)
+    {
+      case EXTERNAL_FLASH_WEAR_STATE_MOUNT:
+        MountPage(volume_id);
+        break;
+
+      case EXTERNAL_FLASH_WEAR_STATE_READ:
+        ChunkDone(volume_id);
+        break;
+
+      case EXTERNAL_FLASH_WEAR_STATE_WRITE_LOAD:
+        // Merge the client data into the current copy of the logical page
+        offset = (uint16_t)((volume->Client_Address + volume->Progress) % EXTERNAL_FLASH_WEAR_DATA_SIZE);
+        memcpy(&volume->Page_Buffer[offset], &volume->Client_Buffer[volume->Progress], volume->Chunk_Size);
+        StartProgram(volume_id);
+        break;
+
+      case EXTERNAL_FLASH_WEAR_STATE_WRITE_PROGRAM:
+        ChunkDone(volume_id);
+        break;
+
+      case EXTERNAL_FLASH_WEAR_STATE_CLEAN:
+        volume->Page_State[volume->Page] = EXTERNAL_FLASH_WEAR_PAGE_ERASED;
+        volume->State = EXTERNAL_FLASH_WEAR_STATE_IDLE;
+        break;
+
+      case EXTERNAL_FLASH_WEAR_STATE_UNMOUNTED:
+      case EXTERNAL_FLASH_WEAR_STATE_IDLE:
+      default:
+        break;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Sets the External Flash request of the current state, started now or by the handler
+ * @param   volume_id: volume index
+ * @param   operation: External Flash operation
+ * @param   page: pool page
+ * @param   offset: offset in the page
+ * @param   buffer: data buffer, NULL for erases
+ * @param   size: bytes
+ */
+static void Request(uint8_t volume_id, EXTERNAL_FLASH_WEAR_OPERATION_TYPE operation, uint16_t page, uint16_t offset, void* buffer, uint16_t size)
+{
+    EXTERNAL_FLASH_WEAR_STORE_TYPE* volume = &ExternalFlashWear_Store[volume_id];
+
+    volume->Request_Operation = operation;
+    volume->Request_Address = ExternalFlashWear_Map[volume_id].Pool_Address + ((uint32_t)page * EXTERNAL_FLASH_WEAR_PAGE_SIZE) + offset;
+    volume->Request_Buffer = buffer;
+    volume->Request_Size = size;
+    volume->Request = EXTERNAL_FLASH_WEAR_REQUEST_PENDING;
+
+    SystemTimers__ResumeTask(ExternalFlashWear_Handler_Index);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Completes the current state without External Flash access, advanced by Process
+ * @param   volume_id: volume index
+ */
+static void RequestDone(uint8_t volume_id)
+{
+    ExternalFlashWear_Store[volume_id].Request = EXTERNAL_FLASH_WEAR_REQUEST_DONE;
+
+    SystemTimers__ResumeTask(ExternalFlashWear_Handler_Index);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the pool page to classify, or fills the page buffer with 0xFF if the page is known erased
+ * @param   volume_id: volume index
+ */
+static void MountRead(uint8_t volume_id)
+{
+    EXTERNAL_FLASH_WEAR_STORE_TYPE* volume = &ExternalFlashWear_Store[volume_id];
+
+    if(ExternalFlash__IsErased(volume->Instance, ExternalFlashWear_Map[volume_id].Pool_Address + ((uint32_t)volume->Page * EXTERNAL_FLASH_WEAR_PAGE_SIZE), EXTERNAL_FLASH_WEAR_PAGE_SIZE) == TRUE)
+    {
+        memset(volume->Page_Buffer, 0xFF, EXTERNAL_FLASH_WEAR_PAGE_SIZE);
+        RequestDone(volume_id);
+    }
+    else
+    {
+        Request(volume_id, EXTERNAL_FLASH_WEAR_OPERATION_READ, volume->Page, 0, volume->Page_Buffer, EXTERNAL_FLASH_WEAR_PAGE_SIZE);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Classifies the pool page read and reads the next one, or ends the mount
+ * @details A fully erased page is ready, a page with a good CRC is the copy of its logical page if newer than the one
+ *          found so far, anything else is dirty.
+ * @param   volume_id: volume index
+ */
+static void MountPage(uint8_t volume_id)
+{
+    EXTERNAL_FLASH_WEAR_STORE_TYPE* volume = &ExternalFlashWear_Store[volume_id];
+    EXTERNAL_FLASH_WEAR_FOOTER_TYPE footer;
+    EXTERNAL_FLASH_WEAR_PAGE_STATE_TYPE state = EXTERNAL_FLASH_WEAR_PAGE_ERASED;
+    uint16_t page = volume->Page;
+    uint32_t crc;
+
+    memcpy(&footer, &volume->Page_Buffer[EXTERNAL_FLASH_WEAR_DATA_SIZE], sizeof(footer));
+
+    for(uint16_t index = 0; index < EXTERNAL_FLASH_WEAR_PAGE_SIZE; index++)
+    {
+        if(volume->Page_Buffer[index] != 0xFF)
+        {
+            state = EXTERNAL_FLASH_WEAR_PAGE_DIRTY;
+            break;
+        }
+    }
+
+    if((state == EXTERNAL_FLASH_WEAR_PAGE_DIRTY) && (footer.Logical_Page < ExternalFlashWear_Map[volume_id].Logical_Pages))
+    {
+        crc = ExternalFlash__GetCrc(0, volume->Page_Buffer, EXTERNAL_FLASH_WEAR_DATA_SIZE);
+        crc = ExternalFlash__GetCrc(crc, &footer.Logical_Page, sizeof(footer.Logical_Page));
+        crc = ExternalFlash__GetCrc(crc, &footer.Sequence, sizeof(footer.Sequence));
+
+        if(((uint16_t)crc == footer.Crc) &&
+           ((volume->Map[footer.Logical_Page] == EXTERNAL_FLASH_WEAR_PAGE_NONE) ||
+            ((int32_t)(footer.Sequence - volume->Sequence[footer.Logical_Page]) > 0)))
+        {
+            // Newer copy, the previous one is stale
+            if(volume->Map[footer.Logical_Page] != EXTERNAL_FLASH_WEAR_PAGE_NONE)
+            {
+                volume->Page_State[volume->Map[footer.Logical_Page]] = EXTERNAL_FLASH_WEAR_PAGE_DIRTY;
+            }
+            volume->Map[footer.Logical_Page] = page;
+            volume->Sequence[footer.Logical_Page] = footer.Sequence;
+            state = EXTERNAL_FLASH_WEAR_PAGE_MAPPED;
+
+            if((int32_t)(footer.Sequence + 1 - volume->Next_Sequence) > 0)
+            {
+                volume->Next_Sequence = footer.Sequence + 1;
+            }
+        }
+    }
+    volume->Page_State[page] = state;
+
+    page++;
+    if(page < ExternalFlashWear_Map[volume_id].Pool_Pages)
+    {
+        volume->Page = page;
+        MountRead(volume_id);
+    }
+    else
+    {
+        // Allocation resumes after the newest copy
+        for(uint16_t logical = 0; logical < ExternalFlashWear_Map[volume_id].Logical_Pages; logical++)
+        {
+            if((volume->Map[logical] != EXTERNAL_FLASH_WEAR_PAGE_NONE) && (volume->Sequence[logical] == (volume->Next_Sequence - 1)))
+            {
+                volume->Alloc_Page = volume->Map[logical];
+            }
+        }
+        volume->State = EXTERNAL_FLASH_WEAR_STATE_IDLE;
+        ExecuteCallBack(volume_id, EXTERNAL_FLASH_WEAR_EVENT_MOUNTED);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the read or write of the logical page at the progress of the current operation
+ * @param   volume_id: volume index
+ */
+static void StartChunk(uint8_t volume_id)
+{
+    EXTERNAL_FLASH_WEAR_STORE_TYPE* volume = &ExternalFlashWear_Store[volume_id];
+    uint32_t address = volume->Client_Address + volume->Progress;
+    uint16_t logical = (uint16_t)(address / EXTERNAL_FLASH_WEAR_DATA_SIZE);
+    uint16_t offset = (uint16_t)(address % EXTERNAL_FLASH_WEAR_DATA_SIZE);
+    uint16_t page = volume->Map[logical];
+
+    volume->Chunk_Size = MIN((uint16_t)(EXTERNAL_FLASH_WEAR_DATA_SIZE - offset), (uint16_t)(volume->Client_Size - volume->Progress));
+
+    if(volume->State == EXTERNAL_FLASH_WEAR_STATE_READ)
+    {
+        if(page != EXTERNAL_FLASH_WEAR_PAGE_NONE)
+        {
+            Request(volume_id, EXTERNAL_FLASH_WEAR_OPERATION_READ, page, offset, &volume->Client_Buffer[volume->Progress], volume->Chunk_Size);
+        }
+        else
+        {
+            memset(&volume->Client_Buffer[volume->Progress], 0xFF, volume->Chunk_Size);
+            RequestDone(volume_id);
+        }
+    }
+    else
+    {
+        volume->State = EXTERNAL_FLASH_WEAR_STATE_WRITE_LOAD;
+        if((volume->Chunk_Size < EXTERNAL_FLASH_WEAR_DATA_SIZE) && (page != EXTERNAL_FLASH_WEAR_PAGE_NONE))
+        {
+            // Partial page: the rest of the data comes from the current copy
+            Request(volume_id, EXTERNAL_FLASH_WEAR_OPERATION_READ, page, 0, volume->Page_Buffer, EXTERNAL_FLASH_WEAR_DATA_SIZE);
+        }
+        else
+        {
+            memset(volume->Page_Buffer, 0xFF, EXTERNAL_FLASH_WEAR_DATA_SIZE);
+            RequestDone(volume_id);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Completes the new copy in the page buffer and programs it into the next erased pool page
+ * @details Erased pages are picked round robin after the last one allocated, so that all the free pages share the
+ *          erases. When writes come faster than the handler erases, the copy goes into a dirty page with a full page
+ *          write, erased and programmed by a single device command as a direct write would be.
+ * @param   volume_id: volume index
+ */
+static void StartProgram(uint8_t volume_id)
+{
+    EXTERNAL_FLASH_WEAR_STORE_TYPE* volume = &ExternalFlashWear_Store[volume_id];
+    EXTERNAL_FLASH_WEAR_FOOTER_TYPE footer;
+    uint32_t crc;
+
+    footer.Logical_Page = (uint16_t)((volume->Client_Address + volume->Progress) / EXTERNAL_FLASH_WEAR_DATA_SIZE);
+    footer.Sequence = volume->Next_Sequence;
+
+    crc = ExternalFlash__GetCrc(0, volume->Page_Buffer, EXTERNAL_FLASH_WEAR_DATA_SIZE);
+    crc = ExternalFlash__GetCrc(crc, &footer.Logical_Page, sizeof(footer.Logical_Page));
+    footer.Crc = (uint16_t)ExternalFlash__GetCrc(crc, &footer.Sequence, sizeof(footer.Sequence));
+
+    memcpy(&volume->Page_Buffer[EXTERNAL_FLASH_WEAR_DATA_SIZE], &footer, sizeof(footer));
+
+    volume->State = EXTERNAL_FLASH_WEAR_STATE_WRITE_PROGRAM;
+    volume->Page = FindPage(volume_id, EXTERNAL_FLASH_WEAR_PAGE_ERASED, volume->Alloc_Page);
+    if(volume->Page != EXTERNAL_FLASH_WEAR_PAGE_NONE)
+    {
+        Request(volume_id, EXTERNAL_FLASH_WEAR_OPERATION_PROGRAM, volume->Page, 0, volume->Page_Buffer, EXTERNAL_FLASH_WEAR_PAGE_SIZE);
+    }
+    else
+    {
+        // The pool is larger than the volume, so a page not mapped is always there
+        volume->Page = FindPage(volume_id, EXTERNAL_FLASH_WEAR_PAGE_DIRTY, volume->Alloc_Page);
+        Request(volume_id, EXTERNAL_FLASH_WEAR_OPERATION_WRITE, volume->Page, 0, volume->Page_Buffer, EXTERNAL_FLASH_WEAR_PAGE_SIZE);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Ends the read or the program of a logical page: remaps it after a program, then moves to the next page
+ *          or notifies the client
+ * @param   volume_id: volume index
+ */
+static void ChunkDone(uint8_t volume_id)
+{
+    EXTERNAL_FLASH_WEAR_STORE_TYPE* volume = &ExternalFlashWear_Store[volume_id];
+    uint16_t logical;
+    EXTERNAL_FLASH_WEAR_EVENT_TYPE event = EXTERNAL_FLASH_WEAR_EVENT_READ;
+
+    if(volume->State == EXTERNAL_FLASH_WEAR_STATE_WRITE_PROGRAM)
+    {
+        logical = (uint16_t)((volume->Client_Address + volume->Progress) / EXTERNAL_FLASH_WEAR_DATA_SIZE);
+
+        // The new copy is programmed, the old one can go
+        if(volume->Map[logical] != EXTERNAL_FLASH_WEAR_PAGE_NONE)
+        {
+            volume->Page_State[volume->Map[logical]] = EXTERNAL_FLASH_WEAR_PAGE_DIRTY;
+        }
+        volume->Map[logical] = volume->Page;
+        volume->Sequence[logical] = volume->Next_Sequence;
+        volume->Page_State[volume->Page] = EXTERNAL_FLASH_WEAR_PAGE_MAPPED;
+        volume->Alloc_Page = volume->Page;
+        volume->Next_Sequence++;
+        event = EXTERNAL_FLASH_WEAR_EVENT_WRITTEN;
+    }
+
+    volume->Progress += volume->Chunk_Size;
+
+    if(volume->Progress < volume->Client_Size)
+    {
+        StartChunk(volume_id);
+    }
+    else
+    {
+        volume->State = EXTERNAL_FLASH_WEAR_STATE_IDLE;
+        ExecuteCallBack(volume_id, event);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Finds the first pool page in a state, searching round robin after a page
+ * @param   volume_id: volume index
+ * @param   state: page state searched
+ * @param   after: search start, excluded unless it is the only page in the state
+ * @return  pool page, EXTERNAL_FLASH_WEAR_PAGE_NONE if none
+ */
+static uint16_t FindPage(uint8_t volume_id, EXTERNAL_FLASH_WEAR_PAGE_STATE_TYPE state, uint16_t after)
+{
+    uint16_t pool_pages = ExternalFlashWear_Map[volume_id].Pool_Pages;
+    uint16_t page = after;
+    uint16_t found = EXTERNAL_FLASH_WEAR_PAGE_NONE;
+
+    for(uint16_t count = 0; (count < pool_pages) && (found == EXTERNAL_FLASH_WEAR_PAGE_NONE); count++)
+    {
+        page = (page + 1 < pool_pages) ? (page + 1) : 0;
+        if(ExternalFlashWear_Store[volume_id].Page_State[page] == state)
+        {
+            found = page;
+        }
+    }
+
+    return found;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Notifies a volume event to the registered handlers
+ * @param   volume_id: volume index, source instance of the event
+ * @param   event: EXTERNAL_FLASH_WEAR_EVENT_TYPE, event value
+ */
+static void ExecuteCallBack(uint8_t volume_id, EXTERNAL_FLASH_WEAR_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE data;
+    CALLBACK_EVENT_TYPE callback_event;
+
+    data.Generic_Provider_Id = GENERIC_NVDATA_EXTERNAL_FLASH;
+    data.Source_Instance_Id = volume_id;
+    data.Event_Value = (uint16_t)event;
+
+    memcpy(&callback_event, ((uint32_t*)(&data)), sizeof(CALLBACK_EVENT_TYPE));
+
+    Callback__Notify(&ExternalFlashWear_Callback_Control_Structure, callback_event, volume_id, NULL);
+}
@@ -0,0 +1,74 @@
+/**
+ *  @file       ExternalFlashWear.h
+ *
+ *  @brief      Wear leveled volumes over pools of External Flash pages.
+ *  @details    Each volume declared in EXTERNAL_FLASH_WEAR_MAP (ExternalFlashWear_prv.h) owns the External Flash
+ *              instance of its client channel and a pool of device pages, larger than the logical pages it exposes.
+ *              Logical page n holds the volume bytes [n * EXTERNAL_FLASH_WEAR_DATA_SIZE, (n + 1) *
+ *              EXTERNAL_FLASH_WEAR_DATA_SIZE), the rest of the device page is a footer with the logical page number,
+ *              a sequence number and a CRC.
+ *
+ *              A write never updates a page in place: the logical page is programmed, with the new data and a new
+ *              sequence number, into an erased pool page picked round robin, and the page it replaces is erased later
+ *              from the handler task. Updates of a hot page are so spread across all the free pages of the pool. The
+ *              logical to physical table lives in RAM and mount rebuilds it from the footers.
+ *
+ *              All operations are asynchronous: they return FALSE if the volume is busy and their completion is
+ *              notified to the registered event handlers, with the volume id as source instance and an
+ *              EXTERNAL_FLASH_WEAR_EVENT_TYPE as event value.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+#ifndef EXTERNALFLASHWEAR_H_
+#define EXTERNALFLASHWEAR_H_
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "C_Extensions.h"
+#include "Callback.h"
+#include "ExternalFlash.h"
+#include "ExternalFlashWear_prv.h"
+
+//-------------------------------------- PUBLIC (Variables, Constants & Defines) --------------------------------------
+
+//! Device page size
+#ifndef EXTERNAL_FLASH_WEAR_PAGE_SIZE
+#define EXTERNAL_FLASH_WEAR_PAGE_SIZE               (256)
+#endif
+
+//! Largest pool, in pages
+#ifndef EXTERNAL_FLASH_WEAR_MAX_POOL_PAGES
+#define EXTERNAL_FLASH_WEAR_MAX_POOL_PAGES          (64)
+#endif
+
+//! Handler task period, one page of the pool is erased per period when the volume is idle
+#ifndef EXTERNAL_FLASH_WEAR_HANDLER_PERIOD_MS
+#define EXTERNAL_FLASH_WEAR_HANDLER_PERIOD_MS       EXTERNAL_FLASH_HANDLER_PERIOD_MS
+#endif
+
+//! Page footer size and volume bytes held by each page
+#define EXTERNAL_FLASH_WEAR_FOOTER_SIZE             (8)
+#define EXTERNAL_FLASH_WEAR_DATA_SIZE               (EXTERNAL_FLASH_WEAR_PAGE_SIZE - EXTERNAL_FLASH_WEAR_FOOTER_SIZE)
+
+//! Volume events, notified as event value
+typedef enum EXTERNAL_FLASH_WEAR_EVENT_ENUM
+{
+    EXTERNAL_FLASH_WEAR_EVENT_MOUNTED,
+    EXTERNAL_FLASH_WEAR_EVENT_READ,
+    EXTERNAL_FLASH_WEAR_EVENT_WRITTEN,
+    EXTERNAL_FLASH_WEAR_EVENT_NUM
+} EXTERNAL_FLASH_WEAR_EVENT_TYPE;
+
+//-------------------------------------- PUBLIC (Function Prototypes) -------------------------------------------------
+
+void ExternalFlashWear__Initialize(void);
+void ExternalFlashWear__Handler(void);
+BOOL_TYPE ExternalFlashWear__Mount(uint8_t volume_id);
+BOOL_TYPE ExternalFlashWear__Read(uint8_t volume_id, void* buffer, uint32_t data_address, uint16_t size);
+BOOL_TYPE ExternalFlashWear__Write(uint8_t volume_id, void* buffer, uint32_t data_address, uint16_t size);
+uint32_t ExternalFlashWear__GetSize(uint8_t volume_id);
+BOOL_TYPE ExternalFlashWear__IsBusy(uint8_t volume_id);
+void ExternalFlashWear__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value);
+void ExternalFlashWear__UnregisterEventHandler(CALLBACK_HANDLER_TYPE event_handler);
+
+#endif /* EXTERNALFLASHWEAR_H_ */
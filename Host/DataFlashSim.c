@@ -0,0 +1,1028 @@
+/**
+ *  @file       DataFlashSim.c
+ *
+ *  @brief      Host (Linux) DataFlash simulator exposing the generic comm bus and generic IO interfaces.
+ *  @details    Every byte clocked on the virtual SPI goes through a command decoder: the first byte is the opcode,
+ *              then address and dummy bytes, then the data phase. Program and erase commands execute when the chip
+ *              select is released and keep the chip busy (RDY/BUSY low) for the configured datasheet time.
+ *              Bus Read/Write calls return immediately and notify their completion event after the SPI transfer
+ *              time, like a DMA driven bus provider does.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "DataFlashSim.h"
+#include "SystemTimersSim.h"
+
+#include <stdlib.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! DataFlash opcodes
+#define DATAFLASH_SIM_CMD_MAIN_MEMORY_PAGE_READ             0xd2
+#define DATAFLASH_SIM_CMD_CONTINUOUS_READ_LP                0x01
+#define DATAFLASH_SIM_CMD_CONTINUOUS_READ_LF                0x03
+#define DATAFLASH_SIM_CMD_CONTINUOUS_READ_HF                0x0b
+#define DATAFLASH_SIM_CMD_BUFFER_1_READ_HF                  0xd4
+#define DATAFLASH_SIM_CMD_BUFFER_1_READ_LF                  0xd1
+#define DATAFLASH_SIM_CMD_BUFFER_2_READ_HF                  0xd6
+#define DATAFLASH_SIM_CMD_BUFFER_2_READ_LF                  0xd3
+#define DATAFLASH_SIM_CMD_BUFFER_1_WRITE                    0x84
+#define DATAFLASH_SIM_CMD_BUFFER_2_WRITE                    0x87
+#define DATAFLASH_SIM_CMD_BUFFER_1_TO_MAIN_ERASE            0x83
+#define DATAFLASH_SIM_CMD_BUFFER_2_TO_MAIN_ERASE            0x86
+#define DATAFLASH_SIM_CMD_BUFFER_1_TO_MAIN_NO_ERASE         0x88
+#define DATAFLASH_SIM_CMD_BUFFER_2_TO_MAIN_NO_ERASE         0x89
+#define DATAFLASH_SIM_CMD_MAIN_PROGRAM_BUFFER_1             0x82
+#define DATAFLASH_SIM_CMD_MAIN_PROGRAM_BUFFER_2             0x85
+#define DATAFLASH_SIM_CMD_PAGE_PROGRAM_NO_ERASE             0x02
+#define DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_1               0x58
+#define DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_2               0x59
+#define DATAFLASH_SIM_CMD_MAIN_TO_BUFFER_1                  0x53
+#define DATAFLASH_SIM_CMD_MAIN_TO_BUFFER_2                  0x55
+#define DATAFLASH_SIM_CMD_COMPARE_BUFFER_1                  0x60
+#define DATAFLASH_SIM_CMD_COMPARE_BUFFER_2                  0x61
+#define DATAFLASH_SIM_CMD_PAGE_ERASE                        0x81
+#define DATAFLASH_SIM_CMD_BLOCK_ERASE                       0x50
+#define DATAFLASH_SIM_CMD_SECTOR_ERASE                      0x7c
+#define DATAFLASH_SIM_CMD_STATUS_REGISTER_READ              0xd7
+#define DATAFLASH_SIM_CMD_MANUFACTURER_ID_READ              0x9f
+#define DATAFLASH_SIM_CMD_CHIP_ERASE                        0xc7        // Followed by 94 80 9a
+#define DATAFLASH_SIM_CMD_CONFIGURATION                     0x3d        // Followed by 2a 80 a6 / 2a 80 a7
+
+//! Command header lengths
+#define DATAFLASH_SIM_ADDRESS_BYTES                         3
+#define DATAFLASH_SIM_HEADER_MAX_BYTES                      8
+
+//! Status register bits, byte 1
+#define DATAFLASH_SIM_STATUS_RDY                            0x80
+#define DATAFLASH_SIM_STATUS_COMP                           0x40
+#define DATAFLASH_SIM_STATUS_PAGE_SIZE                      0x01
+#define DATAFLASH_SIM_STATUS_DENSITY_SHIFT                  2
+
+//! Bus process reported in the high byte of the bus events
+#define DATAFLASH_SIM_BUS_PROCESS_WRITE                     1
+#define DATAFLASH_SIM_BUS_PROCESS_READ                      2
+
+//! No buffer involved in the ongoing operation
+#define DATAFLASH_SIM_BUFFER_NONE                           INVALID_VALUE_8
+
+//! Maximum number of registered bus event handlers
+#define DATAFLASH_SIM_HANDLER_NUM                           (8)
+
+//! Simulated chip struct type
+typedef struct DATAFLASH_SIM_CHIP_STRUCT
+{
+    DATAFLASH_SIM_CONFIG_TYPE   Config;
+    BOOL_TYPE                   Initialized;
+    uint8_t*                    Memory;                     // Page_Num pages of the DataFlash (extended) page size
+    uint8_t*                    Buffer[2];
+    uint32_t*                   Page_Erase_Count;
+    uint32_t*                   Page_Program_Count;         // Programs since last erase of the page
+    uint16_t                    Extended_Page_Size;
+    BOOL_TYPE                   Power_Of_Two_Pages;
+    BOOL_TYPE                   Compare_Mismatch;
+
+    // Ongoing transaction
+    BOOL_TYPE                   Selected;
+    uint8_t                     Header[DATAFLASH_SIM_HEADER_MAX_BYTES];
+    uint8_t                     Header_Length;
+    uint8_t                     Header_Expected;
+    BOOL_TYPE                   Command_Accepted;
+    uint16_t                    Page;
+    uint16_t                    Byte;
+    uint32_t                    Data_Count;
+    BOOL_TYPE                   Status_Second_Byte;
+
+    // Ongoing internal operation
+    uint64_t                    Busy_Until_Us;
+    uint8_t                     Busy_Buffer;
+
+    // Ongoing bus transfer
+    BOOL_TYPE                   Transfer_Pending;
+    uint8_t                     Transfer_Process;
+    uint16_t                    Transfer_Size;
+
+    DATAFLASH_SIM_STATS_TYPE    Stats;
+} DATAFLASH_SIM_CHIP_TYPE;
+
+//! Registered bus event handler struct type
+typedef struct DATAFLASH_SIM_HANDLER_STRUCT
+{
+    CALLBACK_HANDLER_TYPE       Handler;
+    uint16_t                    Filter_Id;
+} DATAFLASH_SIM_HANDLER_TYPE;
+
+static DATAFLASH_SIM_CHIP_TYPE DataFlashSim_Chip[DATAFLASH_SIM_CH_NUM];
+static DATAFLASH_SIM_HANDLER_TYPE DataFlashSim_Handler[DATAFLASH_SIM_HANDLER_NUM];
+static uint8_t DataFlashSim_Handler_Num;
+static BOOL_TYPE DataFlashSim_Pin[DATAFLASH_SIM_PIN_NUM];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static uint8_t Clock(DATAFLASH_SIM_CHIP_TYPE* chip, uint8_t mosi);
+static uint8_t GetHeaderLength(uint8_t opcode);
+static void StartCommand(DATAFLASH_SIM_CHIP_TYPE* chip);
+static void ExecuteCommand(DATAFLASH_SIM_CHIP_TYPE* chip);
+static uint8_t DataOut(DATAFLASH_SIM_CHIP_TYPE* chip);
+static void DataIn(DATAFLASH_SIM_CHIP_TYPE* chip, uint8_t mosi);
+static BOOL_TYPE IsBusy(const DATAFLASH_SIM_CHIP_TYPE* chip);
+static void SetBusy(DATAFLASH_SIM_CHIP_TYPE* chip, uint32_t time_us, uint8_t buffer);
+static void ReadyEdge(void* context);
+static uint8_t* GetPage(DATAFLASH_SIM_CHIP_TYPE* chip, uint16_t page);
+static uint16_t GetPageSize(const DATAFLASH_SIM_CHIP_TYPE* chip);
+static void ProgramPage(DATAFLASH_SIM_CHIP_TYPE* chip, uint16_t page, const uint8_t* data, BOOL_TYPE erase);
+static void ErasePages(DATAFLASH_SIM_CHIP_TYPE* chip, uint16_t first_page, uint16_t page_num);
+static BOOL_TYPE StartTransfer(uint8_t channel, uint8_t process, uint16_t size, uint32_t address);
+static void TransferComplete(void* context);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Fills a configuration with an AT45DB021E (2 Mbit, 1024 pages) at 10 MHz and its typical datasheet timings
+ * @param   config: configuration to fill
+ */
+void DataFlashSim__GetDefaultConfig(DATAFLASH_SIM_CONFIG_TYPE* config)
+{
+    memset(config, 0x00, sizeof(DATAFLASH_SIM_CONFIG_TYPE));
+
+    config->Page_Size = 256;
+    config->Page_Num = 1024;
+    config->Pages_Per_Block = 8;
+    config->Pages_Per_Sector = 128;
+    config->Power_Of_Two_Pages = TRUE;
+    config->Density_Code = 0x05;
+    config->Jedec_Id[0] = 0x1f;
+    config->Jedec_Id[1] = 0x23;
+    config->Jedec_Id[2] = 0x00;
+    config->Ready_Pin = DATAFLASH_SIM_PIN_NONE;
+
+    config->Timing.Spi_Clock_Hz = 10000000;
+    config->Timing.Bus_Call_Overhead_Us = 2;
+    config->Timing.Buffer_Transfer_Us = 200;
+    config->Timing.Buffer_Compare_Us = 200;
+    config->Timing.Page_Erase_Program_Us = 9000;
+    config->Timing.Page_Program_Us = 1500;
+    config->Timing.Page_Erase_Us = 7000;
+    config->Timing.Block_Erase_Us = 25000;
+    config->Timing.Sector_Erase_Us = 400000;
+    config->Timing.Chip_Erase_Us = 3000000;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Creates a simulated chip, erased, on a bus channel
+ * @param   channel: bus channel of the chip
+ * @param   config: part configuration
+ * @return  TRUE if the chip was created
+ */
+BOOL_TYPE DataFlashSim__Initialize(uint8_t channel, const DATAFLASH_SIM_CONFIG_TYPE* config)
+{
+    BOOL_TYPE success = FALSE;
+
+    if(channel < DATAFLASH_SIM_CH_NUM)
+    {
+        DATAFLASH_SIM_CHIP_TYPE* chip = &DataFlashSim_Chip[channel];
+
+        if(chip->Initialized == TRUE)
+        {
+            free(chip->Memory);
+            free(chip->Buffer[0]);
+            free(chip->Buffer[1]);
+            free(chip->Page_Erase_Count);
+            free(chip->Page_Program_Count);
+        }
+
+        memset(chip, 0x00, sizeof(DATAFLASH_SIM_CHIP_TYPE));
+        chip->Config = *config;
+        chip->Extended_Page_Size = config->Page_Size + (config->Page_Size / 32);
+        chip->Power_Of_Two_Pages = config->Power_Of_Two_Pages;
+        chip->Busy_Buffer = DATAFLASH_SIM_BUFFER_NONE;
+
+        chip->Memory = malloc((size_t)config->Page_Num * chip->Extended_Page_Size);
+        chip->Buffer[0] = malloc(chip->Extended_Page_Size);
+        chip->Buffer[1] = malloc(chip->Extended_Page_Size);
+        chip->Page_Erase_Count = calloc(config->Page_Num, sizeof(uint32_t));
+        chip->Page_Program_Count = calloc(config->Page_Num, sizeof(uint32_t));
+        SYS_ASSERT((chip->Memory != NULL) && (chip->Buffer[0] != NULL) && (chip->Buffer[1] != NULL) &&
+                   (chip->Page_Erase_Count != NULL) && (chip->Page_Program_Count != NULL));
+
+        memset(chip->Memory, 0xff, (size_t)config->Page_Num * chip->Extended_Page_Size);
+        memset(chip->Buffer[0], 0xff, chip->Extended_Page_Size);
+        memset(chip->Buffer[1], 0xff, chip->Extended_Page_Size);
+
+        chip->Initialized = TRUE;
+        success = TRUE;
+    }
+    return success;
+}
+
+void DataFlashSim__Deinitialize(void)
+{
+    for(uint8_t channel = 0; channel < DATAFLASH_SIM_CH_NUM; channel++)
+    {
+        if(DataFlashSim_Chip[channel].Initialized == TRUE)
+        {
+            free(DataFlashSim_Chip[channel].Memory);
+            free(DataFlashSim_Chip[channel].Buffer[0]);
+            free(DataFlashSim_Chip[channel].Buffer[1]);
+            free(DataFlashSim_Chip[channel].Page_Erase_Count);
+            free(DataFlashSim_Chip[channel].Page_Program_Count);
+        }
+    }
+    memset(DataFlashSim_Chip, 0x00, sizeof(DataFlashSim_Chip));
+    DataFlashSim_Handler_Num = 0;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gives direct access to the array, pages are laid out with the DataFlash (extended) page size
+ * @param   channel: bus channel of the chip
+ * @return  pointer to the array, NULL if the chip does not exist
+ */
+uint8_t* DataFlashSim__GetMemory(uint8_t channel)
+{
+    uint8_t* memory = NULL;
+
+    if((channel < DATAFLASH_SIM_CH_NUM) && (DataFlashSim_Chip[channel].Initialized == TRUE))
+    {
+        memory = DataFlashSim_Chip[channel].Memory;
+    }
+    return memory;
+}
+
+uint32_t DataFlashSim__GetMemorySize(uint8_t channel)
+{
+    uint32_t size = 0;
+
+    if((channel < DATAFLASH_SIM_CH_NUM) && (DataFlashSim_Chip[channel].Initialized == TRUE))
+    {
+        size = (uint32_t)DataFlashSim_Chip[channel].Config.Page_Num * DataFlashSim_Chip[channel].Extended_Page_Size;
+    }
+    return size;
+}
+
+const DATAFLASH_SIM_STATS_TYPE* DataFlashSim__GetStats(uint8_t channel)
+{
+    const DATAFLASH_SIM_STATS_TYPE* stats = NULL;
+
+    if(channel < DATAFLASH_SIM_CH_NUM)
+    {
+        stats = &DataFlashSim_Chip[channel].Stats;
+    }
+    return stats;
+}
+
+void DataFlashSim__ResetStats(uint8_t channel)
+{
+    if(channel < DATAFLASH_SIM_CH_NUM)
+    {
+        memset(&DataFlashSim_Chip[channel].Stats, 0x00, sizeof(DATAFLASH_SIM_STATS_TYPE));
+    }
+}
+
+void DataFlashSim__GetPageWear(uint8_t channel, uint16_t page, uint32_t* erase_count, uint32_t* program_count)
+{
+    *erase_count = 0;
+    *program_count = 0;
+
+    if((channel < DATAFLASH_SIM_CH_NUM) &&
+       (DataFlashSim_Chip[channel].Initialized == TRUE) &&
+       (page < DataFlashSim_Chip[channel].Config.Page_Num))
+    {
+        *erase_count = DataFlashSim_Chip[channel].Page_Erase_Count[page];
+        *program_count = DataFlashSim_Chip[channel].Page_Program_Count[page];
+    }
+}
+
+BOOL_TYPE DataFlashSim__IsReady(uint8_t channel)
+{
+    BOOL_TYPE ready = FALSE;
+
+    if(channel < DATAFLASH_SIM_CH_NUM)
+    {
+        ready = (IsBusy(&DataFlashSim_Chip[channel]) == TRUE) ? FALSE : TRUE;
+    }
+    return ready;
+}
+
+//=====================================================================================================================
+//-------------------------------------- Generic Comm Bus Interface ---------------------------------------------------
+//=====================================================================================================================
+
+uint8_t DataFlashSim__GetAllocation(uint8_t bound_id)
+{
+    uint8_t channel = INVALID_VALUE_8;
+
+    if((bound_id < DATAFLASH_SIM_CH_NUM) && (DataFlashSim_Chip[bound_id].Initialized == TRUE))
+    {
+        channel = bound_id;
+    }
+    return channel;
+}
+
+void DataFlashSim__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value)
+{
+    (void)filter_value;
+
+    SYS_ASSERT(DataFlashSim_Handler_Num < DATAFLASH_SIM_HANDLER_NUM);
+
+    DataFlashSim_Handler[DataFlashSim_Handler_Num].Handler = event_handler;
+    DataFlashSim_Handler[DataFlashSim_Handler_Num].Filter_Id = filter_id;
+    DataFlashSim_Handler_Num++;
+}
+
+BOOL_TYPE DataFlashSim__StartTransaction(uint8_t channel)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((channel < DATAFLASH_SIM_CH_NUM) && (DataFlashSim_Chip[channel].Initialized == TRUE))
+    {
+        DATAFLASH_SIM_CHIP_TYPE* chip = &DataFlashSim_Chip[channel];
+
+        if(chip->Selected == TRUE)
+        {
+            // Chip select already asserted: the ongoing command goes on
+            chip->Stats.Protocol_Errors++;
+        }
+        else
+        {
+            chip->Selected = TRUE;
+            chip->Header_Length = 0;
+            chip->Header_Expected = 1;
+            chip->Command_Accepted = FALSE;
+            chip->Data_Count = 0;
+            chip->Status_Second_Byte = FALSE;
+            chip->Stats.Transactions++;
+        }
+        success = TRUE;
+    }
+    return success;
+}
+
+void DataFlashSim__StopTransaction(uint8_t channel)
+{
+    if((channel < DATAFLASH_SIM_CH_NUM) && (DataFlashSim_Chip[channel].Selected == TRUE))
+    {
+        DATAFLASH_SIM_CHIP_TYPE* chip = &DataFlashSim_Chip[channel];
+
+        chip->Selected = FALSE;
+
+        if(chip->Header_Length < chip->Header_Expected)
+        {
+            // Truncated command, ignored by the chip
+            if(chip->Header_Length > 0)
+            {
+                chip->Stats.Protocol_Errors++;
+            }
+        }
+        else if(chip->Command_Accepted == TRUE)
+        {
+            ExecuteCommand(chip);
+        }
+    }
+}
+
+BOOL_TYPE DataFlashSim__Write(uint8_t channel, void* data, uint32_t address, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((channel < DATAFLASH_SIM_CH_NUM) && (DataFlashSim_Chip[channel].Selected == TRUE))
+    {
+        if(StartTransfer(channel, DATAFLASH_SIM_BUS_PROCESS_WRITE, size, address) == TRUE)
+        {
+            for(uint16_t index = 0; index < size; index++)
+            {
+                (void)Clock(&DataFlashSim_Chip[channel], ((uint8_t*)data)[index]);
+            }
+            success = TRUE;
+        }
+    }
+    return success;
+}
+
+BOOL_TYPE DataFlashSim__Read(uint8_t channel, void* data, uint32_t address, uint16_t size)
+{
+    BOOL_TYPE success = FALSE;
+
+    if((channel < DATAFLASH_SIM_CH_NUM) && (DataFlashSim_Chip[channel].Selected == TRUE))
+    {
+        if(StartTransfer(channel, DATAFLASH_SIM_BUS_PROCESS_READ, size, address) == TRUE)
+        {
+            for(uint16_t index = 0; index < size; index++)
+            {
+                ((uint8_t*)data)[index] = Clock(&DataFlashSim_Chip[channel], 0x00);
+            }
+            success = TRUE;
+        }
+    }
+    return success;
+}
+
+//=====================================================================================================================
+//-------------------------------------- Generic IO Interface ---------------------------------------------------------
+//=====================================================================================================================
+
+BOOL_TYPE DataFlashSim__DigitalRead(uint8_t pin)
+{
+    BOOL_TYPE level = FALSE;
+
+    if(pin < DATAFLASH_SIM_PIN_NUM)
+    {
+        level = DataFlashSim_Pin[pin];
+
+        // RDY/BUSY output of a chip
+        for(uint8_t channel = 0; channel < DATAFLASH_SIM_CH_NUM; channel++)
+        {
+            if((DataFlashSim_Chip[channel].Initialized == TRUE) && (DataFlashSim_Chip[channel].Config.Ready_Pin == pin))
+            {
+                level = (IsBusy(&DataFlashSim_Chip[channel]) == TRUE) ? FALSE : TRUE;
+            }
+        }
+    }
+    return level;
+}
+
+void DataFlashSim__DigitalWrite(uint8_t pin, BOOL_TYPE level)
+{
+    if(pin < DATAFLASH_SIM_PIN_NUM)
+    {
+        DataFlashSim_Pin[pin] = level;
+    }
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Clocks one byte on the SPI
+ * @param   chip: selected chip
+ * @param   mosi: byte sent to the chip
+ * @return  byte received from the chip
+ */
+static uint8_t Clock(DATAFLASH_SIM_CHIP_TYPE* chip, uint8_t mosi)
+{
+    uint8_t miso = 0xff;
+
+    if(chip->Header_Length < chip->Header_Expected)
+    {
+        chip->Header[chip->Header_Length++] = mosi;
+
+        if(chip->Header_Length == 1)
+        {
+            chip->Header_Expected = GetHeaderLength(mosi);
+            if(chip->Header_Expected == 0)
+            {
+                // Unknown opcode, the rest of the transaction is ignored and not counted again as truncated
+                chip->Header_Expected = 1;
+                chip->Stats.Protocol_Errors++;
+            }
+        }
+
+        if((chip->Header_Length == chip->Header_Expected) && (GetHeaderLength(chip->Header[0]) != 0))
+        {
+            StartCommand(chip);
+        }
+    }
+    else if(chip->Command_Accepted == TRUE)
+    {
+        miso = DataOut(chip);
+        DataIn(chip, mosi);
+        chip->Data_Count++;
+    }
+    return miso;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Header length, opcode included, of each supported command
+ * @param   opcode: command opcode
+ * @return  header length in bytes, 0 for unknown opcodes
+ */
+static uint8_t GetHeaderLength(uint8_t opcode)
+{
+    uint8_t length = 0;
+
+    switch(opcode)
+    {
+      case DATAFLASH_SIM_CMD_STATUS_REGISTER_READ:
+      case DATAFLASH_SIM_CMD_MANUFACTURER_ID_READ:
+        length = 1;
+        break;
+
+      case DATAFLASH_SIM_CMD_CONTINUOUS_READ_LP:
+      case DATAFLASH_SIM_CMD_CONTINUOUS_READ_LF:
+      case DATAFLASH_SIM_CMD_BUFFER_1_READ_LF:
+      case DATAFLASH_SIM_CMD_BUFFER_2_READ_LF:
+      case DATAFLASH_SIM_CMD_BUFFER_1_WRITE:
+      case DATAFLASH_SIM_CMD_BUFFER_2_WRITE:
+      case DATAFLASH_SIM_CMD_BUFFER_1_TO_MAIN_ERASE:
+      case DATAFLASH_SIM_CMD_BUFFER_2_TO_MAIN_ERASE:
+      case DATAFLASH_SIM_CMD_BUFFER_1_TO_MAIN_NO_ERASE:
+      case DATAFLASH_SIM_CMD_BUFFER_2_TO_MAIN_NO_ERASE:
+      case DATAFLASH_SIM_CMD_MAIN_PROGRAM_BUFFER_1:
+      case DATAFLASH_SIM_CMD_MAIN_PROGRAM_BUFFER_2:
+      case DATAFLASH_SIM_CMD_PAGE_PROGRAM_NO_ERASE:
+      case DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_1:
+      case DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_2:
+      case DATAFLASH_SIM_CMD_MAIN_TO_BUFFER_1:
+      case DATAFLASH_SIM_CMD_MAIN_TO_BUFFER_2:
+      case DATAFLASH_SIM_CMD_COMPARE_BUFFER_1:
+      case DATAFLASH_SIM_CMD_COMPARE_BUFFER_2:
+      case DATAFLASH_SIM_CMD_PAGE_ERASE:
+      case DATAFLASH_SIM_CMD_BLOCK_ERASE:
+      case DATAFLASH_SIM_CMD_SECTOR_ERASE:
+      case DATAFLASH_SIM_CMD_CHIP_ERASE:
+      case DATAFLASH_SIM_CMD_CONFIGURATION:
+        length = 1 + DATAFLASH_SIM_ADDRESS_BYTES;
+        break;
+
+      case DATAFLASH_SIM_CMD_CONTINUOUS_READ_HF:
+      case DATAFLASH_SIM_CMD_BUFFER_1_READ_HF:
+      case DATAFLASH_SIM_CMD_BUFFER_2_READ_HF:
+        length = 1 + DATAFLASH_SIM_ADDRESS_BYTES + 1;
+        break;
+
+      case DATAFLASH_SIM_CMD_MAIN_MEMORY_PAGE_READ:
+        length = 1 + DATAFLASH_SIM_ADDRESS_BYTES + 4;
+        break;
+
+      default:
+        break;
+    }
+    return length;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Decodes the address of a complete header and prepares the data phase
+ * @param   chip: selected chip
+ */
+static void StartCommand(DATAFLASH_SIM_CHIP_TYPE* chip)
+{
+    uint8_t opcode = chip->Header[0];
+    uint32_t address = ((uint32_t)chip->Header[1] << 16) | ((uint32_t)chip->Header[2] << 8) | chip->Header[3];
+    uint8_t byte_bits = 0;
+    uint8_t buffer = DATAFLASH_SIM_BUFFER_NONE;
+
+    // Byte address bits: log2 of the power of two page size, one more for DataFlash page size
+    while((1u << byte_bits) < chip->Config.Page_Size)
+    {
+        byte_bits++;
+    }
+    if(chip->Power_Of_Two_Pages == FALSE)
+    {
+        byte_bits++;
+    }
+
+    chip->Page = (uint16_t)((address >> byte_bits) % chip->Config.Page_Num);
+    chip->Byte = (uint16_t)((address & ((1u << byte_bits) - 1)) % GetPageSize(chip));
+
+    switch(opcode)
+    {
+      case DATAFLASH_SIM_CMD_BUFFER_1_READ_HF:
+      case DATAFLASH_SIM_CMD_BUFFER_1_READ_LF:
+      case DATAFLASH_SIM_CMD_BUFFER_1_WRITE:
+      case DATAFLASH_SIM_CMD_BUFFER_1_TO_MAIN_ERASE:
+      case DATAFLASH_SIM_CMD_BUFFER_1_TO_MAIN_NO_ERASE:
+      case DATAFLASH_SIM_CMD_MAIN_PROGRAM_BUFFER_1:
+      case DATAFLASH_SIM_CMD_PAGE_PROGRAM_NO_ERASE:
+      case DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_1:
+      case DATAFLASH_SIM_CMD_MAIN_TO_BUFFER_1:
+      case DATAFLASH_SIM_CMD_COMPARE_BUFFER_1:
+        buffer = 0;
+        break;
+
+      case DATAFLASH_SIM_CMD_BUFFER_2_READ_HF:
+      case DATAFLASH_SIM_CMD_BUFFER_2_READ_LF:
+      case DATAFLASH_SIM_CMD_BUFFER_2_WRITE:
+      case DATAFLASH_SIM_CMD_BUFFER_2_TO_MAIN_ERASE:
+      case DATAFLASH_SIM_CMD_BUFFER_2_TO_MAIN_NO_ERASE:
+      case DATAFLASH_SIM_CMD_MAIN_PROGRAM_BUFFER_2:
+      case DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_2:
+      case DATAFLASH_SIM_CMD_MAIN_TO_BUFFER_2:
+      case DATAFLASH_SIM_CMD_COMPARE_BUFFER_2:
+        buffer = 1;
+        break;
+
+      default:
+        break;
+    }
+
+    // While busy only status/ID reads and accesses to the buffer not used by the ongoing operation are accepted
+    if((IsBusy(chip) == TRUE) &&
+       (opcode != DATAFLASH_SIM_CMD_STATUS_REGISTER_READ) &&
+       (opcode != DATAFLASH_SIM_CMD_MANUFACTURER_ID_READ) &&
+       (((opcode != DATAFLASH_SIM_CMD_BUFFER_1_READ_HF) && (opcode != DATAFLASH_SIM_CMD_BUFFER_1_READ_LF) &&
+         (opcode != DATAFLASH_SIM_CMD_BUFFER_2_READ_HF) && (opcode != DATAFLASH_SIM_CMD_BUFFER_2_READ_LF) &&
+         (opcode != DATAFLASH_SIM_CMD_BUFFER_1_WRITE) && (opcode != DATAFLASH_SIM_CMD_BUFFER_2_WRITE)) ||
+        (buffer == chip->Busy_Buffer)))
+    {
+        chip->Stats.Busy_Violations++;
+        chip->Command_Accepted = FALSE;
+    }
+    else
+    {
+        chip->Command_Accepted = TRUE;
+
+        switch(opcode)
+        {
+          case DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_1:
+          case DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_2:
+            // Page is transferred to the buffer before the data phase
+            memcpy(chip->Buffer[buffer], GetPage(chip, chip->Page), chip->Extended_Page_Size);
+            break;
+
+          case DATAFLASH_SIM_CMD_PAGE_PROGRAM_NO_ERASE:
+            // Only the bytes clocked in are programmed
+            memset(chip->Buffer[0], 0xff, chip->Extended_Page_Size);
+            break;
+
+          case DATAFLASH_SIM_CMD_STATUS_REGISTER_READ:
+            chip->Stats.Status_Reads++;
+            break;
+
+          case DATAFLASH_SIM_CMD_MAIN_MEMORY_PAGE_READ:
+          case DATAFLASH_SIM_CMD_CONTINUOUS_READ_LP:
+          case DATAFLASH_SIM_CMD_CONTINUOUS_READ_LF:
+          case DATAFLASH_SIM_CMD_CONTINUOUS_READ_HF:
+            chip->Stats.Page_Reads++;
+            break;
+
+          default:
+            break;
+        }
+
+        if((buffer != DATAFLASH_SIM_BUFFER_NONE) &&
+           (opcode != DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_1) && (opcode != DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_2))
+        {
+            chip->Stats.Buffer_Accesses++;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Executes the command of the transaction when the chip select is released
+ * @param   chip: chip just deselected
+ */
+static void ExecuteCommand(DATAFLASH_SIM_CHIP_TYPE* chip)
+{
+    const DATAFLASH_SIM_TIMING_TYPE* timing = &chip->Config.Timing;
+    uint8_t opcode = chip->Header[0];
+
+    switch(opcode)
+    {
+      case DATAFLASH_SIM_CMD_BUFFER_1_TO_MAIN_ERASE:
+      case DATAFLASH_SIM_CMD_MAIN_PROGRAM_BUFFER_1:
+      case DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_1:
+        ProgramPage(chip, chip->Page, chip->Buffer[0], TRUE);
+        SetBusy(chip, timing->Page_Erase_Program_Us, 0);
+        break;
+
+      case DATAFLASH_SIM_CMD_BUFFER_2_TO_MAIN_ERASE:
+      case DATAFLASH_SIM_CMD_MAIN_PROGRAM_BUFFER_2:
+      case DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_2:
+        ProgramPage(chip, chip->Page, chip->Buffer[1], TRUE);
+        SetBusy(chip, timing->Page_Erase_Program_Us, 1);
+        break;
+
+      case DATAFLASH_SIM_CMD_BUFFER_1_TO_MAIN_NO_ERASE:
+      case DATAFLASH_SIM_CMD_PAGE_PROGRAM_NO_ERASE:
+        ProgramPage(chip, chip->Page, chip->Buffer[0], FALSE);
+        SetBusy(chip, timing->Page_Program_Us, 0);
+        break;
+
+      case DATAFLASH_SIM_CMD_BUFFER_2_TO_MAIN_NO_ERASE:
+        ProgramPage(chip, chip->Page, chip->Buffer[1], FALSE);
+        SetBusy(chip, timing->Page_Program_Us, 1);
+        break;
+
+      case DATAFLASH_SIM_CMD_MAIN_TO_BUFFER_1:
+      case DATAFLASH_SIM_CMD_MAIN_TO_BUFFER_2:
+        memcpy(chip->Buffer[opcode == DATAFLASH_SIM_CMD_MAIN_TO_BUFFER_2], GetPage(chip, chip->Page), chip->Extended_Page_Size);
+        chip->Stats.Buffer_Transfers++;
+        SetBusy(chip, timing->Buffer_Transfer_Us, (opcode == DATAFLASH_SIM_CMD_MAIN_TO_BUFFER_2));
+        break;
+
+      case DATAFLASH_SIM_CMD_COMPARE_BUFFER_1:
+      case DATAFLASH_SIM_CMD_COMPARE_BUFFER_2:
+        chip->Compare_Mismatch = (memcmp(chip->Buffer[opcode == DATAFLASH_SIM_CMD_COMPARE_BUFFER_2],
+                                         GetPage(chip, chip->Page), GetPageSize(chip)) != 0) ? TRUE : FALSE;
+        SetBusy(chip, timing->Buffer_Compare_Us, (opcode == DATAFLASH_SIM_CMD_COMPARE_BUFFER_2));
+        break;
+
+      case DATAFLASH_SIM_CMD_PAGE_ERASE:
+        ErasePages(chip, chip->Page, 1);
+        SetBusy(chip, timing->Page_Erase_Us, DATAFLASH_SIM_BUFFER_NONE);
+        break;
+
+      case DATAFLASH_SIM_CMD_BLOCK_ERASE:
+        ErasePages(chip, chip->Page - (chip->Page % chip->Config.Pages_Per_Block), chip->Config.Pages_Per_Block);
+        chip->Stats.Block_Erases++;
+        SetBusy(chip, timing->Block_Erase_Us, DATAFLASH_SIM_BUFFER_NONE);
+        break;
+
+      case DATAFLASH_SIM_CMD_SECTOR_ERASE:
+        ErasePages(chip, chip->Page - (chip->Page % chip->Config.Pages_Per_Sector), chip->Config.Pages_Per_Sector);
+        chip->Stats.Sector_Erases++;
+        SetBusy(chip, timing->Sector_Erase_Us, DATAFLASH_SIM_BUFFER_NONE);
+        break;
+
+      case DATAFLASH_SIM_CMD_CHIP_ERASE:
+        if((chip->Header[1] == 0x94) && (chip->Header[2] == 0x80) && (chip->Header[3] == 0x9a))
+        {
+            ErasePages(chip, 0, chip->Config.Page_Num);
+            chip->Stats.Chip_Erases++;
+            SetBusy(chip, timing->Chip_Erase_Us, DATAFLASH_SIM_BUFFER_NONE);
+        }
+        break;
+
+      case DATAFLASH_SIM_CMD_CONFIGURATION:
+        if((chip->Header[1] == 0x2a) && (chip->Header[2] == 0x80) && ((chip->Header[3] & 0xfe) == 0xa6))
+        {
+            // a6: power of two page size, a7: DataFlash page size
+            chip->Power_Of_Two_Pages = (chip->Header[3] == 0xa6) ? TRUE : FALSE;
+            SetBusy(chip, timing->Page_Erase_Program_Us, DATAFLASH_SIM_BUFFER_NONE);
+        }
+        break;
+
+      default:
+        // Read commands, buffer writes: nothing to execute
+        break;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Byte clocked out by the chip in the data phase
+ * @param   chip: selected chip
+ * @return  byte clocked out
+ */
+static uint8_t DataOut(DATAFLASH_SIM_CHIP_TYPE* chip)
+{
+    uint8_t miso = 0xff;
+    uint16_t page_size = GetPageSize(chip);
+
+    switch(chip->Header[0])
+    {
+      case DATAFLASH_SIM_CMD_STATUS_REGISTER_READ:
+        // Status register is output continuously, byte 1 then byte 2
+        if(chip->Status_Second_Byte == FALSE)
+        {
+            miso = (uint8_t)(chip->Config.Density_Code << DATAFLASH_SIM_STATUS_DENSITY_SHIFT);
+            miso |= (IsBusy(chip) == FALSE) ? DATAFLASH_SIM_STATUS_RDY : 0;
+            miso |= (chip->Compare_Mismatch == TRUE) ? DATAFLASH_SIM_STATUS_COMP : 0;
+            miso |= (chip->Power_Of_Two_Pages == TRUE) ? DATAFLASH_SIM_STATUS_PAGE_SIZE : 0;
+        }
+        else
+        {
+            miso = (IsBusy(chip) == FALSE) ? DATAFLASH_SIM_STATUS_RDY : 0;
+        }
+        chip->Status_Second_Byte = (chip->Status_Second_Byte == FALSE) ? TRUE : FALSE;
+        break;
+
+      case DATAFLASH_SIM_CMD_MANUFACTURER_ID_READ:
+        // Manufacturer id, device id 1 and 2, extended device information length and byte
+        miso = (chip->Data_Count < sizeof(chip->Config.Jedec_Id)) ? chip->Config.Jedec_Id[chip->Data_Count] : 0x00;
+        break;
+
+      case DATAFLASH_SIM_CMD_MAIN_MEMORY_PAGE_READ:
+        // Wraps around within the page
+        miso = GetPage(chip, chip->Page)[chip->Byte];
+        chip->Byte = (chip->Byte + 1) % page_size;
+        break;
+
+      case DATAFLASH_SIM_CMD_CONTINUOUS_READ_LP:
+      case DATAFLASH_SIM_CMD_CONTINUOUS_READ_LF:
+      case DATAFLASH_SIM_CMD_CONTINUOUS_READ_HF:
+        // Continues on the next page, wraps around at the end of the array
+        miso = GetPage(chip, chip->Page)[chip->Byte];
+        if(++chip->Byte == page_size)
+        {
+            chip->Byte = 0;
+            chip->Page = (chip->Page + 1) % chip->Config.Page_Num;
+            chip->Stats.Page_Reads++;
+        }
+        break;
+
+      case DATAFLASH_SIM_CMD_BUFFER_1_READ_HF:
+      case DATAFLASH_SIM_CMD_BUFFER_1_READ_LF:
+        miso = chip->Buffer[0][chip->Byte];
+        chip->Byte = (chip->Byte + 1) % page_size;
+        break;
+
+      case DATAFLASH_SIM_CMD_BUFFER_2_READ_HF:
+      case DATAFLASH_SIM_CMD_BUFFER_2_READ_LF:
+        miso = chip->Buffer[1][chip->Byte];
+        chip->Byte = (chip->Byte + 1) % page_size;
+        break;
+
+      default:
+        break;
+    }
+    return miso;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Byte clocked in the chip in the data phase
+ * @param   chip: selected chip
+ * @param   mosi: byte clocked in
+ */
+static void DataIn(DATAFLASH_SIM_CHIP_TYPE* chip, uint8_t mosi)
+{
+    uint16_t page_size = GetPageSize(chip);
+
+    switch(chip->Header[0])
+    {
+      case DATAFLASH_SIM_CMD_BUFFER_1_WRITE:
+      case DATAFLASH_SIM_CMD_MAIN_PROGRAM_BUFFER_1:
+      case DATAFLASH_SIM_CMD_PAGE_PROGRAM_NO_ERASE:
+      case DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_1:
+        // Wraps around within the buffer
+        chip->Buffer[0][chip->Byte] = mosi;
+        chip->Byte = (chip->Byte + 1) % page_size;
+        break;
+
+      case DATAFLASH_SIM_CMD_BUFFER_2_WRITE:
+      case DATAFLASH_SIM_CMD_MAIN_PROGRAM_BUFFER_2:
+      case DATAFLASH_SIM_CMD_READ_MODIFY_WRITE_2:
+        chip->Buffer[1][chip->Byte] = mosi;
+        chip->Byte = (chip->Byte + 1) % page_size;
+        break;
+
+      default:
+        // Commands without data input ignore the MOSI line
+        break;
+    }
+}
+
+static BOOL_TYPE IsBusy(const DATAFLASH_SIM_CHIP_TYPE* chip)
+{
+    return (SystemTimersSim__GetUs() < chip->Busy_Until_Us) ? TRUE : FALSE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts an internal operation, the chip is busy until it ends
+ * @param   chip: chip
+ * @param   time_us: operation time
+ * @param   buffer: buffer used by the operation, DATAFLASH_SIM_BUFFER_NONE if none
+ */
+static void SetBusy(DATAFLASH_SIM_CHIP_TYPE* chip, uint32_t time_us, uint8_t buffer)
+{
+    chip->Busy_Until_Us = SystemTimersSim__GetUs() + time_us;
+    chip->Busy_Buffer = buffer;
+    chip->Stats.Busy_Time_Us += time_us;
+
+    if(chip->Config.Ready_Interrupt != NULL)
+    {
+        SystemTimersSim__ScheduleEvent(time_us, ReadyEdge, chip);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   RDY/BUSY rising edge interrupt, deferred event scheduled at the end of the internal operation
+ * @param   context: chip
+ */
+static void ReadyEdge(void* context)
+{
+    DATAFLASH_SIM_CHIP_TYPE* chip = (DATAFLASH_SIM_CHIP_TYPE*)context;
+
+    if((IsBusy(chip) == FALSE) && (chip->Config.Ready_Interrupt != NULL))
+    {
+        chip->Config.Ready_Interrupt();
+    }
+}
+
+static uint8_t* GetPage(DATAFLASH_SIM_CHIP_TYPE* chip, uint16_t page)
+{
+    return &chip->Memory[(uint32_t)page * chip->Extended_Page_Size];
+}
+
+static uint16_t GetPageSize(const DATAFLASH_SIM_CHIP_TYPE* chip)
+{
+    return (chip->Power_Of_Two_Pages == TRUE) ? chip->Config.Page_Size : chip->Extended_Page_Size;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Programs a page from a buffer
+ * @param   chip: chip
+ * @param   page: page to program
+ * @param   data: buffer content
+ * @param   erase: TRUE to erase the page first, FALSE to only program bits from 1 to 0
+ */
+static void ProgramPage(DATAFLASH_SIM_CHIP_TYPE* chip, uint16_t page, const uint8_t* data, BOOL_TYPE erase)
+{
+    uint8_t* target = GetPage(chip, page);
+    uint16_t page_size = GetPageSize(chip);
+
+    if(erase == TRUE)
+    {
+        ErasePages(chip, page, 1);
+    }
+
+    for(uint16_t index = 0; index < page_size; index++)
+    {
+        target[index] &= data[index];
+    }
+
+    chip->Page_Program_Count[page]++;
+    chip->Stats.Page_Programs++;
+}
+
+static void ErasePages(DATAFLASH_SIM_CHIP_TYPE* chip, uint16_t first_page, uint16_t page_num)
+{
+    for(uint16_t page = first_page; (page < (first_page + page_num)) && (page < chip->Config.Page_Num); page++)
+    {
+        memset(GetPage(chip, page), 0xff, chip->Extended_Page_Size);
+        chip->Page_Erase_Count[page]++;
+        chip->Page_Program_Count[page] = 0;
+        chip->Stats.Page_Erases++;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts a bus transfer, its completion event is notified after the SPI transfer time
+ * @param   channel: bus channel
+ * @param   process: bus process reported in the event
+ * @param   size: transfer size in bytes
+ * @param   address: address phase, clocked out MSB first before the data, COMMBUS_ADDRESS_NONE if none
+ * @return  TRUE if started, FALSE if another transfer is still in progress
+ */
+static BOOL_TYPE StartTransfer(uint8_t channel, uint8_t process, uint16_t size, uint32_t address)
+{
+    DATAFLASH_SIM_CHIP_TYPE* chip = &DataFlashSim_Chip[channel];
+    BOOL_TYPE success = FALSE;
+
+    if(chip->Transfer_Pending == FALSE)
+    {
+        uint32_t bytes = (uint32_t)size + ((address != COMMBUS_ADDRESS_NONE) ? sizeof(uint32_t) : 0);
+        uint32_t time_us = chip->Config.Timing.Bus_Call_Overhead_Us +
+                           (uint32_t)((((uint64_t)bytes * 8 * 1000000) + chip->Config.Timing.Spi_Clock_Hz - 1) / chip->Config.Timing.Spi_Clock_Hz);
+
+        // Address phase, chained to the data in the same transfer
+        if(address != COMMBUS_ADDRESS_NONE)
+        {
+            for(int8_t shift = 24; shift >= 0; shift -= 8)
+            {
+                (void)Clock(chip, (uint8_t)(address >> shift));
+            }
+        }
+
+        chip->Transfer_Pending = TRUE;
+        chip->Transfer_Process = process;
+        chip->Transfer_Size = size;
+        chip->Stats.Bus_Calls++;
+        chip->Stats.Bus_Bytes += bytes;
+        chip->Stats.Bus_Time_Us += time_us;
+
+        SystemTimersSim__ScheduleEvent(time_us, TransferComplete, (void*)chip);
+        success = TRUE;
+    }
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Notifies the completion of a bus transfer to the handlers registered on its channel
+ * @param   context: chip
+ */
+static void TransferComplete(void* context)
+{
+    DATAFLASH_SIM_CHIP_TYPE* chip = (DATAFLASH_SIM_CHIP_TYPE*)context;
+    uint8_t channel = (uint8_t)(chip - DataFlashSim_Chip);
+    COMMON_I_CALLBACK_TYPE bus_event;
+    CALLBACK_EVENT_TYPE event;
+
+    chip->Transfer_Pending = FALSE;
+    chip->Stats.Bus_Events++;
+
+    bus_event.Generic_Provider_Id = chip->Config.Generic_Comm_Bus_Id;
+    bus_event.Source_Instance_Id = channel;
+    bus_event.Event_Value = COMBINE_BYTES(chip->Transfer_Process, chip->Transfer_Size);
+
+    memcpy(&event, &bus_event, sizeof(CALLBACK_EVENT_TYPE));
+
+    for(uint8_t index = 0; index < DataFlashSim_Handler_Num; index++)
+    {
+        if((DataFlashSim_Handler[index].Filter_Id == channel) ||
+           (DataFlashSim_Handler[index].Filter_Id == CALLBACK_FILTER_VALUE_NONE))
+        {
+            DataFlashSim_Handler[index].Handler(event);
+        }
+    }
+}
@@ -0,0 +1,129 @@
+/**
+ *  @file       DataFlashSim.h
+ *
+ *  @brief      Host (Linux) DataFlash simulator exposing the generic comm bus and generic IO interfaces.
+ *  @details    Emulates an AT45DB family DataFlash behind a virtual SPI channel: the command set used by the
+ *              ExternalFlash driver (reads, buffer accesses, read-modify-write, program, erase, status register,
+ *              JEDEC ID), a configurable SPI clock and the datasheet program/erase timings.
+ *              Bus transfers complete, and chip operations end, in the virtual time of SystemTimersSim, so the
+ *              driver can be benchmarked and regression tested without hardware.
+ *
+ *              Host builds map the bus provider used by EXTERNAL_FLASH_MAP to DATAFLASH_SIM_COMM_BUS_HANDLERS
+ *              and the digital IO provider to DATAFLASH_SIM_IO_HANDLERS.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+#ifndef DATAFLASHSIM_H_
+#define DATAFLASHSIM_H_
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "Callback.h"
+#include "CommonInterface.h"
+#include "Utilities.h"
+
+//-------------------------------------- PUBLIC (Variables, Constants & Defines) --------------------------------------
+
+//! Number of simulated chips, the bus channel of each chip is its index
+#define DATAFLASH_SIM_CH_NUM                (2)
+
+//! Number of simulated digital IO pins
+#define DATAFLASH_SIM_PIN_NUM               (16)
+#define DATAFLASH_SIM_PIN_NONE              INVALID_VALUE_8
+
+//! Datasheet timings of the simulated part, all in microseconds except the SPI clock
+typedef struct DATAFLASH_SIM_TIMING_STRUCT
+{
+    uint32_t                    Spi_Clock_Hz;
+    uint32_t                    Bus_Call_Overhead_Us;       // Driver/DMA setup time of every bus Read/Write call
+    uint32_t                    Buffer_Transfer_Us;         // tXFR
+    uint32_t                    Buffer_Compare_Us;          // tCOMP
+    uint32_t                    Page_Erase_Program_Us;      // tEP
+    uint32_t                    Page_Program_Us;            // tP
+    uint32_t                    Page_Erase_Us;              // tPE
+    uint32_t                    Block_Erase_Us;             // tBE
+    uint32_t                    Sector_Erase_Us;            // tSE
+    uint32_t                    Chip_Erase_Us;              // tCE
+} DATAFLASH_SIM_TIMING_TYPE;
+
+//! Simulated part configuration
+typedef struct DATAFLASH_SIM_CONFIG_STRUCT
+{
+    uint8_t                     Generic_Comm_Bus_Id;        // Provider id notified in the bus events
+    uint16_t                    Page_Size;                  // Power of two page size, the DataFlash page size is 33/32 of it
+    uint16_t                    Page_Num;
+    uint16_t                    Pages_Per_Block;
+    uint16_t                    Pages_Per_Sector;
+    BOOL_TYPE                   Power_Of_Two_Pages;         // Initial page size configuration
+    uint8_t                     Density_Code;               // Status register density bits
+    uint8_t                     Jedec_Id[5];                // Manufacturer id, device id 1 and 2, extended device information length and byte
+    DATAFLASH_SIM_TIMING_TYPE   Timing;
+    uint8_t                     Ready_Pin;                  // Digital IO pin wired to RDY/BUSY, high while ready, DATAFLASH_SIM_PIN_NONE if none
+    void                        (*Ready_Interrupt)(void);   // Called on the RDY/BUSY rising edge, NULL if none
+} DATAFLASH_SIM_CONFIG_TYPE;
+
+//! Simulated chip statistics
+typedef struct DATAFLASH_SIM_STATS_STRUCT
+{
+    uint32_t                    Transactions;               // Chip select assertions
+    uint32_t                    Bus_Calls;                  // Bus Read/Write calls
+    uint32_t                    Bus_Events;                 // Completion events notified
+    uint64_t                    Bus_Bytes;
+    uint64_t                    Bus_Time_Us;
+    uint32_t                    Status_Reads;
+    uint32_t                    Page_Reads;                 // Pages touched by array/page reads
+    uint32_t                    Buffer_Accesses;
+    uint32_t                    Buffer_Transfers;
+    uint32_t                    Page_Programs;
+    uint32_t                    Page_Erases;                // Including erases of block, sector and chip erase
+    uint32_t                    Block_Erases;
+    uint32_t                    Sector_Erases;
+    uint32_t                    Chip_Erases;
+    uint64_t                    Busy_Time_Us;
+    uint32_t                    Busy_Violations;            // Commands rejected because the chip was busy
+    uint32_t                    Protocol_Errors;            // Unknown opcodes, truncated headers, nested transactions
+} DATAFLASH_SIM_STATS_TYPE;
+
+//! Generic comm bus handlers initializer for the simulated bus provider
+#define DATAFLASH_SIM_COMM_BUS_HANDLERS                                         \
+{                                                                               \
+    .GetAllocation          = DataFlashSim__GetAllocation,                      \
+    .RegisterEventHandler   = DataFlashSim__RegisterEventHandler,               \
+    .StartTransaction       = DataFlashSim__StartTransaction,                   \
+    .StopTransaction        = DataFlashSim__StopTransaction,                    \
+    .Write                  = DataFlashSim__Write,                              \
+    .Read                   = DataFlashSim__Read,                               \
+}
+
+//! Generic IO handlers initializer for the simulated digital IO provider
+#define DATAFLASH_SIM_IO_HANDLERS                                               \
+{                                                                               \
+    .Read                   = DataFlashSim__DigitalRead,                        \
+    .Write                  = DataFlashSim__DigitalWrite,                       \
+}
+
+//-------------------------------------- PUBLIC (Function Prototypes) -------------------------------------------------
+
+void DataFlashSim__GetDefaultConfig(DATAFLASH_SIM_CONFIG_TYPE* config);
+BOOL_TYPE DataFlashSim__Initialize(uint8_t channel, const DATAFLASH_SIM_CONFIG_TYPE* config);
+void DataFlashSim__Deinitialize(void);
+uint8_t* DataFlashSim__GetMemory(uint8_t channel);
+uint32_t DataFlashSim__GetMemorySize(uint8_t channel);
+const DATAFLASH_SIM_STATS_TYPE* DataFlashSim__GetStats(uint8_t channel);
+void DataFlashSim__ResetStats(uint8_t channel);
+void DataFlashSim__GetPageWear(uint8_t channel, uint16_t page, uint32_t* erase_count, uint32_t* program_count);
+BOOL_TYPE DataFlashSim__IsReady(uint8_t channel);
+
+// Generic comm bus interface
+uint8_t DataFlashSim__GetAllocation(uint8_t bound_id);
+void DataFlashSim__RegisterEventHandler(CALLBACK_HANDLER_TYPE event_handler, uint16_t filter_id, uint16_t filter_value);
+BOOL_TYPE DataFlashSim__StartTransaction(uint8_t channel);
+void DataFlashSim__StopTransaction(uint8_t channel);
+BOOL_TYPE DataFlashSim__Write(uint8_t channel, void* data, uint32_t address, uint16_t size);
+BOOL_TYPE DataFlashSim__Read(uint8_t channel, void* data, uint32_t address, uint16_t size);
+
+// Generic IO interface
+BOOL_TYPE DataFlashSim__DigitalRead(uint8_t pin);
+void DataFlashSim__DigitalWrite(uint8_t pin, BOOL_TYPE level);
+
+#endif /* DATAFLASHSIM_H_ */
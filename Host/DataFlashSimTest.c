@@ -0,0 +1,488 @@
+/**
+ *  @file       DataFlashSimTest.c
+ *
+ *  @brief      Host regression test of the DataFlash simulator the other host tests and the benchmark run on.
+ *  @details    Drives the generic comm bus interface of DataFlashSim directly, as the driver does: identification and
+ *              status register, buffer write and read, buffer to main memory program, page and block erase, page and
+ *              continuous reads. The chip must store what is programmed, stay busy for the configured datasheet times
+ *              on its status register, RDY/BUSY pin and interrupt, reject commands addressed while busy, count protocol
+ *              errors, and notify each bus transfer after its SPI time at the configured clock.
+ *
+ *              Build: see ExternalFlashTest.h, with the sources of ExternalFlashTest.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Bus channel of the simulated chip, and one without a chip
+#define DATAFLASH_SIM_TEST_CHANNEL                  EXTERNAL_FLASH_TEST_BUS_CHANNEL
+#define DATAFLASH_SIM_TEST_OTHER_CHANNEL            (1 - EXTERNAL_FLASH_TEST_BUS_CHANNEL)
+
+//! Digital IO pin wired to RDY/BUSY
+#define DATAFLASH_SIM_TEST_PIN                      (5)
+
+//! Opcodes, as sent by the driver
+#define DATAFLASH_SIM_TEST_CMD_PAGE_READ            0xd2
+#define DATAFLASH_SIM_TEST_CMD_CONTINUOUS_READ_LF   0x03
+#define DATAFLASH_SIM_TEST_CMD_CONTINUOUS_READ_HF   0x0b
+#define DATAFLASH_SIM_TEST_CMD_BUFFER_1_READ        0xd4
+#define DATAFLASH_SIM_TEST_CMD_BUFFER_1_WRITE       0x84
+#define DATAFLASH_SIM_TEST_CMD_BUFFER_2_WRITE       0x87
+#define DATAFLASH_SIM_TEST_CMD_BUFFER_1_TO_MAIN     0x83
+#define DATAFLASH_SIM_TEST_CMD_PAGE_ERASE           0x81
+#define DATAFLASH_SIM_TEST_CMD_BLOCK_ERASE          0x50
+#define DATAFLASH_SIM_TEST_CMD_STATUS_READ          0xd7
+#define DATAFLASH_SIM_TEST_CMD_ID_READ              0x9f
+#define DATAFLASH_SIM_TEST_CMD_UNKNOWN              0x00
+
+//! Status register byte 1 of the default part: ready, density code 0x05, power of two page size
+#define DATAFLASH_SIM_TEST_STATUS_READY             (0x80 | (0x05 << 2) | 0x01)
+#define DATAFLASH_SIM_TEST_STATUS_RDY               0x80
+
+//! Bus processes reported in the high byte of the bus events
+#define DATAFLASH_SIM_TEST_PROCESS_WRITE            1
+#define DATAFLASH_SIM_TEST_PROCESS_READ             2
+
+//! Pages and bytes used by the tests
+#define DATAFLASH_SIM_TEST_PROGRAM_PAGE             (5)
+#define DATAFLASH_SIM_TEST_PROGRAM_BYTE             (10)
+#define DATAFLASH_SIM_TEST_PROGRAM_SIZE             (20)
+#define DATAFLASH_SIM_TEST_READ_PAGE                (20)
+#define DATAFLASH_SIM_TEST_READ_BYTE                (200)
+#define DATAFLASH_SIM_TEST_READ_SIZE                (400)
+#define DATAFLASH_SIM_TEST_ERASE_PAGE               (9)
+
+static DATAFLASH_SIM_CONFIG_TYPE DataFlashSimTest_Config;
+static uint8_t DataFlashSimTest_Data[DATAFLASH_SIM_TEST_READ_SIZE];
+static uint8_t DataFlashSimTest_Read[DATAFLASH_SIM_TEST_READ_SIZE];
+
+//! Bus time of the transfers since the last statistics reset
+static uint64_t DataFlashSimTest_Bus_Us;
+
+//! RDY/BUSY rising edges and time of the last one
+static uint32_t DataFlashSimTest_Ready_Edges;
+static uint64_t DataFlashSimTest_Ready_Us;
+
+//! Bus events notified to the handler registered on the channel without a chip
+static uint32_t DataFlashSimTest_Foreign_Events;
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void TestIdentification(void);
+static void TestProgram(void);
+static void TestBusy(void);
+static void TestProtocol(void);
+static void TestReads(void);
+static void TestBlockErase(void);
+static BOOL_TYPE Transfer(uint8_t process, uint32_t header, uint8_t* data, uint16_t size);
+static void Command(uint8_t opcode, uint16_t page, uint16_t byte, uint8_t* data, uint16_t size);
+static void ReadCommand(uint8_t opcode, uint16_t page, uint16_t byte, uint8_t dummy_bytes, uint8_t* data, uint16_t size);
+static uint8_t ReadStatus(void);
+static uint8_t* GetPage(uint16_t page);
+static void ReadyInterrupt(void);
+static void ForeignEventHandler(CALLBACK_EVENT_TYPE event);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    SystemTimersSim__Initialize();
+    DataFlashSim__Deinitialize();
+
+    DataFlashSim__GetDefaultConfig(&DataFlashSimTest_Config);
+    DataFlashSimTest_Config.Generic_Comm_Bus_Id = EXTERNAL_FLASH_TEST_BUS_PROVIDER;
+    DataFlashSimTest_Config.Ready_Pin = DATAFLASH_SIM_TEST_PIN;
+    DataFlashSimTest_Config.Ready_Interrupt = ReadyInterrupt;
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__Initialize(DATAFLASH_SIM_TEST_CHANNEL, &DataFlashSimTest_Config) == TRUE);
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetAllocation(DATAFLASH_SIM_TEST_CHANNEL) == DATAFLASH_SIM_TEST_CHANNEL);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetAllocation(DATAFLASH_SIM_TEST_OTHER_CHANNEL) == INVALID_VALUE_8);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__StartTransaction(DATAFLASH_SIM_TEST_OTHER_CHANNEL) == FALSE);
+    DataFlashSim__RegisterEventHandler(ExternalFlashTest__EventHandler, DATAFLASH_SIM_TEST_CHANNEL, CALLBACK_FILTER_VALUE_NONE);
+    DataFlashSim__RegisterEventHandler(ForeignEventHandler, DATAFLASH_SIM_TEST_OTHER_CHANNEL, CALLBACK_FILTER_VALUE_NONE);
+
+    TestIdentification();
+    TestProgram();
+    TestBusy();
+    TestProtocol();
+    TestReads();
+    TestBlockErase();
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSimTest_Foreign_Events == 0);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("DataFlashSimTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the JEDEC id and the status register of the idle chip
+ */
+static void TestIdentification(void)
+{
+    uint8_t id[3];
+
+    DataFlashSim__StartTransaction(DATAFLASH_SIM_TEST_CHANNEL);
+    id[0] = DATAFLASH_SIM_TEST_CMD_ID_READ;
+    EXTERNAL_FLASH_TEST_CHECK(Transfer(DATAFLASH_SIM_TEST_PROCESS_WRITE, COMMBUS_ADDRESS_NONE, id, 1) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(Transfer(DATAFLASH_SIM_TEST_PROCESS_READ, COMMBUS_ADDRESS_NONE, id, sizeof(id)) == TRUE);
+    DataFlashSim__StopTransaction(DATAFLASH_SIM_TEST_CHANNEL);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(id, DataFlashSimTest_Config.Jedec_Id, sizeof(id)) == 0);
+
+    EXTERNAL_FLASH_TEST_CHECK(ReadStatus() == DATAFLASH_SIM_TEST_STATUS_READY);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__IsReady(DATAFLASH_SIM_TEST_CHANNEL) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__DigitalRead(DATAFLASH_SIM_TEST_PIN) == TRUE);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Writes part of buffer 1 and reads it back, then programs it to a page with built-in erase: the chip is busy
+ *          for tEP and only the bytes written change in the page
+ */
+static void TestProgram(void)
+{
+    uint8_t* page = GetPage(DATAFLASH_SIM_TEST_PROGRAM_PAGE);
+    uint32_t erase_count;
+    uint32_t program_count;
+    uint64_t start_us;
+    uint16_t i;
+
+    for(i = 0; i < DATAFLASH_SIM_TEST_PROGRAM_SIZE; i++)
+    {
+        DataFlashSimTest_Data[i] = (uint8_t)((i * 11) + 3);
+    }
+    Command(DATAFLASH_SIM_TEST_CMD_BUFFER_1_WRITE, 0, DATAFLASH_SIM_TEST_PROGRAM_BYTE, DataFlashSimTest_Data, DATAFLASH_SIM_TEST_PROGRAM_SIZE);
+    ReadCommand(DATAFLASH_SIM_TEST_CMD_BUFFER_1_READ, 0, DATAFLASH_SIM_TEST_PROGRAM_BYTE, 1, DataFlashSimTest_Read, DATAFLASH_SIM_TEST_PROGRAM_SIZE);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(DataFlashSimTest_Read, DataFlashSimTest_Data, DATAFLASH_SIM_TEST_PROGRAM_SIZE) == 0);
+
+    Command(DATAFLASH_SIM_TEST_CMD_BUFFER_1_TO_MAIN, DATAFLASH_SIM_TEST_PROGRAM_PAGE, 0, NULL, 0);
+    start_us = SystemTimersSim__GetUs();
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__IsReady(DATAFLASH_SIM_TEST_CHANNEL) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__DigitalRead(DATAFLASH_SIM_TEST_PIN) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK((ReadStatus() & DATAFLASH_SIM_TEST_STATUS_RDY) == 0);
+
+    // The status byte is clocked out after the opcode transfer
+    SystemTimersSim__RunUntil(start_us + DataFlashSimTest_Config.Timing.Page_Erase_Program_Us - 20);
+    EXTERNAL_FLASH_TEST_CHECK((ReadStatus() & DATAFLASH_SIM_TEST_STATUS_RDY) == 0);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSimTest_Ready_Edges == 0);
+    SystemTimersSim__RunUntil(start_us + DataFlashSimTest_Config.Timing.Page_Erase_Program_Us);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__IsReady(DATAFLASH_SIM_TEST_CHANNEL) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__DigitalRead(DATAFLASH_SIM_TEST_PIN) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSimTest_Ready_Edges == 1);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSimTest_Ready_Us == (start_us + DataFlashSimTest_Config.Timing.Page_Erase_Program_Us));
+    EXTERNAL_FLASH_TEST_CHECK(ReadStatus() == DATAFLASH_SIM_TEST_STATUS_READY);
+
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(&page[DATAFLASH_SIM_TEST_PROGRAM_BYTE], DataFlashSimTest_Data, DATAFLASH_SIM_TEST_PROGRAM_SIZE) == 0);
+    EXTERNAL_FLASH_TEST_CHECK((page[DATAFLASH_SIM_TEST_PROGRAM_BYTE - 1] == 0xff) && (page[DATAFLASH_SIM_TEST_PROGRAM_BYTE + DATAFLASH_SIM_TEST_PROGRAM_SIZE] == 0xff));
+    DataFlashSim__GetPageWear(DATAFLASH_SIM_TEST_CHANNEL, DATAFLASH_SIM_TEST_PROGRAM_PAGE, &erase_count, &program_count);
+    EXTERNAL_FLASH_TEST_CHECK((erase_count == 1) && (program_count == 1));
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(DATAFLASH_SIM_TEST_CHANNEL)->Page_Programs == 1);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   While a program from buffer 1 is ongoing only the status register and buffer 2 are accessible: reads, erases
+ *          and buffer 1 writes are rejected without effect
+ */
+static void TestBusy(void)
+{
+    const DATAFLASH_SIM_STATS_TYPE* stats = DataFlashSim__GetStats(DATAFLASH_SIM_TEST_CHANNEL);
+    uint8_t* page = GetPage(DATAFLASH_SIM_TEST_PROGRAM_PAGE);
+    uint64_t start_us;
+    uint8_t byte = 0x5a;
+
+    DataFlashSim__ResetStats(DATAFLASH_SIM_TEST_CHANNEL);
+    Command(DATAFLASH_SIM_TEST_CMD_BUFFER_1_TO_MAIN, DATAFLASH_SIM_TEST_PROGRAM_PAGE + 1, 0, NULL, 0);
+    start_us = SystemTimersSim__GetUs();
+
+    memset(DataFlashSimTest_Read, 0, DATAFLASH_SIM_TEST_PROGRAM_SIZE);
+    ReadCommand(DATAFLASH_SIM_TEST_CMD_PAGE_READ, DATAFLASH_SIM_TEST_PROGRAM_PAGE, DATAFLASH_SIM_TEST_PROGRAM_BYTE, 4, DataFlashSimTest_Read, DATAFLASH_SIM_TEST_PROGRAM_SIZE);
+    EXTERNAL_FLASH_TEST_CHECK((DataFlashSimTest_Read[0] == 0xff) && (DataFlashSimTest_Read[DATAFLASH_SIM_TEST_PROGRAM_SIZE - 1] == 0xff));
+    Command(DATAFLASH_SIM_TEST_CMD_BUFFER_1_WRITE, 0, 0, &byte, 1);
+    Command(DATAFLASH_SIM_TEST_CMD_PAGE_ERASE, DATAFLASH_SIM_TEST_PROGRAM_PAGE, 0, NULL, 0);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Busy_Violations == 3);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(&page[DATAFLASH_SIM_TEST_PROGRAM_BYTE], DataFlashSimTest_Data, DATAFLASH_SIM_TEST_PROGRAM_SIZE) == 0);
+
+    Command(DATAFLASH_SIM_TEST_CMD_BUFFER_2_WRITE, 0, 0, &byte, 1);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Busy_Violations == 3);
+    EXTERNAL_FLASH_TEST_CHECK((ReadStatus() & DATAFLASH_SIM_TEST_STATUS_RDY) == 0);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Page_Erases == 1);
+
+    // The ready edge of the program, then a page erase lasting tPE
+    SystemTimersSim__RunUntil(start_us + DataFlashSimTest_Config.Timing.Page_Erase_Program_Us);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSimTest_Ready_Edges == 2);
+    Command(DATAFLASH_SIM_TEST_CMD_PAGE_ERASE, DATAFLASH_SIM_TEST_PROGRAM_PAGE, 0, NULL, 0);
+    start_us = SystemTimersSim__GetUs();
+    EXTERNAL_FLASH_TEST_CHECK(stats->Busy_Violations == 3);
+    EXTERNAL_FLASH_TEST_CHECK((page[DATAFLASH_SIM_TEST_PROGRAM_BYTE] == 0xff) && (stats->Page_Erases == 2));
+    SystemTimersSim__RunUntil(start_us + DataFlashSimTest_Config.Timing.Page_Erase_Us - 1);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__IsReady(DATAFLASH_SIM_TEST_CHANNEL) == FALSE);
+    SystemTimersSim__RunUntil(start_us + DataFlashSimTest_Config.Timing.Page_Erase_Us);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__IsReady(DATAFLASH_SIM_TEST_CHANNEL) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSimTest_Ready_Edges == 3);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Unknown opcodes, nested transactions and truncated headers are counted as protocol errors and ignored, and
+ *          a transfer started while another is in progress is refused
+ */
+static void TestProtocol(void)
+{
+    const DATAFLASH_SIM_STATS_TYPE* stats = DataFlashSim__GetStats(DATAFLASH_SIM_TEST_CHANNEL);
+    uint8_t header[2];
+
+    DataFlashSim__ResetStats(DATAFLASH_SIM_TEST_CHANNEL);
+    DataFlashSim__StartTransaction(DATAFLASH_SIM_TEST_CHANNEL);
+    header[0] = DATAFLASH_SIM_TEST_CMD_UNKNOWN;
+    EXTERNAL_FLASH_TEST_CHECK(Transfer(DATAFLASH_SIM_TEST_PROCESS_WRITE, COMMBUS_ADDRESS_NONE, header, 1) == TRUE);
+    DataFlashSim__StopTransaction(DATAFLASH_SIM_TEST_CHANNEL);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Protocol_Errors == 1);
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__StartTransaction(DATAFLASH_SIM_TEST_CHANNEL) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__StartTransaction(DATAFLASH_SIM_TEST_CHANNEL) == TRUE);
+    DataFlashSim__StopTransaction(DATAFLASH_SIM_TEST_CHANNEL);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Protocol_Errors == 2);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Transactions == 2);
+
+    // Page erase cut after the first address byte
+    DataFlashSim__StartTransaction(DATAFLASH_SIM_TEST_CHANNEL);
+    header[0] = DATAFLASH_SIM_TEST_CMD_PAGE_ERASE;
+    header[1] = 0;
+    EXTERNAL_FLASH_TEST_CHECK(Transfer(DATAFLASH_SIM_TEST_PROCESS_WRITE, COMMBUS_ADDRESS_NONE, header, sizeof(header)) == TRUE);
+    DataFlashSim__StopTransaction(DATAFLASH_SIM_TEST_CHANNEL);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Protocol_Errors == 3);
+    EXTERNAL_FLASH_TEST_CHECK((stats->Page_Erases == 0) && (DataFlashSim__IsReady(DATAFLASH_SIM_TEST_CHANNEL) == TRUE));
+
+    DataFlashSim__StartTransaction(DATAFLASH_SIM_TEST_CHANNEL);
+    header[0] = DATAFLASH_SIM_TEST_CMD_STATUS_READ;
+    ExternalFlashTest__Start();
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__Write(DATAFLASH_SIM_TEST_CHANNEL, header, COMMBUS_ADDRESS_NONE, 1) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__Read(DATAFLASH_SIM_TEST_CHANNEL, &header[1], COMMBUS_ADDRESS_NONE, 1) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__Wait() == TRUE);
+    DataFlashSim__StopTransaction(DATAFLASH_SIM_TEST_CHANNEL);
+    EXTERNAL_FLASH_TEST_CHECK((stats->Bus_Calls == 3) && (stats->Bus_Events == 3));
+    EXTERNAL_FLASH_TEST_CHECK(stats->Busy_Violations == 0);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Continuous reads go on across pages and wrap around at the end of the array, page reads wrap around within
+ *          the page; every transfer takes the SPI time of its bytes
+ */
+static void TestReads(void)
+{
+    const DATAFLASH_SIM_STATS_TYPE* stats = DataFlashSim__GetStats(DATAFLASH_SIM_TEST_CHANNEL);
+    uint16_t page_size = DataFlashSimTest_Config.Page_Size;
+    uint16_t head = page_size - DATAFLASH_SIM_TEST_READ_BYTE;
+    uint32_t i;
+
+    for(i = 0; i < DATAFLASH_SIM_TEST_READ_SIZE; i++)
+    {
+        DataFlashSimTest_Data[i] = (uint8_t)((i * 7) + 1);
+    }
+    memcpy(&GetPage(DATAFLASH_SIM_TEST_READ_PAGE)[DATAFLASH_SIM_TEST_READ_BYTE], DataFlashSimTest_Data, head);
+    memcpy(GetPage(DATAFLASH_SIM_TEST_READ_PAGE + 1), &DataFlashSimTest_Data[head], page_size);
+    memcpy(GetPage(DATAFLASH_SIM_TEST_READ_PAGE + 2), &DataFlashSimTest_Data[head + page_size], DATAFLASH_SIM_TEST_READ_SIZE - head - page_size);
+    DataFlashSim__ResetStats(DATAFLASH_SIM_TEST_CHANNEL);
+    DataFlashSimTest_Bus_Us = 0;
+
+    memset(DataFlashSimTest_Read, 0, sizeof(DataFlashSimTest_Read));
+    ReadCommand(DATAFLASH_SIM_TEST_CMD_CONTINUOUS_READ_HF, DATAFLASH_SIM_TEST_READ_PAGE, DATAFLASH_SIM_TEST_READ_BYTE, 1, DataFlashSimTest_Read, DATAFLASH_SIM_TEST_READ_SIZE);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(DataFlashSimTest_Read, DataFlashSimTest_Data, DATAFLASH_SIM_TEST_READ_SIZE) == 0);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Page_Reads == 3);
+
+    memset(DataFlashSimTest_Read, 0, sizeof(DataFlashSimTest_Read));
+    ReadCommand(DATAFLASH_SIM_TEST_CMD_CONTINUOUS_READ_LF, DATAFLASH_SIM_TEST_READ_PAGE, DATAFLASH_SIM_TEST_READ_BYTE, 0, DataFlashSimTest_Read, DATAFLASH_SIM_TEST_READ_SIZE);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(DataFlashSimTest_Read, DataFlashSimTest_Data, DATAFLASH_SIM_TEST_READ_SIZE) == 0);
+
+    memset(DataFlashSimTest_Read, 0, sizeof(DataFlashSimTest_Read));
+    ReadCommand(DATAFLASH_SIM_TEST_CMD_PAGE_READ, DATAFLASH_SIM_TEST_READ_PAGE, DATAFLASH_SIM_TEST_READ_BYTE, 4, DataFlashSimTest_Read, page_size);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(DataFlashSimTest_Read, DataFlashSimTest_Data, head) == 0);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(&DataFlashSimTest_Read[head], GetPage(DATAFLASH_SIM_TEST_READ_PAGE), DATAFLASH_SIM_TEST_READ_BYTE) == 0);
+
+    memcpy(&GetPage(DataFlashSimTest_Config.Page_Num - 1)[page_size - 4], DataFlashSimTest_Data, 4);
+    memcpy(GetPage(0), &DataFlashSimTest_Data[4], 4);
+    memset(DataFlashSimTest_Read, 0, sizeof(DataFlashSimTest_Read));
+    ReadCommand(DATAFLASH_SIM_TEST_CMD_CONTINUOUS_READ_LF, DataFlashSimTest_Config.Page_Num - 1, page_size - 4, 0, DataFlashSimTest_Read, 8);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(DataFlashSimTest_Read, DataFlashSimTest_Data, 8) == 0);
+
+    EXTERNAL_FLASH_TEST_CHECK(stats->Bus_Time_Us == DataFlashSimTest_Bus_Us);
+    EXTERNAL_FLASH_TEST_CHECK((stats->Bus_Calls == stats->Bus_Events) && (stats->Transactions == 4));
+    EXTERNAL_FLASH_TEST_CHECK((stats->Busy_Violations == 0) && (stats->Protocol_Errors == 0));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   A block erase addressed to any page of a block erases all and only its pages, the chip is busy for tBE
+ */
+static void TestBlockErase(void)
+{
+    const DATAFLASH_SIM_STATS_TYPE* stats = DataFlashSim__GetStats(DATAFLASH_SIM_TEST_CHANNEL);
+    uint16_t block_start = DATAFLASH_SIM_TEST_ERASE_PAGE - (DATAFLASH_SIM_TEST_ERASE_PAGE % DataFlashSimTest_Config.Pages_Per_Block);
+    uint16_t block_end = block_start + DataFlashSimTest_Config.Pages_Per_Block;
+    uint64_t start_us;
+    uint16_t page;
+
+    for(page = block_start - 1; page <= block_end; page++)
+    {
+        GetPage(page)[0] = 0x00;
+    }
+    DataFlashSim__ResetStats(DATAFLASH_SIM_TEST_CHANNEL);
+
+    Command(DATAFLASH_SIM_TEST_CMD_BLOCK_ERASE, DATAFLASH_SIM_TEST_ERASE_PAGE, 0, NULL, 0);
+    start_us = SystemTimersSim__GetUs();
+    for(page = block_start - 1; page <= block_end; page++)
+    {
+        EXTERNAL_FLASH_TEST_CHECK(GetPage(page)[0] == (((page >= block_start) && (page < block_end)) ? 0xff : 0x00));
+    }
+    EXTERNAL_FLASH_TEST_CHECK((stats->Block_Erases == 1) && (stats->Page_Erases == DataFlashSimTest_Config.Pages_Per_Block));
+
+    SystemTimersSim__RunUntil(start_us + DataFlashSimTest_Config.Timing.Block_Erase_Us - 1);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__DigitalRead(DATAFLASH_SIM_TEST_PIN) == FALSE);
+    SystemTimersSim__RunUntil(start_us + DataFlashSimTest_Config.Timing.Block_Erase_Us);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__DigitalRead(DATAFLASH_SIM_TEST_PIN) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Busy_Time_Us == DataFlashSimTest_Config.Timing.Block_Erase_Us);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs a bus transfer to its completion event, checking the event and the SPI time of the transfer
+ * @param   process: DATAFLASH_SIM_TEST_PROCESS_WRITE or DATAFLASH_SIM_TEST_PROCESS_READ
+ * @param   header: opcode and address clocked out before the data, COMMBUS_ADDRESS_NONE if none
+ * @param   data: data to write or read
+ * @param   size: data size
+ * @return  TRUE if the transfer was accepted and its event notified
+ */
+static BOOL_TYPE Transfer(uint8_t process, uint32_t header, uint8_t* data, uint16_t size)
+{
+    uint32_t bytes = size + ((header != COMMBUS_ADDRESS_NONE) ? sizeof(header) : 0);
+    uint32_t expected_us = DataFlashSimTest_Config.Timing.Bus_Call_Overhead_Us +
+                           (((bytes * 8 * 1000000ULL) + DataFlashSimTest_Config.Timing.Spi_Clock_Hz - 1) / DataFlashSimTest_Config.Timing.Spi_Clock_Hz);
+    uint64_t start_us = SystemTimersSim__GetUs();
+    BOOL_TYPE success;
+
+    ExternalFlashTest__Start();
+    if(process == DATAFLASH_SIM_TEST_PROCESS_WRITE)
+    {
+        success = DataFlashSim__Write(DATAFLASH_SIM_TEST_CHANNEL, data, header, size);
+    }
+    else
+    {
+        success = DataFlashSim__Read(DATAFLASH_SIM_TEST_CHANNEL, data, header, size);
+    }
+
+    if(success == TRUE)
+    {
+        success = ExternalFlashTest__Wait();
+        EXTERNAL_FLASH_TEST_CHECK((SystemTimersSim__GetUs() - start_us) == expected_us);
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetSource() == DATAFLASH_SIM_TEST_CHANNEL);
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == COMBINE_BYTES(process, size));
+        DataFlashSimTest_Bus_Us += expected_us;
+    }
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Sends a command with its address and data in one transfer, then releases the chip select
+ * @param   opcode: command opcode
+ * @param   page: page address
+ * @param   byte: byte address
+ * @param   data: data clocked in after the address, NULL if none
+ * @param   size: data size
+ */
+static void Command(uint8_t opcode, uint16_t page, uint16_t byte, uint8_t* data, uint16_t size)
+{
+    uint32_t header = ((uint32_t)opcode << 24) | ((uint32_t)page << 8) | byte;
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__StartTransaction(DATAFLASH_SIM_TEST_CHANNEL) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(Transfer(DATAFLASH_SIM_TEST_PROCESS_WRITE, header, data, size) == TRUE);
+    DataFlashSim__StopTransaction(DATAFLASH_SIM_TEST_CHANNEL);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Sends a read command with its address and dummy bytes, reads the data, then releases the chip select
+ * @param   opcode: command opcode
+ * @param   page: page address
+ * @param   byte: byte address
+ * @param   dummy_bytes: dummy bytes after the address, at most 4
+ * @param   data: data read
+ * @param   size: data size
+ */
+static void ReadCommand(uint8_t opcode, uint16_t page, uint16_t byte, uint8_t dummy_bytes, uint8_t* data, uint16_t size)
+{
+    uint32_t header = ((uint32_t)opcode << 24) | ((uint32_t)page << 8) | byte;
+    uint8_t dummy[4] = {0};
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__StartTransaction(DATAFLASH_SIM_TEST_CHANNEL) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(Transfer(DATAFLASH_SIM_TEST_PROCESS_WRITE, header, dummy, dummy_bytes) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(Transfer(DATAFLASH_SIM_TEST_PROCESS_READ, COMMBUS_ADDRESS_NONE, data, size) == TRUE);
+    DataFlashSim__StopTransaction(DATAFLASH_SIM_TEST_CHANNEL);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the status register
+ * @return  status register byte 1
+ */
+static uint8_t ReadStatus(void)
+{
+    uint8_t status = DATAFLASH_SIM_TEST_CMD_STATUS_READ;
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__StartTransaction(DATAFLASH_SIM_TEST_CHANNEL) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(Transfer(DATAFLASH_SIM_TEST_PROCESS_WRITE, COMMBUS_ADDRESS_NONE, &status, 1) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(Transfer(DATAFLASH_SIM_TEST_PROCESS_READ, COMMBUS_ADDRESS_NONE, &status, 1) == TRUE);
+    DataFlashSim__StopTransaction(DATAFLASH_SIM_TEST_CHANNEL);
+    return status;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Page of the simulated array
+ * @param   page: page number
+ * @return  pointer to the page
+ */
+static uint8_t* GetPage(uint16_t page)
+{
+    uint16_t extended_page_size = DataFlashSimTest_Config.Page_Size + (DataFlashSimTest_Config.Page_Size / 32);
+
+    return &DataFlashSim__GetMemory(DATAFLASH_SIM_TEST_CHANNEL)[(uint32_t)page * extended_page_size];
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   RDY/BUSY rising edge interrupt of the simulated chip
+ */
+static void ReadyInterrupt(void)
+{
+    DataFlashSimTest_Ready_Edges++;
+    DataFlashSimTest_Ready_Us = SystemTimersSim__GetUs();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Bus event handler registered on the channel without a chip, it must never be called
+ * @param   event: bus event
+ */
+static void ForeignEventHandler(CALLBACK_EVENT_TYPE event)
+{
+    (void)event;
+    DataFlashSimTest_Foreign_Events++;
+}
@@ -0,0 +1,119 @@
+/**
+ *  @file       ExternalFlashAddressTest.c
+ *
+ *  @brief      Host regression test of the address computations of the ExternalFlash driver.
+ *  @details    GetPage, GetPageOffset and GetCommandAddress replace the divisions by the page size with shifts and a
+ *              reciprocal multiply: for each AT45DB part, with binary and DataFlash pages, they are compared with '/' and
+ *              '%' on every address of the device. The test includes the driver source to reach its private functions.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_DETECT_FEATURE enabled and
+ *              EXTERNAL_FLASH_MAX_PAGE_NUMBER set to 32768, without linking ExternalFlashBackup.c; again with
+ *              EXTERNAL_FLASH_SPARE_FEATURE enabled.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include "../ExternalFlashBackup.c"
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_DETECT_FEATURE == DISABLED) || (EXTERNAL_FLASH_MAX_PAGE_NUMBER < 32768)
+#error "ExternalFlashAddressTest requires EXTERNAL_FLASH_DETECT_FEATURE and EXTERNAL_FLASH_MAX_PAGE_NUMBER 32768"
+#endif
+
+//! Simulated part, the AT45DB641E has the extended device information length 1
+typedef struct
+{
+    uint8_t                     Device_Id;                  // JEDEC device id 1
+    uint8_t                     Edi_Length;                 // Extended device information length
+    uint16_t                    Page_Num;
+    uint16_t                    Page_Size;                  // Binary page size
+} EXTERNAL_FLASH_ADDRESS_TEST_PART_TYPE;
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void TestPart(const EXTERNAL_FLASH_ADDRESS_TEST_PART_TYPE* part, BOOL_TYPE binary_page);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    // One part of each entry of the driver device table
+    for(uint8_t index = 0; index < ELEMENTS_IN_ARRAY(ExternalFlash_Device); index++)
+    {
+        EXTERNAL_FLASH_ADDRESS_TEST_PART_TYPE part;
+
+        part.Device_Id = ExternalFlash_Device[index].Device_Id;
+        part.Edi_Length = (ExternalFlash_Device[index].Edi_Length == 0xFF) ? 0 : ExternalFlash_Device[index].Edi_Length;
+        part.Page_Num = ExternalFlash_Device[index].Page_Num;
+        part.Page_Size = ExternalFlash_Device[index].Page_Size;
+
+        TestPart(&part, TRUE);
+        TestPart(&part, FALSE);
+    }
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashAddressTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Detects a simulated part and checks the address computations on all its addresses
+ * @param   part: simulated part
+ * @param   binary_page: TRUE for the binary page size configuration
+ */
+static void TestPart(const EXTERNAL_FLASH_ADDRESS_TEST_PART_TYPE* part, BOOL_TYPE binary_page)
+{
+    DATAFLASH_SIM_CONFIG_TYPE config;
+    uint32_t page_size;
+    uint32_t device_size;
+    uint32_t failed_address = INVALID_VALUE_32;
+    uint8_t instance_id;
+
+    ExternalFlashTest__GetDefaultConfig(&config);
+    config.Page_Size = part->Page_Size;
+    config.Page_Num = part->Page_Num;
+    config.Power_Of_Two_Pages = binary_page;
+    config.Density_Code = (uint8_t)(((part->Device_Id & 0x1F) * 2) - 1);
+    config.Jedec_Id[1] = part->Device_Id;
+    config.Jedec_Id[3] = part->Edi_Length;
+    instance_id = ExternalFlashTest__Setup(&config, NULL);
+
+    page_size = EXTERNAL_FLASH_PAGE_SIZE(instance_id);
+    device_size = EXTERNAL_FLASH_NUMBER_OF_BYTES(instance_id);
+    EXTERNAL_FLASH_TEST_CHECK(EXTERNAL_FLASH_PAGE_NUMBER(instance_id) == part->Page_Num);
+    EXTERNAL_FLASH_TEST_CHECK((page_size + EXTERNAL_FLASH_SPARE_SIZE(instance_id)) ==
+                              ((binary_page == TRUE) ? part->Page_Size : (uint32_t)part->Page_Size + (part->Page_Size / 32)));
+
+    for(uint32_t address = 0; (address < device_size) && (failed_address == INVALID_VALUE_32); address++)
+    {
+        uint32_t page = address / page_size;
+        uint32_t offset = address % page_size;
+
+        if((EXTERNAL_FLASH_PAGE_OF(instance_id, address) != page) ||
+           (EXTERNAL_FLASH_PAGE_OFFSET(instance_id, address) != offset) ||
+           (GetCommandAddress(instance_id, address) != ((page << EXTERNAL_FLASH_BYTE_BITS(instance_id)) | offset)))
+        {
+            failed_address = address;
+        }
+    }
+    if(EXTERNAL_FLASH_TEST_CHECK(failed_address == INVALID_VALUE_32) == FALSE)
+    {
+        printf("part 0x%02X/%u, %s pages: address %u\n", part->Device_Id, part->Edi_Length, (binary_page == TRUE) ? "binary" : "DataFlash", failed_address);
+    }
+
+    // The command address fits the 3 address bytes
+    EXTERNAL_FLASH_TEST_CHECK(GetCommandAddress(instance_id, device_size - 1) < (1UL << 24));
+}
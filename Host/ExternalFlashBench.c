@@ -0,0 +1,447 @@
+/**
+ *  @file       ExternalFlashBench.c
+ *
+ *  @brief      Throughput and latency benchmark of the ExternalFlash driver on the simulated DataFlash.
+ *  @details    Drives ExternalFlash__Read / ExternalFlash__Write back to back on DataFlashSim across transfer sizes,
+ *              alignments (page aligned or straddling a page boundary), access patterns (sequential, random, or
+ *              packed back to back transfers sharing pages) and read/write mixes. Every case starts from a fresh driver
+ *              and an erased chip, read data is checked against a RAM model of the device, and the driver is flushed
+ *              at the end of the case.
+ *
+ *              One record per case is printed on stdout, CSV with a header line (default) or JSON lines (-j):
+ *              label, mix, pattern, alignment, size, ops, bytes, virtual time, MB/s, mean/p99/max latency from
+ *              submit to callback, handler invocations, bus events and page programs per operation, errors.
+ *
+ *              Usage: ExternalFlashBench [-j] [-l label] [-n ops] [-c spi_clock_hz] [-s seed]
+ *
+ *              Host builds link this file with the driver, Host/DataFlashSim.c, Host/SystemTimersSim.c and the
+ *              host framework, whose EXTERNAL_FLASH_MAP binds EXTERNAL_FLASH_BENCH_CLIENT to the simulated bus and
+ *              whose EXTERNAL_FLASH_TIMESTAMP_US() reads SystemTimersSim__GetUs.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlash.h"
+
+#include "DataFlashSim.h"
+#include "SystemTimersSim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Map entry of the benchmarked instance: client channel, bus provider id and provider bound id
+#ifndef EXTERNAL_FLASH_BENCH_CLIENT
+#define EXTERNAL_FLASH_BENCH_CLIENT             ((EXTERNAL_FLASH_CH_TYPE)0)
+#endif
+#ifndef EXTERNAL_FLASH_BENCH_BUS_PROVIDER
+#define EXTERNAL_FLASH_BENCH_BUS_PROVIDER       (0)
+#endif
+#ifndef EXTERNAL_FLASH_BENCH_BUS_CHANNEL
+#define EXTERNAL_FLASH_BENCH_BUS_CHANNEL        (0)
+#endif
+
+//! Largest transfer, the driver API size is 16 bit
+#define EXTERNAL_FLASH_BENCH_MAX_SIZE           (65535)
+
+//! Maximum operations per case, and bytes per case used to scale the default operation count
+#define EXTERNAL_FLASH_BENCH_MAX_OPS            (1024)
+#define EXTERNAL_FLASH_BENCH_DEFAULT_OPS        (256)
+#define EXTERNAL_FLASH_BENCH_BYTES_PER_CASE     (256UL * 1024UL)
+#define EXTERNAL_FLASH_BENCH_MIN_OPS            (16)
+
+//! Virtual time allowed to a single operation
+#define EXTERNAL_FLASH_BENCH_OP_TIMEOUT_US      (10ULL * 1000000ULL)
+
+typedef enum EXTERNAL_FLASH_BENCH_MIX_ENUM
+{
+    EXTERNAL_FLASH_BENCH_MIX_READ,
+    EXTERNAL_FLASH_BENCH_MIX_WRITE,
+    EXTERNAL_FLASH_BENCH_MIX_READ_70_WRITE_30,
+    EXTERNAL_FLASH_BENCH_MIX_NUM
+} EXTERNAL_FLASH_BENCH_MIX_TYPE;
+
+typedef enum EXTERNAL_FLASH_BENCH_PATTERN_ENUM
+{
+    EXTERNAL_FLASH_BENCH_PATTERN_SEQUENTIAL,
+    EXTERNAL_FLASH_BENCH_PATTERN_RANDOM,
+    EXTERNAL_FLASH_BENCH_PATTERN_PACKED,
+    EXTERNAL_FLASH_BENCH_PATTERN_NUM
+} EXTERNAL_FLASH_BENCH_PATTERN_TYPE;
+
+typedef enum EXTERNAL_FLASH_BENCH_ALIGNMENT_ENUM
+{
+    EXTERNAL_FLASH_BENCH_ALIGNMENT_PAGE,
+    EXTERNAL_FLASH_BENCH_ALIGNMENT_STRADDLE,
+    EXTERNAL_FLASH_BENCH_ALIGNMENT_NUM
+} EXTERNAL_FLASH_BENCH_ALIGNMENT_TYPE;
+
+static const char* const ExternalFlashBench_Mix_Name[EXTERNAL_FLASH_BENCH_MIX_NUM] = {"read", "write", "read70_write30"};
+static const char* const ExternalFlashBench_Pattern_Name[EXTERNAL_FLASH_BENCH_PATTERN_NUM] = {"sequential", "random", "packed"};
+static const char* const ExternalFlashBench_Alignment_Name[EXTERNAL_FLASH_BENCH_ALIGNMENT_NUM] = {"page", "straddle"};
+
+static const uint16_t ExternalFlashBench_Size[] = {1, 4, 16, 64, 256, 1024, 4096, 16384, EXTERNAL_FLASH_BENCH_MAX_SIZE};
+
+//! Benchmark options
+typedef struct EXTERNAL_FLASH_BENCH_OPTIONS_STRUCT
+{
+    const char*                 Label;
+    BOOL_TYPE                   Json;
+    uint32_t                    Ops;                        // 0: scaled on the transfer size
+    uint32_t                    Spi_Clock_Hz;
+    uint32_t                    Seed;
+} EXTERNAL_FLASH_BENCH_OPTIONS_TYPE;
+
+//! Case result
+typedef struct EXTERNAL_FLASH_BENCH_RESULT_STRUCT
+{
+    uint32_t                    Ops;
+    uint64_t                    Bytes;
+    uint64_t                    Time_Us;
+    uint64_t                    Latency_Sum_Us;
+    uint32_t                    Latency_P99_Us;
+    uint32_t                    Latency_Max_Us;
+    uint32_t                    Handler_Runs;
+    uint32_t                    Bus_Events;
+    uint32_t                    Page_Programs;
+    uint32_t                    Errors;
+} EXTERNAL_FLASH_BENCH_RESULT_TYPE;
+
+static uint8_t ExternalFlashBench_Instance;
+static volatile BOOL_TYPE ExternalFlashBench_Done;
+static uint32_t ExternalFlashBench_Random;
+static uint32_t ExternalFlashBench_Latency[EXTERNAL_FLASH_BENCH_MAX_OPS];
+
+static uint8_t* ExternalFlashBench_Model;                   // Expected device content
+static uint8_t ExternalFlashBench_Data[EXTERNAL_FLASH_BENCH_MAX_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void Setup(const EXTERNAL_FLASH_BENCH_OPTIONS_TYPE* options, DATAFLASH_SIM_CONFIG_TYPE* config);
+static void RunCase(const EXTERNAL_FLASH_BENCH_OPTIONS_TYPE* options, EXTERNAL_FLASH_BENCH_MIX_TYPE mix,
+                    EXTERNAL_FLASH_BENCH_PATTERN_TYPE pattern, EXTERNAL_FLASH_BENCH_ALIGNMENT_TYPE alignment, uint16_t size);
+static BOOL_TYPE RunOperation(BOOL_TYPE write, uint32_t address, uint16_t size, uint32_t* latency_us);
+static void PrintResult(const EXTERNAL_FLASH_BENCH_OPTIONS_TYPE* options, EXTERNAL_FLASH_BENCH_MIX_TYPE mix,
+                        EXTERNAL_FLASH_BENCH_PATTERN_TYPE pattern, EXTERNAL_FLASH_BENCH_ALIGNMENT_TYPE alignment,
+                        uint16_t size, const EXTERNAL_FLASH_BENCH_RESULT_TYPE* result);
+static void EventHandler(CALLBACK_EVENT_TYPE event);
+static BOOL_TYPE IsDone(void* context);
+static uint32_t Random(void);
+static int CompareLatency(const void* a, const void* b);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(int argc, char* argv[])
+{
+    EXTERNAL_FLASH_BENCH_OPTIONS_TYPE options = {"", FALSE, 0, 0, 1};
+
+    for(int arg = 1; arg < argc; arg++)
+    {
+        if(strcmp(argv[arg], "-j") == 0)
+        {
+            options.Json = TRUE;
+        }
+        else if((strcmp(argv[arg], "-l") == 0) && (arg + 1 < argc))
+        {
+            options.Label = argv[++arg];
+        }
+        else if((strcmp(argv[arg], "-n") == 0) && (arg + 1 < argc))
+        {
+            options.Ops = (uint32_t)strtoul(argv[++arg], NULL, 0);
+            options.Ops = MIN(options.Ops, EXTERNAL_FLASH_BENCH_MAX_OPS);
+        }
+        else if((strcmp(argv[arg], "-c") == 0) && (arg + 1 < argc))
+        {
+            options.Spi_Clock_Hz = (uint32_t)strtoul(argv[++arg], NULL, 0);
+        }
+        else if((strcmp(argv[arg], "-s") == 0) && (arg + 1 < argc))
+        {
+            options.Seed = (uint32_t)strtoul(argv[++arg], NULL, 0);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-j] [-l label] [-n ops] [-c spi_clock_hz] [-s seed]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(options.Json == FALSE)
+    {
+        printf("label,mix,pattern,alignment,size,ops,bytes,time_us,mb_s,lat_mean_us,lat_p99_us,lat_max_us,"
+               "handler_runs_per_op,bus_events_per_op,page_programs_per_op,errors\n");
+    }
+
+    for(uint8_t mix = 0; mix < EXTERNAL_FLASH_BENCH_MIX_NUM; mix++)
+    {
+        for(uint8_t pattern = 0; pattern < EXTERNAL_FLASH_BENCH_PATTERN_NUM; pattern++)
+        {
+            for(uint8_t alignment = 0; alignment < EXTERNAL_FLASH_BENCH_ALIGNMENT_NUM; alignment++)
+            {
+                for(uint8_t size_index = 0; size_index < ELEMENTS_IN_ARRAY(ExternalFlashBench_Size); size_index++)
+                {
+                    RunCase(&options, (EXTERNAL_FLASH_BENCH_MIX_TYPE)mix, (EXTERNAL_FLASH_BENCH_PATTERN_TYPE)pattern,
+                            (EXTERNAL_FLASH_BENCH_ALIGNMENT_TYPE)alignment, ExternalFlashBench_Size[size_index]);
+                }
+            }
+        }
+    }
+
+    DataFlashSim__Deinitialize();
+    free(ExternalFlashBench_Model);
+    return 0;
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Brings up virtual time, an erased simulated chip and the driver
+ * @param   options: benchmark options
+ * @param   config: simulated part configuration, filled
+ */
+static void Setup(const EXTERNAL_FLASH_BENCH_OPTIONS_TYPE* options, DATAFLASH_SIM_CONFIG_TYPE* config)
+{
+    SystemTimersSim__Initialize();
+
+    DataFlashSim__Deinitialize();
+    DataFlashSim__GetDefaultConfig(config);
+    config->Generic_Comm_Bus_Id = EXTERNAL_FLASH_BENCH_BUS_PROVIDER;
+    if(options->Spi_Clock_Hz != 0)
+    {
+        config->Timing.Spi_Clock_Hz = options->Spi_Clock_Hz;
+    }
+    SYS_ASSERT(DataFlashSim__Initialize(EXTERNAL_FLASH_BENCH_BUS_CHANNEL, config) == TRUE);
+
+    free(ExternalFlashBench_Model);
+    ExternalFlashBench_Model = malloc((size_t)config->Page_Size * config->Page_Num);
+    SYS_ASSERT(ExternalFlashBench_Model != NULL);
+    memset(ExternalFlashBench_Model, 0xff, (size_t)config->Page_Size * config->Page_Num);
+
+    ExternalFlash__Initialize();
+    ExternalFlashBench_Instance = ExternalFlash__GetAllocation((uint8_t)EXTERNAL_FLASH_BENCH_CLIENT, NULL, 0);
+    SYS_ASSERT(ExternalFlashBench_Instance != INVALID_VALUE_8);
+    ExternalFlash__RegisterEventHandler(EventHandler, ExternalFlashBench_Instance, CALLBACK_FILTER_VALUE_NONE);
+
+    // Let the driver leave its initialization state
+    SystemTimersSim__RunUntil(SystemTimersSim__GetUs() + (2 * EXTERNAL_FLASH_HANDLER_PERIOD_MS * 1000));
+}
+
+static void RunCase(const EXTERNAL_FLASH_BENCH_OPTIONS_TYPE* options, EXTERNAL_FLASH_BENCH_MIX_TYPE mix,
+                    EXTERNAL_FLASH_BENCH_PATTERN_TYPE pattern, EXTERNAL_FLASH_BENCH_ALIGNMENT_TYPE alignment, uint16_t size)
+{
+    DATAFLASH_SIM_CONFIG_TYPE config;
+    EXTERNAL_FLASH_BENCH_RESULT_TYPE result;
+    uint32_t ops;
+    uint32_t capacity;
+    uint32_t slots;
+    uint32_t offset;
+    uint8_t task_index;
+    uint64_t start_us;
+    uint32_t start_runs;
+
+    Setup(options, &config);
+    ExternalFlashBench_Random = options->Seed;
+    memset(&result, 0x00, sizeof(result));
+
+    ops = options->Ops;
+    if(ops == 0)
+    {
+        ops = MAX(EXTERNAL_FLASH_BENCH_MIN_OPS, MIN(EXTERNAL_FLASH_BENCH_DEFAULT_OPS, EXTERNAL_FLASH_BENCH_BYTES_PER_CASE / size));
+    }
+
+    // Accesses start at a page boundary, or end half of the transfer (at least one byte) before a page boundary
+    capacity = (uint32_t)config.Page_Size * config.Page_Num;
+    offset = (alignment == EXTERNAL_FLASH_BENCH_ALIGNMENT_PAGE) ? 0 : (config.Page_Size - MAX(1, MIN(size, config.Page_Size) / 2));
+    slots = (capacity - size - offset) / config.Page_Size + 1;
+
+    task_index = SystemTimersSim__FindTask("ExternalFlash__Handler");
+    DataFlashSim__ResetStats(EXTERNAL_FLASH_BENCH_BUS_CHANNEL);
+    start_us = SystemTimersSim__GetUs();
+    start_runs = SystemTimersSim__GetTaskRuns(task_index);
+
+    for(uint32_t op = 0; op < ops; op++)
+    {
+        BOOL_TYPE write;
+        uint32_t slot;
+        uint32_t address;
+
+        switch(mix)
+        {
+          case EXTERNAL_FLASH_BENCH_MIX_READ:
+            write = FALSE;
+            break;
+          case EXTERNAL_FLASH_BENCH_MIX_WRITE:
+            write = TRUE;
+            break;
+          default:
+            write = ((Random() % 10) < 3) ? TRUE : FALSE;
+            break;
+        }
+
+        if(pattern == EXTERNAL_FLASH_BENCH_PATTERN_SEQUENTIAL)
+        {
+            // Consecutive transfers rounded up to whole pages, restarting from the first slot at the end of the device
+            slot = (uint32_t)(((uint64_t)op * ((size + config.Page_Size - 1) / config.Page_Size)) % slots);
+            address = (slot * config.Page_Size) + offset;
+        }
+        else if(pattern == EXTERNAL_FLASH_BENCH_PATTERN_RANDOM)
+        {
+            slot = Random() % slots;
+            address = (slot * config.Page_Size) + offset;
+        }
+        else
+        {
+            // Each transfer starts where the previous one ended, small transfers share the same page
+            address = (uint32_t)(((uint64_t)op * size) % (capacity - size - offset + 1)) + offset;
+        }
+
+        if(RunOperation(write, address, size, &ExternalFlashBench_Latency[result.Ops]) == TRUE)
+        {
+            result.Latency_Sum_Us += ExternalFlashBench_Latency[result.Ops];
+            result.Latency_Max_Us = MAX(result.Latency_Max_Us, ExternalFlashBench_Latency[result.Ops]);
+            result.Bytes += size;
+            result.Ops++;
+        }
+        else
+        {
+            result.Errors++;
+        }
+    }
+
+    // Program what the driver still holds in the chip buffer, so that the case accounts for all of its page programs
+    ExternalFlashBench_Done = FALSE;
+    if((ExternalFlash__Flush(ExternalFlashBench_Instance) == TRUE) &&
+       (SystemTimersSim__RunUntilCondition(IsDone, NULL, EXTERNAL_FLASH_BENCH_OP_TIMEOUT_US) == FALSE))
+    {
+        result.Errors++;
+    }
+
+    result.Time_Us = SystemTimersSim__GetUs() - start_us;
+    result.Handler_Runs = SystemTimersSim__GetTaskRuns(task_index) - start_runs;
+    result.Bus_Events = DataFlashSim__GetStats(EXTERNAL_FLASH_BENCH_BUS_CHANNEL)->Bus_Events;
+    result.Page_Programs = DataFlashSim__GetStats(EXTERNAL_FLASH_BENCH_BUS_CHANNEL)->Page_Programs;
+    result.Errors += DataFlashSim__GetStats(EXTERNAL_FLASH_BENCH_BUS_CHANNEL)->Busy_Violations +
+                     DataFlashSim__GetStats(EXTERNAL_FLASH_BENCH_BUS_CHANNEL)->Protocol_Errors;
+
+    if(result.Ops > 0)
+    {
+        qsort(ExternalFlashBench_Latency, result.Ops, sizeof(uint32_t), CompareLatency);
+        result.Latency_P99_Us = ExternalFlashBench_Latency[((result.Ops * 99) + 99) / 100 - 1];
+    }
+
+    PrintResult(options, mix, pattern, alignment, size, &result);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Submits one operation and runs virtual time until its callback
+ * @param   write: TRUE for a write, FALSE for a read
+ * @param   address: instance address
+ * @param   size: transfer size
+ * @param   latency_us: time from submit to callback
+ * @return  TRUE if the operation completed, and read data matched the device model
+ */
+static BOOL_TYPE RunOperation(BOOL_TYPE write, uint32_t address, uint16_t size, uint32_t* latency_us)
+{
+    BOOL_TYPE success = FALSE;
+    uint64_t start_us = SystemTimersSim__GetUs();
+
+    if(write == TRUE)
+    {
+        for(uint16_t index = 0; index < size; index++)
+        {
+            ExternalFlashBench_Data[index] = (uint8_t)Random();
+        }
+    }
+
+    ExternalFlashBench_Done = FALSE;
+
+    if(((write == TRUE) && (ExternalFlash__Write(ExternalFlashBench_Instance, ExternalFlashBench_Data, address, size) == TRUE)) ||
+       ((write == FALSE) && (ExternalFlash__Read(ExternalFlashBench_Instance, ExternalFlashBench_Data, address, size) == TRUE)))
+    {
+        if(SystemTimersSim__RunUntilCondition(IsDone, NULL, EXTERNAL_FLASH_BENCH_OP_TIMEOUT_US) == TRUE)
+        {
+            *latency_us = (uint32_t)(SystemTimersSim__GetUs() - start_us);
+
+            if(write == TRUE)
+            {
+                memcpy(&ExternalFlashBench_Model[address], ExternalFlashBench_Data, size);
+                success = TRUE;
+            }
+            else
+            {
+                success = (memcmp(&ExternalFlashBench_Model[address], ExternalFlashBench_Data, size) == 0) ? TRUE : FALSE;
+            }
+        }
+    }
+    return success;
+}
+
+static void PrintResult(const EXTERNAL_FLASH_BENCH_OPTIONS_TYPE* options, EXTERNAL_FLASH_BENCH_MIX_TYPE mix,
+                        EXTERNAL_FLASH_BENCH_PATTERN_TYPE pattern, EXTERNAL_FLASH_BENCH_ALIGNMENT_TYPE alignment,
+                        uint16_t size, const EXTERNAL_FLASH_BENCH_RESULT_TYPE* result)
+{
+    uint32_t ops = MAX(result->Ops, 1);
+    double mb_s = (result->Time_Us > 0) ? ((double)result->Bytes / (double)result->Time_Us) : 0.0;    // bytes/us = MB/s
+
+    if(options->Json == TRUE)
+    {
+        printf("{\"label\":\"%s\",\"mix\":\"%s\",\"pattern\":\"%s\",\"alignment\":\"%s\",\"size\":%u,\"ops\":%u,"
+               "\"bytes\":%llu,\"time_us\":%llu,\"mb_s\":%.6f,\"lat_mean_us\":%.1f,\"lat_p99_us\":%u,\"lat_max_us\":%u,"
+               "\"handler_runs_per_op\":%.2f,\"bus_events_per_op\":%.2f,\"page_programs_per_op\":%.2f,\"errors\":%u}\n",
+               options->Label, ExternalFlashBench_Mix_Name[mix], ExternalFlashBench_Pattern_Name[pattern],
+               ExternalFlashBench_Alignment_Name[alignment], size, result->Ops,
+               (unsigned long long)result->Bytes, (unsigned long long)result->Time_Us, mb_s,
+               (double)result->Latency_Sum_Us / ops, result->Latency_P99_Us, result->Latency_Max_Us,
+               (double)result->Handler_Runs / ops, (double)result->Bus_Events / ops,
+               (double)result->Page_Programs / ops, result->Errors);
+    }
+    else
+    {
+        printf("%s,%s,%s,%s,%u,%u,%llu,%llu,%.6f,%.1f,%u,%u,%.2f,%.2f,%.2f,%u\n",
+               options->Label, ExternalFlashBench_Mix_Name[mix], ExternalFlashBench_Pattern_Name[pattern],
+               ExternalFlashBench_Alignment_Name[alignment], size, result->Ops,
+               (unsigned long long)result->Bytes, (unsigned long long)result->Time_Us, mb_s,
+               (double)result->Latency_Sum_Us / ops, result->Latency_P99_Us, result->Latency_Max_Us,
+               (double)result->Handler_Runs / ops, (double)result->Bus_Events / ops,
+               (double)result->Page_Programs / ops, result->Errors);
+    }
+}
+
+static void EventHandler(CALLBACK_EVENT_TYPE event)
+{
+    (void)event;
+    ExternalFlashBench_Done = TRUE;
+}
+
+static BOOL_TYPE IsDone(void* context)
+{
+    (void)context;
+    return ExternalFlashBench_Done;
+}
+
+//! xorshift32, deterministic across hosts
+static uint32_t Random(void)
+{
+    ExternalFlashBench_Random ^= ExternalFlashBench_Random << 13;
+    ExternalFlashBench_Random ^= ExternalFlashBench_Random >> 17;
+    ExternalFlashBench_Random ^= ExternalFlashBench_Random << 5;
+    return ExternalFlashBench_Random;
+}
+
+static int CompareLatency(const void* a, const void* b)
+{
+    uint32_t latency_a = *(const uint32_t*)a;
+    uint32_t latency_b = *(const uint32_t*)b;
+
+    return (latency_a > latency_b) - (latency_a < latency_b);
+}
@@ -0,0 +1,177 @@
+/**
+ *  @file       ExternalFlashBlankTest.c
+ *
+ *  @brief      Host regression test of the erased page map of the ExternalFlash driver.
+ *  @details    A chip with single bytes written here and there, at any offset of their pages, is mounted with an
+ *              unknown map. A blank check of the whole device, with a client read served in between, must find every
+ *              page as it is in the chip memory, clocking each page out once with continuous array reads, and notify
+ *              its end with EXTERNAL_FLASH_PROCESS_SCAN_COMPLETE. A write to a page known erased clears its bit and,
+ *              without write combining, programs it without erasing it; an erase sets the bits again. Ranges not page
+ *              aligned, out of the device and a second check while one is running are refused.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_BLANK_FEATURE enabled; again with
+ *              EXTERNAL_FLASH_WRITE_COMBINE_FEATURE enabled.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_BLANK_FEATURE == DISABLED)
+#error "ExternalFlashBlankTest requires EXTERNAL_FLASH_BLANK_FEATURE"
+#endif
+
+//! One page in this many has a byte written
+#define EXTERNAL_FLASH_BLANK_TEST_DIRTY_STRIDE      (7)
+
+//! Bytes of the client read and of the write into an erased page
+#define EXTERNAL_FLASH_BLANK_TEST_SIZE              (100)
+
+static uint8_t ExternalFlashBlankTest_Image[EXTERNAL_FLASH_TEST_IMAGE_SIZE];
+static uint8_t ExternalFlashBlankTest_Data[EXTERNAL_FLASH_BLANK_TEST_SIZE];
+static uint8_t ExternalFlashBlankTest_Read[512];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static BOOL_TYPE IsPageBlank(const uint8_t* memory, uint16_t page, uint16_t page_size);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    EXTERNAL_FLASH_GEOMETRY_TYPE geometry;
+    const DATAFLASH_SIM_STATS_TYPE* stats;
+    uint32_t address;
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == DISABLED)
+    uint32_t page_erases;
+#endif
+    uint16_t page_size;
+    uint16_t page;
+    uint8_t instance_id;
+    BOOL_TYPE matching = TRUE;
+
+    // Bytes written at any offset of some pages, the first and the last page included
+    instance_id = ExternalFlashTest__Setup(NULL, NULL);
+    SYS_ASSERT(ExternalFlash__GetGeometry(instance_id, &geometry) == TRUE);
+    SYS_ASSERT(DataFlashSim__GetMemorySize(EXTERNAL_FLASH_TEST_BUS_CHANNEL) <= sizeof(ExternalFlashBlankTest_Image));
+    SYS_ASSERT(geometry.Page_Size <= sizeof(ExternalFlashBlankTest_Read));
+    page_size = geometry.Page_Size;
+    (void)ExternalFlashTest__Snapshot(ExternalFlashBlankTest_Image);
+    for(page = 0; page < geometry.Page_Num; page++)
+    {
+        if(((page % EXTERNAL_FLASH_BLANK_TEST_DIRTY_STRIDE) == 0) || (page == (geometry.Page_Num - 1)))
+        {
+            address = ((uint32_t)page * page_size) + ((page * 37UL) % page_size);
+            ExternalFlashBlankTest_Image[ExternalFlashTest__GetMemoryOffset(address)] = (uint8_t)(0xFE << (page % 8));
+        }
+    }
+
+    instance_id = ExternalFlashTest__Setup(NULL, ExternalFlashBlankTest_Image);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+
+    // Unknown map after the mount, refused ranges
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__IsErased(instance_id, page_size, 1) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__ScanErased(EXTERNAL_FLASH_CH_NUM, 0, 1) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__ScanErased(instance_id, 1, 1) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__ScanErased(instance_id, 0, 0) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__ScanErased(instance_id, (uint32_t)(geometry.Page_Num - 1) * page_size, 2) == FALSE);
+
+    // Whole device, a client read served while the check runs
+    DataFlashSim__ResetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__ScanErased(instance_id, 0, geometry.Page_Num) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__ScanErased(instance_id, 0, 1) == FALSE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashBlankTest_Read, 0, page_size));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() != COMBINE_BYTES(EXTERNAL_FLASH_PROCESS_SCAN_COMPLETE, 0));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashBlankTest_Read, &ExternalFlashBlankTest_Image[ExternalFlashTest__GetMemoryOffset(0)], page_size) == 0);
+    ExternalFlashTest__Start();
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__Wait() == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == COMBINE_BYTES(EXTERNAL_FLASH_PROCESS_SCAN_COMPLETE, 0));
+
+    // Each page clocked out once besides the client read, EXTERNAL_FLASH_BLANK_SCAN_SIZE bytes at a time, with a few
+    // command bytes each
+    stats = DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Bus_Bytes <= ((((uint64_t)geometry.Page_Num + 1) * page_size) + (8 * (uint64_t)stats->Transactions)));
+    EXTERNAL_FLASH_TEST_CHECK(stats->Transactions <= (2 * (((uint32_t)geometry.Page_Num * page_size) / EXTERNAL_FLASH_BLANK_SCAN_SIZE)) + 4);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Busy_Violations == 0);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Protocol_Errors == 0);
+
+    for(page = 0; page < geometry.Page_Num; page++)
+    {
+        if(ExternalFlash__IsErased(instance_id, (uint32_t)page * page_size, page_size) != IsPageBlank(ExternalFlashBlankTest_Image, page, page_size))
+        {
+            matching = FALSE;
+        }
+    }
+    EXTERNAL_FLASH_TEST_CHECK(matching == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__IsErased(instance_id, page_size + 3, (uint16_t)(5 * page_size)) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__IsErased(instance_id, page_size + 3, (uint16_t)(6 * page_size)) == FALSE);
+
+    // Write into a page known erased: programmed without erase, no longer known erased
+    memset(ExternalFlashBlankTest_Data, 0x3C, sizeof(ExternalFlashBlankTest_Data));
+    address = (2 * (uint32_t)page_size) + 7;
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashBlankTest_Data, address, sizeof(ExternalFlashBlankTest_Data)));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Flush(instance_id));
+#else
+    page_erases = DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Page_Erases;
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashBlankTest_Data, address, sizeof(ExternalFlashBlankTest_Data)));
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Page_Erases == page_erases);
+#endif
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__IsErased(instance_id, address, 1) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__IsErased(instance_id, page_size, page_size) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__IsErased(instance_id, 3 * (uint32_t)page_size, page_size) == TRUE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashBlankTest_Read, 2 * (uint32_t)page_size, page_size));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(&ExternalFlashBlankTest_Read[7], ExternalFlashBlankTest_Data, sizeof(ExternalFlashBlankTest_Data)) == 0);
+    EXTERNAL_FLASH_TEST_CHECK((ExternalFlashBlankTest_Read[6] == 0xFF) && (ExternalFlashBlankTest_Read[7 + sizeof(ExternalFlashBlankTest_Data)] == 0xFF));
+
+    // Erase of the first block, written pages included
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__IsErased(instance_id, 0, geometry.Block_Size) == FALSE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Erase(instance_id, 0, geometry.Block_Size));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__IsErased(instance_id, 0, geometry.Block_Size) == TRUE);
+
+    // The map is not kept over a restart
+    (void)ExternalFlashTest__Snapshot(ExternalFlashBlankTest_Image);
+    instance_id = ExternalFlashTest__Setup(NULL, ExternalFlashBlankTest_Image);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__IsErased(instance_id, 0, page_size) == FALSE);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashBlankTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Tells if a device page of a chip memory is all 0xFF
+ * @param   memory: chip memory
+ * @param   page: device page
+ * @param   page_size: device page size
+ * @return  TRUE if blank
+ */
+static BOOL_TYPE IsPageBlank(const uint8_t* memory, uint16_t page, uint16_t page_size)
+{
+    uint32_t offset = ExternalFlashTest__GetMemoryOffset((uint32_t)page * page_size);
+    BOOL_TYPE blank = TRUE;
+
+    for(uint16_t index = 0; index < page_size; index++)
+    {
+        if(memory[offset + index] != 0xFF)
+        {
+            blank = FALSE;
+        }
+    }
+
+    return blank;
+}
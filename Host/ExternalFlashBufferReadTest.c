@@ -0,0 +1,136 @@
+/**
+ *  @file       ExternalFlashBufferReadTest.c
+ *
+ *  @brief      Host regression test of the reads served from the chip buffers by the ExternalFlash driver.
+ *  @details    A read-modify-write leaves the new page content in a chip buffer: reads within that page must come from
+ *              the buffer, and while the chip programs the next page from the other buffer they must not wait for the
+ *              program to end. Reads across a page boundary, and reads of a page changed by a program or an erase,
+ *              must go to the main memory. Every read returns the data written.
+ *
+ *              Build: see ExternalFlashTest.h, with the default features; again with EXTERNAL_FLASH_GATHER_FEATURE
+ *              enabled.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+#error "ExternalFlashBufferReadTest requires EXTERNAL_FLASH_WRITE_COMBINE_FEATURE disabled"
+#endif
+
+//! Bytes of the test writes and reads, within a page of the default part
+#define EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE        (64)
+
+//! Page size of the default part
+#define EXTERNAL_FLASH_BUFFER_READ_TEST_PAGE_SIZE   (256)
+
+static uint8_t ExternalFlashBufferReadTest_Data[EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE];
+static uint8_t ExternalFlashBufferReadTest_Read[EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static BOOL_TYPE ReadPage(uint8_t instance_id, uint32_t address, uint16_t size, uint64_t* time_us);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    DATAFLASH_SIM_CONFIG_TYPE config;
+    uint32_t page_a;
+    uint32_t page_b;
+    uint64_t time_us;
+    uint8_t instance_id;
+
+    ExternalFlashTest__GetDefaultConfig(&config);
+    instance_id = ExternalFlashTest__Setup(NULL, NULL);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+    page_a = 3 * EXTERNAL_FLASH_BUFFER_READ_TEST_PAGE_SIZE;
+    page_b = 4 * EXTERNAL_FLASH_BUFFER_READ_TEST_PAGE_SIZE;
+
+    srand(1);
+    for(uint16_t index = 0; index < sizeof(ExternalFlashBufferReadTest_Data); index++)
+    {
+        ExternalFlashBufferReadTest_Data[index] = (uint8_t)rand();
+    }
+
+    // Read of the page just written, once programmed
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashBufferReadTest_Data, page_a + 16, EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE));
+    ExternalFlashTest__RunFor(2 * config.Timing.Page_Erase_Program_Us);
+    EXTERNAL_FLASH_TEST_CHECK(ReadPage(instance_id, page_a + 16, EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE, &time_us) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashBufferReadTest_Read, ExternalFlashBufferReadTest_Data, EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE) == 0);
+
+    // Read of a page while the chip programs another one from the other buffer
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashBufferReadTest_Data, page_b, EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE));
+    EXTERNAL_FLASH_TEST_CHECK(ReadPage(instance_id, page_a + 16, EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE, &time_us) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(time_us < config.Timing.Page_Erase_Program_Us);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashBufferReadTest_Read, ExternalFlashBufferReadTest_Data, EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE) == 0);
+
+    // The page being programmed is read once the program ends
+    EXTERNAL_FLASH_TEST_CHECK(ReadPage(instance_id, page_b, EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE, &time_us) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashBufferReadTest_Read, ExternalFlashBufferReadTest_Data, EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE) == 0);
+
+    // Across the page boundary, from the main memory
+    EXTERNAL_FLASH_TEST_CHECK(ReadPage(instance_id, page_b - 8, 16, &time_us) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(&ExternalFlashBufferReadTest_Read[8], ExternalFlashBufferReadTest_Data, 8) == 0);
+
+    // A program makes the buffered copy stale
+    memset(ExternalFlashBufferReadTest_Read, 0x0F, sizeof(ExternalFlashBufferReadTest_Read));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Program(instance_id, ExternalFlashBufferReadTest_Read, page_a + 16, EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE));
+    EXTERNAL_FLASH_TEST_CHECK(ReadPage(instance_id, page_a + 16, EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE, &time_us) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK((ExternalFlashBufferReadTest_Read[0] == (ExternalFlashBufferReadTest_Data[0] & 0x0F)) &&
+                              (ExternalFlashBufferReadTest_Read[63] == (ExternalFlashBufferReadTest_Data[63] & 0x0F)));
+
+    // So does an erase
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashBufferReadTest_Data, page_a + 16, EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Erase(instance_id, page_a, EXTERNAL_FLASH_BUFFER_READ_TEST_PAGE_SIZE));
+    EXTERNAL_FLASH_TEST_CHECK(ReadPage(instance_id, page_a + 16, EXTERNAL_FLASH_BUFFER_READ_TEST_SIZE, &time_us) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK((ExternalFlashBufferReadTest_Read[0] == 0xFF) && (ExternalFlashBufferReadTest_Read[63] == 0xFF));
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Busy_Violations == 0);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashBufferReadTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads into ExternalFlashBufferReadTest_Read and tells where the chip served the read from
+ * @param   instance_id: External Flash instance
+ * @param   address: read address
+ * @param   size: bytes
+ * @param   time_us: virtual time from the request to the callback
+ * @return  TRUE if served from a chip buffer, FALSE if from the main memory
+ */
+static BOOL_TYPE ReadPage(uint8_t instance_id, uint32_t address, uint16_t size, uint64_t* time_us)
+{
+    const DATAFLASH_SIM_STATS_TYPE* stats = DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    uint32_t buffer_accesses = stats->Buffer_Accesses;
+    uint32_t page_reads = stats->Page_Reads;
+    uint64_t start_us = SystemTimersSim__GetUs();
+
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashBufferReadTest_Read, address, size));
+    *time_us = SystemTimersSim__GetUs() - start_us;
+
+    // One source only
+    EXTERNAL_FLASH_TEST_CHECK((stats->Buffer_Accesses - buffer_accesses) + (stats->Page_Reads - page_reads) >= 1);
+    EXTERNAL_FLASH_TEST_CHECK((stats->Buffer_Accesses == buffer_accesses) || (stats->Page_Reads == page_reads));
+
+    return (stats->Buffer_Accesses != buffer_accesses) ? TRUE : FALSE;
+}
@@ -0,0 +1,310 @@
+/**
+ *  @file       ExternalFlashCaptureTest.c
+ *
+ *  @brief      Host regression test of the call capture of the ExternalFlash driver.
+ *  @details    The capture stream must start with its magic and version and hold, in call order, one record per
+ *              allocation and request, accepted or not, and one per callback, each decoded as documented with
+ *              EXTERNAL_FLASH_CAPTURE_RECORD_TYPE; the record times must add up to the virtual time of the calls. Once
+ *              the RAM buffer is full the capture stops at a record boundary and counts the dropped records, and a new
+ *              initialization starts a new stream.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_CAPTURE_FEATURE enabled.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_CAPTURE_FEATURE == DISABLED)
+#error "ExternalFlashCaptureTest requires EXTERNAL_FLASH_CAPTURE_FEATURE"
+#endif
+
+//! Bytes of the test write, across two pages of the default part
+#define EXTERNAL_FLASH_CAPTURE_TEST_SIZE            (300)
+
+//! Page and block size of the default part
+#define EXTERNAL_FLASH_CAPTURE_TEST_PAGE_SIZE       (256)
+#define EXTERNAL_FLASH_CAPTURE_TEST_BLOCK_SIZE      (8 * EXTERNAL_FLASH_CAPTURE_TEST_PAGE_SIZE)
+
+//! Stream header: magic and version
+#define EXTERNAL_FLASH_CAPTURE_TEST_HEADER_SIZE     (5)
+
+//! Largest record: type, time, instance, two 32 bit varints, flag
+#define EXTERNAL_FLASH_CAPTURE_TEST_RECORD_MAX_SIZE (1 + 5 + 1 + 5 + 5 + 1)
+
+//! Records kept for the comparison
+#define EXTERNAL_FLASH_CAPTURE_TEST_RECORDS         (EXTERNAL_FLASH_CAPTURE_SIZE / 4)
+
+//! Decoded capture record
+typedef struct
+{
+    uint8_t                     Type;                       // EXTERNAL_FLASH_CAPTURE_RECORD_TYPE
+    uint32_t                    Time_Us;                    // Time since the previous record
+    uint8_t                     Instance;                   // Client id for allocation records
+    uint32_t                    Value_1;                    // Address, instance offset or callback event value
+    uint32_t                    Value_2;                    // Size, number of pages or allocated instance
+    uint8_t                     Flag;                       // Accepted, or mirror used for allocation records
+} EXTERNAL_FLASH_CAPTURE_TEST_RECORD_TYPE;
+
+static EXTERNAL_FLASH_CAPTURE_TEST_RECORD_TYPE ExternalFlashCaptureTest_Expected[EXTERNAL_FLASH_CAPTURE_TEST_RECORDS];
+static EXTERNAL_FLASH_CAPTURE_TEST_RECORD_TYPE ExternalFlashCaptureTest_Record[EXTERNAL_FLASH_CAPTURE_TEST_RECORDS];
+static uint32_t ExternalFlashCaptureTest_Expected_Num;
+static uint8_t ExternalFlashCaptureTest_Data[EXTERNAL_FLASH_CAPTURE_TEST_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void Expect(EXTERNAL_FLASH_CAPTURE_RECORD_TYPE type, uint8_t instance, uint32_t value_1, uint32_t value_2, uint8_t flag);
+static void ExpectComplete(void);
+static uint32_t Decode(const uint8_t* data, uint32_t size, BOOL_TYPE* valid);
+static BOOL_TYPE DecodeByte(const uint8_t* data, uint32_t size, uint32_t* offset, uint8_t* value);
+static BOOL_TYPE DecodeVarint(const uint8_t* data, uint32_t size, uint32_t* offset, uint32_t* value);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    const uint8_t* capture;
+    uint32_t size;
+    uint32_t dropped;
+    uint32_t record_num;
+    uint32_t time_us = 0;
+    uint64_t start_us;
+    uint8_t instance_id;
+    BOOL_TYPE valid;
+    BOOL_TYPE match = TRUE;
+
+    start_us = SystemTimersSim__GetUs();
+    instance_id = ExternalFlashTest__Setup(NULL, NULL);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+    memset(ExternalFlashCaptureTest_Data, 0x3C, sizeof(ExternalFlashCaptureTest_Data));
+    Expect(EXTERNAL_FLASH_CAPTURE_RECORD_ALLOCATION, (uint8_t)EXTERNAL_FLASH_TEST_CLIENT, 0, instance_id, FALSE);
+
+    // Accepted requests and their callbacks
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashCaptureTest_Data, 100, EXTERNAL_FLASH_CAPTURE_TEST_SIZE));
+    Expect(EXTERNAL_FLASH_CAPTURE_RECORD_WRITE, instance_id, 100, EXTERNAL_FLASH_CAPTURE_TEST_SIZE, TRUE);
+    ExpectComplete();
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashCaptureTest_Data, 100, EXTERNAL_FLASH_CAPTURE_TEST_SIZE));
+    Expect(EXTERNAL_FLASH_CAPTURE_RECORD_READ, instance_id, 100, EXTERNAL_FLASH_CAPTURE_TEST_SIZE, TRUE);
+    ExpectComplete();
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Erase(instance_id, EXTERNAL_FLASH_CAPTURE_TEST_BLOCK_SIZE, EXTERNAL_FLASH_CAPTURE_TEST_BLOCK_SIZE));
+    Expect(EXTERNAL_FLASH_CAPTURE_RECORD_ERASE, instance_id, EXTERNAL_FLASH_CAPTURE_TEST_BLOCK_SIZE, EXTERNAL_FLASH_CAPTURE_TEST_BLOCK_SIZE, TRUE);
+    ExpectComplete();
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Program(instance_id, ExternalFlashCaptureTest_Data, EXTERNAL_FLASH_CAPTURE_TEST_BLOCK_SIZE, EXTERNAL_FLASH_CAPTURE_TEST_PAGE_SIZE));
+    Expect(EXTERNAL_FLASH_CAPTURE_RECORD_PROGRAM, instance_id, EXTERNAL_FLASH_CAPTURE_TEST_BLOCK_SIZE, EXTERNAL_FLASH_CAPTURE_TEST_PAGE_SIZE, TRUE);
+    ExpectComplete();
+
+    // A rejected request, on an invalid instance
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__Read(EXTERNAL_FLASH_CH_NUM, ExternalFlashCaptureTest_Data, 100, 16) == FALSE);
+    Expect(EXTERNAL_FLASH_CAPTURE_RECORD_READ, EXTERNAL_FLASH_CH_NUM, 100, 16, FALSE);
+
+    capture = ExternalFlash__GetCapture(&size, &dropped);
+    EXTERNAL_FLASH_TEST_CHECK(capture != NULL);
+    EXTERNAL_FLASH_TEST_CHECK(dropped == 0);
+    EXTERNAL_FLASH_TEST_CHECK(size > EXTERNAL_FLASH_CAPTURE_TEST_HEADER_SIZE);
+    EXTERNAL_FLASH_TEST_CHECK((capture[0] == 'E') && (capture[1] == 'F') && (capture[2] == 'C') && (capture[3] == 'P'));
+    EXTERNAL_FLASH_TEST_CHECK(capture[4] == EXTERNAL_FLASH_CAPTURE_VERSION);
+
+    // Records in call order, as captured
+    record_num = Decode(capture, size, &valid);
+    EXTERNAL_FLASH_TEST_CHECK(valid == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(record_num == ExternalFlashCaptureTest_Expected_Num);
+    for(uint32_t index = 0; (index < record_num) && (index < ExternalFlashCaptureTest_Expected_Num); index++)
+    {
+        const EXTERNAL_FLASH_CAPTURE_TEST_RECORD_TYPE* record = &ExternalFlashCaptureTest_Record[index];
+        const EXTERNAL_FLASH_CAPTURE_TEST_RECORD_TYPE* expected = &ExternalFlashCaptureTest_Expected[index];
+
+        if((record->Type != expected->Type) || (record->Instance != expected->Instance) ||
+           (record->Value_1 != expected->Value_1) || (record->Value_2 != expected->Value_2) || (record->Flag != expected->Flag))
+        {
+            match = FALSE;
+        }
+        time_us += record->Time_Us;
+    }
+    EXTERNAL_FLASH_TEST_CHECK(match == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(time_us <= (uint32_t)(SystemTimersSim__GetUs() - start_us));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashCaptureTest_Record[1].Time_Us >= (2 * EXTERNAL_FLASH_HANDLER_PERIOD_MS * 1000));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashCaptureTest_Record[2].Time_Us > 0);
+
+    // Full buffer, the stored stream stays a whole number of records
+    for(uint32_t index = 0; (index < EXTERNAL_FLASH_CAPTURE_SIZE) && (dropped == 0); index++)
+    {
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashCaptureTest_Data, 0, 16));
+        capture = ExternalFlash__GetCapture(&size, &dropped);
+    }
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashCaptureTest_Data, 0, 16));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__GetCapture(&size, &dropped) == capture);
+    EXTERNAL_FLASH_TEST_CHECK(dropped >= 3);
+    EXTERNAL_FLASH_TEST_CHECK(size <= EXTERNAL_FLASH_CAPTURE_SIZE);
+    EXTERNAL_FLASH_TEST_CHECK(size > (EXTERNAL_FLASH_CAPTURE_SIZE - EXTERNAL_FLASH_CAPTURE_TEST_RECORD_MAX_SIZE));
+    (void)Decode(capture, size, &valid);
+    EXTERNAL_FLASH_TEST_CHECK(valid == TRUE);
+
+    // A new initialization starts a new stream
+    ExternalFlash__Initialize();
+    capture = ExternalFlash__GetCapture(&size, &dropped);
+    EXTERNAL_FLASH_TEST_CHECK((size == EXTERNAL_FLASH_CAPTURE_TEST_HEADER_SIZE) && (dropped == 0));
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashCaptureTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Appends a record to the expected stream
+ * @param   type: record type
+ * @param   instance: instance, client id for allocation records
+ * @param   value_1: address, instance offset or callback event value
+ * @param   value_2: size, number of pages or allocated instance
+ * @param   flag: request accepted, or mirror used for allocation records
+ */
+static void Expect(EXTERNAL_FLASH_CAPTURE_RECORD_TYPE type, uint8_t instance, uint32_t value_1, uint32_t value_2, uint8_t flag)
+{
+    EXTERNAL_FLASH_CAPTURE_TEST_RECORD_TYPE* record = &ExternalFlashCaptureTest_Expected[ExternalFlashCaptureTest_Expected_Num++];
+
+    SYS_ASSERT(ExternalFlashCaptureTest_Expected_Num <= EXTERNAL_FLASH_CAPTURE_TEST_RECORDS);
+    record->Type = (uint8_t)type;
+    record->Time_Us = 0;
+    record->Instance = instance;
+    record->Value_1 = value_1;
+    record->Value_2 = value_2;
+    record->Flag = flag;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Appends the record of the last callback to the expected stream
+ */
+static void ExpectComplete(void)
+{
+    Expect(EXTERNAL_FLASH_CAPTURE_RECORD_COMPLETE, ExternalFlashTest__GetSource(), ExternalFlashTest__GetEvent(), 0, 0);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Decodes the records of a capture stream into ExternalFlashCaptureTest_Record
+ * @param   data: stream, header included
+ * @param   size: stream bytes
+ * @param   valid: set to TRUE if the stream is a whole number of valid records
+ * @return  records decoded
+ */
+static uint32_t Decode(const uint8_t* data, uint32_t size, BOOL_TYPE* valid)
+{
+    uint32_t offset = EXTERNAL_FLASH_CAPTURE_TEST_HEADER_SIZE;
+    uint32_t record_num = 0;
+
+    *valid = TRUE;
+    while((offset < size) && (*valid == TRUE))
+    {
+        EXTERNAL_FLASH_CAPTURE_TEST_RECORD_TYPE record;
+        uint8_t allocated;
+
+        memset(&record, 0, sizeof(record));
+        *valid = (DecodeByte(data, size, &offset, &record.Type) == TRUE) &&
+                 (DecodeVarint(data, size, &offset, &record.Time_Us) == TRUE) &&
+                 (DecodeByte(data, size, &offset, &record.Instance) == TRUE) ? TRUE : FALSE;
+        switch(record.Type)
+        {
+          case EXTERNAL_FLASH_CAPTURE_RECORD_ALLOCATION:
+            if((DecodeByte(data, size, &offset, &record.Flag) == FALSE) ||
+               (DecodeVarint(data, size, &offset, &record.Value_1) == FALSE) ||
+               (DecodeByte(data, size, &offset, &allocated) == FALSE))
+            {
+                *valid = FALSE;
+            }
+            else
+            {
+                record.Value_2 = allocated;
+            }
+            break;
+
+          case EXTERNAL_FLASH_CAPTURE_RECORD_COMPLETE:
+            if(DecodeVarint(data, size, &offset, &record.Value_1) == FALSE)
+            {
+                *valid = FALSE;
+            }
+            break;
+
+          default:
+            if((record.Type >= EXTERNAL_FLASH_CAPTURE_RECORD_NUM) ||
+               (DecodeVarint(data, size, &offset, &record.Value_1) == FALSE) ||
+               (DecodeVarint(data, size, &offset, &record.Value_2) == FALSE) ||
+               (DecodeByte(data, size, &offset, &record.Flag) == FALSE))
+            {
+                *valid = FALSE;
+            }
+            break;
+        }
+
+        if((*valid == TRUE) && (record_num < EXTERNAL_FLASH_CAPTURE_TEST_RECORDS))
+        {
+            ExternalFlashCaptureTest_Record[record_num] = record;
+        }
+        record_num++;
+    }
+    return record_num;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Decodes a byte of the stream
+ * @param   data: stream
+ * @param   size: stream bytes
+ * @param   offset: position, advanced past the byte
+ * @param   value: decoded byte
+ * @return  TRUE if the byte is in the stream
+ */
+static BOOL_TYPE DecodeByte(const uint8_t* data, uint32_t size, uint32_t* offset, uint8_t* value)
+{
+    BOOL_TYPE valid = FALSE;
+
+    if(*offset < size)
+    {
+        *value = data[(*offset)++];
+        valid = TRUE;
+    }
+    return valid;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Decodes a LEB128 varint of the stream
+ * @param   data: stream
+ * @param   size: stream bytes
+ * @param   offset: position, advanced past the varint
+ * @param   value: decoded value
+ * @return  TRUE if the whole varint is in the stream
+ */
+static BOOL_TYPE DecodeVarint(const uint8_t* data, uint32_t size, uint32_t* offset, uint32_t* value)
+{
+    BOOL_TYPE valid = FALSE;
+    uint8_t shift = 0;
+
+    *value = 0;
+    while((*offset < size) && (shift < 35))
+    {
+        uint8_t byte = data[(*offset)++];
+
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        shift += 7;
+        if((byte & 0x80) == 0)
+        {
+            valid = TRUE;
+            break;
+        }
+    }
+    return valid;
+}
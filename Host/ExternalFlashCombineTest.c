@@ -0,0 +1,188 @@
+/**
+ *  @file       ExternalFlashCombineTest.c
+ *
+ *  @brief      Host regression test of the write combining of the ExternalFlash driver.
+ *  @details    Small writes to one page are accumulated in the chip buffer: they program the page once, when a write
+ *              touches another page, on ExternalFlash__Flush or once EXTERNAL_FLASH_WRITE_COMBINE_TIMEOUT_MS passed
+ *              without writes. Until then the main memory keeps the old data, reads see the new one, and a program
+ *              or an erase of the buffered page commits it first. A power loss before the commit loses only the
+ *              buffered writes.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_WRITE_COMBINE_FEATURE enabled; again with
+ *              EXTERNAL_FLASH_GATHER_FEATURE enabled.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == DISABLED)
+#error "ExternalFlashCombineTest requires EXTERNAL_FLASH_WRITE_COMBINE_FEATURE"
+#endif
+
+//! Small writes of the test, all in one page of the default part
+#define EXTERNAL_FLASH_COMBINE_TEST_WRITES          (16)
+#define EXTERNAL_FLASH_COMBINE_TEST_WRITE_SIZE      (12)
+
+//! Page and block size of the default part
+#define EXTERNAL_FLASH_COMBINE_TEST_PAGE_SIZE       (256)
+#define EXTERNAL_FLASH_COMBINE_TEST_BLOCK_SIZE      (8 * EXTERNAL_FLASH_COMBINE_TEST_PAGE_SIZE)
+
+static uint8_t ExternalFlashCombineTest_Data[EXTERNAL_FLASH_COMBINE_TEST_WRITES * EXTERNAL_FLASH_COMBINE_TEST_WRITE_SIZE];
+static uint8_t ExternalFlashCombineTest_Read[EXTERNAL_FLASH_COMBINE_TEST_WRITES * EXTERNAL_FLASH_COMBINE_TEST_WRITE_SIZE];
+static uint8_t ExternalFlashCombineTest_Image[EXTERNAL_FLASH_TEST_IMAGE_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static uint32_t GetPagePrograms(void);
+static void WritePage(uint8_t instance_id, uint32_t address);
+static BOOL_TYPE IsInMemory(uint32_t address, uint16_t size);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    uint32_t programs;
+    uint32_t address;
+    uint8_t instance_id;
+
+    instance_id = ExternalFlashTest__Setup(NULL, NULL);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+    SYS_ASSERT(DataFlashSim__GetMemorySize(EXTERNAL_FLASH_TEST_BUS_CHANNEL) <= sizeof(ExternalFlashCombineTest_Image));
+    SYS_ASSERT(sizeof(ExternalFlashCombineTest_Data) <= EXTERNAL_FLASH_COMBINE_TEST_PAGE_SIZE);
+
+    srand(1);
+    for(uint16_t index = 0; index < sizeof(ExternalFlashCombineTest_Data); index++)
+    {
+        ExternalFlashCombineTest_Data[index] = (uint8_t)rand();
+    }
+
+    // Writes to one page, programmed once by the flush
+    address = 2 * EXTERNAL_FLASH_COMBINE_TEST_PAGE_SIZE + 8;
+    programs = GetPagePrograms();
+    WritePage(instance_id, address);
+    EXTERNAL_FLASH_TEST_CHECK(GetPagePrograms() == programs);
+    EXTERNAL_FLASH_TEST_CHECK(IsInMemory(address, sizeof(ExternalFlashCombineTest_Data)) == FALSE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashCombineTest_Read, address, sizeof(ExternalFlashCombineTest_Read)));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashCombineTest_Read, ExternalFlashCombineTest_Data, sizeof(ExternalFlashCombineTest_Data)) == 0);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Flush(instance_id));
+    EXTERNAL_FLASH_TEST_CHECK(GetPagePrograms() == (programs + 1));
+    ExternalFlashTest__RunFor(100 * 1000);
+    EXTERNAL_FLASH_TEST_CHECK(IsInMemory(address, sizeof(ExternalFlashCombineTest_Data)) == TRUE);
+
+    // Flush of a clean buffer, nothing to program
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Flush(instance_id));
+    EXTERNAL_FLASH_TEST_CHECK(GetPagePrograms() == (programs + 1));
+
+    // A write to another page commits the buffered one
+    address = 5 * EXTERNAL_FLASH_COMBINE_TEST_PAGE_SIZE;
+    programs = GetPagePrograms();
+    WritePage(instance_id, address);
+    EXTERNAL_FLASH_TEST_CHECK(GetPagePrograms() == programs);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashCombineTest_Data, address + EXTERNAL_FLASH_COMBINE_TEST_PAGE_SIZE, 4));
+    EXTERNAL_FLASH_TEST_CHECK(GetPagePrograms() == (programs + 1));
+
+    // The timeout commits the buffered page
+    ExternalFlashTest__RunFor((EXTERNAL_FLASH_WRITE_COMBINE_TIMEOUT_MS / 2) * 1000);
+    EXTERNAL_FLASH_TEST_CHECK(GetPagePrograms() == (programs + 1));
+    ExternalFlashTest__RunFor(EXTERNAL_FLASH_WRITE_COMBINE_TIMEOUT_MS * 1000);
+    EXTERNAL_FLASH_TEST_CHECK(GetPagePrograms() == (programs + 2));
+    EXTERNAL_FLASH_TEST_CHECK(IsInMemory(address, sizeof(ExternalFlashCombineTest_Data)) == TRUE);
+
+    // An erase of the buffered page follows the buffered writes
+    address = EXTERNAL_FLASH_COMBINE_TEST_BLOCK_SIZE;
+    WritePage(instance_id, address);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Erase(instance_id, EXTERNAL_FLASH_COMBINE_TEST_BLOCK_SIZE, EXTERNAL_FLASH_COMBINE_TEST_BLOCK_SIZE));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashCombineTest_Read, address, sizeof(ExternalFlashCombineTest_Read)));
+    EXTERNAL_FLASH_TEST_CHECK((ExternalFlashCombineTest_Read[0] == 0xFF) && (ExternalFlashCombineTest_Read[sizeof(ExternalFlashCombineTest_Read) - 1] == 0xFF));
+    ExternalFlashTest__RunFor(2 * EXTERNAL_FLASH_WRITE_COMBINE_TIMEOUT_MS * 1000);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashCombineTest_Read, address, sizeof(ExternalFlashCombineTest_Read)));
+    EXTERNAL_FLASH_TEST_CHECK((ExternalFlashCombineTest_Read[0] == 0xFF) && (ExternalFlashCombineTest_Read[sizeof(ExternalFlashCombineTest_Read) - 1] == 0xFF));
+
+    // A program of the buffered page follows the buffered writes
+    WritePage(instance_id, address);
+    memset(ExternalFlashCombineTest_Read, 0x0F, sizeof(ExternalFlashCombineTest_Read));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Program(instance_id, ExternalFlashCombineTest_Read, address, sizeof(ExternalFlashCombineTest_Read)));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashCombineTest_Read, address, sizeof(ExternalFlashCombineTest_Read)));
+    EXTERNAL_FLASH_TEST_CHECK((ExternalFlashCombineTest_Read[0] == (ExternalFlashCombineTest_Data[0] & 0x0F)) &&
+                              (ExternalFlashCombineTest_Read[100] == (ExternalFlashCombineTest_Data[100] & 0x0F)));
+
+    // Power loss with a buffered page: the committed pages survive, the buffered writes are lost
+    address = 7 * EXTERNAL_FLASH_COMBINE_TEST_PAGE_SIZE;
+    WritePage(instance_id, address);
+    (void)ExternalFlashTest__Snapshot(ExternalFlashCombineTest_Image);
+    instance_id = ExternalFlashTest__Setup(NULL, ExternalFlashCombineTest_Image);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashCombineTest_Read, address, sizeof(ExternalFlashCombineTest_Read)));
+    EXTERNAL_FLASH_TEST_CHECK((ExternalFlashCombineTest_Read[0] == 0xFF) && (ExternalFlashCombineTest_Read[sizeof(ExternalFlashCombineTest_Read) - 1] == 0xFF));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashCombineTest_Read, 2 * EXTERNAL_FLASH_COMBINE_TEST_PAGE_SIZE + 8, sizeof(ExternalFlashCombineTest_Read)));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashCombineTest_Read, ExternalFlashCombineTest_Data, sizeof(ExternalFlashCombineTest_Data)) == 0);
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Busy_Violations == 0);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashCombineTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Pages programmed by the simulated chip so far
+ * @return  page programs
+ */
+static uint32_t GetPagePrograms(void)
+{
+    return DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Page_Programs;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Writes the test data with small writes, one after the other
+ * @param   instance_id: External Flash instance
+ * @param   address: address of the first write
+ */
+static void WritePage(uint8_t instance_id, uint32_t address)
+{
+    for(uint16_t index = 0; index < EXTERNAL_FLASH_COMBINE_TEST_WRITES; index++)
+    {
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, &ExternalFlashCombineTest_Data[index * EXTERNAL_FLASH_COMBINE_TEST_WRITE_SIZE],
+                                                     address + (index * EXTERNAL_FLASH_COMBINE_TEST_WRITE_SIZE), EXTERNAL_FLASH_COMBINE_TEST_WRITE_SIZE));
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Checks if the test data is in the main memory of the chip
+ * @param   address: linear address of the data
+ * @param   size: bytes
+ * @return  TRUE if all the bytes match
+ */
+static BOOL_TYPE IsInMemory(uint32_t address, uint16_t size)
+{
+    const uint8_t* memory = DataFlashSim__GetMemory(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    BOOL_TYPE match = TRUE;
+
+    for(uint16_t index = 0; index < size; index++)
+    {
+        if(memory[ExternalFlashTest__GetMemoryOffset(address + index)] != ExternalFlashCombineTest_Data[index])
+        {
+            match = FALSE;
+        }
+    }
+    return match;
+}
@@ -0,0 +1,153 @@
+/**
+ *  @file       ExternalFlashCounterTest.c
+ *
+ *  @brief      Host regression test of the External Flash bit-flip counters, with the driver page integrity check.
+ *  @details    Counter 0 is incremented through several half rollovers, mounted again along the way and after resets,
+ *              and reset in the middle of increments and rollovers: after each reset the value must be the one before
+ *              or after the interrupted increment. Each increment programs the bitmap byte over its programmed bits,
+ *              the driver page CRCs must follow without reporting a mismatch.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_INTEGRITY_FEATURE enabled, linking
+ *              ExternalFlashCounter.c; the host framework EXTERNAL_FLASH_COUNTER_MAP declares counter 0 on
+ *              EXTERNAL_FLASH_TEST_CLIENT.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+#include "ExternalFlashCounter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_INTEGRITY_FEATURE == DISABLED)
+#error "ExternalFlashCounterTest requires EXTERNAL_FLASH_INTEGRITY_FEATURE"
+#endif
+
+//! Increments of the test, several rollovers of a counter of one page per half
+#define EXTERNAL_FLASH_COUNTER_TEST_INCREMENTS      (3 * EXTERNAL_FLASH_COUNTER_BITS(1) + 100)
+
+//! Resets in the middle of an increment
+#define EXTERNAL_FLASH_COUNTER_TEST_RESETS          (200)
+
+static uint8_t ExternalFlashCounterTest_Instance;
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void Restart(const uint8_t* image);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    uint8_t* image;
+    uint32_t value = 0;
+
+    Restart(NULL);
+    image = malloc(DataFlashSim__GetMemorySize(EXTERNAL_FLASH_TEST_BUS_CHANNEL));
+    SYS_ASSERT(image != NULL);
+    srand(1);
+
+    // Not mounted
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashCounter__GetValue(0) == INVALID_VALUE_32);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashCounter__Increment(0) == FALSE);
+
+    // Fresh mount
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashCounter__Mount(0));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_COUNTER_EVENT_MOUNTED);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashCounter__GetValue(0) == 0);
+
+    // Increments through rollovers, mounted again from time to time
+    while(value < EXTERNAL_FLASH_COUNTER_TEST_INCREMENTS)
+    {
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlashCounter__Increment(0));
+        value++;
+        if(EXTERNAL_FLASH_TEST_CHECK(ExternalFlashCounter__GetValue(0) == value) == FALSE)
+        {
+            break;
+        }
+        if((value % 997) == 0)
+        {
+            EXTERNAL_FLASH_TEST_RUN(ExternalFlashCounter__Mount(0));
+            EXTERNAL_FLASH_TEST_CHECK(ExternalFlashCounter__GetValue(0) == value);
+            EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(ExternalFlashCounterTest_Instance) == TRUE);
+        }
+    }
+
+    // Reset, the page CRCs are learned again by the mount and followed by the next increments
+    (void)ExternalFlashTest__Snapshot(image);
+    Restart(image);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashCounter__Mount(0));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashCounter__GetValue(0) == value);
+    for(uint8_t increment = 0; increment < 20; increment++)
+    {
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlashCounter__Increment(0));
+        value++;
+    }
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashCounter__Mount(0));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashCounter__GetValue(0) == value);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(ExternalFlashCounterTest_Instance) == TRUE);
+
+    // Resets at random points of an increment, rollovers included: the increment is lost or counted
+    for(uint16_t reset = 0; reset < EXTERNAL_FLASH_COUNTER_TEST_RESETS; reset++)
+    {
+        uint32_t cut_us = (uint32_t)(rand() % 12000);
+
+        // Get close to a rollover now and then
+        for(uint16_t increment = ((reset % 10) == 0) ? (uint16_t)(rand() % 2000) : 0; increment > 0; increment--)
+        {
+            EXTERNAL_FLASH_TEST_RUN(ExternalFlashCounter__Increment(0));
+            value++;
+        }
+
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashCounter__Increment(0) == TRUE);
+        ExternalFlashTest__RunFor(cut_us);
+        (void)ExternalFlashTest__Snapshot(image);
+
+        Restart(image);
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlashCounter__Mount(0));
+        if(EXTERNAL_FLASH_TEST_CHECK((ExternalFlashCounter__GetValue(0) == value) || (ExternalFlashCounter__GetValue(0) == (value + 1))) == FALSE)
+        {
+            break;
+        }
+        value = ExternalFlashCounter__GetValue(0);
+
+        // Counting goes on after the reset
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlashCounter__Increment(0));
+        value++;
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashCounter__GetValue(0) == value);
+    }
+
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashCounter__Mount(0));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashCounter__GetValue(0) == value);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(ExternalFlashCounterTest_Instance) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+
+    free(image);
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashCounterTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Brings up the driver and the counters as after a reset
+ * @param   image: chip content, NULL for an erased chip
+ */
+static void Restart(const uint8_t* image)
+{
+    ExternalFlashCounterTest_Instance = ExternalFlashTest__Setup(NULL, image);
+    ExternalFlashCounter__Initialize();
+    ExternalFlashCounter__RegisterEventHandler(ExternalFlashTest__EventHandler, CALLBACK_FILTER_VALUE_NONE, CALLBACK_FILTER_VALUE_NONE);
+}
@@ -0,0 +1,190 @@
+/**
+ *  @file       ExternalFlashDetectTest.c
+ *
+ *  @brief      Host regression test of the device detection of the ExternalFlash driver.
+ *  @details    Each AT45DB part, with binary and DataFlash pages, is detected from its JEDEC ID and page size
+ *              configuration: the geometry must match the part and data written across pages, at the end of the device
+ *              and into an erased block must land at its place in the chip array. The AT45DB642D and AT45DB641E share
+ *              their device id and differ by the extended device information. An unknown part is handled as the
+ *              EXTERNAL_FLASH_DEVICE_ID part.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_DETECT_FEATURE enabled and
+ *              EXTERNAL_FLASH_MAX_PAGE_NUMBER set to 32768.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_DETECT_FEATURE == DISABLED) || (EXTERNAL_FLASH_MAX_PAGE_NUMBER < 32768)
+#error "ExternalFlashDetectTest requires EXTERNAL_FLASH_DETECT_FEATURE and EXTERNAL_FLASH_MAX_PAGE_NUMBER 32768"
+#endif
+
+//! Bytes of each write, across pages of all the parts
+#define EXTERNAL_FLASH_DETECT_TEST_SIZE             (2500)
+
+//! Simulated part
+typedef struct
+{
+    uint8_t                     Device_Id;                  // JEDEC device id 1
+    uint8_t                     Edi_Length;                 // Extended device information length
+    uint16_t                    Page_Num;
+    uint16_t                    Page_Size;                  // Binary page size
+} EXTERNAL_FLASH_DETECT_TEST_PART_TYPE;
+
+static const EXTERNAL_FLASH_DETECT_TEST_PART_TYPE ExternalFlashDetectTest_Part[] =
+{
+    {0x22, 0,   512,  256},                                 // AT45DB011D
+    {0x23, 0,  1024,  256},                                 // AT45DB021D
+    {0x23, 1,  1024,  256},                                 // AT45DB021E
+    {0x24, 0,  2048,  256},                                 // AT45DB041D
+    {0x25, 0,  4096,  256},                                 // AT45DB081D
+    {0x26, 0,  4096,  512},                                 // AT45DB161D
+    {0x27, 0,  8192,  512},                                 // AT45DB321D
+    {0x27, 1,  8192,  512},                                 // AT45DB321E
+    {0x28, 0,  8192, 1024},                                 // AT45DB642D
+    {0x28, 1, 32768,  256},                                 // AT45DB641E
+};
+
+static uint8_t ExternalFlashDetectTest_Data[EXTERNAL_FLASH_DETECT_TEST_SIZE];
+static uint8_t ExternalFlashDetectTest_Read[EXTERNAL_FLASH_DETECT_TEST_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void TestPart(const EXTERNAL_FLASH_DETECT_TEST_PART_TYPE* part, BOOL_TYPE binary_page);
+static void CheckMemory(const EXTERNAL_FLASH_DETECT_TEST_PART_TYPE* part, uint16_t page_size, uint32_t address, uint16_t size);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    EXTERNAL_FLASH_DETECT_TEST_PART_TYPE unknown = {0x2F, 0, 1024, 256};
+    DATAFLASH_SIM_CONFIG_TYPE config;
+    EXTERNAL_FLASH_GEOMETRY_TYPE geometry;
+    uint8_t instance_id;
+
+    srand(1);
+    for(uint16_t index = 0; index < sizeof(ExternalFlashDetectTest_Data); index++)
+    {
+        ExternalFlashDetectTest_Data[index] = (uint8_t)rand();
+    }
+
+    for(uint8_t index = 0; index < ELEMENTS_IN_ARRAY(ExternalFlashDetectTest_Part); index++)
+    {
+        TestPart(&ExternalFlashDetectTest_Part[index], TRUE);
+        TestPart(&ExternalFlashDetectTest_Part[index], FALSE);
+    }
+
+    // Unknown part, as the default one
+    ExternalFlashTest__GetDefaultConfig(&config);
+    config.Jedec_Id[1] = unknown.Device_Id;
+    instance_id = ExternalFlashTest__Setup(&config, NULL);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__GetGeometry(instance_id, &geometry) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(geometry.Jedec_Id[1] == unknown.Device_Id);
+    EXTERNAL_FLASH_TEST_CHECK(geometry.Page_Size == EXTERNAL_FLASH_DEVICE_PAGE_SIZE);
+    EXTERNAL_FLASH_TEST_CHECK(geometry.Page_Num == EXTERNAL_FLASH_DEVICE_PAGE_NUMBER);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashDetectTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Detects a simulated part and writes it through the driver
+ * @param   part: simulated part
+ * @param   binary_page: TRUE for the binary page size configuration
+ */
+static void TestPart(const EXTERNAL_FLASH_DETECT_TEST_PART_TYPE* part, BOOL_TYPE binary_page)
+{
+    DATAFLASH_SIM_CONFIG_TYPE config;
+    EXTERNAL_FLASH_GEOMETRY_TYPE geometry;
+    uint16_t page_size = (binary_page == TRUE) ? part->Page_Size : (uint16_t)(part->Page_Size + (part->Page_Size / 32));
+    uint32_t device_size = (uint32_t)page_size * part->Page_Num;
+    uint32_t address[3];
+    uint8_t instance_id;
+
+    ExternalFlashTest__GetDefaultConfig(&config);
+    config.Page_Size = part->Page_Size;
+    config.Page_Num = part->Page_Num;
+    config.Power_Of_Two_Pages = binary_page;
+    config.Density_Code = (uint8_t)(((part->Device_Id & 0x1F) * 2) - 1);
+    config.Jedec_Id[1] = part->Device_Id;
+    config.Jedec_Id[3] = part->Edi_Length;
+    instance_id = ExternalFlashTest__Setup(&config, NULL);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+
+    if(EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__GetGeometry(instance_id, &geometry) == TRUE) == FALSE)
+    {
+        return;
+    }
+    EXTERNAL_FLASH_TEST_CHECK(geometry.Page_Size == page_size);
+    EXTERNAL_FLASH_TEST_CHECK(geometry.Page_Num == part->Page_Num);
+    EXTERNAL_FLASH_TEST_CHECK((1UL << geometry.Byte_Bits) >= page_size);
+    EXTERNAL_FLASH_TEST_CHECK((1UL << geometry.Byte_Bits) < (2UL * page_size));
+    EXTERNAL_FLASH_TEST_CHECK(geometry.Block_Size == (8 * page_size));
+
+    // Across pages, at the end of the device, over an erased block
+    address[0] = (uint32_t)page_size - 10;
+    address[1] = device_size - EXTERNAL_FLASH_DETECT_TEST_SIZE;
+    address[2] = 3 * (uint32_t)geometry.Block_Size;
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashDetectTest_Data, address[0], EXTERNAL_FLASH_DETECT_TEST_SIZE));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashDetectTest_Data, address[1], EXTERNAL_FLASH_DETECT_TEST_SIZE));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Erase(instance_id, address[2], geometry.Block_Size));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Program(instance_id, ExternalFlashDetectTest_Data, address[2], page_size));
+
+    for(uint8_t index = 0; index < ELEMENTS_IN_ARRAY(address); index++)
+    {
+        uint16_t size = (index == 2) ? page_size : EXTERNAL_FLASH_DETECT_TEST_SIZE;
+
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashDetectTest_Read, address[index], size));
+        EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashDetectTest_Read, ExternalFlashDetectTest_Data, size) == 0);
+        CheckMemory(part, page_size, address[index], size);
+    }
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashDetectTest_Read, address[2] + page_size, page_size));
+    EXTERNAL_FLASH_TEST_CHECK((ExternalFlashDetectTest_Read[0] == 0xFF) && (ExternalFlashDetectTest_Read[page_size - 1] == 0xFF));
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Checks that the test data is at its place in the chip array, where the pages are always 33/32 of the
+ *          binary page size
+ * @param   part: simulated part
+ * @param   page_size: page size of the configuration
+ * @param   address: linear address of the data
+ * @param   size: bytes
+ */
+static void CheckMemory(const EXTERNAL_FLASH_DETECT_TEST_PART_TYPE* part, uint16_t page_size, uint32_t address, uint16_t size)
+{
+    const uint8_t* memory = DataFlashSim__GetMemory(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    uint32_t extended_page = (uint32_t)part->Page_Size + (part->Page_Size / 32);
+    BOOL_TYPE match = TRUE;
+
+    for(uint16_t index = 0; index < size; index++)
+    {
+        uint32_t page = (address + index) / page_size;
+        uint32_t byte = (address + index) % page_size;
+
+        if(memory[(page * extended_page) + byte] != ExternalFlashDetectTest_Data[index])
+        {
+            match = FALSE;
+        }
+    }
+    EXTERNAL_FLASH_TEST_CHECK(match == TRUE);
+}
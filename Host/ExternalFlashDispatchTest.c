@@ -0,0 +1,269 @@
+/**
+ *  @file       ExternalFlashDispatchTest.c
+ *
+ *  @brief      Host regression test of the dispatch of the bus events to the ExternalFlash instances.
+ *  @details    Two instances share the simulated chip, the second one at an offset. Random writes and reads are issued
+ *              to both at once: the instance issuing second is refused while the first one owns the chip and accepted
+ *              once it completed, each completion is notified once and to the instance that issued it, and each
+ *              instance reads back its own data, written at its own offset in the chip memory.
+ *
+ *              Build: see ExternalFlashTest.h, with a second EXTERNAL_FLASH_MAP entry
+ *              EXTERNAL_FLASH_DISPATCH_TEST_CLIENT on the same bus provider and channel as EXTERNAL_FLASH_TEST_CLIENT.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Map entry of the second instance, on the chip of EXTERNAL_FLASH_TEST_CLIENT
+#ifndef EXTERNAL_FLASH_DISPATCH_TEST_CLIENT
+#define EXTERNAL_FLASH_DISPATCH_TEST_CLIENT         ((EXTERNAL_FLASH_CH_TYPE)1)
+#endif
+
+//! Offset of the second instance in the device
+#define EXTERNAL_FLASH_DISPATCH_TEST_OFFSET         (0x8000)
+
+//! Bytes of each instance area, largest operation, operation pairs of the random sequence
+#define EXTERNAL_FLASH_DISPATCH_TEST_AREA_SIZE      (8192)
+#define EXTERNAL_FLASH_DISPATCH_TEST_MAX_SIZE       (600)
+#define EXTERNAL_FLASH_DISPATCH_TEST_OPERATIONS     (300)
+
+//! Instances of the test
+#define EXTERNAL_FLASH_DISPATCH_TEST_INSTANCES      (2)
+
+//! Step of virtual time while retrying a refused call
+#define EXTERNAL_FLASH_DISPATCH_TEST_STEP_US        (100)
+
+static uint8_t ExternalFlashDispatchTest_Instance[EXTERNAL_FLASH_DISPATCH_TEST_INSTANCES];
+static uint8_t ExternalFlashDispatchTest_Model[EXTERNAL_FLASH_DISPATCH_TEST_INSTANCES][EXTERNAL_FLASH_DISPATCH_TEST_AREA_SIZE];
+static uint8_t ExternalFlashDispatchTest_Data[EXTERNAL_FLASH_DISPATCH_TEST_INSTANCES][EXTERNAL_FLASH_DISPATCH_TEST_MAX_SIZE];
+static uint32_t ExternalFlashDispatchTest_Events[EXTERNAL_FLASH_DISPATCH_TEST_INSTANCES];
+static uint32_t ExternalFlashDispatchTest_Foreign_Events;
+
+//! Operation issued to an instance
+typedef struct
+{
+    BOOL_TYPE   Write;
+    uint16_t    Address;
+    uint16_t    Size;
+} EXTERNAL_FLASH_DISPATCH_TEST_OPERATION_TYPE;
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void DispatchEventHandler(CALLBACK_EVENT_TYPE event);
+static void NewOperation(uint8_t index, EXTERNAL_FLASH_DISPATCH_TEST_OPERATION_TYPE* operation);
+static BOOL_TYPE Issue(uint8_t index, const EXTERNAL_FLASH_DISPATCH_TEST_OPERATION_TYPE* operation);
+static void Complete(uint8_t index, const EXTERNAL_FLASH_DISPATCH_TEST_OPERATION_TYPE* operation);
+static BOOL_TYPE RunUntilEvents(uint8_t index, uint32_t events);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    EXTERNAL_FLASH_DISPATCH_TEST_OPERATION_TYPE operation[EXTERNAL_FLASH_DISPATCH_TEST_INSTANCES];
+    const uint8_t* memory;
+    uint32_t events[EXTERNAL_FLASH_DISPATCH_TEST_INSTANCES];
+    uint8_t first;
+    uint8_t second;
+    BOOL_TYPE accepted;
+    BOOL_TYPE first_done;
+    BOOL_TYPE refused = TRUE;
+    BOOL_TYPE serialized = TRUE;
+
+    ExternalFlashDispatchTest_Instance[0] = ExternalFlashTest__Setup(NULL, NULL);
+    ExternalFlashDispatchTest_Instance[1] = ExternalFlash__GetAllocation((uint8_t)EXTERNAL_FLASH_DISPATCH_TEST_CLIENT, NULL, EXTERNAL_FLASH_DISPATCH_TEST_OFFSET);
+    SYS_ASSERT(ExternalFlashDispatchTest_Instance[1] < EXTERNAL_FLASH_CH_NUM);
+    SYS_ASSERT(ExternalFlashDispatchTest_Instance[1] != ExternalFlashDispatchTest_Instance[0]);
+    for(uint8_t index = 0; index < EXTERNAL_FLASH_DISPATCH_TEST_INSTANCES; index++)
+    {
+        ExternalFlash__RegisterEventHandler(DispatchEventHandler, ExternalFlashDispatchTest_Instance[index], CALLBACK_FILTER_VALUE_NONE);
+        memset(ExternalFlashDispatchTest_Model[index], 0xFF, EXTERNAL_FLASH_DISPATCH_TEST_AREA_SIZE);
+    }
+
+    // Operations issued to both instances at once, the first issued by either
+    srand(5);
+    for(uint32_t pair = 0; pair < EXTERNAL_FLASH_DISPATCH_TEST_OPERATIONS; pair++)
+    {
+        first = (uint8_t)(rand() % EXTERNAL_FLASH_DISPATCH_TEST_INSTANCES);
+        second = (uint8_t)(1 - first);
+        NewOperation(first, &operation[first]);
+        NewOperation(second, &operation[second]);
+        events[0] = ExternalFlashDispatchTest_Events[0];
+        events[1] = ExternalFlashDispatchTest_Events[1];
+
+        ExternalFlashTest__Start();
+        EXTERNAL_FLASH_TEST_CHECK(Issue(first, &operation[first]) == TRUE);
+        if(Issue(second, &operation[second]) == TRUE)
+        {
+            refused = FALSE;
+        }
+        else
+        {
+            // Accepted once the first one completed
+            do
+            {
+                first_done = (ExternalFlashDispatchTest_Events[first] > events[first]) ? TRUE : FALSE;
+                accepted = Issue(second, &operation[second]);
+            } while((accepted == FALSE) && (ExternalFlashTest__Retry() == TRUE));
+            if((accepted == FALSE) || (first_done == FALSE))
+            {
+                serialized = FALSE;
+            }
+        }
+
+        EXTERNAL_FLASH_TEST_CHECK(RunUntilEvents(first, events[first] + 1) == TRUE);
+        EXTERNAL_FLASH_TEST_CHECK(RunUntilEvents(second, events[second] + 1) == TRUE);
+        Complete(first, &operation[first]);
+        Complete(second, &operation[second]);
+    }
+    EXTERNAL_FLASH_TEST_CHECK(refused == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(serialized == TRUE);
+
+    // No event duplicated or left over
+    ExternalFlashTest__RunFor(10 * EXTERNAL_FLASH_HANDLER_PERIOD_MS * 1000);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashDispatchTest_Events[0] == EXTERNAL_FLASH_DISPATCH_TEST_OPERATIONS);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashDispatchTest_Events[1] == EXTERNAL_FLASH_DISPATCH_TEST_OPERATIONS);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashDispatchTest_Foreign_Events == 0);
+
+    // Each area in the chip memory at the offset of its instance
+    memory = DataFlashSim__GetMemory(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    for(uint8_t index = 0; index < EXTERNAL_FLASH_DISPATCH_TEST_INSTANCES; index++)
+    {
+        uint32_t base = (index == 0) ? 0 : EXTERNAL_FLASH_DISPATCH_TEST_OFFSET;
+        BOOL_TYPE matching = TRUE;
+
+        for(uint32_t address = 0; address < EXTERNAL_FLASH_DISPATCH_TEST_AREA_SIZE; address++)
+        {
+            uint32_t device_address = base + address;
+
+            if(memory[ExternalFlashTest__GetMemoryOffset(device_address)] != ExternalFlashDispatchTest_Model[index][address])
+            {
+                matching = FALSE;
+            }
+        }
+        EXTERNAL_FLASH_TEST_CHECK(matching == TRUE);
+    }
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Busy_Violations == 0);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashDispatchTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Completion handler of both instances: counts the events of each, and those of any other instance
+ * @param   event: COMMON_I_CALLBACK_TYPE notified
+ */
+static void DispatchEventHandler(CALLBACK_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE flash_event;
+    BOOL_TYPE known = FALSE;
+
+    memcpy(&flash_event, &event, sizeof(CALLBACK_EVENT_TYPE));
+    for(uint8_t index = 0; index < EXTERNAL_FLASH_DISPATCH_TEST_INSTANCES; index++)
+    {
+        if(flash_event.Source_Instance_Id == ExternalFlashDispatchTest_Instance[index])
+        {
+            ExternalFlashDispatchTest_Events[index]++;
+            known = TRUE;
+        }
+    }
+    if(known == FALSE)
+    {
+        ExternalFlashDispatchTest_Foreign_Events++;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Picks a random write or read in the area of an instance, filling the data of a write
+ * @param   index: test instance
+ * @param   operation: operation picked
+ */
+static void NewOperation(uint8_t index, EXTERNAL_FLASH_DISPATCH_TEST_OPERATION_TYPE* operation)
+{
+    operation->Write = ((rand() % 2) == 0) ? TRUE : FALSE;
+    operation->Size = (uint16_t)(1 + (rand() % EXTERNAL_FLASH_DISPATCH_TEST_MAX_SIZE));
+    operation->Address = (uint16_t)(rand() % (EXTERNAL_FLASH_DISPATCH_TEST_AREA_SIZE - operation->Size + 1));
+    for(uint16_t offset = 0; offset < operation->Size; offset++)
+    {
+        ExternalFlashDispatchTest_Data[index][offset] = (operation->Write == TRUE) ? (uint8_t)rand() : 0;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Issues an operation to an instance
+ * @param   index: test instance
+ * @param   operation: operation
+ * @return  TRUE if accepted
+ */
+static BOOL_TYPE Issue(uint8_t index, const EXTERNAL_FLASH_DISPATCH_TEST_OPERATION_TYPE* operation)
+{
+    BOOL_TYPE accepted;
+
+    if(operation->Write == TRUE)
+    {
+        accepted = ExternalFlash__Write(ExternalFlashDispatchTest_Instance[index], ExternalFlashDispatchTest_Data[index], operation->Address, operation->Size);
+    }
+    else
+    {
+        accepted = ExternalFlash__Read(ExternalFlashDispatchTest_Instance[index], ExternalFlashDispatchTest_Data[index], operation->Address, operation->Size);
+    }
+
+    return accepted;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Applies a completed write to the model of its instance, or checks a completed read against it
+ * @param   index: test instance
+ * @param   operation: operation completed
+ */
+static void Complete(uint8_t index, const EXTERNAL_FLASH_DISPATCH_TEST_OPERATION_TYPE* operation)
+{
+    if(operation->Write == TRUE)
+    {
+        memcpy(&ExternalFlashDispatchTest_Model[index][operation->Address], ExternalFlashDispatchTest_Data[index], operation->Size);
+    }
+    else
+    {
+        EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashDispatchTest_Data[index], &ExternalFlashDispatchTest_Model[index][operation->Address], operation->Size) == 0);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs virtual time until an instance received a number of events
+ * @param   index: test instance
+ * @param   events: events expected
+ * @return  TRUE if received within EXTERNAL_FLASH_TEST_TIMEOUT_US
+ */
+static BOOL_TYPE RunUntilEvents(uint8_t index, uint32_t events)
+{
+    uint64_t end_us = SystemTimersSim__GetUs() + EXTERNAL_FLASH_TEST_TIMEOUT_US;
+
+    while((ExternalFlashDispatchTest_Events[index] < events) && (SystemTimersSim__GetUs() < end_us))
+    {
+        ExternalFlashTest__RunFor(EXTERNAL_FLASH_DISPATCH_TEST_STEP_US);
+    }
+
+    return (ExternalFlashDispatchTest_Events[index] >= events) ? TRUE : FALSE;
+}
@@ -0,0 +1,161 @@
+/**
+ *  @file       ExternalFlashGatherTest.c
+ *
+ *  @brief      Host regression test of the gather transfers of the ExternalFlash driver.
+ *  @details    With gather transfers each page of a Write and each chunk of a Read is one bus call: the command header
+ *              goes out as the address phase of the payload. Writes and reads at unaligned addresses across pages must
+ *              land at their place in the chip array and read back, the simulated chip must see no protocol error and
+ *              every transaction other than a status read must take a single bus call. A status read is the command
+ *              and the status bytes, two calls, and with write combining a flush ends with a chip select without
+ *              transfer once the buffer is committed.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_GATHER_FEATURE enabled; again with
+ *              EXTERNAL_FLASH_WRITE_COMBINE_FEATURE enabled.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_GATHER_FEATURE == DISABLED)
+#error "ExternalFlashGatherTest requires EXTERNAL_FLASH_GATHER_FEATURE"
+#endif
+
+//! Bytes of the test write, across six pages of the default part
+#define EXTERNAL_FLASH_GATHER_TEST_SIZE             (1300)
+
+//! Unaligned address of the test write
+#define EXTERNAL_FLASH_GATHER_TEST_ADDRESS          (37)
+
+//! Page size of the default part
+#define EXTERNAL_FLASH_GATHER_TEST_PAGE_SIZE        (256)
+
+//! Flushes after each write, the buffered page is committed by the flush
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+#define EXTERNAL_FLASH_GATHER_TEST_FLUSHES          (1)
+#else
+#define EXTERNAL_FLASH_GATHER_TEST_FLUSHES          (0)
+#endif
+
+static uint8_t ExternalFlashGatherTest_Data[EXTERNAL_FLASH_GATHER_TEST_SIZE];
+static uint8_t ExternalFlashGatherTest_Read[EXTERNAL_FLASH_GATHER_TEST_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void CheckTransfers(const DATAFLASH_SIM_STATS_TYPE* before, uint32_t min_transactions, uint32_t flushes);
+static void CheckMemory(void);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    DATAFLASH_SIM_STATS_TYPE before;
+    uint32_t page_num;
+    uint8_t instance_id;
+
+    instance_id = ExternalFlashTest__Setup(NULL, NULL);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+    page_num = ((EXTERNAL_FLASH_GATHER_TEST_ADDRESS + EXTERNAL_FLASH_GATHER_TEST_SIZE - 1) / EXTERNAL_FLASH_GATHER_TEST_PAGE_SIZE) -
+               (EXTERNAL_FLASH_GATHER_TEST_ADDRESS / EXTERNAL_FLASH_GATHER_TEST_PAGE_SIZE) + 1;
+
+    srand(1);
+    for(uint16_t index = 0; index < sizeof(ExternalFlashGatherTest_Data); index++)
+    {
+        ExternalFlashGatherTest_Data[index] = (uint8_t)rand();
+    }
+
+    // Write across pages, one transfer per page
+    memcpy(&before, DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL), sizeof(before));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashGatherTest_Data, EXTERNAL_FLASH_GATHER_TEST_ADDRESS, EXTERNAL_FLASH_GATHER_TEST_SIZE));
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Flush(instance_id));
+#endif
+    CheckTransfers(&before, page_num, EXTERNAL_FLASH_GATHER_TEST_FLUSHES);
+
+    // Read it back, then a few bytes across a page boundary
+    memcpy(&before, DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL), sizeof(before));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashGatherTest_Read, EXTERNAL_FLASH_GATHER_TEST_ADDRESS, EXTERNAL_FLASH_GATHER_TEST_SIZE));
+    CheckTransfers(&before, 1, 0);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashGatherTest_Read, ExternalFlashGatherTest_Data, EXTERNAL_FLASH_GATHER_TEST_SIZE) == 0);
+    CheckMemory();
+
+    memset(ExternalFlashGatherTest_Read, 0, sizeof(ExternalFlashGatherTest_Read));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashGatherTest_Read, EXTERNAL_FLASH_GATHER_TEST_PAGE_SIZE - 3, 6));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashGatherTest_Read,
+                                     &ExternalFlashGatherTest_Data[EXTERNAL_FLASH_GATHER_TEST_PAGE_SIZE - 3 - EXTERNAL_FLASH_GATHER_TEST_ADDRESS], 6) == 0);
+
+    // A single byte rewritten in the middle of a page keeps the rest of it
+    memcpy(&before, DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL), sizeof(before));
+    ExternalFlashGatherTest_Data[500] ^= 0xFF;
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, &ExternalFlashGatherTest_Data[500], EXTERNAL_FLASH_GATHER_TEST_ADDRESS + 500, 1));
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Flush(instance_id));
+#endif
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashGatherTest_Read, EXTERNAL_FLASH_GATHER_TEST_ADDRESS, EXTERNAL_FLASH_GATHER_TEST_SIZE));
+    CheckTransfers(&before, 2, EXTERNAL_FLASH_GATHER_TEST_FLUSHES);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashGatherTest_Read, ExternalFlashGatherTest_Data, EXTERNAL_FLASH_GATHER_TEST_SIZE) == 0);
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Busy_Violations == 0);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashGatherTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Checks that the transactions since a snapshot of the chip statistics took one bus call each, two for the
+ *          status reads
+ * @param   before: chip statistics before the operations
+ * @param   min_transactions: transactions other than status reads the operations need at least
+ * @param   flushes: flushes among the operations, each one ends with a chip select without transfer
+ */
+static void CheckTransfers(const DATAFLASH_SIM_STATS_TYPE* before, uint32_t min_transactions, uint32_t flushes)
+{
+    const DATAFLASH_SIM_STATS_TYPE* after = DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    uint32_t status_reads = after->Status_Reads - before->Status_Reads;
+    uint32_t transactions = after->Transactions - before->Transactions - status_reads - flushes;
+    uint32_t bus_calls = after->Bus_Calls - before->Bus_Calls - (2 * status_reads);
+
+    EXTERNAL_FLASH_TEST_CHECK(transactions >= min_transactions);
+    if(EXTERNAL_FLASH_TEST_CHECK(bus_calls == transactions) == FALSE)
+    {
+        printf("%u transactions, %u bus calls\n", transactions, bus_calls);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Checks that the test data is at its place in the chip array
+ */
+static void CheckMemory(void)
+{
+    const uint8_t* memory = DataFlashSim__GetMemory(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    BOOL_TYPE match = TRUE;
+
+    for(uint16_t index = 0; index < EXTERNAL_FLASH_GATHER_TEST_SIZE; index++)
+    {
+        uint32_t address = EXTERNAL_FLASH_GATHER_TEST_ADDRESS + index;
+
+        if(memory[ExternalFlashTest__GetMemoryOffset(address)] != ExternalFlashGatherTest_Data[index])
+        {
+            match = FALSE;
+        }
+    }
+    EXTERNAL_FLASH_TEST_CHECK(match == TRUE);
+}
@@ -0,0 +1,135 @@
+/**
+ *  @file       ExternalFlashIdleTest.c
+ *
+ *  @brief      Host regression test of ExternalFlash__IsBusy and ExternalFlash__GetTimeToIdle.
+ *  @details    A write, an erase and a read are started and followed in small steps of virtual time: the instance must
+ *              be busy, with a time to idle above zero, until the driver expects the chip ready again, and idle with a
+ *              time to idle of zero from then on, the simulated chip being ready then or shortly after. The estimate
+ *              given when each operation starts must be within a factor of the time the operation actually took,
+ *              status polls at handler periods included. Invalid instances are always busy, with no estimate.
+ *
+ *              Build: see ExternalFlashTest.h, with the default features.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Bytes of the test operations, several pages of the default part
+#define EXTERNAL_FLASH_IDLE_TEST_SIZE               (4096)
+
+//! Step of virtual time while following an operation
+#define EXTERNAL_FLASH_IDLE_TEST_STEP_US            (100)
+
+static uint8_t ExternalFlashIdleTest_Data[EXTERNAL_FLASH_IDLE_TEST_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void FollowToIdle(uint8_t instance_id, uint64_t start_us, uint32_t estimate_us);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    uint8_t instance_id;
+    uint64_t start_us;
+    uint32_t estimate_us;
+
+    instance_id = ExternalFlashTest__Setup(NULL, NULL);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+
+    // Invalid instance, then bound and idle
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__IsBusy(EXTERNAL_FLASH_CH_NUM) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__GetTimeToIdle(EXTERNAL_FLASH_CH_NUM) == INVALID_VALUE_32);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__IsBusy(instance_id) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__GetTimeToIdle(instance_id) == 0);
+
+    // Write of four pages: busy until the last page program ends
+    memset(ExternalFlashIdleTest_Data, 0x5A, sizeof(ExternalFlashIdleTest_Data));
+    start_us = SystemTimersSim__GetUs();
+    ExternalFlashTest__Start();
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__Write(instance_id, ExternalFlashIdleTest_Data, 0, 1024) == TRUE);
+    estimate_us = ExternalFlash__GetTimeToIdle(instance_id);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__IsBusy(instance_id) == TRUE);
+    FollowToIdle(instance_id, start_us, estimate_us);
+
+    // Erase of a block
+    start_us = SystemTimersSim__GetUs();
+    ExternalFlashTest__Start();
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__Erase(instance_id, 0, EXTERNAL_FLASH_IDLE_TEST_SIZE) == TRUE);
+    estimate_us = ExternalFlash__GetTimeToIdle(instance_id);
+    FollowToIdle(instance_id, start_us, estimate_us);
+
+    // Read: idle at its callback, the chip has nothing left to do
+    start_us = SystemTimersSim__GetUs();
+    ExternalFlashTest__Start();
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__Read(instance_id, ExternalFlashIdleTest_Data, 0, EXTERNAL_FLASH_IDLE_TEST_SIZE) == TRUE);
+    estimate_us = ExternalFlash__GetTimeToIdle(instance_id);
+    FollowToIdle(instance_id, start_us, estimate_us);
+    EXTERNAL_FLASH_TEST_CHECK((ExternalFlashIdleTest_Data[0] == 0xFF) && (ExternalFlashIdleTest_Data[EXTERNAL_FLASH_IDLE_TEST_SIZE - 1] == 0xFF));
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Busy_Violations == 0);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashIdleTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Follows an operation started with ExternalFlashTest__Start until the instance is idle, checking the busy
+ *          state and the time to idle at each step, then checks the estimate given at its start
+ * @param   instance_id: External Flash instance
+ * @param   start_us: virtual time of the operation start
+ * @param   estimate_us: time to idle given at its start
+ */
+static void FollowToIdle(uint8_t instance_id, uint64_t start_us, uint32_t estimate_us)
+{
+    uint64_t end_us = start_us + EXTERNAL_FLASH_TEST_TIMEOUT_US;
+    uint64_t ready_us;
+    uint32_t actual_us;
+    BOOL_TYPE consistent = TRUE;
+
+    EXTERNAL_FLASH_TEST_CHECK(estimate_us > 0);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__Wait() == TRUE);
+
+    while((ExternalFlash__IsBusy(instance_id) == TRUE) && (SystemTimersSim__GetUs() < end_us))
+    {
+        if(ExternalFlash__GetTimeToIdle(instance_id) == 0)
+        {
+            consistent = FALSE;
+        }
+        ExternalFlashTest__RunFor(EXTERNAL_FLASH_IDLE_TEST_STEP_US);
+    }
+    actual_us = (uint32_t)(SystemTimersSim__GetUs() - start_us);
+
+    EXTERNAL_FLASH_TEST_CHECK(consistent == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__IsBusy(instance_id) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__GetTimeToIdle(instance_id) == 0);
+
+    // The driver times the chip from typical operation times: the chip is ready then, or shortly after
+    ready_us = SystemTimersSim__GetUs();
+    while((DataFlashSim__IsReady(EXTERNAL_FLASH_TEST_BUS_CHANNEL) == FALSE) && (SystemTimersSim__GetUs() < end_us))
+    {
+        ExternalFlashTest__RunFor(EXTERNAL_FLASH_IDLE_TEST_STEP_US);
+    }
+    EXTERNAL_FLASH_TEST_CHECK((SystemTimersSim__GetUs() - ready_us) <= (actual_us / 16));
+    if(EXTERNAL_FLASH_TEST_CHECK((estimate_us >= (actual_us / 4)) && (estimate_us <= (2 * actual_us))) == FALSE)
+    {
+        printf("estimated %u us, idle after %u us\n", estimate_us, actual_us);
+    }
+}
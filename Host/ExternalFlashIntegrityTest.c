@@ -0,0 +1,134 @@
+/**
+ *  @file       ExternalFlashIntegrityTest.c
+ *
+ *  @brief      Host regression test of the page integrity check of the ExternalFlash driver.
+ *  @details    Whole page writes, erases and programs into erased bytes keep the page CRC, programs over programmed
+ *              bytes (a bit-flip counter clearing one more bit at each increment) must not raise false mismatches,
+ *              a page changed behind the driver is reported, and the CRCs are learned again after a reset.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_INTEGRITY_FEATURE enabled.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_INTEGRITY_FEATURE == DISABLED)
+#error "ExternalFlashIntegrityTest requires EXTERNAL_FLASH_INTEGRITY_FEATURE"
+#endif
+
+static uint8_t ExternalFlashIntegrityTest_Data[2 * EXTERNAL_FLASH_MAX_PAGE_SIZE];
+static uint8_t ExternalFlashIntegrityTest_Read[8 * EXTERNAL_FLASH_MAX_PAGE_SIZE];
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    uint8_t* data = ExternalFlashIntegrityTest_Data;
+    uint8_t* read = ExternalFlashIntegrityTest_Read;
+    EXTERNAL_FLASH_GEOMETRY_TYPE geometry;
+    uint8_t* image;
+    uint8_t* memory;
+    uint32_t extended_page;
+    uint16_t page;
+    uint8_t instance_id;
+    uint8_t counter;
+
+    instance_id = ExternalFlashTest__Setup(NULL, NULL);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+    SYS_ASSERT(ExternalFlash__GetGeometry(instance_id, &geometry) == TRUE);
+    page = geometry.Page_Size;
+    memory = DataFlashSim__GetMemory(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    extended_page = (uint32_t)page + (page / 32);
+    srand(1);
+
+    // Whole page write
+    for(uint16_t index = 0; index < (2 * page); index++)
+    {
+        data[index] = (uint8_t)rand();
+    }
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, data, 0, page));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, 0, page));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(read, data, page) == 0);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(instance_id) == TRUE);
+
+    // Partial program into an erased page
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Erase(instance_id, page, page));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Program(instance_id, data, page + 10, 20));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, page, page));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(&read[10], data, 20) == 0);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(instance_id) == TRUE);
+
+    // Programs over programmed bytes, read whole after each one
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Erase(instance_id, 2 * page, page));
+    for(uint8_t bits = 1; bits <= 8; bits++)
+    {
+        counter = (uint8_t)(0xFF << bits);
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Program(instance_id, &counter, (2 * page) + 5, 1));
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, 2 * page, page));
+        EXTERNAL_FLASH_TEST_CHECK(read[5] == counter);
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(instance_id) == TRUE);
+    }
+
+    // Whole page program over a programmed page, the result is the AND of old and new data
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Program(instance_id, data, 2 * page, page));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, 2 * page, page));
+    EXTERNAL_FLASH_TEST_CHECK(read[5] == 0x00);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(&read[6], &data[6], page - 6) == 0);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(instance_id) == TRUE);
+
+    // A page changed behind the driver is reported by the whole page reads, a partial read is not checked. The pages
+    // written next take the chip buffers, the reads go to the main memory.
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, data, 3 * page, page));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, data, 5 * page, 2 * page));
+    memory[(3 * extended_page) + 7] ^= 0x01;
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, 3 * page, page / 2));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(instance_id) == TRUE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, 3 * page, page));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(instance_id) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(instance_id) == TRUE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, 2 * page, 2 * page));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(instance_id) == FALSE);
+
+    // Written again, the page matches
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, data, 3 * page, page));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, 3 * page, page));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(instance_id) == TRUE);
+
+    // After a reset the CRCs are learned again by the first reads, counter increments included
+    image = malloc(DataFlashSim__GetMemorySize(EXTERNAL_FLASH_TEST_BUS_CHANNEL));
+    SYS_ASSERT(image != NULL);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Erase(instance_id, 4 * page, page));
+    counter = 0xFE;
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Program(instance_id, &counter, 4 * page, 1));
+    memcpy(image, memory, DataFlashSim__GetMemorySize(EXTERNAL_FLASH_TEST_BUS_CHANNEL));
+
+    instance_id = ExternalFlashTest__Setup(NULL, image);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+    for(uint8_t bits = 2; bits <= 4; bits++)
+    {
+        counter = (uint8_t)(0xFF << bits);
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, 4 * page, page));
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Program(instance_id, &counter, 4 * page, 1));
+    }
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, 0, 5 * page));
+    EXTERNAL_FLASH_TEST_CHECK(read[4 * page] == 0xF0);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(instance_id) == TRUE);
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+
+    free(image);
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashIntegrityTest");
+}
@@ -0,0 +1,341 @@
+/**
+ *  @file       ExternalFlashKvCheckpointTest.c
+ *
+ *  @brief      Host regression test of the index checkpoints of the ExternalFlashKv module.
+ *  @details    After random puts and deletes that wrap the log, a mount after a restart must load the index from the
+ *              newest checkpoint and read a fraction of the bytes of a full rebuild, and give the same values as the
+ *              model of the store. With the newest slot corrupt the mount falls back to the older one, with both slots
+ *              corrupt to a full rebuild. Power losses are simulated by restarting on a copy of the chip memory at many
+ *              points of a checkpoint: every value survives whichever slot the mount loads. A format must not leave an
+ *              older checkpoint over the new log. The test includes the module source to reach its map and store.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE enabled and an
+ *              EXTERNAL_FLASH_KV_MAP entry EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID whose log and checkpoint area are on
+ *              the simulated chip, linking ExternalFlashLog.c and without linking ExternalFlashKv.c.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include "../ExternalFlashKv.c"
+
+#include <stdlib.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE == DISABLED)
+#error "ExternalFlashKvCheckpointTest requires EXTERNAL_FLASH_KV_CHECKPOINT_FEATURE"
+#endif
+
+//! Store under test
+#ifndef EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID
+#define EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID        (0)
+#endif
+
+
+//! Keys of the test, puts and deletes of the random sequence, points of a checkpoint where the power is lost
+#define EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEYS      (32)
+#define EXTERNAL_FLASH_KV_CHECKPOINT_TEST_OPERATIONS (1500)
+#define EXTERNAL_FLASH_KV_CHECKPOINT_TEST_CUTS      (24)
+
+//! Key of a test key index
+#define EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEY(index) (((uint32_t)(index) * 1000UL) + 7UL)
+
+static uint16_t ExternalFlashKvCheckpointTest_Size[EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEYS];    // INVALID_VALUE_16 if not stored
+static uint16_t ExternalFlashKvCheckpointTest_Version[EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEYS];
+static uint16_t ExternalFlashKvCheckpointTest_Base_Size[EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEYS];
+static uint16_t ExternalFlashKvCheckpointTest_Base_Version[EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEYS];
+static uint8_t ExternalFlashKvCheckpointTest_Value[EXTERNAL_FLASH_KV_MAX_VALUE_SIZE];
+static uint8_t ExternalFlashKvCheckpointTest_Read[EXTERNAL_FLASH_KV_MAX_VALUE_SIZE];
+static uint8_t ExternalFlashKvCheckpointTest_Image[EXTERNAL_FLASH_TEST_IMAGE_SIZE];
+static uint8_t ExternalFlashKvCheckpointTest_Base[EXTERNAL_FLASH_TEST_IMAGE_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static uint64_t Start(const uint8_t* image);
+static uint64_t Restart(void);
+static void Put(uint16_t index, uint16_t size);
+static void PutUntilCheckpoint(void);
+static void CheckAll(void);
+static void WaitIdle(void);
+static BOOL_TYPE IsWorking(void* context);
+static void CorruptSlot(uint8_t* image, uint8_t slot);
+static uint8_t GetNewestSlot(void);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    uint16_t index;
+    uint64_t checkpoint_bytes;
+    uint64_t rebuild_bytes;
+    uint64_t start_us;
+    uint64_t checkpoint_us;
+    uint32_t generation;
+    uint32_t min_generation = INVALID_VALUE_32;
+    uint32_t max_generation = 0;
+
+    SYS_ASSERT(EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID < EXTERNAL_FLASH_KV_NUM);
+
+    // Fresh chip, then random puts and deletes wrapping the log
+    (void)Start(NULL);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashKv__Format(EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_KV_EVENT_MOUNTED);
+    for(index = 0; index < EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEYS; index++)
+    {
+        ExternalFlashKvCheckpointTest_Size[index] = INVALID_VALUE_16;
+        ExternalFlashKvCheckpointTest_Version[index] = 0;
+    }
+    srand(1);
+    for(uint32_t operation = 0; operation < EXTERNAL_FLASH_KV_CHECKPOINT_TEST_OPERATIONS; operation++)
+    {
+        index = (uint16_t)(rand() % EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEYS);
+        if(((rand() % 8) == 0) && (ExternalFlashKvCheckpointTest_Size[index] != INVALID_VALUE_16))
+        {
+            EXTERNAL_FLASH_TEST_RUN(ExternalFlashKv__Delete(EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID, EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEY(index)));
+            ExternalFlashKvCheckpointTest_Size[index] = INVALID_VALUE_16;
+        }
+        else
+        {
+            Put(index, (uint16_t)(rand() % (EXTERNAL_FLASH_KV_MAX_VALUE_SIZE + 1)));
+        }
+    }
+    CheckAll();
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashKv_Store[EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID].Generation > 2);
+
+    // Mount after a restart from the newest checkpoint
+    WaitIdle();
+    checkpoint_bytes = Restart();
+    CheckAll();
+
+    // Newest slot corrupt: the older one is loaded; both corrupt: full rebuild
+    WaitIdle();
+    (void)ExternalFlashTest__Snapshot(ExternalFlashKvCheckpointTest_Base);
+    memcpy(ExternalFlashKvCheckpointTest_Image, ExternalFlashKvCheckpointTest_Base, sizeof(ExternalFlashKvCheckpointTest_Image));
+    CorruptSlot(ExternalFlashKvCheckpointTest_Image, GetNewestSlot());
+    (void)Start(ExternalFlashKvCheckpointTest_Image);
+    CheckAll();
+    memcpy(ExternalFlashKvCheckpointTest_Image, ExternalFlashKvCheckpointTest_Base, sizeof(ExternalFlashKvCheckpointTest_Image));
+    CorruptSlot(ExternalFlashKvCheckpointTest_Image, 0);
+    CorruptSlot(ExternalFlashKvCheckpointTest_Image, 1);
+    rebuild_bytes = Start(ExternalFlashKvCheckpointTest_Image);
+    CheckAll();
+    if(EXTERNAL_FLASH_TEST_CHECK((2 * checkpoint_bytes) < rebuild_bytes) == FALSE)
+    {
+        printf("mount bytes: %llu from a checkpoint, %llu rebuilding\n", (unsigned long long)checkpoint_bytes, (unsigned long long)rebuild_bytes);
+    }
+
+    // Power loss at many points of a checkpoint, spread over twice its duration
+    (void)Start(ExternalFlashKvCheckpointTest_Base);
+    WaitIdle();
+    memcpy(ExternalFlashKvCheckpointTest_Base_Size, ExternalFlashKvCheckpointTest_Size, sizeof(ExternalFlashKvCheckpointTest_Base_Size));
+    memcpy(ExternalFlashKvCheckpointTest_Base_Version, ExternalFlashKvCheckpointTest_Version, sizeof(ExternalFlashKvCheckpointTest_Base_Version));
+    PutUntilCheckpoint();
+    start_us = SystemTimersSim__GetUs();
+    WaitIdle();
+    checkpoint_us = SystemTimersSim__GetUs() - start_us;
+    for(uint32_t cut = 0; cut < EXTERNAL_FLASH_KV_CHECKPOINT_TEST_CUTS; cut++)
+    {
+        memcpy(ExternalFlashKvCheckpointTest_Size, ExternalFlashKvCheckpointTest_Base_Size, sizeof(ExternalFlashKvCheckpointTest_Size));
+        memcpy(ExternalFlashKvCheckpointTest_Version, ExternalFlashKvCheckpointTest_Base_Version, sizeof(ExternalFlashKvCheckpointTest_Version));
+        (void)Start(ExternalFlashKvCheckpointTest_Base);
+        WaitIdle();
+        PutUntilCheckpoint();
+        ExternalFlashTest__RunFor((uint32_t)((2 * checkpoint_us * cut) / (EXTERNAL_FLASH_KV_CHECKPOINT_TEST_CUTS - 1)));
+
+        (void)Restart();
+        CheckAll();
+        generation = ExternalFlashKv_Store[EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID].Slot_Header[GetNewestSlot()].Generation;
+        min_generation = (generation < min_generation) ? generation : min_generation;
+        max_generation = (generation > max_generation) ? generation : max_generation;
+    }
+    // Checkpoints both lost and completed were seen
+    EXTERNAL_FLASH_TEST_CHECK(min_generation < max_generation);
+
+    // A format leaves no checkpoint of the old log
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashKv__Format(EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID));
+    WaitIdle();
+    (void)Restart();
+    for(index = 0; index < EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEYS; index++)
+    {
+        ExternalFlashKvCheckpointTest_Size[index] = INVALID_VALUE_16;
+    }
+    CheckAll();
+    Put(0, 4);
+    (void)Restart();
+    CheckAll();
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashKvCheckpointTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the driver, the logs and the stores on a chip, mounting the store under test
+ * @param   image: chip memory, NULL for an erased chip
+ * @return  bus bytes of the mount
+ */
+static uint64_t Start(const uint8_t* image)
+{
+    (void)ExternalFlashTest__Setup(NULL, image);
+    ExternalFlashLog__Initialize();
+    ExternalFlashKv__Initialize();
+    ExternalFlashKv__RegisterEventHandler(ExternalFlashTest__EventHandler, EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID, CALLBACK_FILTER_VALUE_NONE);
+    DataFlashSim__ResetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashKv__Mount(EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_KV_EVENT_MOUNTED);
+
+    return DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Bus_Bytes;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Restarts on the current chip memory, as after a power loss
+ * @return  bus bytes of the mount
+ */
+static uint64_t Restart(void)
+{
+    (void)ExternalFlashTest__Snapshot(ExternalFlashKvCheckpointTest_Image);
+    return Start(ExternalFlashKvCheckpointTest_Image);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Puts the next version of the value of a test key and updates the model
+ * @param   index: test key index
+ * @param   size: value bytes
+ */
+static void Put(uint16_t index, uint16_t size)
+{
+    uint16_t version = ExternalFlashKvCheckpointTest_Version[index] + 1;
+
+    for(uint16_t offset = 0; offset < size; offset++)
+    {
+        ExternalFlashKvCheckpointTest_Value[offset] = (uint8_t)((index * 7) + (version * 13) + offset);
+    }
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashKv__Put(EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID, EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEY(index), ExternalFlashKvCheckpointTest_Value, size));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_KV_EVENT_STORED);
+    ExternalFlashKvCheckpointTest_Version[index] = version;
+    ExternalFlashKvCheckpointTest_Size[index] = size;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Puts values until the records since the last checkpoint reach the checkpoint interval, so that the handler
+ *          saves the next checkpoint
+ */
+static void PutUntilCheckpoint(void)
+{
+    uint16_t index = 0;
+
+    while(ExternalFlashKv_Store[EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID].Records < EXTERNAL_FLASH_KV_CHECKPOINT_INTERVAL)
+    {
+        Put(index, (uint16_t)(index + 8));
+        index = (uint16_t)((index + 1) % EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEYS);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Checks the size and the value of every test key against the model
+ */
+static void CheckAll(void)
+{
+    for(uint16_t index = 0; index < EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEYS; index++)
+    {
+        uint16_t size = ExternalFlashKvCheckpointTest_Size[index];
+        BOOL_TYPE match = TRUE;
+
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashKv__GetSize(EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID, EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEY(index)) == size);
+        if(size != INVALID_VALUE_16)
+        {
+            memset(ExternalFlashKvCheckpointTest_Read, 0, sizeof(ExternalFlashKvCheckpointTest_Read));
+            EXTERNAL_FLASH_TEST_RUN(ExternalFlashKv__Get(EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID, EXTERNAL_FLASH_KV_CHECKPOINT_TEST_KEY(index), ExternalFlashKvCheckpointTest_Read, sizeof(ExternalFlashKvCheckpointTest_Read)));
+            EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_KV_EVENT_VALUE);
+            for(uint16_t offset = 0; offset < size; offset++)
+            {
+                if(ExternalFlashKvCheckpointTest_Read[offset] != (uint8_t)((index * 7) + (ExternalFlashKvCheckpointTest_Version[index] * 13) + offset))
+                {
+                    match = FALSE;
+                }
+            }
+            EXTERNAL_FLASH_TEST_CHECK(match == TRUE);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs virtual time until the store and its log end their background work, checkpoints, garbage collection
+ *          steps and the erase ahead of an append included
+ */
+static void WaitIdle(void)
+{
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__RunWhile(IsWorking, NULL) == TRUE);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Run condition of WaitIdle
+ * @param   context: not used
+ * @return  TRUE until the store and its log end their background work, checkpoints, garbage collection
+ *          steps and the erase ahead of an append included
+ */
+static BOOL_TYPE IsWorking(void* context)
+{
+    (void)context;
+    return ((ExternalFlashKv__IsBusy(EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID) == TRUE) ||
+            (IsGcNeeded(EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID) == TRUE) ||
+            (ExternalFlashKv_Store[EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID].Records >= EXTERNAL_FLASH_KV_CHECKPOINT_INTERVAL) ||
+            (ExternalFlashLog__IsBusy(ExternalFlashKv_Map[EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID].Log_Id) == TRUE)) ? TRUE : FALSE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Flips a byte of the index saved in a checkpoint slot of a chip memory image
+ * @param   image: chip memory
+ * @param   slot: checkpoint slot
+ */
+static void CorruptSlot(uint8_t* image, uint8_t slot)
+{
+    uint32_t address = ExternalFlashKv_Map[EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID].Checkpoint_Address +
+                       (slot * EXTERNAL_FLASH_KV_CHECKPOINT_SLOT_SIZE) + sizeof(EXTERNAL_FLASH_KV_CHECKPOINT_HEADER_TYPE) + 2;
+
+    image[ExternalFlashTest__GetMemoryOffset(address)] ^= 0x55;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gives the slot of the newest checkpoint found by the last mount, erased slots and slots found corrupt
+ *          excluded
+ * @return  checkpoint slot
+ */
+static uint8_t GetNewestSlot(void)
+{
+    EXTERNAL_FLASH_KV_STORE_TYPE* store = &ExternalFlashKv_Store[EXTERNAL_FLASH_KV_CHECKPOINT_TEST_ID];
+    uint8_t newest = 0;
+
+    for(uint8_t slot = 1; slot < EXTERNAL_FLASH_KV_CHECKPOINT_SLOTS; slot++)
+    {
+        if((store->Slot_Header[slot].Generation != INVALID_VALUE_32) &&
+           ((store->Slot_Header[newest].Generation == INVALID_VALUE_32) || (store->Slot_Header[slot].Generation > store->Slot_Header[newest].Generation)))
+        {
+            newest = slot;
+        }
+    }
+
+    return newest;
+}
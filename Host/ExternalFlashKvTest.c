@@ -0,0 +1,356 @@
+/**
+ *  @file       ExternalFlashKvTest.c
+ *
+ *  @brief      Host regression test of the ExternalFlashKv module.
+ *  @details    Random puts and deletes over a set of keys are checked against a model of the store: the log wraps
+ *              several times, so every value still stored after it has gone through garbage collection, and a mount,
+ *              from RAM or after a restart on the same chip memory, must rebuild the same index. Power losses are
+ *              simulated by restarting on a copy of the chip memory at many points of a put and of a garbage
+ *              collection pass: the key put gives either its old or its new value, every other key keeps its own.
+ *              The test includes the module source to reach its map and store.
+ *
+ *              Build: see ExternalFlashTest.h, with an EXTERNAL_FLASH_KV_MAP entry EXTERNAL_FLASH_KV_TEST_ID whose log
+ *              is on the simulated chip, linking ExternalFlashLog.c and without linking ExternalFlashKv.c.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include "../ExternalFlashKv.c"
+
+#include <stdlib.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Store under test
+#ifndef EXTERNAL_FLASH_KV_TEST_ID
+#define EXTERNAL_FLASH_KV_TEST_ID                   (0)
+#endif
+
+
+//! Keys of the test, puts and deletes of the random sequence, points of a put or a collection where the power is lost
+#define EXTERNAL_FLASH_KV_TEST_KEYS                 (48)
+#define EXTERNAL_FLASH_KV_TEST_OPERATIONS           (3000)
+#define EXTERNAL_FLASH_KV_TEST_CUTS                 (24)
+
+//! Key of a test key index
+#define EXTERNAL_FLASH_KV_TEST_KEY(index)           (((uint32_t)(index) * 1000UL) + 7UL)
+
+static uint16_t ExternalFlashKvTest_Size[EXTERNAL_FLASH_KV_TEST_KEYS];      // INVALID_VALUE_16 if not stored
+static uint16_t ExternalFlashKvTest_Version[EXTERNAL_FLASH_KV_TEST_KEYS];
+static uint8_t ExternalFlashKvTest_Value[EXTERNAL_FLASH_KV_MAX_VALUE_SIZE];
+static uint8_t ExternalFlashKvTest_Read[EXTERNAL_FLASH_KV_MAX_VALUE_SIZE];
+static uint8_t ExternalFlashKvTest_Image[EXTERNAL_FLASH_TEST_IMAGE_SIZE];
+static uint8_t ExternalFlashKvTest_Base[EXTERNAL_FLASH_TEST_IMAGE_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void Start(const uint8_t* image);
+static void Restart(void);
+static void FillValue(uint16_t index, uint16_t version, uint16_t size);
+static void Put(uint16_t index, uint16_t size);
+static void Delete(uint16_t index);
+static BOOL_TYPE IsValue(uint16_t index, uint16_t version, uint16_t size);
+static void CheckAll(void);
+static void WaitIdle(void);
+static BOOL_TYPE IsWorking(void* context);
+static BOOL_TYPE IsCollecting(void* context);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    EXTERNAL_FLASH_LOG_INFO_TYPE info;
+    uint8_t log_id = ExternalFlashKv_Map[EXTERNAL_FLASH_KV_TEST_ID].Log_Id;
+    uint32_t written = 0;
+    uint16_t index;
+    uint16_t size;
+    uint16_t version;
+    uint64_t start_us;
+    uint64_t put_us;
+    uint64_t gc_us;
+    uint32_t outcome[2] = {0, 0};
+
+    SYS_ASSERT(EXTERNAL_FLASH_KV_TEST_ID < EXTERNAL_FLASH_KV_NUM);
+
+    // Fresh chip: a format gives an empty store
+    Start(NULL);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashKv__Format(EXTERNAL_FLASH_KV_TEST_ID));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_KV_EVENT_MOUNTED);
+    for(index = 0; index < EXTERNAL_FLASH_KV_TEST_KEYS; index++)
+    {
+        ExternalFlashKvTest_Size[index] = INVALID_VALUE_16;
+        ExternalFlashKvTest_Version[index] = 0;
+    }
+    CheckAll();
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashKv__Get(EXTERNAL_FLASH_KV_TEST_ID, EXTERNAL_FLASH_KV_TEST_KEY(0), ExternalFlashKvTest_Read, sizeof(ExternalFlashKvTest_Read)) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashKv__Delete(EXTERNAL_FLASH_KV_TEST_ID, EXTERNAL_FLASH_KV_TEST_KEY(0)) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashKv__Put(EXTERNAL_FLASH_KV_TEST_ID, EXTERNAL_FLASH_KV_TEST_KEY(0), ExternalFlashKvTest_Value, EXTERNAL_FLASH_KV_MAX_VALUE_SIZE + 1) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashKv__Put(EXTERNAL_FLASH_KV_NUM, EXTERNAL_FLASH_KV_TEST_KEY(0), ExternalFlashKvTest_Value, 1) == FALSE);
+
+    // Random puts and deletes, the log wraps several times through garbage collection
+    srand(1);
+    for(uint32_t operation = 0; operation < EXTERNAL_FLASH_KV_TEST_OPERATIONS; operation++)
+    {
+        index = (uint16_t)(rand() % EXTERNAL_FLASH_KV_TEST_KEYS);
+        if(((rand() % 8) == 0) && (ExternalFlashKvTest_Size[index] != INVALID_VALUE_16))
+        {
+            Delete(index);
+            written += EXTERNAL_FLASH_KV_RECORD_SIZE(0);
+        }
+        else
+        {
+            size = (uint16_t)(rand() % (EXTERNAL_FLASH_KV_MAX_VALUE_SIZE + 1));
+            Put(index, size);
+            written += EXTERNAL_FLASH_KV_RECORD_SIZE(size);
+        }
+
+        if((operation % 1000) == 999)
+        {
+            CheckAll();
+        }
+    }
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashLog__GetInfo(log_id, &info) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(written > (3UL * info.Sector_Num * EXTERNAL_FLASH_LOG_SECTOR_SIZE));
+    EXTERNAL_FLASH_TEST_CHECK(info.Next_Sequence > EXTERNAL_FLASH_KV_TEST_OPERATIONS);
+
+    // Mount from RAM and after a restart
+    WaitIdle();
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashKv__Mount(EXTERNAL_FLASH_KV_TEST_ID));
+    CheckAll();
+    Restart();
+    CheckAll();
+
+    // Power loss at many points of a put, spread over twice its duration
+    WaitIdle();
+    (void)ExternalFlashTest__Snapshot(ExternalFlashKvTest_Base);
+    index = (ExternalFlashKvTest_Size[0] != INVALID_VALUE_16) ? 0 : 1;
+    size = ExternalFlashKvTest_Size[index];
+    version = ExternalFlashKvTest_Version[index];
+    start_us = SystemTimersSim__GetUs();
+    Put(index, EXTERNAL_FLASH_KV_MAX_VALUE_SIZE);
+    put_us = SystemTimersSim__GetUs() - start_us;
+    for(uint32_t cut = 0; cut < EXTERNAL_FLASH_KV_TEST_CUTS; cut++)
+    {
+        Start(ExternalFlashKvTest_Base);
+        WaitIdle();
+        FillValue(index, version + 1, EXTERNAL_FLASH_KV_MAX_VALUE_SIZE);
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashKv__Put(EXTERNAL_FLASH_KV_TEST_ID, EXTERNAL_FLASH_KV_TEST_KEY(index), ExternalFlashKvTest_Value, EXTERNAL_FLASH_KV_MAX_VALUE_SIZE) == TRUE);
+        ExternalFlashTest__RunFor((uint32_t)((2 * put_us * cut) / (EXTERNAL_FLASH_KV_TEST_CUTS - 1)));
+
+        // Old or new value, then the model follows the store
+        Restart();
+        if(ExternalFlashKv__GetSize(EXTERNAL_FLASH_KV_TEST_ID, EXTERNAL_FLASH_KV_TEST_KEY(index)) == EXTERNAL_FLASH_KV_MAX_VALUE_SIZE)
+        {
+            ExternalFlashKvTest_Size[index] = EXTERNAL_FLASH_KV_MAX_VALUE_SIZE;
+            ExternalFlashKvTest_Version[index] = version + 1;
+            outcome[1]++;
+        }
+        else
+        {
+            ExternalFlashKvTest_Size[index] = size;
+            ExternalFlashKvTest_Version[index] = version;
+            outcome[0]++;
+        }
+        CheckAll();
+    }
+    EXTERNAL_FLASH_TEST_CHECK((outcome[0] > 0) && (outcome[1] > 0));
+    ExternalFlashKvTest_Size[index] = size;
+    ExternalFlashKvTest_Version[index] = version;
+
+    // Puts up to the point where the log needs garbage collection, saved before the handler starts it
+    Start(ExternalFlashKvTest_Base);
+    WaitIdle();
+    do
+    {
+        index = (uint16_t)(rand() % EXTERNAL_FLASH_KV_TEST_KEYS);
+        Put(index, (uint16_t)(rand() % (EXTERNAL_FLASH_KV_MAX_VALUE_SIZE + 1)));
+    } while(IsGcNeeded(EXTERNAL_FLASH_KV_TEST_ID) == FALSE);
+    (void)ExternalFlashTest__Snapshot(ExternalFlashKvTest_Base);
+
+    // Collection after a mount, then power loss at many points of it
+    Start(ExternalFlashKvTest_Base);
+    start_us = SystemTimersSim__GetUs();
+    EXTERNAL_FLASH_TEST_CHECK(IsGcNeeded(EXTERNAL_FLASH_KV_TEST_ID) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__RunWhile(IsCollecting, NULL) == TRUE);
+    gc_us = SystemTimersSim__GetUs() - start_us;
+    CheckAll();
+    for(uint32_t cut = 0; cut < EXTERNAL_FLASH_KV_TEST_CUTS; cut++)
+    {
+        Start(ExternalFlashKvTest_Base);
+        ExternalFlashTest__RunFor((uint32_t)((gc_us * cut) / (EXTERNAL_FLASH_KV_TEST_CUTS - 1)));
+        Restart();
+        CheckAll();
+
+        // The store accepts puts again, the next cut starts from the saved memory
+        index = (uint16_t)(cut % EXTERNAL_FLASH_KV_TEST_KEYS);
+        size = ExternalFlashKvTest_Size[index];
+        version = ExternalFlashKvTest_Version[index];
+        Put(index, (uint16_t)cut);
+        CheckAll();
+        ExternalFlashKvTest_Size[index] = size;
+        ExternalFlashKvTest_Version[index] = version;
+    }
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashKvTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the driver, the logs and the stores on a chip, mounting the store under test
+ * @param   image: chip memory, NULL for an erased chip
+ */
+static void Start(const uint8_t* image)
+{
+    (void)ExternalFlashTest__Setup(NULL, image);
+    ExternalFlashLog__Initialize();
+    ExternalFlashKv__Initialize();
+    ExternalFlashKv__RegisterEventHandler(ExternalFlashTest__EventHandler, EXTERNAL_FLASH_KV_TEST_ID, CALLBACK_FILTER_VALUE_NONE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashKv__Mount(EXTERNAL_FLASH_KV_TEST_ID));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_KV_EVENT_MOUNTED);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Restarts on the current chip memory, as after a power loss
+ */
+static void Restart(void)
+{
+    (void)ExternalFlashTest__Snapshot(ExternalFlashKvTest_Image);
+    Start(ExternalFlashKvTest_Image);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Fills ExternalFlashKvTest_Value with a version of the value of a test key
+ * @param   index: test key index
+ * @param   version: value version
+ * @param   size: value bytes
+ */
+static void FillValue(uint16_t index, uint16_t version, uint16_t size)
+{
+    for(uint16_t offset = 0; offset < size; offset++)
+    {
+        ExternalFlashKvTest_Value[offset] = (uint8_t)((index * 7) + (version * 13) + offset);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Puts the next version of the value of a test key and updates the model
+ * @param   index: test key index
+ * @param   size: value bytes
+ */
+static void Put(uint16_t index, uint16_t size)
+{
+    FillValue(index, ExternalFlashKvTest_Version[index] + 1, size);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashKv__Put(EXTERNAL_FLASH_KV_TEST_ID, EXTERNAL_FLASH_KV_TEST_KEY(index), ExternalFlashKvTest_Value, size));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_KV_EVENT_STORED);
+    ExternalFlashKvTest_Version[index]++;
+    ExternalFlashKvTest_Size[index] = size;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Deletes a test key and updates the model
+ * @param   index: test key index
+ */
+static void Delete(uint16_t index)
+{
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashKv__Delete(EXTERNAL_FLASH_KV_TEST_ID, EXTERNAL_FLASH_KV_TEST_KEY(index)));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_KV_EVENT_DELETED);
+    ExternalFlashKvTest_Size[index] = INVALID_VALUE_16;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Tells if ExternalFlashKvTest_Read holds a version of the value of a test key
+ * @param   index: test key index
+ * @param   version: value version
+ * @param   size: value bytes
+ * @return  TRUE if it does
+ */
+static BOOL_TYPE IsValue(uint16_t index, uint16_t version, uint16_t size)
+{
+    BOOL_TYPE match = TRUE;
+
+    for(uint16_t offset = 0; offset < size; offset++)
+    {
+        if(ExternalFlashKvTest_Read[offset] != (uint8_t)((index * 7) + (version * 13) + offset))
+        {
+            match = FALSE;
+        }
+    }
+
+    return match;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Checks the size and the value of every test key against the model
+ */
+static void CheckAll(void)
+{
+    for(uint16_t index = 0; index < EXTERNAL_FLASH_KV_TEST_KEYS; index++)
+    {
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashKv__GetSize(EXTERNAL_FLASH_KV_TEST_ID, EXTERNAL_FLASH_KV_TEST_KEY(index)) == ExternalFlashKvTest_Size[index]);
+        if(ExternalFlashKvTest_Size[index] != INVALID_VALUE_16)
+        {
+            memset(ExternalFlashKvTest_Read, 0, sizeof(ExternalFlashKvTest_Read));
+            EXTERNAL_FLASH_TEST_RUN(ExternalFlashKv__Get(EXTERNAL_FLASH_KV_TEST_ID, EXTERNAL_FLASH_KV_TEST_KEY(index), ExternalFlashKvTest_Read, sizeof(ExternalFlashKvTest_Read)));
+            EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_KV_EVENT_VALUE);
+            EXTERNAL_FLASH_TEST_CHECK(IsValue(index, ExternalFlashKvTest_Version[index], ExternalFlashKvTest_Size[index]) == TRUE);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs virtual time until the store and its log end their background work, garbage collection steps and
+ *          the erase ahead of an append included
+ */
+static void WaitIdle(void)
+{
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__RunWhile(IsWorking, NULL) == TRUE);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Run condition of WaitIdle
+ * @param   context: not used
+ * @return  TRUE until the store and its log end their background work, garbage collection steps and
+ *          the erase ahead of an append included
+ */
+static BOOL_TYPE IsWorking(void* context)
+{
+    (void)context;
+    return ((ExternalFlashKv__IsBusy(EXTERNAL_FLASH_KV_TEST_ID) == TRUE) ||
+            (IsGcNeeded(EXTERNAL_FLASH_KV_TEST_ID) == TRUE) ||
+            (ExternalFlashLog__IsBusy(ExternalFlashKv_Map[EXTERNAL_FLASH_KV_TEST_ID].Log_Id) == TRUE)) ? TRUE : FALSE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Run condition of a garbage collection
+ * @param   context: not used
+ * @return  TRUE until the store has no sector left to collect
+ */
+static BOOL_TYPE IsCollecting(void* context)
+{
+    (void)context;
+    return ((IsGcNeeded(EXTERNAL_FLASH_KV_TEST_ID) == TRUE) || (ExternalFlashKv__IsBusy(EXTERNAL_FLASH_KV_TEST_ID) == TRUE)) ? TRUE : FALSE;
+}
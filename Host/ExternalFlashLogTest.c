@@ -0,0 +1,363 @@
+/**
+ *  @file       ExternalFlashLogTest.c
+ *
+ *  @brief      Host regression test of the ExternalFlashLog module.
+ *  @details    Records of varied sizes, some larger than the scratch buffer, are appended until the region wrapped
+ *              more than twice: reading from the oldest record must give every record still stored, in sequence and
+ *              with its data, and a mount, from RAM or after a restart on the same chip memory, must find the same
+ *              head without reading the whole region. Power losses are simulated by restarting on a copy of the chip
+ *              memory: taken at many points of an append, or with the last record partly programmed. The records
+ *              completed before the loss must survive, the interrupted one is either missing or reported corrupt, and
+ *              the log must accept appends again. The test includes the module source to reach its map.
+ *
+ *              Build: see ExternalFlashTest.h, with an EXTERNAL_FLASH_LOG_MAP entry EXTERNAL_FLASH_LOG_TEST_ID on the
+ *              simulated chip, without linking ExternalFlashLog.c.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include "../ExternalFlashLog.c"
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Log under test
+#ifndef EXTERNAL_FLASH_LOG_TEST_ID
+#define EXTERNAL_FLASH_LOG_TEST_ID                  (0)
+#endif
+
+//! Points of an append where the power is lost, and records appended before it
+#define EXTERNAL_FLASH_LOG_TEST_CUTS                (40)
+#define EXTERNAL_FLASH_LOG_TEST_RECORDS             (16)
+
+static uint8_t ExternalFlashLogTest_Record[EXTERNAL_FLASH_LOG_MAX_RECORD_SIZE];
+static uint8_t ExternalFlashLogTest_Read[EXTERNAL_FLASH_LOG_MAX_RECORD_SIZE];
+static uint8_t ExternalFlashLogTest_Image[EXTERNAL_FLASH_TEST_IMAGE_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void Start(const uint8_t* image);
+static void Restart(void);
+static void StartCut(void);
+static uint16_t GetRecordSize(uint32_t sequence);
+static void FillRecord(uint32_t sequence);
+static void Append(uint32_t sequence);
+static uint32_t ReadAll(uint32_t* first, uint32_t* corrupt);
+static void WaitIdle(void);
+static BOOL_TYPE IsWorking(void* context);
+static uint32_t GetRecordOffset(uint32_t last);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    EXTERNAL_FLASH_LOG_INFO_TYPE info;
+    uint32_t region_size = ExternalFlashLog_Map[EXTERNAL_FLASH_LOG_TEST_ID].Region_Size;
+    uint32_t written = 0;
+    uint32_t sequence = 0;
+    uint32_t first;
+    uint32_t corrupt;
+    uint32_t count;
+    uint64_t mount_bytes;
+    uint64_t start_us;
+    uint64_t append_us;
+    uint32_t outcome[3] = {0, 0, 0};
+
+    SYS_ASSERT(EXTERNAL_FLASH_LOG_TEST_ID < EXTERNAL_FLASH_LOG_NUM);
+
+    // Fresh chip: a mount finds no record, a format gives an empty log
+    Start(NULL);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashLog__GetNextSequence(EXTERNAL_FLASH_LOG_TEST_ID) == 0);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashLog__Format(EXTERNAL_FLASH_LOG_TEST_ID));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_LOG_EVENT_MOUNTED);
+    EXTERNAL_FLASH_TEST_CHECK(ReadAll(&first, &corrupt) == 0);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashLog__Append(EXTERNAL_FLASH_LOG_NUM, ExternalFlashLogTest_Record, 1) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashLog__Append(EXTERNAL_FLASH_LOG_TEST_ID, ExternalFlashLogTest_Record, EXTERNAL_FLASH_LOG_MAX_RECORD_SIZE + 1) == FALSE);
+
+    // Appends until the region wrapped more than twice, checked once per wrap
+    while(written < (5 * region_size / 2))
+    {
+        Append(sequence);
+        written += EXTERNAL_FLASH_LOG_HEADER_SIZE + GetRecordSize(sequence);
+        sequence++;
+
+        if((written % region_size) < (uint32_t)(EXTERNAL_FLASH_LOG_HEADER_SIZE + GetRecordSize(sequence - 1)))
+        {
+            count = ReadAll(&first, &corrupt);
+            EXTERNAL_FLASH_TEST_CHECK((count > 0) && ((first + count) == sequence) && (corrupt == INVALID_VALUE_32));
+        }
+    }
+    count = ReadAll(&first, &corrupt);
+    EXTERNAL_FLASH_TEST_CHECK((first > 0) && ((first + count) == sequence) && (corrupt == INVALID_VALUE_32));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashLog__GetInfo(EXTERNAL_FLASH_LOG_TEST_ID, &info) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(info.Sector_Num == (region_size / EXTERNAL_FLASH_LOG_SECTOR_SIZE));
+    EXTERNAL_FLASH_TEST_CHECK(info.Free_Sectors == 0);
+    EXTERNAL_FLASH_TEST_CHECK(info.Next_Sequence == sequence);
+
+    // Mount from RAM and after a restart, reading a fraction of the region
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashLog__Mount(EXTERNAL_FLASH_LOG_TEST_ID));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashLog__GetNextSequence(EXTERNAL_FLASH_LOG_TEST_ID) == sequence);
+    Restart();
+    mount_bytes = DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Bus_Bytes;
+    EXTERNAL_FLASH_TEST_CHECK(mount_bytes < (region_size / 2));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashLog__GetNextSequence(EXTERNAL_FLASH_LOG_TEST_ID) == sequence);
+    EXTERNAL_FLASH_TEST_CHECK((ReadAll(&first, &corrupt) == count) && (corrupt == INVALID_VALUE_32));
+    Append(sequence++);
+    count = ReadAll(&first, &corrupt);
+    EXTERNAL_FLASH_TEST_CHECK(((first + count) == sequence) && (corrupt == INVALID_VALUE_32));
+
+    // Power loss with the last record payload partly programmed: the record reads corrupt, the next one follows it
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashLog__Format(EXTERNAL_FLASH_LOG_TEST_ID));
+    for(sequence = 0; sequence < 5; sequence++)
+    {
+        Append(sequence);
+    }
+    (void)ExternalFlashTest__Snapshot(ExternalFlashLogTest_Image);
+    for(uint32_t index = GetRecordOffset(4) - 10; index < GetRecordOffset(4); index++)
+    {
+        ExternalFlashLogTest_Image[ExternalFlashTest__GetMemoryOffset(ExternalFlashLog_Map[EXTERNAL_FLASH_LOG_TEST_ID].Region_Address + index)] = 0xFF;
+    }
+    Start(ExternalFlashLogTest_Image);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashLog__GetNextSequence(EXTERNAL_FLASH_LOG_TEST_ID) == 5);
+    EXTERNAL_FLASH_TEST_CHECK((ReadAll(&first, &corrupt) == 5) && (first == 0) && (corrupt == 4));
+    Append(5);
+    EXTERNAL_FLASH_TEST_CHECK((ReadAll(&first, &corrupt) == 6) && (corrupt == 4));
+
+    // Power loss with only the sequence of the last header programmed: the sector is closed, appends go on in the next
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashLog__Format(EXTERNAL_FLASH_LOG_TEST_ID));
+    for(sequence = 0; sequence < 5; sequence++)
+    {
+        Append(sequence);
+    }
+    (void)ExternalFlashTest__Snapshot(ExternalFlashLogTest_Image);
+    for(uint32_t index = GetRecordOffset(3) + sizeof(uint32_t); index < GetRecordOffset(4); index++)
+    {
+        ExternalFlashLogTest_Image[ExternalFlashTest__GetMemoryOffset(ExternalFlashLog_Map[EXTERNAL_FLASH_LOG_TEST_ID].Region_Address + index)] = 0xFF;
+    }
+    Start(ExternalFlashLogTest_Image);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashLog__GetNextSequence(EXTERNAL_FLASH_LOG_TEST_ID) == 4);
+    EXTERNAL_FLASH_TEST_CHECK((ReadAll(&first, &corrupt) == 4) && (first == 0) && (corrupt == INVALID_VALUE_32));
+    Append(4);
+    EXTERNAL_FLASH_TEST_CHECK((ReadAll(&first, &corrupt) == 5) && (corrupt == INVALID_VALUE_32));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashLog_Store[EXTERNAL_FLASH_LOG_TEST_ID].Head.Sector == 1);
+
+    // Power loss at many points of an append of a record larger than the scratch buffer, spread over its duration
+    SYS_ASSERT(GetRecordSize(EXTERNAL_FLASH_LOG_TEST_RECORDS) > EXTERNAL_FLASH_LOG_SCRATCH_SIZE);
+    StartCut();
+    start_us = SystemTimersSim__GetUs();
+    Append(EXTERNAL_FLASH_LOG_TEST_RECORDS);
+    append_us = SystemTimersSim__GetUs() - start_us;
+    for(uint32_t cut = 0; cut < EXTERNAL_FLASH_LOG_TEST_CUTS; cut++)
+    {
+        StartCut();
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashLog__Append(EXTERNAL_FLASH_LOG_TEST_ID, ExternalFlashLogTest_Record, GetRecordSize(EXTERNAL_FLASH_LOG_TEST_RECORDS)) == TRUE);
+        ExternalFlashTest__RunFor((uint32_t)((append_us * cut) / (EXTERNAL_FLASH_LOG_TEST_CUTS - 1)));
+
+        Restart();
+        sequence = ExternalFlashLog__GetNextSequence(EXTERNAL_FLASH_LOG_TEST_ID);
+        count = ReadAll(&first, &corrupt);
+        EXTERNAL_FLASH_TEST_CHECK((sequence == EXTERNAL_FLASH_LOG_TEST_RECORDS) || (sequence == (EXTERNAL_FLASH_LOG_TEST_RECORDS + 1)));
+        EXTERNAL_FLASH_TEST_CHECK((first == 0) && (count == sequence));
+        EXTERNAL_FLASH_TEST_CHECK((corrupt == INVALID_VALUE_32) || (corrupt == EXTERNAL_FLASH_LOG_TEST_RECORDS));
+        outcome[(count > EXTERNAL_FLASH_LOG_TEST_RECORDS) ? ((corrupt == INVALID_VALUE_32) ? 2 : 1) : 0]++;
+
+        Append(sequence);
+        count = ReadAll(&first, &corrupt);
+        EXTERNAL_FLASH_TEST_CHECK((first == 0) && (count == (sequence + 1)));
+    }
+    // Lost, torn and completed appends were all seen
+    EXTERNAL_FLASH_TEST_CHECK((outcome[0] > 0) && (outcome[1] > 0) && (outcome[2] > 0));
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashLogTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the driver and the logs on a chip, mounting the log under test
+ * @param   image: chip memory, NULL for an erased chip
+ */
+static void Start(const uint8_t* image)
+{
+    (void)ExternalFlashTest__Setup(NULL, image);
+    ExternalFlashLog__Initialize();
+    ExternalFlashLog__RegisterEventHandler(ExternalFlashTest__EventHandler, EXTERNAL_FLASH_LOG_TEST_ID, CALLBACK_FILTER_VALUE_NONE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashLog__Mount(EXTERNAL_FLASH_LOG_TEST_ID));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_LOG_EVENT_MOUNTED);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Restarts on the current chip memory, as after a power loss, with the chip statistics of the mount only
+ */
+static void Restart(void)
+{
+    (void)ExternalFlashTest__Snapshot(ExternalFlashLogTest_Image);
+    (void)ExternalFlashTest__Setup(NULL, ExternalFlashLogTest_Image);
+    ExternalFlashLog__Initialize();
+    ExternalFlashLog__RegisterEventHandler(ExternalFlashTest__EventHandler, EXTERNAL_FLASH_LOG_TEST_ID, CALLBACK_FILTER_VALUE_NONE);
+    DataFlashSim__ResetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashLog__Mount(EXTERNAL_FLASH_LOG_TEST_ID));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_LOG_EVENT_MOUNTED);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts on an erased chip with EXTERNAL_FLASH_LOG_TEST_RECORDS records in the log and the next one ready in
+ *          ExternalFlashLogTest_Record
+ */
+static void StartCut(void)
+{
+    Start(NULL);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashLog__Format(EXTERNAL_FLASH_LOG_TEST_ID));
+    for(uint32_t sequence = 0; sequence < EXTERNAL_FLASH_LOG_TEST_RECORDS; sequence++)
+    {
+        Append(sequence);
+    }
+    WaitIdle();
+    FillRecord(EXTERNAL_FLASH_LOG_TEST_RECORDS);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Payload size of a test record, empty records and records larger than the scratch buffer included
+ * @param   sequence: record sequence
+ * @return  payload bytes
+ */
+static uint16_t GetRecordSize(uint32_t sequence)
+{
+    return (uint16_t)(((sequence * 37) % 300) + (((sequence % 16) == 0) ? 600 : 0));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Fills ExternalFlashLogTest_Record with the test record of a sequence
+ * @param   sequence: record sequence
+ */
+static void FillRecord(uint32_t sequence)
+{
+    for(uint16_t index = 0; index < GetRecordSize(sequence); index++)
+    {
+        ExternalFlashLogTest_Record[index] = (uint8_t)((sequence * 13) + index);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Appends the test record of a sequence
+ * @param   sequence: record sequence, the next one of the log
+ */
+static void Append(uint32_t sequence)
+{
+    FillRecord(sequence);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashLog__Append(EXTERNAL_FLASH_LOG_TEST_ID, ExternalFlashLogTest_Record, GetRecordSize(sequence)));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_LOG_EVENT_APPENDED);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the log from the oldest record to the head, checking the sequence and the data of each record
+ * @param   first: sequence of the oldest record
+ * @param   corrupt: sequence of the last record reported corrupt, INVALID_VALUE_32 if none
+ * @return  records read, corrupt ones included
+ */
+static uint32_t ReadAll(uint32_t* first, uint32_t* corrupt)
+{
+    uint32_t count = 0;
+    uint32_t sequence;
+    uint32_t position;
+    uint16_t length;
+    BOOL_TYPE valid = TRUE;
+
+    *first = INVALID_VALUE_32;
+    *corrupt = INVALID_VALUE_32;
+    WaitIdle();
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashLog__Rewind(EXTERNAL_FLASH_LOG_TEST_ID) == TRUE);
+    for(;;)
+    {
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlashLog__ReadNext(EXTERNAL_FLASH_LOG_TEST_ID, ExternalFlashLogTest_Read, sizeof(ExternalFlashLogTest_Read)));
+        if((ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_LOG_EVENT_END) || (count > EXTERNAL_FLASH_TEST_IMAGE_SIZE))
+        {
+            break;
+        }
+        (void)ExternalFlashLog__GetRecordInfo(EXTERNAL_FLASH_LOG_TEST_ID, &sequence, &length, &position);
+        if(count == 0)
+        {
+            *first = sequence;
+        }
+
+        if((sequence != (*first + count)) || (length != GetRecordSize(sequence)))
+        {
+            valid = FALSE;
+        }
+        else if(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_LOG_EVENT_CORRUPT)
+        {
+            *corrupt = sequence;
+        }
+        else
+        {
+            for(uint16_t index = 0; index < length; index++)
+            {
+                if(ExternalFlashLogTest_Read[index] != (uint8_t)((sequence * 13) + index))
+                {
+                    valid = FALSE;
+                }
+            }
+        }
+        count++;
+    }
+    EXTERNAL_FLASH_TEST_CHECK(valid == TRUE);
+    return count;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs virtual time until the log ends its background work, the erase ahead of an append
+ */
+static void WaitIdle(void)
+{
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__RunWhile(IsWorking, NULL) == TRUE);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Run condition of WaitIdle
+ * @param   context: not used
+ * @return  TRUE until the log ends its background work, the erase ahead of an append
+ */
+static BOOL_TYPE IsWorking(void* context)
+{
+    (void)context;
+    return ExternalFlashLog__IsBusy(EXTERNAL_FLASH_LOG_TEST_ID);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Region offset of the end of a record, for records from sequence 0 all in the first sector
+ * @param   last: record sequence
+ * @return  offset after the record
+ */
+static uint32_t GetRecordOffset(uint32_t last)
+{
+    uint32_t offset = 0;
+
+    for(uint32_t sequence = 0; sequence <= last; sequence++)
+    {
+        offset += EXTERNAL_FLASH_LOG_HEADER_SIZE + GetRecordSize(sequence);
+    }
+    SYS_ASSERT(offset <= EXTERNAL_FLASH_LOG_SECTOR_SIZE);
+    return offset;
+}
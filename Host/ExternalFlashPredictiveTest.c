@@ -0,0 +1,170 @@
+/**
+ *  @file       ExternalFlashPredictiveTest.c
+ *
+ *  @brief      Host regression test of the predictive completion scheduling of the ExternalFlash driver.
+ *  @details    Rounds of a write, an erase, a program and a read back run on a chip faster than its typical times, on
+ *              one as fast and on one slower. The driver must never address the chip while busy and must read back
+ *              the data written; as its completion model learns the actual times, no round gets longer, the rounds on
+ *              the fast chip get shorter, those on the slow chip need fewer status polls, and on every chip the last
+ *              round polls the status register less than twice per internal operation, where period polling needs more.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_PREDICTIVE_FEATURE enabled.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_PREDICTIVE_FEATURE == DISABLED)
+#error "ExternalFlashPredictiveTest requires EXTERNAL_FLASH_PREDICTIVE_FEATURE"
+#endif
+
+//! Rounds run on each chip
+#define EXTERNAL_FLASH_PREDICTIVE_TEST_ROUNDS       (10)
+
+//! Bytes written, programmed and read back in each round, across page boundaries of the default part
+#define EXTERNAL_FLASH_PREDICTIVE_TEST_SIZE         (2048)
+
+//! Bytes erased in each round, and distance between the areas of two rounds
+#define EXTERNAL_FLASH_PREDICTIVE_TEST_STRIDE       (4096)
+
+//! Start of the programmed area, past the written ones
+#define EXTERNAL_FLASH_PREDICTIVE_TEST_PROGRAM_BASE (EXTERNAL_FLASH_PREDICTIVE_TEST_ROUNDS * EXTERNAL_FLASH_PREDICTIVE_TEST_STRIDE)
+
+//! Offset of the written areas, not page aligned
+#define EXTERNAL_FLASH_PREDICTIVE_TEST_WRITE_OFFSET (100)
+
+//! Program and erase times of the simulated chips, in percent of the typical ones
+static const uint16_t ExternalFlashPredictiveTest_Scale[] = {50, 100, 200};
+
+static uint8_t ExternalFlashPredictiveTest_Data[EXTERNAL_FLASH_PREDICTIVE_TEST_SIZE];
+static uint8_t ExternalFlashPredictiveTest_Read[EXTERNAL_FLASH_PREDICTIVE_TEST_SIZE];
+
+//! Virtual time and status polls of a round
+typedef struct
+{
+    uint64_t    Time_Us;
+    uint32_t    Status_Reads;
+    uint32_t    Chip_Ops;
+} EXTERNAL_FLASH_PREDICTIVE_TEST_ROUND_TYPE;
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void TestChip(uint16_t scale);
+static void RunRound(uint8_t instance_id, uint8_t round, EXTERNAL_FLASH_PREDICTIVE_TEST_ROUND_TYPE* result);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    uint8_t i;
+
+    for(i = 0; i < (sizeof(ExternalFlashPredictiveTest_Scale) / sizeof(ExternalFlashPredictiveTest_Scale[0])); i++)
+    {
+        TestChip(ExternalFlashPredictiveTest_Scale[i]);
+    }
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashPredictiveTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Brings up a blank chip with scaled program and erase times and runs the rounds on it, checking that the
+ *          driver learned the chip times by the last round
+ * @param   scale: program and erase times in percent of the typical ones
+ */
+static void TestChip(uint16_t scale)
+{
+    DATAFLASH_SIM_CONFIG_TYPE config;
+    EXTERNAL_FLASH_PREDICTIVE_TEST_ROUND_TYPE first;
+    EXTERNAL_FLASH_PREDICTIVE_TEST_ROUND_TYPE last;
+    uint8_t instance_id;
+    uint8_t round;
+
+    ExternalFlashTest__GetDefaultConfig(&config);
+    config.Timing.Page_Erase_Program_Us = (config.Timing.Page_Erase_Program_Us * scale) / 100;
+    config.Timing.Page_Program_Us = (config.Timing.Page_Program_Us * scale) / 100;
+    config.Timing.Page_Erase_Us = (config.Timing.Page_Erase_Us * scale) / 100;
+    config.Timing.Block_Erase_Us = (config.Timing.Block_Erase_Us * scale) / 100;
+
+    instance_id = ExternalFlashTest__Setup(&config, NULL);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+
+    RunRound(instance_id, 0, &first);
+    for(round = 1; round < EXTERNAL_FLASH_PREDICTIVE_TEST_ROUNDS; round++)
+    {
+        RunRound(instance_id, round, &last);
+    }
+
+    // The refinements of the model may move a poll by a scheduling tick
+    EXTERNAL_FLASH_TEST_CHECK((last.Time_Us * 32) <= (first.Time_Us * 33));
+    if(scale < 100)
+    {
+        // The typical times were waited at first
+        EXTERNAL_FLASH_TEST_CHECK((last.Time_Us * 5) < (first.Time_Us * 4));
+    }
+    else if(scale > 100)
+    {
+        // The chip was found busy at the typical times at first
+        EXTERNAL_FLASH_TEST_CHECK(last.Status_Reads < first.Status_Reads);
+    }
+    if(EXTERNAL_FLASH_TEST_CHECK(last.Status_Reads < (2 * last.Chip_Ops)) == FALSE)
+    {
+        printf("%u%% chip: %u status polls for %u operations\n", scale, last.Status_Reads, last.Chip_Ops);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Writes across pages, erases a range and programs part of it, then reads the written data back
+ * @param   instance_id: External Flash instance
+ * @param   round: round number, selecting the areas and the data
+ * @param   result: time, status polls and internal chip operations of the round
+ */
+static void RunRound(uint8_t instance_id, uint8_t round, EXTERNAL_FLASH_PREDICTIVE_TEST_ROUND_TYPE* result)
+{
+    const DATAFLASH_SIM_STATS_TYPE* stats;
+    uint32_t address = ((uint32_t)round * EXTERNAL_FLASH_PREDICTIVE_TEST_STRIDE);
+    uint64_t start_us;
+    uint32_t i;
+
+    for(i = 0; i < EXTERNAL_FLASH_PREDICTIVE_TEST_SIZE; i++)
+    {
+        ExternalFlashPredictiveTest_Data[i] = (uint8_t)((i * 13) + (round * 31) + 1);
+    }
+    DataFlashSim__ResetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    start_us = SystemTimersSim__GetUs();
+
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashPredictiveTest_Data, address + EXTERNAL_FLASH_PREDICTIVE_TEST_WRITE_OFFSET, EXTERNAL_FLASH_PREDICTIVE_TEST_SIZE));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Erase(instance_id, EXTERNAL_FLASH_PREDICTIVE_TEST_PROGRAM_BASE + address, EXTERNAL_FLASH_PREDICTIVE_TEST_STRIDE));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Program(instance_id, ExternalFlashPredictiveTest_Data, EXTERNAL_FLASH_PREDICTIVE_TEST_PROGRAM_BASE + address, EXTERNAL_FLASH_PREDICTIVE_TEST_SIZE));
+    memset(ExternalFlashPredictiveTest_Read, 0, sizeof(ExternalFlashPredictiveTest_Read));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashPredictiveTest_Read, address + EXTERNAL_FLASH_PREDICTIVE_TEST_WRITE_OFFSET, EXTERNAL_FLASH_PREDICTIVE_TEST_SIZE));
+
+    result->Time_Us = SystemTimersSim__GetUs() - start_us;
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashPredictiveTest_Read, ExternalFlashPredictiveTest_Data, sizeof(ExternalFlashPredictiveTest_Read)) == 0);
+    memset(ExternalFlashPredictiveTest_Read, 0, sizeof(ExternalFlashPredictiveTest_Read));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashPredictiveTest_Read, EXTERNAL_FLASH_PREDICTIVE_TEST_PROGRAM_BASE + address, EXTERNAL_FLASH_PREDICTIVE_TEST_SIZE));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashPredictiveTest_Read, ExternalFlashPredictiveTest_Data, sizeof(ExternalFlashPredictiveTest_Read)) == 0);
+
+    stats = DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    result->Status_Reads = stats->Status_Reads;
+    result->Chip_Ops = stats->Page_Programs + stats->Block_Erases;
+    EXTERNAL_FLASH_TEST_CHECK(stats->Busy_Violations == 0);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Protocol_Errors == 0);
+}
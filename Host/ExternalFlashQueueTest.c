@@ -0,0 +1,435 @@
+/**
+ *  @file       ExternalFlashQueueTest.c
+ *
+ *  @brief      Host regression test of the ExternalFlashQueue module.
+ *  @details    Random bursts of enqueues, peeks and dequeues must deliver every element once, in order and intact,
+ *              while the log wraps several times; peeks and dequeues program nothing but the read pointer, written
+ *              once every EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL dequeues. A restart delivers again the elements dequeued
+ *              after the last commit, fewer than the interval, and loses none; after ExternalFlashQueue__Commit it
+ *              delivers none again. A full queue refuses enqueues until elements are dequeued. Power losses at many
+ *              points of an enqueue and of a commit leave the queue with or without the element, and the head at the
+ *              old or the new read pointer. The test includes the module source to reach its map.
+ *
+ *              Build: see ExternalFlashTest.h, with an EXTERNAL_FLASH_QUEUE_MAP entry EXTERNAL_FLASH_QUEUE_TEST_ID
+ *              whose log and record are on the simulated chip, linking ExternalFlashLog.c and ExternalFlashRecord.c and
+ *              without linking ExternalFlashQueue.c.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include "../ExternalFlashQueue.c"
+
+#include <stdlib.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Queue under test
+#ifndef EXTERNAL_FLASH_QUEUE_TEST_ID
+#define EXTERNAL_FLASH_QUEUE_TEST_ID                (0)
+#endif
+
+
+//! Bursts of the random sequence, largest burst of enqueues or dequeues, restart every this many bursts, points of
+//! an enqueue or a commit where the power is lost
+#define EXTERNAL_FLASH_QUEUE_TEST_BURSTS            (2000)
+#define EXTERNAL_FLASH_QUEUE_TEST_BURST_SIZE        (8)
+#define EXTERNAL_FLASH_QUEUE_TEST_RESTART_BURSTS    (97)
+#define EXTERNAL_FLASH_QUEUE_TEST_CUTS              (24)
+
+//! Largest element of the test, its first bytes holding its id
+#define EXTERNAL_FLASH_QUEUE_TEST_ELEMENT_SIZE      (120)
+
+static uint8_t ExternalFlashQueueTest_Element[EXTERNAL_FLASH_QUEUE_TEST_ELEMENT_SIZE];
+static uint8_t ExternalFlashQueueTest_Read[EXTERNAL_FLASH_QUEUE_TEST_ELEMENT_SIZE];
+static uint8_t ExternalFlashQueueTest_Image[EXTERNAL_FLASH_TEST_IMAGE_SIZE];
+static uint8_t ExternalFlashQueueTest_Base[EXTERNAL_FLASH_TEST_IMAGE_SIZE];
+
+static uint32_t ExternalFlashQueueTest_Next_In;                 // Id of the next element enqueued
+static uint32_t ExternalFlashQueueTest_Next_Out;                // Id of the next element expected at the head
+static uint32_t ExternalFlashQueueTest_Commits;                 // EXTERNAL_FLASH_QUEUE_EVENT_COMMITTED notified
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void QueueEventHandler(CALLBACK_EVENT_TYPE event);
+static void Start(const uint8_t* image);
+static void Restart(void);
+static uint16_t FillElement(uint32_t id);
+static BOOL_TYPE Enqueue(void);
+static uint32_t Peek(void);
+static void Dequeue(void);
+static void CommitNow(void);
+static void WaitIdle(void);
+static BOOL_TYPE IsWorking(void* context);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    EXTERNAL_FLASH_LOG_INFO_TYPE info;
+    uint8_t log_id = ExternalFlashQueue_Map[EXTERNAL_FLASH_QUEUE_TEST_ID].Log_Id;
+    uint32_t written = 0;
+    uint32_t dequeues = 0;
+    uint32_t redelivered = 0;
+    uint32_t programs;
+    uint32_t head;
+    uint32_t next_in;
+    uint32_t next_out;
+    uint64_t start_us;
+    uint64_t enqueue_us;
+    uint64_t commit_us;
+    uint32_t outcome[2] = {0, 0};
+    uint16_t count;
+
+    SYS_ASSERT(EXTERNAL_FLASH_QUEUE_TEST_ID < EXTERNAL_FLASH_QUEUE_NUM);
+    SYS_ASSERT(EXTERNAL_FLASH_QUEUE_TEST_ELEMENT_SIZE <= EXTERNAL_FLASH_QUEUE_MAX_ELEMENT_SIZE);
+
+    // Fresh chip: a format gives an empty queue
+    Start(NULL);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashQueue__Format(EXTERNAL_FLASH_QUEUE_TEST_ID));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_QUEUE_EVENT_MOUNTED);
+    EXTERNAL_FLASH_TEST_CHECK(Peek() == INVALID_VALUE_32);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueue__Dequeue(EXTERNAL_FLASH_QUEUE_TEST_ID) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueue__Commit(EXTERNAL_FLASH_QUEUE_TEST_ID) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueue__GetLength(EXTERNAL_FLASH_QUEUE_TEST_ID) == INVALID_VALUE_16);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueue__Enqueue(EXTERNAL_FLASH_QUEUE_TEST_ID, ExternalFlashQueueTest_Element, EXTERNAL_FLASH_QUEUE_MAX_ELEMENT_SIZE + 1) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueue__Enqueue(EXTERNAL_FLASH_QUEUE_NUM, ExternalFlashQueueTest_Element, 4) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueue__IsBusy(EXTERNAL_FLASH_QUEUE_NUM) == TRUE);
+
+    // Random bursts, the log wraps several times; restarts without a commit deliver the last elements again
+    srand(3);
+    ExternalFlashQueueTest_Next_In = 0;
+    ExternalFlashQueueTest_Next_Out = 0;
+    for(uint32_t burst = 0; burst < EXTERNAL_FLASH_QUEUE_TEST_BURSTS; burst++)
+    {
+        count = (uint16_t)(rand() % EXTERNAL_FLASH_QUEUE_TEST_BURST_SIZE);
+        for(uint16_t index = 0; (index < count) && (Enqueue() == TRUE); index++)
+        {
+            written += FillElement(ExternalFlashQueueTest_Next_In - 1);
+        }
+
+        count = (uint16_t)(rand() % (EXTERNAL_FLASH_QUEUE_TEST_BURST_SIZE + 1));
+        for(uint16_t index = 0; (index < count) && (ExternalFlashQueueTest_Next_Out != ExternalFlashQueueTest_Next_In); index++)
+        {
+            if((rand() % 3) == 0)
+            {
+                // A peek again gives the same element
+                EXTERNAL_FLASH_TEST_CHECK(Peek() == ExternalFlashQueueTest_Next_Out);
+            }
+            EXTERNAL_FLASH_TEST_CHECK(Peek() == ExternalFlashQueueTest_Next_Out);
+            Dequeue();
+            dequeues++;
+        }
+        if(ExternalFlashQueueTest_Next_Out == ExternalFlashQueueTest_Next_In)
+        {
+            EXTERNAL_FLASH_TEST_CHECK(Peek() == INVALID_VALUE_32);
+        }
+
+        if((burst % EXTERNAL_FLASH_QUEUE_TEST_RESTART_BURSTS) == (EXTERNAL_FLASH_QUEUE_TEST_RESTART_BURSTS - 1))
+        {
+            WaitIdle();
+            next_out = ExternalFlashQueueTest_Next_Out;
+            Restart();
+            head = Peek();
+            if(head == INVALID_VALUE_32)
+            {
+                EXTERNAL_FLASH_TEST_CHECK(next_out == ExternalFlashQueueTest_Next_In);
+            }
+            else if(EXTERNAL_FLASH_TEST_CHECK((head <= next_out) && ((next_out - head) < EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL)) == TRUE)
+            {
+                redelivered += next_out - head;
+                ExternalFlashQueueTest_Next_Out = head;
+            }
+        }
+    }
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashLog__GetInfo(log_id, &info) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(written > (3UL * info.Sector_Num * EXTERNAL_FLASH_LOG_SECTOR_SIZE));
+    EXTERNAL_FLASH_TEST_CHECK(redelivered > 0);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueueTest_Commits >= ((dequeues - redelivered) / EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueueTest_Commits <= (dequeues / EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL));
+
+    // Peeks and dequeues below the commit interval program nothing
+    WaitIdle();
+    while((ExternalFlashQueueTest_Next_In - ExternalFlashQueueTest_Next_Out) < EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL)
+    {
+        EXTERNAL_FLASH_TEST_CHECK(Enqueue() == TRUE);
+    }
+    CommitNow();
+    Restart();
+    programs = DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Page_Programs;
+    for(uint16_t index = 0; index < (EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL - 1); index++)
+    {
+        EXTERNAL_FLASH_TEST_CHECK(Peek() == ExternalFlashQueueTest_Next_Out);
+        Dequeue();
+    }
+    WaitIdle();
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Page_Programs == programs);
+
+    // An explicit commit: nothing delivered again after a restart
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashQueue__Commit(EXTERNAL_FLASH_QUEUE_TEST_ID));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_QUEUE_EVENT_COMMITTED);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueue__Commit(EXTERNAL_FLASH_QUEUE_TEST_ID) == FALSE);
+    Restart();
+    EXTERNAL_FLASH_TEST_CHECK(Peek() == ExternalFlashQueueTest_Next_Out);
+
+    // A full queue refuses enqueues until elements are dequeued, and keeps them over a restart
+    while(Enqueue() == TRUE)
+    {
+        SYS_ASSERT((ExternalFlashQueueTest_Next_In - ExternalFlashQueueTest_Next_Out) < (info.Sector_Num * EXTERNAL_FLASH_LOG_SECTOR_SIZE));
+    }
+    EXTERNAL_FLASH_TEST_CHECK(Enqueue() == FALSE);
+    written = 0;
+    for(uint32_t id = ExternalFlashQueueTest_Next_Out; id != ExternalFlashQueueTest_Next_In; id++)
+    {
+        written += FillElement(id);
+    }
+    EXTERNAL_FLASH_TEST_CHECK(written > (((info.Sector_Num - 2UL) * EXTERNAL_FLASH_LOG_SECTOR_SIZE) / 2));
+    Restart();
+    while(ExternalFlashQueueTest_Next_Out != ExternalFlashQueueTest_Next_In)
+    {
+        EXTERNAL_FLASH_TEST_CHECK(Peek() == ExternalFlashQueueTest_Next_Out);
+        Dequeue();
+    }
+    EXTERNAL_FLASH_TEST_CHECK(Peek() == INVALID_VALUE_32);
+    WaitIdle();
+    EXTERNAL_FLASH_TEST_CHECK(Enqueue() == TRUE);
+
+    // Power loss at many points of an enqueue, spread over twice its duration
+    CommitNow();
+    (void)ExternalFlashTest__Snapshot(ExternalFlashQueueTest_Base);
+    next_in = ExternalFlashQueueTest_Next_In;
+    next_out = ExternalFlashQueueTest_Next_Out;
+    start_us = SystemTimersSim__GetUs();
+    EXTERNAL_FLASH_TEST_CHECK(Enqueue() == TRUE);
+    enqueue_us = SystemTimersSim__GetUs() - start_us;
+    for(uint32_t cut = 0; cut < EXTERNAL_FLASH_QUEUE_TEST_CUTS; cut++)
+    {
+        Start(ExternalFlashQueueTest_Base);
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueue__Enqueue(EXTERNAL_FLASH_QUEUE_TEST_ID, ExternalFlashQueueTest_Element, FillElement(next_in)) == TRUE);
+        ExternalFlashTest__RunFor((uint32_t)((2 * enqueue_us * cut) / (EXTERNAL_FLASH_QUEUE_TEST_CUTS - 1)));
+
+        // The elements before, then the new one intact or nothing
+        Restart();
+        ExternalFlashQueueTest_Next_Out = next_out;
+        while(ExternalFlashQueueTest_Next_Out != next_in)
+        {
+            EXTERNAL_FLASH_TEST_CHECK(Peek() == ExternalFlashQueueTest_Next_Out);
+            Dequeue();
+        }
+        head = Peek();
+        EXTERNAL_FLASH_TEST_CHECK((head == INVALID_VALUE_32) || (head == next_in));
+        outcome[(head == next_in) ? 1 : 0]++;
+    }
+    EXTERNAL_FLASH_TEST_CHECK((outcome[0] > 0) && (outcome[1] > 0));
+
+    // Power loss at many points of a commit: the head at the old or at the new read pointer
+    Start(ExternalFlashQueueTest_Base);
+    ExternalFlashQueueTest_Next_In = next_in;
+    ExternalFlashQueueTest_Next_Out = next_out;
+    while((ExternalFlashQueueTest_Next_In - ExternalFlashQueueTest_Next_Out) < EXTERNAL_FLASH_QUEUE_COMMIT_INTERVAL)
+    {
+        EXTERNAL_FLASH_TEST_CHECK(Enqueue() == TRUE);
+    }
+    WaitIdle();
+    (void)ExternalFlashTest__Snapshot(ExternalFlashQueueTest_Base);
+    next_out = ExternalFlashQueueTest_Next_Out;
+    start_us = SystemTimersSim__GetUs();
+    EXTERNAL_FLASH_TEST_CHECK(Peek() == next_out);
+    Dequeue();
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashQueue__Commit(EXTERNAL_FLASH_QUEUE_TEST_ID));
+    commit_us = SystemTimersSim__GetUs() - start_us;
+    outcome[0] = 0;
+    outcome[1] = 0;
+    for(uint32_t cut = 0; cut < EXTERNAL_FLASH_QUEUE_TEST_CUTS; cut++)
+    {
+        Start(ExternalFlashQueueTest_Base);
+        EXTERNAL_FLASH_TEST_CHECK(Peek() == next_out);
+        Dequeue();
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueue__Commit(EXTERNAL_FLASH_QUEUE_TEST_ID) == TRUE);
+        ExternalFlashTest__RunFor((uint32_t)((commit_us * cut) / (EXTERNAL_FLASH_QUEUE_TEST_CUTS - 1)));
+
+        Restart();
+        head = Peek();
+        EXTERNAL_FLASH_TEST_CHECK((head == next_out) || (head == (next_out + 1)));
+        outcome[(head == next_out) ? 0 : 1]++;
+    }
+    EXTERNAL_FLASH_TEST_CHECK((outcome[0] > 0) && (outcome[1] > 0));
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashQueueTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Queue event handler: counts the commits, started by the dequeues at any time, and passes the completion of
+ *          the other operations to ExternalFlashTest__EventHandler
+ * @param   event: queue callback event
+ */
+static void QueueEventHandler(CALLBACK_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE queue_event;
+
+    memcpy(&queue_event, &event, sizeof(CALLBACK_EVENT_TYPE));
+    if(queue_event.Event_Value == EXTERNAL_FLASH_QUEUE_EVENT_COMMITTED)
+    {
+        ExternalFlashQueueTest_Commits++;
+    }
+    ExternalFlashTest__EventHandler(event);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the driver, the logs, the records and the queues on a chip, mounting the queue under test
+ * @param   image: chip memory, NULL for an erased chip
+ */
+static void Start(const uint8_t* image)
+{
+    (void)ExternalFlashTest__Setup(NULL, image);
+    ExternalFlashLog__Initialize();
+    ExternalFlashRecord__Initialize();
+    ExternalFlashQueue__Initialize();
+    ExternalFlashQueue__RegisterEventHandler(QueueEventHandler, EXTERNAL_FLASH_QUEUE_TEST_ID, CALLBACK_FILTER_VALUE_NONE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashQueue__Mount(EXTERNAL_FLASH_QUEUE_TEST_ID));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_QUEUE_EVENT_MOUNTED);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Restarts on the current chip memory, as after a power loss
+ */
+static void Restart(void)
+{
+    (void)ExternalFlashTest__Snapshot(ExternalFlashQueueTest_Image);
+    Start(ExternalFlashQueueTest_Image);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Fills ExternalFlashQueueTest_Element with a test element
+ * @param   id: element id
+ * @return  element bytes
+ */
+static uint16_t FillElement(uint32_t id)
+{
+    uint16_t size = (uint16_t)(sizeof(id) + ((id * 7919UL) % (EXTERNAL_FLASH_QUEUE_TEST_ELEMENT_SIZE - sizeof(id) + 1)));
+
+    memcpy(ExternalFlashQueueTest_Element, &id, sizeof(id));
+    for(uint16_t offset = sizeof(id); offset < size; offset++)
+    {
+        ExternalFlashQueueTest_Element[offset] = (uint8_t)((id * 31) + offset);
+    }
+
+    return size;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Enqueues the next test element, waiting while the queue is busy with a commit
+ * @return  TRUE if enqueued, FALSE if the queue refused it as full
+ */
+static BOOL_TYPE Enqueue(void)
+{
+    BOOL_TYPE success;
+
+    WaitIdle();
+    ExternalFlashTest__Start();
+    success = ExternalFlashQueue__Enqueue(EXTERNAL_FLASH_QUEUE_TEST_ID, ExternalFlashQueueTest_Element, FillElement(ExternalFlashQueueTest_Next_In));
+    if(success == TRUE)
+    {
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__Wait() == TRUE);
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_QUEUE_EVENT_ENQUEUED);
+        ExternalFlashQueueTest_Next_In++;
+    }
+
+    return success;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Peeks the head of the queue and checks its length and content against its id
+ * @return  id of the element at the head, INVALID_VALUE_32 if the queue is empty
+ */
+static uint32_t Peek(void)
+{
+    uint32_t id = INVALID_VALUE_32;
+
+    WaitIdle();
+    memset(ExternalFlashQueueTest_Read, 0, sizeof(ExternalFlashQueueTest_Read));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashQueue__Peek(EXTERNAL_FLASH_QUEUE_TEST_ID, ExternalFlashQueueTest_Read, sizeof(ExternalFlashQueueTest_Read)));
+    if(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_QUEUE_EVENT_PEEKED)
+    {
+        memcpy(&id, ExternalFlashQueueTest_Read, sizeof(id));
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueue__GetLength(EXTERNAL_FLASH_QUEUE_TEST_ID) == FillElement(id));
+        EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashQueueTest_Read, ExternalFlashQueueTest_Element, FillElement(id)) == 0);
+    }
+    else
+    {
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_QUEUE_EVENT_EMPTY);
+    }
+
+    return id;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Dequeues the element peeked and updates the model
+ */
+static void Dequeue(void)
+{
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueue__Dequeue(EXTERNAL_FLASH_QUEUE_TEST_ID) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashQueue__Dequeue(EXTERNAL_FLASH_QUEUE_TEST_ID) == FALSE);
+    ExternalFlashQueueTest_Next_Out++;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Writes the read pointer, if anything was dequeued since the last commit, so that a restart starts from the
+ *          head of the model
+ */
+static void CommitNow(void)
+{
+    WaitIdle();
+    ExternalFlashTest__Start();
+    if(ExternalFlashQueue__Commit(EXTERNAL_FLASH_QUEUE_TEST_ID) == TRUE)
+    {
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__Wait() == TRUE);
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_QUEUE_EVENT_COMMITTED);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs virtual time until the queue and its log end their background work, commits and the erase ahead of
+ *          an append included
+ */
+static void WaitIdle(void)
+{
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__RunWhile(IsWorking, NULL) == TRUE);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Run condition of WaitIdle
+ * @param   context: not used
+ * @return  TRUE until the queue and its log end their background work, commits and the erase ahead of
+ *          an append included
+ */
+static BOOL_TYPE IsWorking(void* context)
+{
+    (void)context;
+    return ((ExternalFlashQueue__IsBusy(EXTERNAL_FLASH_QUEUE_TEST_ID) == TRUE) ||
+            (ExternalFlashLog__IsBusy(ExternalFlashQueue_Map[EXTERNAL_FLASH_QUEUE_TEST_ID].Log_Id) == TRUE)) ? TRUE : FALSE;
+}
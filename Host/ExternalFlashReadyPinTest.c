@@ -0,0 +1,122 @@
+/**
+ *  @file       ExternalFlashReadyPinTest.c
+ *
+ *  @brief      Host regression test of the RDY/BUSY pin support of the ExternalFlash driver.
+ *  @details    The same write, read back and erase run with the simulated pin wired to its interrupt, then polled at
+ *              handler periods only: the status register is never read over the bus, the chip is never addressed
+ *              while busy and the data read back is the one written. The interrupt lets the driver resume at the
+ *              chip ready edge, so the operations end sooner than when the pin is only polled.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_READY_PIN_FEATURE enabled and the map entry of
+ *              EXTERNAL_FLASH_TEST_CLIENT wired to EXTERNAL_FLASH_READY_PIN_TEST_PIN, high while ready.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_READY_PIN_FEATURE == DISABLED)
+#error "ExternalFlashReadyPinTest requires EXTERNAL_FLASH_READY_PIN_FEATURE"
+#endif
+
+//! Digital IO pin of the map entry of EXTERNAL_FLASH_TEST_CLIENT
+#ifndef EXTERNAL_FLASH_READY_PIN_TEST_PIN
+#define EXTERNAL_FLASH_READY_PIN_TEST_PIN           (3)
+#endif
+
+//! Bytes written and read back, across page boundaries of the default part
+#define EXTERNAL_FLASH_READY_PIN_TEST_SIZE          (2048)
+
+//! Start of the write, not page aligned, and of the erased range
+#define EXTERNAL_FLASH_READY_PIN_TEST_ADDRESS       (100)
+#define EXTERNAL_FLASH_READY_PIN_TEST_ERASE_ADDRESS (8192)
+#define EXTERNAL_FLASH_READY_PIN_TEST_ERASE_SIZE    (4096)
+
+static uint8_t ExternalFlashReadyPinTest_Data[EXTERNAL_FLASH_READY_PIN_TEST_SIZE];
+static uint8_t ExternalFlashReadyPinTest_Read[EXTERNAL_FLASH_READY_PIN_TEST_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static uint64_t RunOperations(BOOL_TYPE interrupt);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    uint64_t interrupt_us;
+    uint64_t polled_us;
+    uint32_t i;
+
+    for(i = 0; i < EXTERNAL_FLASH_READY_PIN_TEST_SIZE; i++)
+    {
+        ExternalFlashReadyPinTest_Data[i] = (uint8_t)((i * 7) + 1);
+    }
+
+    interrupt_us = RunOperations(TRUE);
+    polled_us = RunOperations(FALSE);
+
+    if(EXTERNAL_FLASH_TEST_CHECK(interrupt_us < polled_us) == FALSE)
+    {
+        printf("%u us with the interrupt, %u us polled\n", (uint32_t)interrupt_us, (uint32_t)polled_us);
+    }
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashReadyPinTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Brings up a blank chip with the RDY/BUSY pin wired, then writes, reads back and erases, checking that the
+ *          status register is never read and the chip never addressed while busy
+ * @param   interrupt: TRUE to call ExternalFlash__ReadyPinInterrupt on the pin rising edge
+ * @return  virtual time taken by the operations
+ */
+static uint64_t RunOperations(BOOL_TYPE interrupt)
+{
+    DATAFLASH_SIM_CONFIG_TYPE config;
+    const DATAFLASH_SIM_STATS_TYPE* stats;
+    uint8_t instance_id;
+    uint64_t start_us;
+
+    ExternalFlashTest__GetDefaultConfig(&config);
+    config.Ready_Pin = EXTERNAL_FLASH_READY_PIN_TEST_PIN;
+    config.Ready_Interrupt = (interrupt == TRUE) ? ExternalFlash__ReadyPinInterrupt : NULL;
+
+    instance_id = ExternalFlashTest__Setup(&config, NULL);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+    DataFlashSim__ResetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    start_us = SystemTimersSim__GetUs();
+
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashReadyPinTest_Data, EXTERNAL_FLASH_READY_PIN_TEST_ADDRESS, EXTERNAL_FLASH_READY_PIN_TEST_SIZE));
+    memset(ExternalFlashReadyPinTest_Read, 0, sizeof(ExternalFlashReadyPinTest_Read));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashReadyPinTest_Read, EXTERNAL_FLASH_READY_PIN_TEST_ADDRESS, EXTERNAL_FLASH_READY_PIN_TEST_SIZE));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashReadyPinTest_Read, ExternalFlashReadyPinTest_Data, sizeof(ExternalFlashReadyPinTest_Read)) == 0);
+
+    // The erase waits for the last page program, then the next read for the erase
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Erase(instance_id, EXTERNAL_FLASH_READY_PIN_TEST_ERASE_ADDRESS, EXTERNAL_FLASH_READY_PIN_TEST_ERASE_SIZE));
+    memset(ExternalFlashReadyPinTest_Read, 0, sizeof(ExternalFlashReadyPinTest_Read));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashReadyPinTest_Read, EXTERNAL_FLASH_READY_PIN_TEST_ERASE_ADDRESS, EXTERNAL_FLASH_READY_PIN_TEST_SIZE));
+    EXTERNAL_FLASH_TEST_CHECK((ExternalFlashReadyPinTest_Read[0] == 0xFF) && (ExternalFlashReadyPinTest_Read[EXTERNAL_FLASH_READY_PIN_TEST_SIZE - 1] == 0xFF));
+
+    stats = DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Status_Reads == 0);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Busy_Violations == 0);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Protocol_Errors == 0);
+    EXTERNAL_FLASH_TEST_CHECK(stats->Page_Erases > 0);
+
+    return SystemTimersSim__GetUs() - start_us;
+}
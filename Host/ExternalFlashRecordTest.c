@@ -0,0 +1,256 @@
+/**
+ *  @file       ExternalFlashRecordTest.c
+ *
+ *  @brief      Host regression test of the ExternalFlashRecord module.
+ *  @details    Records of varied lengths, within the first page of a slot and across pages, must read back and survive a
+ *              mount after a restart on the same chip memory. Power losses are simulated by restarting on a copy of the
+ *              chip memory at many points of a write, into either slot: the mount gives the old or the new record,
+ *              never a mix. A commit page programmed in part, and data corrupted past the commit page, make the mount
+ *              keep the previous record. The test includes the module source to reach its map.
+ *
+ *              Build: see ExternalFlashTest.h, with an EXTERNAL_FLASH_RECORD_MAP entry EXTERNAL_FLASH_RECORD_TEST_ID of
+ *              more than one page on the simulated chip, without linking ExternalFlashRecord.c; again with
+ *              EXTERNAL_FLASH_WRITE_COMBINE_FEATURE enabled.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include "../ExternalFlashRecord.c"
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Record under test
+#ifndef EXTERNAL_FLASH_RECORD_TEST_ID
+#define EXTERNAL_FLASH_RECORD_TEST_ID               (0)
+#endif
+
+//! Largest record
+#define EXTERNAL_FLASH_RECORD_TEST_MAX_SIZE         (4096)
+
+//! Writes of varied lengths, points of a write where the power is lost
+#define EXTERNAL_FLASH_RECORD_TEST_WRITES           (40)
+#define EXTERNAL_FLASH_RECORD_TEST_CUTS             (24)
+
+static uint8_t ExternalFlashRecordTest_Data[EXTERNAL_FLASH_RECORD_TEST_MAX_SIZE];
+static uint8_t ExternalFlashRecordTest_Read[EXTERNAL_FLASH_RECORD_TEST_MAX_SIZE];
+static uint8_t ExternalFlashRecordTest_Image[EXTERNAL_FLASH_TEST_IMAGE_SIZE];
+static uint8_t ExternalFlashRecordTest_Base[EXTERNAL_FLASH_TEST_IMAGE_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void Start(const uint8_t* image);
+static void Restart(void);
+static uint16_t GetLength(uint32_t version);
+static void FillRecord(uint32_t version);
+static void Write(uint32_t version);
+static BOOL_TYPE IsRecord(uint32_t version);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    uint16_t record_size = ExternalFlashRecord_Map[EXTERNAL_FLASH_RECORD_TEST_ID].Record_Size;
+    uint32_t slot_size = EXTERNAL_FLASH_RECORD_SLOT_SIZE(record_size);
+    uint32_t version;
+    uint32_t address;
+    uint64_t start_us;
+    uint64_t write_us;
+    uint32_t outcome[2] = {0, 0};
+
+    SYS_ASSERT(EXTERNAL_FLASH_RECORD_TEST_ID < EXTERNAL_FLASH_RECORD_NUM);
+    SYS_ASSERT((record_size > EXTERNAL_FLASH_RECORD_FIRST_DATA_SIZE) && (record_size <= EXTERNAL_FLASH_RECORD_TEST_MAX_SIZE));
+
+    // Fresh chip: no record
+    Start(NULL);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashRecord__GetLength(EXTERNAL_FLASH_RECORD_TEST_ID) == INVALID_VALUE_16);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashRecord__Read(EXTERNAL_FLASH_RECORD_TEST_ID, ExternalFlashRecordTest_Read, record_size) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashRecord__Write(EXTERNAL_FLASH_RECORD_TEST_ID, ExternalFlashRecordTest_Data, record_size + 1) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashRecord__Write(EXTERNAL_FLASH_RECORD_NUM, ExternalFlashRecordTest_Data, 1) == FALSE);
+
+    // Writes of varied lengths, each one read back, with a mount after a restart from time to time
+    for(version = 0; version < EXTERNAL_FLASH_RECORD_TEST_WRITES; version++)
+    {
+        Write(version);
+        EXTERNAL_FLASH_TEST_CHECK(IsRecord(version) == TRUE);
+        if((version % 8) == 7)
+        {
+            Restart();
+            EXTERNAL_FLASH_TEST_CHECK(IsRecord(version) == TRUE);
+        }
+    }
+
+    // Power loss at many points of a write across pages, into each slot, spread over twice its duration
+    for(uint8_t slot = 0; slot < EXTERNAL_FLASH_RECORD_SLOTS; slot++)
+    {
+        while((GetLength(version) <= EXTERNAL_FLASH_RECORD_FIRST_DATA_SIZE) || (ExternalFlashRecord_Store[EXTERNAL_FLASH_RECORD_TEST_ID].Slot == slot))
+        {
+            Write(version++);
+        }
+        (void)ExternalFlashTest__Snapshot(ExternalFlashRecordTest_Base);
+        start_us = SystemTimersSim__GetUs();
+        Write(version);
+        write_us = SystemTimersSim__GetUs() - start_us;
+
+        for(uint32_t cut = 0; cut < EXTERNAL_FLASH_RECORD_TEST_CUTS; cut++)
+        {
+            Start(ExternalFlashRecordTest_Base);
+            FillRecord(version);
+            EXTERNAL_FLASH_TEST_CHECK(ExternalFlashRecord__Write(EXTERNAL_FLASH_RECORD_TEST_ID, ExternalFlashRecordTest_Data, GetLength(version)) == TRUE);
+            ExternalFlashTest__RunFor((uint32_t)((2 * write_us * cut) / (EXTERNAL_FLASH_RECORD_TEST_CUTS - 1)));
+
+            Restart();
+            if(IsRecord(version) == TRUE)
+            {
+                outcome[1]++;
+            }
+            else
+            {
+                EXTERNAL_FLASH_TEST_CHECK(IsRecord(version - 1) == TRUE);
+                outcome[0]++;
+            }
+        }
+        Start(ExternalFlashRecordTest_Base);
+        Write(version++);
+    }
+    // Old and new records were both seen
+    EXTERNAL_FLASH_TEST_CHECK((outcome[0] > 0) && (outcome[1] > 0));
+
+    // Commit page programmed in part: the base memory with half of the new commit page
+    while(GetLength(version) <= EXTERNAL_FLASH_RECORD_PAGE_SIZE)
+    {
+        Write(version++);
+    }
+    (void)ExternalFlashTest__Snapshot(ExternalFlashRecordTest_Base);
+    Write(version);
+    address = ExternalFlashRecord_Map[EXTERNAL_FLASH_RECORD_TEST_ID].Address + (ExternalFlashRecord_Store[EXTERNAL_FLASH_RECORD_TEST_ID].Slot * slot_size);
+    (void)ExternalFlashTest__Snapshot(ExternalFlashRecordTest_Image);
+    memcpy(&ExternalFlashRecordTest_Image[ExternalFlashTest__GetMemoryOffset(address + (EXTERNAL_FLASH_RECORD_PAGE_SIZE / 2))],
+           &ExternalFlashRecordTest_Base[ExternalFlashTest__GetMemoryOffset(address + (EXTERNAL_FLASH_RECORD_PAGE_SIZE / 2))], EXTERNAL_FLASH_RECORD_PAGE_SIZE / 2);
+    Start(ExternalFlashRecordTest_Image);
+    EXTERNAL_FLASH_TEST_CHECK(IsRecord(version - 1) == TRUE);
+
+    // Data corrupted past the commit page: the previous record is kept, the next write goes over the bad slot
+    Restart();
+    Write(version);
+    while(GetLength(version) <= EXTERNAL_FLASH_RECORD_FIRST_DATA_SIZE)
+    {
+        Write(++version);
+    }
+    address = ExternalFlashRecord_Map[EXTERNAL_FLASH_RECORD_TEST_ID].Address + (ExternalFlashRecord_Store[EXTERNAL_FLASH_RECORD_TEST_ID].Slot * slot_size);
+    (void)ExternalFlashTest__Snapshot(ExternalFlashRecordTest_Image);
+    ExternalFlashRecordTest_Image[ExternalFlashTest__GetMemoryOffset(address + EXTERNAL_FLASH_RECORD_PAGE_SIZE)] ^= 0x01;
+    Start(ExternalFlashRecordTest_Image);
+    EXTERNAL_FLASH_TEST_CHECK(IsRecord(version - 1) == TRUE);
+    Write(++version);
+    Restart();
+    EXTERNAL_FLASH_TEST_CHECK(IsRecord(version) == TRUE);
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashRecordTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the driver and the records on a chip, mounting the record under test
+ * @param   image: chip memory, NULL for an erased chip
+ */
+static void Start(const uint8_t* image)
+{
+    (void)ExternalFlashTest__Setup(NULL, image);
+    ExternalFlashRecord__Initialize();
+    ExternalFlashRecord__RegisterEventHandler(ExternalFlashTest__EventHandler, EXTERNAL_FLASH_RECORD_TEST_ID, CALLBACK_FILTER_VALUE_NONE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashRecord__Mount(EXTERNAL_FLASH_RECORD_TEST_ID));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_RECORD_EVENT_MOUNTED);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Restarts on the current chip memory, as after a power loss
+ */
+static void Restart(void)
+{
+    (void)ExternalFlashTest__Snapshot(ExternalFlashRecordTest_Image);
+    Start(ExternalFlashRecordTest_Image);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Length of a version of the test record, empty and full records included
+ * @param   version: record version
+ * @return  data bytes
+ */
+static uint16_t GetLength(uint32_t version)
+{
+    uint16_t record_size = ExternalFlashRecord_Map[EXTERNAL_FLASH_RECORD_TEST_ID].Record_Size;
+
+    return (uint16_t)(((version % 8) == 0) ? (((version % 16) == 0) ? 0 : record_size) : ((version * 97) % record_size));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Fills ExternalFlashRecordTest_Data with a version of the test record
+ * @param   version: record version
+ */
+static void FillRecord(uint32_t version)
+{
+    for(uint16_t index = 0; index < GetLength(version); index++)
+    {
+        ExternalFlashRecordTest_Data[index] = (uint8_t)((version * 29) + index);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Writes a version of the test record
+ * @param   version: record version
+ */
+static void Write(uint32_t version)
+{
+    FillRecord(version);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashRecord__Write(EXTERNAL_FLASH_RECORD_TEST_ID, ExternalFlashRecordTest_Data, GetLength(version)));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_RECORD_EVENT_WRITTEN);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Tells if the current record is a version of the test record, reading it
+ * @param   version: record version
+ * @return  TRUE if its length and all its data match
+ */
+static BOOL_TYPE IsRecord(uint32_t version)
+{
+    uint16_t length = GetLength(version);
+    BOOL_TYPE match = FALSE;
+
+    if(ExternalFlashRecord__GetLength(EXTERNAL_FLASH_RECORD_TEST_ID) == length)
+    {
+        memset(ExternalFlashRecordTest_Read, 0, sizeof(ExternalFlashRecordTest_Read));
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlashRecord__Read(EXTERNAL_FLASH_RECORD_TEST_ID, ExternalFlashRecordTest_Read, sizeof(ExternalFlashRecordTest_Read)));
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_RECORD_EVENT_READ);
+
+        match = TRUE;
+        for(uint16_t index = 0; index < length; index++)
+        {
+            if(ExternalFlashRecordTest_Read[index] != (uint8_t)((version * 29) + index))
+            {
+                match = FALSE;
+            }
+        }
+    }
+
+    return match;
+}
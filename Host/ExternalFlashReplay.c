@@ -0,0 +1,511 @@
+/**
+ *  @file       ExternalFlashReplay.c
+ *
+ *  @brief      Replays an ExternalFlash capture stream through the driver on the simulated DataFlash.
+ *  @details    The input is the stream produced with EXTERNAL_FLASH_CAPTURE_FEATURE enabled (ExternalFlash__GetCapture
+ *              or the application EXTERNAL_FLASH_CAPTURE_SINK). Allocations are repeated, then every accepted
+ *              Read/Write/Flush/Program/Erase/WritePages/ReadSpare/ScanErased is submitted at its captured time, or as soon as the driver accepts it if the instance or
+ *              its chip is still busy. Requests the driver rejected on the unit are skipped: they were retried by the
+ *              client and the retry shows up as a later accepted record. Write data and page metadata are not
+ *              captured, a pattern is written instead. Built with EXTERNAL_FLASH_SPARE_FEATURE enabled the simulated
+ *              chip has DataFlash pages, with a spare area.
+ *
+ *              The report compares the replay with the capture: request latency from submit to callback (mean,
+ *              p99, max), span of the workload, time requests had to wait to be accepted, plus the simulated chip
+ *              activity (bus events, page programs, busy time).
+ *
+ *              Usage: ExternalFlashReplay capture.bin [-f] [-c spi_clock_hz]
+ *                  -f: ignore captured inter-arrival times, submit each request as soon as possible
+ *
+ *              Host builds link this file with the driver, Host/DataFlashSim.c, Host/SystemTimersSim.c and the
+ *              host framework, whose EXTERNAL_FLASH_MAP binds the captured clients to the simulated bus and whose
+ *              EXTERNAL_FLASH_TIMESTAMP_US() reads SystemTimersSim__GetUs.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlash.h"
+#include "CommonInterface.h"
+
+#include "DataFlashSim.h"
+#include "SystemTimersSim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Simulated chip channel and provider id of the replayed instances
+#ifndef EXTERNAL_FLASH_REPLAY_BUS_PROVIDER
+#define EXTERNAL_FLASH_REPLAY_BUS_PROVIDER      (0)
+#endif
+#ifndef EXTERNAL_FLASH_REPLAY_BUS_CHANNEL
+#define EXTERNAL_FLASH_REPLAY_BUS_CHANNEL       (0)
+#endif
+
+//! Largest transfer, the driver API size is 16 bit
+#define EXTERNAL_FLASH_REPLAY_MAX_SIZE          (65535)
+
+//! Virtual time allowed to wait for a request to be accepted or completed
+#define EXTERNAL_FLASH_REPLAY_TIMEOUT_US        (10ULL * 1000000ULL)
+
+//! Replay state of an instance
+typedef struct EXTERNAL_FLASH_REPLAY_INSTANCE_STRUCT
+{
+    uint8_t                     Replay_Instance;            // Instance allocated by the replay, INVALID_VALUE_8 if none
+    uint8_t*                    Mirror;
+    BOOL_TYPE                   Pending;                    // Request submitted, callback not received yet
+    uint64_t                    Submit_Us;
+    uint64_t                    Capture_Submit_Us;          // Captured submit time of the pending request
+    BOOL_TYPE                   Capture_Pending;
+    uint8_t                     Data[EXTERNAL_FLASH_REPLAY_MAX_SIZE];
+} EXTERNAL_FLASH_REPLAY_INSTANCE_TYPE;
+
+//! Latency samples
+typedef struct EXTERNAL_FLASH_REPLAY_SAMPLES_STRUCT
+{
+    uint32_t*                   Sample;
+    uint32_t                    Num;
+    uint32_t                    Capacity;
+    uint64_t                    Sum;
+} EXTERNAL_FLASH_REPLAY_SAMPLES_TYPE;
+
+static EXTERNAL_FLASH_REPLAY_INSTANCE_TYPE ExternalFlashReplay_Instance[UINT8_MAX + 1];
+static EXTERNAL_FLASH_REPLAY_SAMPLES_TYPE ExternalFlashReplay_Latency;
+static EXTERNAL_FLASH_REPLAY_SAMPLES_TYPE ExternalFlashReplay_Capture_Latency;
+static uint32_t ExternalFlashReplay_Completions;
+static uint32_t ExternalFlashReplay_Memory_Size;
+static uint16_t ExternalFlashReplay_Page_Size;
+//! Page metadata read, not checked
+static EXTERNAL_FLASH_SPARE_TYPE ExternalFlashReplay_Spare[EXTERNAL_FLASH_REPLAY_MAX_SIZE / sizeof(EXTERNAL_FLASH_SPARE_TYPE)];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static BOOL_TYPE DecodeByte(const uint8_t* data, uint32_t size, uint32_t* offset, uint8_t* value);
+static BOOL_TYPE DecodeVarint(const uint8_t* data, uint32_t size, uint32_t* offset, uint32_t* value);
+static uint8_t ReplayRequest(EXTERNAL_FLASH_REPLAY_INSTANCE_TYPE* instance, EXTERNAL_FLASH_CAPTURE_RECORD_TYPE type, uint32_t address, uint16_t size);
+static void EventHandler(CALLBACK_EVENT_TYPE event);
+static BOOL_TYPE IsCompleted(void* context);
+static BOOL_TYPE IsIdle(void* context);
+static void AddSample(EXTERNAL_FLASH_REPLAY_SAMPLES_TYPE* samples, uint32_t value);
+static void PrintSamples(const char* name, EXTERNAL_FLASH_REPLAY_SAMPLES_TYPE* samples);
+static int CompareSample(const void* a, const void* b);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(int argc, char* argv[])
+{
+    DATAFLASH_SIM_CONFIG_TYPE config;
+    const DATAFLASH_SIM_STATS_TYPE* stats;
+    FILE* file;
+    uint8_t* capture;
+    long capture_size;
+    uint32_t offset;
+    uint64_t capture_us = 0;
+    uint64_t start_us;
+    uint64_t wait_us = 0;
+    uint32_t requests = 0;
+    uint32_t skipped = 0;
+    uint32_t failed = 0;
+    BOOL_TYPE fast = FALSE;
+    BOOL_TYPE valid = TRUE;
+    const char* file_name = NULL;
+
+    DataFlashSim__GetDefaultConfig(&config);
+    config.Generic_Comm_Bus_Id = EXTERNAL_FLASH_REPLAY_BUS_PROVIDER;
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    // Page metadata needs the spare area of the DataFlash pages
+    config.Power_Of_Two_Pages = FALSE;
+#endif
+
+    for(int arg = 1; arg < argc; arg++)
+    {
+        if(strcmp(argv[arg], "-f") == 0)
+        {
+            fast = TRUE;
+        }
+        else if((strcmp(argv[arg], "-c") == 0) && (arg + 1 < argc))
+        {
+            config.Timing.Spi_Clock_Hz = (uint32_t)strtoul(argv[++arg], NULL, 0);
+        }
+        else if(file_name == NULL)
+        {
+            file_name = argv[arg];
+        }
+        else
+        {
+            file_name = NULL;
+            break;
+        }
+    }
+    if(file_name == NULL)
+    {
+        fprintf(stderr, "Usage: %s capture.bin [-f] [-c spi_clock_hz]\n", argv[0]);
+        return 1;
+    }
+
+    file = fopen(file_name, "rb");
+    if(file == NULL)
+    {
+        perror(file_name);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    capture_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    capture = malloc((size_t)MAX(capture_size, 1));
+    if((capture == NULL) || (fread(capture, 1, (size_t)capture_size, file) != (size_t)capture_size))
+    {
+        fprintf(stderr, "%s: read error\n", file_name);
+        return 1;
+    }
+    fclose(file);
+
+    if((capture_size < 5) ||
+       ((capture[0] | (capture[1] << 8) | (capture[2] << 16) | ((uint32_t)capture[3] << 24)) != EXTERNAL_FLASH_CAPTURE_MAGIC) ||
+       (capture[4] != EXTERNAL_FLASH_CAPTURE_VERSION))
+    {
+        fprintf(stderr, "%s: not an ExternalFlash capture (or unsupported version)\n", file_name);
+        return 1;
+    }
+
+    // Fresh simulated chip and driver
+    SystemTimersSim__Initialize();
+    SYS_ASSERT(DataFlashSim__Initialize(EXTERNAL_FLASH_REPLAY_BUS_CHANNEL, &config) == TRUE);
+    ExternalFlashReplay_Memory_Size = (uint32_t)config.Page_Size * config.Page_Num;
+    ExternalFlashReplay_Page_Size = config.Page_Size;
+    ExternalFlash__Initialize();
+    for(uint16_t index = 0; index <= UINT8_MAX; index++)
+    {
+        ExternalFlashReplay_Instance[index].Replay_Instance = INVALID_VALUE_8;
+    }
+    start_us = SystemTimersSim__GetUs();
+
+    offset = 5;
+    while((valid == TRUE) && (offset < (uint32_t)capture_size))
+    {
+        uint8_t type = capture[offset++];
+        uint32_t delta_us = 0;
+        uint32_t value_1 = 0;
+        uint32_t value_2 = 0;
+        uint8_t instance_id = 0;
+        uint8_t allocated = 0;
+        uint8_t flag = 0;
+
+        valid = DecodeVarint(capture, (uint32_t)capture_size, &offset, &delta_us);
+        valid &= DecodeByte(capture, (uint32_t)capture_size, &offset, &instance_id);
+        capture_us += delta_us;
+
+        switch(type)
+        {
+          case EXTERNAL_FLASH_CAPTURE_RECORD_ALLOCATION:
+            valid &= DecodeByte(capture, (uint32_t)capture_size, &offset, &flag);
+            valid &= DecodeVarint(capture, (uint32_t)capture_size, &offset, &value_1);
+            valid &= DecodeByte(capture, (uint32_t)capture_size, &offset, &allocated);
+            if(valid == TRUE)
+            {
+                EXTERNAL_FLASH_REPLAY_INSTANCE_TYPE* instance = &ExternalFlashReplay_Instance[allocated];
+
+                if((flag == TRUE) && (instance->Mirror == NULL))
+                {
+                    instance->Mirror = calloc(ExternalFlashReplay_Memory_Size + EXTERNAL_FLASH_REPLAY_MAX_SIZE, 1);
+                }
+                instance->Replay_Instance = ExternalFlash__GetAllocation(instance_id, instance->Mirror, (uint16_t)value_1);
+                if(instance->Replay_Instance < EXTERNAL_FLASH_CH_NUM)
+                {
+                    ExternalFlash__RegisterEventHandler(EventHandler, instance->Replay_Instance, CALLBACK_FILTER_VALUE_NONE);
+                }
+
+                // Let the driver leave its initialization state
+                SystemTimersSim__RunUntil(SystemTimersSim__GetUs() + (2 * EXTERNAL_FLASH_HANDLER_PERIOD_MS * 1000));
+            }
+            break;
+
+          case EXTERNAL_FLASH_CAPTURE_RECORD_READ:
+          case EXTERNAL_FLASH_CAPTURE_RECORD_WRITE:
+          case EXTERNAL_FLASH_CAPTURE_RECORD_FLUSH:
+          case EXTERNAL_FLASH_CAPTURE_RECORD_PROGRAM:
+          case EXTERNAL_FLASH_CAPTURE_RECORD_ERASE:
+          case EXTERNAL_FLASH_CAPTURE_RECORD_WRITE_PAGES:
+          case EXTERNAL_FLASH_CAPTURE_RECORD_READ_SPARE:
+          case EXTERNAL_FLASH_CAPTURE_RECORD_SCAN_ERASED:
+            valid &= DecodeVarint(capture, (uint32_t)capture_size, &offset, &value_1);
+            valid &= DecodeVarint(capture, (uint32_t)capture_size, &offset, &value_2);
+            valid &= DecodeByte(capture, (uint32_t)capture_size, &offset, &flag);
+            if((valid == TRUE) && (flag == TRUE))
+            {
+                EXTERNAL_FLASH_REPLAY_INSTANCE_TYPE* instance = &ExternalFlashReplay_Instance[instance_id];
+                uint64_t due_us = start_us + capture_us;
+
+                instance->Capture_Submit_Us = capture_us;
+                instance->Capture_Pending = TRUE;
+
+                if((fast == FALSE) && (due_us > SystemTimersSim__GetUs()))
+                {
+                    SystemTimersSim__RunUntil(due_us);
+                }
+                due_us = SystemTimersSim__GetUs();
+
+                switch(ReplayRequest(instance, (EXTERNAL_FLASH_CAPTURE_RECORD_TYPE)type, value_1, (uint16_t)value_2))
+                {
+                  case TRUE:
+                    requests++;
+                    wait_us += instance->Submit_Us - due_us;
+                    break;
+                  case FALSE:
+                    failed++;
+                    break;
+                  default:
+                    skipped++;
+                    break;
+                }
+            }
+            else if(valid == TRUE)
+            {
+                skipped++;
+            }
+            break;
+
+          case EXTERNAL_FLASH_CAPTURE_RECORD_COMPLETE:
+            valid &= DecodeVarint(capture, (uint32_t)capture_size, &offset, &value_1);
+            if((valid == TRUE) && (ExternalFlashReplay_Instance[instance_id].Capture_Pending == TRUE))
+            {
+                AddSample(&ExternalFlashReplay_Capture_Latency, (uint32_t)(capture_us - ExternalFlashReplay_Instance[instance_id].Capture_Submit_Us));
+                ExternalFlashReplay_Instance[instance_id].Capture_Pending = FALSE;
+            }
+            break;
+
+          default:
+            valid = FALSE;
+            break;
+        }
+    }
+
+    if(valid == FALSE)
+    {
+        fprintf(stderr, "%s: corrupted record at offset %u, replay stopped\n", file_name, offset);
+    }
+
+    // Drain the requests still in progress
+    if(SystemTimersSim__RunUntilCondition(IsIdle, NULL, EXTERNAL_FLASH_REPLAY_TIMEOUT_US) == FALSE)
+    {
+        failed++;
+    }
+
+    stats = DataFlashSim__GetStats(EXTERNAL_FLASH_REPLAY_BUS_CHANNEL);
+    printf("capture: %s, %ld bytes, span %llu us\n", file_name, capture_size, (unsigned long long)capture_us);
+    printf("replay:  %u requests, %u skipped (rejected on the unit), %u failed, span %llu us, %s\n",
+           requests, skipped, failed, (unsigned long long)(SystemTimersSim__GetUs() - start_us),
+           (fast == TRUE) ? "as fast as possible" : "captured arrival times");
+    printf("         waited %llu us in total for the driver to accept requests\n", (unsigned long long)wait_us);
+    PrintSamples("captured latency", &ExternalFlashReplay_Capture_Latency);
+    PrintSamples("replayed latency", &ExternalFlashReplay_Latency);
+    printf("chip:    %u bus events, %u page programs, %u page erases, %llu us busy, %u busy violations, %u protocol errors\n",
+           stats->Bus_Events, stats->Page_Programs, stats->Page_Erases, (unsigned long long)stats->Busy_Time_Us,
+           stats->Busy_Violations, stats->Protocol_Errors);
+
+    DataFlashSim__Deinitialize();
+    free(capture);
+    return ((valid == TRUE) && (failed == 0)) ? 0 : 1;
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+static BOOL_TYPE DecodeByte(const uint8_t* data, uint32_t size, uint32_t* offset, uint8_t* value)
+{
+    BOOL_TYPE valid = FALSE;
+
+    if(*offset < size)
+    {
+        *value = data[(*offset)++];
+        valid = TRUE;
+    }
+    return valid;
+}
+
+static BOOL_TYPE DecodeVarint(const uint8_t* data, uint32_t size, uint32_t* offset, uint32_t* value)
+{
+    BOOL_TYPE valid = FALSE;
+    uint8_t shift = 0;
+
+    *value = 0;
+    while((*offset < size) && (shift < 35))
+    {
+        uint8_t byte = data[(*offset)++];
+
+        *value |= (uint32_t)(byte & 0x7f) << shift;
+        shift += 7;
+        if((byte & 0x80) == 0)
+        {
+            valid = TRUE;
+            break;
+        }
+    }
+    return valid;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Submits a captured request, waiting for the driver to accept it
+ * @param   instance: captured instance
+ * @param   type: read, write, flush, program, erase, write pages, read spare or scan erased record
+ * @param   address: instance address
+ * @param   size: transfer size, number of pages for read spare and scan erased
+ * @return  TRUE if submitted, FALSE if never accepted, INVALID_VALUE_8 if the instance was not allocated or the
+ *          request does not apply to the replay driver (flush without write combining)
+ */
+static uint8_t ReplayRequest(EXTERNAL_FLASH_REPLAY_INSTANCE_TYPE* instance, EXTERNAL_FLASH_CAPTURE_RECORD_TYPE type, uint32_t address, uint16_t size)
+{
+    uint8_t result = FALSE;
+    uint64_t limit_us = SystemTimersSim__GetUs() + EXTERNAL_FLASH_REPLAY_TIMEOUT_US;
+    uint64_t span = ((type == EXTERNAL_FLASH_CAPTURE_RECORD_READ_SPARE) || (type == EXTERNAL_FLASH_CAPTURE_RECORD_SCAN_ERASED)) ?
+                    ((uint64_t)size * ExternalFlashReplay_Page_Size) : size;
+    EXTERNAL_FLASH_SPARE_TYPE spare = {INVALID_VALUE_16, 0, 0, INVALID_VALUE_16};
+
+    if((instance->Replay_Instance >= EXTERNAL_FLASH_CH_NUM) || (((uint64_t)address + span) > ExternalFlashReplay_Memory_Size))
+    {
+        result = INVALID_VALUE_8;
+    }
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == DISABLED)
+    else if(type == EXTERNAL_FLASH_CAPTURE_RECORD_FLUSH)
+    {
+        result = INVALID_VALUE_8;
+    }
+#endif
+
+    while((result == FALSE) && (SystemTimersSim__GetUs() < limit_us))
+    {
+        switch(type)
+        {
+          case EXTERNAL_FLASH_CAPTURE_RECORD_WRITE:
+            memset(instance->Data, (uint8_t)(address + size), size);
+            result = ExternalFlash__Write(instance->Replay_Instance, instance->Data, address, size);
+            break;
+          case EXTERNAL_FLASH_CAPTURE_RECORD_FLUSH:
+            result = ExternalFlash__Flush(instance->Replay_Instance);
+            break;
+          case EXTERNAL_FLASH_CAPTURE_RECORD_PROGRAM:
+            memset(instance->Data, (uint8_t)(address + size), size);
+            result = ExternalFlash__Program(instance->Replay_Instance, instance->Data, address, size);
+            break;
+          case EXTERNAL_FLASH_CAPTURE_RECORD_ERASE:
+            result = ExternalFlash__Erase(instance->Replay_Instance, address, size);
+            break;
+          case EXTERNAL_FLASH_CAPTURE_RECORD_WRITE_PAGES:
+            memset(instance->Data, (uint8_t)(address + size), size);
+            spare.Logical_Page = (uint16_t)(address / ExternalFlashReplay_Page_Size);
+            result = ExternalFlash__WritePages(instance->Replay_Instance, instance->Data, address, size, &spare);
+            break;
+          case EXTERNAL_FLASH_CAPTURE_RECORD_READ_SPARE:
+            result = ExternalFlash__ReadSpare(instance->Replay_Instance, ExternalFlashReplay_Spare, address, size);
+            break;
+          case EXTERNAL_FLASH_CAPTURE_RECORD_SCAN_ERASED:
+            result = ExternalFlash__ScanErased(instance->Replay_Instance, address, size);
+            break;
+          default:
+            result = ExternalFlash__Read(instance->Replay_Instance, instance->Data, address, size);
+            break;
+        }
+
+        if(result == TRUE)
+        {
+            instance->Pending = TRUE;
+            instance->Submit_Us = SystemTimersSim__GetUs();
+        }
+        else
+        {
+            uint32_t completions = ExternalFlashReplay_Completions;
+
+            // Instance or chip busy: wait for a completion, or a handler period if nothing is in progress
+            if(SystemTimersSim__RunUntilCondition(IsCompleted, &completions, EXTERNAL_FLASH_HANDLER_PERIOD_MS * 1000) == FALSE)
+            {
+                SystemTimersSim__RunUntil(SystemTimersSim__GetUs() + 1);
+            }
+        }
+    }
+    return result;
+}
+
+static void EventHandler(CALLBACK_EVENT_TYPE event)
+{
+    COMMON_I_CALLBACK_TYPE data;
+
+    memcpy(&data, &event, sizeof(CALLBACK_EVENT_TYPE));
+
+    for(uint16_t index = 0; index <= UINT8_MAX; index++)
+    {
+        EXTERNAL_FLASH_REPLAY_INSTANCE_TYPE* instance = &ExternalFlashReplay_Instance[index];
+
+        if((instance->Replay_Instance == data.Source_Instance_Id) && (instance->Pending == TRUE))
+        {
+            AddSample(&ExternalFlashReplay_Latency, (uint32_t)(SystemTimersSim__GetUs() - instance->Submit_Us));
+            instance->Pending = FALSE;
+            break;
+        }
+    }
+    ExternalFlashReplay_Completions++;
+}
+
+static BOOL_TYPE IsCompleted(void* context)
+{
+    return (ExternalFlashReplay_Completions != *(uint32_t*)context) ? TRUE : FALSE;
+}
+
+static BOOL_TYPE IsIdle(void* context)
+{
+    BOOL_TYPE idle = TRUE;
+
+    (void)context;
+    for(uint16_t index = 0; index <= UINT8_MAX; index++)
+    {
+        if(ExternalFlashReplay_Instance[index].Pending == TRUE)
+        {
+            idle = FALSE;
+            break;
+        }
+    }
+    return idle;
+}
+
+static void AddSample(EXTERNAL_FLASH_REPLAY_SAMPLES_TYPE* samples, uint32_t value)
+{
+    if(samples->Num == samples->Capacity)
+    {
+        samples->Capacity = MAX(1024, samples->Capacity * 2);
+        samples->Sample = realloc(samples->Sample, samples->Capacity * sizeof(uint32_t));
+        SYS_ASSERT(samples->Sample != NULL);
+    }
+    samples->Sample[samples->Num++] = value;
+    samples->Sum += value;
+}
+
+static void PrintSamples(const char* name, EXTERNAL_FLASH_REPLAY_SAMPLES_TYPE* samples)
+{
+    if(samples->Num > 0)
+    {
+        qsort(samples->Sample, samples->Num, sizeof(uint32_t), CompareSample);
+        printf("%-17s %u requests, mean %.1f us, p99 %u us, max %u us\n", name, samples->Num,
+               (double)samples->Sum / samples->Num, samples->Sample[((samples->Num * 99) + 99) / 100 - 1],
+               samples->Sample[samples->Num - 1]);
+    }
+    else
+    {
+        printf("%-17s no completed requests\n", name);
+    }
+}
+
+static int CompareSample(const void* a, const void* b)
+{
+    uint32_t sample_a = *(const uint32_t*)a;
+    uint32_t sample_b = *(const uint32_t*)b;
+
+    return (sample_a > sample_b) - (sample_a < sample_b);
+}
@@ -0,0 +1,241 @@
+/**
+ *  @file       ExternalFlashScrubTest.c
+ *
+ *  @brief      Host regression test of the background scrub of the ExternalFlash driver.
+ *  @details    The chip starts with data written before the reset, the driver then writes a few pages. A page changed
+ *              for the first scrub read only is rewritten, a page changed for good is reported, and the scrub learns
+ *              no CRC from what it reads. With a spare area the pages are checked against the CRC of their metadata,
+ *              a page degraded before the reset is reported too.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_INTEGRITY_FEATURE, EXTERNAL_FLASH_SCRUB_FEATURE and
+ *              EXTERNAL_FLASH_STATS_FEATURE enabled; again with EXTERNAL_FLASH_SPARE_FEATURE enabled and
+ *              EXTERNAL_FLASH_DEVICE_BINARY_PAGE disabled for the spare area.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_SCRUB_FEATURE == DISABLED) || (EXTERNAL_FLASH_STATS_FEATURE == DISABLED)
+#error "ExternalFlashScrubTest requires EXTERNAL_FLASH_SCRUB_FEATURE and EXTERNAL_FLASH_STATS_FEATURE"
+#endif
+
+//! First page written by the driver, far enough for the scrub not to reach it during the writes
+#define EXTERNAL_FLASH_SCRUB_TEST_PAGE              (500)
+
+//! Page never written by the driver
+#define EXTERNAL_FLASH_SCRUB_TEST_OLD_PAGE          (700)
+
+static uint8_t ExternalFlashScrubTest_Data[4 * EXTERNAL_FLASH_MAX_PAGE_SIZE];
+static uint8_t ExternalFlashScrubTest_Read[4 * EXTERNAL_FLASH_MAX_PAGE_SIZE];
+static uint8_t ExternalFlashScrubTest_Instance;
+static uint16_t ExternalFlashScrubTest_Page_Size;
+static uint32_t ExternalFlashScrubTest_Extended_Page;
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void Restart(const uint8_t* image);
+static void WritePages(uint16_t page, uint16_t page_num);
+static void RunPass(void);
+static void FlipUntilRead(uint16_t page);
+static EXTERNAL_FLASH_STATS_TYPE* GetStats(void);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    uint8_t* data = ExternalFlashScrubTest_Data;
+    uint8_t* read = ExternalFlashScrubTest_Read;
+    uint16_t page;
+    uint8_t* memory;
+    uint8_t* image;
+    uint32_t size;
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    EXTERNAL_FLASH_SPARE_TYPE spare;
+#endif
+
+    // Data written before the reset, unknown to the driver
+    srand(1);
+    Restart(NULL);
+    size = DataFlashSim__GetMemorySize(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    image = malloc(size);
+    SYS_ASSERT(image != NULL);
+    for(uint32_t index = 0; index < size; index++)
+    {
+        image[index] = (uint8_t)rand();
+    }
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    // Erased metadata, as left by the erases of the chip
+    for(uint32_t index = 0; index < size; index += ExternalFlashScrubTest_Extended_Page)
+    {
+        memset(&image[index + ExternalFlashScrubTest_Page_Size], 0xFF, ExternalFlashScrubTest_Extended_Page - ExternalFlashScrubTest_Page_Size);
+    }
+#endif
+    Restart(image);
+    page = ExternalFlashScrubTest_Page_Size;
+    memory = DataFlashSim__GetMemory(EXTERNAL_FLASH_TEST_BUS_CHANNEL);
+    for(uint16_t index = 0; index < sizeof(ExternalFlashScrubTest_Data); index++)
+    {
+        data[index] = (uint8_t)rand();
+    }
+
+    // Pages written by the driver, then two more that take the chip buffers
+    WritePages(EXTERNAL_FLASH_SCRUB_TEST_PAGE, 4);
+    WritePages(EXTERNAL_FLASH_SCRUB_TEST_PAGE + 100, 2);
+
+    // Changed for the first read only, the page is rewritten
+    FlipUntilRead(EXTERNAL_FLASH_SCRUB_TEST_PAGE + 1);
+    RunPass();
+    EXTERNAL_FLASH_TEST_CHECK(GetStats()->Scrub_Repairs == 1);
+    EXTERNAL_FLASH_TEST_CHECK(GetStats()->Crc_Errors == 0);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(ExternalFlashScrubTest_Instance) == TRUE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(ExternalFlashScrubTest_Instance, read, (uint32_t)EXTERNAL_FLASH_SCRUB_TEST_PAGE * page, 4 * page));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(read, data, 4 * page) == 0);
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    // Written back with its metadata
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__ReadSpare(ExternalFlashScrubTest_Instance, &spare, (uint32_t)(EXTERNAL_FLASH_SCRUB_TEST_PAGE + 1) * page, 1));
+    EXTERNAL_FLASH_TEST_CHECK(spare.Sequence == 1);
+    EXTERNAL_FLASH_TEST_CHECK(spare.Logical_Page == 1);
+    EXTERNAL_FLASH_TEST_CHECK(spare.Erase_Count == 1);
+#endif
+
+    // Changed for good, the page is reported
+    memory[((EXTERNAL_FLASH_SCRUB_TEST_PAGE + 2) * ExternalFlashScrubTest_Extended_Page) + 9] ^= 0x10;
+    RunPass();
+    EXTERNAL_FLASH_TEST_CHECK(GetStats()->Scrub_Repairs == 1);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(ExternalFlashScrubTest_Instance) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(ExternalFlashScrubTest_Instance) == TRUE);
+    memory[((EXTERNAL_FLASH_SCRUB_TEST_PAGE + 2) * ExternalFlashScrubTest_Extended_Page) + 9] ^= 0x10;
+
+    // A page read by the scrub while changed is not learned: read whole once restored, the page matches
+    memory[(EXTERNAL_FLASH_SCRUB_TEST_OLD_PAGE * ExternalFlashScrubTest_Extended_Page) + 3] ^= 0x01;
+    RunPass();
+    memory[(EXTERNAL_FLASH_SCRUB_TEST_OLD_PAGE * ExternalFlashScrubTest_Extended_Page) + 3] ^= 0x01;
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(ExternalFlashScrubTest_Instance, read, (uint32_t)EXTERNAL_FLASH_SCRUB_TEST_OLD_PAGE * page, page));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(ExternalFlashScrubTest_Instance) == TRUE);
+    RunPass();
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(ExternalFlashScrubTest_Instance) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(GetStats()->Scrub_Repairs == 1);
+
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    // Changed before the reset, the page is reported against its stored CRC
+    memcpy(image, memory, size);
+    image[((EXTERNAL_FLASH_SCRUB_TEST_PAGE + 3) * ExternalFlashScrubTest_Extended_Page) + 1] ^= 0x04;
+    Restart(image);
+    RunPass();
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__CheckIntegrity(ExternalFlashScrubTest_Instance) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(GetStats()->Scrub_Repairs == 0);
+#endif
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+
+    free(image);
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashScrubTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Brings up the driver as after a reset, the scrub starting from the first page
+ * @param   image: chip content, NULL for an erased chip
+ */
+static void Restart(const uint8_t* image)
+{
+    DATAFLASH_SIM_CONFIG_TYPE config;
+    EXTERNAL_FLASH_GEOMETRY_TYPE geometry;
+
+    ExternalFlashTest__GetDefaultConfig(&config);
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    // DataFlash pages, the spare area is the 1/32 extra bytes of each page
+    config.Power_Of_Two_Pages = FALSE;
+#endif
+    ExternalFlashScrubTest_Instance = ExternalFlashTest__Setup(&config, image);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, ExternalFlashScrubTest_Instance, CALLBACK_FILTER_VALUE_NONE);
+    SYS_ASSERT(ExternalFlash__GetGeometry(ExternalFlashScrubTest_Instance, &geometry) == TRUE);
+    ExternalFlashScrubTest_Page_Size = geometry.Page_Size;
+    ExternalFlashScrubTest_Extended_Page = (uint32_t)geometry.Page_Size + (geometry.Page_Size / 32);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Writes the test data to whole pages, with their metadata on chips with a spare area
+ * @param   page: first page
+ * @param   page_num: pages, 4 at most
+ */
+static void WritePages(uint16_t page, uint16_t page_num)
+{
+    uint32_t address = (uint32_t)page * ExternalFlashScrubTest_Page_Size;
+    uint16_t size = (uint16_t)(page_num * ExternalFlashScrubTest_Page_Size);
+
+#if (EXTERNAL_FLASH_SPARE_FEATURE == ENABLED)
+    EXTERNAL_FLASH_SPARE_TYPE first = {0, 1, 0, 0};
+
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__WritePages(ExternalFlashScrubTest_Instance, ExternalFlashScrubTest_Data, address, size, &first));
+#else
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(ExternalFlashScrubTest_Instance, ExternalFlashScrubTest_Data, address, size));
+#endif
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Flush(ExternalFlashScrubTest_Instance));
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs virtual time until the scrub has read the whole device once more
+ */
+static void RunPass(void)
+{
+    uint32_t start = GetStats()->Scrub_Bytes;
+    uint32_t device = (uint32_t)ExternalFlashScrubTest_Page_Size * (DataFlashSim__GetMemorySize(EXTERNAL_FLASH_TEST_BUS_CHANNEL) / ExternalFlashScrubTest_Extended_Page);
+
+    while((GetStats()->Scrub_Bytes - start) < (device + ExternalFlashScrubTest_Page_Size))
+    {
+        ExternalFlashTest__RunFor(10000);
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Changes a bit of a page for the first scrub read of the page only
+ * @details The scrub walk started at the first page on restart and no page failed its CRC since.
+ * @param   page: page changed
+ */
+static void FlipUntilRead(uint16_t page)
+{
+    uint8_t* byte = &DataFlashSim__GetMemory(EXTERNAL_FLASH_TEST_BUS_CHANNEL)[(page * ExternalFlashScrubTest_Extended_Page) + 7];
+
+    *byte ^= 0x01;
+    while(GetStats()->Scrub_Bytes < (((uint32_t)page + 1) * ExternalFlashScrubTest_Page_Size))
+    {
+        ExternalFlashTest__RunFor(50);
+    }
+    *byte ^= 0x01;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Driver statistics of the test instance
+ * @return  statistics, valid until the next call
+ */
+static EXTERNAL_FLASH_STATS_TYPE* GetStats(void)
+{
+    static EXTERNAL_FLASH_STATS_TYPE stats;
+
+    SYS_ASSERT(ExternalFlash__GetStats(ExternalFlashScrubTest_Instance, &stats) == TRUE);
+    return &stats;
+}
@@ -0,0 +1,195 @@
+/**
+ *  @file       ExternalFlashSpareTest.c
+ *
+ *  @brief      Host regression test of the page metadata kept by the ExternalFlash driver in the page spare area.
+ *  @details    On a chip with DataFlash pages each page metadata written by ExternalFlash__WritePages matches its data,
+ *              carries the sequence and logical page given and an erase count read back from the old metadata, across
+ *              resets, which follows the erases of the chip. Plain writes and programs merge the page and keep its
+ *              metadata matching, except programs of pages without metadata, and erases erase it.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_SPARE_FEATURE enabled and either
+ *              EXTERNAL_FLASH_DETECT_FEATURE enabled or EXTERNAL_FLASH_DEVICE_BINARY_PAGE disabled.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_SPARE_FEATURE == DISABLED)
+#error "ExternalFlashSpareTest requires EXTERNAL_FLASH_SPARE_FEATURE"
+#endif
+
+//! Writes of the same page
+#define EXTERNAL_FLASH_SPARE_TEST_REWRITES          (5)
+
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+//! Combined writes are in the chip buffer until flushed
+#define EXTERNAL_FLASH_SPARE_TEST_FLUSH(instance_id)    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Flush(instance_id))
+#else
+#define EXTERNAL_FLASH_SPARE_TEST_FLUSH(instance_id)
+#endif
+
+static uint8_t ExternalFlashSpareTest_Data[8 * EXTERNAL_FLASH_MAX_PAGE_SIZE];
+static uint8_t ExternalFlashSpareTest_Read[8 * EXTERNAL_FLASH_MAX_PAGE_SIZE];
+static uint8_t ExternalFlashSpareTest_Page[EXTERNAL_FLASH_MAX_PAGE_SIZE];
+static EXTERNAL_FLASH_SPARE_TYPE ExternalFlashSpareTest_Spare[8];
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    uint8_t* data = ExternalFlashSpareTest_Data;
+    uint8_t* read = ExternalFlashSpareTest_Read;
+    uint8_t* expected = ExternalFlashSpareTest_Page;
+    EXTERNAL_FLASH_SPARE_TYPE* spare = ExternalFlashSpareTest_Spare;
+    EXTERNAL_FLASH_SPARE_TYPE first = {0x1234, 7, 100, 3};
+    DATAFLASH_SIM_CONFIG_TYPE config;
+    EXTERNAL_FLASH_GEOMETRY_TYPE geometry;
+    uint8_t* image;
+    uint32_t extended_page;
+    uint32_t erase_count;
+    uint32_t program_count;
+    uint16_t page;
+    uint8_t instance_id;
+
+    // DataFlash pages, the spare area is the 1/32 extra bytes of each page
+    ExternalFlashTest__GetDefaultConfig(&config);
+    config.Power_Of_Two_Pages = FALSE;
+    instance_id = ExternalFlashTest__Setup(&config, NULL);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+    SYS_ASSERT(ExternalFlash__GetGeometry(instance_id, &geometry) == TRUE);
+    SYS_ASSERT(geometry.Spare_Size >= sizeof(EXTERNAL_FLASH_SPARE_TYPE));
+    page = geometry.Page_Size;
+    extended_page = (uint32_t)page + geometry.Spare_Size;
+    image = malloc(DataFlashSim__GetMemorySize(EXTERNAL_FLASH_TEST_BUS_CHANNEL));
+    SYS_ASSERT(image != NULL);
+    srand(1);
+    for(uint16_t index = 0; index < sizeof(ExternalFlashSpareTest_Data); index++)
+    {
+        data[index] = (uint8_t)rand();
+    }
+
+    // Metadata is written with whole pages only
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__WritePages(instance_id, data, 1, page, &first) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__WritePages(instance_id, data, 0, page - 1, &first) == FALSE);
+
+    // Pages written on erased pages, around erased ones
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__WritePages(instance_id, data, 10 * page, 4 * page, &first));
+    EXTERNAL_FLASH_SPARE_TEST_FLUSH(instance_id);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, 10 * page, 4 * page));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(read, data, 4 * page) == 0);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__ReadSpare(instance_id, spare, 9 * page, 6));
+    EXTERNAL_FLASH_TEST_CHECK((spare[0].Crc == INVALID_VALUE_16) && (spare[0].Erase_Count == INVALID_VALUE_16));
+    EXTERNAL_FLASH_TEST_CHECK((spare[5].Crc == INVALID_VALUE_16) && (spare[5].Erase_Count == INVALID_VALUE_16));
+    for(uint8_t index = 0; index < 4; index++)
+    {
+        EXTERNAL_FLASH_TEST_CHECK(spare[index + 1].Crc == (uint16_t)ExternalFlash__GetCrc(0, &data[index * page], page));
+        EXTERNAL_FLASH_TEST_CHECK(spare[index + 1].Sequence == 7);
+        EXTERNAL_FLASH_TEST_CHECK(spare[index + 1].Logical_Page == (100 + index));
+        EXTERNAL_FLASH_TEST_CHECK(spare[index + 1].Erase_Count == 0);
+        // Same transfer as the data, at the start of the spare area
+        EXTERNAL_FLASH_TEST_CHECK(memcmp(&DataFlashSim__GetMemory(EXTERNAL_FLASH_TEST_BUS_CHANNEL)[((10 + index) * extended_page) + page],
+                                         &spare[index + 1], sizeof(EXTERNAL_FLASH_SPARE_TYPE)) == 0);
+    }
+
+    // Pages written again count one more erase each, the others keep their count
+    first.Sequence = 8;
+    first.Logical_Page = 200;
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__WritePages(instance_id, &data[4 * page], 11 * page, 2 * page, &first));
+    EXTERNAL_FLASH_SPARE_TEST_FLUSH(instance_id);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__ReadSpare(instance_id, spare, 10 * page, 4));
+    EXTERNAL_FLASH_TEST_CHECK((spare[0].Erase_Count == 0) && (spare[0].Sequence == 7));
+    EXTERNAL_FLASH_TEST_CHECK((spare[1].Erase_Count == 1) && (spare[1].Sequence == 8) && (spare[1].Logical_Page == 200));
+    EXTERNAL_FLASH_TEST_CHECK((spare[2].Erase_Count == 1) && (spare[2].Sequence == 8) && (spare[2].Logical_Page == 201));
+    EXTERNAL_FLASH_TEST_CHECK(spare[2].Crc == (uint16_t)ExternalFlash__GetCrc(0, &data[5 * page], page));
+    EXTERNAL_FLASH_TEST_CHECK((spare[3].Erase_Count == 0) && (spare[3].Logical_Page == 103));
+
+    // The count follows the erases of the chip, the first write erased the page too
+    for(uint8_t write = 0; write < EXTERNAL_FLASH_SPARE_TEST_REWRITES; write++)
+    {
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlash__WritePages(instance_id, &data[write * page], 20 * page, page, &first));
+        EXTERNAL_FLASH_SPARE_TEST_FLUSH(instance_id);
+    }
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__ReadSpare(instance_id, spare, 20 * page, 1));
+    DataFlashSim__GetPageWear(EXTERNAL_FLASH_TEST_BUS_CHANNEL, 20, &erase_count, &program_count);
+    EXTERNAL_FLASH_TEST_CHECK(spare[0].Erase_Count == (EXTERNAL_FLASH_SPARE_TEST_REWRITES - 1));
+    EXTERNAL_FLASH_TEST_CHECK(erase_count == EXTERNAL_FLASH_SPARE_TEST_REWRITES);
+
+    // After a reset the count goes on from the flash
+    (void)ExternalFlashTest__Snapshot(image);
+    instance_id = ExternalFlashTest__Setup(&config, image);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__WritePages(instance_id, data, 20 * page, page, &first));
+    EXTERNAL_FLASH_SPARE_TEST_FLUSH(instance_id);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__ReadSpare(instance_id, spare, 20 * page, 1));
+    EXTERNAL_FLASH_TEST_CHECK(spare[0].Erase_Count == EXTERNAL_FLASH_SPARE_TEST_REWRITES);
+    EXTERNAL_FLASH_TEST_CHECK(spare[0].Crc == (uint16_t)ExternalFlash__GetCrc(0, data, page));
+
+    // The count stops before the erased value
+    spare[0].Erase_Count = INVALID_VALUE_16 - 1;
+    memcpy(&DataFlashSim__GetMemory(EXTERNAL_FLASH_TEST_BUS_CHANNEL)[(30 * extended_page) + page], &spare[0], sizeof(EXTERNAL_FLASH_SPARE_TYPE));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__WritePages(instance_id, data, 30 * page, page, &first));
+    EXTERNAL_FLASH_SPARE_TEST_FLUSH(instance_id);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__ReadSpare(instance_id, spare, 30 * page, 1));
+    EXTERNAL_FLASH_TEST_CHECK(spare[0].Erase_Count == (INVALID_VALUE_16 - 1));
+
+    // A partial write merges the page: the metadata keeps its sequence and logical page, counts the erase and matches
+    memcpy(expected, &data[6 * page], page);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__WritePages(instance_id, expected, 40 * page, page, &first));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, data, (40 * page) + 5, 10));
+    memcpy(&expected[5], data, 10);
+    EXTERNAL_FLASH_SPARE_TEST_FLUSH(instance_id);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, 40 * page, page));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(read, expected, page) == 0);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__ReadSpare(instance_id, spare, 40 * page, 1));
+    EXTERNAL_FLASH_TEST_CHECK((spare[0].Sequence == first.Sequence) && (spare[0].Logical_Page == first.Logical_Page));
+    EXTERNAL_FLASH_TEST_CHECK(spare[0].Erase_Count == 1);
+    EXTERNAL_FLASH_TEST_CHECK(spare[0].Crc == (uint16_t)ExternalFlash__GetCrc(0, expected, page));
+
+    // A program of a page with metadata too, its result is the bitwise AND of old and new data
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Program(instance_id, &data[7 * page], (40 * page) + page - 4, 4));
+    for(uint16_t index = 0; index < 4; index++)
+    {
+        expected[page - 4 + index] &= data[(7 * page) + index];
+    }
+    EXTERNAL_FLASH_SPARE_TEST_FLUSH(instance_id);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, 40 * page, page));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(read, expected, page) == 0);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__ReadSpare(instance_id, spare, 40 * page, 1));
+    EXTERNAL_FLASH_TEST_CHECK((spare[0].Erase_Count == 2) && (spare[0].Crc == (uint16_t)ExternalFlash__GetCrc(0, expected, page)));
+
+    // Programs of erased pages leave their metadata erased and their older data is not erased again
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Program(instance_id, data, 41 * page, 10));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Program(instance_id, &data[10], (41 * page) + 10, page));
+    EXTERNAL_FLASH_SPARE_TEST_FLUSH(instance_id);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, read, 41 * page, page + 10));
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(read, data, page + 10) == 0);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__ReadSpare(instance_id, spare, 41 * page, 2));
+    EXTERNAL_FLASH_TEST_CHECK((spare[0].Crc == INVALID_VALUE_16) && (spare[0].Erase_Count == INVALID_VALUE_16));
+    EXTERNAL_FLASH_TEST_CHECK((spare[1].Crc == INVALID_VALUE_16) && (spare[1].Erase_Count == INVALID_VALUE_16));
+    DataFlashSim__GetPageWear(EXTERNAL_FLASH_TEST_BUS_CHANNEL, 41, &erase_count, &program_count);
+    EXTERNAL_FLASH_TEST_CHECK(erase_count == 0);
+
+    // An erase erases the metadata with the page data
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Erase(instance_id, 40 * page, 2 * page));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__ReadSpare(instance_id, spare, 40 * page, 2));
+    EXTERNAL_FLASH_TEST_CHECK((spare[0].Crc == INVALID_VALUE_16) && (spare[0].Erase_Count == INVALID_VALUE_16));
+    EXTERNAL_FLASH_TEST_CHECK((spare[1].Crc == INVALID_VALUE_16) && (spare[1].Erase_Count == INVALID_VALUE_16));
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+
+    free(image);
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashSpareTest");
+}
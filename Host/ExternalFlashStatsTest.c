@@ -0,0 +1,172 @@
+/**
+ *  @file       ExternalFlashStatsTest.c
+ *
+ *  @brief      Host regression test of the per instance statistics of the ExternalFlash driver.
+ *  @details    Writes, reads and erases are counted with their bytes and the page programs and erases they issue,
+ *              which must match the operations seen by the simulated chip. Each completed request lands in one
+ *              latency bucket, not above the bucket of the virtual time it took, a read issued while the chip is still
+ *              programming counts busy polls, and a reset clears everything.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_STATS_FEATURE enabled.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_STATS_FEATURE == DISABLED)
+#error "ExternalFlashStatsTest requires EXTERNAL_FLASH_STATS_FEATURE"
+#endif
+
+//! Bytes of the test write, across three pages of the default part
+#define EXTERNAL_FLASH_STATS_TEST_SIZE              (600)
+//! Page and block size of the default part
+#define EXTERNAL_FLASH_STATS_TEST_PAGE_SIZE         (256)
+#define EXTERNAL_FLASH_STATS_TEST_BLOCK_SIZE        (8 * EXTERNAL_FLASH_STATS_TEST_PAGE_SIZE)
+
+static uint8_t ExternalFlashStatsTest_Data[EXTERNAL_FLASH_STATS_TEST_SIZE];
+static uint8_t ExternalFlashStatsTest_Read[EXTERNAL_FLASH_STATS_TEST_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static uint32_t GetLatencyCount(const uint32_t* latency);
+static uint8_t GetLatencyBucket(const uint32_t* latency);
+static uint8_t GetBucket(uint64_t latency_us);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    EXTERNAL_FLASH_STATS_TYPE stats;
+    uint64_t write_us;
+    uint64_t read_us;
+    uint64_t start_us;
+    uint8_t instance_id;
+
+    instance_id = ExternalFlashTest__Setup(NULL, NULL);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+    memset(ExternalFlashStatsTest_Data, 0x5A, sizeof(ExternalFlashStatsTest_Data));
+
+    // Invalid requests
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__GetStats(EXTERNAL_FLASH_CH_NUM, &stats) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__GetStats(instance_id, NULL) == FALSE);
+
+    // Write across three pages, then read it back
+    start_us = SystemTimersSim__GetUs();
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashStatsTest_Data, 100, EXTERNAL_FLASH_STATS_TEST_SIZE));
+    write_us = SystemTimersSim__GetUs() - start_us;
+    start_us = SystemTimersSim__GetUs();
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashStatsTest_Read, 100, EXTERNAL_FLASH_STATS_TEST_SIZE));
+    read_us = SystemTimersSim__GetUs() - start_us;
+
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__GetStats(instance_id, &stats) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(stats.Writes == 1);
+    EXTERNAL_FLASH_TEST_CHECK(stats.Reads == 1);
+    EXTERNAL_FLASH_TEST_CHECK(stats.Bytes_Written == EXTERNAL_FLASH_STATS_TEST_SIZE);
+    EXTERNAL_FLASH_TEST_CHECK(stats.Bytes_Read == EXTERNAL_FLASH_STATS_TEST_SIZE);
+    EXTERNAL_FLASH_TEST_CHECK(stats.Page_Writes == 3);
+    EXTERNAL_FLASH_TEST_CHECK(stats.Page_Writes == DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Page_Programs);
+    EXTERNAL_FLASH_TEST_CHECK(stats.Page_Erases == DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Page_Erases);
+    EXTERNAL_FLASH_TEST_CHECK((stats.Late_Transfers == 0) && (stats.Retries == 0));
+
+    // One sample per request, in a bucket not above the virtual time the request took
+    EXTERNAL_FLASH_TEST_CHECK(GetLatencyCount(stats.Write_Latency) == 1);
+    EXTERNAL_FLASH_TEST_CHECK(GetLatencyCount(stats.Read_Latency) == 1);
+    EXTERNAL_FLASH_TEST_CHECK(GetLatencyBucket(stats.Write_Latency) <= GetBucket(write_us));
+    EXTERNAL_FLASH_TEST_CHECK(GetLatencyBucket(stats.Read_Latency) <= GetBucket(read_us));
+    EXTERNAL_FLASH_TEST_CHECK(GetLatencyBucket(stats.Write_Latency) > GetLatencyBucket(stats.Read_Latency));
+
+    // A block erase counts its pages
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Erase(instance_id, EXTERNAL_FLASH_STATS_TEST_BLOCK_SIZE, EXTERNAL_FLASH_STATS_TEST_BLOCK_SIZE));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__GetStats(instance_id, &stats) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(stats.Page_Erases == DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Page_Erases);
+
+    // A read right after a write, or its flush with write combining, waits for the program to end
+    ExternalFlash__ResetStats(instance_id);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__GetStats(instance_id, &stats) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK((stats.Writes == 0) && (stats.Page_Writes == 0) && (stats.Busy_Polls == 0));
+    EXTERNAL_FLASH_TEST_CHECK((GetLatencyCount(stats.Write_Latency) == 0) && (GetLatencyCount(stats.Read_Latency) == 0));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashStatsTest_Data, 0, EXTERNAL_FLASH_STATS_TEST_PAGE_SIZE));
+#if (EXTERNAL_FLASH_WRITE_COMBINE_FEATURE == ENABLED)
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Flush(instance_id));
+#endif
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashStatsTest_Read, 4 * EXTERNAL_FLASH_STATS_TEST_PAGE_SIZE, 16));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlash__GetStats(instance_id, &stats) == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK((stats.Writes == 1) && (stats.Reads == 1) && (stats.Bytes_Read == 16));
+    EXTERNAL_FLASH_TEST_CHECK(stats.Busy_Polls > 0);
+    EXTERNAL_FLASH_TEST_CHECK(stats.Busy_Wait_Us > 0);
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashStatsTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Samples of a latency histogram
+ * @param   latency: histogram
+ * @return  samples
+ */
+static uint32_t GetLatencyCount(const uint32_t* latency)
+{
+    uint32_t count = 0;
+
+    for(uint8_t bucket = 0; bucket < EXTERNAL_FLASH_STATS_LATENCY_BUCKETS; bucket++)
+    {
+        count += latency[bucket];
+    }
+    return count;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Highest bucket holding samples in a latency histogram
+ * @param   latency: histogram
+ * @return  bucket, 0 if the histogram is empty
+ */
+static uint8_t GetLatencyBucket(const uint32_t* latency)
+{
+    uint8_t highest = 0;
+
+    for(uint8_t bucket = 0; bucket < EXTERNAL_FLASH_STATS_LATENCY_BUCKETS; bucket++)
+    {
+        if(latency[bucket] != 0)
+        {
+            highest = bucket;
+        }
+    }
+    return highest;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Histogram bucket of a latency, see EXTERNAL_FLASH_STATS_LATENCY_BUCKETS
+ * @param   latency_us: latency
+ * @return  bucket
+ */
+static uint8_t GetBucket(uint64_t latency_us)
+{
+    uint8_t bucket = 0;
+
+    while((latency_us > 0) && (bucket < (EXTERNAL_FLASH_STATS_LATENCY_BUCKETS - 1)))
+    {
+        latency_us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
@@ -0,0 +1,261 @@
+/**
+ *  @file       ExternalFlashTest.c
+ *
+ *  @brief      Host regression test support for the ExternalFlash driver and the modules built on it.
+ *  @details    See ExternalFlashTest.h.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+static DATAFLASH_SIM_CONFIG_TYPE ExternalFlashTest_Config;
+static volatile BOOL_TYPE ExternalFlashTest_Done;
+static COMMON_I_CALLBACK_TYPE ExternalFlashTest_Event;
+static uint64_t ExternalFlashTest_Start_Us;
+static uint32_t ExternalFlashTest_Checks;
+static uint32_t ExternalFlashTest_Failures;
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static BOOL_TYPE IsDone(void* context);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gives the DataFlashSim default part wired to the bus provider of the tested instance
+ * @details Without EXTERNAL_FLASH_DETECT_FEATURE the part has the page size the driver is built for.
+ * @param   config: configuration to fill, to be adjusted by the tests of other parts
+ */
+void ExternalFlashTest__GetDefaultConfig(DATAFLASH_SIM_CONFIG_TYPE* config)
+{
+    DataFlashSim__GetDefaultConfig(config);
+    config->Generic_Comm_Bus_Id = EXTERNAL_FLASH_TEST_BUS_PROVIDER;
+#if (EXTERNAL_FLASH_DETECT_FEATURE == DISABLED) && (EXTERNAL_FLASH_DEVICE_BINARY_PAGE == DISABLED)
+    config->Power_Of_Two_Pages = FALSE;
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Brings up virtual time, a simulated chip and the driver, as after a reset
+ * @details The modules under test are initialized by the caller, after this call.
+ * @param   config: simulated part configuration, NULL for the DataFlashSim default part
+ * @param   image: content of the chip array (DataFlashSim__GetMemory layout) kept from a previous run, NULL for an
+ *          erased chip
+ * @return  External Flash instance of EXTERNAL_FLASH_TEST_CLIENT
+ */
+uint8_t ExternalFlashTest__Setup(const DATAFLASH_SIM_CONFIG_TYPE* config, const uint8_t* image)
+{
+    uint8_t instance_id;
+
+    if(config == NULL)
+    {
+        ExternalFlashTest__GetDefaultConfig(&ExternalFlashTest_Config);
+    }
+    else
+    {
+        memcpy(&ExternalFlashTest_Config, config, sizeof(ExternalFlashTest_Config));
+    }
+
+    SystemTimersSim__Initialize();
+
+    DataFlashSim__Deinitialize();
+    SYS_ASSERT(DataFlashSim__Initialize(EXTERNAL_FLASH_TEST_BUS_CHANNEL, &ExternalFlashTest_Config) == TRUE);
+    if(image != NULL)
+    {
+        memcpy(DataFlashSim__GetMemory(EXTERNAL_FLASH_TEST_BUS_CHANNEL), image, DataFlashSim__GetMemorySize(EXTERNAL_FLASH_TEST_BUS_CHANNEL));
+    }
+
+    ExternalFlash__Initialize();
+    instance_id = ExternalFlash__GetAllocation((uint8_t)EXTERNAL_FLASH_TEST_CLIENT, NULL, 0);
+    SYS_ASSERT(instance_id < EXTERNAL_FLASH_CH_NUM);
+
+    // Let the driver leave its initialization state
+    SystemTimersSim__RunUntil(SystemTimersSim__GetUs() + (2 * EXTERNAL_FLASH_HANDLER_PERIOD_MS * 1000));
+
+    return instance_id;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Copies the chip memory, to restart on it later as after a power loss
+ * @param   image: buffer of DataFlashSim__GetMemorySize bytes
+ * @return  image
+ */
+uint8_t* ExternalFlashTest__Snapshot(uint8_t* image)
+{
+    memcpy(image, DataFlashSim__GetMemory(EXTERNAL_FLASH_TEST_BUS_CHANNEL), DataFlashSim__GetMemorySize(EXTERNAL_FLASH_TEST_BUS_CHANNEL));
+    return image;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Chip memory offset of a device address of the binary page addressing, the chip memory holding the spare
+ *          bytes of each page
+ * @param   address: device address
+ * @return  offset in the chip memory
+ */
+uint32_t ExternalFlashTest__GetMemoryOffset(uint32_t address)
+{
+    uint16_t page_size = ExternalFlashTest_Config.Page_Size;
+
+    return ((address / page_size) * (page_size + (page_size / 32))) + (address % page_size);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Completion handler, registered by the tests with the driver or the module under test
+ * @param   event: COMMON_I_CALLBACK_TYPE notified
+ */
+void ExternalFlashTest__EventHandler(CALLBACK_EVENT_TYPE event)
+{
+    memcpy(&ExternalFlashTest_Event, &event, sizeof(ExternalFlashTest_Event));
+    ExternalFlashTest_Done = TRUE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Marks the start of an operation, see EXTERNAL_FLASH_TEST_RUN
+ */
+void ExternalFlashTest__Start(void)
+{
+    ExternalFlashTest_Done = FALSE;
+    ExternalFlashTest_Start_Us = SystemTimersSim__GetUs();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs a millisecond of virtual time before calling again an operation not accepted
+ * @return  TRUE to call it again, FALSE once EXTERNAL_FLASH_TEST_TIMEOUT_US is over
+ */
+BOOL_TYPE ExternalFlashTest__Retry(void)
+{
+    BOOL_TYPE retry = FALSE;
+
+    if((SystemTimersSim__GetUs() - ExternalFlashTest_Start_Us) < EXTERNAL_FLASH_TEST_TIMEOUT_US)
+    {
+        SystemTimersSim__RunUntil(SystemTimersSim__GetUs() + 1000);
+        // Callbacks of the background work run meanwhile are not the operation completion
+        ExternalFlashTest_Done = FALSE;
+        retry = TRUE;
+    }
+    return retry;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs virtual time until the callback of the operation accepted
+ * @return  TRUE if the callback was received within EXTERNAL_FLASH_TEST_TIMEOUT_US from the start of the operation
+ */
+BOOL_TYPE ExternalFlashTest__Wait(void)
+{
+    uint64_t elapsed_us = SystemTimersSim__GetUs() - ExternalFlashTest_Start_Us;
+    BOOL_TYPE done = FALSE;
+
+    if(elapsed_us < EXTERNAL_FLASH_TEST_TIMEOUT_US)
+    {
+        done = SystemTimersSim__RunUntilCondition(IsDone, NULL, EXTERNAL_FLASH_TEST_TIMEOUT_US - elapsed_us);
+    }
+    return done;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs virtual time, for the background work of the driver and the modules
+ * @param   time_us: virtual time to run
+ */
+void ExternalFlashTest__RunFor(uint32_t time_us)
+{
+    SystemTimersSim__RunUntil(SystemTimersSim__GetUs() + time_us);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs virtual time, a millisecond at a time, while the background work of the driver or a module goes on
+ * @param   busy: condition true while the work goes on
+ * @param   context: argument of the condition
+ * @return  TRUE if the work ended within EXTERNAL_FLASH_TEST_TIMEOUT_US
+ */
+BOOL_TYPE ExternalFlashTest__RunWhile(SYSTEMTIMERSSIM_CONDITION_TYPE busy, void* context)
+{
+    uint64_t end_us = SystemTimersSim__GetUs() + EXTERNAL_FLASH_TEST_TIMEOUT_US;
+
+    while((busy(context) == TRUE) && (SystemTimersSim__GetUs() < end_us))
+    {
+        SystemTimersSim__RunUntil(SystemTimersSim__GetUs() + 1000);
+    }
+    return (busy(context) == TRUE) ? FALSE : TRUE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Event value of the last callback
+ * @return  event value
+ */
+uint16_t ExternalFlashTest__GetEvent(void)
+{
+    return ExternalFlashTest_Event.Event_Value;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Source instance of the last callback
+ * @return  instance id
+ */
+uint8_t ExternalFlashTest__GetSource(void)
+{
+    return ExternalFlashTest_Event.Source_Instance_Id;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Counts a check, printing it if it failed
+ * @param   condition: check result
+ * @param   expression: checked expression
+ * @param   line: source line of the check
+ * @return  condition
+ */
+BOOL_TYPE ExternalFlashTest__Check(BOOL_TYPE condition, const char* expression, int line)
+{
+    ExternalFlashTest_Checks++;
+    if(condition == FALSE)
+    {
+        ExternalFlashTest_Failures++;
+        printf("FAIL line %d: %s\n", line, expression);
+    }
+    return condition;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Prints the test result
+ * @param   name: test name
+ * @return  process exit code, 0 if no check failed
+ */
+int ExternalFlashTest__Report(const char* name)
+{
+    printf("%s: %u checks, %u failed\n", name, ExternalFlashTest_Checks, ExternalFlashTest_Failures);
+    return (ExternalFlashTest_Failures == 0) ? 0 : 1;
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+static BOOL_TYPE IsDone(void* context)
+{
+    (void)context;
+    return ExternalFlashTest_Done;
+}
@@ -0,0 +1,85 @@
+/**
+ *  @file       ExternalFlashTest.h
+ *
+ *  @brief      Host regression test support for the ExternalFlash driver and the modules built on it.
+ *  @details    Brings up virtual time, a simulated DataFlash and the driver, runs virtual time until the callback of
+ *              an operation and counts the failed checks. Each Host/ExternalFlash*Test.c is a program of its own, built
+ *              with the features it tests enabled, that returns 0 when all its checks passed.
+ *
+ *              Host builds link a test with this file, the driver and the modules under test, Host/DataFlashSim.c,
+ *              Host/SystemTimersSim.c and the host framework, whose EXTERNAL_FLASH_MAP binds EXTERNAL_FLASH_TEST_CLIENT
+ *              to the simulated bus and whose EXTERNAL_FLASH_TIMESTAMP_US() reads SystemTimersSim__GetUs, e.g.:
+ *
+ *                  cc -D<feature>=ENABLED -I. -IHost -I<framework> -o <test> Host/ExternalFlash<Name>Test.c
+ *                     Host/ExternalFlashTest.c ExternalFlashBackup.c Host/DataFlashSim.c Host/SystemTimersSim.c
+ *                     <framework sources>
+ *
+ *              The build line of each test lists its features and sources.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+#ifndef EXTERNALFLASHTEST_H_
+#define EXTERNALFLASHTEST_H_
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlash.h"
+
+#include "DataFlashSim.h"
+#include "SystemTimersSim.h"
+
+#include <stdio.h>
+
+//-------------------------------------- PUBLIC (Variables, Constants & Defines) --------------------------------------
+
+//! Map entry of the tested instance: client channel, bus provider id and provider bound id
+#ifndef EXTERNAL_FLASH_TEST_CLIENT
+#define EXTERNAL_FLASH_TEST_CLIENT              ((EXTERNAL_FLASH_CH_TYPE)0)
+#endif
+#ifndef EXTERNAL_FLASH_TEST_BUS_PROVIDER
+#define EXTERNAL_FLASH_TEST_BUS_PROVIDER        (0)
+#endif
+#ifndef EXTERNAL_FLASH_TEST_BUS_CHANNEL
+#define EXTERNAL_FLASH_TEST_BUS_CHANNEL         (0)
+#endif
+
+//! Virtual time allowed to a single operation, retries of a busy target included
+#define EXTERNAL_FLASH_TEST_TIMEOUT_US          (20ULL * 1000000ULL)
+
+//! Chip memory of the default part, its pages with their spare bytes, for the images kept by the tests
+#define EXTERNAL_FLASH_TEST_IMAGE_SIZE          (1024UL * 264)
+
+//! Records a failed check with its expression and line, evaluates to the condition
+#define EXTERNAL_FLASH_TEST_CHECK(condition)    ExternalFlashTest__Check(((condition) ? TRUE : FALSE), #condition, __LINE__)
+
+//! Starts an asynchronous operation, calling it again every millisecond while its target is busy, and runs virtual
+//! time until its callback; a call never accepted or a callback not received within EXTERNAL_FLASH_TEST_TIMEOUT_US is
+//! a failed check
+#define EXTERNAL_FLASH_TEST_RUN(call)                                                               \
+do                                                                                                  \
+{                                                                                                   \
+    ExternalFlashTest__Start();                                                                     \
+    while(((call) == FALSE) && (ExternalFlashTest__Retry() == TRUE))                                \
+    {                                                                                               \
+    }                                                                                               \
+    (void)ExternalFlashTest__Check(ExternalFlashTest__Wait(), #call, __LINE__);                     \
+} while(0)
+
+//-------------------------------------- PUBLIC (Function Prototypes) -------------------------------------------------
+
+void ExternalFlashTest__GetDefaultConfig(DATAFLASH_SIM_CONFIG_TYPE* config);
+uint8_t ExternalFlashTest__Setup(const DATAFLASH_SIM_CONFIG_TYPE* config, const uint8_t* image);
+uint8_t* ExternalFlashTest__Snapshot(uint8_t* image);
+uint32_t ExternalFlashTest__GetMemoryOffset(uint32_t address);
+void ExternalFlashTest__EventHandler(CALLBACK_EVENT_TYPE event);
+void ExternalFlashTest__Start(void);
+BOOL_TYPE ExternalFlashTest__Retry(void);
+BOOL_TYPE ExternalFlashTest__Wait(void);
+void ExternalFlashTest__RunFor(uint32_t time_us);
+BOOL_TYPE ExternalFlashTest__RunWhile(SYSTEMTIMERSSIM_CONDITION_TYPE busy, void* context);
+uint16_t ExternalFlashTest__GetEvent(void);
+uint8_t ExternalFlashTest__GetSource(void);
+BOOL_TYPE ExternalFlashTest__Check(BOOL_TYPE condition, const char* expression, int line);
+int ExternalFlashTest__Report(const char* name);
+
+#endif /* EXTERNALFLASHTEST_H_ */
@@ -0,0 +1,536 @@
+/**
+ *  @file       ExternalFlashTraceDecode.c
+ *
+ *  @brief      Decodes a dump of the ExternalFlash trace block into a timeline.
+ *  @details    The input is the raw memory of the block returned by ExternalFlash__GetTrace (built with
+ *              EXTERNAL_FLASH_TRACE_FEATURE enabled) of a little endian target, e.g. from the debugger:
+ *                  dump binary memory trace.bin &ExternalFlash_Trace (&ExternalFlash_Trace + 1)
+ *
+ *              The task and bus rings are merged on their timestamps and printed one entry per line. Then, per
+ *              instance, the time between entries is attributed to:
+ *              - bus: a bus transfer was requested and its completion event not received yet
+ *              - sched: the bus event (or a request) is pending and the handler task has not run yet
+ *              - busy: the chip was found busy (or the bus could not be started) and the handler waits to poll again
+ *              Time in IDLE is not attributed.
+ *
+ *              Usage: ExternalFlashTraceDecode trace.bin [-s]     (-s: attribution summary only)
+ *
+ *              With -c the input is a capture stream instead (EXTERNAL_FLASH_CAPTURE_FEATURE, see ExternalFlashReplay),
+ *              printed one record per line:
+ *
+ *              Usage: ExternalFlashTraceDecode -c capture.bin
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlash.h"
+#include "CommonInterface.h"
+#include "Utilities.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Dump layout, little endian and without padding
+#define TRACE_DECODE_HEADER_SIZE            (8)
+#define TRACE_DECODE_RING_HEAD_SIZE         (4)
+#define TRACE_DECODE_ENTRY_SIZE             (12)
+
+//! Instances tracked by the attribution, instance ids above are only printed
+#define TRACE_DECODE_INSTANCE_NUM           (16)
+
+//! State names, in the order of EXTERNAL_FLASH_STATE_TYPE (ExternalFlashBackup.c)
+static const char* const TraceDecode_State_Name[] =
+{
+    "INITIALIZE",
+    "IDLE",
+    "SEND_READ_HEADER",
+    "WAIT_SEND_READ_HEADER",
+    "READ",
+    "SEND_WRITE_HEADER",
+    "WAIT_SEND_WRITE_HEADER",
+    "WRITE",
+    "SEND_STATUS_BEFORE_READ",
+    "READ_STATUS_BEFORE_READ",
+    "SEND_STATUS_BEFORE_WRITE",
+    "READ_STATUS_BEFORE_WRITE",
+    "COMMIT_BUFFER_BEFORE_READ",
+    "COMMIT_BUFFER_BEFORE_WRITE",
+    "LOAD_BUFFER",
+    "ERASE",
+    "DETECT_ID",
+    "DETECT_PAGE_SIZE",
+    "WRITE_SPARE",
+};
+
+#define TRACE_DECODE_STATE_INITIALIZE               (0)
+#define TRACE_DECODE_STATE_IDLE                     (1)
+#define TRACE_DECODE_STATE_SEND_STATUS_BEFORE_READ  (8)
+#define TRACE_DECODE_STATE_SEND_STATUS_BEFORE_WRITE (10)
+
+//! Capture record names, in the order of EXTERNAL_FLASH_CAPTURE_RECORD_TYPE
+static const char* const TraceDecode_Record_Name[EXTERNAL_FLASH_CAPTURE_RECORD_NUM] =
+{
+    "ALLOCATION",
+    "READ",
+    "WRITE",
+    "COMPLETE",
+    "FLUSH",
+    "PROGRAM",
+    "ERASE",
+    "WRITE_PAGES",
+    "READ_SPARE",
+    "SCAN_ERASED",
+};
+
+//! Time attribution phases
+typedef enum TRACE_DECODE_PHASE_ENUM
+{
+    TRACE_DECODE_PHASE_IDLE,
+    TRACE_DECODE_PHASE_BUS,
+    TRACE_DECODE_PHASE_SCHED,
+    TRACE_DECODE_PHASE_BUSY,
+    TRACE_DECODE_PHASE_NUM
+} TRACE_DECODE_PHASE_TYPE;
+
+//! Decoded entry
+typedef struct TRACE_DECODE_ENTRY_STRUCT
+{
+    EXTERNAL_FLASH_TRACE_ENTRY_TYPE Entry;
+    uint8_t                     Context;
+    uint32_t                    Sequence;                   // Position in its ring, oldest first
+    uint32_t                    Age_Us;                     // Time before the newest entry of the dump
+} TRACE_DECODE_ENTRY_TYPE;
+
+//! Per instance attribution
+typedef struct TRACE_DECODE_INSTANCE_STRUCT
+{
+    BOOL_TYPE                   Seen;
+    TRACE_DECODE_PHASE_TYPE     Phase;
+    uint32_t                    Phase_Start_Age_Us;
+    uint64_t                    Phase_Us[TRACE_DECODE_PHASE_NUM];
+    uint32_t                    Requests;                   // Transitions out of IDLE
+} TRACE_DECODE_INSTANCE_TYPE;
+
+static TRACE_DECODE_INSTANCE_TYPE TraceDecode_Instance[TRACE_DECODE_INSTANCE_NUM];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static uint32_t GetU32(const uint8_t* data);
+static uint16_t GetU16(const uint8_t* data);
+static const char* StateName(uint8_t state, char* text);
+static const char* ProcessName(uint8_t process);
+static TRACE_DECODE_PHASE_TYPE GetPhase(const EXTERNAL_FLASH_TRACE_ENTRY_TYPE* entry);
+static int CompareEntry(const void* a, const void* b);
+static int DecodeCapture(const char* file_name);
+static BOOL_TYPE DecodeVarint(const uint8_t* data, uint32_t size, uint32_t* offset, uint32_t* value);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(int argc, char* argv[])
+{
+    FILE* file;
+    uint8_t* dump;
+    long dump_size;
+    uint16_t size;
+    uint16_t ring_num;
+    TRACE_DECODE_ENTRY_TYPE* entries;
+    uint32_t entry_num = 0;
+    uint32_t newest_us = 0;
+    BOOL_TYPE summary_only = ((argc > 2) && (strcmp(argv[2], "-s") == 0)) ? TRUE : FALSE;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "Usage: %s trace.bin [-s] | -c capture.bin\n", argv[0]);
+        return 1;
+    }
+    if(strcmp(argv[1], "-c") == 0)
+    {
+        return (argc > 2) ? DecodeCapture(argv[2]) : 1;
+    }
+
+    file = fopen(argv[1], "rb");
+    if(file == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    dump_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    dump = malloc((size_t)MAX(dump_size, 1));
+    if((dump == NULL) || (fread(dump, 1, (size_t)dump_size, file) != (size_t)dump_size))
+    {
+        fprintf(stderr, "%s: read error\n", argv[1]);
+        return 1;
+    }
+    fclose(file);
+
+    // Validate header
+    if((dump_size < TRACE_DECODE_HEADER_SIZE) || (GetU32(dump) != EXTERNAL_FLASH_TRACE_MAGIC))
+    {
+        fprintf(stderr, "%s: not an ExternalFlash trace dump\n", argv[1]);
+        return 1;
+    }
+    size = GetU16(&dump[4]);
+    ring_num = GetU16(&dump[6]);
+    if((size == 0) || ((size & (size - 1)) != 0) ||
+       (dump_size < (long)(TRACE_DECODE_HEADER_SIZE + ((uint32_t)ring_num * (TRACE_DECODE_RING_HEAD_SIZE + ((uint32_t)size * TRACE_DECODE_ENTRY_SIZE))))))
+    {
+        fprintf(stderr, "%s: truncated or corrupted dump (size %u, rings %u)\n", argv[1], size, ring_num);
+        return 1;
+    }
+
+    // Collect valid entries of all rings
+    entries = malloc(sizeof(TRACE_DECODE_ENTRY_TYPE) * (size_t)size * ring_num);
+    SYS_ASSERT(entries != NULL);
+    for(uint16_t ring = 0; ring < ring_num; ring++)
+    {
+        const uint8_t* ring_data = &dump[TRACE_DECODE_HEADER_SIZE + (ring * (TRACE_DECODE_RING_HEAD_SIZE + (size * TRACE_DECODE_ENTRY_SIZE)))];
+        uint32_t head = GetU32(ring_data);
+        uint32_t count = MIN(head, size);
+
+        for(uint32_t sequence = 0; sequence < count; sequence++)
+        {
+            const uint8_t* data = &ring_data[TRACE_DECODE_RING_HEAD_SIZE + (((head - count + sequence) & (size - 1)) * TRACE_DECODE_ENTRY_SIZE)];
+            TRACE_DECODE_ENTRY_TYPE* entry = &entries[entry_num++];
+
+            entry->Entry.Timestamp_Us = GetU32(&data[0]);
+            entry->Entry.Event = data[4];
+            entry->Entry.Instance = data[5];
+            entry->Entry.Old_State = data[6];
+            entry->Entry.New_State = data[7];
+            entry->Entry.Process = data[8];
+            entry->Entry.Progress = GetU16(&data[10]);
+            entry->Context = (uint8_t)ring;
+            entry->Sequence = sequence;
+        }
+
+        // The last entry of each ring is a candidate for the newest one
+        if(count > 0)
+        {
+            uint32_t last_us = entries[entry_num - 1].Entry.Timestamp_Us;
+            if((entry_num == count) || ((int32_t)(last_us - newest_us) > 0))
+            {
+                newest_us = last_us;
+            }
+        }
+    }
+
+    // Order on age, robust to the 32 bit timestamp wrap as long as the dump spans less than ~71 minutes
+    for(uint32_t index = 0; index < entry_num; index++)
+    {
+        entries[index].Age_Us = newest_us - entries[index].Entry.Timestamp_Us;
+    }
+    qsort(entries, entry_num, sizeof(TRACE_DECODE_ENTRY_TYPE), CompareEntry);
+
+    if(summary_only == FALSE)
+    {
+        printf("%12s %9s %-4s %4s %-5s %-26s    %-26s %-10s %8s\n",
+               "time_us", "delta_us", "ctx", "inst", "event", "old_state", "new_state", "process", "progress");
+    }
+
+    for(uint32_t index = 0; index < entry_num; index++)
+    {
+        const EXTERNAL_FLASH_TRACE_ENTRY_TYPE* entry = &entries[index].Entry;
+        uint32_t time_us = entries[0].Age_Us - entries[index].Age_Us;
+        uint32_t delta_us = (index == 0) ? 0 : (entries[index - 1].Age_Us - entries[index].Age_Us);
+        char old_text[16];
+        char new_text[16];
+
+        if(summary_only == FALSE)
+        {
+            printf("%12u %9u %-4s %4u %-5s %-26s -> %-26s %-10s %8u\n",
+                   time_us, delta_us,
+                   (entries[index].Context == EXTERNAL_FLASH_TRACE_CONTEXT_BUS) ? "bus" : "task",
+                   entry->Instance,
+                   (entry->Event == EXTERNAL_FLASH_TRACE_EVENT_BUS) ? "event" : "state",
+                   StateName(entry->Old_State, old_text), StateName(entry->New_State, new_text),
+                   ProcessName(entry->Process), entry->Progress);
+        }
+
+        if(entry->Instance < TRACE_DECODE_INSTANCE_NUM)
+        {
+            TRACE_DECODE_INSTANCE_TYPE* instance = &TraceDecode_Instance[entry->Instance];
+
+            // Close the running phase and open the one entered by this entry
+            if(instance->Seen == TRUE)
+            {
+                instance->Phase_Us[instance->Phase] += instance->Phase_Start_Age_Us - entries[index].Age_Us;
+            }
+            if((entry->Event == EXTERNAL_FLASH_TRACE_EVENT_STATE) &&
+               ((entry->Old_State == TRACE_DECODE_STATE_IDLE) && (entry->New_State != TRACE_DECODE_STATE_IDLE)))
+            {
+                instance->Requests++;
+            }
+            instance->Seen = TRUE;
+            instance->Phase = GetPhase(entry);
+            instance->Phase_Start_Age_Us = entries[index].Age_Us;
+        }
+    }
+
+    printf("\n%4s %8s %12s %12s %12s\n", "inst", "requests", "bus_us", "sched_us", "busy_us");
+    for(uint8_t instance_id = 0; instance_id < TRACE_DECODE_INSTANCE_NUM; instance_id++)
+    {
+        if(TraceDecode_Instance[instance_id].Seen == TRUE)
+        {
+            printf("%4u %8u %12llu %12llu %12llu\n", instance_id, TraceDecode_Instance[instance_id].Requests,
+                   (unsigned long long)TraceDecode_Instance[instance_id].Phase_Us[TRACE_DECODE_PHASE_BUS],
+                   (unsigned long long)TraceDecode_Instance[instance_id].Phase_Us[TRACE_DECODE_PHASE_SCHED],
+                   (unsigned long long)TraceDecode_Instance[instance_id].Phase_Us[TRACE_DECODE_PHASE_BUSY]);
+        }
+    }
+
+    free(entries);
+    free(dump);
+    return 0;
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+static uint32_t GetU32(const uint8_t* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint16_t GetU16(const uint8_t* data)
+{
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+static const char* StateName(uint8_t state, char* text)
+{
+    const char* name = text;
+
+    if(state < ELEMENTS_IN_ARRAY(TraceDecode_State_Name))
+    {
+        name = TraceDecode_State_Name[state];
+    }
+    else
+    {
+        sprintf(text, "STATE_%u", state);
+    }
+    return name;
+}
+
+static const char* ProcessName(uint8_t process)
+{
+    const char* name;
+
+    switch(process)
+    {
+      case NVDATA_PROCESS_NONE:
+        name = "none";
+        break;
+      case NVDATA_PROCESS_WRITE:
+        name = "write";
+        break;
+      case NVDATA_PROCESS_WAIT_WRITE:
+        name = "wait_write";
+        break;
+      case NVDATA_PROCESS_READ:
+        name = "read";
+        break;
+      case NVDATA_PROCESS_WAIT_READ:
+        name = "wait_read";
+        break;
+      case EXTERNAL_FLASH_PROCESS_SCAN_COMPLETE:
+        name = "scan_complete";
+        break;
+      default:
+        name = "?";
+        break;
+    }
+    return name;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Phase an instance enters with a trace entry
+ * @param   entry: trace entry
+ * @return  phase lasting until the next entry of the same instance
+ */
+static TRACE_DECODE_PHASE_TYPE GetPhase(const EXTERNAL_FLASH_TRACE_ENTRY_TYPE* entry)
+{
+    TRACE_DECODE_PHASE_TYPE phase;
+
+    if(entry->Event == EXTERNAL_FLASH_TRACE_EVENT_BUS)
+    {
+        // Completion flagged, the handler has to run
+        phase = TRACE_DECODE_PHASE_SCHED;
+    }
+    else if((entry->New_State == TRACE_DECODE_STATE_IDLE) || (entry->New_State == TRACE_DECODE_STATE_INITIALIZE))
+    {
+        phase = TRACE_DECODE_PHASE_IDLE;
+    }
+    else if((entry->Process == NVDATA_PROCESS_WAIT_READ) || (entry->Process == NVDATA_PROCESS_WAIT_WRITE))
+    {
+        phase = TRACE_DECODE_PHASE_BUS;
+    }
+    else if((entry->Process == NVDATA_PROCESS_NONE) &&
+            ((entry->New_State == TRACE_DECODE_STATE_SEND_STATUS_BEFORE_READ) || (entry->New_State == TRACE_DECODE_STATE_SEND_STATUS_BEFORE_WRITE)))
+    {
+        // Status polled again on next handler period
+        phase = TRACE_DECODE_PHASE_BUSY;
+    }
+    else
+    {
+        phase = TRACE_DECODE_PHASE_SCHED;
+    }
+    return phase;
+}
+
+//! Oldest first, on ties bus events first since they complete transfers requested before
+static int CompareEntry(const void* a, const void* b)
+{
+    const TRACE_DECODE_ENTRY_TYPE* entry_a = (const TRACE_DECODE_ENTRY_TYPE*)a;
+    const TRACE_DECODE_ENTRY_TYPE* entry_b = (const TRACE_DECODE_ENTRY_TYPE*)b;
+    int result;
+
+    if(entry_a->Age_Us != entry_b->Age_Us)
+    {
+        result = (entry_a->Age_Us > entry_b->Age_Us) ? -1 : 1;
+    }
+    else if(entry_a->Context != entry_b->Context)
+    {
+        result = (entry_a->Context == EXTERNAL_FLASH_TRACE_CONTEXT_BUS) ? -1 : 1;
+    }
+    else
+    {
+        result = (entry_a->Sequence < entry_b->Sequence) ? -1 : 1;
+    }
+    return result;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Prints the records of a capture stream, see EXTERNAL_FLASH_CAPTURE_RECORD_TYPE
+ * @param   file_name: capture stream file
+ * @return  process exit code, 0 if the whole stream was decoded
+ */
+static int DecodeCapture(const char* file_name)
+{
+    FILE* file;
+    uint8_t* capture;
+    long capture_size;
+    uint32_t offset = 5;
+    uint64_t time_us = 0;
+    BOOL_TYPE valid = TRUE;
+
+    file = fopen(file_name, "rb");
+    if(file == NULL)
+    {
+        perror(file_name);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    capture_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    capture = malloc((size_t)MAX(capture_size, 1));
+    if((capture == NULL) || (fread(capture, 1, (size_t)capture_size, file) != (size_t)capture_size))
+    {
+        fprintf(stderr, "%s: read error\n", file_name);
+        return 1;
+    }
+    fclose(file);
+
+    if((capture_size < 5) || (GetU32(capture) != EXTERNAL_FLASH_CAPTURE_MAGIC) || (capture[4] != EXTERNAL_FLASH_CAPTURE_VERSION))
+    {
+        fprintf(stderr, "%s: not an ExternalFlash capture (or unsupported version)\n", file_name);
+        return 1;
+    }
+
+    printf("%12s %-11s %4s %10s %8s %s\n", "time_us", "record", "inst", "address", "size", "result");
+    while((valid == TRUE) && (offset < (uint32_t)capture_size))
+    {
+        uint8_t type = capture[offset++];
+        uint32_t delta_us = 0;
+        uint32_t value_1 = 0;
+        uint32_t value_2 = 0;
+
+        valid = DecodeVarint(capture, (uint32_t)capture_size, &offset, &delta_us);
+        valid &= (offset < (uint32_t)capture_size) ? TRUE : FALSE;
+        if((valid == FALSE) || (type >= EXTERNAL_FLASH_CAPTURE_RECORD_NUM))
+        {
+            valid = FALSE;
+            break;
+        }
+        time_us += delta_us;
+        printf("%12llu %-11s %4u ", (unsigned long long)time_us, TraceDecode_Record_Name[type], capture[offset++]);
+
+        switch(type)
+        {
+          case EXTERNAL_FLASH_CAPTURE_RECORD_ALLOCATION:
+            // Client id printed as instance: mirror used, instance offset, allocated instance
+            valid = ((offset + 1) < (uint32_t)capture_size) ? TRUE : FALSE;
+            if(valid == TRUE)
+            {
+                uint8_t mirror = capture[offset++];
+
+                valid = DecodeVarint(capture, (uint32_t)capture_size, &offset, &value_1);
+                valid &= (offset < (uint32_t)capture_size) ? TRUE : FALSE;
+                if(valid == TRUE)
+                {
+                    printf("%10u %8s instance %u%s\n", value_1, "", capture[offset++], (mirror == TRUE) ? ", mirror" : "");
+                }
+            }
+            break;
+
+          case EXTERNAL_FLASH_CAPTURE_RECORD_COMPLETE:
+            valid = DecodeVarint(capture, (uint32_t)capture_size, &offset, &value_1);
+            if(valid == TRUE)
+            {
+                printf("%10s %8u %s\n", "", value_1 & 0xFF, ProcessName((uint8_t)(value_1 >> 8)));
+            }
+            break;
+
+          default:
+            // Read, write and page requests; the size of the page metadata reads and blank checks is in pages
+            valid = DecodeVarint(capture, (uint32_t)capture_size, &offset, &value_1);
+            valid &= DecodeVarint(capture, (uint32_t)capture_size, &offset, &value_2);
+            valid &= (offset < (uint32_t)capture_size) ? TRUE : FALSE;
+            if(valid == TRUE)
+            {
+                printf("%10u %8u %s\n", value_1, value_2, (capture[offset++] == TRUE) ? "accepted" : "rejected");
+            }
+            break;
+        }
+    }
+
+    if(valid == FALSE)
+    {
+        printf("\n%s: corrupted record at offset %u\n", file_name, offset);
+    }
+
+    free(capture);
+    return (valid == TRUE) ? 0 : 1;
+}
+
+static BOOL_TYPE DecodeVarint(const uint8_t* data, uint32_t size, uint32_t* offset, uint32_t* value)
+{
+    BOOL_TYPE valid = FALSE;
+
+    *value = 0;
+    for(uint8_t shift = 0; (shift < 35) && (*offset < size); shift += 7)
+    {
+        uint8_t byte = data[(*offset)++];
+
+        *value |= (uint32_t)(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0)
+        {
+            valid = TRUE;
+            break;
+        }
+    }
+    return valid;
+}
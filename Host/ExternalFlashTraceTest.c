@@ -0,0 +1,175 @@
+/**
+ *  @file       ExternalFlashTraceTest.c
+ *
+ *  @brief      Host regression test of the state transition trace of the ExternalFlash driver.
+ *  @details    The trace block must carry its layout, each request must leave in the task ring a chain of state changes
+ *              from idle back to idle and in the bus ring the bus events it waited for, all in time order within the
+ *              request. Once the rings wrap, the entries read from the oldest one on must still form one chain.
+ *
+ *              Build: see ExternalFlashTest.h, with EXTERNAL_FLASH_TRACE_FEATURE enabled.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include <string.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+#if (EXTERNAL_FLASH_TRACE_FEATURE == DISABLED)
+#error "ExternalFlashTraceTest requires EXTERNAL_FLASH_TRACE_FEATURE"
+#endif
+
+//! Bytes of the test write, across two pages of the default part
+#define EXTERNAL_FLASH_TRACE_TEST_SIZE              (300)
+
+static uint8_t ExternalFlashTraceTest_Data[EXTERNAL_FLASH_TRACE_TEST_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static const EXTERNAL_FLASH_TRACE_ENTRY_TYPE* GetEntry(EXTERNAL_FLASH_TRACE_CONTEXT_TYPE context, uint32_t index);
+static void CheckRequest(uint8_t instance_id, uint8_t idle, uint32_t task_head, uint32_t bus_head, uint64_t start_us);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    const EXTERNAL_FLASH_TRACE_TYPE* trace = ExternalFlash__GetTrace();
+    const EXTERNAL_FLASH_TRACE_RING_TYPE* task = &trace->Ring[EXTERNAL_FLASH_TRACE_CONTEXT_TASK];
+    const EXTERNAL_FLASH_TRACE_RING_TYPE* bus = &trace->Ring[EXTERNAL_FLASH_TRACE_CONTEXT_BUS];
+    uint32_t task_head;
+    uint32_t bus_head;
+    uint64_t start_us;
+    uint8_t instance_id;
+    uint8_t idle;
+    BOOL_TYPE chained = TRUE;
+
+    instance_id = ExternalFlashTest__Setup(NULL, NULL);
+    ExternalFlash__RegisterEventHandler(ExternalFlashTest__EventHandler, instance_id, CALLBACK_FILTER_VALUE_NONE);
+    memset(ExternalFlashTraceTest_Data, 0xA5, sizeof(ExternalFlashTraceTest_Data));
+
+    // Layout of the dump
+    EXTERNAL_FLASH_TEST_CHECK(trace != NULL);
+    EXTERNAL_FLASH_TEST_CHECK(trace->Magic == EXTERNAL_FLASH_TRACE_MAGIC);
+    EXTERNAL_FLASH_TEST_CHECK(trace->Size == EXTERNAL_FLASH_TRACE_SIZE);
+    EXTERNAL_FLASH_TEST_CHECK(trace->Ring_Num == EXTERNAL_FLASH_TRACE_CONTEXT_NUM);
+
+    // The initialization ends in the idle state
+    SYS_ASSERT(task->Head > 0);
+    idle = GetEntry(EXTERNAL_FLASH_TRACE_CONTEXT_TASK, task->Head - 1)->New_State;
+
+    // Write, then read
+    task_head = task->Head;
+    bus_head = bus->Head;
+    start_us = SystemTimersSim__GetUs();
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Write(instance_id, ExternalFlashTraceTest_Data, 100, EXTERNAL_FLASH_TRACE_TEST_SIZE));
+    CheckRequest(instance_id, idle, task_head, bus_head, start_us);
+
+    task_head = task->Head;
+    bus_head = bus->Head;
+    start_us = SystemTimersSim__GetUs();
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashTraceTest_Data, 100, EXTERNAL_FLASH_TRACE_TEST_SIZE));
+    CheckRequest(instance_id, idle, task_head, bus_head, start_us);
+
+    // Wrapped rings, read from the oldest entry
+    while(task->Head < (3 * EXTERNAL_FLASH_TRACE_SIZE))
+    {
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlash__Read(instance_id, ExternalFlashTraceTest_Data, 0, 16));
+    }
+    for(uint32_t index = task->Head - EXTERNAL_FLASH_TRACE_SIZE + 1; index < task->Head; index++)
+    {
+        if((GetEntry(EXTERNAL_FLASH_TRACE_CONTEXT_TASK, index)->Old_State != GetEntry(EXTERNAL_FLASH_TRACE_CONTEXT_TASK, index - 1)->New_State) ||
+           (GetEntry(EXTERNAL_FLASH_TRACE_CONTEXT_TASK, index)->Timestamp_Us < GetEntry(EXTERNAL_FLASH_TRACE_CONTEXT_TASK, index - 1)->Timestamp_Us))
+        {
+            chained = FALSE;
+        }
+    }
+    EXTERNAL_FLASH_TEST_CHECK(chained == TRUE);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashTraceTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Entry of a ring
+ * @param   context: ring
+ * @param   index: entry, counted from the first one ever written
+ * @return  entry
+ */
+static const EXTERNAL_FLASH_TRACE_ENTRY_TYPE* GetEntry(EXTERNAL_FLASH_TRACE_CONTEXT_TYPE context, uint32_t index)
+{
+    return &ExternalFlash__GetTrace()->Ring[context].Entry[index % EXTERNAL_FLASH_TRACE_SIZE];
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Checks the entries traced by a completed request
+ * @param   instance_id: External Flash instance of the request
+ * @param   idle: idle state
+ * @param   task_head: task ring head before the request
+ * @param   bus_head: bus ring head before the request
+ * @param   start_us: virtual time of the request
+ */
+static void CheckRequest(uint8_t instance_id, uint8_t idle, uint32_t task_head, uint32_t bus_head, uint64_t start_us)
+{
+    const EXTERNAL_FLASH_TRACE_TYPE* trace = ExternalFlash__GetTrace();
+    uint32_t task_end = trace->Ring[EXTERNAL_FLASH_TRACE_CONTEXT_TASK].Head;
+    uint32_t bus_end = trace->Ring[EXTERNAL_FLASH_TRACE_CONTEXT_BUS].Head;
+    uint32_t timestamp_us = (uint32_t)start_us;
+    uint8_t state = idle;
+    BOOL_TYPE valid = TRUE;
+
+    // All the request entries are still in the rings
+    if((EXTERNAL_FLASH_TEST_CHECK((task_end - task_head) <= EXTERNAL_FLASH_TRACE_SIZE) == FALSE) ||
+       (EXTERNAL_FLASH_TEST_CHECK((bus_end - bus_head) <= EXTERNAL_FLASH_TRACE_SIZE) == FALSE))
+    {
+        return;
+    }
+    EXTERNAL_FLASH_TEST_CHECK(task_end > task_head);
+    EXTERNAL_FLASH_TEST_CHECK(bus_end > bus_head);
+
+    // State changes from idle back to idle
+    for(uint32_t index = task_head; index < task_end; index++)
+    {
+        const EXTERNAL_FLASH_TRACE_ENTRY_TYPE* entry = GetEntry(EXTERNAL_FLASH_TRACE_CONTEXT_TASK, index);
+
+        if((entry->Event != EXTERNAL_FLASH_TRACE_EVENT_STATE) || (entry->Instance != instance_id) ||
+           (entry->Old_State != state) || (entry->Timestamp_Us < timestamp_us))
+        {
+            valid = FALSE;
+        }
+        state = entry->New_State;
+        timestamp_us = entry->Timestamp_Us;
+    }
+    EXTERNAL_FLASH_TEST_CHECK(valid == TRUE);
+    EXTERNAL_FLASH_TEST_CHECK(state == idle);
+
+    // Bus events, the state is unchanged
+    timestamp_us = (uint32_t)start_us;
+    for(uint32_t index = bus_head; index < bus_end; index++)
+    {
+        const EXTERNAL_FLASH_TRACE_ENTRY_TYPE* entry = GetEntry(EXTERNAL_FLASH_TRACE_CONTEXT_BUS, index);
+
+        if((entry->Event != EXTERNAL_FLASH_TRACE_EVENT_BUS) || (entry->Instance != instance_id) ||
+           (entry->Old_State != entry->New_State) || (entry->Old_State == idle) ||
+           (entry->Timestamp_Us < timestamp_us) || (entry->Timestamp_Us > (uint32_t)SystemTimersSim__GetUs()) ||
+           (entry->Progress > EXTERNAL_FLASH_TRACE_TEST_SIZE))
+        {
+            valid = FALSE;
+        }
+        timestamp_us = entry->Timestamp_Us;
+    }
+    EXTERNAL_FLASH_TEST_CHECK(valid == TRUE);
+}
@@ -0,0 +1,281 @@
+/**
+ *  @file       ExternalFlashWearTest.c
+ *
+ *  @brief      Host regression test of the ExternalFlashWear module.
+ *  @details    Rewrites of the same volume bytes must spread their erases over the free pages of the pool instead of
+ *              wearing one page, and random writes across logical pages must read back against a model of the volume,
+ *              also after a mount from RAM or after a restart on the same chip memory. Power losses are simulated by
+ *              restarting on a copy of the chip memory at many points of a write across logical pages: each logical
+ *              page gives either all its old or all its new bytes. The test includes the module source to reach its
+ *              map.
+ *
+ *              Build: see ExternalFlashTest.h, with an EXTERNAL_FLASH_WEAR_MAP entry EXTERNAL_FLASH_WEAR_TEST_ID on the
+ *              simulated chip, without linking ExternalFlashWear.c.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "ExternalFlashTest.h"
+
+#include "../ExternalFlashWear.c"
+
+#include <stdlib.h>
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Volume under test
+#ifndef EXTERNAL_FLASH_WEAR_TEST_ID
+#define EXTERNAL_FLASH_WEAR_TEST_ID                 (0)
+#endif
+
+
+//! Largest volume
+#define EXTERNAL_FLASH_WEAR_TEST_VOLUME_SIZE        (EXTERNAL_FLASH_WEAR_MAX_POOL_PAGES * EXTERNAL_FLASH_WEAR_DATA_SIZE)
+
+//! Rewrites of the same bytes, random writes, points of a write where the power is lost
+#define EXTERNAL_FLASH_WEAR_TEST_REWRITES           (400)
+#define EXTERNAL_FLASH_WEAR_TEST_WRITES             (1000)
+#define EXTERNAL_FLASH_WEAR_TEST_CUTS               (24)
+
+//! Bytes of the hot spot rewritten
+#define EXTERNAL_FLASH_WEAR_TEST_HOT_SIZE           (32)
+
+static uint8_t ExternalFlashWearTest_Model[EXTERNAL_FLASH_WEAR_TEST_VOLUME_SIZE];
+static uint8_t ExternalFlashWearTest_Data[EXTERNAL_FLASH_WEAR_TEST_VOLUME_SIZE];
+static uint8_t ExternalFlashWearTest_Read[EXTERNAL_FLASH_WEAR_TEST_VOLUME_SIZE];
+static uint8_t ExternalFlashWearTest_Image[EXTERNAL_FLASH_TEST_IMAGE_SIZE];
+static uint8_t ExternalFlashWearTest_Base[EXTERNAL_FLASH_TEST_IMAGE_SIZE];
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static void Start(const uint8_t* image);
+static void Restart(void);
+static void Write(uint32_t address, uint16_t size);
+static void ReadAll(void);
+static void WaitIdle(void);
+static BOOL_TYPE IsWorking(void* context);
+static uint32_t GetMaxErases(void);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+int main(void)
+{
+    uint32_t volume_size;
+    uint32_t spare_pages;
+    uint32_t address;
+    uint32_t first_page;
+    uint32_t last_page;
+    uint16_t size;
+    uint64_t start_us;
+    uint64_t write_us;
+    uint32_t outcome[2] = {0, 0};
+    BOOL_TYPE is_old;
+    BOOL_TYPE is_new;
+
+    SYS_ASSERT(EXTERNAL_FLASH_WEAR_TEST_ID < EXTERNAL_FLASH_WEAR_NUM);
+    volume_size = ExternalFlashWear__GetSize(EXTERNAL_FLASH_WEAR_TEST_ID);
+    spare_pages = (uint32_t)ExternalFlashWear_Map[EXTERNAL_FLASH_WEAR_TEST_ID].Pool_Pages - ExternalFlashWear_Map[EXTERNAL_FLASH_WEAR_TEST_ID].Logical_Pages;
+
+    // Fresh chip: the volume reads erased
+    Start(NULL);
+    memset(ExternalFlashWearTest_Model, 0xFF, sizeof(ExternalFlashWearTest_Model));
+    ReadAll();
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashWear__Write(EXTERNAL_FLASH_WEAR_TEST_ID, ExternalFlashWearTest_Data, volume_size - 1, 2) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashWear__Read(EXTERNAL_FLASH_WEAR_TEST_ID, ExternalFlashWearTest_Read, 0, 0) == FALSE);
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashWear__Write(EXTERNAL_FLASH_WEAR_NUM, ExternalFlashWearTest_Data, 0, 1) == FALSE);
+
+    // Rewrites of a hot spot: its erases are spread over the free pages of the pool
+    srand(1);
+    for(uint32_t rewrite = 0; rewrite < EXTERNAL_FLASH_WEAR_TEST_REWRITES; rewrite++)
+    {
+        Write(4, EXTERNAL_FLASH_WEAR_TEST_HOT_SIZE);
+    }
+    WaitIdle();
+    EXTERNAL_FLASH_TEST_CHECK(GetMaxErases() <= ((EXTERNAL_FLASH_WEAR_TEST_REWRITES / spare_pages) + 2));
+    ReadAll();
+
+    // Random writes within and across logical pages, checked with mounts from RAM
+    for(uint32_t write = 0; write < EXTERNAL_FLASH_WEAR_TEST_WRITES; write++)
+    {
+        address = (uint32_t)rand() % volume_size;
+        size = (uint16_t)(1 + ((uint32_t)rand() % (((volume_size - address) < 600) ? (volume_size - address) : 600)));
+        Write(address, size);
+
+        if((write % 200) == 199)
+        {
+            ReadAll();
+            WaitIdle();
+            EXTERNAL_FLASH_TEST_RUN(ExternalFlashWear__Mount(EXTERNAL_FLASH_WEAR_TEST_ID));
+            ReadAll();
+        }
+    }
+
+    // Mount after a restart
+    WaitIdle();
+    Restart();
+    ReadAll();
+
+    // Power loss at many points of a write across three logical pages, spread over twice its duration
+    WaitIdle();
+    (void)ExternalFlashTest__Snapshot(ExternalFlashWearTest_Base);
+    address = EXTERNAL_FLASH_WEAR_DATA_SIZE - 10;
+    size = (2 * EXTERNAL_FLASH_WEAR_DATA_SIZE) + 20;
+    first_page = address / EXTERNAL_FLASH_WEAR_DATA_SIZE;
+    last_page = (address + size - 1) / EXTERNAL_FLASH_WEAR_DATA_SIZE;
+    for(uint16_t index = 0; index < size; index++)
+    {
+        ExternalFlashWearTest_Data[address + index] = (uint8_t)~ExternalFlashWearTest_Model[address + index];
+    }
+    start_us = SystemTimersSim__GetUs();
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashWear__Write(EXTERNAL_FLASH_WEAR_TEST_ID, &ExternalFlashWearTest_Data[address], address, size));
+    write_us = SystemTimersSim__GetUs() - start_us;
+    for(uint32_t cut = 0; cut < EXTERNAL_FLASH_WEAR_TEST_CUTS; cut++)
+    {
+        Start(ExternalFlashWearTest_Base);
+        WaitIdle();
+        EXTERNAL_FLASH_TEST_CHECK(ExternalFlashWear__Write(EXTERNAL_FLASH_WEAR_TEST_ID, &ExternalFlashWearTest_Data[address], address, size) == TRUE);
+        ExternalFlashTest__RunFor((uint32_t)((2 * write_us * cut) / (EXTERNAL_FLASH_WEAR_TEST_CUTS - 1)));
+
+        // Each logical page is old or new, the other bytes keep their value
+        Restart();
+        memset(ExternalFlashWearTest_Read, 0, sizeof(ExternalFlashWearTest_Read));
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlashWear__Read(EXTERNAL_FLASH_WEAR_TEST_ID, ExternalFlashWearTest_Read, 0, (uint16_t)volume_size));
+        for(uint32_t page = first_page; page <= last_page; page++)
+        {
+            uint32_t page_address = page * EXTERNAL_FLASH_WEAR_DATA_SIZE;
+
+            is_old = (memcmp(&ExternalFlashWearTest_Read[page_address], &ExternalFlashWearTest_Model[page_address], EXTERNAL_FLASH_WEAR_DATA_SIZE) == 0) ? TRUE : FALSE;
+            for(uint32_t offset = page_address; offset < (page_address + EXTERNAL_FLASH_WEAR_DATA_SIZE); offset++)
+            {
+                ExternalFlashWearTest_Read[offset] ^= ((offset >= address) && (offset < (address + size))) ? 0xFF : 0x00;
+            }
+            is_new = (memcmp(&ExternalFlashWearTest_Read[page_address], &ExternalFlashWearTest_Model[page_address], EXTERNAL_FLASH_WEAR_DATA_SIZE) == 0) ? TRUE : FALSE;
+            EXTERNAL_FLASH_TEST_CHECK((is_old == TRUE) || (is_new == TRUE));
+            outcome[(is_new == TRUE) ? 1 : 0]++;
+            memcpy(&ExternalFlashWearTest_Read[page_address], &ExternalFlashWearTest_Model[page_address], EXTERNAL_FLASH_WEAR_DATA_SIZE);
+        }
+        EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashWearTest_Read, ExternalFlashWearTest_Model, volume_size) == 0);
+
+        // The volume accepts writes again
+        WaitIdle();
+        EXTERNAL_FLASH_TEST_RUN(ExternalFlashWear__Write(EXTERNAL_FLASH_WEAR_TEST_ID, &ExternalFlashWearTest_Model[address], address, size));
+        ReadAll();
+    }
+    EXTERNAL_FLASH_TEST_CHECK((outcome[0] > 0) && (outcome[1] > 0));
+
+    EXTERNAL_FLASH_TEST_CHECK(DataFlashSim__GetStats(EXTERNAL_FLASH_TEST_BUS_CHANNEL)->Protocol_Errors == 0);
+
+    DataFlashSim__Deinitialize();
+    return ExternalFlashTest__Report("ExternalFlashWearTest");
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Starts the driver and the volumes on a chip, mounting the volume under test
+ * @param   image: chip memory, NULL for an erased chip
+ */
+static void Start(const uint8_t* image)
+{
+    (void)ExternalFlashTest__Setup(NULL, image);
+    ExternalFlashWear__Initialize();
+    ExternalFlashWear__RegisterEventHandler(ExternalFlashTest__EventHandler, EXTERNAL_FLASH_WEAR_TEST_ID, CALLBACK_FILTER_VALUE_NONE);
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashWear__Mount(EXTERNAL_FLASH_WEAR_TEST_ID));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_WEAR_EVENT_MOUNTED);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Restarts on the current chip memory, as after a power loss
+ */
+static void Restart(void)
+{
+    (void)ExternalFlashTest__Snapshot(ExternalFlashWearTest_Image);
+    Start(ExternalFlashWearTest_Image);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Writes random bytes and updates the model
+ * @param   address: volume address
+ * @param   size: bytes
+ */
+static void Write(uint32_t address, uint16_t size)
+{
+    for(uint16_t index = 0; index < size; index++)
+    {
+        ExternalFlashWearTest_Data[address + index] = (uint8_t)rand();
+    }
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashWear__Write(EXTERNAL_FLASH_WEAR_TEST_ID, &ExternalFlashWearTest_Data[address], address, size));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_WEAR_EVENT_WRITTEN);
+    memcpy(&ExternalFlashWearTest_Model[address], &ExternalFlashWearTest_Data[address], size);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Reads the whole volume and checks it against the model
+ */
+static void ReadAll(void)
+{
+    uint32_t volume_size = ExternalFlashWear__GetSize(EXTERNAL_FLASH_WEAR_TEST_ID);
+
+    memset(ExternalFlashWearTest_Read, 0, sizeof(ExternalFlashWearTest_Read));
+    EXTERNAL_FLASH_TEST_RUN(ExternalFlashWear__Read(EXTERNAL_FLASH_WEAR_TEST_ID, ExternalFlashWearTest_Read, 0, (uint16_t)volume_size));
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__GetEvent() == EXTERNAL_FLASH_WEAR_EVENT_READ);
+    EXTERNAL_FLASH_TEST_CHECK(memcmp(ExternalFlashWearTest_Read, ExternalFlashWearTest_Model, volume_size) == 0);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs virtual time until the volume has erased its dirty pages
+ */
+static void WaitIdle(void)
+{
+    EXTERNAL_FLASH_TEST_CHECK(ExternalFlashTest__RunWhile(IsWorking, NULL) == TRUE);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Run condition of WaitIdle
+ * @param   context: not used
+ * @return  TRUE until the volume has erased its dirty pages
+ */
+static BOOL_TYPE IsWorking(void* context)
+{
+    (void)context;
+    return ((ExternalFlashWear__IsBusy(EXTERNAL_FLASH_WEAR_TEST_ID) == TRUE) ||
+            (FindPage(EXTERNAL_FLASH_WEAR_TEST_ID, EXTERNAL_FLASH_WEAR_PAGE_DIRTY, 0) != EXTERNAL_FLASH_WEAR_PAGE_NONE)) ? TRUE : FALSE;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Gives the erases of the most worn page of the pool
+ * @return  erase count
+ */
+static uint32_t GetMaxErases(void)
+{
+    uint32_t first_page = ExternalFlashWear_Map[EXTERNAL_FLASH_WEAR_TEST_ID].Pool_Address / EXTERNAL_FLASH_WEAR_PAGE_SIZE;
+    uint32_t max_erases = 0;
+    uint32_t erases;
+    uint32_t programs;
+
+    for(uint16_t page = 0; page < ExternalFlashWear_Map[EXTERNAL_FLASH_WEAR_TEST_ID].Pool_Pages; page++)
+    {
+        DataFlashSim__GetPageWear(EXTERNAL_FLASH_TEST_BUS_CHANNEL, (uint16_t)(first_page + page), &erases, &programs);
+        if(erases > max_erases)
+        {
+            max_erases = erases;
+        }
+    }
+
+    return max_erases;
+}
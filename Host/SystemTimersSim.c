@@ -0,0 +1,355 @@
+/**
+ *  @file       SystemTimersSim.c
+ *
+ *  @brief      Host (Linux) stand-in of the SystemTimers module driven by virtual time.
+ *  @details    Tasks run at their period (or at the time requested through SystemTimers__SetTaskIdxNextCall),
+ *              deferred events run at their due time, and the virtual clock jumps from one to the next.
+ *              When a task and an event are due at the same time the event runs first, like an interrupt would.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+//---------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "SystemTimersSim.h"
+
+//-------------------------------------- PRIVATE (Variables, Constants & Defines) -------------------------------------
+
+//! Task struct type
+typedef struct SYSTEMTIMERSSIM_TASK_STRUCT
+{
+    const char*                 Name;
+    void                        (*Handler)(void);
+    uint32_t                    Period_Us;
+    uint64_t                    Next_Call_Us;
+    uint32_t                    Runs;
+    BOOL_TYPE                   Allocated;
+    BOOL_TYPE                   Suspended;
+    BOOL_TYPE                   Next_Call_Forced;           // Next call set by the task itself while running
+} SYSTEMTIMERSSIM_TASK_TYPE;
+
+//! Timeout handle struct type
+typedef struct SYSTEMTIMERSSIM_HANDLE_STRUCT
+{
+    uint64_t                    Expire_Us;
+    BOOL_TYPE                   Allocated;
+} SYSTEMTIMERSSIM_HANDLE_TYPE;
+
+//! Deferred event struct type
+typedef struct SYSTEMTIMERSSIM_PENDING_EVENT_STRUCT
+{
+    SYSTEMTIMERSSIM_EVENT_TYPE  Event;
+    void*                       Context;
+    uint64_t                    Due_Us;
+    uint32_t                    Sequence;                   // Keeps same-time events in scheduling order
+} SYSTEMTIMERSSIM_PENDING_EVENT_TYPE;
+
+static SYSTEMTIMERSSIM_TASK_TYPE SystemTimersSim_Task[SYSTEMTIMERSSIM_TASK_NUM];
+static SYSTEMTIMERSSIM_HANDLE_TYPE SystemTimersSim_Handle[SYSTEMTIMERSSIM_HANDLE_NUM];
+static SYSTEMTIMERSSIM_PENDING_EVENT_TYPE SystemTimersSim_Event[SYSTEMTIMERSSIM_EVENT_NUM];
+static uint8_t SystemTimersSim_Event_Num;
+static uint32_t SystemTimersSim_Event_Sequence;
+
+//! Virtual time
+static uint64_t SystemTimersSim_Now_Us;
+
+//! Task currently running, INVALID_VALUE_8 if none
+static uint8_t SystemTimersSim_Running_Task = INVALID_VALUE_8;
+
+#define SYSTEMTIMERSSIM_US_PER_MS           (1000)
+
+//-------------------------------------- PRIVATE (Function Prototypes) ------------------------------------------------
+
+static BOOL_TYPE RunNext(uint64_t limit_us);
+
+//=====================================================================================================================
+//-------------------------------------- Public Functions -------------------------------------------------------------
+//=====================================================================================================================
+
+void SystemTimersSim__Initialize(void)
+{
+    memset(SystemTimersSim_Task, 0x00, sizeof(SystemTimersSim_Task));
+    memset(SystemTimersSim_Handle, 0x00, sizeof(SystemTimersSim_Handle));
+    SystemTimersSim_Event_Num = 0;
+    SystemTimersSim_Event_Sequence = 0;
+    SystemTimersSim_Now_Us = 0;
+    SystemTimersSim_Running_Task = INVALID_VALUE_8;
+}
+
+uint64_t SystemTimersSim__GetUs(void)
+{
+    return SystemTimersSim_Now_Us;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Schedules an event to be executed after delay_us of virtual time
+ * @param   delay_us: delay from now
+ * @param   event: function to execute
+ * @param   context: argument passed to the function
+ */
+void SystemTimersSim__ScheduleEvent(uint32_t delay_us, SYSTEMTIMERSSIM_EVENT_TYPE event, void* context)
+{
+    SYS_ASSERT(SystemTimersSim_Event_Num < SYSTEMTIMERSSIM_EVENT_NUM);
+
+    SystemTimersSim_Event[SystemTimersSim_Event_Num].Event = event;
+    SystemTimersSim_Event[SystemTimersSim_Event_Num].Context = context;
+    SystemTimersSim_Event[SystemTimersSim_Event_Num].Due_Us = SystemTimersSim_Now_Us + delay_us;
+    SystemTimersSim_Event[SystemTimersSim_Event_Num].Sequence = SystemTimersSim_Event_Sequence++;
+    SystemTimersSim_Event_Num++;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs tasks and events until the virtual time reaches time_us
+ * @param   time_us: absolute virtual time to reach
+ */
+void SystemTimersSim__RunUntil(uint64_t time_us)
+{
+    while(RunNext(time_us) == TRUE)
+    {
+    }
+
+    if(SystemTimersSim_Now_Us < time_us)
+    {
+        SystemTimersSim_Now_Us = time_us;
+    }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Runs tasks and events until a condition is met or timeout_us of virtual time elapsed
+ * @param   condition: stop condition
+ * @param   context: argument passed to the condition
+ * @param   timeout_us: maximum virtual time to run
+ * @return  TRUE if the condition was met, FALSE on timeout
+ */
+BOOL_TYPE SystemTimersSim__RunUntilCondition(SYSTEMTIMERSSIM_CONDITION_TYPE condition, void* context, uint64_t timeout_us)
+{
+    uint64_t limit_us = SystemTimersSim_Now_Us + timeout_us;
+    BOOL_TYPE met = condition(context);
+
+    while((met == FALSE) && (RunNext(limit_us) == TRUE))
+    {
+        met = condition(context);
+    }
+
+    return met;
+}
+
+uint32_t SystemTimersSim__GetTaskRuns(uint8_t task_index)
+{
+    uint32_t runs = 0;
+
+    if(task_index < SYSTEMTIMERSSIM_TASK_NUM)
+    {
+        runs = SystemTimersSim_Task[task_index].Runs;
+    }
+    return runs;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Finds a task by the name given at its creation
+ * @param   name: task name
+ * @return  task index, INVALID_VALUE_8 if not found
+ */
+uint8_t SystemTimersSim__FindTask(const char* name)
+{
+    uint8_t task_index;
+
+    for(task_index = 0; task_index < SYSTEMTIMERSSIM_TASK_NUM; task_index++)
+    {
+        if((SystemTimersSim_Task[task_index].Allocated == TRUE) &&
+           (strcmp(SystemTimersSim_Task[task_index].Name, name) == 0))
+        {
+            break;
+        }
+    }
+
+    if(task_index == SYSTEMTIMERSSIM_TASK_NUM)
+    {
+        task_index = INVALID_VALUE_8;
+    }
+    return task_index;
+}
+
+//=====================================================================================================================
+//-------------------------------------- SystemTimers API -------------------------------------------------------------
+//=====================================================================================================================
+
+uint8_t SystemTimers__CreateTask(const char* name, TASK_HANDLER_TYPE handler, uint32_t period, TIMER_UNIT_TYPE unit, BOOL_TYPE suspended)
+{
+    uint8_t task_index;
+
+    for(task_index = 0; task_index < SYSTEMTIMERSSIM_TASK_NUM; task_index++)
+    {
+        if(SystemTimersSim_Task[task_index].Allocated == FALSE)
+        {
+            SystemTimersSim_Task[task_index].Name = name;
+            SystemTimersSim_Task[task_index].Handler = handler;
+            SystemTimersSim_Task[task_index].Period_Us = (unit == TIMER_MS) ? (period * SYSTEMTIMERSSIM_US_PER_MS) :
+                                                                              (period * SYSTEMTIMERSSIM_US_PER_MS * 1000);
+            SystemTimersSim_Task[task_index].Next_Call_Us = SystemTimersSim_Now_Us + SystemTimersSim_Task[task_index].Period_Us;
+            SystemTimersSim_Task[task_index].Runs = 0;
+            SystemTimersSim_Task[task_index].Suspended = suspended;
+            SystemTimersSim_Task[task_index].Next_Call_Forced = FALSE;
+            SystemTimersSim_Task[task_index].Allocated = TRUE;
+            break;
+        }
+    }
+
+    if(task_index == SYSTEMTIMERSSIM_TASK_NUM)
+    {
+        task_index = INVALID_VALUE_8;
+    }
+    return task_index;
+}
+
+void SystemTimers__ResumeTask(uint8_t task_index)
+{
+    if((task_index < SYSTEMTIMERSSIM_TASK_NUM) &&
+       (SystemTimersSim_Task[task_index].Suspended == TRUE))
+    {
+        SystemTimersSim_Task[task_index].Suspended = FALSE;
+        SystemTimersSim_Task[task_index].Next_Call_Us = SystemTimersSim_Now_Us;
+    }
+}
+
+void SystemTimers__SuspendTask(uint8_t task_index)
+{
+    if(task_index < SYSTEMTIMERSSIM_TASK_NUM)
+    {
+        SystemTimersSim_Task[task_index].Suspended = TRUE;
+    }
+}
+
+void SystemTimers__SetTaskIdxNextCall(uint8_t task_index, uint32_t next_call_ms)
+{
+    if(task_index < SYSTEMTIMERSSIM_TASK_NUM)
+    {
+        SystemTimersSim_Task[task_index].Next_Call_Us = SystemTimersSim_Now_Us + ((uint64_t)next_call_ms * SYSTEMTIMERSSIM_US_PER_MS);
+        SystemTimersSim_Task[task_index].Next_Call_Forced = (task_index == SystemTimersSim_Running_Task) ? TRUE : FALSE;
+    }
+}
+
+uint8_t SystemTimers__AllocateHandle(void)
+{
+    uint8_t handle;
+
+    for(handle = 0; handle < SYSTEMTIMERSSIM_HANDLE_NUM; handle++)
+    {
+        if(SystemTimersSim_Handle[handle].Allocated == FALSE)
+        {
+            SystemTimersSim_Handle[handle].Allocated = TRUE;
+            SystemTimersSim_Handle[handle].Expire_Us = SystemTimersSim_Now_Us;
+            break;
+        }
+    }
+
+    if(handle == SYSTEMTIMERSSIM_HANDLE_NUM)
+    {
+        handle = INVALID_VALUE_8;
+    }
+    return handle;
+}
+
+void SystemTimers__SetMs(uint8_t handle, uint32_t time_ms)
+{
+    if(handle < SYSTEMTIMERSSIM_HANDLE_NUM)
+    {
+        SystemTimersSim_Handle[handle].Expire_Us = SystemTimersSim_Now_Us + ((uint64_t)time_ms * SYSTEMTIMERSSIM_US_PER_MS);
+    }
+}
+
+void SystemTimers__ReleaseHandle(uint8_t handle)
+{
+    if(handle < SYSTEMTIMERSSIM_HANDLE_NUM)
+    {
+        SystemTimersSim_Handle[handle].Allocated = FALSE;
+    }
+}
+
+//=====================================================================================================================
+//-------------------------------------- Private Functions ------------------------------------------------------------
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+/**
+ * @brief   Executes the earliest due event or task, advancing the virtual time to it
+ * @param   limit_us: nothing due after this virtual time is executed
+ * @return  TRUE if something was executed, FALSE if nothing is due before limit_us
+ */
+static BOOL_TYPE RunNext(uint64_t limit_us)
+{
+    uint8_t event_index = INVALID_VALUE_8;
+    uint8_t task_index = INVALID_VALUE_8;
+    BOOL_TYPE executed = FALSE;
+
+    // Earliest event
+    for(uint8_t index = 0; index < SystemTimersSim_Event_Num; index++)
+    {
+        if((event_index == INVALID_VALUE_8) ||
+           (SystemTimersSim_Event[index].Due_Us < SystemTimersSim_Event[event_index].Due_Us) ||
+           ((SystemTimersSim_Event[index].Due_Us == SystemTimersSim_Event[event_index].Due_Us) &&
+            (SystemTimersSim_Event[index].Sequence < SystemTimersSim_Event[event_index].Sequence)))
+        {
+            event_index = index;
+        }
+    }
+
+    // Earliest task
+    for(uint8_t index = 0; index < SYSTEMTIMERSSIM_TASK_NUM; index++)
+    {
+        if((SystemTimersSim_Task[index].Allocated == TRUE) &&
+           (SystemTimersSim_Task[index].Suspended == FALSE) &&
+           ((task_index == INVALID_VALUE_8) ||
+            (SystemTimersSim_Task[index].Next_Call_Us < SystemTimersSim_Task[task_index].Next_Call_Us)))
+        {
+            task_index = index;
+        }
+    }
+
+    if((event_index != INVALID_VALUE_8) &&
+       (SystemTimersSim_Event[event_index].Due_Us <= limit_us) &&
+       ((task_index == INVALID_VALUE_8) ||
+        (SystemTimersSim_Event[event_index].Due_Us <= SystemTimersSim_Task[task_index].Next_Call_Us)))
+    {
+        SYSTEMTIMERSSIM_PENDING_EVENT_TYPE pending = SystemTimersSim_Event[event_index];
+
+        // Remove before executing, the event may schedule new ones
+        SystemTimersSim_Event[event_index] = SystemTimersSim_Event[--SystemTimersSim_Event_Num];
+
+        if(pending.Due_Us > SystemTimersSim_Now_Us)
+        {
+            SystemTimersSim_Now_Us = pending.Due_Us;
+        }
+        pending.Event(pending.Context);
+        executed = TRUE;
+    }
+    else if((task_index != INVALID_VALUE_8) &&
+            (SystemTimersSim_Task[task_index].Next_Call_Us <= limit_us))
+    {
+        if(SystemTimersSim_Task[task_index].Next_Call_Us > SystemTimersSim_Now_Us)
+        {
+            SystemTimersSim_Now_Us = SystemTimersSim_Task[task_index].Next_Call_Us;
+        }
+
+        SystemTimersSim_Task[task_index].Next_Call_Forced = FALSE;
+        SystemTimersSim_Running_Task = task_index;
+        SystemTimersSim_Task[task_index].Runs++;
+        SystemTimersSim_Task[task_index].Handler();
+        SystemTimersSim_Running_Task = INVALID_VALUE_8;
+
+        // Reschedule at period unless the task asked for a specific next call
+        if(SystemTimersSim_Task[task_index].Next_Call_Forced == FALSE)
+        {
+            SystemTimersSim_Task[task_index].Next_Call_Us = SystemTimersSim_Now_Us + SystemTimersSim_Task[task_index].Period_Us;
+        }
+        executed = TRUE;
+    }
+
+    return executed;
+}
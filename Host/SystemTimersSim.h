@@ -0,0 +1,42 @@
+/**
+ *  @file       SystemTimersSim.h
+ *
+ *  @brief      Host (Linux) stand-in of the SystemTimers module driven by virtual time.
+ *  @details    Implements the SystemTimers API used by the NV drivers (tasks, timeout handles) on top of a virtual
+ *              microsecond clock, plus a deferred event queue used by simulated peripherals to model interrupts.
+ *              Virtual time only advances inside SystemTimersSim__Run*, so results are fully deterministic.
+ *
+ *  @copyright  Copyright 2023. A-Safe Italia. All rights reserved - CONFIDENTIAL
+ */
+#ifndef SYSTEMTIMERSSIM_H_
+#define SYSTEMTIMERSSIM_H_
+
+//-------------------------------------- Include Files ----------------------------------------------------------------
+
+#include "SystemTimers.h"
+#include "Utilities.h"
+
+//-------------------------------------- PUBLIC (Variables, Constants & Defines) --------------------------------------
+
+//! Maximum number of tasks, timeout handles and pending deferred events
+#define SYSTEMTIMERSSIM_TASK_NUM            (16)
+#define SYSTEMTIMERSSIM_HANDLE_NUM          (16)
+#define SYSTEMTIMERSSIM_EVENT_NUM           (32)
+
+//! Deferred event function type, executed in "interrupt" context when its virtual time is reached
+typedef void (*SYSTEMTIMERSSIM_EVENT_TYPE)(void* context);
+
+//! Run loop stop condition, checked after every executed task or event
+typedef BOOL_TYPE (*SYSTEMTIMERSSIM_CONDITION_TYPE)(void* context);
+
+//-------------------------------------- PUBLIC (Function Prototypes) -------------------------------------------------
+
+void SystemTimersSim__Initialize(void);
+uint64_t SystemTimersSim__GetUs(void);
+void SystemTimersSim__ScheduleEvent(uint32_t delay_us, SYSTEMTIMERSSIM_EVENT_TYPE event, void* context);
+void SystemTimersSim__RunUntil(uint64_t time_us);
+BOOL_TYPE SystemTimersSim__RunUntilCondition(SYSTEMTIMERSSIM_CONDITION_TYPE condition, void* context, uint64_t timeout_us);
+uint32_t SystemTimersSim__GetTaskRuns(uint8_t task_index);
+uint8_t SystemTimersSim__FindTask(const char* name);
+
+#endif /* SYSTEMTIMERSSIM_H_ */